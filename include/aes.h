@@ -0,0 +1,48 @@
+#ifndef AES_H
+#define AES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* AES-128 decryption, for HLS segments encrypted with METHOD=AES-128
+ * (CBC with PKCS#7 padding). The round instructions are used where the
+ * CPU has them (CPU_AES: AES-NI on x86, the ARMv8 Cryptographic Extension
+ * on AArch64, see include/cpu.h); the fallback is the table version of
+ * the equivalent inverse cipher, one 1 KB table with rotations. All of
+ * them share the decryption key schedule aes128_init() computes.
+ *
+ * CBC decryption of a block only needs the ciphertext before it, so the
+ * vector versions work on four blocks at once to keep the unit busy.
+ */
+#define AES_BLOCK 16
+
+typedef struct {
+    uint8_t round_keys[11][AES_BLOCK] __attribute__((aligned(16)));  // In decryption order
+} aes128_t;
+
+void aes128_init(aes128_t *aes, const uint8_t key[AES_BLOCK]);
+
+// CBC-decrypt `blocks` blocks of src into dst (dst may be src). iv is the
+// ciphertext block before src and is left at src's last block, so a
+// stream can be decrypted in any number of calls.
+void aes128_cbc_decrypt(const aes128_t *aes, uint8_t iv[AES_BLOCK], const uint8_t *src, uint8_t *dst,
+                        size_t blocks);
+// The same with the table version, whatever the CPU has
+void aes128_cbc_decrypt_c(const aes128_t *aes, uint8_t iv[AES_BLOCK], const uint8_t *src, uint8_t *dst,
+                          size_t blocks);
+// Kernel check (bin/kernels): decrypt with version i of the round
+// instruction code from now on, i counting from 0, best first. Returns 1
+// when it is in use, 0 when the CPU does not run it and -1 past the last
+// one; *name is the version's name unless -1. Not while other threads
+// decrypt.
+int aes128_use_version(size_t i, const char **name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AES_H
@@ -0,0 +1,76 @@
+#ifndef BIG_ALLOC_H
+#define BIG_ALLOC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocator for large, long-lived buffers: pool frames, DPB images and
+ * segment buffers. From BIG_ALLOC_MIN up a buffer is mapped straight from
+ * the kernel instead of the heap: in explicit huge pages (MAP_HUGETLB)
+ * while the system has some reserved, otherwise BIG_ALLOC_HUGE-aligned and
+ * marked for transparent huge pages, so a 1080p picture takes two TLB
+ * entries instead of hundreds. The pages are faulted in when the buffer is
+ * allocated rather than one by one as the first picture is decoded. Each
+ * step falls back to the next, the last being malloc; ANHELO_HUGEPAGES=0
+ * uses malloc only.
+ *
+ * Buffers are BIG_ALLOC_ALIGN-aligned and not cleared.
+ */
+#define BIG_ALLOC_MIN (256 * 1024)
+#define BIG_ALLOC_HUGE (2 * 1024 * 1024)
+#define BIG_ALLOC_ALIGN 64
+
+// NULL when out of memory
+void *big_alloc(size_t size);
+// Grow keeping the contents (a smaller size keeps the buffer); NULL, with
+// p left as it was, when out of memory. p may be NULL.
+void *big_realloc(void *p, size_t size);
+// NULL ignored
+void big_free(void *p);
+
+/* Memory budget. Every buffer big_alloc() hands out is counted, mapped
+ * pages and header included, so pool frames, DPB images, segment
+ * buffers, packet payloads and the mosaic and preview pictures together
+ * are what the player holds. ANHELO_MEMORY_BUDGET sets a ceiling in
+ * megabytes (default MEMORY_BUDGET_MB, 96 suits 256 MB devices; 0 is
+ * none). Nothing is refused at the ceiling: as the held bytes approach
+ * it the holders back off in steps instead, each level keeping the ones
+ * below it.
+ *
+ *   BIG_PRESSURE_PREFETCH  the HLS fetcher stays one segment ahead and
+ *                          frees the buffers of segments played
+ *   BIG_PRESSURE_DPB       h264bsd sizes the DPBs it activates for the
+ *                          reference and reorder frames the stream needs
+ *                          rather than for its level
+ *   BIG_PRESSURE_RENDITION ABR steps down a rendition and does not climb
+ *
+ * The levels take effect as the buffers are next allocated, so a budget
+ * is a target the player converges to, not a hard limit.
+ */
+#ifndef MEMORY_BUDGET_MB
+#define MEMORY_BUDGET_MB 0
+#endif
+
+typedef enum {
+    BIG_PRESSURE_NONE,
+    BIG_PRESSURE_PREFETCH,      // From 70% of the budget
+    BIG_PRESSURE_DPB,           // From 85%
+    BIG_PRESSURE_RENDITION,     // From 95%
+} big_pressure_t;
+
+// Bytes held in big_alloc() buffers
+size_t big_alloc_held(void);
+// The budget in bytes, 0 for none
+size_t big_alloc_budget(void);
+// Where the held bytes are against the budget; a level reached is reported
+// once on stderr
+big_pressure_t big_alloc_pressure(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BIG_ALLOC_H
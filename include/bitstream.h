@@ -0,0 +1,146 @@
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* MSB-first bit reader shared by the codecs: the MPEG-4 decoder reads
+ * through bit_reader_t, the simple H.264 parser as well, and h264bsd's
+ * strmData_t shows its bits with bits_peek64().
+ *
+ * The reader only keeps a bit index. Every show loads the 8 bytes at the
+ * index in one unaligned big-endian load, shifted by the bit offset and
+ * completed from the ninth byte, so there is no cache to refill and up to
+ * 64 bits can be shown at once. Only the last 8 bytes of a buffer take
+ * the byte-by-byte path. Reads past the end return zeros and bits_left()
+ * goes negative, which the callers check once per macroblock or header
+ * rather than on every read.
+ *
+ * The H.264 parsers take RBSP: emulation prevention bytes are removed
+ * once per NAL unit up front (bits_unescape(), or h264bsd's own
+ * h264bsdExtractNalUnit) rather than looked for on every read.
+ */
+typedef struct {
+    const uint8_t* data;
+    size_t size;        // Bytes
+    size_t index;       // Next bit to read
+} bit_reader_t;
+
+static inline uint64_t bits_load_be64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+// The 64 bits of data[size] from bit `index` on, zeros past the end
+static inline uint64_t bits_peek64(const uint8_t* data, size_t size, size_t index) {
+    size_t byte = index >> 3;
+    unsigned shift = (unsigned)(index & 7);
+    if (byte + 9 <= size)
+        return (bits_load_be64(data + byte) << shift) | (data[byte + 8] >> (8 - shift));
+    uint64_t v = 0;
+    for (size_t i = 0; i < 9; i++) {
+        uint64_t b = byte + i < size ? data[byte + i] : 0;
+        v = i < 8 ? v << 8 | b : (v << shift) | (b >> (8 - shift));
+    }
+    return v;
+}
+
+static inline void init_bits(bit_reader_t* br, const uint8_t* data, size_t size) {
+    br->data = data;
+    br->size = size;
+    br->index = 0;
+}
+
+// Next 64 bits without consuming them
+static inline uint64_t show_bits64(const bit_reader_t* br) {
+    return bits_peek64(br->data, br->size, br->index);
+}
+
+// Next n bits, 1 <= n <= 32, without consuming them
+static inline uint32_t show_bits(const bit_reader_t* br, int n) {
+    return (uint32_t)(show_bits64(br) >> (64 - n));
+}
+
+static inline void skip_bits(bit_reader_t* br, int n) {
+    br->index += (size_t)n;
+}
+
+static inline uint32_t get_bits(bit_reader_t* br, int n) {
+    uint32_t v = show_bits(br, n);
+    br->index += (size_t)n;
+    return v;
+}
+
+static inline int get_bits1(bit_reader_t* br) {
+    return (int)get_bits(br, 1);
+}
+
+// Unsigned Exp-Golomb code. Codes of more than 31 leading zeros are
+// invalid here: UINT32_MAX is returned and the reader is left at the end.
+static inline uint32_t get_ue(bit_reader_t* br) {
+    uint64_t v = show_bits64(br);
+    int zeros = v ? __builtin_clzll(v) : 64;
+    if (zeros > 31) {
+        br->index = br->size * 8;
+        return UINT32_MAX;
+    }
+    int length = 2 * zeros + 1;
+    br->index += (size_t)length;
+    return (uint32_t)(v >> (64 - length)) - 1;
+}
+
+// Signed Exp-Golomb code: 1, -1, 2, -2, ... for code numbers 1, 2, 3, 4, ...
+static inline int32_t get_se(bit_reader_t* br) {
+    uint32_t k = get_ue(br);
+    return k & 1 ? (int32_t)((k >> 1) + 1) : -(int32_t)(k >> 1);
+}
+
+// Position in bits from the start of the buffer
+static inline size_t bits_pos(const bit_reader_t* br) {
+    return br->index;
+}
+
+// Unread bits; negative once the reader went past the end
+static inline long bits_left(const bit_reader_t* br) {
+    return (long)(br->size * 8) - (long)br->index;
+}
+
+static inline void seek_bits(bit_reader_t* br, size_t pos) {
+    br->index = pos;
+}
+
+static inline void align_bits(bit_reader_t* br) {
+    br->index = (br->index + 7) & ~(size_t)7;
+}
+
+// Copy a NAL unit's payload to dst without its emulation prevention bytes
+// (the 0x03 of each 0x000003). dst may be src. Returns the RBSP size.
+static inline size_t bits_unescape(uint8_t* dst, const uint8_t* src, size_t size) {
+    size_t out = 0;
+    int zeros = 0;
+    for (size_t i = 0; i < size; i++) {
+        uint8_t b = src[i];
+        if (zeros >= 2 && b == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        zeros = b ? 0 : zeros + 1;
+        dst[out++] = b;
+    }
+    return out;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BITSTREAM_H
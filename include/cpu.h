@@ -0,0 +1,35 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Instruction set extensions of the CPU the program runs on, detected at
+ * startup (cpuid on x86, the auxiliary vector's HWCAP on ARM). Kernels
+ * with vector versions above the ISA the program was built for keep a
+ * table of them, best first, and use the first one whose features are
+ * all here, so one build runs everywhere and still uses AVX2 where there
+ * is some. ANHELO_CPU_DISABLE, a comma-separated list of the names below
+ * or "all", takes features out to try or work around a version.
+ */
+#define CPU_SSE2   (1u << 0)
+#define CPU_SSSE3  (1u << 1)
+#define CPU_SSE41  (1u << 2)
+#define CPU_AVX2   (1u << 3)    // With the OS saving the YMM registers
+#define CPU_AES    (1u << 4)    // AES round instructions: AES-NI, or ARMv8's on AArch64
+#define CPU_NEON   (1u << 8)
+
+// Detected once, less ANHELO_CPU_DISABLE
+unsigned cpu_features(void);
+
+// The names of these features ("sse2 ssse3 ..."), "none" without any
+void cpu_feature_names(unsigned features, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CPU_H
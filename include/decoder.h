@@ -0,0 +1,113 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Capability flags of a decoder backend
+#define DECODER_CAP_H264     (1u << 0)  // Decodes H.264, one NAL unit per decode() call
+#define DECODER_CAP_MPEG4    (1u << 1)  // Decodes MPEG-4 Part 2, one frame per call
+#define DECODER_CAP_REORDER  (1u << 2)  // Outputs pictures in display order (B-frames)
+
+// Work a decoder may leave out to keep up (decoder_set_skip)
+#define DECODER_SKIP_NONREF_DEBLOCK (1u << 0)  // No deblocking of non-reference pictures
+#define DECODER_SKIP_CONCEAL        (1u << 1)  // Lost macroblocks copied from the reference picture
+
+// Reduced pictures for fast preview output (decoder_set_output)
+#define DECODER_OUTPUT_GRAY    (1u << 0)  // Luma only, chroma planes are flat gray
+#define DECODER_OUTPUT_HALF    (1u << 1)  // Half width and height
+#define DECODER_OUTPUT_QUARTER (1u << 2)  // Quarter width and height
+
+// A decoded YUV 4:2:0 picture. The planes belong to the decoder and stay
+// valid until its next decode(), flush() or destroy(), or while the
+// picture is held (decoder_hold_picture).
+typedef struct {
+    const uint8_t *y, *u, *v;
+    int width;
+    int height;
+    int y_stride;
+    int uv_stride;
+} decoder_picture_t;
+
+// One decoder implementation. Input is never modified, so it may point
+// into shared segment buffers.
+typedef struct {
+    const char *name;
+    unsigned caps;
+    void *(*create)(void);
+    void (*destroy)(void *ctx);
+    // Decode one unit of input (see the DECODER_CAP_* codec flags).
+    // Returns 0 on success, -1 if the unit was rejected.
+    int (*decode)(void *ctx, const uint8_t *data, size_t size);
+    // Take the next decoded picture, in display order. Returns 1 if `pic`
+    // was filled, 0 when none is ready.
+    int (*get_picture)(void *ctx, decoder_picture_t *pic);
+    // End of stream: make pictures held back for reordering available
+    void (*flush)(void *ctx);
+    // Optional: leave out the DECODER_SKIP_* work in `skip` from now on
+    void (*set_skip)(void *ctx, unsigned skip);
+    // Optional: keep the planes of the picture get_picture() filled last
+    // valid until release_picture() is given the returned handle. Holds
+    // are counted. NULL if the picture can't be held.
+    void *(*hold_picture)(void *ctx);
+    void (*release_picture)(void *ctx, void *handle);
+    // Optional: output pictures as early as the stream allows and keep no
+    // more of them than it needs, from its next sequence on
+    void (*set_low_latency)(void *ctx, int on);
+    // Optional: pictures decoded before the next one is output, -1 while
+    // not known (no sequence started)
+    int (*get_delay)(void *ctx);
+    // Optional: don't decode chroma from now on. Chroma stays corrupt
+    // after turning this off until the next keyframe.
+    void (*set_luma_only)(void *ctx, int on);
+    // Optional: macroblocks concealed (lost or corrupt) since create()
+    unsigned long (*concealed_mbs)(void *ctx);
+} decoder_backend_t;
+
+typedef struct decoder decoder_t;
+
+// Built-in backends, in order of preference (NULL-terminated)
+extern const decoder_backend_t *const decoder_backends[];
+
+// Create a decoder for a codec (one DECODER_CAP_* codec flag). `name`
+// picks a backend by name; NULL or an unknown or unsuitable name falls back
+// to the preferred backend for the codec. Returns NULL if none is built in.
+decoder_t *decoder_create(unsigned codec, const char *name);
+void decoder_destroy(decoder_t *dec);
+
+int decoder_decode(decoder_t *dec, const uint8_t *data, size_t size);
+int decoder_get_picture(decoder_t *dec, decoder_picture_t *pic);
+void decoder_flush(decoder_t *dec);
+// Ignored by backends that can't skip work
+void decoder_set_skip(decoder_t *dec, unsigned skip);
+// Zero-copy output: hold the picture last taken with decoder_get_picture()
+// past the next decode() so its planes can be used in place, then release
+// it. Returns NULL if the backend can't, the picture must then be used
+// (or copied) before the next call. Pictures still held when the decoder is
+// destroyed are freed with it.
+void *decoder_hold_picture(decoder_t *dec);
+void decoder_release_picture(decoder_t *dec, void *handle);
+// Low-latency output, ignored by backends without it
+void decoder_set_low_latency(decoder_t *dec, int on);
+// Output delay in pictures; -1 if not known or the backend can't tell
+int decoder_get_delay(decoder_t *dec);
+// Reduce the pictures decoder_get_picture() returns (DECODER_OUTPUT_*
+// flags, 0 for full pictures). Gray pictures skip chroma decoding in
+// backends that can; scaled pictures are box-filtered copies, decoded at
+// full size since later pictures predict from it. Reduced pictures can't
+// be held.
+void decoder_set_output(decoder_t *dec, unsigned output);
+// Macroblocks concealed so far, 0 if the backend doesn't count them
+unsigned long decoder_concealed_mbs(decoder_t *dec);
+
+const decoder_backend_t *decoder_backend(const decoder_t *dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DECODER_H
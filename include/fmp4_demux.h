@@ -0,0 +1,55 @@
+#ifndef FMP4_DEMUX_H
+#define FMP4_DEMUX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Timestamps are converted to this clock (the MPEG-TS one) so both
+// demuxers feed the same presentation clock
+#define FMP4_CLOCK_HZ 90000
+
+// One sample (access unit) of the selected H.264 track. `data` points into
+// the buffer passed to fmp4_demux_parse() and holds NAL units with
+// `nal_length_size`-byte big-endian length prefixes, as stored in the mdat.
+//
+// A sample with `config` set carries the track's SPS/PPS from avcC
+// (re-framed with 4-byte prefixes). It is delivered before the first
+// sample and again whenever the init section changes.
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    int nal_length_size;
+    int64_t pts;          // FMP4_CLOCK_HZ units
+    int64_t dts;
+    bool keyframe;
+    bool config;
+} fmp4_sample_t;
+
+// Return non-zero to stop the current fmp4_demux_parse()
+typedef int (*fmp4_sample_callback_t)(const fmp4_sample_t *sample, void *user_data);
+
+typedef struct fmp4_demux fmp4_demux_t;
+
+fmp4_demux_t *fmp4_demux_create(fmp4_sample_callback_t callback, void *user_data);
+void fmp4_demux_destroy(fmp4_demux_t *mp4);
+
+// True if data starts with a box fMP4 segments begin with (ftyp, styp,
+// moov, moof, sidx, emsg)
+bool fmp4_probe(const uint8_t *data, size_t size);
+
+// Parse a buffer of whole top-level boxes: an init section (ftyp/moov),
+// media fragments (moof/mdat), or both back to back. Samples are delivered
+// straight out of `data` as each moof is read. Returns the callback's
+// non-zero result, if any.
+int fmp4_demux_parse(fmp4_demux_t *mp4, const uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FMP4_DEMUX_H
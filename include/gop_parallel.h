@@ -0,0 +1,54 @@
+#ifndef GOP_PARALLEL_H
+#define GOP_PARALLEL_H
+
+#include "decoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* GOP-parallel H.264 decoding, for backlogs and offline work: the stream
+ * is cut at its IDR pictures and each IDR-to-IDR range goes whole to one
+ * of several workers, each on a thread of its own with a decoder of its
+ * own. Nothing after an IDR picture refers to anything before it, so the
+ * ranges decode independently of each other; their pictures are copied
+ * out and handed to the callback in stream order, on the thread feeding
+ * the stream. Throughput grows with the workers as long as IDRs come
+ * often (every segment starts with one on the streams we play), on top of
+ * the decoder's own frame and slice threads. The price is latency and
+ * memory: a range of pictures waits in each worker until the ranges
+ * before it are out.
+ *
+ * Each range starts with the parameter sets seen last before it, so a
+ * stream that sends them once still decodes. A stream with no IDR after
+ * its first picture is one range, on one worker.
+ */
+#define GOP_PARALLEL_MAX_WORKERS 16
+
+typedef struct gop_parallel gop_parallel_t;
+
+// Called with every picture, in display order. The planes are valid
+// until it returns.
+typedef void (*gop_picture_fn)(const decoder_picture_t *pic, void *user);
+
+// `workers` decoders of backend `name` (see decoder_create(); 0 workers =
+// one per CPU). NULL when out of memory or no H.264 decoder is built in.
+gop_parallel_t *gop_parallel_create(const char *name, int workers, gop_picture_fn fn, void *user);
+// Reduced pictures (DECODER_OUTPUT_* flags), set before the first decode
+void gop_parallel_set_output(gop_parallel_t *g, unsigned output);
+// Feed one NAL unit. Blocks while every worker has a range waiting to be
+// handed on, handing on those that are done. Returns -1 when out of memory.
+int gop_parallel_decode(gop_parallel_t *g, const uint8_t *data, size_t size);
+// End of stream: decode everything fed and hand on its pictures
+void gop_parallel_flush(gop_parallel_t *g);
+void gop_parallel_destroy(gop_parallel_t *g);
+const decoder_backend_t *gop_parallel_backend(const gop_parallel_t *g);
+// Ranges handed on so far, and how many of them had slices but gave no
+// picture (bench -v)
+void gop_parallel_stats(const gop_parallel_t *g, unsigned long *ranges, unsigned long *empty);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GOP_PARALLEL_H
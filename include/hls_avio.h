@@ -0,0 +1,46 @@
+#ifndef HLS_AVIO_H
+#define HLS_AVIO_H
+
+#include <libavformat/avio.h>
+
+#include "hls_demuxer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* HLS for libavformat (FFmpeg builds only): the demuxer's fetcher runs the
+ * stream, with its prefetch queue, connection reuse, Twitch prefetch
+ * segments and fast start, and an AVIOContext reads the segments one after
+ * the other. FFmpeg then only demuxes the TS it is given and decodes.
+ *
+ * A thread of its own runs hls_process_stream_chunked() and copies the
+ * chunks into a ring of HLS_AVIO_CHUNKS slots that libavformat's reads
+ * empty; the fetcher waits while the ring is full.
+ */
+#define HLS_AVIO_CHUNKS 64
+#define HLS_AVIO_BUFFER (64 * 1024)  // AVIOContext buffer
+#define HLS_AVIO_POLL_MS 50          // Reads look for hls_avio_close() this often
+
+typedef struct hls_avio hls_avio_t;
+
+// Start playing `url` on `demuxer`, set up as for hls_process_stream().
+// Returns NULL if the thread or the context could not be created.
+hls_avio_t *hls_avio_open(hls_demuxer_t *demuxer, const char *url);
+
+// Non-seekable context reading the stream, for AVFormatContext.pb (with
+// AVFMT_FLAG_CUSTOM_IO); it stays hls_avio_t's. Reads return AVERROR_EOF
+// once the stream ended and AVERROR_EXIT after hls_avio_close().
+AVIOContext *hls_avio_context(hls_avio_t *avio);
+
+// How the stream ended, HLS_OK while it runs
+hls_error_t hls_avio_error(hls_avio_t *avio);
+
+// Stop the fetcher and free everything. Close the AVFormatContext first.
+void hls_avio_close(hls_avio_t *avio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HLS_AVIO_H
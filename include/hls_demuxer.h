@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,31 +21,122 @@ typedef enum {
 typedef struct {
     char *url;
     double duration;
-    bool is_key_segment;
-    char *key_url;
-    char *key_iv;
+    bool is_key_segment;  // Encrypted (#EXT-X-KEY with a METHOD other than NONE)
+    char *key_url;     // AES-128 key URI, NULL for a method we cannot decrypt
+    char *key_iv;      // IV attribute as listed (0x...), NULL to use the media sequence number
+    bool is_prefetch;  // #EXT-X-TWITCH-PREFETCH: still being produced upstream
+    char *map_url;     // #EXT-X-MAP URI in effect (fMP4 init section), NULL for TS
+    double program_date_time;  // Wall clock of its first sample, Unix seconds, from the last
+                               // #EXT-X-PROGRAM-DATE-TIME and the durations since (0 if none)
 } hls_segment_t;
 
-// Playlist structure
+// Master playlist rendition (#EXT-X-STREAM-INF)
+typedef struct {
+    char *url;                // As listed, relative to the master playlist
+    long bandwidth;           // BANDWIDTH, bits per second
+    long average_bandwidth;   // AVERAGE-BANDWIDTH (0 if absent)
+    int width, height;        // RESOLUTION (0 if absent)
+    double frame_rate;        // FRAME-RATE (0 if absent)
+    char *codecs;             // CODECS (NULL if absent)
+} hls_variant_t;
+
+// Low-Latency HLS partial segment (#EXT-X-PART)
 typedef struct {
+    char *url;
+    double duration;
+    bool independent;
+    long msn;          // Media sequence number of the parent segment
+    int index;         // Position within the parent segment
+} hls_part_t;
+
+struct memory_pool;
+
+// Playlist structure. All strings live in the playlist's arena and stay
+// valid until the next reset/parse or hls_playlist_destroy().
+typedef struct {
+    struct memory_pool *arena;
     hls_playlist_type_t type;
     char *base_url;
     hls_segment_t *segments;
     size_t segment_count;
     size_t segment_capacity;
-    char **variants;  // For master playlists
-    size_t variant_count;
+    size_t prefetch_count;   // Trailing segments[] entries that are prefetch hints
+    hls_variant_t *variants;  // Master playlists: ascending bandwidth, only
+    size_t variant_count;     // renditions our decoders can play
+    size_t variant_capacity;
+    double target_duration;  // #EXT-X-TARGETDURATION in seconds (0 if absent)
+    bool ended;              // #EXT-X-ENDLIST seen, no more reloads needed
+    long media_sequence;     // #EXT-X-MEDIA-SEQUENCE (msn of segments[0])
+    // Low-Latency HLS
+    double part_target;      // #EXT-X-PART-INF PART-TARGET (0 if not LL-HLS)
+    bool can_block_reload;   // #EXT-X-SERVER-CONTROL CAN-BLOCK-RELOAD=YES
+    double part_hold_back;   // #EXT-X-SERVER-CONTROL PART-HOLD-BACK
+    double can_skip_until;   // #EXT-X-SERVER-CONTROL CAN-SKIP-UNTIL, seconds (0 = no delta updates)
+    hls_part_t *parts;       // Parts in playlist order, including those of
+    size_t part_count;       // the in-progress segment after segments[]
+    size_t part_capacity;
+    char *preload_hint_url;  // #EXT-X-PRELOAD-HINT TYPE=PART (the next part)
+    char *map_url;           // Last #EXT-X-MAP URI (applies to the parts after segments[])
+    bool encrypted;          // Last #EXT-X-KEY, in effect for the segments that follow
+    char *key_url;
+    char *key_iv;
 } hls_playlist_t;
 
-// Callback for segment data
+// Callback for segment data. While playback is paused it is called with
+// size 0 about every 50 ms so the application can keep handling input.
+// fMP4 segments arrive with their #EXT-X-MAP init section in front, so
+// every segment can be decoded on its own.
 typedef int (*hls_segment_callback_t)(const unsigned char *data, size_t size, void *user_data);
 
+// Streaming delivery: chunks are multiples of HLS_CHUNK_ALIGN (one TS packet)
+// except possibly the last chunk of a segment. Data is only valid during the
+// call. A non-zero return stops the stream, as with hls_segment_callback_t,
+// and the same size-0 ticks arrive (with no flags) while paused.
+#define HLS_CHUNK_ALIGN 188
+#define HLS_CHUNK_SEGMENT_START 0x1  // First chunk of a new segment
+#define HLS_CHUNK_SEGMENT_END   0x2  // Last chunk of the segment (may be empty)
+#define HLS_CHUNK_TRUNCATED     0x4  // Download failed; segment data is incomplete
+typedef int (*hls_chunk_callback_t)(const unsigned char *data, size_t size, unsigned flags, void *user_data);
+
+// Playback latency, updated as each live segment starts. Read it from the
+// stream callback.
+typedef struct {
+    double latency;             // Seconds from the segment being played to the live edge
+    long segments_behind;       // The same, in segments
+    unsigned catchups;          // Times playback skipped ahead to catch up
+    unsigned segments_skipped;  // Segments left unplayed by those skips
+    // The segment being delivered (0 when unknown, or played from the
+    // timeshift ring)
+    double program_date_time;   // Wall clock of its first sample, Unix seconds
+    uint64_t downloaded_us;     // CLOCK_MONOTONIC microseconds its download completed
+    // Measured by the consumer, see hls_report_latency() (0 = unknown)
+    double live_latency;        // Seconds from a picture's program date-time to it being shown
+    double present_delay;       // Seconds from its segment's download to it being shown
+} hls_stats_t;
+
 // Main demuxer context
 typedef struct {
     char *user_agent;
     long timeout_ms;
     hls_segment_callback_t segment_callback;
     void *callback_user_data;
+    void *curl_handle;  // Persistent CURL easy handle on the process-wide share (net.h)
+    size_t prefetch_depth;      // Segments the fetcher may download ahead of the callback
+    size_t prefetch_max_bytes;  // Fetcher pauses once this many bytes are queued
+    void *fetch_queue;          // Active prefetch queue while hls_process_stream runs
+    void *abr;                  // Adaptive bitrate state while hls_process_stream runs
+    size_t live_start_segments; // On join, start this many segments before the live edge (0 = oldest listed)
+    bool fast_start;            // First join: start at the newest segment instead
+    size_t catchup_segments;    // Skip back to live_start_segments once this far behind (0 = never)
+    hls_stats_t stats;
+    size_t timeshift_bytes;     // Size of the on-disk timeshift ring (0 = off)
+    const char *timeshift_dir;  // Where to put the ring file (NULL = $TMPDIR, else /var/tmp)
+    void *timeshift;            // Timeshift state while hls_process_stream runs
+    uint64_t fetch_cpus;        // CPUs the fetcher thread is pinned to (0 = any, see pipeline.h)
+    void *capture;              // Capture or replay of the transfers (NULL = plain network)
+    bool unpooled;              // Fetching alongside other demuxers: no shared connections (net.h)
+    size_t range_parts;         // Connections a segment may be split over when one is too slow (< 2 = never, the default)
+    const struct hls_primed *primed;  // Played first by the next hls_process_stream(), see hls_prime()
 } hls_demuxer_t;
 
 // Error codes
@@ -62,18 +154,105 @@ void hls_demuxer_destroy(hls_demuxer_t *demuxer);
 
 // Playlist management
 hls_playlist_t* hls_playlist_create(void);
+void hls_playlist_reset(hls_playlist_t *playlist);  // Empty it, keeping its memory
 void hls_playlist_destroy(hls_playlist_t *playlist);
 
 // Parsing functions
 hls_error_t hls_parse_playlist(hls_demuxer_t *demuxer, const char *url, hls_playlist_t *playlist);
 hls_error_t hls_parse_playlist_from_memory(hls_demuxer_t *demuxer, const char *data, size_t len, const char *base_url, hls_playlist_t *playlist);
+// Playlist delta update (the response to an _HLS_skip=YES reload): an
+// #EXT-X-SKIP stands for segments `previous`, the playlist as last loaded,
+// already lists. Those are copied over, so `playlist` (another object than
+// `previous`) ends up as the full playlist. HLS_ERROR_PARSE if `previous`
+// lacks any of them; the full playlist has to be loaded then. A response
+// without #EXT-X-SKIP parses as hls_parse_playlist_from_memory() does.
+hls_error_t hls_parse_playlist_delta(hls_demuxer_t *demuxer, const char *data, size_t len, const char *base_url,
+                                     const hls_playlist_t *previous, hls_playlist_t *playlist);
 
 // Stream processing
 hls_error_t hls_process_stream(hls_demuxer_t *demuxer, const char *playlist_url, hls_segment_callback_t callback, void *user_data);
+hls_error_t hls_process_stream_chunked(hls_demuxer_t *demuxer, const char *playlist_url, hls_chunk_callback_t callback, void *user_data);
+
+// Preview of a stream: fetch the playlist (the lightest video rendition of
+// a master) and only its newest complete segment, handed to the callback
+// in chunks as it downloads. A non-zero return ends the download early, as
+// soon as the callback has the picture it was after, and is not an error.
+// *ended (may be NULL) tells whether the playlist has #EXT-X-ENDLIST, so a
+// later fetch would get the same segment.
+hls_error_t hls_fetch_preview(hls_demuxer_t *demuxer, const char *playlist_url, hls_segment_callback_t callback,
+                              void *user_data, bool *ended);
+
+// Warm standby for channel switching: hls_prime() fetches the newest
+// complete segment of a live stream ahead of playing it, as
+// hls_fetch_preview() picks it (with its init section, decrypted). Set as
+// demuxer->primed, the next hls_process_stream() of that playlist URL plays
+// that segment at once and fetches on from the one after it, so the
+// stream starts without waiting for a playlist and a segment download.
+typedef struct hls_primed {
+    char *playlist_url;         // Stream it is a segment of (NULL = none)
+    unsigned char *data;        // The segment, as the segment callback gets it
+    size_t size;
+    long msn;                   // Its media sequence number
+    double duration;
+    double program_date_time;   // Unix seconds (0 if unknown)
+    double target_duration;     // Of its playlist, how soon it is stale
+    uint64_t fetched_us;        // CLOCK_MONOTONIC when the download completed
+    bool ended;                 // The playlist has #EXT-X-ENDLIST
+} hls_primed_t;
+
+hls_error_t hls_prime(hls_demuxer_t *demuxer, const char *playlist_url, hls_primed_t *primed);
+void hls_primed_clear(hls_primed_t *primed);
+
+// Adaptive bitrate feedback from the stream callback: `frames` were decoded
+// and shown in `busy_seconds` of work (excluding frame-pacing sleeps). Only
+// used when the stream was opened from a master playlist.
+void hls_report_decode_stats(hls_demuxer_t *demuxer, unsigned frames, double busy_seconds);
+
+// Latency feedback from the stream callback, for the pictures shown last:
+// glass-to-glass from the program date-time, and from the segment download
+// (0 = unknown). Catching up counts pictures shown later than the playlist
+// position tells.
+void hls_report_latency(hls_demuxer_t *demuxer, double live_latency, double present_delay);
+
+// Ask the fetcher to drop its backlog position and rejoin live_start_segments
+// from the live edge on the next playlist reload. Safe to call from the
+// stream callback.
+void hls_jump_to_live_edge(hls_demuxer_t *demuxer);
+
+// Timeshift: played segments are recorded into a memory-mapped ring file of
+// timeshift_bytes, and recorded segments are handed to the callback straight
+// from the mapping. All of these may be called from any thread while the
+// stream runs and take effect at the next segment boundary.
+
+// Pause or resume. Recording continues while paused; playback resumes where
+// it stopped, behind live (hls_jump_to_live_edge() catches up).
+void hls_timeshift_pause(hls_demuxer_t *demuxer, bool paused);
+// Replay from `seconds` before the newest recorded segment (0 = back to live)
+void hls_timeshift_rewind(hls_demuxer_t *demuxer, double seconds);
+// Seconds of recording still to play before playback is live again
+double hls_timeshift_behind_live(hls_demuxer_t *demuxer);
+
+// Capture and replay, for runs that can be repeated: hls_capture_start()
+// records every playlist and segment the demuxer fetches from now on, each
+// with when it was fetched and how long it took, into directory dir.
+// hls_replay_start() answers the demuxer's fetches from such a directory
+// instead of the network, in real time (responses come when, and as fast
+// as, they did) or at max speed (at once, playlist reloads do not wait and
+// playback does not skip ahead). The last recorded playlist ends the
+// stream. hls_replay_url() is the URL playback started from.
+typedef enum {
+    HLS_REPLAY_REALTIME,
+    HLS_REPLAY_MAX_SPEED
+} hls_replay_speed_t;
+
+hls_error_t hls_capture_start(hls_demuxer_t *demuxer, const char *dir);
+hls_error_t hls_replay_start(hls_demuxer_t *demuxer, const char *dir, hls_replay_speed_t speed);
+const char *hls_replay_url(const hls_demuxer_t *demuxer);
 
 // Utility functions
 const char* hls_get_error_string(hls_error_t error);
 bool hls_is_master_playlist(const char *data, size_t len);
+bool hls_codecs_playable(const char *codecs);
 char* hls_resolve_url(const char *base_url, const char *relative_url);
 
 #ifdef __cplusplus
@@ -0,0 +1,62 @@
+#ifndef HWACCEL_H
+#define HWACCEL_H
+
+#include <libavcodec/avcodec.h>
+
+#include "decoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hardware decoding for the libavcodec paths (FFmpeg builds only): the
+ * FFmpeg player in main.c and the "ffmpeg" decoder backend.
+ *
+ * ANHELO_HWACCEL names an FFmpeg device type (vaapi, vdpau, cuda, ...),
+ * "auto" takes the first the codec and the machine have, unset or 0
+ * decodes in software. ANHELO_HWACCEL_DEVICE picks the device (e.g.
+ * /dev/dri/renderD129) when there are several. Streams the device can't
+ * decode fall back to software through get_format.
+ *
+ * Frames stay in GPU surfaces through decoding and reordering. VAAPI_GLX
+ * builds open VAAPI devices on the X display of the OpenGL output's GLX
+ * context: the surfaces shown are put into an X pixmap that the output
+ * binds as a texture (hwaccel_put_pixmap, video_draw_pixmap), scaled and
+ * converted to RGB by the GPU, and never reach system memory. Other
+ * devices and outputs download the surfaces shown, as YUV 4:2:0 that the
+ * outputs upload as textures and convert themselves (video_draw_yuv).
+ * Drivers only offering NV12 for that cost a pass of the CPU over the
+ * chroma of each picture shown, to split it into U and V planes
+ * (hwaccel_picture).
+ */
+typedef struct hwaccel hwaccel_t;
+
+// Set up hardware decoding on `ctx` before avcodec_open2(). Returns NULL
+// when not asked for or no device could be opened (software decoding).
+// Free with hwaccel_destroy() after the codec context.
+hwaccel_t *hwaccel_attach(AVCodecContext *ctx, const AVCodec *codec, const char *name);
+void hwaccel_destroy(hwaccel_t *hw);
+
+// The frame in system memory: downloaded from its surface when it has one
+// (into a frame of hw's, valid until the next call), else `frame` itself.
+// NULL if the download failed. `hw` may be NULL.
+const AVFrame *hwaccel_download(hwaccel_t *hw, const AVFrame *frame);
+
+// VAAPI_GLX builds: put the frame's surface into X pixmap `pixmap` of the
+// display the device was opened on, scaled to width x height and
+// converted to RGB (vaPutSurface). Returns 0 when done, -1 when the frame
+// is not a surface of a device on the OpenGL output's display (then to be
+// downloaded) or the put failed. Fits video_draw_pixmap()'s put callback
+// once bound to hw and the frame. `hw` may be NULL.
+int hwaccel_put_pixmap(hwaccel_t *hw, const AVFrame *frame, unsigned long pixmap, int width, int height);
+
+// Planar YUV 4:2:0 planes of a frame in system memory; NV12 is split into
+// a buffer of hw's (valid until the next call). Returns 1 when the planes
+// are the frame's own, 0 when they are a copy, -1 for other formats.
+int hwaccel_picture(hwaccel_t *hw, const AVFrame *frame, decoder_picture_t *pic);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HWACCEL_H
@@ -2,40 +2,98 @@
 #define MEMORY_POOL_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
+/* Arena: allocations are bumped off the current block and only given back
+ * all together, by pool_reset() or by rewinding to a pool_mark() taken
+ * earlier (a scope). Blocks are kept for the next round, so a pool that
+ * reached its working size stops calling malloc. When the current block is
+ * full the next one, left empty by a reset or rewind, is reused if the
+ * allocation fits; otherwise a new block is chained in after the current
+ * one. A pool belongs to one thread; pool_thread() is the calling thread's
+ * scratch arena.
+ */
 #define POOL_BLOCK_SIZE 8192  // 8KB blocks
-#define FRAME_POOL_SIZE 4     // Pool of 4 frames
+#define POOL_ALIGN 16         // pool_alloc(): enough for SSE/NEON loads
+
+typedef struct pool_block pool_block_t;
 
-// Memory pool for small allocations
 typedef struct memory_pool {
-    char *pool;
-    size_t pool_size;
-    size_t used;
-    struct memory_pool *next;
+    pool_block_t *first;
+    pool_block_t *current;      // Being filled; the blocks after it are empty
+    size_t block_size;          // Of chained blocks, unless an allocation needs more
 } memory_pool_t;
 
-// Frame buffer pool
+// Position in a pool to rewind to
 typedef struct {
-    void *frames[FRAME_POOL_SIZE];
-    void *rgb_buffers[FRAME_POOL_SIZE];
-    int available[FRAME_POOL_SIZE];
-    int pool_size;
-#ifndef NO_FFMPEG
-    size_t rgb_sizes[FRAME_POOL_SIZE]; // RGB buffer sizes (FFmpeg mode only)
-#endif
-} frame_pool_t;
+    pool_block_t *block;
+    size_t used;
+} pool_mark_t;
 
 // Memory pool functions
 memory_pool_t *pool_create(size_t initial_size);
+// NULL when out of memory
 void *pool_alloc(memory_pool_t *pool, size_t size);
+// align is a power of two (1 for strings, 64 for cache lines)
+void *pool_alloc_aligned(memory_pool_t *pool, size_t size, size_t align);
+// The first len bytes of s (or up to its end) as a string in the pool
+char *pool_strndup(memory_pool_t *pool, const char *s, size_t len);
+pool_mark_t pool_mark(memory_pool_t *pool);
+// Free everything allocated since the mark was taken
+void pool_rewind(memory_pool_t *pool, pool_mark_t mark);
 void pool_reset(memory_pool_t *pool);
 void pool_destroy(memory_pool_t *pool);
+// The calling thread's arena, created on first use and destroyed when the
+// thread exits. Callers allocate between a pool_mark() and a pool_rewind().
+memory_pool_t *pool_thread(void);
+
+/* Frame pool: picture buffers handed between the decoder, the converter
+ * and the render thread. Frames are reference counted and go back to their
+ * pool with the last frame_unref(), from any thread: taking and returning
+ * one is a compare-and-swap on a lock-free free list. A frame is laid out
+ * for the format and size it is taken for, keeping its memory when that is
+ * large enough, so a geometry change only reallocates frames as they are
+ * taken again. Planes and rows are FRAME_ALIGN-aligned, with FRAME_PADDING
+ * bytes after the last plane for vector code reading past the end.
+ */
+#define FRAME_POOL_MAX 32     // Frames one pool can hand out at once
+#define FRAME_ALIGN 64
+#define FRAME_PADDING 64
+
+typedef enum {
+    FRAME_YUV420,           // Y, U, V planes, chroma at half width and height
+    FRAME_RGB24,            // Packed R, G, B in planes[0]
+    FRAME_BGR24,            // Packed B, G, R
+    FRAME_BGRA32,           // Packed B, G, R, A
+} frame_format_t;
 
-// Frame pool functions
-frame_pool_t *frame_pool_create(int width, int height, int pool_size);
-void *get_frame_from_pool(frame_pool_t *pool);
-void *get_rgb_buffer_from_pool(frame_pool_t *pool, int index);
-void return_frame_to_pool(frame_pool_t *pool, void *frame);
+typedef struct frame_pool frame_pool_t;
+
+typedef struct {
+    frame_format_t format;
+    int width, height;
+    uint8_t *planes[3];     // planes[1] and [2] NULL for packed formats
+    int strides[3];
+    // Owned by the pool
+    frame_pool_t *pool;
+    atomic_int refs;
+    int index;
+    uint8_t *memory;
+    size_t size;            // Of memory
+} frame_t;
+
+// A pool of up to `capacity` frames (at most FRAME_POOL_MAX), allocated as
+// they are first taken. Returns NULL when out of memory.
+frame_pool_t *frame_pool_create(int capacity);
+// Frames still referenced stay valid; the pool is freed with the last one.
 void frame_pool_destroy(frame_pool_t *pool);
 
+// A free frame laid out for format at width x height, with one reference.
+// Returns NULL when every frame is in use or out of memory.
+frame_t *frame_pool_get(frame_pool_t *pool, frame_format_t format, int width, int height);
+void frame_ref(frame_t *frame);
+// Back to the pool with the last reference; NULL is ignored
+void frame_unref(frame_t *frame);
+
 #endif // MEMORY_POOL_H
@@ -0,0 +1,93 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Playback metrics: a histogram per pipeline stage and a few counters,
+ * updated from any thread with relaxed atomic adds (no locks), so
+ * recording costs a few nanoseconds and can stay on in production.
+ *
+ * Histogram buckets are powers of two: bucket 0 holds 0, bucket b values
+ * in [2^(b-1), 2^b). Percentiles are interpolated within their bucket.
+ *
+ * ANHELO_METRICS=<path> appends a JSON line of the last interval to the
+ * file every ANHELO_METRICS_INTERVAL seconds (default 10);
+ * ANHELO_METRICS=udp://host:port sends it as a datagram instead.
+ */
+typedef enum {
+    METRIC_PLAYLIST_FETCH,      // us, playlist reloads (blocking ones left out)
+    METRIC_SEGMENT_DOWNLOAD,    // us
+    METRIC_SEGMENT_KBPS,        // kbit/s of each segment download
+    METRIC_DEMUX,               // us per segment, queueing its packets left out
+    METRIC_DECODE_I,            // us per access unit, by picture type
+    METRIC_DECODE_P,
+    METRIC_DECODE_B,
+    METRIC_CONVERT,             // us per picture, YUV to the output's pixels
+    METRIC_DRAW,                // us per picture, upload and swap
+    METRIC_LATENESS,            // us a picture was shown after its time (0: on time)
+    METRIC_LIVE_LATENCY,        // us from a picture's program date-time to it being shown
+    METRIC_PRESENT_DELAY,       // us from its segment's download to it being shown
+    METRIC_QUEUE_DEPTH,         // Packets and pictures waiting behind the one shown
+    METRIC_STAGES
+} metric_stage_t;
+
+typedef enum {
+    METRIC_FRAMES_DECODED,
+    METRIC_FRAMES_DISPLAYED,
+    METRIC_FRAMES_DROPPED,
+    METRIC_SEGMENTS,
+    METRIC_SEGMENT_BYTES,
+    METRIC_CONCEALED_MBS,       // Lost or corrupt macroblocks concealed by the decoder
+    METRIC_COUNTERS
+} metric_counter_t;
+
+#define METRICS_BUCKETS 32
+
+// A copy of the metrics at one time, or the difference of two
+typedef struct {
+    uint64_t time_us;           // metrics_now_us() when taken
+    struct {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;           // Since the start, also in differences
+        uint64_t buckets[METRICS_BUCKETS];
+    } stages[METRIC_STAGES];
+    uint64_t counters[METRIC_COUNTERS];
+} metrics_snapshot_t;
+
+// Monotonic clock the stages are timed with
+uint64_t metrics_now_us(void);
+
+void metrics_record(metric_stage_t stage, uint64_t value);
+void metrics_count(metric_counter_t counter, uint64_t n);
+
+void metrics_snapshot(metrics_snapshot_t *snapshot);
+// What happened from `from` to `to`
+void metrics_delta(metrics_snapshot_t *delta, const metrics_snapshot_t *to, const metrics_snapshot_t *from);
+// Estimated value below which a fraction q (0..1) of a stage's values lie,
+// 0 without any
+uint64_t metrics_percentile(const metrics_snapshot_t *snapshot, metric_stage_t stage, double q);
+uint64_t metrics_mean(const metrics_snapshot_t *snapshot, metric_stage_t stage);
+
+// The stats overlay's text for the interval `d` (see video_set_osd()):
+// what snprintf() returns
+int metrics_format_overlay(char *buf, size_t size, const metrics_snapshot_t *d);
+
+const char *metrics_stage_name(metric_stage_t stage);
+const char *metrics_counter_name(metric_counter_t counter);
+
+// Start and stop the periodic dump configured by ANHELO_METRICS; nothing
+// without it. Stopping writes the interval not dumped yet.
+void metrics_start(void);
+void metrics_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
@@ -0,0 +1,44 @@
+#ifndef MOSAIC_H
+#define MOSAIC_H
+
+#include "pipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Mosaic playback: several HLS streams played at once in one process and
+ * shown as tiles of one window (bin/app <url> <url>...). Each stream has
+ * a demuxer and a decoder of its own; what one process shares is the
+ * connection cache (net.h), a pool of decode workers and the window, which
+ * shows the newest picture due of every tile with a single swap.
+ *
+ *   fetch    each stream's demuxer fetcher thread, as for one stream
+ *   demux    a thread per stream splits its segments into access units,
+ *            copied into the stream's packet ring (MOSAIC_PACKETS)
+ *   decode   the workers take streams that have packets and room for
+ *            pictures and decode a few packets of each in turn; a stream
+ *            is on one worker at a time, the workers are not tied to a
+ *            stream
+ *   present  the main thread paces every stream by its own PTS clock and
+ *            composes the tiles
+ *
+ * ANHELO_MOSAIC_THREADS sets the number of workers (one per CPU by
+ * default, no more than streams). Pictures much larger than their tile are
+ * output reduced by the decoder (DECODER_OUTPUT_HALF or _QUARTER) unless
+ * ANHELO_DECIMATE gives the factor (1 for full pictures).
+ */
+#define MOSAIC_MAX_STREAMS 16
+#define MOSAIC_PACKETS 32           // Access units demuxed ahead, per stream
+#define MOSAIC_PICTURES 4           // Pictures decoded ahead, per stream
+#define MOSAIC_BATCH 4              // Packets a worker decodes of a stream before the next one
+
+// Play `count` stream URLs until every one ended or the window is closed.
+// Returns 0, or -1 when nothing could be started.
+int mosaic_play(const char *const *urls, int count, const pipeline_config_t *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MOSAIC_H
@@ -0,0 +1,53 @@
+#ifndef NAL_INDEX_H
+#define NAL_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One H.264 NAL unit inside a buffer (start code or length prefix excluded)
+typedef struct {
+    size_t offset;
+    size_t size;
+    uint8_t type;     // nal_unit_type
+    uint8_t ref_idc;  // nal_ref_idc (0 = not used for reference)
+} nal_unit_t;
+
+// NAL units of one buffer, in stream order. The array is kept between
+// builds so a long-lived index stops allocating once it has grown.
+typedef struct {
+    nal_unit_t *units;
+    size_t count;
+    size_t capacity;
+} nal_index_t;
+
+// First 00 00 01 start code in [p, end), or NULL. A four-byte start code
+// is found at its second zero.
+const uint8_t *nal_find_start_code(const uint8_t *p, const uint8_t *end);
+
+// Kernel check (bin/kernels): find start codes with version i of the
+// search loop from now on, i counting from 0 in the order they are tried,
+// best first. Returns 1 when it is in use, 0 when the CPU does not run it
+// and -1 past the last one; *name is the version's name unless -1. Not
+// while other threads search.
+int nal_scan_use_version(size_t i, const char **name);
+
+// Index an Annex-B byte stream in one pass. Trailing zero bytes (the
+// leading zero of a four-byte start code, trailing_zero_8bits) are not
+// part of a unit. Returns the unit count, or -1 if out of memory.
+int nal_index_annexb(nal_index_t *index, const uint8_t *data, size_t size);
+
+// Index NAL units with big-endian length prefixes of `prefix_size` bytes
+// (1-4, as in avcC). Stops at the first length that overruns the buffer.
+int nal_index_length_prefixed(nal_index_t *index, const uint8_t *data, size_t size, int prefix_size);
+
+void nal_index_free(nal_index_t *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NAL_INDEX_H
@@ -0,0 +1,25 @@
+/* Process-wide libcurl state. The resolver and the HLS demuxer attach their
+ * easy handles to one share, so DNS answers, TLS sessions and idle
+ * connections carry over from the Twitch API hosts to the playlist and CDN
+ * hosts that follow. Call curl_global_init() before the first use.
+ */
+#ifndef ANHELO_NET_H
+#define ANHELO_NET_H
+
+#include <curl/curl.h>
+
+/* The shared cache (DNS, TLS sessions, connections), created on first use.
+ * May be NULL if libcurl could not allocate it. */
+CURLSH *net_share(void);
+
+/* A new easy handle attached to net_share(), with signals disabled so it is
+ * safe on any thread. Free with curl_easy_cleanup(). */
+CURL *net_easy_handle(void);
+
+/* The same, on a share of DNS answers and TLS sessions only, for handles
+ * busy at the same time as others (one per mosaic stream): libcurl cannot
+ * hand connections between transfers running concurrently on different
+ * threads, so these keep theirs to themselves. */
+CURL *net_easy_handle_unpooled(void);
+
+#endif
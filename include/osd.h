@@ -0,0 +1,31 @@
+#ifndef OSD_H
+#define OSD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Built-in bitmap font for on-screen text (the stats overlay), so the
+// outputs need no font library. Lines are separated by '\n'.
+#define OSD_GLYPH_WIDTH 5
+#define OSD_GLYPH_HEIGHT 7
+// Room the outputs keep for the text
+#define OSD_TEXT_MAX 1024
+
+// Size in pixels of the box osd_draw() draws the text on
+void osd_measure(const char *text, int scale, int *width, int *height);
+
+// Draw the text on an opaque box with its top left corner at (x, y),
+// clipped to width x height, into pixels of bpp bytes each. Every byte of
+// a pixel is set to fg or bg: grey levels in any RGB order, or luma with
+// bpp 1. Each font pixel is scale x scale pixels.
+void osd_draw(uint8_t *pixels, int stride, int bpp, int width, int height, int x, int y, int scale,
+              const char *text, uint8_t fg, uint8_t bg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OSD_H
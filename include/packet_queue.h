@@ -0,0 +1,64 @@
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef MINIMAL_MEMORY_BUFFERS
+#define PACKET_QUEUE_DEPTH 8
+#else
+#define PACKET_QUEUE_DEPTH 32    // Default: about a second of access units
+#endif
+#define PACKET_QUEUE_MAX 128
+
+// A demuxed packet (access unit, parameter sets, or a marker without
+// data) copied into a queue slot. type and arg are the caller's.
+typedef struct {
+    int type;
+    int arg;
+    int64_t pts;                // 90 kHz
+    uint8_t *data;
+    size_t size;
+    size_t capacity;            // Of data, kept for the next packet in the slot
+} packet_t;
+
+// Single-producer/single-consumer queue of packets between the demuxing
+// and the decoding thread, on an spsc_ring_t. Slot buffers keep their
+// capacity, so once they have grown queueing a packet is a copy.
+typedef struct packet_queue packet_queue_t;
+
+// depth is clamped to 1..PACKET_QUEUE_MAX. Returns NULL when out of memory.
+packet_queue_t *packet_queue_create(int depth);
+void packet_queue_destroy(packet_queue_t *q);
+
+// Producer: copy a packet into the next slot and publish it, waiting while
+// every slot is taken; the time spent waiting is added to *waited_us (may
+// be NULL). Returns -1 once the consumer closed the queue, or when out of
+// memory (the packet is dropped).
+int packet_queue_push(packet_queue_t *q, int type, int arg, int64_t pts, const uint8_t *data, size_t size,
+                      uint64_t *waited_us);
+// Producer: no more packets will come
+void packet_queue_finish(packet_queue_t *q);
+
+// Consumer: the oldest packet, waiting up to timeout_ms for one. Returns
+// the same packet until packet_queue_pop(), NULL on timeout or once the
+// producer finished and every packet was taken.
+packet_t *packet_queue_peek(packet_queue_t *q, int timeout_ms);
+// Consumer: done with the packet packet_queue_peek() returned
+void packet_queue_pop(packet_queue_t *q);
+// Consumer: the producer finished and no packet is left
+int packet_queue_finished(packet_queue_t *q);
+// Consumer: stop taking packets; the producer's pushes fail from now on
+void packet_queue_close(packet_queue_t *q);
+// Any thread: packets queued, the one peeked included
+int packet_queue_count(const packet_queue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PACKET_QUEUE_H
@@ -0,0 +1,65 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* HLS playback runs as a pipeline of stages, each on a thread of its own
+ * by default and connected by bounded queues:
+ *
+ *   fetch    the demuxer's fetcher thread downloads segments into the
+ *            prefetch queue (segment_queue.h)
+ *   demux    TS/fMP4 segments are split into access units, queued as
+ *            packets (packet_queue.h)
+ *   decode   the decoder turns packets into pictures, queued in the
+ *            render queue (render_queue.h)
+ *   convert  the band workers of yuv2rgb_threads convert a picture to the
+ *            output's pixels while the presenting thread waits for them
+ *   present  the main thread, which owns the window, shows pictures at
+ *            their time
+ *
+ * A full queue makes the stage feeding it wait, so a slow stage holds the
+ * ones before it back instead of letting memory grow; an empty one makes
+ * the stage after it sleep. ANHELO_DEMUX_THREAD=0 demuxes on the decoding
+ * thread and ANHELO_DECODE_THREAD=0 (or the older ANHELO_RENDER_THREAD=0)
+ * decodes on the presenting thread. ANHELO_<STAGE>_CPUS, e.g.
+ * ANHELO_DECODE_CPUS=2-3, pins a stage's threads to a list of CPUs.
+ */
+typedef enum {
+    PIPELINE_FETCH,
+    PIPELINE_DEMUX,
+    PIPELINE_DECODE,
+    PIPELINE_CONVERT,
+    PIPELINE_PRESENT,
+    PIPELINE_STAGES
+} pipeline_stage_t;
+
+typedef struct {
+    int threaded[PIPELINE_STAGES];  // Has a thread of its own (fetch, convert and present always do)
+    uint64_t cpus[PIPELINE_STAGES]; // Bit n: may run on CPU n; 0 = anywhere
+} pipeline_config_t;
+
+// The configuration from the environment
+void pipeline_config_load(pipeline_config_t *config);
+
+// A CPU list such as "0,2-3" as a mask of CPUs below 64; 0 for an empty or
+// malformed list
+uint64_t pipeline_parse_cpus(const char *list);
+
+const char *pipeline_stage_name(pipeline_stage_t stage);
+
+// Pin the calling thread to the stage's CPUs and name it after the stage
+void pipeline_enter_stage(const pipeline_config_t *config, pipeline_stage_t stage);
+
+// Pin the calling thread to these CPUs; 0 leaves it as it is. Returns -1
+// when the system refuses.
+int pipeline_pin_thread(uint64_t cpus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIPELINE_H
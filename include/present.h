@@ -0,0 +1,84 @@
+#ifndef PRESENT_H
+#define PRESENT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What happened to the pictures given to present_schedule()
+typedef struct {
+    unsigned long shown;
+    unsigned long early;        // Came before their refresh and waited for it
+    unsigned long late;         // Shown past their time (by over half a refresh)
+    unsigned long dropped;      // Left out: they would have been a frame late
+} present_stats_t;
+
+/* Presentation scheduler: pictures are shown when the monotonic clock
+ * reaches their PTS (90 kHz), measured from an anchor (pts, time) taken at
+ * the first picture. A jump of more than PRESENT_MAX_DRIFT_US either way (a
+ * stream discontinuity, a seek, a stall) re-anchors at the current picture
+ * instead of sleeping or rushing to make it up.
+ *
+ * When drawing waits for the display's refresh (vsync), every picture goes
+ * to the refresh closest to its time. Drawing then starts within the
+ * refresh before that one and the swap does the rest of the waiting, so
+ * the wait is never slept twice. Unless it is given, the refresh interval
+ * is measured from the swaps of a window of pictures: the longest
+ * interval of which they are all close to whole multiples. A swap coming
+ * back a refresh early shows it was a multiple of the real one.
+ *
+ * A picture that could only be shown a frame duration late or more, when
+ * the next one is due, is dropped rather than shown behind time. A picture
+ * is still shown at least every PRESENT_MAX_GAP_US.
+ */
+#define PRESENT_MAX_DRIFT_US 500000
+#define PRESENT_MAX_GAP_US 250000
+
+typedef struct {
+    int64_t anchor_pts;         // TS_NO_TIMESTAMP until the first picture
+    uint64_t anchor_us;
+    int64_t last_pts;           // Of the last picture scheduled
+    uint64_t frame_us;          // Frame duration, from the PTS steps
+    int vsync;                  // Drawing returns at the refresh it is shown at
+    uint64_t refresh_us;        // Refresh interval, 0 while not known
+    int refresh_fixed;          // Given, not measured
+    uint64_t vblank_us;         // Refresh the last picture was shown at, 0 if none
+    uint64_t target_us;         // Refresh the last picture was meant for, 0 if none
+    uint32_t intervals_us[32];  // Swap intervals of this window
+    unsigned intervals;
+    uint64_t shown_us;          // When the last picture was shown, 0 if none
+    present_stats_t stats;
+} present_clock_t;
+
+typedef enum {
+    PRESENT_SHOW,
+    PRESENT_DROP,
+} present_action_t;
+
+// frame_us is the frame duration until the PTS tell it, refresh_us the
+// display's refresh interval (0 to measure it)
+void present_init(present_clock_t *c, uint64_t frame_us, uint64_t refresh_us);
+// Another stream starts (a channel switch): anchor at its first picture,
+// keeping the refresh measurement and the stats
+void present_restart(present_clock_t *c);
+// Whether drawing waits for the refresh (video_vsync())
+void present_set_vsync(present_clock_t *c, int vsync);
+
+// Schedule a picture with this PTS at `now`: when it is shown, drawing
+// starts at *start_us; *late_us is how late (negative: early) it will be
+// shown, or is when dropped.
+present_action_t present_schedule(present_clock_t *c, int64_t pts, uint64_t now,
+                                  uint64_t *start_us, int64_t *late_us);
+// The picture scheduled last was drawn, and shown by `now` with vsync
+void present_shown(present_clock_t *c, uint64_t now);
+
+// Microseconds from PTS b to PTS a (90 kHz), allowing for the 33-bit wrap
+int64_t present_pts_delta_us(int64_t a, int64_t b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PRESENT_H
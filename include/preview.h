@@ -0,0 +1,35 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Preview mode, for browsing channels (ANHELO_PREVIEW=<seconds> bin/app
+ * <url>...): every channel is a still thumbnail on a grid, refreshed every
+ * few seconds, instead of a stream being played. A refresh fetches the
+ * channel's newest segment (hls_fetch_preview()) only until its first IDR
+ * picture is in, decodes the parameter sets and that picture alone, with
+ * the output reduced to the tile (DECODER_OUTPUT_HALF or _QUARTER, from
+ * the size the last refresh found), and drops the decoder again. Between
+ * refreshes a channel holds nothing but its thumbnail and its demuxer's
+ * connection, so dozens of them cost less than one playing stream.
+ *
+ * A few workers (ANHELO_PREVIEW_THREADS, PREVIEW_WORKERS by default)
+ * refresh the channel due soonest in turn; the main thread tiles the new
+ * thumbnails. A channel whose playlist ended is not refreshed again, and
+ * ANHELO_PREVIEW_ROUNDS stops each channel after that many refreshes
+ * (0, the default, browses until the window is closed).
+ */
+#define PREVIEW_MAX_CHANNELS 64
+#define PREVIEW_WORKERS 4
+
+// Show `count` stream URLs as thumbnails refreshed every `interval`
+// seconds. Returns 0, or -1 when nothing could be started.
+int preview_browse(const char *const *urls, int count, double interval);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PREVIEW_H
@@ -0,0 +1,58 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdint.h>
+#include "decoder.h"
+#include "memory_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RENDER_QUEUE_DEPTH 3     // Default pictures decoded ahead of the one shown
+#define RENDER_QUEUE_MAX 8
+
+// A decoded picture copied into a queue frame, with its presentation time
+typedef struct {
+    decoder_picture_t pic;      // Planes of frame
+    frame_t *frame;             // frame_ref() it to keep it past render_queue_pop()
+    int64_t pts;                // 90 kHz
+} render_picture_t;
+
+// Single-producer/single-consumer queue of decoded pictures between the
+// decoding thread and the thread presenting them. The producer copies
+// pictures into frames of the queue's pool, one per slot, handed over
+// by an spsc_ring_t: a side only sleeps, on a semaphore, when the queue
+// is full or empty.
+typedef struct render_queue render_queue_t;
+
+// depth is clamped to 1..RENDER_QUEUE_MAX. Returns NULL when out of memory.
+render_queue_t *render_queue_create(int depth);
+void render_queue_destroy(render_queue_t *q);
+
+// Producer: copy a picture into the next slot and publish it, waiting
+// while every slot is taken; the time spent waiting is added to *waited_us.
+// Returns -1 once the consumer closed the queue, or when out of memory or
+// frames (the picture is dropped).
+int render_queue_push(render_queue_t *q, const decoder_picture_t *pic, int64_t pts, uint64_t *waited_us);
+// Producer: no more pictures will come
+void render_queue_finish(render_queue_t *q);
+
+// Consumer: the oldest picture, waiting up to timeout_ms for one. Returns
+// the same picture until render_queue_pop(), NULL on timeout or once the
+// producer finished and every picture was taken.
+render_picture_t *render_queue_peek(render_queue_t *q, int timeout_ms);
+// Consumer: done with the picture render_queue_peek() returned
+void render_queue_pop(render_queue_t *q);
+// Consumer: the producer finished and no picture is left
+int render_queue_finished(render_queue_t *q);
+// Consumer: stop taking pictures; the producer's pushes fail from now on
+void render_queue_close(render_queue_t *q);
+// Any thread: pictures queued, the one peeked included
+int render_queue_count(const render_queue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RENDER_QUEUE_H
@@ -0,0 +1,65 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Index handling of a single-producer/single-consumer ring of `depth`
+// slots, for queues keeping their slots in an array of their own (see
+// render_queue.h, packet_queue.h). Two semaphores count the free and the
+// ready slots: glibc takes and posts them with a single atomic operation
+// and only sleeps on a futex when the count is zero, so neither side ever
+// takes a lock. Each index is only moved by its own side.
+typedef struct {
+    unsigned depth;
+    atomic_uint head;           // Producer: slots published
+    atomic_uint tail;           // Consumer: slots taken
+    sem_t free_slots;
+    sem_t ready;                // One post per slot, and one for finish
+    atomic_int closed;          // Consumer stopped
+    int peeked;                 // Consumer: ready taken for the tail slot
+    int ended;                  // Consumer: took the finish post
+} spsc_ring_t;
+
+void spsc_ring_init(spsc_ring_t *r, unsigned depth);
+void spsc_ring_destroy(spsc_ring_t *r);
+
+// Producer: wait for a free slot and return its index, adding the time
+// waited to *waited_us (may be NULL). -1 once the consumer closed the ring.
+int spsc_ring_reserve(spsc_ring_t *r, uint64_t *waited_us);
+// Producer: give the reserved slot back unused
+void spsc_ring_cancel(spsc_ring_t *r);
+// Producer: hand the reserved slot to the consumer
+void spsc_ring_publish(spsc_ring_t *r);
+// Producer: nothing more will be published
+void spsc_ring_finish(spsc_ring_t *r);
+
+// Consumer: index of the oldest published slot, waiting up to timeout_ms
+// for one. The same slot until spsc_ring_pop(); -1 on timeout or once the
+// producer finished and every slot was taken.
+int spsc_ring_peek(spsc_ring_t *r, int timeout_ms);
+// Consumer: index of the slot spsc_ring_peek() returned, -1 if none is
+// held
+int spsc_ring_peeked(const spsc_ring_t *r);
+// Consumer: done with the slot spsc_ring_peek() returned; it may be
+// reused as soon as this returns
+void spsc_ring_pop(spsc_ring_t *r);
+// Consumer: the producer finished and no slot is left
+int spsc_ring_finished(const spsc_ring_t *r);
+// Consumer: stop taking slots; the producer's reserves fail from now on
+void spsc_ring_close(spsc_ring_t *r);
+
+// Either side, or any thread: slots published and not taken yet (a
+// snapshot, for statistics)
+unsigned spsc_ring_count(const spsc_ring_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPSC_RING_H
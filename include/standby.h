@@ -0,0 +1,44 @@
+#ifndef STANDBY_H
+#define STANDBY_H
+
+#include "hls_demuxer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Warm standby for channel switching (ANHELO_ZAP=1 bin/app <url>...):
+ * while one channel plays, a thread of its own keeps the channel most
+ * likely to be switched to next fetched ahead with hls_prime(), on a
+ * demuxer of its own, and fetches it again every target duration so it
+ * stays the newest segment. A switch to that channel takes the segment and
+ * plays it from its IDR at once, instead of waiting for the playlist, a
+ * segment and its download.
+ *
+ * The standby's easy handle keeps its connection to the CDN warm, and its
+ * DNS answers and TLS sessions are the player's (net.h); connections are
+ * not shared, libcurl can't hand them between transfers on two threads.
+ */
+#define STANDBY_MAX_CHANNELS 64
+#define STANDBY_RETRY_US 2000000    // After a failed fetch
+#define STANDBY_MIN_REFRESH_US 1000000
+#define STANDBY_MAX_REFRESH_US 10000000
+
+typedef struct standby standby_t;
+
+// Standby over `count` stream URLs (they must outlive it), keeping none
+// ready yet. NULL if the thread could not be started.
+standby_t *standby_create(const char *const *urls, int count);
+// Keep channel `channel` ready from now on (-1 = none)
+void standby_target(standby_t *s, int channel);
+// The segment kept ready for `channel`, when there is one still at the live
+// edge: it is moved into *primed and 1 returned (0 without one)
+int standby_take(standby_t *s, int channel, hls_primed_t *primed);
+// Waits for a fetch in progress
+void standby_destroy(standby_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STANDBY_H
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Event tracer for diagnostics on the hot paths (every NAL unit, PES or
+ * segment), where printf and fflush would cost a synchronous write each.
+ *
+ * Events are compiled in up to TRACE_LEVEL (make TRACE=1..3; DEBUG=1
+ * builds default to 3, release builds to 0): the level of each TRACE_*()
+ * is a constant, so above TRACE_LEVEL the call and its arguments are
+ * gone. An event is a fixed-size binary record put into a ring of the
+ * calling thread, without locks or formatting. A background thread turns
+ * the records into text lines every TRACE_FLUSH_MS, and a crash signal
+ * (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT) writes what is left before
+ * the process dies. When the flusher falls behind a full ring drops new
+ * events, and the number lost is reported.
+ *
+ * Lines go to ANHELO_TRACE=<path> (appended), to stderr without it;
+ * ANHELO_TRACE=0 records nothing.
+ */
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_INFO 2
+#define TRACE_LEVEL_DEBUG 3
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL 0
+#endif
+
+#define TRACE_RING_EVENTS 4096      // Per thread, a power of two
+#define TRACE_FLUSH_MS 100
+
+// Events and their two values (names in src/trace.c)
+typedef enum {
+    TRACE_NAL,                  // nal_unit_type, bytes
+    TRACE_NAL_ERROR,            // nal_unit_type, bytes: the decoder failed on it
+    TRACE_PARAM_SET,            // nal_unit_type, first 8 bytes
+    TRACE_PES,                  // stream_type, bytes
+    TRACE_SEGMENT,              // segments so far, bytes
+    TRACE_LATENCY,              // packets and pictures queued, us behind the program date-time
+    TRACE_SIMPLE_H264_NAL,      // nal_unit_type, bytes
+    TRACE_SIMPLE_H264_SPS,      // width, height
+    TRACE_SIMPLE_H264_ERROR,    // nal_unit_type, 0: parameter set not parsed or missing
+    TRACE_SIMPLE_H264_FRAME,    // width, height
+    TRACE_EVENTS
+} trace_event_t;
+
+#define TRACE_AT(level, event, a, b) \
+    do { if ((level) <= TRACE_LEVEL) trace_event((event), (uint32_t)(a), (uint64_t)(b)); } while (0)
+#define TRACE_ERROR(event, a, b) TRACE_AT(TRACE_LEVEL_ERROR, event, a, b)
+#define TRACE_INFO(event, a, b) TRACE_AT(TRACE_LEVEL_INFO, event, a, b)
+#define TRACE_DEBUG(event, a, b) TRACE_AT(TRACE_LEVEL_DEBUG, event, a, b)
+
+// Record an event on the calling thread's ring; use the macros above
+void trace_event(trace_event_t event, uint32_t a, uint64_t b);
+
+// Start recording to the output ANHELO_TRACE names, and stop, writing what
+// was recorded. Nothing when built without events.
+void trace_start(void);
+void trace_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
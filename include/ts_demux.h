@@ -0,0 +1,62 @@
+#ifndef TS_DEMUX_H
+#define TS_DEMUX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TS_PACKET_SIZE 188
+
+// PMT stream_type values we care about
+#define TS_STREAM_MPEG4_VIDEO 0x10
+#define TS_STREAM_H264        0x1B
+#define TS_STREAM_HEVC        0x24
+
+// PTS/DTS are in 90 kHz units, 33 bits wide
+#define TS_CLOCK_HZ      90000
+#define TS_NO_TIMESTAMP  (-1)
+
+// One reassembled PES packet of the selected video stream. `data` (the
+// elementary stream bytes, PES header stripped) is only valid during the
+// callback. For H.264 over TS a video PES is one access unit.
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    int pid;
+    uint8_t stream_type;  // From the PMT (0 if the PID was guessed without one)
+    int64_t pts;          // Presentation time (TS_NO_TIMESTAMP if absent)
+    int64_t dts;          // Decode time (the PTS when not sent separately)
+} ts_pes_t;
+
+// Return non-zero to stop the current ts_demux_feed()/ts_demux_flush()
+typedef int (*ts_pes_callback_t)(const ts_pes_t *pes, void *user_data);
+
+typedef struct ts_demux ts_demux_t;
+
+ts_demux_t *ts_demux_create(ts_pes_callback_t callback, void *user_data);
+void ts_demux_destroy(ts_demux_t *ts);
+
+// Feed transport stream bytes. Any length works: a trailing partial packet
+// and a partial PES are kept for the next call, so consecutive HLS segments
+// are fed as one stream. Returns the callback's non-zero result, if any.
+int ts_demux_feed(ts_demux_t *ts, const uint8_t *data, size_t size);
+
+// Deliver the PES still being assembled (its end is otherwise only known
+// when the next one starts), e.g. at the end of the stream
+int ts_demux_flush(ts_demux_t *ts);
+
+// Forget all stream state, e.g. before switching to an unrelated stream
+void ts_demux_reset(ts_demux_t *ts);
+
+// Video PID in use (-1 until known)
+int ts_demux_video_pid(const ts_demux_t *ts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TS_DEMUX_H
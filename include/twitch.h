@@ -7,4 +7,21 @@
 
 char *twitch_resolve(const char *input);
 
+/* Like twitch_resolve(), but returns the master playlist URL listing every
+ * rendition instead of picking the lowest one. */
+char *twitch_resolve_master(const char *input);
+
+/* Resolved URLs are cached per channel under $XDG_CACHE_HOME/anhelo (or
+ * ~/.cache/anhelo) until the access token expires. Drop the channel's entry,
+ * e.g. after its cached URL failed to play. */
+void twitch_cache_forget(const char *input);
+
+/* Start connecting to the Twitch API hosts in the background (DNS + TLS),
+ * e.g. while the channel name is being entered. Resolves that follow reuse
+ * the warm connections. Safe to call more than once; it is only ever a hint. */
+void twitch_prewarm(void);
+
+/* Block until a pending twitch_prewarm() has finished. Call before exit. */
+void twitch_prewarm_wait(void);
+
 #endif
@@ -3,6 +3,7 @@
 #define VIDEO_H
 
 #include <stdint.h>
+#include "yuv2rgb.h"
 
 typedef struct video_t video_t;
 
@@ -12,10 +13,78 @@ video_t *video_create(int width, int height);
 // draw a RGB24 buffer (linesize bytes per row)
 void video_draw(video_t *v, const uint8_t *rgb, int linesize);
 
-// poll events, returns 0 to continue, non-zero to quit
+// pixel layout the output stores; pictures converted to it are drawn
+// without another pass over the pixels
+yuv2rgb_format_t video_pixel_format(video_t *v);
+
+// draw a buffer in video_pixel_format() (linesize bytes per row)
+void video_draw_native(video_t *v, const uint8_t *pixels, int linesize);
+
+// the output's own pixels for the picture to be converted into, in
+// video_pixel_format() with linesize bytes per row, at width x height
+// (the picture scaled down when it is larger than the window). NULL when
+// the output has no such access (the caller then uses video_draw_native()).
+// video_unlock_native() shows what was written.
+uint8_t *video_lock_native(video_t *v, int *linesize, int *width, int *height);
+void video_unlock_native(video_t *v);
+
+// draw a YUV 4:2:0 picture of the size given to video_create(), with the
+// output converting it itself (no CPU conversion, half the upload of
+// RGB24). Returns 0 when drawn, -1 when the output has no YUV path: the
+// picture is then to be converted and drawn with video_draw_native().
+int video_draw_yuv(video_t *v, int width, int height,
+                   const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                   int y_stride, int uv_stride);
+
+// draw a picture that put() renders into X pixmap `pixmap` of the window's
+// display at width x height (the displayed size), in RGB, returning 0
+// once done or -1: the GPU scales, converts and shows it without the
+// picture reaching system memory (VAAPI_GLX builds, OpenGL output with
+// GLX_EXT_texture_from_pixmap). Returns 0 when drawn, -1 when the output
+// has no pixmap path or put() failed: the picture is then drawn another
+// way.
+typedef int (*video_put_fn)(unsigned long pixmap, int width, int height, void *user);
+int video_draw_pixmap(video_t *v, video_put_fn put, void *user);
+
+// non-zero when drawing waits for the display's refresh and returns once
+// the picture is shown
+int video_vsync(video_t *v);
+
+// poll events, returns 0 to continue, non-zero to quit. The I key shows
+// and hides the stats overlay.
 int video_poll(video_t *v);
 
+// channel key seen by video_poll() since the last call: -1 for Page Up or
+// the up arrow (previous channel), 1 for Page Down or the down arrow
+// (next), 0 for none
+int video_channel_step(video_t *v);
+
+// whether the stats overlay is shown, and the text (lines separated by
+// '\n', NULL for none) it draws over the top left corner of the pictures
+// from now on
+int video_osd_enabled(video_t *v);
+void video_set_osd(video_t *v, const char *text);
+
 // destroy
 void video_destroy(video_t *v);
 
+// Mosaic output (include/mosaic.h): the window split into a grid of cols x
+// rows cells, each showing the pictures of one tile (numbered row by row)
+// scaled to fit it. NULL when the output can't tile.
+typedef struct video_mosaic_t video_mosaic_t;
+
+video_mosaic_t *video_mosaic_create(int cols, int rows);
+// size of a cell in window pixels
+void video_mosaic_cell_size(video_mosaic_t *m, int *width, int *height);
+// give a tile a new YUV 4:2:0 picture, of any size; it is used before this
+// returns and shown by every video_mosaic_present() until the next one
+void video_mosaic_tile(video_mosaic_t *m, int tile, int width, int height,
+                       const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                       int y_stride, int uv_stride);
+// show every tile's picture at once
+void video_mosaic_present(video_mosaic_t *m);
+// as video_poll()
+int video_mosaic_poll(video_mosaic_t *m);
+void video_mosaic_destroy(video_mosaic_t *m);
+
 #endif
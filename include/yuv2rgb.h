@@ -0,0 +1,98 @@
+#ifndef YUV2RGB_H
+#define YUV2RGB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Packed pixel layouts the conversion writes, in memory byte order
+typedef enum {
+    YUV2RGB_RGB24,      // R, G, B
+    YUV2RGB_BGR24,      // B, G, R
+    YUV2RGB_BGRA32,     // B, G, R, 255
+} yuv2rgb_format_t;
+
+static inline int yuv2rgb_bytes_per_pixel(yuv2rgb_format_t format) {
+    return format == YUV2RGB_BGRA32 ? 4 : 3;
+}
+
+// Convert a YUV 4:2:0 picture to packed pixels of the given format
+// (BT.601, full-range integer approximation). Uses the widest vector
+// code the CPU runs; every path gives the same pixels.
+void yuv420_to_rgb(yuv2rgb_format_t format, int width, int height,
+                   const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                   int y_stride, int u_stride, int v_stride,
+                   uint8_t *dst, int dst_stride);
+
+// Kernel check (bin/kernels): convert with version i of the vector code
+// from now on, i counting from 0 in the order they are tried, best first.
+// Returns 1 when it is in use, 0 when the CPU does not run it and -1 past
+// the last one; *name is the version's name unless -1. Not while other
+// threads convert.
+int yuv2rgb_use_version(size_t i, const char **name);
+
+// Convert a YUV 4:2:0 picture to packed RGB24
+void yuv420_to_rgb24(int width, int height,
+                     const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                     int y_stride, int u_stride, int v_stride,
+                     uint8_t *rgb, int rgb_stride);
+
+// Sampling of yuv420_to_rgb_scaled()
+typedef enum {
+    YUV2RGB_NEAREST,
+    YUV2RGB_BILINEAR,
+} yuv2rgb_filter_t;
+
+// Convert a YUV 4:2:0 picture straight to dst_width x dst_height packed
+// pixels: each plane is sampled at the output size a row at a time, and
+// only those samples are converted. Returns -1 when out of memory.
+int yuv420_to_rgb_scaled(yuv2rgb_format_t format, yuv2rgb_filter_t filter, int width, int height,
+                         const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                         int y_stride, int u_stride, int v_stride,
+                         uint8_t *dst, int dst_width, int dst_height, int dst_stride);
+
+// Output rows [first_row, first_row + rows) of yuv420_to_rgb_scaled(),
+// first_row even; dst is still the start of the whole output
+int yuv420_to_rgb_scaled_rows(yuv2rgb_format_t format, yuv2rgb_filter_t filter, int width, int height,
+                              const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                              int y_stride, int u_stride, int v_stride,
+                              uint8_t *dst, int dst_width, int dst_height, int dst_stride,
+                              int first_row, int rows);
+
+// Pool of threads converting horizontal bands of a picture at once
+typedef struct yuv2rgb_threads yuv2rgb_threads_t;
+
+// Start a pool for this many threads in all, the calling thread being
+// one of them; 0 or less means one per online CPU. Returns NULL for a
+// single thread or when no worker could be started.
+yuv2rgb_threads_t *yuv2rgb_threads_create(int threads);
+void yuv2rgb_threads_destroy(yuv2rgb_threads_t *t);
+// Pin the workers to a mask of CPUs (bit n: CPU n, 0 = any). The calling
+// thread, which converts bands too, is left as it is. Returns -1 when the
+// system refuses.
+int yuv2rgb_threads_pin(yuv2rgb_threads_t *t, uint64_t cpus);
+
+// yuv420_to_rgb() split into bands over the pool's threads, returning once
+// every band is done. Small pictures, and every picture with a NULL pool,
+// are converted on the calling thread alone.
+void yuv420_to_rgb_threaded(yuv2rgb_threads_t *t, yuv2rgb_format_t format, int width, int height,
+                            const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                            int y_stride, int u_stride, int v_stride,
+                            uint8_t *dst, int dst_stride);
+
+// yuv420_to_rgb_scaled() split the same way, by output rows. Bands short
+// of memory are left unconverted.
+int yuv420_to_rgb_scaled_threaded(yuv2rgb_threads_t *t, yuv2rgb_format_t format, yuv2rgb_filter_t filter,
+                                  int width, int height,
+                                  const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                                  int y_stride, int u_stride, int v_stride,
+                                  uint8_t *dst, int dst_width, int dst_height, int dst_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YUV2RGB_H
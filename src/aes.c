@@ -0,0 +1,290 @@
+// AES-128 decryption, see include/aes.h. The version used is the first of
+// decrypt_table (AES-NI on x86, the ARMv8 AES instructions on AArch64)
+// the CPU runs, else the table version. Define AES_NO_SIMD to build the
+// table version only.
+#include "../include/aes.h"
+#include "../include/cpu.h"
+#include <pthread.h>
+#include <string.h>
+
+#if !defined(AES_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AES_X86
+#include <immintrin.h>
+#elif !defined(AES_NO_SIMD) && defined(__aarch64__) && defined(__GNUC__)
+#define AES_ARM
+#include <arm_neon.h>
+#endif
+
+static uint8_t sbox[256], inv_sbox[256];
+static uint32_t td[256];            // InvMixColumns of InvSubBytes, one column; the others are rotations
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static uint8_t xtime(uint8_t x) {
+    return (uint8_t)((x << 1) ^ (x & 0x80 ? 0x1b : 0));
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
+    for (; b; b >>= 1, a = xtime(a))
+        if (b & 1) p ^= a;
+    return p;
+}
+
+static uint8_t rotl8(uint8_t x, int n) {
+    return (uint8_t)(x << n | x >> (8 - n));
+}
+
+static uint32_t ror32(uint32_t x, int n) {
+    return x >> n | x << (32 - n);
+}
+
+static void tables_init(void) {
+    // p runs through the powers of 3, a generator of GF(2^8)*, and q
+    // through its inverses, so q is the inverse of p
+    uint8_t p = 1, q = 1;
+    do {
+        p ^= xtime(p);
+        q ^= (uint8_t)(q << 1);
+        q ^= (uint8_t)(q << 2);
+        q ^= (uint8_t)(q << 4);
+        if (q & 0x80) q ^= 0x09;
+        sbox[p] = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+    for (int i = 0; i < 256; i++) inv_sbox[sbox[i]] = (uint8_t)i;
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = inv_sbox[i];
+        td[i] = (uint32_t)gf_mul(s, 14) << 24 | (uint32_t)gf_mul(s, 9) << 16 | (uint32_t)gf_mul(s, 13) << 8 |
+                gf_mul(s, 11);
+    }
+}
+
+static void inv_mix_column(const uint8_t in[4], uint8_t out[4]) {
+    out[0] = gf_mul(in[0], 14) ^ gf_mul(in[1], 11) ^ gf_mul(in[2], 13) ^ gf_mul(in[3], 9);
+    out[1] = gf_mul(in[0], 9) ^ gf_mul(in[1], 14) ^ gf_mul(in[2], 11) ^ gf_mul(in[3], 13);
+    out[2] = gf_mul(in[0], 13) ^ gf_mul(in[1], 9) ^ gf_mul(in[2], 14) ^ gf_mul(in[3], 11);
+    out[3] = gf_mul(in[0], 11) ^ gf_mul(in[1], 13) ^ gf_mul(in[2], 9) ^ gf_mul(in[3], 14);
+}
+
+// The encryption key schedule, then reversed for the equivalent inverse
+// cipher: the middle round keys go through InvMixColumns
+void aes128_init(aes128_t *aes, const uint8_t key[AES_BLOCK]) {
+    pthread_once(&tables_once, tables_init);
+    uint8_t ek[11][AES_BLOCK];
+    memcpy(ek[0], key, AES_BLOCK);
+    uint8_t rcon = 1;
+    for (int r = 1; r <= 10; r++) {
+        const uint8_t *prev = ek[r - 1];
+        uint8_t t[4] = { (uint8_t)(sbox[prev[13]] ^ rcon), sbox[prev[14]], sbox[prev[15]], sbox[prev[12]] };
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 4; k++)
+                ek[r][4 * c + k] = prev[4 * c + k] ^ (c ? ek[r][4 * (c - 1) + k] : t[k]);
+        rcon = xtime(rcon);
+    }
+    memcpy(aes->round_keys[0], ek[10], AES_BLOCK);
+    for (int r = 1; r < 10; r++)
+        for (int c = 0; c < 4; c++) inv_mix_column(ek[10 - r] + 4 * c, aes->round_keys[r] + 4 * c);
+    memcpy(aes->round_keys[10], ek[0], AES_BLOCK);
+}
+
+static uint32_t load_be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void store_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static void decrypt_block_c(const uint8_t rk[11][AES_BLOCK], const uint8_t in[AES_BLOCK], uint8_t out[AES_BLOCK]) {
+    uint32_t s0 = load_be32(in) ^ load_be32(rk[0]), s1 = load_be32(in + 4) ^ load_be32(rk[0] + 4);
+    uint32_t s2 = load_be32(in + 8) ^ load_be32(rk[0] + 8), s3 = load_be32(in + 12) ^ load_be32(rk[0] + 12);
+    for (int r = 1; r < 10; r++) {
+        uint32_t t0 = td[s0 >> 24] ^ ror32(td[(s3 >> 16) & 0xff], 8) ^ ror32(td[(s2 >> 8) & 0xff], 16) ^
+                      ror32(td[s1 & 0xff], 24) ^ load_be32(rk[r]);
+        uint32_t t1 = td[s1 >> 24] ^ ror32(td[(s0 >> 16) & 0xff], 8) ^ ror32(td[(s3 >> 8) & 0xff], 16) ^
+                      ror32(td[s2 & 0xff], 24) ^ load_be32(rk[r] + 4);
+        uint32_t t2 = td[s2 >> 24] ^ ror32(td[(s1 >> 16) & 0xff], 8) ^ ror32(td[(s0 >> 8) & 0xff], 16) ^
+                      ror32(td[s3 & 0xff], 24) ^ load_be32(rk[r] + 8);
+        uint32_t t3 = td[s3 >> 24] ^ ror32(td[(s2 >> 16) & 0xff], 8) ^ ror32(td[(s1 >> 8) & 0xff], 16) ^
+                      ror32(td[s0 & 0xff], 24) ^ load_be32(rk[r] + 12);
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    // Last round: InvShiftRows and InvSubBytes only
+    const uint32_t s[4] = { s0, s1, s2, s3 };
+    for (int c = 0; c < 4; c++) {
+        uint32_t v = (uint32_t)inv_sbox[s[c] >> 24] << 24 | (uint32_t)inv_sbox[(s[(c + 3) & 3] >> 16) & 0xff] << 16 |
+                     (uint32_t)inv_sbox[(s[(c + 2) & 3] >> 8) & 0xff] << 8 | inv_sbox[s[(c + 1) & 3] & 0xff];
+        store_be32(out + 4 * c, v ^ load_be32(rk[10] + 4 * c));
+    }
+}
+
+void aes128_cbc_decrypt_c(const aes128_t *aes, uint8_t iv[AES_BLOCK], const uint8_t *src, uint8_t *dst,
+                          size_t blocks) {
+    uint8_t prev[AES_BLOCK], cipher[AES_BLOCK], plain[AES_BLOCK];
+    memcpy(prev, iv, AES_BLOCK);
+    for (size_t b = 0; b < blocks; b++, src += AES_BLOCK, dst += AES_BLOCK) {
+        memcpy(cipher, src, AES_BLOCK);
+        decrypt_block_c(aes->round_keys, cipher, plain);
+        for (int i = 0; i < AES_BLOCK; i++) dst[i] = plain[i] ^ prev[i];
+        memcpy(prev, cipher, AES_BLOCK);
+    }
+    memcpy(iv, prev, AES_BLOCK);
+}
+
+#if defined(AES_X86) || defined(AES_ARM)
+typedef void (*cbc_decrypt_fn)(const aes128_t *aes, uint8_t iv[AES_BLOCK], const uint8_t *src, uint8_t *dst,
+                               size_t blocks);
+#endif
+
+#ifdef AES_X86
+__attribute__((target("aes,sse2")))
+static inline __m128i decrypt_aesni(const __m128i k[11], __m128i s) {
+    s = _mm_xor_si128(s, k[0]);
+    for (int r = 1; r < 10; r++) s = _mm_aesdec_si128(s, k[r]);
+    return _mm_aesdeclast_si128(s, k[10]);
+}
+
+__attribute__((target("aes,sse2")))
+static void cbc_decrypt_aesni(const aes128_t *aes, uint8_t iv[AES_BLOCK], const uint8_t *src, uint8_t *dst,
+                              size_t blocks) {
+    __m128i k[11];
+    for (int r = 0; r < 11; r++) k[r] = _mm_load_si128((const __m128i *)aes->round_keys[r]);
+    __m128i prev = _mm_loadu_si128((const __m128i *)iv);
+    size_t b = 0;
+    for (; b + 4 <= blocks; b += 4, src += 4 * AES_BLOCK, dst += 4 * AES_BLOCK) {
+        __m128i c0 = _mm_loadu_si128((const __m128i *)src), c1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c2 = _mm_loadu_si128((const __m128i *)(src + 32)), c3 = _mm_loadu_si128((const __m128i *)(src + 48));
+        __m128i s0 = _mm_xor_si128(c0, k[0]), s1 = _mm_xor_si128(c1, k[0]);
+        __m128i s2 = _mm_xor_si128(c2, k[0]), s3 = _mm_xor_si128(c3, k[0]);
+        for (int r = 1; r < 10; r++) {
+            s0 = _mm_aesdec_si128(s0, k[r]);
+            s1 = _mm_aesdec_si128(s1, k[r]);
+            s2 = _mm_aesdec_si128(s2, k[r]);
+            s3 = _mm_aesdec_si128(s3, k[r]);
+        }
+        s0 = _mm_aesdeclast_si128(s0, k[10]);
+        s1 = _mm_aesdeclast_si128(s1, k[10]);
+        s2 = _mm_aesdeclast_si128(s2, k[10]);
+        s3 = _mm_aesdeclast_si128(s3, k[10]);
+        _mm_storeu_si128((__m128i *)dst, _mm_xor_si128(s0, prev));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_xor_si128(s1, c0));
+        _mm_storeu_si128((__m128i *)(dst + 32), _mm_xor_si128(s2, c1));
+        _mm_storeu_si128((__m128i *)(dst + 48), _mm_xor_si128(s3, c2));
+        prev = c3;
+    }
+    for (; b < blocks; b++, src += AES_BLOCK, dst += AES_BLOCK) {
+        __m128i c = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dst, _mm_xor_si128(decrypt_aesni(k, c), prev));
+        prev = c;
+    }
+    _mm_storeu_si128((__m128i *)iv, prev);
+}
+
+static const struct {
+    unsigned features;
+    cbc_decrypt_fn fn;
+    const char *name;
+} decrypt_table[] = {
+    { CPU_AES | CPU_SSE2, cbc_decrypt_aesni, "aes-ni" },
+};
+#endif
+
+#ifdef AES_ARM
+// AESD is AddRoundKey, InvShiftRows and InvSubBytes, so the round key
+// comes first and InvMixColumns (AESIMC) after it
+__attribute__((target("arch=armv8-a+crypto")))
+static inline uint8x16_t decrypt_armv8(const uint8x16_t k[11], uint8x16_t s) {
+    for (int r = 0; r < 9; r++) s = vaesimcq_u8(vaesdq_u8(s, k[r]));
+    return veorq_u8(vaesdq_u8(s, k[9]), k[10]);
+}
+
+__attribute__((target("arch=armv8-a+crypto")))
+static void cbc_decrypt_armv8(const aes128_t *aes, uint8_t iv[AES_BLOCK], const uint8_t *src, uint8_t *dst,
+                              size_t blocks) {
+    uint8x16_t k[11];
+    for (int r = 0; r < 11; r++) k[r] = vld1q_u8(aes->round_keys[r]);
+    uint8x16_t prev = vld1q_u8(iv);
+    size_t b = 0;
+    for (; b + 4 <= blocks; b += 4, src += 4 * AES_BLOCK, dst += 4 * AES_BLOCK) {
+        uint8x16_t c0 = vld1q_u8(src), c1 = vld1q_u8(src + 16), c2 = vld1q_u8(src + 32), c3 = vld1q_u8(src + 48);
+        uint8x16_t s0 = c0, s1 = c1, s2 = c2, s3 = c3;
+        for (int r = 0; r < 9; r++) {
+            s0 = vaesimcq_u8(vaesdq_u8(s0, k[r]));
+            s1 = vaesimcq_u8(vaesdq_u8(s1, k[r]));
+            s2 = vaesimcq_u8(vaesdq_u8(s2, k[r]));
+            s3 = vaesimcq_u8(vaesdq_u8(s3, k[r]));
+        }
+        s0 = veorq_u8(vaesdq_u8(s0, k[9]), k[10]);
+        s1 = veorq_u8(vaesdq_u8(s1, k[9]), k[10]);
+        s2 = veorq_u8(vaesdq_u8(s2, k[9]), k[10]);
+        s3 = veorq_u8(vaesdq_u8(s3, k[9]), k[10]);
+        vst1q_u8(dst, veorq_u8(s0, prev));
+        vst1q_u8(dst + 16, veorq_u8(s1, c0));
+        vst1q_u8(dst + 32, veorq_u8(s2, c1));
+        vst1q_u8(dst + 48, veorq_u8(s3, c2));
+        prev = c3;
+    }
+    for (; b < blocks; b++, src += AES_BLOCK, dst += AES_BLOCK) {
+        uint8x16_t c = vld1q_u8(src);
+        vst1q_u8(dst, veorq_u8(decrypt_armv8(k, c), prev));
+        prev = c;
+    }
+    vst1q_u8(iv, prev);
+}
+
+static const struct {
+    unsigned features;
+    cbc_decrypt_fn fn;
+    const char *name;
+} decrypt_table[] = {
+    { CPU_AES, cbc_decrypt_armv8, "armv8" },
+};
+#endif
+
+#if defined(AES_X86) || defined(AES_ARM)
+static cbc_decrypt_fn decrypt_fn;   // NULL: tables only
+static pthread_once_t decrypt_once = PTHREAD_ONCE_INIT;
+
+static void select_decrypt(void) {
+    unsigned features = cpu_features();
+    for (size_t i = 0; i < sizeof(decrypt_table) / sizeof(decrypt_table[0]); i++) {
+        if ((decrypt_table[i].features & features) == decrypt_table[i].features) {
+            decrypt_fn = decrypt_table[i].fn;
+            break;
+        }
+    }
+}
+#endif
+
+int aes128_use_version(size_t i, const char **name) {
+#if defined(AES_X86) || defined(AES_ARM)
+    if (i >= sizeof(decrypt_table) / sizeof(decrypt_table[0])) return -1;
+    *name = decrypt_table[i].name;
+    if ((decrypt_table[i].features & cpu_features()) != decrypt_table[i].features) return 0;
+    pthread_once(&decrypt_once, select_decrypt);
+    decrypt_fn = decrypt_table[i].fn;
+    return 1;
+#else
+    (void)i;
+    (void)name;
+    return -1;
+#endif
+}
+
+void aes128_cbc_decrypt(const aes128_t *aes, uint8_t iv[AES_BLOCK], const uint8_t *src, uint8_t *dst,
+                        size_t blocks) {
+#if defined(AES_X86) || defined(AES_ARM)
+    pthread_once(&decrypt_once, select_decrypt);
+    if (decrypt_fn) {
+        decrypt_fn(aes, iv, src, dst, blocks);
+        return;
+    }
+#endif
+    aes128_cbc_decrypt_c(aes, iv, src, dst, blocks);
+}
@@ -0,0 +1,395 @@
+// Headless decode benchmark: demuxes a local MPEG-TS or H.264 Annex-B
+// file, decodes it as fast as possible into a null sink (or converts each
+// picture to RGB24 with -c) and reports the throughput, the time of each
+// stage and the peak RSS. No network, no window, no frame pacing.
+//
+//   bench [-d backend] [-c] [-p] [-g workers] [-v] [-e seed] [-l loops] file.ts|file.264
+//
+// Demuxing and NAL indexing run as a pass of their own before decoding so
+// their time is not mixed into the decoder's. -p times the h264bsd stages
+// (see h264bsd_profile.h), which costs a few percent; the fps figure is
+// only comparable between runs with the same options. Threads are set
+// like for the player, with ANHELO_FRAME_THREADS, ANHELO_SLICE_THREADS and
+// ANHELO_CONVERT_THREADS. -g decodes the IDR-to-IDR ranges on that many
+// decoders at once (include/gop_parallel.h, 0 = one per CPU); -v with it
+// decodes the file once more each way and checks the pictures match.
+// Without -g, -v checks the h264bsd pictures deblocked row by row against
+// whole-picture deblocking (ANHELO_DEBLOCK_ROWS=0), decoding serially.
+// -e flips bits in the slices first, so the checks cover concealment.
+#include "../../include/decoder.h"
+#include "../../include/gop_parallel.h"
+#include "../../include/nal_index.h"
+#include "../../include/ts_demux.h"
+#include "../../include/yuv2rgb.h"
+#include "../../include/cpu.h"
+#include "../codecs/h264/h264bsd_profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define TS_PACKET_SIZE 188
+
+static uint64_t time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static double ms(uint64_t ns) {
+    return ns / 1e6;
+}
+
+// Elementary stream of the video PES packets, back to back
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} es_buffer_t;
+
+static int append_pes(const ts_pes_t *pes, void *user_data) {
+    es_buffer_t *es = user_data;
+    if (es->size + pes->size > es->capacity) {
+        size_t capacity = es->capacity ? es->capacity * 2 : 1 << 20;
+        while (capacity < es->size + pes->size) capacity *= 2;
+        uint8_t *p = realloc(es->data, capacity);
+        if (!p) return -1;
+        es->data = p;
+        es->capacity = capacity;
+    }
+    memcpy(es->data + es->size, pes->data, pes->size);
+    es->size += pes->size;
+    return 0;
+}
+
+static int is_transport_stream(const uint8_t *data, size_t size) {
+    if (size < TS_PACKET_SIZE || data[0] != 0x47) return 0;
+    return size < 2 * TS_PACKET_SIZE || data[TS_PACKET_SIZE] == 0x47;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    uint8_t *data = NULL;
+    size_t capacity = 0;
+    *size = 0;
+    for (;;) {
+        if (*size == capacity) {
+            capacity = capacity ? capacity * 2 : 1 << 20;
+            uint8_t *p = realloc(data, capacity);
+            if (!p) break;
+            data = p;
+        }
+        size_t n = fread(data + *size, 1, capacity - *size, f);
+        if (n == 0) break;
+        *size += n;
+    }
+    fclose(f);
+    return data;
+}
+
+typedef struct {
+    int convert;
+    yuv2rgb_threads_t *threads;
+    uint8_t *rgb;
+    size_t rgb_size;
+    uint64_t convert_ns;
+    unsigned pictures;
+} sink_t;
+
+static void sink_picture(const decoder_picture_t *pic, void *user) {
+    sink_t *sink = user;
+    sink->pictures++;
+    if (!sink->convert) return;
+    size_t need = (size_t)pic->width * pic->height * 3;
+    if (need > sink->rgb_size) {
+        free(sink->rgb);
+        sink->rgb = malloc(need);
+        sink->rgb_size = sink->rgb ? need : 0;
+        if (!sink->rgb) return;
+    }
+    uint64_t start = time_ns();
+    yuv420_to_rgb_threaded(sink->threads, YUV2RGB_RGB24, pic->width, pic->height,
+                           pic->y, pic->u, pic->v, pic->y_stride, pic->uv_stride, pic->uv_stride,
+                           sink->rgb, pic->width * 3);
+    sink->convert_ns += time_ns() - start;
+}
+
+// Take every picture the decoder has ready
+static void drain(decoder_t *dec, sink_t *sink) {
+    decoder_picture_t pic;
+    while (decoder_get_picture(dec, &pic)) sink_picture(&pic, sink);
+}
+
+// Hashes of the pictures, in output order (-v)
+typedef struct {
+    uint64_t *hashes;
+    size_t count, capacity;
+} picture_hashes_t;
+
+static void hash_picture(const decoder_picture_t *pic, void *user) {
+    picture_hashes_t *h = user;
+    if (h->count == h->capacity) {
+        size_t capacity = h->capacity ? h->capacity * 2 : 256;
+        uint64_t *p = realloc(h->hashes, capacity * sizeof(*p));
+        if (!p) return;
+        h->hashes = p;
+        h->capacity = capacity;
+    }
+    // FNV-1a over the size and the visible samples
+    uint64_t hash = 14695981039346656037ull ^ (uint64_t)pic->width << 32 ^ (uint64_t)pic->height;
+    int cw = (pic->width + 1) / 2, ch = (pic->height + 1) / 2;
+    for (int y = 0; y < pic->height; y++)
+        for (int x = 0; x < pic->width; x++) hash = (hash ^ pic->y[(size_t)y * pic->y_stride + x]) * 1099511628211ull;
+    for (int y = 0; y < ch; y++) {
+        for (int x = 0; x < cw; x++) {
+            hash = (hash ^ pic->u[(size_t)y * pic->uv_stride + x]) * 1099511628211ull;
+            hash = (hash ^ pic->v[(size_t)y * pic->uv_stride + x]) * 1099511628211ull;
+        }
+    }
+    h->hashes[h->count++] = hash;
+}
+
+// -v: the GOP-parallel pictures against the serial ones, and every range
+// with slices giving pictures of its own. Returns 0 when they match.
+static int verify_gop(const char *backend, int workers, const uint8_t *stream, const nal_index_t *index) {
+    picture_hashes_t serial = {0}, parallel = {0};
+    decoder_t *dec = decoder_create(DECODER_CAP_H264, backend);
+    gop_parallel_t *gop = gop_parallel_create(backend, workers, hash_picture, &parallel);
+    if (!dec || !gop) {
+        decoder_destroy(dec);
+        gop_parallel_destroy(gop);
+        return -1;
+    }
+    decoder_picture_t pic;
+    for (size_t i = 0; i < index->count; i++) {
+        decoder_decode(dec, stream + index->units[i].offset, index->units[i].size);
+        while (decoder_get_picture(dec, &pic)) hash_picture(&pic, &serial);
+        gop_parallel_decode(gop, stream + index->units[i].offset, index->units[i].size);
+    }
+    decoder_flush(dec);
+    while (decoder_get_picture(dec, &pic)) hash_picture(&pic, &serial);
+    gop_parallel_flush(gop);
+    unsigned long ranges, empty;
+    gop_parallel_stats(gop, &ranges, &empty);
+
+    size_t first_bad = 0;
+    while (first_bad < serial.count && first_bad < parallel.count &&
+           serial.hashes[first_bad] == parallel.hashes[first_bad]) first_bad++;
+    int ok = serial.count == parallel.count && first_bad == serial.count && empty == 0;
+    if (ok) printf("Verify:     %zu pictures as decoded serially, %lu ranges\n", serial.count, ranges);
+    else printf("Verify:     FAILED, %zu pictures (serially %zu), first differing %zu, %lu of %lu ranges empty\n",
+                parallel.count, serial.count, first_bad, empty, ranges);
+    decoder_destroy(dec);
+    gop_parallel_destroy(gop);
+    free(serial.hashes);
+    free(parallel.hashes);
+    return ok ? 0 : -1;
+}
+
+// -v without -g: serial decoding against the same with whole pictures
+// deblocked. Returns 0 when they match.
+static int verify_rows(const char *backend, const uint8_t *stream, const nal_index_t *index) {
+    picture_hashes_t rows = {0}, whole = {0};
+    picture_hashes_t *hashes[2] = {&rows, &whole};
+    decoder_picture_t pic;
+    for (int pass = 0; pass < 2; pass++) {
+        // The backend reads it when created
+        if (pass == 1) setenv("ANHELO_DEBLOCK_ROWS", "0", 1);
+        decoder_t *dec = decoder_create(DECODER_CAP_H264, backend);
+        if (pass == 1) unsetenv("ANHELO_DEBLOCK_ROWS");
+        if (!dec) {
+            free(rows.hashes);
+            free(whole.hashes);
+            return -1;
+        }
+        for (size_t i = 0; i < index->count; i++) {
+            decoder_decode(dec, stream + index->units[i].offset, index->units[i].size);
+            while (decoder_get_picture(dec, &pic)) hash_picture(&pic, hashes[pass]);
+        }
+        decoder_flush(dec);
+        while (decoder_get_picture(dec, &pic)) hash_picture(&pic, hashes[pass]);
+        decoder_destroy(dec);
+    }
+
+    size_t first_bad = 0;
+    while (first_bad < rows.count && first_bad < whole.count &&
+           rows.hashes[first_bad] == whole.hashes[first_bad]) first_bad++;
+    int ok = rows.count == whole.count && first_bad == rows.count;
+    if (ok) printf("Verify:     %zu pictures as deblocked whole\n", rows.count);
+    else printf("Verify:     FAILED, %zu pictures (deblocked whole %zu), first differing %zu\n",
+                rows.count, whole.count, first_bad);
+    free(rows.hashes);
+    free(whole.hashes);
+    return ok ? 0 : -1;
+}
+
+// -e: flip one to three bits past the header of about one slice NAL unit
+// in eight, the same ones for the same seed
+static void corrupt_slices(uint8_t *stream, const nal_index_t *index, unsigned seed) {
+    uint32_t x = seed * 2654435761u | 1;
+    for (size_t i = 0; i < index->count; i++) {
+        const nal_unit_t *unit = &index->units[i];
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        if ((unit->type != 1 && unit->type != 5) || unit->size < 2 || x % 8) continue;
+        for (unsigned n = x / 8 % 3 + 1; n > 0; n--) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            stream[unit->offset + 1 + x % (unit->size - 1)] ^= 1u << (x >> 29);
+        }
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-d backend] [-c] [-p] [-g workers] [-v] [-e seed] [-l loops] file.ts|file.264\n"
+                    "  -d  decoder backend (default: the preferred H.264 backend)\n"
+                    "  -c  convert pictures to RGB24 (default: null sink)\n"
+                    "  -p  time the h264bsd decoding stages\n"
+                    "  -g  decode IDR-to-IDR ranges on this many decoders at once (0 = one per CPU)\n"
+                    "  -v  check the pictures: with -g against serial decoding, else deblocked\n"
+                    "      row by row against whole pictures\n"
+                    "  -e  flip bits in the slices first, the same ones for the same seed\n"
+                    "  -l  decode the file this many times\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    const char *backend = NULL;
+    int profile = 0, loops = 1, gop_workers = -1, verify = 0, corrupt = 0, opt;
+    unsigned seed = 0;
+    sink_t sink = {0};
+    while ((opt = getopt(argc, argv, "d:cpg:ve:l:")) != -1) {
+        switch (opt) {
+        case 'd': backend = optarg; break;
+        case 'c': sink.convert = 1; break;
+        case 'p': profile = 1; break;
+        case 'g': gop_workers = atoi(optarg) > 0 ? atoi(optarg) : 0; break;
+        case 'v': verify = 1; break;
+        case 'e': corrupt = 1; seed = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'l': loops = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (sink.convert) {
+        const char *threads = getenv("ANHELO_CONVERT_THREADS");
+        sink.threads = yuv2rgb_threads_create(threads ? atoi(threads) : 0);
+    }
+
+    size_t size;
+    uint8_t *file = read_file(argv[optind], &size);
+    if (!file || size == 0) {
+        fprintf(stderr, "Can't read %s\n", argv[optind]);
+        free(file);
+        return 1;
+    }
+
+    // Demux and index the NAL units
+    es_buffer_t es = {0};
+    nal_index_t index = {0};
+    uint8_t *stream = file;
+    size_t stream_size = size;
+    uint64_t start = time_ns();
+    int ts = is_transport_stream(file, size);
+    if (ts) {
+        ts_demux_t *demux = ts_demux_create(append_pes, &es);
+        if (!demux || ts_demux_feed(demux, file, size) || ts_demux_flush(demux)) {
+            fprintf(stderr, "Demuxing failed\n");
+            return 1;
+        }
+        ts_demux_destroy(demux);
+        stream = es.data;
+        stream_size = es.size;
+    }
+    if (!stream || nal_index_annexb(&index, stream, stream_size) <= 0) {
+        fprintf(stderr, "No H.264 NAL units in %s\n", argv[optind]);
+        return 1;
+    }
+    uint64_t demux_ns = time_ns() - start;
+    if (corrupt) corrupt_slices(stream, &index, seed);
+
+    decoder_t *dec = NULL;
+    gop_parallel_t *gop = NULL;
+    uint64_t decode_ns = 0;
+#ifdef H264DEC_PROFILE
+    h264bsdProfiling = profile;
+    h264bsdProfileReset();
+#endif
+    for (int loop = 0; loop < loops; loop++) {
+        decoder_destroy(dec);
+        gop_parallel_destroy(gop);
+        dec = NULL;
+        gop = NULL;
+        if (gop_workers >= 0) gop = gop_parallel_create(backend, gop_workers, sink_picture, &sink);
+        else dec = decoder_create(DECODER_CAP_H264, backend);
+        if (!dec && !gop) {
+            fprintf(stderr, "No H.264 decoder\n");
+            return 1;
+        }
+        start = time_ns();
+        if (gop) {
+            for (size_t i = 0; i < index.count; i++)
+                gop_parallel_decode(gop, stream + index.units[i].offset, index.units[i].size);
+            gop_parallel_flush(gop);
+        } else {
+            for (size_t i = 0; i < index.count; i++) {
+                decoder_decode(dec, stream + index.units[i].offset, index.units[i].size);
+                drain(dec, &sink);
+            }
+            decoder_flush(dec);
+            drain(dec, &sink);
+        }
+        decode_ns += time_ns() - start;
+    }
+    const char *name = gop ? gop_parallel_backend(gop)->name : decoder_backend(dec)->name;
+
+    uint64_t busy_ns = decode_ns - sink.convert_ns;
+    printf("File:       %s (%s, %zu NAL units)\n", argv[optind], ts ? "MPEG-TS" : "H.264", index.count);
+    if (gop) printf("Decoder:    %s, GOP-parallel\n", name);
+    else printf("Decoder:    %s\n", name);
+    char features[64];
+    cpu_feature_names(cpu_features(), features, sizeof(features));
+    printf("CPU:        %s\n", features);
+    printf("Pictures:   %u in %.1f ms, %.1f fps\n", sink.pictures, ms(decode_ns),
+           decode_ns ? sink.pictures * 1e9 / decode_ns : 0.0);
+    printf("Stages (ms, all threads):\n");
+    printf("  NAL parsing  %10.2f  (demux and index, once)\n", ms(demux_ns));
+#ifdef H264DEC_PROFILE
+    if (profile && strcmp(name, "h264bsd") == 0) {
+        static const char *const stages[PROFILE_NUM_STAGES] = {
+            "CAVLC", "transform", "intra", "inter", "deblock"
+        };
+        uint64_t stage_ns[PROFILE_NUM_STAGES], staged = 0;
+        h264bsdProfileGet(stage_ns);
+        for (int i = 0; i < PROFILE_NUM_STAGES; i++) {
+            printf("  %-12s %10.2f\n", stages[i], ms(stage_ns[i]));
+            staged += stage_ns[i];
+        }
+        if (staged <= busy_ns) printf("  %-12s %10.2f  (headers, DPB, threads)\n", "other", ms(busy_ns - staged));
+    } else
+#endif
+        printf("  decode       %10.2f%s\n", ms(busy_ns), profile ? "  (no stage times for this backend)" : "");
+    if (sink.convert) printf("  conversion   %10.2f\n", ms(sink.convert_ns));
+
+    // ru_maxrss is in kilobytes on Linux; it includes the file read in
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        printf("Peak RSS:   %.1f MB (file %.1f MB)\n", usage.ru_maxrss / 1024.0, size / 1048576.0);
+    // After the figures, so its decoding does not count in them
+    int status = 0;
+    if (verify && gop) status = verify_gop(backend, gop_workers, stream, &index) != 0;
+    else if (verify) status = verify_rows(backend, stream, &index) != 0;
+
+    decoder_destroy(dec);
+    gop_parallel_destroy(gop);
+    nal_index_free(&index);
+    free(es.data);
+    free(file);
+    free(sink.rgb);
+    yuv2rgb_threads_destroy(sink.threads);
+    return status;
+}
@@ -0,0 +1,633 @@
+// Kernel check: runs the h264bsd motion compensation, inverse transforms,
+// intra prediction and deblocking, the MPEG-4 IDCT and motion compensation,
+// the RGB conversion, the start code search and AES-128 CBC decryption over
+// random inputs, once with the kernels the program is built with and once
+// with the C reference (kernels_ref.c, the _c functions of the MPEG-4 DSP
+// and aes128_cbc_decrypt_c, a byte loop for the start codes), compares the
+// outputs byte for byte and reports the time per block of both.
+//
+//   kernels [-n cases] [-s seed]
+//
+// Exits with 1 if any output differs. The h264bsd variant under test is
+// the one picked at compile time (SSE2 or NEON, see h264bsd_cfg.h); with
+// H264DEC_NO_SIMD in CFLAGS it checks the C build against itself. The
+// MPEG-4, conversion, start code and AES kernels pick theirs from a table
+// for the CPU they run on (cpu.h): each version in the table this CPU
+// runs is checked in turn, so ANHELO_CPU_DISABLE takes versions out. Times
+// are TSC cycles on x86 and nanoseconds elsewhere, measured around each
+// call.
+#include "kernels_ref.h"
+#include "../../include/yuv2rgb.h"
+#include "../../include/cpu.h"
+#include "../../include/aes.h"
+#include "../../include/nal_index.h"
+#include "../codecs/h264/h264bsd_cfg.h"
+#include "../codecs/h264/h264bsd_reconstruct.h"
+#include "../codecs/h264/h264bsd_transform.h"
+#include "../codecs/h264/h264bsd_intra_prediction.h"
+#include "../codecs/h264/h264bsd_deblocking.h"
+#include "../codecs/h264/h264bsd_neighbour.h"
+#include "../codecs/h264/h264bsd_util.h"
+#include "../codecs/mpeg4/dsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICK_UNIT "cycles"
+static uint64_t ticks(void) {
+    return __rdtsc();
+}
+#else
+#define TICK_UNIT "ns"
+static uint64_t ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#if defined(H264DEC_SIMD) && defined(__SSE2__)
+#define VARIANT "SSE2"
+#elif defined(H264DEC_SIMD) && defined(__ARM_NEON)
+#define VARIANT "NEON"
+#else
+#define VARIANT "C"
+#endif
+
+// xorshift32; every case is generated twice from the same seed, once into
+// the reference's buffers and once into the tested kernel's
+static uint32_t rnd(uint32_t *s) {
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+static int rnd_range(uint32_t *s, int lo, int hi) {
+    return lo + (int)(rnd(s) % (uint32_t)(hi - lo + 1));
+}
+
+static uint8_t clamp_u8(int v) {
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+// Gradient plus noise of amplitude `amp`, so the deblocking thresholds and
+// the interpolation get both flat and busy areas
+static void fill_plane(uint32_t *s, uint8_t *p, int w, int h, int stride, int amp) {
+    int base = rnd_range(s, 0, 255), dx = rnd_range(s, -4, 4), dy = rnd_range(s, -4, 4);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            int v = base + (dx * x + dy * y) / 2;
+            if (amp) v += rnd_range(s, -amp, amp);
+            p[(size_t)y * stride + x] = clamp_u8(v);
+        }
+}
+
+// h264bsd picture of w x h macroblocks, luma then both chroma planes
+static void fill_picture(uint32_t *s, uint8_t *data, int w, int h, int amp) {
+    fill_plane(s, data, w * 16, h * 16, w * 16, amp);
+    fill_plane(s, data + w * h * 256, w * 8, h * 16, w * 8, amp);
+}
+
+typedef struct {
+    const char *name;
+    const char *version;
+    const char *block;
+    unsigned long cases;
+    unsigned long mismatches;
+    unsigned long blocks;
+    uint64_t ref_ticks;
+    uint64_t test_ticks;
+} result_t;
+
+// Time one call into `total`. The two variants run in turns, first one
+// then the other, so neither always finds the caches warmed by the other.
+#define TIMED(total, call) do { uint64_t t0 = ticks(); call; (total) += ticks() - t0; } while (0)
+
+static void mismatch(result_t *r, unsigned long n) {
+    if (r->mismatches++ == 0)
+        fprintf(stderr, "%s (%s): case %lu differs from the C reference\n", r->name, r->version, n);
+}
+
+// Motion compensation: one partition from a reference picture, with
+// motion vectors reaching past the picture edges now and then
+#define MC_W 5
+#define MC_H 4
+
+static void check_interpolation(result_t *r, uint32_t *s, unsigned long cases) {
+    static const u32 sizes[7][2] = {{16,16},{16,8},{8,16},{8,8},{8,4},{4,8},{4,4}};
+    static u8 pic[MC_W * MC_H * 384];
+    image_t ref = {0};
+    ref.data = pic;
+    ref.width = MC_W;
+    ref.height = MC_H;
+    for (unsigned long n = 0; n < cases; n++) {
+        if (n % 256 == 0) fill_picture(s, pic, MC_W, MC_H, rnd_range(s, 0, 64));
+        const u32 *size = sizes[rnd(s) % 7];
+        u32 xA = rnd_range(s, 0, MC_W - 1) * 16, yA = rnd_range(s, 0, MC_H - 1) * 16;
+        u32 partX = rnd_range(s, 0, 16 / size[0] - 1) * size[0];
+        u32 partY = rnd_range(s, 0, 16 / size[1] - 1) * size[1];
+        int range = rnd(s) % 4 ? 64 : (MC_W * 16 + 32) * 4;
+        mv_t mv;
+        mv.hor = (i16)rnd_range(s, -range, range);
+        mv.ver = (i16)rnd_range(s, -range, range);
+        u8 a[384], b[384];
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1)
+                TIMED(r->test_ticks, h264bsdPredictSamples(b, &mv, &ref, xA, yA, partX, partY,
+                                                           size[0], size[1]));
+            else
+                TIMED(r->ref_ticks, ref_h264bsdPredictSamples(a, &mv, &ref, xA, yA, partX, partY,
+                                                              size[0], size[1]));
+        }
+        if (memcmp(a, b, sizeof(a))) mismatch(r, n);
+        r->blocks++;
+    }
+    r->cases += cases;
+}
+
+// Residual coefficients: sparse, mostly small levels, some large enough
+// to leave the [-512, 511] range
+static u32 gen_coeffs(uint32_t *s, i32 *data, int count) {
+    static const int amps[4] = {4, 16, 64, 1024};
+    int amp = amps[rnd(s) % 4];
+    u32 density = rnd(s) % 16 + 1, map = 0;
+    for (int i = 0; i < count; i++) {
+        data[i] = rnd(s) % 16 < density ? rnd_range(s, -amp, amp) : 0;
+        if (data[i]) map |= 1u << i;
+    }
+    return map;
+}
+
+static void check_transform(result_t *r, uint32_t *s, unsigned long cases) {
+    for (unsigned long n = 0; n < cases; n++) {
+        i32 a[16], b[16];
+        u32 map = gen_coeffs(s, a, 16);
+        u32 qp = rnd(s) % 52, skip = rnd(s) % 4 == 0;
+        memcpy(b, a, sizeof(a));
+        u32 ra = 0, rb = 0;
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1) TIMED(r->test_ticks, rb = h264bsdProcessBlock(b, qp, skip, map));
+            else TIMED(r->ref_ticks, ra = ref_h264bsdProcessBlock(a, qp, skip, map));
+        }
+        // The data is left undefined when the block is out of range
+        if (ra != rb || (ra == HANTRO_OK && memcmp(a, b, sizeof(a)))) mismatch(r, n);
+        r->blocks++;
+    }
+    r->cases += cases;
+}
+
+static void check_luma_dc(result_t *r, uint32_t *s, unsigned long cases) {
+    for (unsigned long n = 0; n < cases; n++) {
+        i32 a[16], b[16];
+        gen_coeffs(s, a, 16);
+        u32 qp = rnd(s) % 52;
+        memcpy(b, a, sizeof(a));
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1) TIMED(r->test_ticks, h264bsdProcessLumaDc(b, qp));
+            else TIMED(r->ref_ticks, ref_h264bsdProcessLumaDc(a, qp));
+        }
+        if (memcmp(a, b, sizeof(a))) mismatch(r, n);
+        r->blocks++;
+    }
+    r->cases += cases;
+}
+
+static void check_chroma_dc(result_t *r, uint32_t *s, unsigned long cases) {
+    for (unsigned long n = 0; n < cases; n++) {
+        i32 a[8], b[8];
+        gen_coeffs(s, a, 8);
+        u32 qp = rnd(s) % 52;
+        memcpy(b, a, sizeof(a));
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1) TIMED(r->test_ticks, h264bsdProcessChromaDc(b, qp));
+            else TIMED(r->ref_ticks, ref_h264bsdProcessChromaDc(a, qp));
+        }
+        if (memcmp(a, b, sizeof(a))) mismatch(r, n);
+        r->blocks++;
+    }
+    r->cases += cases;
+}
+
+// Intra prediction of one macroblock of a 3x3 picture, with random
+// neighbour types, slices and prediction modes and random residuals
+#define INTRA_W 3
+#define INTRA_H 3
+#define INTRA_MBS (INTRA_W * INTRA_H)
+
+typedef struct {
+    u8 pic[INTRA_MBS * 384];
+    mbStorage_t mb[INTRA_MBS];
+    macroblockLayer_t layer;
+    image_t image;
+    u32 mbNum;
+    u32 constrained;
+} intra_case_t;
+
+static void gen_intra(intra_case_t *c, uint32_t seed) {
+    static const mbType_e types[4] = {P_L0_16x16, I_4x4, I_16x16_2_0_0, I_PCM};
+    uint32_t s = seed;
+    fill_picture(&s, c->pic, INTRA_W, INTRA_H, rnd_range(&s, 0, 48));
+    for (u32 i = 0; i < INTRA_MBS; i++) {
+        mbStorage_t *mb = &c->mb[i];
+        mb->mbType = types[rnd(&s) % 4];
+        mb->sliceId = rnd(&s) % 4 == 0;
+        mb->decoded = 1;
+        for (u32 j = 0; j < 16; j++) mb->intra4x4PredMode[j] = (u8)(rnd(&s) % 9);
+    }
+    c->mbNum = rnd(&s) % INTRA_MBS;
+    c->constrained = rnd(&s) % 4 == 0;
+    mbStorage_t *mb = &c->mb[c->mbNum];
+    mb->mbType = rnd(&s) % 2 ? I_4x4 : (mbType_e)rnd_range(&s, I_16x16_0_0_0, I_16x16_3_2_1);
+    mb->sliceId = 0;
+    mb->decoded = 0;
+    macroblockLayer_t *layer = &c->layer;
+    memset(layer, 0, sizeof(*layer));
+    layer->mbType = mb->mbType;
+    for (u32 j = 0; j < 16; j++) {
+        layer->mbPred.prevIntra4x4PredModeFlag[j] = rnd(&s) % 2;
+        layer->mbPred.remIntra4x4PredMode[j] = rnd(&s) % 8;
+    }
+    layer->mbPred.intraChromaPredMode = rnd(&s) % 4;
+    for (u32 j = 0; j < 24; j++) {
+        i32 *level = layer->residual.level[j];
+        if (rnd(&s) % 2) {
+            MARK_RESIDUAL_EMPTY(level);
+        } else {
+            int amp = rnd_range(&s, 1, 255);
+            for (u32 k = 0; k < 16; k++) level[k] = rnd_range(&s, -amp, amp);
+        }
+    }
+    h264bsdSetCurrImageMbPointers(&c->image, c->mbNum);
+}
+
+static void check_intra(result_t *r, uint32_t *s, unsigned long cases) {
+    static intra_case_t a, b;
+    u8 mbData[384 + 15 + 32];
+    u8 *data = (u8*)ALIGN(mbData, 16);
+    a.image.data = a.pic;
+    b.image.data = b.pic;
+    a.image.width = b.image.width = INTRA_W;
+    a.image.height = b.image.height = INTRA_H;
+    h264bsdInitMbNeighbours(a.mb, INTRA_W, INTRA_MBS);
+    h264bsdInitMbNeighbours(b.mb, INTRA_W, INTRA_MBS);
+    for (unsigned long n = 0; n < cases; n++) {
+        uint32_t seed = rnd(s);
+        gen_intra(&a, seed);
+        gen_intra(&b, seed);
+        u32 ra = 0, rb = 0;
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1)
+                TIMED(r->test_ticks, rb = h264bsdIntraPrediction(&b.mb[b.mbNum], &b.layer, &b.image,
+                                                                 b.mbNum, b.constrained, data));
+            else
+                TIMED(r->ref_ticks, ra = ref_h264bsdIntraPrediction(&a.mb[a.mbNum], &a.layer, &a.image,
+                                                                    a.mbNum, a.constrained, data));
+        }
+        if (ra != rb || memcmp(a.pic, b.pic, sizeof(a.pic)) ||
+            memcmp(a.mb[a.mbNum].intra4x4PredMode, b.mb[b.mbNum].intra4x4PredMode, 16))
+            mismatch(r, n);
+        r->blocks++;
+    }
+    r->cases += cases;
+}
+
+// Deblocking of a whole 4x3 picture with random macroblock types, QPs,
+// filter offsets, coefficients and motion
+#define DEBLOCK_W 4
+#define DEBLOCK_H 3
+#define DEBLOCK_MBS (DEBLOCK_W * DEBLOCK_H)
+
+typedef struct {
+    u8 pic[DEBLOCK_MBS * 384];
+    mbStorage_t mb[DEBLOCK_MBS];
+    image_t image;
+} deblock_case_t;
+
+static void gen_deblock(deblock_case_t *c, uint32_t seed) {
+    static const mbType_e types[6] = {P_Skip, P_L0_16x16, P_L0_L0_16x8, P_L0_L0_8x16, P_8x8, I_4x4};
+    uint32_t s = seed;
+    fill_picture(&s, c->pic, DEBLOCK_W, DEBLOCK_H, rnd_range(&s, 0, 24));
+    int qp = rnd_range(&s, 10, 51);
+    for (u32 i = 0; i < DEBLOCK_MBS; i++) {
+        mbStorage_t *mb = &c->mb[i];
+        mb->mbType = rnd(&s) % 5 == 0 ? (mbType_e)rnd_range(&s, I_16x16_0_0_0, I_16x16_3_2_1)
+                                      : types[rnd(&s) % 6];
+        mb->sliceId = rnd(&s) % 8 == 0;
+        mb->disableDeblockingFilterIdc = rnd(&s) % 8 == 0 ? rnd_range(&s, 1, 2) : 0;
+        mb->filterOffsetA = rnd_range(&s, -6, 6) * 2;
+        mb->filterOffsetB = rnd_range(&s, -6, 6) * 2;
+        mb->qpY = (u32)MIN(MAX(qp + rnd_range(&s, -4, 4), 0), 51);
+        mb->chromaQpIndexOffset = rnd_range(&s, -12, 12);
+        for (u32 j = 0; j < 27; j++) mb->totalCoeff[j] = rnd(&s) % 3 ? 0 : (i16)rnd_range(&s, 1, 16);
+        // Motion and references per partition, as the decoder stores them
+        u32 parts = mb->mbType == P_8x8 ? 16 : mb->mbType == P_L0_L0_16x8 ||
+                    mb->mbType == P_L0_L0_8x16 ? 2 : 1;
+        mv_t mv[16];
+        u8 *ref[4];
+        for (u32 j = 0; j < parts; j++) {
+            mv[j].hor = (i16)rnd_range(&s, -6, 6);
+            mv[j].ver = (i16)rnd_range(&s, -6, 6);
+        }
+        for (u32 j = 0; j < 4; j++) ref[j] = c->pic + rnd(&s) % 2;
+        for (u32 j = 0; j < 16; j++) {
+            u32 part = parts == 16 ? j :
+                       mb->mbType == P_L0_L0_16x8 ? j / 8 :
+                       mb->mbType == P_L0_L0_8x16 ? (j / 4) % 2 : 0;
+            mb->mv[j] = mv[part];
+        }
+        for (u32 j = 0; j < 4; j++) {
+            u32 part = parts == 16 ? j :
+                       mb->mbType == P_L0_L0_16x8 ? j / 2 :
+                       mb->mbType == P_L0_L0_8x16 ? j % 2 : 0;
+            mb->refAddr[j] = ref[part];
+            mb->refPic[j] = (u32)(ref[part] - c->pic);
+        }
+        mb->decoded = 1;
+    }
+}
+
+static void check_deblock(result_t *r, uint32_t *s, unsigned long cases) {
+    static deblock_case_t a, b;
+    a.image.data = a.pic;
+    b.image.data = b.pic;
+    a.image.width = b.image.width = DEBLOCK_W;
+    a.image.height = b.image.height = DEBLOCK_H;
+    h264bsdInitMbNeighbours(a.mb, DEBLOCK_W, DEBLOCK_MBS);
+    h264bsdInitMbNeighbours(b.mb, DEBLOCK_W, DEBLOCK_MBS);
+    for (unsigned long n = 0; n < cases; n++) {
+        uint32_t seed = rnd(s);
+        gen_deblock(&a, seed);
+        gen_deblock(&b, seed);
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1)
+                TIMED(r->test_ticks, h264bsdFilterPictureRows(&b.image, b.mb, 0, DEBLOCK_H));
+            else
+                TIMED(r->ref_ticks, ref_h264bsdFilterPictureRows(&a.image, a.mb, 0, DEBLOCK_H));
+        }
+        if (memcmp(a.pic, b.pic, sizeof(a.pic))) mismatch(r, n);
+        r->blocks += DEBLOCK_MBS;
+    }
+    r->cases += cases;
+}
+
+// RGB conversion of pictures of random size, strides and output format;
+// one block is 16x16 pixels
+static void check_yuv2rgb(result_t *r, uint32_t *s, unsigned long cases) {
+    static u8 y[96 * 80], u[48 * 40], v[48 * 40], a[96 * 4 * 80], b[96 * 4 * 80];
+    for (unsigned long n = 0; n < cases; n++) {
+        yuv2rgb_format_t format = (yuv2rgb_format_t)rnd_range(s, YUV2RGB_RGB24, YUV2RGB_BGRA32);
+        int bpp = yuv2rgb_bytes_per_pixel(format);
+        int w = rnd_range(s, 1, 96), h = rnd_range(s, 1, 64), cw = (w + 1) / 2;
+        int ys = w + rnd_range(s, 0, 96 - w), cs = cw + rnd_range(s, 0, 48 - cw);
+        int rs = w * bpp + rnd_range(s, 0, 2) * 16;
+        if (rs > 96 * 4) rs = w * bpp;
+        if (n % 64 == 0) {
+            fill_plane(s, y, 96, 80, 96, 255);
+            fill_plane(s, u, 48, 40, 48, 255);
+            fill_plane(s, v, 48, 40, 48, 255);
+        }
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1) TIMED(r->test_ticks, yuv420_to_rgb(format, w, h, y, u, v, ys, cs, cs, b, rs));
+            else TIMED(r->ref_ticks, ref_yuv420_to_rgb(format, w, h, y, u, v, ys, cs, cs, a, rs));
+        }
+        if (memcmp(a, b, sizeof(a))) mismatch(r, n);
+        r->blocks += (unsigned long)(w * h + 255) / 256;
+    }
+    r->cases += cases;
+}
+
+// Scaled conversion from and to random sizes, both filters; one block is
+// 16x16 output pixels
+static void check_yuv2rgb_scaled(result_t *r, uint32_t *s, unsigned long cases) {
+    static u8 y[96 * 80], u[48 * 40], v[48 * 40], a[96 * 4 * 80], b[96 * 4 * 80];
+    for (unsigned long n = 0; n < cases; n++) {
+        yuv2rgb_format_t format = (yuv2rgb_format_t)rnd_range(s, YUV2RGB_RGB24, YUV2RGB_BGRA32);
+        yuv2rgb_filter_t filter = (yuv2rgb_filter_t)rnd_range(s, YUV2RGB_NEAREST, YUV2RGB_BILINEAR);
+        int bpp = yuv2rgb_bytes_per_pixel(format);
+        int w = rnd_range(s, 1, 96), h = rnd_range(s, 1, 80), cw = (w + 1) / 2;
+        int dw = rnd_range(s, 1, 96), dh = rnd_range(s, 1, 80);
+        int ys = w + rnd_range(s, 0, 96 - w), cs = cw + rnd_range(s, 0, 48 - cw);
+        if (n % 64 == 0) {
+            fill_plane(s, y, 96, 80, 96, 255);
+            fill_plane(s, u, 48, 40, 48, 255);
+            fill_plane(s, v, 48, 40, 48, 255);
+        }
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1)
+                TIMED(r->test_ticks, yuv420_to_rgb_scaled(format, filter, w, h, y, u, v, ys, cs, cs,
+                                                          b, dw, dh, dw * bpp));
+            else
+                TIMED(r->ref_ticks, ref_yuv420_to_rgb_scaled(format, filter, w, h, y, u, v, ys, cs, cs,
+                                                             a, dw, dh, dw * bpp));
+        }
+        if (memcmp(a, b, sizeof(a))) mismatch(r, n);
+        r->blocks += (unsigned long)(dw * dh + 255) / 256;
+    }
+    r->cases += cases;
+}
+
+// MPEG-4 8x8 IDCT and the intra block store. Sparse blocks like real ones
+// mostly, full-range noise now and then for the overflow corners.
+static void check_mpeg4_idct(result_t *r, uint32_t *s, unsigned long cases) {
+    for (unsigned long n = 0; n < cases; n++) {
+        int16_t a[64], b[64];
+        u8 pa[64], pb[64];
+        int density = n % 8 == 0 ? 64 : rnd_range(s, 1, 12);
+        int amp = n % 8 == 0 ? 2047 : rnd_range(s, 1, 300);
+        for (int i = 0; i < 64; i++) a[i] = rnd(s) % 64 < (u32)density ? rnd_range(s, -amp, amp) : 0;
+        memcpy(b, a, sizeof(a));
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1) TIMED(r->test_ticks, mpeg4_idct(b); mpeg4_put_block(b, pb, 8));
+            else TIMED(r->ref_ticks, mpeg4_idct_c(a); mpeg4_put_block_c(a, pa, 8));
+        }
+        if (memcmp(a, b, sizeof(a)) || memcmp(pa, pb, sizeof(pa))) mismatch(r, n);
+        r->blocks++;
+    }
+    r->cases += cases;
+}
+
+// Half-pel MPEG-4 prediction of 8x8 and 16x16 blocks from a reference with
+// one row and column past the block
+static void check_mpeg4_mc(result_t *r, uint32_t *s, unsigned long cases) {
+    enum { STRIDE = 32 };
+    for (unsigned long n = 0; n < cases; n++) {
+        u8 src[17 * STRIDE], a[16 * STRIDE], b[16 * STRIDE];
+        int size = n & 1 ? 16 : 8;
+        int dxy = rnd(s) & 3, rounding = rnd(s) & 1;
+        for (size_t i = 0; i < sizeof(src); i++) src[i] = (u8)rnd(s);
+        memset(a, 0, sizeof(a));
+        memset(b, 0, sizeof(b));
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1) TIMED(r->test_ticks, mpeg4_mc(b, src, STRIDE, size, dxy, rounding));
+            else TIMED(r->ref_ticks, mpeg4_mc_c(a, src, STRIDE, size, dxy, rounding));
+        }
+        if (memcmp(a, b, sizeof(a))) mismatch(r, n);
+        r->blocks++;
+    }
+    r->cases += cases;
+}
+
+// CBC decryption of random keys and lengths, from 1 to 64 blocks (the
+// 4-block lanes and their tails), in place now and then
+static void check_aes(result_t *r, uint32_t *s, unsigned long cases) {
+    enum { MAX_BLOCKS = 64 };
+    static uint8_t src[MAX_BLOCKS * AES_BLOCK], a[MAX_BLOCKS * AES_BLOCK], b[MAX_BLOCKS * AES_BLOCK];
+    for (unsigned long n = 0; n < cases; n++) {
+        uint8_t key[AES_BLOCK], iv[AES_BLOCK], iv_a[AES_BLOCK], iv_b[AES_BLOCK];
+        for (int i = 0; i < AES_BLOCK; i++) key[i] = (uint8_t)rnd(s), iv[i] = (uint8_t)rnd(s);
+        size_t blocks = (size_t)rnd_range(s, 1, MAX_BLOCKS);
+        for (size_t i = 0; i < blocks * AES_BLOCK; i++) src[i] = (uint8_t)rnd(s);
+        int in_place = n % 4 == 0;
+        memcpy(iv_a, iv, AES_BLOCK);
+        memcpy(iv_b, iv, AES_BLOCK);
+        memcpy(b, src, blocks * AES_BLOCK);
+        aes128_t aes;
+        aes128_init(&aes, key);
+        for (int k = 0; k < 2; k++) {
+            if ((k ^ n) & 1) TIMED(r->test_ticks, aes128_cbc_decrypt(&aes, iv_b, in_place ? b : src, b, blocks));
+            else TIMED(r->ref_ticks, aes128_cbc_decrypt_c(&aes, iv_a, src, a, blocks));
+        }
+        if (memcmp(a, b, blocks * AES_BLOCK) || memcmp(iv_a, iv_b, AES_BLOCK)) mismatch(r, n);
+        r->blocks += blocks;
+    }
+    r->cases += cases;
+}
+
+// The start code search as a plain byte loop
+static const uint8_t *ref_find_start_code(const uint8_t *p, const uint8_t *end) {
+    for (; end - p >= 3; p++)
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) return p;
+    return NULL;
+}
+
+// Every start code of a random buffer, found one after the other: noise
+// with few to many zeros, runs of them, three- and four-byte start codes
+// and near misses, at random alignments and lengths. One block is 64 bytes.
+static void check_start_codes(result_t *r, uint32_t *s, unsigned long cases) {
+    enum { SIZE = 4096 };
+    static uint8_t buf[SIZE + 64];
+    for (unsigned long n = 0; n < cases; n++) {
+        size_t offset = rnd(s) % 64, size = (size_t)rnd_range(s, 0, SIZE);
+        uint8_t *data = buf + offset;
+        uint32_t zeros = rnd(s) % 64;
+        for (size_t i = 0; i < size; i++) data[i] = rnd(s) % 256 < zeros ? 0 : (uint8_t)(rnd(s) | 1);
+        for (int k = rnd_range(s, 0, 8); k > 0 && size >= 4; k--) {
+            static const uint8_t codes[4][4] = {{0, 0, 1, 0x65}, {0, 0, 0, 1}, {0, 0, 2, 0}, {0, 0, 0, 0}};
+            memcpy(data + rnd(s) % (size - 3), codes[rnd(s) % 4], 4);
+        }
+        const uint8_t *end = data + size, *p = data;
+        for (;;) {
+            const uint8_t *a = NULL, *b = NULL;
+            for (int k = 0; k < 2; k++) {
+                if ((k ^ n) & 1) TIMED(r->test_ticks, b = nal_find_start_code(p, end));
+                else TIMED(r->ref_ticks, a = ref_find_start_code(p, end));
+            }
+            if (a != b) {
+                mismatch(r, n);
+                break;
+            }
+            if (!a) break;
+            p = a + 1;
+        }
+        r->blocks += (size + 63) / 64;
+    }
+    r->cases += cases;
+}
+
+typedef void (*check_fn)(result_t *r, uint32_t *s, unsigned long cases);
+
+// Makes version i of a kernel's table the one used, see include/cpu.h:
+// 1 when it is, 0 when the CPU does not run it, -1 past the last one
+typedef int (*use_version_fn)(size_t i, const char **name);
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-n cases] [-s seed]\n"
+                    "  -n  random cases per kernel (default 20000)\n"
+                    "  -s  random seed (default: the time)\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    unsigned long cases = 20000;
+    uint32_t seed = (uint32_t)time(NULL);
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n': cases = strtoul(optarg, NULL, 0); break;
+        case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (!seed) seed = 1;
+    mpeg4_dsp_init();
+
+    static const struct {
+        const char *name;
+        const char *block;
+        check_fn check;
+        use_version_fn use;     // NULL: picked at compile time
+    } kernels[] = {
+        {"interpolation", "partition", check_interpolation, NULL},
+        {"transform 4x4", "block", check_transform, NULL},
+        {"luma DC", "block", check_luma_dc, NULL},
+        {"chroma DC", "block", check_chroma_dc, NULL},
+        {"intra", "mb", check_intra, NULL},
+        {"deblocking", "mb", check_deblock, NULL},
+        {"yuv420->rgb", "16x16", check_yuv2rgb, yuv2rgb_use_version},
+        {"scaled ->rgb", "16x16", check_yuv2rgb_scaled, yuv2rgb_use_version},
+        {"start codes", "64 bytes", check_start_codes, nal_scan_use_version},
+        {"mpeg4 IDCT", "block", check_mpeg4_idct, mpeg4_dsp_use_version},
+        {"mpeg4 MC", "block", check_mpeg4_mc, mpeg4_dsp_use_version},
+        {"aes-128 cbc", "block", check_aes, aes128_use_version},
+    };
+    static result_t results[64];
+    size_t count = 0;
+    uint32_t s = seed;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        // Every version the CPU runs; the C one where there are none
+        size_t checked = 0;
+        for (size_t i = 0; kernels[k].use && count < sizeof(results) / sizeof(results[0]); i++) {
+            const char *version;
+            int used = kernels[k].use(i, &version);
+            if (used < 0) break;
+            if (!used) continue;
+            results[count] = (result_t){.name = kernels[k].name, .version = version, .block = kernels[k].block};
+            kernels[k].check(&results[count++], &s, cases);
+            checked++;
+        }
+        if (!checked && count < sizeof(results) / sizeof(results[0])) {
+            results[count] = (result_t){.name = kernels[k].name, .version = kernels[k].use ? "c" : VARIANT,
+                                        .block = kernels[k].block};
+            kernels[k].check(&results[count++], &s, cases);
+        }
+    }
+
+    char features[64];
+    cpu_feature_names(cpu_features(), features, sizeof(features));
+    printf("Kernels:    against the C reference, %lu cases each, seed %u\n", cases, seed);
+    printf("CPU:        %s\n", features);
+    printf("%-14s %-7s %-9s %10s %12s %12s %8s\n", "kernel", "version", "per", "mismatches",
+           "C " TICK_UNIT, TICK_UNIT, "speedup");
+    unsigned long failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+        double ref = r->blocks ? (double)r->ref_ticks / r->blocks : 0;
+        double test = r->blocks ? (double)r->test_ticks / r->blocks : 0;
+        printf("%-14s %-7s %-9s %10lu %12.1f %12.1f %7.2fx\n", r->name, r->version, r->block, r->mismatches,
+               ref, test, test > 0 ? ref / test : 0.0);
+        failed += r->mismatches;
+    }
+    if (failed) printf("FAILED: %lu case(s) differ from the C reference\n", failed);
+    return failed ? 1 : 0;
+}
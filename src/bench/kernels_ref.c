@@ -0,0 +1,72 @@
+// Scalar reference kernels for bin/kernels: the C versions of the h264bsd
+// motion compensation, transform, intra prediction and deblocking and of
+// the RGB conversion, built with H264DEC_NO_SIMD and YUV2RGB_NO_SIMD into
+// this one translation unit. Every external symbol gets a ref_ prefix so
+// they link next to the kernels the decoder is built with.
+#ifndef H264DEC_NO_SIMD
+#define H264DEC_NO_SIMD
+#endif
+#ifndef YUV2RGB_NO_SIMD
+#define YUV2RGB_NO_SIMD
+#endif
+
+// The C paths have a few parameters that only the SIMD builds use
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+
+// h264bsd_reconstruct.c
+#define h264bsdPredictSamples           ref_h264bsdPredictSamples
+#define h264bsdFillBlock                ref_h264bsdFillBlock
+#define h264bsdFillRow7                 ref_h264bsdFillRow7
+#define h264bsdInterpolateChromaHor     ref_h264bsdInterpolateChromaHor
+#define h264bsdInterpolateChromaVer     ref_h264bsdInterpolateChromaVer
+#define h264bsdInterpolateChromaHorVer  ref_h264bsdInterpolateChromaHorVer
+#define h264bsdInterpolateVerHalf       ref_h264bsdInterpolateVerHalf
+#define h264bsdInterpolateVerQuarter    ref_h264bsdInterpolateVerQuarter
+#define h264bsdInterpolateHorHalf       ref_h264bsdInterpolateHorHalf
+#define h264bsdInterpolateHorQuarter    ref_h264bsdInterpolateHorQuarter
+#define h264bsdInterpolateHorVerQuarter ref_h264bsdInterpolateHorVerQuarter
+#define h264bsdInterpolateMidHalf       ref_h264bsdInterpolateMidHalf
+#define h264bsdInterpolateMidVerQuarter ref_h264bsdInterpolateMidVerQuarter
+#define h264bsdInterpolateMidHorQuarter ref_h264bsdInterpolateMidHorQuarter
+
+// h264bsd_deblocking.c
+#define h264bsdFilterPicture            ref_h264bsdFilterPicture
+#define h264bsdFilterPictureRows        ref_h264bsdFilterPictureRows
+#define GetBoundaryStrengthsA           ref_GetBoundaryStrengthsA
+#define InnerBoundaryStrength2          ref_InnerBoundaryStrength2
+#define sample                          ref_sample
+#define hashA                           ref_hashA
+#define hashB                           ref_hashB
+#define hashC                           ref_hashC
+#define hashD                           ref_hashD
+
+// h264bsd_transform.c
+#define h264bsdProcessBlock             ref_h264bsdProcessBlock
+#define h264bsdProcessLumaDc            ref_h264bsdProcessLumaDc
+#define h264bsdProcessChromaDc          ref_h264bsdProcessChromaDc
+
+// h264bsd_intra_prediction.c
+#define h264bsdIntraPrediction          ref_h264bsdIntraPrediction
+#define h264bsdIntra4x4Prediction       ref_h264bsdIntra4x4Prediction
+#define h264bsdIntra16x16Prediction     ref_h264bsdIntra16x16Prediction
+#define h264bsdIntraChromaPrediction    ref_h264bsdIntraChromaPrediction
+#define h264bsdGetNeighbourPels         ref_h264bsdGetNeighbourPels
+#define h264bsdAddResidual              ref_h264bsdAddResidual
+#define h264bsdBlockX                   ref_h264bsdBlockX
+#define h264bsdBlockY                   ref_h264bsdBlockY
+#define h264bsdClip                     ref_h264bsdClip
+#define get_h264bsdClip                 ref_get_h264bsdClip
+
+// yuv2rgb.c
+#define yuv420_to_rgb                   ref_yuv420_to_rgb
+#define yuv420_to_rgb24                 ref_yuv420_to_rgb24
+#define yuv420_to_rgb_scaled            ref_yuv420_to_rgb_scaled
+#define yuv420_to_rgb_scaled_rows       ref_yuv420_to_rgb_scaled_rows
+#define yuv2rgb_use_version             ref_yuv2rgb_use_version
+
+#include "../codecs/h264/h264bsd_reconstruct.c"
+#include "../codecs/h264/h264bsd_deblocking.c"
+#include "../codecs/h264/h264bsd_transform.c"
+#include "../codecs/h264/h264bsd_intra_prediction.c"
+#include "../convert/yuv2rgb.c"
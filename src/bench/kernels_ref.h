@@ -0,0 +1,30 @@
+#ifndef KERNELS_REF_H
+#define KERNELS_REF_H
+
+// Scalar reference kernels for bin/kernels, see kernels_ref.c
+
+#include "../codecs/h264/basetype.h"
+#include "../codecs/h264/h264bsd_image.h"
+#include "../codecs/h264/h264bsd_macroblock_layer.h"
+#include "../../include/yuv2rgb.h"
+#include <stdint.h>
+
+void ref_h264bsdPredictSamples(u8 *data, mv_t *mv, image_t *refPic,
+    u32 xA, u32 yA, u32 partX, u32 partY, u32 partWidth, u32 partHeight);
+u32 ref_h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap);
+void ref_h264bsdProcessLumaDc(i32 *data, u32 qp);
+void ref_h264bsdProcessChromaDc(i32 *data, u32 qp);
+u32 ref_h264bsdIntraPrediction(mbStorage_t *pMb, macroblockLayer_t *mbLayer,
+    image_t *image, u32 mbNum, u32 constrainedIntraPred, u8 *data);
+void ref_h264bsdFilterPictureRows(image_t *image, mbStorage_t *mb,
+    u32 firstRow, u32 numRows);
+void ref_yuv420_to_rgb(yuv2rgb_format_t format, int width, int height,
+                       const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                       int y_stride, int u_stride, int v_stride,
+                       uint8_t *dst, int dst_stride);
+int ref_yuv420_to_rgb_scaled(yuv2rgb_format_t format, yuv2rgb_filter_t filter, int width, int height,
+                             const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                             int y_stride, int u_stride, int v_stride,
+                             uint8_t *dst, int dst_width, int dst_height, int dst_stride);
+
+#endif // KERNELS_REF_H
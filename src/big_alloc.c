@@ -0,0 +1,180 @@
+// Large buffer allocator, see include/big_alloc.h. Every buffer starts
+// BIG_ALLOC_ALIGN bytes into its allocation, after a header saying how it
+// was allocated.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "../include/big_alloc.h"
+
+typedef struct {
+    size_t mapped;              // Length of the mapping, 0 if from malloc
+    size_t capacity;            // Usable bytes after the header
+} big_header_t;
+
+#define BIG_HEADER_SIZE BIG_ALLOC_ALIGN
+
+static int big_mapping = 1;     // ANHELO_HUGEPAGES != 0
+static size_t big_budget = (size_t)MEMORY_BUDGET_MB << 20;
+static atomic_size_t big_held = 0;
+static atomic_int big_reported = BIG_PRESSURE_NONE;  // Highest level said
+static pthread_once_t big_once = PTHREAD_ONCE_INIT;
+
+static void big_init(void) {
+    const char *env = getenv("ANHELO_HUGEPAGES");
+    big_mapping = !(env && strcmp(env, "0") == 0);
+    const char *budget = getenv("ANHELO_MEMORY_BUDGET");
+    if (budget && *budget) big_budget = (size_t)strtoul(budget, NULL, 10) << 20;
+}
+
+static big_header_t *header_of(void *p) {
+    return (big_header_t *)((uint8_t *)p - BIG_HEADER_SIZE);
+}
+
+// What a buffer costs against the budget
+static size_t held_by(const big_header_t *h) {
+    return h->mapped ? h->mapped : h->capacity + BIG_HEADER_SIZE;
+}
+
+#ifdef __linux__
+// Set once a MAP_HUGETLB mapping failed: none are reserved
+static atomic_int hugetlb_failed = 0;
+
+// Fault the pages in now
+static void populate(uint8_t *p, size_t len) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(p, len, MADV_POPULATE_WRITE) == 0) return;
+#endif
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < len; off += (size_t)(page > 0 ? page : 4096)) p[off] = 0;
+}
+
+// len bytes aligned to BIG_ALLOC_HUGE: map a huge page more and unmap the
+// ends, so transparent huge pages can back all of it
+static uint8_t *map_thp(size_t len) {
+    size_t span = len + BIG_ALLOC_HUGE;
+    uint8_t *p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    uint8_t *aligned = (uint8_t *)(((uintptr_t)p + BIG_ALLOC_HUGE - 1) & ~(uintptr_t)(BIG_ALLOC_HUGE - 1));
+    if (aligned > p) munmap(p, (size_t)(aligned - p));
+    if (p + span > aligned + len) munmap(aligned + len, (size_t)(p + span - (aligned + len)));
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, len, MADV_HUGEPAGE);
+#endif
+    populate(aligned, len);
+    return aligned;
+}
+
+static void *big_map(size_t size) {
+    if (size > SIZE_MAX - BIG_HEADER_SIZE - BIG_ALLOC_HUGE) return NULL;
+    size_t len = (size + BIG_HEADER_SIZE + BIG_ALLOC_HUGE - 1) & ~(size_t)(BIG_ALLOC_HUGE - 1);
+    uint8_t *base = NULL;
+#ifdef MAP_HUGETLB
+    if (len >= BIG_ALLOC_HUGE && !atomic_load_explicit(&hugetlb_failed, memory_order_relaxed)) {
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (base == MAP_FAILED) {
+            base = NULL;
+            atomic_store_explicit(&hugetlb_failed, 1, memory_order_relaxed);
+        }
+    }
+#endif
+    if (!base && size + BIG_HEADER_SIZE >= BIG_ALLOC_HUGE) base = map_thp(len);
+    if (!base) {
+        // Under a huge page: whole small pages are enough
+        long page = sysconf(_SC_PAGESIZE);
+        size_t mask = (size_t)(page > 0 ? page : 4096) - 1;
+        len = (size + BIG_HEADER_SIZE + mask) & ~mask;
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (base == MAP_FAILED) return NULL;
+    }
+    big_header_t *h = (big_header_t *)base;
+    h->mapped = len;
+    h->capacity = len - BIG_HEADER_SIZE;
+    return base + BIG_HEADER_SIZE;
+}
+#endif
+
+void *big_alloc(size_t size) {
+    pthread_once(&big_once, big_init);
+#ifdef __linux__
+    if (big_mapping && size >= BIG_ALLOC_MIN) {
+        void *p = big_map(size);
+        if (p) {
+            atomic_fetch_add_explicit(&big_held, held_by(header_of(p)), memory_order_relaxed);
+            return p;
+        }
+    }
+#endif
+    void *base;
+    if (size > SIZE_MAX - BIG_HEADER_SIZE || posix_memalign(&base, BIG_ALLOC_ALIGN, size + BIG_HEADER_SIZE) != 0)
+        return NULL;
+    big_header_t *h = base;
+    h->mapped = 0;
+    h->capacity = size;
+    atomic_fetch_add_explicit(&big_held, held_by(h), memory_order_relaxed);
+    return (uint8_t *)base + BIG_HEADER_SIZE;
+}
+
+void *big_realloc(void *p, size_t size) {
+    if (!p) return big_alloc(size);
+    big_header_t *h = header_of(p);
+    // Never moved to shrink; a mapping has room up to its last page
+    if (size <= h->capacity) return p;
+    void *q = big_alloc(size);
+    if (!q) return NULL;
+    memcpy(q, p, h->capacity < size ? h->capacity : size);
+    big_free(p);
+    return q;
+}
+
+void big_free(void *p) {
+    if (!p) return;
+    big_header_t *h = header_of(p);
+    atomic_fetch_sub_explicit(&big_held, held_by(h), memory_order_relaxed);
+#ifdef __linux__
+    if (h->mapped) {
+        munmap(h, h->mapped);
+        return;
+    }
+#endif
+    free(h);
+}
+
+size_t big_alloc_held(void) {
+    return atomic_load_explicit(&big_held, memory_order_relaxed);
+}
+
+size_t big_alloc_budget(void) {
+    pthread_once(&big_once, big_init);
+    return big_budget;
+}
+
+big_pressure_t big_alloc_pressure(void) {
+    size_t budget = big_alloc_budget();
+    if (!budget) return BIG_PRESSURE_NONE;
+    size_t held = big_alloc_held();
+    big_pressure_t level = held >= budget / 100 * 95 ? BIG_PRESSURE_RENDITION
+                         : held >= budget / 100 * 85 ? BIG_PRESSURE_DPB
+                         : held >= budget / 100 * 70 ? BIG_PRESSURE_PREFETCH
+                         : BIG_PRESSURE_NONE;
+    int reported = atomic_load_explicit(&big_reported, memory_order_relaxed);
+    while ((int)level > reported &&
+           !atomic_compare_exchange_weak_explicit(&big_reported, &reported, (int)level,
+                                                  memory_order_relaxed, memory_order_relaxed)) {}
+    if ((int)level > reported) {
+        static const char *const actions[] = {
+            "", "shrinking the prefetch", "limiting DPB sizes", "stepping down renditions",
+        };
+        fprintf(stderr, "Memory: %zu MB held of a %zu MB budget, %s\n",
+                held >> 20, budget >> 20, actions[level]);
+    }
+    return level;
+}
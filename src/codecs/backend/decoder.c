@@ -0,0 +1,192 @@
+// Decoder backend registry: picks an implementation per codec and
+// forwards calls through its vtable
+#include "../../../include/decoder.h"
+#include "../../../include/memory_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+extern const decoder_backend_t decoder_h264bsd;
+#ifdef USE_SIMPLE_H264
+extern const decoder_backend_t decoder_simple_h264;
+#endif
+#ifdef USE_MPEG4
+extern const decoder_backend_t decoder_mpeg4;
+#endif
+#ifndef NO_FFMPEG
+extern const decoder_backend_t decoder_ffmpeg;
+#endif
+
+const decoder_backend_t *const decoder_backends[] = {
+    &decoder_h264bsd,
+#ifndef NO_FFMPEG
+    &decoder_ffmpeg,
+#endif
+#ifdef USE_MPEG4
+    &decoder_mpeg4,
+#endif
+#ifdef USE_SIMPLE_H264
+    &decoder_simple_h264,   // Test pattern only, never preferred
+#endif
+    NULL
+};
+
+struct decoder {
+    const decoder_backend_t *backend;
+    void *ctx;
+    unsigned output;        // DECODER_OUTPUT_* flags
+    frame_pool_t *reduced_pool;
+    frame_t *reduced;       // The last reduced picture
+    uint8_t *gray;          // Chroma of reduced at its size is gray, NULL if not
+};
+
+static const decoder_backend_t *find_backend(unsigned codec, const char *name) {
+    if (name) {
+        for (size_t i = 0; decoder_backends[i]; i++) {
+            const decoder_backend_t *b = decoder_backends[i];
+            if ((b->caps & codec) && strcmp(b->name, name) == 0) return b;
+        }
+    }
+    for (size_t i = 0; decoder_backends[i]; i++) {
+        if (decoder_backends[i]->caps & codec) return decoder_backends[i];
+    }
+    return NULL;
+}
+
+decoder_t *decoder_create(unsigned codec, const char *name) {
+    const decoder_backend_t *b = find_backend(codec, name);
+    if (!b) return NULL;
+    decoder_t *dec = calloc(1, sizeof(*dec));
+    if (!dec) return NULL;
+    dec->backend = b;
+    dec->ctx = b->create();
+    if (!dec->ctx) {
+        free(dec);
+        return NULL;
+    }
+    return dec;
+}
+
+void decoder_destroy(decoder_t *dec) {
+    if (!dec) return;
+    dec->backend->destroy(dec->ctx);
+    frame_unref(dec->reduced);
+    frame_pool_destroy(dec->reduced_pool);
+    free(dec);
+}
+
+int decoder_decode(decoder_t *dec, const uint8_t *data, size_t size) {
+    if (!dec || !data || size == 0) return -1;
+    return dec->backend->decode(dec->ctx, data, size);
+}
+
+// Box filter `src` down by `factor` into a w x h plane. Source pixels
+// past sw x sh repeat the last column or row.
+static void scale_plane(uint8_t *dst, int dst_stride, int w, int h, const uint8_t *src, int stride,
+                        int sw, int sh, int factor) {
+    int shift = factor == 4 ? 4 : 2;
+    for (int y = 0; y < h; y++) {
+        const uint8_t *rows[4];
+        for (int j = 0; j < factor; j++) {
+            int sy = y * factor + j;
+            rows[j] = src + (size_t)(sy < sh ? sy : sh - 1) * stride;
+        }
+        for (int x = 0; x < w; x++) {
+            unsigned sum = 0;
+            for (int i = 0; i < factor; i++) {
+                int sx = x * factor + i;
+                if (sx >= sw) sx = sw - 1;
+                for (int j = 0; j < factor; j++) sum += rows[j][sx];
+            }
+            dst[(size_t)y * dst_stride + x] = (uint8_t)((sum + (1u << (shift - 1))) >> shift);
+        }
+    }
+}
+
+// Replace `pic` by its reduced version in a frame of dec->reduced_pool,
+// kept until the next picture. Without scaling only its chroma is used.
+static int reduce_picture(decoder_t *dec, decoder_picture_t *pic) {
+    int factor = (dec->output & DECODER_OUTPUT_QUARTER) ? 4 :
+                 (dec->output & DECODER_OUTPUT_HALF) ? 2 : 1;
+    int w = pic->width / factor, h = pic->height / factor;
+    if (w < 2 || h < 2) return 0;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    if (!dec->reduced_pool && !(dec->reduced_pool = frame_pool_create(1))) return -1;
+    int same_size = dec->reduced && dec->reduced->width == w && dec->reduced->height == h;
+    frame_unref(dec->reduced);
+    dec->reduced = frame_pool_get(dec->reduced_pool, FRAME_YUV420, w, h);
+    if (!dec->reduced) return -1;
+    frame_t *f = dec->reduced;
+    if (dec->output & DECODER_OUTPUT_GRAY) {
+        // The frame keeps its memory while the size stays
+        if (!same_size || dec->gray != f->memory) {
+            memset(f->planes[1], 128, (size_t)f->strides[1] * ch);
+            memset(f->planes[2], 128, (size_t)f->strides[2] * ch);
+            dec->gray = f->memory;
+        }
+    } else {
+        int scw = (pic->width + 1) / 2, sch = (pic->height + 1) / 2;
+        scale_plane(f->planes[1], f->strides[1], cw, ch, pic->u, pic->uv_stride, scw, sch, factor);
+        scale_plane(f->planes[2], f->strides[2], cw, ch, pic->v, pic->uv_stride, scw, sch, factor);
+        dec->gray = NULL;
+    }
+    if (factor > 1) {
+        scale_plane(f->planes[0], f->strides[0], w, h, pic->y, pic->y_stride, pic->width, pic->height, factor);
+        pic->y = f->planes[0];
+        pic->y_stride = f->strides[0];
+    }
+    pic->u = f->planes[1];
+    pic->v = f->planes[2];
+    pic->uv_stride = f->strides[1];
+    pic->width = w;
+    pic->height = h;
+    return 0;
+}
+
+int decoder_get_picture(decoder_t *dec, decoder_picture_t *pic) {
+    if (!dec) return 0;
+    int got = dec->backend->get_picture(dec->ctx, pic);
+    if (got && dec->output && reduce_picture(dec, pic) < 0) return 0;
+    return got;
+}
+
+void decoder_flush(decoder_t *dec) {
+    if (dec) dec->backend->flush(dec->ctx);
+}
+
+void decoder_set_skip(decoder_t *dec, unsigned skip) {
+    if (dec && dec->backend->set_skip) dec->backend->set_skip(dec->ctx, skip);
+}
+
+void *decoder_hold_picture(decoder_t *dec) {
+    if (!dec || !dec->backend->hold_picture || dec->output) return NULL;
+    return dec->backend->hold_picture(dec->ctx);
+}
+
+void decoder_release_picture(decoder_t *dec, void *handle) {
+    if (dec && handle) dec->backend->release_picture(dec->ctx, handle);
+}
+
+void decoder_set_low_latency(decoder_t *dec, int on) {
+    if (dec && dec->backend->set_low_latency) dec->backend->set_low_latency(dec->ctx, on);
+}
+
+int decoder_get_delay(decoder_t *dec) {
+    if (!dec || !dec->backend->get_delay) return -1;
+    return dec->backend->get_delay(dec->ctx);
+}
+
+void decoder_set_output(decoder_t *dec, unsigned output) {
+    if (!dec) return;
+    dec->output = output;
+    if (dec->backend->set_luma_only)
+        dec->backend->set_luma_only(dec->ctx, (output & DECODER_OUTPUT_GRAY) != 0);
+}
+
+unsigned long decoder_concealed_mbs(decoder_t *dec) {
+    if (!dec || !dec->backend->concealed_mbs) return 0;
+    return dec->backend->concealed_mbs(dec->ctx);
+}
+
+const decoder_backend_t *decoder_backend(const decoder_t *dec) {
+    return dec ? dec->backend : NULL;
+}
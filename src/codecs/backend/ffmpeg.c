@@ -0,0 +1,119 @@
+// H.264 backend on libavcodec (builds with FFmpeg only), on the GPU with
+// ANHELO_HWACCEL (include/hwaccel.h)
+#include "../../../include/decoder.h"
+#include "../../../include/hwaccel.h"
+#include <libavcodec/avcodec.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    AVCodecContext *codec;
+    AVFrame *frame;
+    AVPacket *packet;
+    uint8_t *annexb;    // Start code + NAL: packets are fed as Annex-B
+    size_t capacity;
+    hwaccel_t *hw;
+    const AVFrame *shown;   // Frame whose planes get_picture() handed out, NULL for a copy
+} ffmpeg_ctx_t;
+
+static void ffmpeg_destroy(void *ctx) {
+    ffmpeg_ctx_t *c = ctx;
+    avcodec_free_context(&c->codec);
+    hwaccel_destroy(c->hw);
+    av_frame_free(&c->frame);
+    av_packet_free(&c->packet);
+    free(c->annexb);
+    free(c);
+}
+
+static void *ffmpeg_create(void) {
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (!codec) return NULL;
+    ffmpeg_ctx_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->codec = avcodec_alloc_context3(codec);
+    c->frame = av_frame_alloc();
+    c->packet = av_packet_alloc();
+    if (c->codec) c->hw = hwaccel_attach(c->codec, codec, getenv("ANHELO_HWACCEL"));
+    if (!c->codec || !c->frame || !c->packet || avcodec_open2(c->codec, codec, NULL) < 0) {
+        ffmpeg_destroy(c);
+        return NULL;
+    }
+    return c;
+}
+
+static int ffmpeg_decode(void *ctx, const uint8_t *data, size_t size) {
+    ffmpeg_ctx_t *c = ctx;
+    if (size + 4 > c->capacity) {
+        uint8_t *p = realloc(c->annexb, size + 4 + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!p) return -1;
+        c->annexb = p;
+        c->capacity = size + 4;
+    }
+    static const uint8_t start_code[4] = {0, 0, 0, 1};
+    memcpy(c->annexb, start_code, 4);
+    memcpy(c->annexb + 4, data, size);
+    memset(c->annexb + 4 + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    c->packet->data = c->annexb;
+    c->packet->size = (int)(size + 4);
+    int ret = avcodec_send_packet(c->codec, c->packet);
+    return (ret < 0 && ret != AVERROR(EAGAIN)) ? -1 : 0;
+}
+
+static int ffmpeg_get_picture(void *ctx, decoder_picture_t *pic) {
+    ffmpeg_ctx_t *c = ctx;
+    while (avcodec_receive_frame(c->codec, c->frame) == 0) {
+        // Only 4:2:0 is handed on; anything else would need converting
+        const AVFrame *frame = hwaccel_download(c->hw, c->frame);
+        int own = frame ? hwaccel_picture(c->hw, frame, pic) : -1;
+        if (own < 0) continue;
+        c->shown = own ? frame : NULL;
+        return 1;
+    }
+    return 0;
+}
+
+static void ffmpeg_flush(void *ctx) {
+    ffmpeg_ctx_t *c = ctx;
+    avcodec_send_packet(c->codec, NULL);
+}
+
+static void ffmpeg_set_skip(void *ctx, unsigned skip) {
+    ffmpeg_ctx_t *c = ctx;
+    c->codec->skip_loop_filter = (skip & DECODER_SKIP_NONREF_DEBLOCK) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+// A held picture is a new reference to the buffers of the frame shown,
+// the decoded one or its download; split NV12 can't be held
+static void *ffmpeg_hold_picture(void *ctx) {
+    ffmpeg_ctx_t *c = ctx;
+    return c->shown ? av_frame_clone(c->shown) : NULL;
+}
+
+static void ffmpeg_release_picture(void *ctx, void *handle) {
+    (void)ctx;
+    AVFrame *frame = handle;
+    av_frame_free(&frame);
+}
+
+// libavcodec already sizes its reordering from the VUI (has_b_frames);
+// frame threads each hold one more picture
+static int ffmpeg_get_delay(void *ctx) {
+    ffmpeg_ctx_t *c = ctx;
+    int threads = (c->codec->active_thread_type & FF_THREAD_FRAME) ? c->codec->thread_count - 1 : 0;
+    return c->codec->has_b_frames + threads;
+}
+
+const decoder_backend_t decoder_ffmpeg = {
+    .name = "ffmpeg",
+    .caps = DECODER_CAP_H264 | DECODER_CAP_REORDER,
+    .create = ffmpeg_create,
+    .destroy = ffmpeg_destroy,
+    .decode = ffmpeg_decode,
+    .get_picture = ffmpeg_get_picture,
+    .flush = ffmpeg_flush,
+    .set_skip = ffmpeg_set_skip,
+    .hold_picture = ffmpeg_hold_picture,
+    .release_picture = ffmpeg_release_picture,
+    .get_delay = ffmpeg_get_delay,
+};
@@ -0,0 +1,379 @@
+// GOP-parallel decoding, see include/gop_parallel.h. The ranges handed to
+// the workers are a list in stream order; each worker takes the oldest one
+// nobody has taken yet, and the feeding thread hands on their pictures
+// from the head of the list as they are done. Range structures are kept
+// for reuse with their buffers, so a steady stream stops allocating.
+#include "../../../include/gop_parallel.h"
+#include "../../../include/big_alloc.h"
+#include "../../../include/bitstream.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GOP_MAX_SPS 32
+#define GOP_MAX_PPS 256
+
+typedef struct {
+    size_t offset, size;
+} gop_unit_t;
+
+typedef struct {
+    uint8_t *memory;
+    size_t capacity;
+    decoder_picture_t pic;
+} gop_picture_t;
+
+typedef struct gop_range {
+    struct gop_range *next;
+    // NAL units, back to back
+    uint8_t *data;
+    size_t size, capacity;
+    gop_unit_t *units;
+    size_t count, units_capacity;
+    int has_slices;
+    // Pictures decoded from them, in display order
+    gop_picture_t *pictures;
+    size_t picture_count, pictures_capacity;
+    int done;
+} gop_range_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} gop_parameter_set_t;
+
+struct gop_parallel {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;         // A range queued or done, or stopping
+    pthread_t threads[GOP_PARALLEL_MAX_WORKERS];
+    decoder_t *decoders[GOP_PARALLEL_MAX_WORKERS];
+    int workers, started;
+    gop_picture_fn fn;
+    void *user;
+    gop_range_t *head, *tail;       // Handed to the workers, oldest first
+    gop_range_t *pending;           // Oldest not taken by a worker yet
+    size_t in_flight;
+    gop_range_t *spare;
+    int stop;
+    // Feeding thread only
+    gop_range_t *current;           // Range being fed
+    unsigned long ranges, empty;    // Handed on, and of those with slices but no pictures
+    size_t tail_from;               // Its units after its last slice
+    gop_parameter_set_t sps[GOP_MAX_SPS], pps[GOP_MAX_PPS];
+};
+
+// Ranges handed to the workers at most: one being decoded and one done or
+// waiting each
+static size_t max_in_flight(const gop_parallel_t *g) {
+    return (size_t)g->workers * 2;
+}
+
+static int append_unit(gop_range_t *r, const uint8_t *data, size_t size) {
+    if (r->size + size > r->capacity) {
+        size_t capacity = r->capacity ? r->capacity * 2 : 1 << 20;
+        while (capacity < r->size + size) capacity *= 2;
+        uint8_t *p = big_realloc(r->data, capacity);
+        if (!p) return -1;
+        r->data = p;
+        r->capacity = capacity;
+    }
+    if (r->count == r->units_capacity) {
+        size_t capacity = r->units_capacity ? r->units_capacity * 2 : 256;
+        gop_unit_t *u = realloc(r->units, capacity * sizeof(*u));
+        if (!u) return -1;
+        r->units = u;
+        r->units_capacity = capacity;
+    }
+    memcpy(r->data + r->size, data, size);
+    r->units[r->count].offset = r->size;
+    r->units[r->count].size = size;
+    r->count++;
+    r->size += size;
+    return 0;
+}
+
+static void free_range(gop_range_t *r) {
+    for (size_t i = 0; i < r->pictures_capacity; i++) big_free(r->pictures[i].memory);
+    free(r->pictures);
+    free(r->units);
+    big_free(r->data);
+    free(r);
+}
+
+// A range to feed, starting with the parameter sets known so far. The
+// caller sets tail_from, which still belongs to the range being cut.
+static gop_range_t *open_range(gop_parallel_t *g) {
+    pthread_mutex_lock(&g->lock);
+    gop_range_t *r = g->spare;
+    if (r) g->spare = r->next;
+    pthread_mutex_unlock(&g->lock);
+    if (!r && !(r = calloc(1, sizeof(*r)))) return NULL;
+    r->next = NULL;
+    r->size = r->count = r->picture_count = 0;
+    r->has_slices = r->done = 0;
+    for (size_t i = 0; i < GOP_MAX_SPS; i++) {
+        if (g->sps[i].data && append_unit(r, g->sps[i].data, g->sps[i].size) != 0) goto fail;
+    }
+    for (size_t i = 0; i < GOP_MAX_PPS; i++) {
+        if (g->pps[i].data && append_unit(r, g->pps[i].data, g->pps[i].size) != 0) goto fail;
+    }
+    return r;
+fail:
+    free_range(r);
+    return NULL;
+}
+
+// Remember an SPS or PPS by its id for the ranges after it
+static int keep_parameter_set(gop_parallel_t *g, const uint8_t *data, size_t size) {
+    uint8_t rbsp[16];
+    size_t n = bits_unescape(rbsp, data + 1, size - 1 < sizeof(rbsp) ? size - 1 : sizeof(rbsp));
+    bit_reader_t br;
+    init_bits(&br, rbsp, n);
+    gop_parameter_set_t *set;
+    if ((data[0] & 0x1f) == 7) {
+        // profile_idc, the constraint flags and level_idc come first
+        skip_bits(&br, 24);
+        uint32_t id = get_ue(&br);
+        if (bits_left(&br) < 0 || id >= GOP_MAX_SPS) return 0;
+        set = &g->sps[id];
+    } else {
+        uint32_t id = get_ue(&br);
+        if (bits_left(&br) < 0 || id >= GOP_MAX_PPS) return 0;
+        set = &g->pps[id];
+    }
+    uint8_t *copy = malloc(size);
+    if (!copy) return -1;
+    memcpy(copy, data, size);
+    free(set->data);
+    set->data = copy;
+    set->size = size;
+    return 0;
+}
+
+// Under the lock: hand on the done ranges at the head of the list
+static void deliver(gop_parallel_t *g) {
+    while (g->head && g->head->done) {
+        gop_range_t *r = g->head;
+        g->head = r->next;
+        if (!g->head) g->tail = NULL;
+        g->in_flight--;
+        g->ranges++;
+        if (r->has_slices && r->picture_count == 0) g->empty++;
+        pthread_mutex_unlock(&g->lock);
+        for (size_t i = 0; i < r->picture_count; i++) g->fn(&r->pictures[i].pic, g->user);
+        pthread_mutex_lock(&g->lock);
+        r->next = g->spare;
+        g->spare = r;
+        pthread_cond_broadcast(&g->changed);
+    }
+}
+
+// Queue a range for the workers, waiting for room
+static void submit(gop_parallel_t *g, gop_range_t *r) {
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        deliver(g);
+        if (g->in_flight < max_in_flight(g)) break;
+        pthread_cond_wait(&g->changed, &g->lock);
+    }
+    r->next = NULL;
+    if (g->tail) g->tail->next = r;
+    else g->head = r;
+    g->tail = r;
+    if (!g->pending) g->pending = r;
+    g->in_flight++;
+    pthread_cond_broadcast(&g->changed);
+    pthread_mutex_unlock(&g->lock);
+}
+
+// A copy of every picture the decoder has ready, in r
+static void take_pictures(decoder_t *dec, gop_range_t *r) {
+    decoder_picture_t pic;
+    while (decoder_get_picture(dec, &pic)) {
+        if (r->picture_count == r->pictures_capacity) {
+            size_t capacity = r->pictures_capacity ? r->pictures_capacity * 2 : 64;
+            gop_picture_t *p = realloc(r->pictures, capacity * sizeof(*p));
+            if (!p) continue;
+            memset(p + r->pictures_capacity, 0, (capacity - r->pictures_capacity) * sizeof(*p));
+            r->pictures = p;
+            r->pictures_capacity = capacity;
+        }
+        gop_picture_t *out = &r->pictures[r->picture_count];
+        int cw = (pic.width + 1) / 2, ch = (pic.height + 1) / 2;
+        size_t luma = (size_t)pic.width * pic.height, chroma = (size_t)cw * ch;
+        if (out->capacity < luma + 2 * chroma) {
+            big_free(out->memory);
+            out->memory = big_alloc(luma + 2 * chroma);
+            out->capacity = out->memory ? luma + 2 * chroma : 0;
+            if (!out->memory) continue;
+        }
+        uint8_t *y = out->memory, *u = y + luma, *v = u + chroma;
+        for (int row = 0; row < pic.height; row++)
+            memcpy(y + (size_t)row * pic.width, pic.y + (size_t)row * pic.y_stride, (size_t)pic.width);
+        for (int row = 0; row < ch; row++) {
+            memcpy(u + (size_t)row * cw, pic.u + (size_t)row * pic.uv_stride, (size_t)cw);
+            memcpy(v + (size_t)row * cw, pic.v + (size_t)row * pic.uv_stride, (size_t)cw);
+        }
+        out->pic.y = y;
+        out->pic.u = u;
+        out->pic.v = v;
+        out->pic.width = pic.width;
+        out->pic.height = pic.height;
+        out->pic.y_stride = pic.width;
+        out->pic.uv_stride = cw;
+        r->picture_count++;
+    }
+}
+
+typedef struct {
+    gop_parallel_t *g;
+    decoder_t *dec;
+} worker_arg_t;
+
+static void *worker_thread(void *arg) {
+    gop_parallel_t *g = ((worker_arg_t *)arg)->g;
+    decoder_t *dec = ((worker_arg_t *)arg)->dec;
+    free(arg);
+    pthread_mutex_lock(&g->lock);
+    while (!g->stop) {
+        gop_range_t *r = g->pending;
+        if (!r) {
+            pthread_cond_wait(&g->changed, &g->lock);
+            continue;
+        }
+        g->pending = r->next;
+        pthread_mutex_unlock(&g->lock);
+        for (size_t i = 0; i < r->count; i++) {
+            decoder_decode(dec, r->data + r->units[i].offset, r->units[i].size);
+            take_pictures(dec, r);
+        }
+        // The pictures held back for reordering belong to this range too
+        decoder_flush(dec);
+        take_pictures(dec, r);
+        pthread_mutex_lock(&g->lock);
+        r->done = 1;
+        pthread_cond_broadcast(&g->changed);
+    }
+    pthread_mutex_unlock(&g->lock);
+    return NULL;
+}
+
+gop_parallel_t *gop_parallel_create(const char *name, int workers, gop_picture_fn fn, void *user) {
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (workers > GOP_PARALLEL_MAX_WORKERS) workers = GOP_PARALLEL_MAX_WORKERS;
+    gop_parallel_t *g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    g->fn = fn;
+    g->user = user;
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->changed, NULL);
+    for (int i = 0; i < workers; i++) {
+        if (!(g->decoders[i] = decoder_create(DECODER_CAP_H264, name))) break;
+        worker_arg_t *arg = malloc(sizeof(*arg));
+        if (!arg) break;
+        arg->g = g;
+        arg->dec = g->decoders[i];
+        if (pthread_create(&g->threads[i], NULL, worker_thread, arg) != 0) {
+            free(arg);
+            break;
+        }
+        g->started++;
+    }
+    g->workers = g->started;
+    if (g->workers == 0) {
+        gop_parallel_destroy(g);
+        return NULL;
+    }
+    return g;
+}
+
+void gop_parallel_set_output(gop_parallel_t *g, unsigned output) {
+    for (int i = 0; i < g->started; i++) decoder_set_output(g->decoders[i], output);
+}
+
+int gop_parallel_decode(gop_parallel_t *g, const uint8_t *data, size_t size) {
+    if (!data || size == 0) return 0;
+    int type = data[0] & 0x1f;
+    // first_mb_in_slice 0, the ue(v) code '1': a new IDR picture starts
+    if (type == 5 && size > 1 && (data[1] & 0x80) && g->current && g->current->has_slices) {
+        gop_range_t *done = g->current;
+        gop_range_t *next = open_range(g);
+        if (!next) return -1;
+        // The units since the last slice (parameter sets, SEI, an access
+        // unit delimiter) lead into the IDR picture
+        for (size_t i = g->tail_from; i < done->count; i++) {
+            if (append_unit(next, done->data + done->units[i].offset, done->units[i].size) != 0) {
+                free_range(next);
+                return -1;
+            }
+        }
+        if (g->tail_from < done->count) {
+            done->size = done->units[g->tail_from].offset;
+            done->count = g->tail_from;
+        }
+        g->tail_from = next->count;
+        g->current = next;
+        submit(g, done);
+    }
+    if (!g->current) {
+        if (!(g->current = open_range(g))) return -1;
+        g->tail_from = g->current->count;
+    }
+    if ((type == 7 || type == 8) && size > 1 && keep_parameter_set(g, data, size) != 0) return -1;
+    if (append_unit(g->current, data, size) != 0) return -1;
+    if (type == 1 || type == 5) {
+        g->current->has_slices = 1;
+        g->tail_from = g->current->count;
+    }
+    return 0;
+}
+
+void gop_parallel_flush(gop_parallel_t *g) {
+    if (g->current) {
+        gop_range_t *r = g->current;
+        g->current = NULL;
+        submit(g, r);
+    }
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        deliver(g);
+        if (!g->head) break;
+        pthread_cond_wait(&g->changed, &g->lock);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+void gop_parallel_destroy(gop_parallel_t *g) {
+    if (!g) return;
+    pthread_mutex_lock(&g->lock);
+    g->stop = 1;
+    pthread_cond_broadcast(&g->changed);
+    pthread_mutex_unlock(&g->lock);
+    for (int i = 0; i < g->started; i++) pthread_join(g->threads[i], NULL);
+    for (int i = 0; i < GOP_PARALLEL_MAX_WORKERS; i++) decoder_destroy(g->decoders[i]);
+    gop_range_t *lists[3] = { g->head, g->spare, g->current };
+    for (int l = 0; l < 3; l++) {
+        for (gop_range_t *r = lists[l], *next; r; r = next) {
+            next = r->next;
+            free_range(r);
+        }
+    }
+    for (size_t i = 0; i < GOP_MAX_SPS; i++) free(g->sps[i].data);
+    for (size_t i = 0; i < GOP_MAX_PPS; i++) free(g->pps[i].data);
+    pthread_cond_destroy(&g->changed);
+    pthread_mutex_destroy(&g->lock);
+    free(g);
+}
+
+const decoder_backend_t *gop_parallel_backend(const gop_parallel_t *g) {
+    return decoder_backend(g->decoders[0]);
+}
+
+void gop_parallel_stats(const gop_parallel_t *g, unsigned long *ranges, unsigned long *empty) {
+    *ranges = g->ranges;
+    *empty = g->empty;
+}
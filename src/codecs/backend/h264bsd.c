@@ -0,0 +1,190 @@
+// H.264 backend on the h264bsd baseline decoder
+#include "../../../include/decoder.h"
+#include "../h264/h264bsd_decoder.h"
+#include "../h264/h264bsd_util.h"
+#include "../h264/h264bsd_frame_threads.h"
+#include "../h264/h264bsd_conceal.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    storage_t *storage;
+    u8 *nal;            // Copy of the NAL being decoded: h264bsd strips
+    size_t capacity;    // emulation prevention bytes in place
+    u32 nal_size;
+    int resume;         // Picture finished at an access unit boundary;
+                        // the NAL in `nal` is still to be decoded
+    u8 *picture;        // DPB image of the picture get_picture() filled last
+    u32 frame_threads;  // Pictures decoded at once, 0 on the calling thread
+} h264bsd_ctx_t;
+
+static void *h264bsd_create(void) {
+    h264bsd_ctx_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->storage = h264bsdAlloc();
+    if (!c->storage || h264bsdInit(c->storage, 0) != HANTRO_OK) {
+        h264bsdFree(c->storage);
+        free(c);
+        return NULL;
+    }
+    // Keep the frame buffers of this many picture sizes over a reconnect
+    // or variant switch (2 by default, 0 frees them).
+    const char *pool = getenv("ANHELO_DPB_POOL_SIZES");
+    if (pool) h264bsdSetImagePoolSizes(c->storage, (u32)atoi(pool));
+    // 0 deblocks whole pictures instead of rows right behind the decoding,
+    // the reference bench -v checks the row filtering against.
+    const char *rows = getenv("ANHELO_DEBLOCK_ROWS");
+    if (rows && atoi(rows) == 0) h264bsdSetRowFiltering(c->storage, HANTRO_FALSE);
+    // Decode this many pictures at once, one per thread. Throughput over
+    // latency: a picture is output a few pictures after its last NAL.
+    const char *frames = getenv("ANHELO_FRAME_THREADS");
+    if (frames && atoi(frames) > 1 &&
+        h264bsdSetFrameThreads(c->storage, (u32)atoi(frames)) == HANTRO_OK) {
+        c->frame_threads = (u32)atoi(frames);
+        return c;
+    }
+    // Decode the slices of a picture on this many threads. Pictures then
+    // complete one NAL later, at the next access unit's first unit.
+    const char *threads = getenv("ANHELO_SLICE_THREADS");
+    if (threads && atoi(threads) > 1) h264bsdSetSliceThreads(c->storage, (u32)atoi(threads));
+    return c;
+}
+
+static void h264bsd_destroy(void *ctx) {
+    h264bsd_ctx_t *c = ctx;
+    h264bsdShutdown(c->storage);
+    h264bsdFree(c->storage);
+    free(c->nal);
+    free(c);
+}
+
+// Run the decoder over c->nal. When it has to come back to the same NAL
+// it reports nothing consumed: right away after activating new parameter
+// sets, and after a picture completed by the start of the next access
+// unit once that picture has been output.
+static int h264bsd_run(h264bsd_ctx_t *c) {
+    u32 used, ret;
+    do {
+        used = 0;
+        ret = h264bsdDecodeInternal(c->storage, c->nal, c->nal_size, &used);
+    } while (ret == H264BSD_HDRS_RDY && used == 0);
+    c->resume = (ret == H264BSD_PIC_RDY && used == 0);
+    return (ret == H264BSD_ERROR || ret == H264BSD_PARAM_SET_ERROR ||
+            ret == H264BSD_MEMALLOC_ERROR) ? -1 : 0;
+}
+
+static int h264bsd_decode(void *ctx, const uint8_t *data, size_t size) {
+    h264bsd_ctx_t *c = ctx;
+    if (c->resume && h264bsd_run(c) < 0) c->resume = 0;
+    if (size > c->capacity) {
+        u8 *p = realloc(c->nal, size);
+        if (!p) return -1;
+        c->nal = p;
+        c->capacity = size;
+    }
+    memcpy(c->nal, data, size);
+    c->nal_size = (u32)size;
+    return h264bsd_run(c);
+}
+
+static int h264bsd_get_picture(void *ctx, decoder_picture_t *pic) {
+    h264bsd_ctx_t *c = ctx;
+    dpbOutPicture_t *out = h264bsdFrameOutputPicture(c->storage);
+    if (!out && c->resume) {
+        h264bsd_run(c);
+        out = h264bsdFrameOutputPicture(c->storage);
+    }
+    const seqParamSet_t *sps = c->storage->activeSps;
+    if (!out || !sps) return 0;
+    c->picture = out->data;
+
+    int w = (int)sps->picWidthInMbs * 16;
+    int h = (int)sps->picHeightInMbs * 16;
+    // Crop offsets are in chroma samples: two luma pixels each
+    int left = 0, right = 0, top = 0, bottom = 0;
+    if (sps->frameCroppingFlag) {
+        left = (int)sps->frameCropLeftOffset;
+        right = (int)sps->frameCropRightOffset;
+        top = (int)sps->frameCropTopOffset;
+        bottom = (int)sps->frameCropBottomOffset;
+        if (2 * (left + right) >= w || 2 * (top + bottom) >= h) left = right = top = bottom = 0;
+    }
+    const uint8_t *u = out->data + w * h;
+    pic->y = out->data + 2 * top * w + 2 * left;
+    pic->u = u + top * (w / 2) + left;
+    pic->v = u + (w / 2) * (h / 2) + top * (w / 2) + left;
+    pic->width = w - 2 * (left + right);
+    pic->height = h - 2 * (top + bottom);
+    pic->y_stride = w;
+    pic->uv_stride = w / 2;
+    return 1;
+}
+
+static void h264bsd_flush(void *ctx) {
+    h264bsd_ctx_t *c = ctx;
+    // An access unit delimiter finishes a picture still waiting for its
+    // access unit boundary: its slices queued on the slice threads, or
+    // some of them lost
+    static const uint8_t aud[] = { 0x09, 0xF0 };
+    if (h264bsd_decode(c, aud, sizeof(aud)) == 0 && c->resume) h264bsd_run(c);
+    h264bsdFinishFrames(c->storage);
+    h264bsdFlushDpb(c->storage->dpb);
+}
+
+static void h264bsd_set_skip(void *ctx, unsigned skip) {
+    h264bsd_ctx_t *c = ctx;
+    c->storage->skipNonRefDeblocking = (skip & DECODER_SKIP_NONREF_DEBLOCK) != 0;
+    h264bsdSetConcealment(c->storage, (skip & DECODER_SKIP_CONCEAL) ? CONCEAL_COPY : CONCEAL_FULL);
+}
+
+// A held picture keeps its DPB image: the DPB decodes into a new one
+// instead until it is released
+static void *h264bsd_hold_picture(void *ctx) {
+    h264bsd_ctx_t *c = ctx;
+    if (!c->picture || h264bsdDpbHoldImage(c->storage->dpb, c->picture) != HANTRO_OK) return NULL;
+    return c->picture;
+}
+
+static void h264bsd_release_picture(void *ctx, void *handle) {
+    h264bsd_ctx_t *c = ctx;
+    h264bsdDpbReleaseImage(c->storage->dpb, handle);
+}
+
+static void h264bsd_set_low_latency(void *ctx, int on) {
+    h264bsd_ctx_t *c = ctx;
+    h264bsdSetLowLatency(c->storage, on ? HANTRO_TRUE : HANTRO_FALSE);
+}
+
+static void h264bsd_set_luma_only(void *ctx, int on) {
+    h264bsd_ctx_t *c = ctx;
+    h264bsdSetLumaOnly(c->storage, on ? HANTRO_TRUE : HANTRO_FALSE);
+}
+
+static unsigned long h264bsd_concealed_mbs(void *ctx) {
+    h264bsd_ctx_t *c = ctx;
+    return h264bsdConcealedMbs(c->storage);
+}
+
+// Reordering in the DPB, plus the pictures still on the frame threads
+static int h264bsd_get_delay(void *ctx) {
+    h264bsd_ctx_t *c = ctx;
+    if (!c->storage->dpb->buffer) return -1;
+    return (int)(h264bsdOutputDelay(c->storage) + c->frame_threads);
+}
+
+const decoder_backend_t decoder_h264bsd = {
+    .name = "h264bsd",
+    .caps = DECODER_CAP_H264 | DECODER_CAP_REORDER,
+    .create = h264bsd_create,
+    .destroy = h264bsd_destroy,
+    .decode = h264bsd_decode,
+    .get_picture = h264bsd_get_picture,
+    .flush = h264bsd_flush,
+    .set_skip = h264bsd_set_skip,
+    .hold_picture = h264bsd_hold_picture,
+    .release_picture = h264bsd_release_picture,
+    .set_low_latency = h264bsd_set_low_latency,
+    .get_delay = h264bsd_get_delay,
+    .set_luma_only = h264bsd_set_luma_only,
+    .concealed_mbs = h264bsd_concealed_mbs,
+};
@@ -0,0 +1,205 @@
+// Hardware decoding through libavcodec's hwaccels, see include/hwaccel.h
+// (builds with FFmpeg only)
+#include "../../../include/hwaccel.h"
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+#ifdef VAAPI_GLX
+#include <libavutil/hwcontext_vaapi.h>
+#include <va/va_x11.h>
+#include <GL/glx.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct hwaccel {
+    AVBufferRef *device;
+    enum AVHWDeviceType type;
+    enum AVPixelFormat pix_fmt;         // Surface format of the device's frames
+    enum AVPixelFormat download_format; // Chosen at the first download, NONE until then
+    AVFrame *download;
+    uint8_t *planes;                    // NV12 split into U and V
+    size_t capacity;
+    int software;                       // get_format fell back, said once
+    int glx;                            // VAAPI on the OpenGL output's X display
+};
+
+// Surfaces when the device takes the stream, else the first software
+// format offered (libavcodec lists the hardware ones first)
+static enum AVPixelFormat get_format(AVCodecContext *ctx, const enum AVPixelFormat *formats) {
+    hwaccel_t *hw = ctx->opaque;
+    for (const enum AVPixelFormat *f = formats; *f != AV_PIX_FMT_NONE; f++)
+        if (*f == hw->pix_fmt) return *f;
+    for (const enum AVPixelFormat *f = formats; *f != AV_PIX_FMT_NONE; f++) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*f);
+        if (desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            if (!hw->software) {
+                fprintf(stderr, "Hwaccel: %s can't decode this stream, decoding in software\n",
+                        av_hwdevice_get_type_name(hw->type));
+                hw->software = 1;
+            }
+            return *f;
+        }
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+#ifdef VAAPI_GLX
+static void free_vaapi_glx(AVHWDeviceContext *device) {
+    vaTerminate(((AVVAAPIDeviceContext *)device->hwctx)->display);
+}
+
+// A VAAPI device on the X display of the GLX context current on this
+// thread, the OpenGL output's, so that its surfaces can be put into that
+// display's pixmaps. NULL when there is none (decoding on another thread)
+// or VAAPI doesn't run on it.
+static AVBufferRef *open_vaapi_glx(void) {
+    Display *display = glXGetCurrentDisplay();
+    if (!display) return NULL;
+    VADisplay va = vaGetDisplay(display);
+    int major, minor;
+    if (!va || vaInitialize(va, &major, &minor) != VA_STATUS_SUCCESS) return NULL;
+    AVBufferRef *device = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_VAAPI);
+    if (!device) {
+        vaTerminate(va);
+        return NULL;
+    }
+    AVHWDeviceContext *ctx = (AVHWDeviceContext *)device->data;
+    ((AVVAAPIDeviceContext *)ctx->hwctx)->display = va;
+    ctx->free = free_vaapi_glx;
+    // Unreferencing terminates the display from here on
+    if (av_hwdevice_ctx_init(device) < 0) av_buffer_unref(&device);
+    return device;
+}
+#endif
+
+hwaccel_t *hwaccel_attach(AVCodecContext *ctx, const AVCodec *codec, const char *name) {
+    if (!name || !*name || strcmp(name, "0") == 0) return NULL;
+    int any = strcmp(name, "auto") == 0;
+    enum AVHWDeviceType wanted = any ? AV_HWDEVICE_TYPE_NONE : av_hwdevice_find_type_by_name(name);
+    if (!any && wanted == AV_HWDEVICE_TYPE_NONE) {
+        fprintf(stderr, "Hwaccel: unknown device type %s, decoding in software\n", name);
+        return NULL;
+    }
+    const char *device_name = getenv("ANHELO_HWACCEL_DEVICE");
+    if (device_name && !*device_name) device_name = NULL;
+
+    const AVCodecHWConfig *config;
+    for (int i = 0; (config = avcodec_get_hw_config(codec, i)) != NULL; i++) {
+        if (!(config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) continue;
+        if (!any && config->device_type != wanted) continue;
+        AVBufferRef *device = NULL;
+        int glx = 0;
+#ifdef VAAPI_GLX
+        if (config->device_type == AV_HWDEVICE_TYPE_VAAPI && !device_name)
+            glx = (device = open_vaapi_glx()) != NULL;
+#endif
+        if (!device && av_hwdevice_ctx_create(&device, config->device_type, device_name, NULL, 0) < 0) continue;
+        hwaccel_t *hw = calloc(1, sizeof(*hw));
+        if (!hw || !(hw->download = av_frame_alloc()) || !(ctx->hw_device_ctx = av_buffer_ref(device))) {
+            if (hw) av_frame_free(&hw->download);
+            free(hw);
+            av_buffer_unref(&device);
+            return NULL;
+        }
+        hw->device = device;
+        hw->type = config->device_type;
+        hw->pix_fmt = config->pix_fmt;
+        hw->download_format = AV_PIX_FMT_NONE;
+        hw->glx = glx;
+        ctx->opaque = hw;
+        ctx->get_format = get_format;
+        printf("Hwaccel: decoding %s on %s%s\n", codec->name, av_hwdevice_get_type_name(hw->type),
+               glx ? ", shown through GLX pixmaps" : "");
+        return hw;
+    }
+    fprintf(stderr, "Hwaccel: no %s device decodes %s, decoding in software\n", name, codec->name);
+    return NULL;
+}
+
+void hwaccel_destroy(hwaccel_t *hw) {
+    if (!hw) return;
+    av_frame_free(&hw->download);
+    av_buffer_unref(&hw->device);
+    free(hw->planes);
+    free(hw);
+}
+
+// Planar 4:2:0 straight from the surface where the driver offers it,
+// NV12 (which every 4:2:0 surface has) split afterwards otherwise
+static enum AVPixelFormat choose_download(const AVFrame *frame) {
+    enum AVPixelFormat *formats = NULL, chosen = AV_PIX_FMT_NONE;
+    if (av_hwframe_transfer_get_formats(frame->hw_frames_ctx, AV_HWFRAME_TRANSFER_DIRECTION_FROM, &formats, 0) < 0)
+        return AV_PIX_FMT_NONE;
+    for (enum AVPixelFormat *f = formats; *f != AV_PIX_FMT_NONE; f++) {
+        if (*f == AV_PIX_FMT_YUV420P) {
+            chosen = *f;
+            break;
+        }
+        if (*f == AV_PIX_FMT_NV12) chosen = *f;
+    }
+    av_freep(&formats);
+    return chosen;
+}
+
+const AVFrame *hwaccel_download(hwaccel_t *hw, const AVFrame *frame) {
+    if (!hw || frame->format != hw->pix_fmt) return frame;
+    if (hw->download_format == AV_PIX_FMT_NONE && (hw->download_format = choose_download(frame)) == AV_PIX_FMT_NONE) {
+        fprintf(stderr, "Hwaccel: surfaces can't be downloaded as YUV 4:2:0\n");
+        return NULL;
+    }
+    av_frame_unref(hw->download);
+    hw->download->format = hw->download_format;
+    if (av_hwframe_transfer_data(hw->download, frame, 0) < 0) return NULL;
+    return hw->download;
+}
+
+int hwaccel_put_pixmap(hwaccel_t *hw, const AVFrame *frame, unsigned long pixmap, int width, int height) {
+#ifdef VAAPI_GLX
+    if (!hw || !hw->glx || frame->format != AV_PIX_FMT_VAAPI) return -1;
+    VADisplay va = ((AVVAAPIDeviceContext *)((AVHWDeviceContext *)hw->device->data)->hwctx)->display;
+    VASurfaceID surface = (VASurfaceID)(uintptr_t)frame->data[3];
+    // BT.601, as the other outputs convert
+    return vaPutSurface(va, surface, (Drawable)pixmap, 0, 0, frame->width, frame->height,
+                        0, 0, width, height, NULL, 0, VA_FRAME_PICTURE | VA_SRC_BT601) == VA_STATUS_SUCCESS ? 0 : -1;
+#else
+    (void)hw; (void)frame; (void)pixmap; (void)width; (void)height;
+    return -1;
+#endif
+}
+
+int hwaccel_picture(hwaccel_t *hw, const AVFrame *frame, decoder_picture_t *pic) {
+    pic->width = frame->width;
+    pic->height = frame->height;
+    pic->y = frame->data[0];
+    pic->y_stride = frame->linesize[0];
+    if (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P) {
+        if (frame->linesize[1] != frame->linesize[2]) return -1;
+        pic->u = frame->data[1];
+        pic->v = frame->data[2];
+        pic->uv_stride = frame->linesize[1];
+        return 1;
+    }
+    if (frame->format != AV_PIX_FMT_NV12 || !hw) return -1;
+
+    int cw = (frame->width + 1) / 2, ch = (frame->height + 1) / 2;
+    size_t size = 2 * (size_t)cw * ch;
+    if (size > hw->capacity) {
+        uint8_t *grown = realloc(hw->planes, size);
+        if (!grown) return -1;
+        hw->planes = grown;
+        hw->capacity = size;
+    }
+    uint8_t *u = hw->planes, *v = hw->planes + (size_t)cw * ch;
+    for (int y = 0; y < ch; y++) {
+        const uint8_t *uv = frame->data[1] + (size_t)y * frame->linesize[1];
+        for (int x = 0; x < cw; x++) {
+            u[(size_t)y * cw + x] = uv[2 * x];
+            v[(size_t)y * cw + x] = uv[2 * x + 1];
+        }
+    }
+    pic->u = u;
+    pic->v = v;
+    pic->uv_stride = cw;
+    return 0;
+}
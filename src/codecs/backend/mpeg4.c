@@ -0,0 +1,70 @@
+// MPEG-4 Part 2 backend on the built-in MPEG-4 decoder
+#include "../../../include/decoder.h"
+#include "../mpeg4/main.h"
+#include <stdlib.h>
+
+// Size the decoder starts with; the VOL header of the stream sets the
+// real one before the first picture
+#define MPEG4_BACKEND_WIDTH  640
+#define MPEG4_BACKEND_HEIGHT 480
+
+typedef struct {
+    mpeg4_decoder_t *dec;
+    decoder_picture_t pic;
+    int ready;
+} mpeg4_ctx_t;
+
+static void *mpeg4_backend_create(void) {
+    mpeg4_ctx_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->dec = mpeg4_create_decoder(MPEG4_BACKEND_WIDTH, MPEG4_BACKEND_HEIGHT);
+    if (!c->dec) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void mpeg4_backend_destroy(void *ctx) {
+    mpeg4_ctx_t *c = ctx;
+    mpeg4_destroy_decoder(c->dec);
+    free(c);
+}
+
+static int mpeg4_backend_decode(void *ctx, const uint8_t *data, size_t size) {
+    mpeg4_ctx_t *c = ctx;
+    uint8_t *y, *u, *v;
+    int stride_y, stride_uv;
+    if (mpeg4_decode_frame(c->dec, data, size, &y, &u, &v, &stride_y, &stride_uv) != MPEG4_SUCCESS)
+        return -1;
+    c->pic.y = y;
+    c->pic.u = u;
+    c->pic.v = v;
+    c->pic.y_stride = stride_y;
+    c->pic.uv_stride = stride_uv;
+    mpeg4_get_frame_size(c->dec, &c->pic.width, &c->pic.height);
+    c->ready = 1;
+    return 0;
+}
+
+static int mpeg4_backend_get_picture(void *ctx, decoder_picture_t *pic) {
+    mpeg4_ctx_t *c = ctx;
+    if (!c->ready) return 0;
+    c->ready = 0;
+    *pic = c->pic;
+    return 1;
+}
+
+static void mpeg4_backend_flush(void *ctx) {
+    (void)ctx; // No reordering: every frame is output when decoded
+}
+
+const decoder_backend_t decoder_mpeg4 = {
+    .name = "mpeg4",
+    .caps = DECODER_CAP_MPEG4,
+    .create = mpeg4_backend_create,
+    .destroy = mpeg4_backend_destroy,
+    .decode = mpeg4_backend_decode,
+    .get_picture = mpeg4_backend_get_picture,
+    .flush = mpeg4_backend_flush,
+};
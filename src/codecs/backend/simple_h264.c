@@ -0,0 +1,67 @@
+// H.264 backend on simple_h264 (parses parameter sets, draws a test
+// pattern per slice)
+#include "../../../include/decoder.h"
+#include "../simple_h264/simple_h264.h"
+#include <stdlib.h>
+
+typedef struct {
+    simple_h264_decoder_t *dec;
+    simple_h264_frame_t frame;
+    int ready;
+} simple_h264_ctx_t;
+
+static void *simple_h264_backend_create(void) {
+    simple_h264_ctx_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->dec = simple_h264_create();
+    if (!c->dec) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void simple_h264_backend_destroy(void *ctx) {
+    simple_h264_ctx_t *c = ctx;
+    simple_h264_destroy(c->dec);
+    free(c);
+}
+
+static int simple_h264_backend_decode(void *ctx, const uint8_t *data, size_t size) {
+    simple_h264_ctx_t *c = ctx;
+    simple_h264_frame_t frame = {0};
+    simple_h264_result_t r = simple_h264_decode(c->dec, data, size, &frame);
+    if (r == SIMPLE_H264_FRAME_READY && frame.y_plane && frame.width > 0 && frame.height > 0) {
+        c->frame = frame;
+        c->ready = 1;
+    }
+    return (r == SIMPLE_H264_ERROR || r == SIMPLE_H264_PARAM_SET_ERROR) ? -1 : 0;
+}
+
+static int simple_h264_backend_get_picture(void *ctx, decoder_picture_t *pic) {
+    simple_h264_ctx_t *c = ctx;
+    if (!c->ready) return 0;
+    c->ready = 0;
+    pic->y = c->frame.y_plane;
+    pic->u = c->frame.u_plane;
+    pic->v = c->frame.v_plane;
+    pic->width = (int)c->frame.width;
+    pic->height = (int)c->frame.height;
+    pic->y_stride = (int)c->frame.y_stride;
+    pic->uv_stride = (int)c->frame.uv_stride;
+    return 1;
+}
+
+static void simple_h264_backend_flush(void *ctx) {
+    (void)ctx; // Pictures are output as soon as they are decoded
+}
+
+const decoder_backend_t decoder_simple_h264 = {
+    .name = "simple_h264",
+    .caps = DECODER_CAP_H264,
+    .create = simple_h264_backend_create,
+    .destroy = simple_h264_backend_destroy,
+    .decode = simple_h264_backend_decode,
+    .get_picture = simple_h264_backend_get_picture,
+    .flush = simple_h264_backend_flush,
+};
@@ -68,108 +68,71 @@
 
 #define VLC_NOT_FOUND 0xFFFFFFFEU
 
-/* VLC tables for coeff_token. Because of long codes (max. 16 bits) some of the
- * tables have been splitted into multiple separate tables. Each array/table
- * element has the following structure:
+/* VLC tables for coeff_token. Element structure:
  * [5 bits for tot.coeff.] [6 bits for tr.ones] [5 bits for VLC length]
  * If there is a 0x0000 value, it means that there is not corresponding VLC
- * codeword for that index. */
-
-/* VLC lengths up to 6 bits, 0 <= nC < 2 */
-static const u16 coeffToken0_0[32] = {
-    0x0000,0x0000,0x0000,0x2066,0x1026,0x0806,0x1865,0x1865,
-    0x1043,0x1043,0x1043,0x1043,0x1043,0x1043,0x1043,0x1043,
-    0x0822,0x0822,0x0822,0x0822,0x0822,0x0822,0x0822,0x0822,
-    0x0822,0x0822,0x0822,0x0822,0x0822,0x0822,0x0822,0x0822};
-
-/* VLC lengths up to 10 bits, 0 <= nC < 2 */
-static const u16 coeffToken0_1[48] = {
-    0x0000,0x0000,0x0000,0x0000,0x406a,0x304a,0x282a,0x200a,
-    0x3869,0x3869,0x2849,0x2849,0x2029,0x2029,0x1809,0x1809,
-    0x3068,0x3068,0x3068,0x3068,0x2048,0x2048,0x2048,0x2048,
-    0x1828,0x1828,0x1828,0x1828,0x1008,0x1008,0x1008,0x1008,
-    0x2867,0x2867,0x2867,0x2867,0x2867,0x2867,0x2867,0x2867,
-    0x1847,0x1847,0x1847,0x1847,0x1847,0x1847,0x1847,0x1847};
-
-/* VLC lengths up to 14 bits, 0 <= nC < 2 */
-static const u16 coeffToken0_2[56] = {
-    0x606e,0x584e,0x502e,0x500e,0x586e,0x504e,0x482e,0x480e,
-    0x400d,0x400d,0x484d,0x484d,0x402d,0x402d,0x380d,0x380d,
-    0x506d,0x506d,0x404d,0x404d,0x382d,0x382d,0x300d,0x300d,
-    0x486b,0x486b,0x486b,0x486b,0x486b,0x486b,0x486b,0x486b,
-    0x384b,0x384b,0x384b,0x384b,0x384b,0x384b,0x384b,0x384b,
-    0x302b,0x302b,0x302b,0x302b,0x302b,0x302b,0x302b,0x302b,
-    0x280b,0x280b,0x280b,0x280b,0x280b,0x280b,0x280b,0x280b};
-
-/* VLC lengths up to 16 bits, 0 <= nC < 2 */
-static const u16 coeffToken0_3[32] = {
-    0x0000,0x0000,0x682f,0x682f,0x8010,0x8050,0x8030,0x7810,
-    0x8070,0x7850,0x7830,0x7010,0x7870,0x7050,0x7030,0x6810,
-    0x706f,0x706f,0x684f,0x684f,0x602f,0x602f,0x600f,0x600f,
-    0x686f,0x686f,0x604f,0x604f,0x582f,0x582f,0x580f,0x580f};
-
-/* VLC lengths up to 6 bits, 2 <= nC < 4 */
-static const u16 coeffToken2_0[32] = {
-    0x0000,0x0000,0x0000,0x0000,0x3866,0x2046,0x2026,0x1006,
-    0x3066,0x1846,0x1826,0x0806,0x2865,0x2865,0x1025,0x1025,
-    0x2064,0x2064,0x2064,0x2064,0x1864,0x1864,0x1864,0x1864,
-    0x1043,0x1043,0x1043,0x1043,0x1043,0x1043,0x1043,0x1043};
-
-/* VLC lengths up to 9 bits, 2 <= nC < 4 */
-static const u16 coeffToken2_1[32] = {
-    0x0000,0x0000,0x0000,0x0000,0x4869,0x3849,0x3829,0x3009,
-    0x2808,0x2808,0x3048,0x3048,0x3028,0x3028,0x2008,0x2008,
-    0x4067,0x4067,0x4067,0x4067,0x2847,0x2847,0x2847,0x2847,
-    0x2827,0x2827,0x2827,0x2827,0x1807,0x1807,0x1807,0x1807};
-
-/* VLC lengths up to 14 bits, 2 <= nC < 4 */
-static const u16 coeffToken2_2[128] = {
-    0x0000,0x0000,0x786d,0x786d,0x806e,0x804e,0x802e,0x800e,
-    0x782e,0x780e,0x784e,0x702e,0x704d,0x704d,0x700d,0x700d,
-    0x706d,0x706d,0x684d,0x684d,0x682d,0x682d,0x680d,0x680d,
-    0x686d,0x686d,0x604d,0x604d,0x602d,0x602d,0x600d,0x600d,
-    0x580c,0x580c,0x580c,0x580c,0x584c,0x584c,0x584c,0x584c,
-    0x582c,0x582c,0x582c,0x582c,0x500c,0x500c,0x500c,0x500c,
-    0x606c,0x606c,0x606c,0x606c,0x504c,0x504c,0x504c,0x504c,
-    0x502c,0x502c,0x502c,0x502c,0x480c,0x480c,0x480c,0x480c,
-    0x586b,0x586b,0x586b,0x586b,0x586b,0x586b,0x586b,0x586b,
-    0x484b,0x484b,0x484b,0x484b,0x484b,0x484b,0x484b,0x484b,
-    0x482b,0x482b,0x482b,0x482b,0x482b,0x482b,0x482b,0x482b,
-    0x400b,0x400b,0x400b,0x400b,0x400b,0x400b,0x400b,0x400b,
-    0x506b,0x506b,0x506b,0x506b,0x506b,0x506b,0x506b,0x506b,
-    0x404b,0x404b,0x404b,0x404b,0x404b,0x404b,0x404b,0x404b,
-    0x402b,0x402b,0x402b,0x402b,0x402b,0x402b,0x402b,0x402b,
-    0x380b,0x380b,0x380b,0x380b,0x380b,0x380b,0x380b,0x380b};
-
-/* VLC lengths up to 6 bits, 4 <= nC < 8 */
-static const u16 coeffToken4_0[64] = {
-    0x0000,0x0000,0x0000,0x0000,0x0000,0x0000,0x0000,0x0000,
+ * codeword for that index.
+ *
+ * Codes are looked up in two levels. The number of leading zeros in the
+ * next 16 bits (15 for all-zero bits) indexes the coeffTokenIndex table,
+ * whose elements are
+ * [12 bits for offset] [4 bits for number of bits n after the first '1']
+ * and the n bits after the first '1' index the coeffToken table from offset
+ * on. */
+
+/* 0 <= nC < 2 */
+static const u16 coeffTokenIndex0[16] = {
+    0x0000,0x0010,0x0020,0x0032,0x0072,0x00b2,0x00f2,0x0132,
+    0x0172,0x01b3,0x0233,0x02b3,0x0333,0x03b2,0x03f0,0x0400};
+static const u16 coeffToken0[65] = {
+    0x0001,0x0822,0x1043,0x1026,0x0806,0x1865,0x1865,0x2867,
+    0x1847,0x2066,0x2066,0x3068,0x2048,0x1828,0x1008,0x3869,
+    0x2849,0x2029,0x1809,0x406a,0x304a,0x282a,0x200a,0x486b,
+    0x384b,0x302b,0x280b,0x400d,0x484d,0x402d,0x380d,0x506d,
+    0x404d,0x382d,0x300d,0x606e,0x584e,0x502e,0x500e,0x586e,
+    0x504e,0x482e,0x480e,0x706f,0x684f,0x602f,0x600f,0x686f,
+    0x604f,0x582f,0x580f,0x8070,0x7850,0x7830,0x7010,0x7870,
+    0x7050,0x7030,0x6810,0x8010,0x8050,0x8030,0x7810,0x682f,
+    0x0000};
+
+/* 2 <= nC < 4 */
+static const u16 coeffTokenIndex2[16] = {
+    0x0001,0x0022,0x0063,0x00e2,0x0122,0x0162,0x01a2,0x01e3,
+    0x0263,0x02e3,0x0363,0x03e2,0x0420,0x0430,0x0440,0x0450};
+static const u16 coeffToken2[70] = {
+    0x0822,0x0002,0x2064,0x1864,0x1043,0x1043,0x3066,0x1846,
+    0x1826,0x0806,0x2865,0x2865,0x1025,0x1025,0x3866,0x2046,
+    0x2026,0x1006,0x4067,0x2847,0x2827,0x1807,0x2808,0x3048,
+    0x3028,0x2008,0x4869,0x3849,0x3829,0x3009,0x586b,0x484b,
+    0x482b,0x400b,0x506b,0x404b,0x402b,0x380b,0x580c,0x584c,
+    0x582c,0x500c,0x606c,0x504c,0x502c,0x480c,0x706d,0x684d,
+    0x682d,0x680d,0x686d,0x604d,0x602d,0x600d,0x782e,0x780e,
+    0x784e,0x702e,0x704d,0x704d,0x700d,0x700d,0x806e,0x804e,
+    0x802e,0x800e,0x786d,0x0000,0x0000,0x0000};
+
+/* 4 <= nC < 8 */
+static const u16 coeffTokenIndex4[16] = {
+    0x0003,0x0083,0x0103,0x0183,0x0203,0x0283,0x0303,0x0382,
+    0x03c1,0x03e0,0x03f0,0x0400,0x0410,0x0420,0x0430,0x0440};
+static const u16 coeffToken4[69] = {
+    0x3864,0x3064,0x2864,0x2064,0x1864,0x1044,0x0824,0x0004,
+    0x2825,0x2845,0x2025,0x2045,0x1825,0x4065,0x1845,0x1025,
     0x1806,0x3846,0x3826,0x1006,0x4866,0x3046,0x3026,0x0806,
-    0x2825,0x2825,0x2845,0x2845,0x2025,0x2025,0x2045,0x2045,
-    0x1825,0x1825,0x4065,0x4065,0x1845,0x1845,0x1025,0x1025,
-    0x3864,0x3864,0x3864,0x3864,0x3064,0x3064,0x3064,0x3064,
-    0x2864,0x2864,0x2864,0x2864,0x2064,0x2064,0x2064,0x2064,
-    0x1864,0x1864,0x1864,0x1864,0x1044,0x1044,0x1044,0x1044,
-    0x0824,0x0824,0x0824,0x0824,0x0004,0x0004,0x0004,0x0004};
-
-/* VLC lengths up to 10 bits, 4 <= nC < 8 */
-static const u16 coeffToken4_1[128] = {
-    0x0000,0x800a,0x806a,0x804a,0x802a,0x780a,0x786a,0x784a,
+    0x3807,0x3007,0x4847,0x2807,0x5067,0x4047,0x4027,0x2007,
+    0x6068,0x5848,0x5028,0x4808,0x5868,0x5048,0x4828,0x4008,
+    0x6009,0x6849,0x6029,0x5809,0x6869,0x6049,0x5829,0x5009,
     0x782a,0x700a,0x706a,0x704a,0x702a,0x680a,0x6829,0x6829,
-    0x6009,0x6009,0x6849,0x6849,0x6029,0x6029,0x5809,0x5809,
-    0x6869,0x6869,0x6049,0x6049,0x5829,0x5829,0x5009,0x5009,
-    0x6068,0x6068,0x6068,0x6068,0x5848,0x5848,0x5848,0x5848,
-    0x5028,0x5028,0x5028,0x5028,0x4808,0x4808,0x4808,0x4808,
-    0x5868,0x5868,0x5868,0x5868,0x5048,0x5048,0x5048,0x5048,
-    0x4828,0x4828,0x4828,0x4828,0x4008,0x4008,0x4008,0x4008,
-    0x3807,0x3807,0x3807,0x3807,0x3807,0x3807,0x3807,0x3807,
-    0x3007,0x3007,0x3007,0x3007,0x3007,0x3007,0x3007,0x3007,
-    0x4847,0x4847,0x4847,0x4847,0x4847,0x4847,0x4847,0x4847,
-    0x2807,0x2807,0x2807,0x2807,0x2807,0x2807,0x2807,0x2807,
-    0x5067,0x5067,0x5067,0x5067,0x5067,0x5067,0x5067,0x5067,
-    0x4047,0x4047,0x4047,0x4047,0x4047,0x4047,0x4047,0x4047,
-    0x4027,0x4027,0x4027,0x4027,0x4027,0x4027,0x4027,0x4027,
-    0x2007,0x2007,0x2007,0x2007,0x2007,0x2007,0x2007,0x2007};
+    0x802a,0x780a,0x786a,0x784a,0x806a,0x804a,0x800a,0x0000,
+    0x0000,0x0000,0x0000,0x0000,0x0000};
+
+/* nC == -1 */
+static const u16 coeffTokenIndexMinus1[16] = {
+    0x0000,0x0010,0x0020,0x0032,0x0071,0x0091,0x00b1,0x00d0,
+    0x00e0,0x00f0,0x0100,0x0110,0x0120,0x0130,0x0140,0x0150};
+static const u16 coeffTokenMinus1[22] = {
+    0x0821,0x0002,0x1043,0x1006,0x1866,0x1026,0x0806,0x2006,
+    0x1806,0x1847,0x1827,0x2048,0x2028,0x2067,0x2067,0x2067,
+    0x2067,0x2067,0x2067,0x2067,0x2067,0x2067};
 
 /* fixed 6 bit length VLC, nC <= 8 */
 static const u16 coeffToken8[64] = {
@@ -182,17 +145,6 @@ static const u16 coeffToken8[64] = {
     0x6806,0x6826,0x6846,0x6866,0x7006,0x7026,0x7046,0x7066,
     0x7806,0x7826,0x7846,0x7866,0x8006,0x8026,0x8046,0x8066};
 
-/* VLC lengths up to 3 bits, nC == -1 */
-static const u16 coeffTokenMinus1_0[8] = {
-    0x0000,0x1043,0x0002,0x0002,0x0821,0x0821,0x0821,0x0821};
-
-/* VLC lengths up to 8 bits, nC == -1 */
-static const u16 coeffTokenMinus1_1[32] = {
-    0x2067,0x2067,0x2048,0x2028,0x1847,0x1847,0x1827,0x1827,
-    0x2006,0x2006,0x2006,0x2006,0x1806,0x1806,0x1806,0x1806,
-    0x1006,0x1006,0x1006,0x1006,0x1866,0x1866,0x1866,0x1866,
-    0x1026,0x1026,0x1026,0x1026,0x0806,0x0806,0x0806,0x0806};
-
 /* VLC tables for total_zeros. One table containing longer code, totalZeros_1,
  * has been broken into two separate tables. Table elements have the
  * following structure:
@@ -302,6 +254,25 @@ static const u8 totalZeros_13[8] = {0x03,0x13,0x32,0x32,0x21,0x21,0x21,0x21};
 
 static const u8 totalZeros_14[4] = {0x02,0x12,0x21,0x21};
 
+static const u8 totalZeros_15[2] = {0x01,0x11};
+
+/* total_zeros tables and the shift that leaves their index from the next 9
+ * stream bits, by totalCoeff - 1 */
+static const u8 * const totalZeros[15] = {
+    totalZeros_1_0, totalZeros_2, totalZeros_3, totalZeros_4, totalZeros_5,
+    totalZeros_6, totalZeros_7, totalZeros_8, totalZeros_9, totalZeros_10,
+    totalZeros_11, totalZeros_12, totalZeros_13, totalZeros_14,
+    totalZeros_15};
+
+static const u8 totalZerosShift[15] = {4,3,3,4,4,3,3,3,3,4,5,5,6,7,8};
+
+/* total_zeros for chroma DC by totalCoeff - 1, indexed by the next 3 stream
+ * bits */
+static const u8 totalZerosChromaDc[3][8] = {
+    {0x33,0x23,0x12,0x12,0x01,0x01,0x01,0x01},
+    {0x22,0x22,0x12,0x12,0x01,0x01,0x01,0x01},
+    {0x11,0x11,0x11,0x11,0x01,0x01,0x01,0x01}};
+
 /* VLC tables for run_before. Table elements have the following structure:
  * [4 bits for info] [4bits for VLC length]
  */
@@ -318,14 +289,22 @@ static const u8 runBefore_2[4] = {0x22,0x12,0x01,0x01};
 
 static const u8 runBefore_1[2] = {0x11,0x01};
 
+/* run_before tables for zerosLeft 1 to 6 and the shift that leaves their
+ * index from the next 11 stream bits */
+static const u8 * const runBefore[6] = {
+    runBefore_1, runBefore_2, runBefore_3, runBefore_4, runBefore_5,
+    runBefore_6};
+
+static const u8 runBeforeShift[6] = {10,9,9,8,8,8};
+
 /* following four macros are used to handle stream buffer "cache" in the CAVLC
  * decoding function */
 
-/* macro to initialize stream buffer cache, fills the buffer (32 bits) */
+/* macro to initialize stream buffer cache, fills the buffer (64 bits) */
 #define BUFFER_INIT(value, bits) \
 { \
-    bits = 32; \
-    value = h264bsdShowBits32(pStrmData); \
+    bits = 64; \
+    value = h264bsdShowBits64(pStrmData); \
 }
 
 /* macro to read numBits bits from the buffer, bits will be written to
@@ -334,12 +313,12 @@ static const u8 runBefore_1[2] = {0x11,0x01};
 { \
     if (bits < (numBits)) \
     { \
-        if(h264bsdFlushBits(pStrmData,32-bits) == END_OF_STREAM) \
+        if(h264bsdFlushBits(pStrmData,64-bits) == END_OF_STREAM) \
             return(HANTRO_NOK); \
-        value = h264bsdShowBits32(pStrmData); \
-        bits = 32; \
+        value = h264bsdShowBits64(pStrmData); \
+        bits = 64; \
     } \
-    (outVal) = value >> (32 - (numBits)); \
+    (outVal) = (u32)(value >> (64 - (numBits))); \
 }
 
 /* macro to flush numBits bits from the buffer */
@@ -355,12 +334,12 @@ static const u8 runBefore_1[2] = {0x11,0x01};
 { \
     if (bits < (numBits)) \
     { \
-        if(h264bsdFlushBits(pStrmData,32-bits) == END_OF_STREAM) \
+        if(h264bsdFlushBits(pStrmData,64-bits) == END_OF_STREAM) \
             return(HANTRO_NOK); \
-        value = h264bsdShowBits32(pStrmData); \
-        bits = 32; \
+        value = h264bsdShowBits64(pStrmData); \
+        bits = 64; \
     } \
-    (outVal) = value >> (32 - (numBits)); \
+    (outVal) = (u32)(value >> (64 - (numBits))); \
     value <<= (numBits); \
     bits -= (numBits); \
 }
@@ -398,7 +377,8 @@ u32 DecodeCoeffToken(u32 bits, u32 nc)
 
 /* Variables */
 
-    u32 value;
+    u32 zeros, index;
+    const u16 *table;
 
 /* Code */
 
@@ -406,52 +386,35 @@ u32 DecodeCoeffToken(u32 bits, u32 nc)
      * represented by u32 here -> -1 maps to 2^32 - 1 */
     ASSERT(nc <= 16 || nc == (u32)(-1));
 
+    zeros = CLZ(bits | 0x1) - 16;
+
     if (nc < 2)
     {
-        if (bits >= 0x8000)
-        {
-            value = 0x0001;
-        }
-        else if (bits >= 0x0C00)
-            value = coeffToken0_0[bits >> 10];
-        else if (bits >= 0x0100)
-            value = coeffToken0_1[bits >> 6];
-        else if (bits >= 0x0020)
-            value = coeffToken0_2[(bits>>2)-8];
-        else
-            value = coeffToken0_3[bits];
+        index = coeffTokenIndex0[zeros];
+        table = coeffToken0;
     }
     else if (nc < 4)
     {
-        if (bits >= 0x8000)
-        {
-            value = bits & 0x4000 ? 0x0002 : 0x0822;
-        }
-        else if (bits >= 0x1000)
-            value = coeffToken2_0[bits >> 10];
-        else if (bits >= 0x0200)
-            value = coeffToken2_1[bits >> 7];
-        else
-            value = coeffToken2_2[bits>>2];
+        index = coeffTokenIndex2[zeros];
+        table = coeffToken2;
     }
     else if (nc < 8)
     {
-        value = coeffToken4_0[bits >> 10];
-        if (!value)
-            value = coeffToken4_1[bits>>6];
+        index = coeffTokenIndex4[zeros];
+        table = coeffToken4;
     }
     else if (nc <= 16)
     {
-        value = coeffToken8[bits>>10];
+        return(coeffToken8[bits>>10]);
     }
     else
     {
-        value = coeffTokenMinus1_0[bits >> 13];
-        if (!value)
-            value = coeffTokenMinus1_1[bits>>8];
+        index = coeffTokenIndexMinus1[zeros];
+        table = coeffTokenMinus1;
     }
 
-    return(value);
+    return(table[(index >> 4) +
+        (((bits << (zeros + 1)) & 0xFFFF) >> (16 - (index & 0xF)))]);
 
 }
 
@@ -475,46 +438,13 @@ u32 DecodeLevelPrefix(u32 bits)
 
 /* Variables */
 
-    u32 numZeros;
-
 /* Code */
 
-    if (bits >= 0x8000)
-        numZeros = 0;
-    else if (bits >= 0x4000)
-        numZeros = 1;
-    else if (bits >= 0x2000)
-        numZeros = 2;
-    else if (bits >= 0x1000)
-        numZeros = 3;
-    else if (bits >= 0x0800)
-        numZeros = 4;
-    else if (bits >= 0x0400)
-        numZeros = 5;
-    else if (bits >= 0x0200)
-        numZeros = 6;
-    else if (bits >= 0x0100)
-        numZeros = 7;
-    else if (bits >= 0x0080)
-        numZeros = 8;
-    else if (bits >= 0x0040)
-        numZeros = 9;
-    else if (bits >= 0x0020)
-        numZeros = 10;
-    else if (bits >= 0x0010)
-        numZeros = 11;
-    else if (bits >= 0x0008)
-        numZeros = 12;
-    else if (bits >= 0x0004)
-        numZeros = 13;
-    else if (bits >= 0x0002)
-        numZeros = 14;
-    else if (bits >= 0x0001)
-        numZeros = 15;
-    else /* more than 15 zeros encountered which is an error */
+    /* more than 15 zeros encountered which is an error */
+    if (!bits)
         return(VLC_NOT_FOUND);
 
-    return(numZeros);
+    return(CLZ(bits) - 16);
 
 }
 
@@ -550,92 +480,16 @@ u32 DecodeTotalZeros(u32 bits, u32 totalCoeff, u32 isChromaDC)
     if (!isChromaDC)
     {
         ASSERT(totalCoeff < 16);
-        switch (totalCoeff)
-        {
-            case 1:
-                value = totalZeros_1_0[bits >> 4];
-                if (!value)
-                    value = totalZeros_1_1[bits];
-                break;
-
-            case 2:
-                value = totalZeros_2[bits >> 3];
-                break;
-
-            case 3:
-                value = totalZeros_3[bits >> 3];
-                break;
-
-            case 4:
-                value = totalZeros_4[bits >> 4];
-                break;
-
-            case 5:
-                value = totalZeros_5[bits >> 4];
-                break;
-
-            case 6:
-                value = totalZeros_6[bits >> 3];
-                break;
-
-            case 7:
-                value = totalZeros_7[bits >> 3];
-                break;
-
-            case 8:
-                value = totalZeros_8[bits >> 3];
-                break;
-
-            case 9:
-                value = totalZeros_9[bits >> 3];
-                break;
-
-            case 10:
-                value = totalZeros_10[bits >> 4];
-                break;
-
-            case 11:
-                value = totalZeros_11[bits >> 5];
-                break;
-
-            case 12:
-                value = totalZeros_12[bits >> 5];
-                break;
-
-            case 13:
-                value = totalZeros_13[bits >> 6];
-                break;
-
-            case 14:
-                value = totalZeros_14[bits >> 7];
-                break;
-
-            default: /* case 15 */
-                value = (bits >> 8) ? 0x11 : 0x01;
-                break;
-        }
+        value = totalZeros[totalCoeff-1][bits >> totalZerosShift[totalCoeff-1]];
+        /* only totalZeros_1_0 has codes longer than its index, those
+         * starting with four zeros */
+        if (!value)
+            value = totalZeros_1_1[bits];
     }
     else
     {
         ASSERT(totalCoeff < 4);
-        bits >>= 6;
-        if (bits > 3)
-            value = 0x01;
-        else
-        {
-            if (totalCoeff == 3)
-                value = 0x11;
-            else if (bits > 1)
-            {
-                value = 0x12;
-            }
-            else if (totalCoeff == 2)
-                value = 0x22;
-            else if (bits)
-                value = 0x23;
-            else
-                value = 0x33;
-        }
+        value = totalZerosChromaDc[totalCoeff-1][bits >> 6];
     }
 
     return(value);
@@ -663,58 +517,27 @@ u32 DecodeRunBefore(u32 bits, u32 zerosLeft)
 
 /* Variables */
 
-    u32 value = 0x0;
+    u32 value = 0x0, zeros;
 
 /* Code */
 
-    switch (zerosLeft)
+    if (zerosLeft <= 6)
+    {
+        ASSERT(zerosLeft);
+        value = runBefore[zerosLeft-1][bits >> runBeforeShift[zerosLeft-1]];
+    }
+    else
     {
-        case 1:
-            value = runBefore_1[bits>>10];
-            break;
-
-        case 2:
-            value = runBefore_2[bits>>9];
-            break;
-
-        case 3:
-            value = runBefore_3[bits>>9];
-            break;
-
-        case 4:
-            value = runBefore_4[bits>>8];
-            break;
-
-        case 5:
-            value = runBefore_5[bits>>8];
-            break;
-
-        case 6:
-            value = runBefore_6[bits>>8];
-            break;
-
-        default:
-            if (bits >= 0x100)
-                value = ((7-(bits>>8))<<4)+0x3;
-            else if (bits >= 0x80)
-                value = 0x74;
-            else if (bits >= 0x40)
-                value = 0x85;
-            else if (bits >= 0x20)
-                value = 0x96;
-            else if (bits >= 0x10)
-                value = 0xa7;
-            else if (bits >= 0x8)
-                value = 0xb8;
-            else if (bits >= 0x4)
-                value = 0xc9;
-            else if (bits >= 0x2)
-                value = 0xdA;
-            else if (bits)
-                value = 0xeB;
-            if (INFO(value) > zerosLeft)
-                value = 0;
-            break;
+        if (bits >= 0x100)
+            value = ((7-(bits>>8))<<4)+0x3;
+        /* runs 7 to 14 are coded as (run - 4) zeros and a '1' */
+        else if (bits)
+        {
+            zeros = CLZ(bits) - 21;
+            value = ((zeros + 4) << 4) + zeros + 1;
+        }
+        if (INFO(value) > zerosLeft)
+            value = 0;
     }
 
     return(value);
@@ -760,7 +583,7 @@ u32 h264bsdDecodeResidualBlockCavlc(
     i32 level[16];
     u32 run[16];
     /* stream "cache" */
-    u32 bufferValue;
+    uint64_t bufferValue;
     u32 bufferBits;
 
 /* Code */
@@ -909,7 +732,7 @@ u32 h264bsdDecodeResidualBlockCavlc(
     else
         levelSuffix = 0;
 
-    if (h264bsdFlushBits(pStrmData, 32-bufferBits) != HANTRO_OK)
+    if (h264bsdFlushBits(pStrmData, 64-bufferBits) != HANTRO_OK)
         return(HANTRO_NOK);
 
     return((totalCoeff << 4) | (levelSuffix << 16));
@@ -46,6 +46,16 @@
 #define MAX_NUM_SEQ_PARAM_SETS 32
 #define MAX_NUM_PIC_PARAM_SETS 256
 
+/* With SSE2 or NEON, motion compensation, deblocking, the inverse
+ * transforms and intra prediction use the kernels in the matching
+ * h264bsd_*_simd.c files. Define H264DEC_NO_SIMD to build the C versions
+ * instead. */
+#if !defined(H264DEC_NO_SIMD) && !defined(H264DEC_OMXDL) && \
+    !defined(H264DEC_ARM11) && !defined(H264DEC_NEON) && \
+    (defined(__SSE2__) || defined(__ARM_NEON))
+#define H264DEC_SIMD
+#endif
+
 /*------------------------------------------------------------------------------
     3. Data types
 ------------------------------------------------------------------------------*/
@@ -26,6 +26,7 @@
      5. Functions
           h264bsdConceal
           ConcealMb
+          CopyMb
           Transform
 
 ------------------------------------------------------------------------------*/
@@ -56,6 +57,9 @@
 static u32 ConcealMb(mbStorage_t *pMb, image_t *currImage, u32 row, u32 col,
     u32 sliceType, u8 *data);
 
+static void CopyMb(mbStorage_t *pMb, image_t *currImage, u32 row, u32 col,
+    u8 *refData);
+
 static void Transform(i32 *data);
 
 /*------------------------------------------------------------------------------
@@ -108,6 +112,13 @@ static void Transform(i32 *data);
             macroblocks to value 40 and macroblock type to intra to enable
             deblocking filter to smooth the edges of the concealed areas.
 
+            With the CONCEAL_COPY policy every lost macroblock is a plain
+            copy of the collocated macroblock of the reference picture,
+            gray if there is none, regardless of the slice type. Copied
+            macroblocks are not filtered. This costs about the same as
+            decoding a skipped macroblock, so a picture with lost slices is
+            not slower to finish than an intact one.
+
         Inputs:
             pStorage        pointer to storage structure
             currImage       pointer to current image structure
@@ -129,6 +140,7 @@ u32 h264bsdConceal(storage_t *pStorage, image_t *currImage, u32 sliceType)
     u32 i, j;
     u32 row, col;
     u32 width, height;
+    u32 copy;
     u8 *refData;
     mbStorage_t *mb;
 
@@ -142,9 +154,11 @@ u32 h264bsdConceal(storage_t *pStorage, image_t *currImage, u32 sliceType)
 
     width = currImage->width;
     height = currImage->height;
+    copy = pStorage->concealment == CONCEAL_COPY;
     refData = NULL;
     /* use reference picture with smallest available index */
-    if (IS_P_SLICE(sliceType) || (pStorage->intraConcealmentFlag != 0))
+    if (IS_P_SLICE(sliceType) || (pStorage->intraConcealmentFlag != 0) ||
+        copy)
     {
         i = 0;
         do
@@ -172,7 +186,8 @@ u32 h264bsdConceal(storage_t *pStorage, image_t *currImage, u32 sliceType)
     /* whole picture lost -> copy previous or set grey */
     if (i == pStorage->picSizeInMbs)
     {
-        if ( (IS_I_SLICE(sliceType) && (pStorage->intraConcealmentFlag == 0)) ||
+        if ( (IS_I_SLICE(sliceType) && (pStorage->intraConcealmentFlag == 0) &&
+              !copy) ||
              refData == NULL)
         {
             memset(currImage->data, 128, width*height*384);
@@ -199,6 +214,21 @@ u32 h264bsdConceal(storage_t *pStorage, image_t *currImage, u32 sliceType)
         return(HANTRO_OK);
     }
 
+    /* copies do not depend on the neighbours, conceal in raster scan */
+    if (copy)
+    {
+        for (i = 0, mb = pStorage->mb; i < pStorage->picSizeInMbs; i++, mb++)
+        {
+            if (!mb->decoded)
+            {
+                CopyMb(mb, currImage, i / width, i % width, refData);
+                mb->decoded = 1;
+                pStorage->numConcealedMbs++;
+            }
+        }
+        return(HANTRO_OK);
+    }
+
     /* start from the row containing the first correct macroblock, conceal the
      * row in question, all rows above that row and then continue downwards */
     mb = pStorage->mb + row * width;
@@ -325,6 +355,7 @@ u32 ConcealMb(mbStorage_t *pMb, image_t *currImage, u32 row, u32 col,
         refImage.width = width;
         refImage.height = height;
         refImage.data = refData;
+        refImage.lumaOnly = currImage->lumaOnly;
         if (refImage.data)
         {
 #ifndef H264DEC_OMXDL
@@ -587,6 +618,75 @@ u32 ConcealMb(mbStorage_t *pMb, image_t *currImage, u32 row, u32 col,
 }
 
 
+/*------------------------------------------------------------------------------
+
+    Function name: CopyMb
+
+        Functional description:
+            Conceal one macroblock by copying the collocated macroblock of
+            the reference picture, or setting it gray if refData is NULL.
+            The macroblock is left out of deblocking.
+
+------------------------------------------------------------------------------*/
+
+void CopyMb(mbStorage_t *pMb, image_t *currImage, u32 row, u32 col,
+    u8 *refData)
+{
+
+/* Variables */
+
+    u32 i;
+    u32 width, offset;
+    u8 *lum, *cb, *cr;
+
+/* Code */
+
+    ASSERT(pMb);
+    ASSERT(!pMb->decoded);
+    ASSERT(currImage);
+
+    pMb->qpY = 40;
+    pMb->disableDeblockingFilterIdc = 1;
+    pMb->mbType = I_4x4;
+    pMb->filterOffsetA = 0;
+    pMb->filterOffsetB = 0;
+    pMb->chromaQpIndexOffset = 0;
+
+    h264bsdSetCurrImageMbPointers(currImage, row * currImage->width + col);
+    lum = currImage->luma;
+    cb = currImage->cb;
+    cr = currImage->cr;
+    width = currImage->width * 16;
+
+    if (refData == NULL)
+    {
+        for (i = 16; i--; lum += width)
+            memset(lum, 128, 16);
+        if (currImage->lumaOnly)
+            return;
+        for (i = 8; i--; cb += width/2, cr += width/2)
+        {
+            memset(cb, 128, 8);
+            memset(cr, 128, 8);
+        }
+        return;
+    }
+
+    /* the images have the same layout, copy from the same offsets */
+    offset = (u32)(lum - currImage->data);
+    for (i = 16; i--; lum += width, offset += width)
+        memcpy(lum, refData + offset, 16);
+    if (currImage->lumaOnly)
+        return;
+    offset = (u32)(cb - currImage->data);
+    for (i = 8; i--; cb += width/2, offset += width/2)
+        memcpy(cb, refData + offset, 8);
+    offset = (u32)(cr - currImage->data);
+    for (i = 8; i--; cr += width/2, offset += width/2)
+        memcpy(cr, refData + offset, 8);
+
+}
+
 /*------------------------------------------------------------------------------
 
     Function name: Transform
@@ -41,6 +41,12 @@
     2. Module defines
 ------------------------------------------------------------------------------*/
 
+/* concealment policies (storage_t concealment), spatial or temporal
+ * concealment depending on the slice type, or a copy of the collocated
+ * macroblock of the reference picture whatever the slice type */
+#define CONCEAL_FULL    0
+#define CONCEAL_COPY    1
+
 /*------------------------------------------------------------------------------
     3. Data types
 ------------------------------------------------------------------------------*/
@@ -25,6 +25,7 @@
      4. Local function prototypes
      5. Functions
           h264bsdFilterPicture
+          h264bsdFilterPictureRows
           FilterVerLumaEdge
           FilterHorLumaEdge
           FilterHorLuma
@@ -53,6 +54,7 @@
 #include "h264bsd_macroblock_layer.h"
 #include "h264bsd_deblocking.h"
 #include "h264bsd_dpb.h"
+#include "h264bsd_profile.h"
 
 #ifdef H264DEC_OMXDL
 #include "omxtypes.h"
@@ -177,6 +179,7 @@ static void FilterLuma(u8 *data, bS_t *bS, edgeThreshold_t *thresholds,
 static void FilterChroma(u8 *cb, u8 *cr, bS_t *bS, edgeThreshold_t *thresholds,
         u32 imageWidth);
 
+#ifndef H264DEC_SIMD
 static void FilterVerLumaEdge( u8 *data, u32 bS, edgeThreshold_t *thresholds,
         u32 imageWidth);
 static void FilterHorLumaEdge( u8 *data, u32 bS, edgeThreshold_t *thresholds,
@@ -190,6 +193,7 @@ static void FilterHorChromaEdge( u8 *data, u32 bS, edgeThreshold_t *thresholds,
   i32 imageWidth);
 static void FilterHorChroma( u8 *data, u32 bS, edgeThreshold_t *thresholds,
   i32 imageWidth);
+#endif /* H264DEC_SIMD */
 
 static void GetLumaEdgeThresholds(
   edgeThreshold_t *thresholds,
@@ -571,12 +575,52 @@ u32 EdgeBoundaryStrengthLeft(mbStorage_t *mb1, mbStorage_t *mb2)
           none
 
 ------------------------------------------------------------------------------*/
-#ifndef H264DEC_OMXDL
 void h264bsdFilterPicture(
   image_t *image,
   mbStorage_t *mb)
 {
 
+/* Code */
+
+    ASSERT(image);
+
+    h264bsdFilterPictureRows(image, mb, 0, image->height);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterPictureRows
+
+        Functional description:
+          Perform deblocking filtering for macroblock rows of a picture. Rows
+          have to be filtered from top to bottom. Filtering of a row changes
+          the three bottom lines of the row above it, and the row may only be
+          filtered once the row below it has been reconstructed: intra
+          prediction of that row uses unfiltered samples.
+
+        Inputs:
+          image         pointer to image to be filtered
+          mb            pointer to macroblock data structure of the top-left
+                        macroblock of the picture
+          firstRow      first macroblock row to filter
+          numRows       number of rows to filter
+
+        Outputs:
+          image         filtered image stored here
+
+        Returns:
+          none
+
+------------------------------------------------------------------------------*/
+#ifndef H264DEC_OMXDL
+void h264bsdFilterPictureRows(
+  image_t *image,
+  mbStorage_t *mb,
+  u32 firstRow,
+  u32 numRows)
+{
+
 /* Variables */
 
     u32 flags;
@@ -586,6 +630,7 @@ void h264bsdFilterPicture(
     mbStorage_t *pMb;
     bS_t bS[16];
     edgeThreshold_t thresholds[3];
+    PROFILE_VARIABLES
 
 /* Code */
 
@@ -599,9 +644,12 @@ void h264bsdFilterPicture(
     data = image->data;
     picSizeInMbs = picWidthInMbs * image->height;
 
-    pMb = mb;
+    ASSERT(firstRow + numRows <= image->height);
 
-    for (mbRow = 0, mbCol = 0; mbRow < image->height; pMb++)
+    pMb = mb + firstRow * picWidthInMbs;
+    PROFILE_START;
+
+    for (mbRow = firstRow, mbCol = 0; mbRow < firstRow + numRows; pMb++)
     {
         flags = GetMbFilteringFlags(pMb);
 
@@ -618,13 +666,16 @@ void h264bsdFilterPicture(
                 FilterLuma((u8*)data, bS, thresholds, picWidthInMbs*16);
 
                 /* chroma */
-                GetChromaEdgeThresholds(thresholds, pMb, flags,
-                    pMb->chromaQpIndexOffset);
-                data = image->data + picSizeInMbs * 256 +
-                    mbRow * picWidthInMbs * 64 + mbCol * 8;
+                if (!image->lumaOnly)
+                {
+                    GetChromaEdgeThresholds(thresholds, pMb, flags,
+                        pMb->chromaQpIndexOffset);
+                    data = image->data + picSizeInMbs * 256 +
+                        mbRow * picWidthInMbs * 64 + mbCol * 8;
 
-                FilterChroma((u8*)data, data + 64*picSizeInMbs, bS,
-                        thresholds, picWidthInMbs*8);
+                    FilterChroma((u8*)data, data + 64*picSizeInMbs, bS,
+                            thresholds, picWidthInMbs*8);
+                }
 
             }
         }
@@ -637,6 +688,8 @@ void h264bsdFilterPicture(
         }
     }
 
+    PROFILE_END(PROFILE_DEBLOCK);
+
 }
 
 int sample = 0;
@@ -645,6 +698,7 @@ unsigned int hashB = 0;
 unsigned int hashC = 0;
 unsigned int hashD = 0;
 
+#ifndef H264DEC_SIMD
 /*------------------------------------------------------------------------------
 
     Function: FilterVerLumaEdge
@@ -1144,9 +1198,23 @@ void FilterHorChroma(
     }
 
 }
-
+#endif /* H264DEC_SIMD */
 
 void GetBoundaryStrengthsA(mbStorage_t *mb, bS_t *bS) {
+#ifdef H264DEC_SIMD
+    /* bit i set if block i or the block above it (left of it) has
+     * coefficients */
+    u32 nz = h264bsdNonZeroBlocks(mb->totalCoeff);
+    u32 top = nz | (nz << 4);
+    u32 left = nz | (nz << 1);
+    u32 i;
+
+    for (i = 4; i < 16; i++)
+        bS[i].top = ((top >> i) & 1) << 1;
+    for (i = 1; i < 16; i++)
+        if (i & 3)
+            bS[i].left = ((left >> i) & 1) << 1;
+#else
     bS[4].top = mb->totalCoeff[2] || mb->totalCoeff[0] ? 2 : 0;
     bS[5].top = mb->totalCoeff[3] || mb->totalCoeff[1] ? 2 : 0;
     bS[6].top = mb->totalCoeff[6] || mb->totalCoeff[4] ? 2 : 0;
@@ -1172,6 +1240,7 @@ void GetBoundaryStrengthsA(mbStorage_t *mb, bS_t *bS) {
     bS[13].left = mb->totalCoeff[11] || mb->totalCoeff[10] ? 2 : 0;
     bS[14].left = mb->totalCoeff[14] || mb->totalCoeff[11] ? 2 : 0;
     bS[15].left = mb->totalCoeff[15] || mb->totalCoeff[14] ? 2 : 0;
+#endif /* H264DEC_SIMD */
 }
 
 /*------------------------------------------------------------------------------
@@ -1540,6 +1609,7 @@ void GetChromaEdgeThresholds(
 
 }
 
+#ifndef H264DEC_SIMD
 /*------------------------------------------------------------------------------
 
     Function: FilterLuma
@@ -1744,37 +1814,149 @@ void FilterChroma(
     }
 }
 
-#else /* H264DEC_OMXDL */
+#else /* H264DEC_SIMD */
 
 /*------------------------------------------------------------------------------
 
-    Function: h264bsdFilterPicture
+    Function: FilterLuma
 
         Functional description:
-          Perform deblocking filtering for a picture. Filter does not copy
-          the original picture anywhere but filtering is performed directly
-          on the original image. Parameters controlling the filtering process
-          are computed based on information in macroblock structures of the
-          filtered macroblock, macroblock above and macroblock on the left of
-          the filtered one.
+            Function to filter all luma edges of a macroblock, a whole
+            16-pixel edge per call. All vertical edges are filtered before
+            the horizontal ones, as in the standard; the C version
+            interleaves them by block row, which gives the same result.
 
-        Inputs:
-          image         pointer to image to be filtered
-          mb            pointer to macroblock data structure of the top-left
-                        macroblock of the picture
+------------------------------------------------------------------------------*/
+void FilterLuma(
+  u8 *data,
+  bS_t *bS,
+  edgeThreshold_t *thresholds,
+  u32 width)
+{
 
-        Outputs:
-          image         filtered image stored here
+/* Variables */
 
-        Returns:
-          none
+    u32 i;
+    u8 edge[4];
+    edgeThreshold_t *thr;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(bS);
+    ASSERT(thresholds);
+
+    for (i = 0; i < 4; i++)
+    {
+        edge[0] = (u8)bS[i].left;
+        edge[1] = (u8)bS[4+i].left;
+        edge[2] = (u8)bS[8+i].left;
+        edge[3] = (u8)bS[12+i].left;
+        if (edge[0] | edge[1] | edge[2] | edge[3])
+        {
+            thr = thresholds + (i ? INNER : LEFT);
+            h264bsdFilterLumaVerEdge16(data + 4*i, width, edge,
+                thr->alpha, thr->beta, thr->tc0);
+        }
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        edge[0] = (u8)bS[4*i].top;
+        edge[1] = (u8)bS[4*i+1].top;
+        edge[2] = (u8)bS[4*i+2].top;
+        edge[3] = (u8)bS[4*i+3].top;
+        if (edge[0] | edge[1] | edge[2] | edge[3])
+        {
+            thr = thresholds + (i ? INNER : TOP);
+            h264bsdFilterLumaHorEdge16(data + 4*i*width, width, edge,
+                thr->alpha, thr->beta, thr->tc0);
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterChroma
+
+        Functional description:
+            Function to filter all chroma edges of a macroblock, Cb and Cr
+            together. The chroma edges at columns and rows 0 and 4 use the
+            bS values of luma edges 0 and 2.
+
+------------------------------------------------------------------------------*/
+void FilterChroma(
+  u8 *dataCb,
+  u8 *dataCr,
+  bS_t *bS,
+  edgeThreshold_t *thresholds,
+  u32 width)
+{
+
+/* Variables */
+
+    u32 i;
+    u8 edge[4];
+    edgeThreshold_t *thr;
+
+/* Code */
+
+    ASSERT(dataCb);
+    ASSERT(dataCr);
+    ASSERT(bS);
+    ASSERT(thresholds);
+
+    for (i = 0; i < 2; i++)
+    {
+        edge[0] = (u8)bS[2*i].left;
+        edge[1] = (u8)bS[4+2*i].left;
+        edge[2] = (u8)bS[8+2*i].left;
+        edge[3] = (u8)bS[12+2*i].left;
+        if (edge[0] | edge[1] | edge[2] | edge[3])
+        {
+            thr = thresholds + (i ? INNER : LEFT);
+            h264bsdFilterChromaVerEdge8(dataCb + 4*i, dataCr + 4*i, width,
+                edge, thr->alpha, thr->beta, thr->tc0);
+        }
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        edge[0] = (u8)bS[8*i].top;
+        edge[1] = (u8)bS[8*i+1].top;
+        edge[2] = (u8)bS[8*i+2].top;
+        edge[3] = (u8)bS[8*i+3].top;
+        if (edge[0] | edge[1] | edge[2] | edge[3])
+        {
+            thr = thresholds + (i ? INNER : TOP);
+            h264bsdFilterChromaHorEdge8(dataCb + 4*i*width,
+                dataCr + 4*i*width, width, edge,
+                thr->alpha, thr->beta, thr->tc0);
+        }
+    }
+}
+
+#endif /* H264DEC_SIMD */
+
+#else /* H264DEC_OMXDL */
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterPictureRows
+
+        Functional description:
+          Perform deblocking filtering for macroblock rows of a picture with
+          the OpenMAX DL edge filters. Same inputs and outputs as the
+          function above.
 
 ------------------------------------------------------------------------------*/
 
 /*lint --e{550} Symbol not accessed */
-void h264bsdFilterPicture(
+void h264bsdFilterPictureRows(
   image_t *image,
-  mbStorage_t *mb)
+  mbStorage_t *mb,
+  u32 firstRow,
+  u32 numRows)
 {
 
 /* Variables */
@@ -1803,9 +1985,11 @@ void h264bsdFilterPicture(
     data = image->data;
     picSizeInMbs = picWidthInMbs * image->height;
 
-    pMb = mb;
+    ASSERT(firstRow + numRows <= image->height);
+
+    pMb = mb + firstRow * picWidthInMbs;
 
-    for (mbRow = 0, mbCol = 0; mbRow < image->height; pMb++)
+    for (mbRow = firstRow, mbCol = 0; mbRow < firstRow + numRows; pMb++)
     {
         flags = GetMbFilteringFlags(pMb);
 
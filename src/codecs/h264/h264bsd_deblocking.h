@@ -34,6 +34,7 @@
 ------------------------------------------------------------------------------*/
 
 #include "basetype.h"
+#include "h264bsd_cfg.h"
 #include "h264bsd_image.h"
 #include "h264bsd_macroblock_layer.h"
 
@@ -53,5 +54,26 @@ void h264bsdFilterPicture(
   image_t *image,
   mbStorage_t *mb);
 
+void h264bsdFilterPictureRows(
+  image_t *image,
+  mbStorage_t *mb,
+  u32 firstRow,
+  u32 numRows);
+
+#ifdef H264DEC_SIMD
+/* Edge filters of h264bsd_deblocking_simd.c. bS gives the boundary strength
+ * of each 4-pixel (chroma: 2-pixel) section of the edge, either 4 for all
+ * of them or 0..3 each, and tc0 the tc0 values of the edge for bS 1..3. */
+void h264bsdFilterLumaHorEdge16(u8 *data, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0);
+void h264bsdFilterLumaVerEdge16(u8 *data, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0);
+void h264bsdFilterChromaHorEdge8(u8 *cb, u8 *cr, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0);
+void h264bsdFilterChromaVerEdge8(u8 *cb, u8 *cr, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0);
+u32 h264bsdNonZeroBlocks(const i16 *totalCoeff);
+#endif /* H264DEC_SIMD */
+
 #endif /* #ifdef H264SWDEC_DEBLOCKING_H */
 
@@ -0,0 +1,658 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdFilterLumaHorEdge16
+          h264bsdFilterLumaVerEdge16
+          h264bsdFilterChromaHorEdge8
+          h264bsdFilterChromaVerEdge8
+          h264bsdNonZeroBlocks
+
+--------------------------------------------------------------------------------
+
+    SSE2 and NEON versions of the deblocking edge filters of
+    h264bsd_deblocking.c. Each call filters a whole macroblock edge: 16 luma
+    pixels, or 8 Cb and 8 Cr pixels side by side, one pixel per vector lane.
+    Vertical edges are transposed so that both directions share the same
+    filters. Results are bit-exact with the C versions.
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+#include "h264bsd_deblocking.h"
+#include "h264bsd_util.h"
+
+#ifdef H264DEC_SIMD
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <arm_neon.h>
+#endif
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+    H264DEC_SIMD is set in h264bsd_cfg.h when the target has SSE2 or NEON.
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/* Vector helpers. v8 holds sixteen unsigned 8-bit lanes, v16 eight signed
+ * 16-bit lanes. Conditions are kept as v8 lane masks (0x00 or 0xFF), the
+ * filter arithmetic is done in 16 bits on each half of the lanes. */
+#if defined(__SSE2__)
+
+typedef __m128i v8;
+typedef __m128i v16;
+
+static inline v8 Load(const u8 *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void Store(u8 *p, v8 a) { _mm_storeu_si128((__m128i*)p, a); }
+
+/* Eight bytes from each pointer: a in lanes 0..7, b in lanes 8..15 */
+static inline v8 LoadPair(const u8 *a, const u8 *b)
+{
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)a),
+        _mm_loadl_epi64((const __m128i*)b));
+}
+
+static inline void StorePair(u8 *a, u8 *b, v8 x)
+{
+    _mm_storel_epi64((__m128i*)a, x);
+    _mm_storel_epi64((__m128i*)b, _mm_srli_si128(x, 8));
+}
+
+static inline v8 Dup(u32 x) { return _mm_set1_epi8((char)x); }
+
+/* Lane mask of |a - b| < t, t given as Limit(t) */
+static inline v8 Limit(u32 t) { return Dup(t - 1); }
+static inline v8 AbsLt(v8 a, v8 b, v8 limit)
+{
+    v8 d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+    return _mm_cmpeq_epi8(_mm_subs_epu8(d, limit), _mm_setzero_si128());
+}
+
+static inline v8 And(v8 a, v8 b) { return _mm_and_si128(a, b); }
+static inline v8 Sel(v8 m, v8 a, v8 b)
+{
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+static inline u32 Any(v8 m) { return (u32)_mm_movemask_epi8(m); }
+
+/* a - m for a lane mask m: adds one where m is set */
+static inline v8 Inc(v8 a, v8 m) { return _mm_sub_epi8(a, m); }
+
+/* (a + b + 1) >> 1 */
+static inline v8 Avg(v8 a, v8 b) { return _mm_avg_epu8(a, b); }
+
+static inline v16 Lo(v8 a) { return _mm_unpacklo_epi8(a, _mm_setzero_si128()); }
+static inline v16 Hi(v8 a) { return _mm_unpackhi_epi8(a, _mm_setzero_si128()); }
+static inline v8 Pack(v16 lo, v16 hi) { return _mm_packus_epi16(lo, hi); }
+
+static inline v16 Add(v16 a, v16 b) { return _mm_add_epi16(a, b); }
+static inline v16 Sub(v16 a, v16 b) { return _mm_sub_epi16(a, b); }
+static inline v16 AddK(v16 a, i32 k) { return _mm_add_epi16(a, _mm_set1_epi16((i16)k)); }
+static inline v16 Shr1(v16 a) { return _mm_srai_epi16(a, 1); }
+static inline v16 Shr2(v16 a) { return _mm_srai_epi16(a, 2); }
+static inline v16 Shr3(v16 a) { return _mm_srai_epi16(a, 3); }
+static inline v16 Clip(v16 a, v16 t)
+{
+    return _mm_max_epi16(_mm_min_epi16(a, t), _mm_sub_epi16(_mm_setzero_si128(), t));
+}
+
+/* Sixteen rows of eight pixels to eight vectors, one per column. Rows 0..7
+ * start at a, rows 8..15 at b, so lane i of each column is row i. */
+static inline void LoadTransposed(const u8 *a, const u8 *b, u32 width,
+    v8 c[8])
+{
+    __m128i x[8], y[8], z[8];
+    u32 i;
+
+    for (i = 0; i < 8; i++)
+    {
+        const u8 *p = (i < 4 ? a : b) + 2*(i & 3)*width;
+        x[i] = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p),
+            _mm_loadl_epi64((const __m128i*)(p + width)));
+    }
+    /* columns 0..3 and 4..7 of rows 4i..4i+3 */
+    for (i = 0; i < 4; i++)
+    {
+        y[2*i]   = _mm_unpacklo_epi16(x[2*i], x[2*i+1]);
+        y[2*i+1] = _mm_unpackhi_epi16(x[2*i], x[2*i+1]);
+    }
+    /* column pairs 01, 23, 45, 67 of rows 0..7, then of rows 8..15 */
+    for (i = 0; i < 2; i++)
+    {
+        z[4*i]   = _mm_unpacklo_epi32(y[4*i],   y[4*i+2]);
+        z[4*i+1] = _mm_unpackhi_epi32(y[4*i],   y[4*i+2]);
+        z[4*i+2] = _mm_unpacklo_epi32(y[4*i+1], y[4*i+3]);
+        z[4*i+3] = _mm_unpackhi_epi32(y[4*i+1], y[4*i+3]);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        c[2*i]   = _mm_unpacklo_epi64(z[i], z[i+4]);
+        c[2*i+1] = _mm_unpackhi_epi64(z[i], z[i+4]);
+    }
+}
+
+static inline void StoreTransposed(u8 *a, u8 *b, u32 width, const v8 c[8])
+{
+    __m128i x[4], y[4];
+    u32 h, i;
+
+    for (h = 0; h < 2; h++)
+    {
+        u8 *p = h ? b : a;
+
+        /* column pairs of rows 0..7 (h = 0) or 8..15 (h = 1) */
+        for (i = 0; i < 4; i++)
+            x[i] = h ? _mm_unpackhi_epi8(c[2*i], c[2*i+1]) :
+                       _mm_unpacklo_epi8(c[2*i], c[2*i+1]);
+        /* rows 0..3 and 4..7, columns 0..3 and 4..7 */
+        y[0] = _mm_unpacklo_epi16(x[0], x[1]);
+        y[1] = _mm_unpackhi_epi16(x[0], x[1]);
+        y[2] = _mm_unpacklo_epi16(x[2], x[3]);
+        y[3] = _mm_unpackhi_epi16(x[2], x[3]);
+        StorePair(p, p + width, _mm_unpacklo_epi32(y[0], y[2]));
+        StorePair(p + 2*width, p + 3*width, _mm_unpackhi_epi32(y[0], y[2]));
+        StorePair(p + 4*width, p + 5*width, _mm_unpacklo_epi32(y[1], y[3]));
+        StorePair(p + 6*width, p + 7*width, _mm_unpackhi_epi32(y[1], y[3]));
+    }
+}
+
+#else /* NEON */
+
+typedef uint8x16_t v8;
+typedef int16x8_t v16;
+
+static inline v8 Load(const u8 *p) { return vld1q_u8(p); }
+static inline void Store(u8 *p, v8 a) { vst1q_u8(p, a); }
+
+static inline v8 LoadPair(const u8 *a, const u8 *b)
+{
+    return vcombine_u8(vld1_u8(a), vld1_u8(b));
+}
+
+static inline void StorePair(u8 *a, u8 *b, v8 x)
+{
+    vst1_u8(a, vget_low_u8(x));
+    vst1_u8(b, vget_high_u8(x));
+}
+
+static inline v8 Dup(u32 x) { return vdupq_n_u8((u8)x); }
+
+static inline v8 Limit(u32 t) { return Dup(t); }
+static inline v8 AbsLt(v8 a, v8 b, v8 limit) { return vcltq_u8(vabdq_u8(a, b), limit); }
+
+static inline v8 And(v8 a, v8 b) { return vandq_u8(a, b); }
+static inline v8 Sel(v8 m, v8 a, v8 b) { return vbslq_u8(m, a, b); }
+static inline u32 Any(v8 m)
+{
+    uint64x2_t t = vreinterpretq_u64_u8(m);
+    return (vgetq_lane_u64(t, 0) | vgetq_lane_u64(t, 1)) != 0;
+}
+
+static inline v8 Inc(v8 a, v8 m) { return vsubq_u8(a, m); }
+static inline v8 Avg(v8 a, v8 b) { return vrhaddq_u8(a, b); }
+
+static inline v16 Lo(v8 a) { return vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(a))); }
+static inline v16 Hi(v8 a) { return vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(a))); }
+static inline v8 Pack(v16 lo, v16 hi) { return vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi)); }
+
+static inline v16 Add(v16 a, v16 b) { return vaddq_s16(a, b); }
+static inline v16 Sub(v16 a, v16 b) { return vsubq_s16(a, b); }
+static inline v16 AddK(v16 a, i32 k) { return vaddq_s16(a, vdupq_n_s16((i16)k)); }
+static inline v16 Shr1(v16 a) { return vshrq_n_s16(a, 1); }
+static inline v16 Shr2(v16 a) { return vshrq_n_s16(a, 2); }
+static inline v16 Shr3(v16 a) { return vshrq_n_s16(a, 3); }
+static inline v16 Clip(v16 a, v16 t) { return vmaxq_s16(vminq_s16(a, t), vnegq_s16(t)); }
+
+/* 8x8 transpose of both halves at once: rows i and i+8 share vector i */
+static inline void Transpose(v8 r[8])
+{
+    uint8x16x2_t t0 = vtrnq_u8(r[0], r[1]);
+    uint8x16x2_t t1 = vtrnq_u8(r[2], r[3]);
+    uint8x16x2_t t2 = vtrnq_u8(r[4], r[5]);
+    uint8x16x2_t t3 = vtrnq_u8(r[6], r[7]);
+    uint16x8x2_t u0 = vtrnq_u16(vreinterpretq_u16_u8(t0.val[0]),
+        vreinterpretq_u16_u8(t1.val[0]));
+    uint16x8x2_t u1 = vtrnq_u16(vreinterpretq_u16_u8(t0.val[1]),
+        vreinterpretq_u16_u8(t1.val[1]));
+    uint16x8x2_t u2 = vtrnq_u16(vreinterpretq_u16_u8(t2.val[0]),
+        vreinterpretq_u16_u8(t3.val[0]));
+    uint16x8x2_t u3 = vtrnq_u16(vreinterpretq_u16_u8(t2.val[1]),
+        vreinterpretq_u16_u8(t3.val[1]));
+    uint32x4x2_t v0 = vtrnq_u32(vreinterpretq_u32_u16(u0.val[0]),
+        vreinterpretq_u32_u16(u2.val[0]));
+    uint32x4x2_t v1 = vtrnq_u32(vreinterpretq_u32_u16(u1.val[0]),
+        vreinterpretq_u32_u16(u3.val[0]));
+    uint32x4x2_t v2 = vtrnq_u32(vreinterpretq_u32_u16(u0.val[1]),
+        vreinterpretq_u32_u16(u2.val[1]));
+    uint32x4x2_t v3 = vtrnq_u32(vreinterpretq_u32_u16(u1.val[1]),
+        vreinterpretq_u32_u16(u3.val[1]));
+    r[0] = vreinterpretq_u8_u32(v0.val[0]);
+    r[4] = vreinterpretq_u8_u32(v0.val[1]);
+    r[1] = vreinterpretq_u8_u32(v1.val[0]);
+    r[5] = vreinterpretq_u8_u32(v1.val[1]);
+    r[2] = vreinterpretq_u8_u32(v2.val[0]);
+    r[6] = vreinterpretq_u8_u32(v2.val[1]);
+    r[3] = vreinterpretq_u8_u32(v3.val[0]);
+    r[7] = vreinterpretq_u8_u32(v3.val[1]);
+}
+
+static inline void LoadTransposed(const u8 *a, const u8 *b, u32 width,
+    v8 c[8])
+{
+    u32 i;
+
+    for (i = 0; i < 8; i++)
+        c[i] = LoadPair(a + i*width, b + i*width);
+    Transpose(c);
+}
+
+static inline void StoreTransposed(u8 *a, u8 *b, u32 width, const v8 c[8])
+{
+    v8 r[8];
+    u32 i;
+
+    for (i = 0; i < 8; i++)
+        r[i] = c[i];
+    Transpose(r);
+    for (i = 0; i < 8; i++)
+        StorePair(a + i*width, b + i*width, r[i]);
+}
+
+#endif
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static void LumaLanes(const u8 *bS, const u8 *tc0, v8 *mask, v8 *tc);
+static void ChromaLanes(const u8 *bS, const u8 *tc0, v8 *mask, v8 *tc);
+static v8 FilterMask(v8 p1, v8 p0, v8 q0, v8 q1, u32 alpha, u32 beta);
+static void FilterLuma(v8 *px, const u8 *bS, u32 alpha, u32 beta,
+    const u8 *tc0);
+static void FilterChroma(v8 *px, const u8 *bS, u32 alpha, u32 beta,
+    const u8 *tc0);
+
+/*------------------------------------------------------------------------------
+
+    Function: LumaLanes, ChromaLanes
+
+        Functional description:
+            Spread the per-section bS and tc0 values of an edge over the
+            lanes: four lanes per bS for luma, two for chroma (the same
+            pattern for the Cb half and the Cr half).
+
+------------------------------------------------------------------------------*/
+
+static void LumaLanes(const u8 *bS, const u8 *tc0, v8 *mask, v8 *tc)
+{
+    u8 m[16], t[16];
+    u32 i;
+
+    for (i = 0; i < 16; i++)
+    {
+        m[i] = bS[i >> 2] ? 0xFF : 0;
+        t[i] = bS[i >> 2] ? tc0[bS[i >> 2] - 1] : 0;
+    }
+    *mask = Load(m);
+    *tc = Load(t);
+}
+
+static void ChromaLanes(const u8 *bS, const u8 *tc0, v8 *mask, v8 *tc)
+{
+    u8 m[16], t[16];
+    u32 i;
+
+    for (i = 0; i < 16; i++)
+    {
+        u32 b = bS[(i & 7) >> 1];
+        m[i] = b ? 0xFF : 0;
+        t[i] = b ? tc0[b - 1] + 1 : 0;
+    }
+    *mask = Load(m);
+    *tc = Load(t);
+}
+
+/* Lanes where the edge is filtered at all */
+static v8 FilterMask(v8 p1, v8 p0, v8 q0, v8 q1, u32 alpha, u32 beta)
+{
+    v8 b = Limit(beta);
+    return And(AbsLt(p0, q0, Limit(alpha)),
+        And(AbsLt(p1, p0, b), AbsLt(q1, q0, b)));
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterLuma
+
+        Functional description:
+            Filter one 16-pixel luma edge. px holds the pixels across the
+            edge, p3 p2 p1 p0 q0 q1 q2 q3, one vector each. bS is either 4
+            for the whole edge or 0..3 for each 4-pixel section.
+
+------------------------------------------------------------------------------*/
+
+static void FilterLuma(v8 *px, const u8 *bS, u32 alpha, u32 beta,
+    const u8 *tc0)
+{
+    v8 p3 = px[0], p2 = px[1], p1 = px[2], p0 = px[3];
+    v8 q0 = px[4], q1 = px[5], q2 = px[6], q3 = px[7];
+    v8 mask, ap, aq;
+    v16 lo[8], hi[8];
+    u32 i;
+
+    mask = FilterMask(p1, p0, q0, q1, alpha, beta);
+
+    if (bS[0] == 4)
+    {
+        if (!Any(mask))
+            return;
+        /* strong filtering on a side needs |p0-q0| < alpha/4 + 2 too */
+        ap = And(mask, AbsLt(p0, q0, Limit((alpha >> 2) + 2)));
+        aq = And(ap, AbsLt(q2, q0, Limit(beta)));
+        ap = And(ap, AbsLt(p2, p0, Limit(beta)));
+
+        for (i = 0; i < 2; i++)
+        {
+            v16 P3 = i ? Hi(p3) : Lo(p3), P2 = i ? Hi(p2) : Lo(p2);
+            v16 P1 = i ? Hi(p1) : Lo(p1), P0 = i ? Hi(p0) : Lo(p0);
+            v16 Q0 = i ? Hi(q0) : Lo(q0), Q1 = i ? Hi(q1) : Lo(q1);
+            v16 Q2 = i ? Hi(q2) : Lo(q2), Q3 = i ? Hi(q3) : Lo(q3);
+            v16 *o = i ? hi : lo;
+            v16 t;
+
+            /* strong p0 p1 p2, weak p0, strong q0 q1 q2, weak q0 */
+            t = Add(Add(P1, P0), Q0);
+            o[0] = Shr3(AddK(Add(Add(P2, Q1), Add(t, t)), 4));
+            o[1] = Shr2(AddK(Add(P2, t), 2));
+            o[2] = Shr3(AddK(Add(Add(P3, P3), Add(Add(P2, P2), Add(P2, t))), 4));
+            o[3] = Shr2(AddK(Add(Add(P1, P1), Add(P0, Q1)), 2));
+            t = Add(Add(P0, Q0), Q1);
+            o[4] = Shr3(AddK(Add(Add(P1, Q2), Add(t, t)), 4));
+            o[5] = Shr2(AddK(Add(Q2, t), 2));
+            o[6] = Shr3(AddK(Add(Add(Q3, Q3), Add(Add(Q2, Q2), Add(Q2, t))), 4));
+            o[7] = Shr2(AddK(Add(Add(Q1, Q1), Add(Q0, P1)), 2));
+        }
+
+        px[1] = Sel(ap, Pack(lo[2], hi[2]), p2);
+        px[2] = Sel(ap, Pack(lo[1], hi[1]), p1);
+        px[3] = Sel(ap, Pack(lo[0], hi[0]), Sel(mask, Pack(lo[3], hi[3]), p0));
+        px[4] = Sel(aq, Pack(lo[4], hi[4]), Sel(mask, Pack(lo[7], hi[7]), q0));
+        px[5] = Sel(aq, Pack(lo[5], hi[5]), q1);
+        px[6] = Sel(aq, Pack(lo[6], hi[6]), q2);
+    }
+    else
+    {
+        v8 bsMask, tc0Lane, tc;
+
+        LumaLanes(bS, tc0, &bsMask, &tc0Lane);
+        mask = And(mask, bsMask);
+        if (!Any(mask))
+            return;
+        ap = And(mask, AbsLt(p2, p0, Limit(beta)));
+        aq = And(mask, AbsLt(q2, q0, Limit(beta)));
+        /* tc = tc0 + ap + aq */
+        tc = Inc(Inc(tc0Lane, ap), aq);
+
+        for (i = 0; i < 2; i++)
+        {
+            v16 P2 = i ? Hi(p2) : Lo(p2), P1 = i ? Hi(p1) : Lo(p1);
+            v16 P0 = i ? Hi(p0) : Lo(p0), Q0 = i ? Hi(q0) : Lo(q0);
+            v16 Q1 = i ? Hi(q1) : Lo(q1), Q2 = i ? Hi(q2) : Lo(q2);
+            v16 TC = i ? Hi(tc) : Lo(tc), TC0 = i ? Hi(tc0Lane) : Lo(tc0Lane);
+            v16 AV = i ? Hi(Avg(p0, q0)) : Lo(Avg(p0, q0));
+            v16 *o = i ? hi : lo;
+            v16 d;
+
+            d = Sub(Q0, P0);
+            d = Add(Add(d, d), Add(d, d));
+            d = Clip(Shr3(AddK(Add(d, Sub(P1, Q1)), 4)), TC);
+            o[0] = Add(P0, d);
+            o[1] = Sub(Q0, d);
+            o[2] = Add(P1, Clip(Shr1(Sub(Add(P2, AV), Add(P1, P1))), TC0));
+            o[3] = Add(Q1, Clip(Shr1(Sub(Add(Q2, AV), Add(Q1, Q1))), TC0));
+        }
+
+        px[2] = Sel(ap, Pack(lo[2], hi[2]), p1);
+        px[3] = Sel(mask, Pack(lo[0], hi[0]), p0);
+        px[4] = Sel(mask, Pack(lo[1], hi[1]), q0);
+        px[5] = Sel(aq, Pack(lo[3], hi[3]), q1);
+    }
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FilterChroma
+
+        Functional description:
+            Filter one chroma edge of 8 Cb and 8 Cr pixels. px holds p1 p0
+            q0 q1; only p0 and q0 change.
+
+------------------------------------------------------------------------------*/
+
+static void FilterChroma(v8 *px, const u8 *bS, u32 alpha, u32 beta,
+    const u8 *tc0)
+{
+    v8 p1 = px[0], p0 = px[1], q0 = px[2], q1 = px[3];
+    v8 mask, bsMask, tc;
+    v16 lo[2], hi[2];
+    u32 i;
+
+    mask = FilterMask(p1, p0, q0, q1, alpha, beta);
+
+    if (bS[0] == 4)
+    {
+        if (!Any(mask))
+            return;
+        for (i = 0; i < 2; i++)
+        {
+            v16 P1 = i ? Hi(p1) : Lo(p1), P0 = i ? Hi(p0) : Lo(p0);
+            v16 Q0 = i ? Hi(q0) : Lo(q0), Q1 = i ? Hi(q1) : Lo(q1);
+            v16 *o = i ? hi : lo;
+            o[0] = Shr2(AddK(Add(Add(Add(P1, P1), P0), Q1), 2));
+            o[1] = Shr2(AddK(Add(Add(Add(Q1, Q1), Q0), P1), 2));
+        }
+    }
+    else
+    {
+        ChromaLanes(bS, tc0, &bsMask, &tc);
+        mask = And(mask, bsMask);
+        if (!Any(mask))
+            return;
+        for (i = 0; i < 2; i++)
+        {
+            v16 P1 = i ? Hi(p1) : Lo(p1), P0 = i ? Hi(p0) : Lo(p0);
+            v16 Q0 = i ? Hi(q0) : Lo(q0), Q1 = i ? Hi(q1) : Lo(q1);
+            v16 TC = i ? Hi(tc) : Lo(tc);
+            v16 *o = i ? hi : lo;
+            v16 d = Sub(Q0, P0);
+            d = Add(Add(d, d), Add(d, d));
+            d = Clip(Shr3(AddK(Add(d, Sub(P1, Q1)), 4)), TC);
+            o[0] = Add(P0, d);
+            o[1] = Sub(Q0, d);
+        }
+    }
+
+    px[1] = Sel(mask, Pack(lo[0], hi[0]), p0);
+    px[2] = Sel(mask, Pack(lo[1], hi[1]), q0);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterLumaHorEdge16
+
+        Functional description:
+            Filter the horizontal luma edge above the 16 pixels at data.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFilterLumaHorEdge16(u8 *data, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0)
+{
+    v8 px[8];
+    u32 i;
+
+    ASSERT(data);
+    ASSERT(bS);
+
+    if (!alpha || !beta)
+        return;
+
+    for (i = 0; i < 8; i++)
+        px[i] = Load(data + ((i32)i - 4) * (i32)width);
+    FilterLuma(px, bS, alpha, beta, tc0);
+    for (i = 1; i < 7; i++)
+        Store(data + ((i32)i - 4) * (i32)width, px[i]);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterLumaVerEdge16
+
+        Functional description:
+            Filter the vertical luma edge left of the 16 rows at data.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFilterLumaVerEdge16(u8 *data, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0)
+{
+    v8 px[8];
+
+    ASSERT(data);
+    ASSERT(bS);
+
+    if (!alpha || !beta)
+        return;
+
+    LoadTransposed(data - 4, data - 4 + 8*width, width, px);
+    FilterLuma(px, bS, alpha, beta, tc0);
+    StoreTransposed(data - 4, data - 4 + 8*width, width, px);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterChromaHorEdge8
+
+        Functional description:
+            Filter the horizontal edge above the 8 Cb and 8 Cr pixels at cb
+            and cr.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFilterChromaHorEdge8(u8 *cb, u8 *cr, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0)
+{
+    v8 px[4];
+    u32 i;
+
+    ASSERT(cb);
+    ASSERT(cr);
+    ASSERT(bS);
+
+    if (!alpha || !beta)
+        return;
+
+    for (i = 0; i < 4; i++)
+    {
+        i32 offset = ((i32)i - 2) * (i32)width;
+        px[i] = LoadPair(cb + offset, cr + offset);
+    }
+    FilterChroma(px, bS, alpha, beta, tc0);
+    StorePair(cb - width, cr - width, px[1]);
+    StorePair(cb, cr, px[2]);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFilterChromaVerEdge8
+
+        Functional description:
+            Filter the vertical edge left of the 8 Cb and 8 Cr rows at cb
+            and cr.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFilterChromaVerEdge8(u8 *cb, u8 *cr, u32 width, const u8 *bS,
+    u32 alpha, u32 beta, const u8 *tc0)
+{
+    v8 px[8];
+
+    ASSERT(cb);
+    ASSERT(cr);
+    ASSERT(bS);
+
+    if (!alpha || !beta)
+        return;
+
+    /* Transposed Cb rows in lanes 0..7, Cr rows in 8..15; p1 p0 q0 q1 are
+     * columns 2..5, the pixels either side are read and written back as
+     * they are */
+    LoadTransposed(cb - 4, cr - 4, width, px);
+    FilterChroma(px + 2, bS, alpha, beta, tc0);
+    StoreTransposed(cb - 4, cr - 4, width, px);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdNonZeroBlocks
+
+        Functional description:
+            Bit mask of the luma 4x4 blocks with coefficients, bit i for
+            block i in raster order.
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdNonZeroBlocks(const i16 *totalCoeff)
+{
+
+/* Variables */
+
+    u32 m;
+
+/* Code */
+
+    ASSERT(totalCoeff);
+
+#if defined(__SSE2__)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)totalCoeff);
+        __m128i b = _mm_loadu_si128((const __m128i*)(totalCoeff + 8));
+        __m128i z = _mm_cmpeq_epi8(_mm_packs_epi16(a, b), _mm_setzero_si128());
+        m = ~(u32)_mm_movemask_epi8(z) & 0xFFFF;
+    }
+#else
+    {
+        static const u8 bits[16] = {1,2,4,8,16,32,64,128,1,2,4,8,16,32,64,128};
+        uint8x16_t nz = vcombine_u8(
+            vmovn_u16(vtstq_u16(vreinterpretq_u16_s16(vld1q_s16(totalCoeff)),
+                vdupq_n_u16(0xFFFF))),
+            vmovn_u16(vtstq_u16(vreinterpretq_u16_s16(vld1q_s16(totalCoeff + 8)),
+                vdupq_n_u16(0xFFFF))));
+        uint8x16_t w = vandq_u8(nz, vld1q_u8(bits));
+        uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(w)));
+        m = (u32)vgetq_lane_u64(s, 0) | ((u32)vgetq_lane_u64(s, 1) << 8);
+    }
+#endif
+
+    /* coefficient order is 4x4 block order: swap blocks 2,3 with 4,5 and
+     * 10,11 with 12,13 to get raster order */
+    return (m & 0xC3C3) | ((m & 0x0C0C) << 2) | ((m & 0x3030) >> 2);
+
+}
+
+#endif /* H264DEC_SIMD */
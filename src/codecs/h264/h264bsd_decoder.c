@@ -25,6 +25,17 @@
      4. Local function prototypes
      5. Functions
           h264bsdInit
+          h264bsdSetSliceThreads
+          h264bsdSetFrameThreads
+          h264bsdSetImagePoolSizes
+          h264bsdSetLowLatency
+          h264bsdSetRowFiltering
+          h264bsdOutputDelay
+          h264bsdSetLumaOnly
+          h264bsdSetConcealment
+          h264bsdConcealedMbs
+          h264bsdSetSeiTypes
+          h264bsdSeiMessages
           h264bsdDecode
           h264bsdShutdown
 
@@ -49,6 +60,8 @@
 #include "h264bsd_deblocking.h"
 #include "h264bsd_conceal.h"
 #include "h264bsd_storage.h"
+#include "h264bsd_slice_threads.h"
+#include "h264bsd_frame_threads.h"
 
 /*------------------------------------------------------------------------------
     2. External compiler flags
@@ -89,6 +102,7 @@ u32 h264bsdInit(storage_t *pStorage, u32 noOutputReordering)
 /* Code */
 
     h264bsdInitStorage(pStorage);
+    h264bsdSetPoolSizes(&pStorage->dpb->pool, IMAGE_POOL_SIZES);
 
     /* allocate mbLayer to be next multiple of 64 to enable use of
      * specific NEON optimized "memset" for clearing the structure */
@@ -101,9 +115,406 @@ u32 h264bsdInit(storage_t *pStorage, u32 noOutputReordering)
     if (noOutputReordering)
         pStorage->noReordering = HANTRO_TRUE;
 
+    pStorage->seiTypes = SEI_DEFAULT_TYPES;
+    pStorage->rowFiltering = HANTRO_TRUE;
+
     return HANTRO_OK;
 }
 
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetSliceThreads
+
+        Functional description:
+            Decode the slices of a picture on a pool of threads. A picture
+            is then completed at the next access unit boundary instead of
+            right after its last slice. Must be called between pictures.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            numThreads          number of threads, 0 or 1 to decode slices
+                                on the calling thread
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_OK           success
+            HANTRO_NOK          threads could not be started, slices are
+                                decoded on the calling thread
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdSetSliceThreads(storage_t *pStorage, u32 numThreads)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    h264bsdFinishSlices(pStorage);
+    h264bsdFreeSliceThreads(pStorage->sliceThreads);
+    pStorage->sliceThreads = NULL;
+
+    if (numThreads <= 1)
+        return HANTRO_OK;
+
+    pStorage->sliceThreads = h264bsdCreateSliceThreads(numThreads);
+
+    return pStorage->sliceThreads ? HANTRO_OK : HANTRO_NOK;
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetFrameThreads
+
+        Functional description:
+            Decode consecutive pictures at the same time on a pool of
+            threads, one picture per thread. h264bsdFrameOutputPicture waits
+            for the thread of a picture still being decoded. The DPB gets an extra image for each thread, so
+            this must be called before the first picture is decoded.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            numThreads          number of threads, 0 or 1 to decode pictures
+                                on the calling thread
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_OK           success
+            HANTRO_NOK          DPB already allocated or threads could not
+                                be started, pictures are decoded on the
+                                calling thread
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdSetFrameThreads(storage_t *pStorage, u32 numThreads)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    if (pStorage->dpb->buffer != NULL)
+        return HANTRO_NOK;
+
+    h264bsdFreeFrameThreads(pStorage->frameThreads);
+    pStorage->frameThreads = NULL;
+    pStorage->dpb->numExtraImages = 0;
+
+    if (numThreads <= 1)
+        return HANTRO_OK;
+
+    if (numThreads > MAX_NUM_FRAME_THREADS)
+        numThreads = MAX_NUM_FRAME_THREADS;
+
+    pStorage->frameThreads = h264bsdCreateFrameThreads(numThreads);
+    if (pStorage->frameThreads == NULL)
+        return HANTRO_NOK;
+
+    /* images of the pictures being decoded, and the one of the picture
+     * waiting for a thread */
+    pStorage->dpb->numExtraImages = numThreads + 1;
+
+    return HANTRO_OK;
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetImagePoolSizes
+
+        Functional description:
+            Set the number of picture sizes whose images are kept when the
+            DPB is freed, to be reused when a sequence parameter set of the
+            same size is activated. IMAGE_POOL_SIZES by default.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            numSizes            number of sizes, 0 to free the images
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetImagePoolSizes(storage_t *pStorage, u32 numSizes)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    h264bsdSetPoolSizes(&pStorage->dpb->pool, numSizes);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetLowLatency
+
+        Functional description:
+            Output pictures as early as the stream allows: as soon as more
+            than num_reorder_frames of the VUI bitstream restriction wait
+            for display instead of when the DPB is full. Streams without
+            the restriction are output when the DPB is full. Takes effect
+            when the next sequence parameter set is activated.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            enable              HANTRO_TRUE to enable, HANTRO_FALSE to
+                                output when the DPB is full
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetLowLatency(storage_t *pStorage, u32 enable)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pStorage->lowLatency = enable ? HANTRO_TRUE : HANTRO_FALSE;
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetRowFiltering
+
+        Functional description:
+            Deblocking filter the rows of a picture decoded on the calling
+            thread while its slices are decoded, see
+            h264bsdFilterDecodedRows, or the whole picture once it is
+            completed. Both give the same pictures, corrupted streams
+            included; filtering whole pictures is there to check that.
+            Frame threads always filter rows, slice threads whole
+            pictures. Enabled by default.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            enable              HANTRO_TRUE to filter rows, HANTRO_FALSE
+                                whole pictures
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetRowFiltering(storage_t *pStorage, u32 enable)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pStorage->rowFiltering = enable ? HANTRO_TRUE : HANTRO_FALSE;
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdOutputDelay
+
+        Functional description:
+            Number of pictures the DPB may hold for display reordering
+            before outputting one, for the active sequence parameter set.
+
+        Inputs:
+            pStorage            pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            number of pictures, 0 if the DPB is not allocated
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdOutputDelay(storage_t *pStorage)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    if (pStorage->dpb->buffer == NULL || pStorage->dpb->noReordering)
+        return 0;
+
+    return MIN(pStorage->dpb->numReorderFrames, pStorage->dpb->dpbSize);
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetLumaOnly
+
+        Functional description:
+            Decode luma only: chroma prediction, residual, reconstruction and
+            deblocking are skipped and the chroma of the output pictures is
+            undefined. Inter prediction of chroma reads the reference
+            pictures, so chroma stays corrupt after the mode is disabled
+            until the next IDR picture. Takes effect from the next picture.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            enable              HANTRO_TRUE to skip chroma, HANTRO_FALSE
+                                to decode it
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetLumaOnly(storage_t *pStorage, u32 enable)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pStorage->currImage->lumaOnly = enable ? HANTRO_TRUE : HANTRO_FALSE;
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetConcealment
+
+        Functional description:
+            Set the concealment policy for lost and corrupted macroblocks,
+            from the next picture on.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            policy              CONCEAL_FULL for spatial concealment of
+                                intra and temporal of inter pictures,
+                                CONCEAL_COPY to copy collocated macroblocks
+                                of the reference picture
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetConcealment(storage_t *pStorage, u32 policy)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+    ASSERT(policy == CONCEAL_FULL || policy == CONCEAL_COPY);
+
+    pStorage->concealment = policy;
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdConcealedMbs
+
+        Functional description:
+            Number of macroblocks concealed since the decoder was
+            initialized, wrapping around at 2^32.
+
+        Inputs:
+            pStorage            pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            number of macroblocks
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdConcealedMbs(storage_t *pStorage)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    return(pStorage->totalConcealedMbs + h264bsdFrameConcealedMbs(pStorage));
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSetSeiTypes
+
+        Functional description:
+            Select the SEI payload types to decode. SEI NAL units are
+            walked payload by payload and the types not selected are
+            skipped by their size, so 0 costs almost nothing per access
+            unit. SEI_DEFAULT_TYPES (recovery point and picture timing)
+            when not set.
+
+        Inputs:
+            pStorage            pointer to storage structure
+            types               SEI_TYPE_MASK bits of the payload types,
+                                only SEI_DECODABLE_TYPES are decoded
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetSeiTypes(storage_t *pStorage, u32 types)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pStorage->seiTypes = types & SEI_DECODABLE_TYPES;
+}
+
+/*------------------------------------------------------------------------------
+
+    Function name: h264bsdSeiMessages
+
+        Functional description:
+            SEI messages decoded since the last picture was completed,
+            which belong to the access unit being decoded. decodedTypes is
+            0 if there were none.
+
+        Inputs:
+            pStorage            pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            pointer to the messages, valid until the next h264bsdDecode
+
+------------------------------------------------------------------------------*/
+
+const seiMessage_t *h264bsdSeiMessages(storage_t *pStorage)
+{
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    return(pStorage->sei);
+}
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdDecodeInternal
@@ -148,11 +559,12 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
     u32 tmp, ppsId, spsId;
     i32 picOrderCnt;
     nalUnit_t nalUnit;
-    seqParamSet_t seqParamSet;
+    seqParamSet_t seqParamSet, *pSeqParamSet;
     picParamSet_t picParamSet;
     strmData_t strm;
     u32 accessUnitBoundaryFlag = HANTRO_FALSE;
     u32 picReady = HANTRO_FALSE;
+    u32 picFiltered = HANTRO_FALSE;
 
     /* if previous buffer was not finished and same pointer given -> skip NAL
      * unit extraction */
@@ -222,16 +634,28 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
                 return (H264BSD_ERROR);
             }
 
-            if (!pStorage->validSliceInAccessUnit)
+            h264bsdFinishSlices(pStorage);
+
+            /* picture concealed and filtered on its frame thread */
+            if (h264bsdEndFrame(pStorage) == HANTRO_OK)
+            {
+                tmp = HANTRO_OK;
+                picFiltered = HANTRO_TRUE;
+            }
+            else if (!pStorage->validSliceInAccessUnit)
             {
                 pStorage->currImage->data =
                     h264bsdAllocateDpbImage(pStorage->dpb);
                 h264bsdInitRefPicList(pStorage->dpb);
                 tmp = h264bsdConceal(pStorage, pStorage->currImage, P_SLICE);
+                pStorage->totalConcealedMbs += pStorage->numConcealedMbs;
             }
             else
+            {
                 tmp = h264bsdConceal(pStorage, pStorage->currImage,
                     pStorage->sliceHeader->sliceType);
+                pStorage->totalConcealedMbs += pStorage->numConcealedMbs;
+            }
 
             picReady = HANTRO_TRUE;
 
@@ -254,6 +678,12 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
         {
             case NAL_SEQ_PARAM_SET:
                 DEBUG(("SEQ PARAM SET\n"));
+                if (h264bsdIsRepeatedParamSet(pStorage, &strm,
+                        NAL_SEQ_PARAM_SET))
+                {
+                    tmp = HANTRO_OK;
+                    break;
+                }
                 tmp = h264bsdDecodeSeqParamSet(&strm, &seqParamSet);
                 if (tmp != HANTRO_OK)
                 {
@@ -263,10 +693,19 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
                     return(H264BSD_ERROR);
                 }
                 tmp = h264bsdStoreSeqParamSet(pStorage, &seqParamSet);
+                if (tmp == HANTRO_OK)
+                    h264bsdStoreParamSetBytes(pStorage, &strm,
+                        NAL_SEQ_PARAM_SET, seqParamSet.seqParameterSetId);
                 break;
 
             case NAL_PIC_PARAM_SET:
                 DEBUG(("PIC PARAM SET\n"));
+                if (h264bsdIsRepeatedParamSet(pStorage, &strm,
+                        NAL_PIC_PARAM_SET))
+                {
+                    tmp = HANTRO_OK;
+                    break;
+                }
                 tmp = h264bsdDecodePicParamSet(&strm, &picParamSet);
                 if (tmp != HANTRO_OK)
                 {
@@ -278,6 +717,9 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
                     return(H264BSD_ERROR);
                 }
                 tmp = h264bsdStorePicParamSet(pStorage, &picParamSet);
+                if (tmp == HANTRO_OK)
+                    h264bsdStoreParamSetBytes(pStorage, &strm,
+                        NAL_PIC_PARAM_SET, picParamSet.picParameterSetId);
                 break;
 
             case NAL_CODED_SLICE_IDR:
@@ -303,6 +745,9 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
                     /* store old activeSpsId and return headers ready
                      * indication if activeSps changes */
                     spsId = pStorage->activeSpsId;
+                    /* DPB is reallocated by the second phase of activation */
+                    if (pStorage->pendingActivation)
+                        h264bsdFinishFrames(pStorage);
                     tmp = h264bsdActivateParamSets(pStorage, ppsId,
                             IS_IDR_NAL_UNIT(&nalUnit) ?
                             HANTRO_TRUE : HANTRO_FALSE);
@@ -329,6 +774,8 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
                         seqParamSet_t *newSPS = pStorage->activeSps;
                         u32 noOutputOfPriorPicsFlag = 1;
 
+                        h264bsdFinishFrames(pStorage);
+
                         if(pStorage->oldSpsId < MAX_NUM_SEQ_PARAM_SETS)
                         {
                             oldSPS = pStorage->sps[pStorage->oldSpsId];
@@ -402,12 +849,15 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
                             return(H264BSD_ERROR);
                         }
                     }
-                    pStorage->currImage->data =
-                        h264bsdAllocateDpbImage(pStorage->dpb);
+                    if (h264bsdStartFrame(pStorage) != HANTRO_OK)
+                        pStorage->currImage->data =
+                            h264bsdAllocateDpbImage(pStorage->dpb);
                 }
 
                 /* store slice header to storage if successfully decoded */
                 pStorage->sliceHeader[0] = pStorage->sliceHeader[1];
+                if (pStorage->skipNonRefDeblocking && nalUnit.nalRefIdc == 0)
+                    pStorage->sliceHeader->disableDeblockingFilterIdc = 1;
                 pStorage->validSliceInAccessUnit = HANTRO_TRUE;
                 pStorage->prevNalUnit[0] = nalUnit;
 
@@ -427,6 +877,14 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
 
                 DEBUG(("SLICE DATA, FIRST %d\n",
                         pStorage->sliceHeader->firstMbInSlice));
+
+                /* end of a picture decoded on the frame or slice threads is
+                 * found at the next access unit boundary */
+                if (h264bsdQueueFrameSlice(pStorage, &strm) == HANTRO_OK)
+                    break;
+                if (h264bsdQueueSlice(pStorage, &strm) == HANTRO_OK)
+                    break;
+
                 tmp = h264bsdDecodeSliceData(&strm, pStorage,
                     pStorage->currImage, pStorage->sliceHeader);
                 if (tmp != HANTRO_OK)
@@ -445,7 +903,25 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
                 break;
 
             case NAL_SEI:
-                DEBUG(("SEI MESSAGE, NOT DECODED"));
+                DEBUG(("SEI MESSAGE\n"));
+                if (!pStorage->seiTypes)
+                    break;
+                /* messages of an access unit before its first slice refer
+                 * to the parameter sets activated by that slice, taken to
+                 * be the active ones */
+                pSeqParamSet = pStorage->activeSps;
+                for (tmp = 0; !pSeqParamSet && tmp < MAX_NUM_SEQ_PARAM_SETS;
+                     tmp++)
+                    pSeqParamSet = pStorage->sps[tmp];
+                tmp = h264bsdDecodeSeiMessage(&strm, pSeqParamSet,
+                    pStorage->sei,
+                    pStorage->activePps ?
+                        pStorage->activePps->numSliceGroups : 0,
+                    pStorage->seiTypes);
+                if (tmp != HANTRO_OK)
+                {
+                    EPRINT("SEI");
+                }
                 break;
 
             default:
@@ -455,9 +931,14 @@ u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
 
     if (picReady)
     {
-        h264bsdFilterPicture(pStorage->currImage, pStorage->mb);
+        /* rows not filtered while the picture was decoded */
+        if (!picFiltered)
+            h264bsdFilterPictureRows(pStorage->currImage, pStorage->mb,
+                pStorage->rowsFiltered,
+                pStorage->currImage->height - pStorage->rowsFiltered);
 
         h264bsdResetStorage(pStorage);
+        pStorage->sei->decodedTypes = 0;
 
          picOrderCnt = h264bsdDecodePicOrderCnt(pStorage->poc,
             pStorage->activeSps, pStorage->sliceHeader, pStorage->prevNalUnit);
@@ -511,7 +992,7 @@ u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u8 **picture, u32
     if (retCode == H264BSD_PIC_RDY) {
       *width = (pStorage->activeSps->picWidthInMbs)*16;
       *height = (pStorage->activeSps->picHeightInMbs)*16;
-      *picture = h264bsdDpbOutputPicture(pStorage->dpb)->data;
+      *picture = h264bsdFrameOutputPicture(pStorage)->data;
     }
 
     return retCode;
@@ -545,6 +1026,13 @@ void h264bsdShutdown(storage_t *pStorage)
 
     ASSERT(pStorage);
 
+    h264bsdFreeSliceThreads(pStorage->sliceThreads);
+    pStorage->sliceThreads = NULL;
+
+    h264bsdFinishFrames(pStorage);
+    h264bsdFreeFrameThreads(pStorage->frameThreads);
+    pStorage->frameThreads = NULL;
+
     for (i = 0; i < MAX_NUM_SEQ_PARAM_SETS; i++)
     {
         if (pStorage->sps[i])
@@ -567,6 +1055,7 @@ void h264bsdShutdown(storage_t *pStorage)
         }
     }
 
+    h264bsdFreeParamSetBytes(pStorage);
     FREE(pStorage->mbLayer);
     FREE(pStorage->mb);
     FREE(pStorage->sliceGroupMap);
@@ -574,6 +1063,8 @@ void h264bsdShutdown(storage_t *pStorage)
     if(pStorage->conversionBuffer != NULL) FREE(pStorage->conversionBuffer);
 
     h264bsdFreeDpb(pStorage->dpb);
+    h264bsdFreeHeldImages(pStorage->dpb);
+    h264bsdFreeImagePool(&pStorage->dpb->pool);
 }
 
 /*------------------------------------------------------------------------------
@@ -62,6 +62,19 @@ enum {
 ------------------------------------------------------------------------------*/
 
 u32 h264bsdInit(storage_t *pStorage, u32 noOutputReordering);
+u32 h264bsdSetSliceThreads(storage_t *pStorage, u32 numThreads);
+u32 h264bsdSetFrameThreads(storage_t *pStorage, u32 numThreads);
+void h264bsdSetImagePoolSizes(storage_t *pStorage, u32 numSizes);
+void h264bsdSetLowLatency(storage_t *pStorage, u32 enable);
+void h264bsdSetRowFiltering(storage_t *pStorage, u32 enable);
+u32 h264bsdOutputDelay(storage_t *pStorage);
+void h264bsdSetLumaOnly(storage_t *pStorage, u32 enable);
+void h264bsdSetConcealment(storage_t *pStorage, u32 policy);
+void h264bsdSetSeiTypes(storage_t *pStorage, u32 types);
+const seiMessage_t *h264bsdSeiMessages(storage_t *pStorage);
+u32 h264bsdConcealedMbs(storage_t *pStorage);
+u32 h264bsdDecodeInternal(storage_t *pStorage, u8 *byteStrm, u32 len,
+    u32 *readBytes);
 u32 h264bsdDecode(storage_t *pStorage, u8 *byteStrm, u32 len, u8 **picture, u32 *width, u32 *height);
 void h264bsdShutdown(storage_t *pStorage);
 
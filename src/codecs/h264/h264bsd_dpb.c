@@ -35,6 +35,11 @@
           h264bsdMarkDecRefPic
           h264bsdGetRefPicData
           h264bsdAllocateDpbImage
+          h264bsdDpbHoldImage
+          h264bsdDpbReleaseImage
+          h264bsdDpbImageHeld
+          h264bsdFreeHeldImages
+          FindHeldImage
           SlidingWindowRefPicMarking
           h264bsdInitDpb
           h264bsdResetDpb
@@ -43,6 +48,7 @@
           SetPicNums
           h264bsdCheckGapsInFrameNum
           FindSmallestPicOrderCnt
+          NumToBeDisplayed
           OutputPicture
           h264bsdDpbOutputPicture
           h264bsdFlushDpb
@@ -111,10 +117,14 @@ static void SetPicNums(dpbStorage_t *dpb, u32 currFrameNum);
 
 static dpbPicture_t* FindSmallestPicOrderCnt(dpbStorage_t *dpb);
 
+static u32 NumToBeDisplayed(dpbStorage_t *dpb);
+
 static u32 OutputPicture(dpbStorage_t *dpb);
 
 static void ShellSort(dpbPicture_t *pPic, u32 num);
 
+static dpbHeldImage_t *FindHeldImage(dpbStorage_t *dpb, u8 *data);
+
 /*------------------------------------------------------------------------------
 
     Function: ComparePictures
@@ -821,6 +831,14 @@ u32 h264bsdMarkDecRefPic(
             i = OutputPicture(dpb);
             ASSERT(i == HANTRO_OK);
         }
+        /* and as soon as more than numReorderFrames wait for display, the
+         * stream does not need more for reordering */
+        while (dpb->numReorderFrames < dpb->dpbSize &&
+               NumToBeDisplayed(dpb) > dpb->numReorderFrames)
+        {
+            i = OutputPicture(dpb);
+            ASSERT(i == HANTRO_OK);
+        }
     }
 
     /* sort dpb */
@@ -880,6 +898,10 @@ u8* h264bsdAllocateDpbImage(dpbStorage_t *dpb)
 
 /* Variables */
 
+    u32 i;
+    u8 *pAllocatedData;
+    dpbHeldImage_t *pHeld;
+
 /* Code */
 
     ASSERT( !dpb->buffer[dpb->dpbSize].toBeDisplayed &&
@@ -888,10 +910,229 @@ u8* h264bsdAllocateDpbImage(dpbStorage_t *dpb)
 
     dpb->currentOut = dpb->buffer + dpb->dpbSize;
 
+    /* image still held by the application -> let go of it and put a new
+     * one in its place. The data pointers of the buffer are exchanged by
+     * other functions, look for the allocation the image is in */
+    pHeld = FindHeldImage(dpb, dpb->currentOut->data);
+    if (pHeld != NULL && pHeld->pAllocatedData == NULL)
+    {
+        pAllocatedData = h264bsdGetPoolImage(&dpb->pool, dpb->imageSize);
+        if (pAllocatedData == NULL)
+        {
+            EPRINT("Held image overwritten");
+            return(dpb->currentOut->data);
+        }
+        for (i = 0; i < dpb->dpbSize + 1 + dpb->numExtraImages; i++)
+        {
+            if (ALIGN(dpb->buffer[i].pAllocatedData, IMAGE_POOL_ALIGNMENT) ==
+                pHeld->data)
+            {
+                pHeld->pAllocatedData = dpb->buffer[i].pAllocatedData;
+                pHeld->size = dpb->imageSize;
+                dpb->buffer[i].pAllocatedData = pAllocatedData;
+                break;
+            }
+        }
+        ASSERT(pHeld->pAllocatedData);
+        dpb->currentOut->data = ALIGN(pAllocatedData, IMAGE_POOL_ALIGNMENT);
+    }
+
     return(dpb->currentOut->data);
 
 }
 
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdDpbHoldImage
+
+        Functional description:
+            Keep an output image for the application until it is released
+            with h264bsdDpbReleaseImage. Holds are counted, each one has to
+            be released. The image is not written while it is held: if it
+            is needed for a new picture the buffer gets a new image and the
+            held one goes back to the image pool when released.
+
+        Inputs:
+            dpb         pointer to DPB data structure
+            data        image returned by h264bsdDpbOutputPicture
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_OK   success
+            HANTRO_NOK  memory allocation failed
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdDpbHoldImage(dpbStorage_t *dpb, u8 *data)
+{
+
+/* Variables */
+
+    dpbHeldImage_t *pHeld;
+
+/* Code */
+
+    ASSERT(dpb);
+    ASSERT(data);
+
+    pHeld = FindHeldImage(dpb, data);
+    if (pHeld == NULL)
+    {
+        pHeld = (dpbHeldImage_t*)realloc(dpb->held,
+            (dpb->numHeld + 1) * sizeof(dpbHeldImage_t));
+        if (pHeld == NULL)
+            return(HANTRO_NOK);
+        dpb->held = pHeld;
+        pHeld = dpb->held + dpb->numHeld++;
+        pHeld->data = data;
+        pHeld->pAllocatedData = NULL;
+        pHeld->count = 0;
+    }
+    pHeld->count++;
+
+    return(HANTRO_OK);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdDpbReleaseImage
+
+        Functional description:
+            Release an image held with h264bsdDpbHoldImage. The last release
+            gives the image to the image pool if the buffer has let go of it
+            meanwhile.
+
+        Inputs:
+            dpb         pointer to DPB data structure
+            data        held image
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdDpbReleaseImage(dpbStorage_t *dpb, u8 *data)
+{
+
+/* Variables */
+
+    dpbHeldImage_t *pHeld;
+
+/* Code */
+
+    ASSERT(dpb);
+
+    pHeld = FindHeldImage(dpb, data);
+    ASSERT(pHeld);
+    if (pHeld == NULL || --pHeld->count)
+        return;
+
+    h264bsdPutPoolImage(&dpb->pool, pHeld->pAllocatedData, pHeld->size);
+    *pHeld = dpb->held[--dpb->numHeld];
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdDpbImageHeld
+
+        Functional description:
+            Check if the application holds an image.
+
+        Inputs:
+            dpb         pointer to DPB data structure
+            data        image
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_TRUE     image held
+            HANTRO_FALSE    otherwise
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdDpbImageHeld(dpbStorage_t *dpb, u8 *data)
+{
+
+/* Code */
+
+    ASSERT(dpb);
+
+    return(FindHeldImage(dpb, data) != NULL ? HANTRO_TRUE : HANTRO_FALSE);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFreeHeldImages
+
+        Functional description:
+            Free the images still held when the decoder is shut down. Called
+            after h264bsdFreeDpb, which lets go of the held images.
+
+        Inputs:
+            dpb         pointer to DPB data structure
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFreeHeldImages(dpbStorage_t *dpb)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(dpb);
+    ASSERT(dpb->buffer == NULL);
+
+    for (i = 0; i < dpb->numHeld; i++)
+        FREE_IMAGE(dpb->held[i].pAllocatedData);
+    FREE(dpb->held);
+    dpb->numHeld = 0;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FindHeldImage
+
+        Functional description:
+            Find the hold of an image, NULL if it is not held.
+
+------------------------------------------------------------------------------*/
+
+dpbHeldImage_t *FindHeldImage(dpbStorage_t *dpb, u8 *data)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    for (i = 0; i < dpb->numHeld; i++)
+        if (dpb->held[i].data == data)
+            return(dpb->held + i);
+
+    return(NULL);
+
+}
+
 /*------------------------------------------------------------------------------
 
     Function: SlidingWindowRefPicMarking
@@ -959,7 +1200,9 @@ static u32 SlidingWindowRefPicMarking(dpbStorage_t *dpb)
             If noReordering flag is FALSE the DPB stores dpbSize pictures
             for display reordering purposes. On the other hand, if the
             flag is TRUE the DPB only stores maxRefFrames reference pictures
-            and outputs all the pictures immediately.
+            and outputs all the pictures immediately. numExtraImages of the
+            DPB more images are allocated after the dpbSize + 1 of the
+            buffer.
 
         Inputs:
             picSizeInMbs    picture size in macroblocks
@@ -1010,24 +1253,26 @@ u32 h264bsdInitDpb(
     dpb->fullness            = 0;
     dpb->numRefFrames        = 0;
     dpb->prevRefFrameNum     = 0;
+    dpb->imageSize           = picSizeInMbs*384;
+    dpb->numReorderFrames    = dpb->dpbSize;
 
-    ALLOCATE(dpb->buffer, MAX_NUM_REF_IDX_L0_ACTIVE + 1, dpbPicture_t);
+    ALLOCATE(dpb->buffer, MAX_NUM_REF_IDX_L0_ACTIVE + 1 + dpb->numExtraImages,
+        dpbPicture_t);
     if (dpb->buffer == NULL)
         return(MEMORY_ALLOCATION_ERROR);
-    memset(dpb->buffer, 0,
-            (MAX_NUM_REF_IDX_L0_ACTIVE + 1)*sizeof(dpbPicture_t));
-    for (i = 0; i < dpb->dpbSize + 1; i++)
+    memset(dpb->buffer, 0, (MAX_NUM_REF_IDX_L0_ACTIVE + 1 +
+            dpb->numExtraImages)*sizeof(dpbPicture_t));
+    for (i = 0; i < dpb->dpbSize + 1 + dpb->numExtraImages; i++)
     {
-        /* Allocate needed amount of memory, which is:
-         * image size + 32 + 15, where 32 cames from the fact that in ARM OpenMax
-         * DL implementation Functions may read beyond the end of an array,
-         * by a maximum of 32 bytes. And +15 cames for the need to align memory
-         * to 16-byte boundary */
-        ALLOCATE(dpb->buffer[i].pAllocatedData, (picSizeInMbs*384 + 32+15), u8);
+        /* image size + padding, reused from the images of the previous
+         * DPB when the size is the same */
+        dpb->buffer[i].pAllocatedData =
+            h264bsdGetPoolImage(&dpb->pool, dpb->imageSize);
         if (dpb->buffer[i].pAllocatedData == NULL)
             return(MEMORY_ALLOCATION_ERROR);
 
-        dpb->buffer[i].data = ALIGN(dpb->buffer[i].pAllocatedData, 16);
+        dpb->buffer[i].data =
+            ALIGN(dpb->buffer[i].pAllocatedData, IMAGE_POOL_ALIGNMENT);
     }
 
     ALLOCATE(dpb->list, MAX_NUM_REF_IDX_L0_ACTIVE + 1, dpbPicture_t*);
@@ -1408,6 +1653,35 @@ dpbPicture_t* FindSmallestPicOrderCnt(dpbStorage_t *dpb)
 
 }
 
+/*------------------------------------------------------------------------------
+
+    Function: NumToBeDisplayed
+
+        Functional description:
+            Function to count the pictures waiting for display.
+
+------------------------------------------------------------------------------*/
+
+u32 NumToBeDisplayed(dpbStorage_t *dpb)
+{
+
+/* Variables */
+
+    u32 i, num;
+
+/* Code */
+
+    ASSERT(dpb);
+
+    num = 0;
+    for (i = 0; i <= dpb->dpbSize; i++)
+        if (dpb->buffer[i].toBeDisplayed)
+            num++;
+
+    return(num);
+
+}
+
 /*------------------------------------------------------------------------------
 
     Function: OutputPicture
@@ -1517,7 +1791,9 @@ void h264bsdFlushDpb(dpbStorage_t *dpb)
     Function: h264bsdFreeDpb
 
         Functional description:
-            Function to free memories reserved for the DPB.
+            Function to free memories reserved for the DPB. The images go
+            back to the image pool of the DPB, those held by the application
+            when released.
 
 ------------------------------------------------------------------------------*/
 
@@ -1527,6 +1803,7 @@ void h264bsdFreeDpb(dpbStorage_t *dpb)
 /* Variables */
 
     u32 i;
+    dpbHeldImage_t *pHeld;
 
 /* Code */
 
@@ -1534,9 +1811,19 @@ void h264bsdFreeDpb(dpbStorage_t *dpb)
 
     if (dpb->buffer)
     {
-        for (i = 0; i < dpb->dpbSize+1; i++)
+        for (i = 0; i < dpb->dpbSize+1+dpb->numExtraImages; i++)
         {
-            FREE(dpb->buffer[i].pAllocatedData);
+            pHeld = FindHeldImage(dpb,
+                ALIGN(dpb->buffer[i].pAllocatedData, IMAGE_POOL_ALIGNMENT));
+            if (pHeld != NULL && pHeld->pAllocatedData == NULL)
+            {
+                pHeld->pAllocatedData = dpb->buffer[i].pAllocatedData;
+                pHeld->size = dpb->imageSize;
+            }
+            else
+                h264bsdPutPoolImage(&dpb->pool,
+                    dpb->buffer[i].pAllocatedData, dpb->imageSize);
+            dpb->buffer[i].pAllocatedData = NULL;
         }
     }
     FREE(dpb->buffer);
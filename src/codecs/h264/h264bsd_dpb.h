@@ -36,6 +36,7 @@
 #include "basetype.h"
 #include "h264bsd_slice_header.h"
 #include "h264bsd_image.h"
+#include "h264bsd_image_pool.h"
 
 /*------------------------------------------------------------------------------
     2. Module defines
@@ -55,8 +56,8 @@ typedef enum {
 
 /* structure to represent a buffered picture */
 typedef struct {
-    u8 *data;           /* 16-byte aligned pointer of pAllocatedData */
-    u8 *pAllocatedData; /* allocated picture pointer; (size + 15) bytes */
+    u8 *data;           /* 64-byte aligned pointer of pAllocatedData */
+    u8 *pAllocatedData; /* allocated picture pointer, h264bsd_image_pool.h */
     i32 picNum;
     u32 frameNum;
     i32 picOrderCnt;
@@ -75,6 +76,14 @@ typedef struct {
     u32 isIdr;
 } dpbOutPicture_t;
 
+/* image held by the application after output, see h264bsdDpbHoldImage */
+typedef struct {
+    u8 *data;
+    u8 *pAllocatedData; /* set once the buffer has let go of the image */
+    u32 size;           /* image size of pAllocatedData */
+    u32 count;          /* number of holds not released */
+} dpbHeldImage_t;
+
 /* structure to represent DPB */
 typedef struct {
     dpbPicture_t *buffer;
@@ -93,6 +102,23 @@ typedef struct {
     u32 lastContainsMmco5;
     u32 noReordering;
     u32 flushed;
+    /* images allocated after the dpbSize + 1 of the buffer, exchanged with
+     * the one given by h264bsdAllocateDpbImage while pictures decoded on
+     * frame threads still use it (h264bsd_frame_threads.c) */
+    u32 numExtraImages;
+    /* set in the copy of the DPB a picture is decoded through on a frame
+     * thread, NULL otherwise */
+    struct framePicture *framePicture;
+    /* images held by the application, kept over h264bsdFreeDpb */
+    dpbHeldImage_t *held;
+    u32 numHeld;
+    u32 imageSize;      /* size of an image, without padding */
+    /* pictures that may wait for display before the first one is output,
+     * dpbSize unless set lower from the stream (low latency) */
+    u32 numReorderFrames;
+    /* images freed by h264bsdFreeDpb or released by the application, reused
+     * by h264bsdInitDpb, kept over h264bsdFreeDpb */
+    imagePool_t pool;
 } dpbStorage_t;
 
 /*------------------------------------------------------------------------------
@@ -119,6 +145,11 @@ void h264bsdInitRefPicList(dpbStorage_t *dpb);
 
 u8* h264bsdAllocateDpbImage(dpbStorage_t *dpb);
 
+u32 h264bsdDpbHoldImage(dpbStorage_t *dpb, u8 *data);
+void h264bsdDpbReleaseImage(dpbStorage_t *dpb, u8 *data);
+u32 h264bsdDpbImageHeld(dpbStorage_t *dpb, u8 *data);
+void h264bsdFreeHeldImages(dpbStorage_t *dpb);
+
 u8* h264bsdGetRefPicData(dpbStorage_t *dpb, u32 index);
 
 u32 h264bsdReorderRefPicList(
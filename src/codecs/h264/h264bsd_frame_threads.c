@@ -0,0 +1,1161 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdCreateFrameThreads
+          h264bsdFreeFrameThreads
+          h264bsdStartFrame
+          h264bsdQueueFrameSlice
+          h264bsdEndFrame
+          h264bsdFinishFrames
+          h264bsdFrameOutputPicture
+          h264bsdFrameConcealedMbs
+          h264bsdFrameRowDecoded
+          h264bsdWaitFrameRows
+          EndPicture
+          CopyRefPicList
+          ImageInUse
+          ImageDecoding
+          SetRowsReady
+          DecodeFrameSlice
+          FinishPicture
+          FrameThread
+
+--------------------------------------------------------------------------------
+
+    Threads decoding consecutive pictures at the same time. Each thread has a
+    picture of its own, pictures are handed to the threads in turn. The
+    calling thread decodes the NAL units, slice headers and reference
+    picture marking as before, and queues the slice data with copies of the
+    state the storage keeps for it. The thread of the picture decodes the
+    slices one after the other, conceals and filters the picture.
+
+    Macroblock rows are deblocking filtered as decoding goes on, a row once
+    the row below it has been decoded. Rows above the one filtered last are
+    final and made available to the pictures referencing this one: before
+    motion compensated prediction of a macroblock a thread waits until the
+    rows it reads in the reference pictures are available.
+
+    An image is not given to a new picture while a picture being decoded
+    reads or writes it, or it waits in the output buffer of the DPB. The DPB
+    has extra images for this, see h264bsdSetFrameThreads. Pictures are
+    output in display order a number of pictures after they are decoded,
+    the threads decode the pictures in between.
+
+    The number of concealed macroblocks of a picture is only known after it
+    has been marked, pictures decoded on frame threads are marked with none.
+    Redundant slices are not decoded, and macroblocks of a corrupted slice
+    that are in rows already made available are not concealed.
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "h264bsd_frame_threads.h"
+#include "h264bsd_slice_data.h"
+#include "h264bsd_conceal.h"
+#include "h264bsd_deblocking.h"
+#include "h264bsd_neighbour.h"
+#include "h264bsd_util.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+#define IS_EXISTING(a) ((a).status > NON_EXISTING)
+
+/* images of the DPB a picture may read: the buffer and its extra images */
+#define MAX_NUM_PIC_REFS (2 * (MAX_NUM_REF_PICS + 1))
+
+/* slice queued for a picture, with copies of what the storage keeps for the
+ * slice being decoded */
+typedef struct
+{
+    sliceHeader_t sliceHeader[1];
+    strmData_t strm[1];
+    u8 *pStrmBuff;              /* copy of the slice NAL unit */
+    u32 strmBuffCapacity;
+    picParamSet_t pps[1];
+    /* the DPB sorts its buffer while the slice is decoded, the list points
+     * to copies of the reference pictures */
+    dpbPicture_t refPics[MAX_NUM_REF_PICS + 1];
+    dpbPicture_t *refPicList[MAX_NUM_REF_PICS + 1];
+    u32 *sliceGroupMap;         /* copy for pictures with slice groups */
+    u32 sliceGroupMapSize;
+} frameSlice_t;
+
+/* one thread and the picture it decodes */
+struct framePicture
+{
+    frameThreads_t *pThreads;
+    pthread_t thread;
+
+    /* storage the picture is decoded with, only the fields used by slice
+     * data decoding and concealment are set. dpb->list points to the
+     * reference pictures of the slice being decoded */
+    storage_t storage[1];
+    seqParamSet_t sps[1];
+    u32 *sliceGroupMap;         /* map of a single slice group */
+    u32 picSizeInMbs;           /* size the mbStorage array is made for */
+    u32 picWidthInMbs;
+
+    /* slices of the picture, all slices of the array are allocated and
+     * reused for the following pictures */
+    frameSlice_t **slices;
+    u32 numAllocated;
+    u32 numSlices;              /* slices queued */
+    u32 numTaken;               /* slices picked by the thread */
+
+    u32 decoding;               /* picture started and not finished */
+    u32 ended;                  /* all slices of the picture queued */
+
+    /* reference pictures and slice type for concealment */
+    u32 concealSliceType;
+    dpbPicture_t concealRefPics[MAX_NUM_REF_PICS + 1];
+    dpbPicture_t *concealRefPicList[MAX_NUM_REF_PICS + 1];
+
+    /* images of all reference picture lists of the picture */
+    u8 *refs[MAX_NUM_PIC_REFS];
+    u32 numRefs;
+
+    u32 rowsReady;              /* rows available to other pictures */
+};
+
+struct frameThreads
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t start;       /* signalled when a picture gets work */
+    pthread_cond_t progress;    /* signalled when rows become available */
+
+    framePicture_t *pics;
+    u32 numThreads;
+    u32 quit;
+
+    framePicture_t *pCurrent;   /* picture being queued, NULL if none */
+    u32 next;                   /* index of the next picture started */
+
+    u32 numConcealedMbs;        /* concealed in all finished pictures */
+};
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static void EndPicture(frameThreads_t *pThreads, dpbStorage_t *dpb,
+    u32 sliceType);
+static void CopyRefPicList(framePicture_t *pPic, dpbStorage_t *dpb,
+    dpbPicture_t *refPics, dpbPicture_t **refPicList);
+static u32 ImageInUse(frameThreads_t *pThreads, dpbStorage_t *dpb, u8 *data);
+static u32 ImageDecoding(frameThreads_t *pThreads, u8 *data);
+static void SetRowsReady(framePicture_t *pPic, u32 numRows);
+static void DecodeFrameSlice(framePicture_t *pPic, frameSlice_t *pSlice);
+static void FinishPicture(framePicture_t *pPic);
+static void *FrameThread(void *arg);
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdCreateFrameThreads
+
+        Functional description:
+            Start the threads, one for each picture decoded at the same
+            time.
+
+        Inputs:
+            numThreads  number of threads, at most MAX_NUM_FRAME_THREADS
+
+        Outputs:
+            none
+
+        Returns:
+            pointer to the threads
+            NULL if memory allocation or creation of the threads failed
+
+------------------------------------------------------------------------------*/
+
+frameThreads_t *h264bsdCreateFrameThreads(u32 numThreads)
+{
+
+/* Variables */
+
+    u32 i, size;
+    frameThreads_t *pThreads;
+    framePicture_t *pPic;
+
+/* Code */
+
+    ASSERT(numThreads);
+
+    if (numThreads > MAX_NUM_FRAME_THREADS)
+        numThreads = MAX_NUM_FRAME_THREADS;
+
+    pThreads = (frameThreads_t*)calloc(1, sizeof(frameThreads_t));
+    if (pThreads == NULL)
+        return(NULL);
+
+    pThreads->pics = (framePicture_t*)calloc(numThreads,
+        sizeof(framePicture_t));
+    if (pThreads->pics == NULL)
+    {
+        FREE(pThreads);
+        return(NULL);
+    }
+
+    pthread_mutex_init(&pThreads->mutex, NULL);
+    pthread_cond_init(&pThreads->start, NULL);
+    pthread_cond_init(&pThreads->progress, NULL);
+
+    /* same size as the mbLayer of the storage, see h264bsdInit */
+    size = (sizeof(macroblockLayer_t) + 63) & ~0x3F;
+
+    for (i = 0; i < numThreads; i++)
+    {
+        pPic = pThreads->pics + i;
+        pPic->pThreads = pThreads;
+        pPic->storage->mbLayer = (macroblockLayer_t*)malloc(size);
+        if (pPic->storage->mbLayer == NULL ||
+            pthread_create(&pPic->thread, NULL, FrameThread, pPic) != 0)
+        {
+            FREE(pPic->storage->mbLayer);
+            break;
+        }
+        pThreads->numThreads++;
+    }
+
+    if (pThreads->numThreads < numThreads)
+    {
+        h264bsdFreeFrameThreads(pThreads);
+        return(NULL);
+    }
+
+    return(pThreads);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFreeFrameThreads
+
+        Functional description:
+            Stop the threads and free them. Pictures being decoded have to
+            be finished first with h264bsdFinishFrames.
+
+        Inputs:
+            pThreads    pointer to the threads, may be NULL
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFreeFrameThreads(frameThreads_t *pThreads)
+{
+
+/* Variables */
+
+    u32 i, j;
+    framePicture_t *pPic;
+
+/* Code */
+
+    if (pThreads == NULL)
+        return;
+
+    pthread_mutex_lock(&pThreads->mutex);
+    pThreads->quit = HANTRO_TRUE;
+    pthread_cond_broadcast(&pThreads->start);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    for (i = 0; i < pThreads->numThreads; i++)
+    {
+        pPic = pThreads->pics + i;
+        pthread_join(pPic->thread, NULL);
+
+        for (j = 0; j < pPic->numAllocated; j++)
+        {
+            FREE(pPic->slices[j]->pStrmBuff);
+            FREE(pPic->slices[j]->sliceGroupMap);
+            FREE(pPic->slices[j]);
+        }
+        FREE(pPic->slices);
+        FREE(pPic->storage->mbLayer);
+        FREE(pPic->storage->mb);
+        FREE(pPic->sliceGroupMap);
+    }
+
+    pthread_cond_destroy(&pThreads->progress);
+    pthread_cond_destroy(&pThreads->start);
+    pthread_mutex_destroy(&pThreads->mutex);
+
+    FREE(pThreads->pics);
+    FREE(pThreads);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdStartFrame
+
+        Functional description:
+            Start decoding a picture on the next thread, after the picture
+            that thread decoded before has been finished. Allocates the
+            image of the picture from the DPB like h264bsdAllocateDpbImage,
+            exchanging it with an extra image of the DPB while it is still
+            in use. If none is free the function waits for pictures being
+            decoded to finish.
+
+        Inputs:
+            pStorage    pointer to storage structure, with the parameter
+                        sets of the picture activated
+
+        Outputs:
+            pStorage    currImage->data points to the image of the picture
+
+        Returns:
+            HANTRO_OK   picture started, queue its slices with
+                        h264bsdQueueFrameSlice
+            HANTRO_NOK  no frame threads or memory allocation failed, the
+                        picture is decoded on the calling thread and the
+                        image has not been allocated
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdStartFrame(storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 i, last, picSizeInMbs;
+    u8 *data;
+    frameThreads_t *pThreads;
+    framePicture_t *pPic;
+    storage_t *pPicStorage;
+    dpbStorage_t *dpb;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pThreads = pStorage->frameThreads;
+    if (pThreads == NULL)
+        return(HANTRO_NOK);
+
+    dpb = pStorage->dpb;
+
+    /* previous picture without an access unit boundary */
+    if (pThreads->pCurrent)
+        EndPicture(pThreads, dpb, P_SLICE);
+
+    pPic = pThreads->pics + pThreads->next;
+    pPicStorage = pPic->storage;
+
+    pthread_mutex_lock(&pThreads->mutex);
+    while (pPic->decoding)
+        pthread_cond_wait(&pThreads->progress, &pThreads->mutex);
+
+    last = dpb->dpbSize + dpb->numExtraImages;
+    for (;;)
+    {
+        for (i = dpb->dpbSize; i <= last; i++)
+            if (!ImageInUse(pThreads, dpb, dpb->buffer[i].data))
+                break;
+        if (i <= last)
+            break;
+        /* wait for one of the pictures being decoded. Images only held by
+         * the output buffer are reused if all of them are */
+        for (i = 0; i < pThreads->numThreads; i++)
+            if (pThreads->pics[i].decoding)
+                break;
+        if (i == pThreads->numThreads)
+        {
+            i = dpb->dpbSize;
+            break;
+        }
+        pthread_cond_wait(&pThreads->progress, &pThreads->mutex);
+    }
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    /* take the free image to position dpbSize of the buffer */
+    if (i != dpb->dpbSize)
+    {
+        data = dpb->buffer[i].data;
+        dpb->buffer[i].data = dpb->buffer[dpb->dpbSize].data;
+        dpb->buffer[dpb->dpbSize].data = data;
+    }
+
+    picSizeInMbs = pStorage->picSizeInMbs;
+    if (pPic->picSizeInMbs != picSizeInMbs ||
+        pPic->picWidthInMbs != pStorage->activeSps->picWidthInMbs)
+    {
+        FREE(pPicStorage->mb);
+        FREE(pPic->sliceGroupMap);
+        pPic->picSizeInMbs = 0;
+
+        ALLOCATE(pPicStorage->mb, picSizeInMbs, mbStorage_t);
+        ALLOCATE(pPic->sliceGroupMap, picSizeInMbs, u32);
+        if (pPicStorage->mb == NULL || pPic->sliceGroupMap == NULL)
+        {
+            h264bsdFinishFrames(pStorage);
+            return(HANTRO_NOK);
+        }
+
+        memset(pPicStorage->mb, 0, picSizeInMbs * sizeof(mbStorage_t));
+        memset(pPic->sliceGroupMap, 0, picSizeInMbs * sizeof(u32));
+        h264bsdInitMbNeighbours(pPicStorage->mb,
+            pStorage->activeSps->picWidthInMbs, picSizeInMbs);
+
+        pPic->picSizeInMbs = picSizeInMbs;
+        pPic->picWidthInMbs = pStorage->activeSps->picWidthInMbs;
+    }
+
+    *pPic->sps = *pStorage->activeSps;
+    pPicStorage->activeSps = pPic->sps;
+    pPicStorage->picSizeInMbs = picSizeInMbs;
+    pPicStorage->sliceGroupMap = pPic->sliceGroupMap;
+    pPicStorage->intraConcealmentFlag = pStorage->intraConcealmentFlag;
+    pPicStorage->concealment = pStorage->concealment;
+    pPicStorage->numConcealedMbs = 0;
+    h264bsdResetStorage(pPicStorage);
+
+    memset(pPicStorage->dpb, 0, sizeof(dpbStorage_t));
+    pPicStorage->dpb->framePicture = pPic;
+
+    pStorage->currImage->data = h264bsdAllocateDpbImage(dpb);
+    *pPicStorage->currImage = *pStorage->currImage;
+
+    pPic->numSlices = 0;
+    pPic->numTaken = 0;
+    pPic->ended = HANTRO_FALSE;
+    pPic->numRefs = 0;
+    pPic->rowsReady = 0;
+
+    pthread_mutex_lock(&pThreads->mutex);
+    pPic->decoding = HANTRO_TRUE;
+    pthread_cond_broadcast(&pThreads->start);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    pThreads->pCurrent = pPic;
+    pThreads->next = (pThreads->next + 1) % pThreads->numThreads;
+
+    return(HANTRO_OK);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdQueueFrameSlice
+
+        Functional description:
+            Queue the slice whose header has just been decoded into the
+            storage to the thread of the picture. The stream data, slice
+            header, picture parameter set, slice group map and reference
+            picture list are copied, so the storage is free to go on with
+            the next NAL unit. Redundant slices are dropped.
+
+        Inputs:
+            pStorage    pointer to storage structure, with the slice header
+                        and reference picture list of the slice
+            pStrmData   pointer to stream data structure, positioned at the
+                        start of the slice data
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_OK   slice queued, or lost if memory allocation failed
+            HANTRO_NOK  picture not started on the frame threads, decode it
+                        on the calling thread
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdQueueFrameSlice(storage_t *pStorage, strmData_t *pStrmData)
+{
+
+/* Variables */
+
+    u32 size;
+    frameThreads_t *pThreads;
+    framePicture_t *pPic;
+    frameSlice_t *pSlice, **slices;
+    u8 *pStrmBuff;
+    u32 *sliceGroupMap;
+
+/* Code */
+
+    ASSERT(pStorage);
+    ASSERT(pStrmData);
+
+    pThreads = pStorage->frameThreads;
+    if (pThreads == NULL || pThreads->pCurrent == NULL)
+        return(HANTRO_NOK);
+
+    pPic = pThreads->pCurrent;
+
+    if (pStorage->sliceHeader->redundantPicCnt)
+        return(HANTRO_OK);
+
+    if (pPic->numSlices == pPic->numAllocated)
+    {
+        pSlice = (frameSlice_t*)calloc(1, sizeof(frameSlice_t));
+        if (pSlice == NULL)
+            return(HANTRO_OK);
+
+        /* the thread indexes the array while holding the mutex */
+        pthread_mutex_lock(&pThreads->mutex);
+        slices = (frameSlice_t**)realloc(pPic->slices,
+            (pPic->numAllocated + 1) * sizeof(frameSlice_t*));
+        if (slices != NULL)
+        {
+            pPic->slices = slices;
+            pPic->slices[pPic->numAllocated++] = pSlice;
+        }
+        pthread_mutex_unlock(&pThreads->mutex);
+        if (slices == NULL)
+        {
+            FREE(pSlice);
+            return(HANTRO_OK);
+        }
+    }
+
+    pSlice = pPic->slices[pPic->numSlices];
+
+    size = pStrmData->strmBuffSize;
+    if (pSlice->strmBuffCapacity < size)
+    {
+        pStrmBuff = (u8*)realloc(pSlice->pStrmBuff, size);
+        if (pStrmBuff == NULL)
+            return(HANTRO_OK);
+        pSlice->pStrmBuff = pStrmBuff;
+        pSlice->strmBuffCapacity = size;
+    }
+
+    if (pStorage->activePps->numSliceGroups != 1)
+    {
+        if (pSlice->sliceGroupMapSize < pStorage->picSizeInMbs)
+        {
+            sliceGroupMap = (u32*)realloc(pSlice->sliceGroupMap,
+                pStorage->picSizeInMbs * sizeof(u32));
+            if (sliceGroupMap == NULL)
+                return(HANTRO_OK);
+            pSlice->sliceGroupMap = sliceGroupMap;
+            pSlice->sliceGroupMapSize = pStorage->picSizeInMbs;
+        }
+        memcpy(pSlice->sliceGroupMap, pStorage->sliceGroupMap,
+            pStorage->picSizeInMbs * sizeof(u32));
+    }
+
+    memcpy(pSlice->pStrmBuff, pStrmData->pStrmBuffStart, size);
+    *pSlice->strm = *pStrmData;
+    pSlice->strm->pStrmBuffStart = pSlice->pStrmBuff;
+    pSlice->strm->pStrmCurrPos = pSlice->pStrmBuff +
+        (pStrmData->pStrmCurrPos - pStrmData->pStrmBuffStart);
+
+    *pSlice->sliceHeader = *pStorage->sliceHeader;
+    *pSlice->pps = *pStorage->activePps;
+    CopyRefPicList(pPic, pStorage->dpb, pSlice->refPics, pSlice->refPicList);
+
+    pthread_mutex_lock(&pThreads->mutex);
+    pPic->numSlices++;
+    pthread_cond_broadcast(&pThreads->start);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    return(HANTRO_OK);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdEndFrame
+
+        Functional description:
+            End the picture being queued at the access unit boundary. Its
+            thread conceals and filters it once the queued slices have been
+            decoded.
+
+        Inputs:
+            pStorage    pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_OK   picture ended, or no picture started on the frame
+                        threads and no valid slice in the access unit:
+                        nothing to conceal
+            HANTRO_NOK  picture decoded on the calling thread
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdEndFrame(storage_t *pStorage)
+{
+
+/* Variables */
+
+    frameThreads_t *pThreads;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pThreads = pStorage->frameThreads;
+    if (pThreads == NULL)
+        return(HANTRO_NOK);
+
+    /* a picture without valid slices is not stored in the DPB */
+    if (pThreads->pCurrent == NULL)
+        return(pStorage->validSliceInAccessUnit ? HANTRO_NOK : HANTRO_OK);
+
+    EndPicture(pThreads, pStorage->dpb, pStorage->sliceHeader->sliceType);
+
+    return(HANTRO_OK);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFinishFrames
+
+        Functional description:
+            End the picture being queued and wait until all pictures are
+            decoded.
+
+        Inputs:
+            pStorage    pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFinishFrames(storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 i;
+    frameThreads_t *pThreads;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pThreads = pStorage->frameThreads;
+    if (pThreads == NULL)
+        return;
+
+    if (pThreads->pCurrent)
+        EndPicture(pThreads, pStorage->dpb, pStorage->sliceHeader->sliceType);
+
+    pthread_mutex_lock(&pThreads->mutex);
+    for (i = 0; i < pThreads->numThreads; i++)
+        while (pThreads->pics[i].decoding)
+            pthread_cond_wait(&pThreads->progress, &pThreads->mutex);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFrameOutputPicture
+
+        Functional description:
+            Get the next picture in display order like
+            h264bsdDpbOutputPicture, waiting for its thread if the picture
+            is still being decoded. The output buffer is emptied when the
+            next picture is started, so the picture can not be left in it.
+
+        Inputs:
+            pStorage    pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            pointer to output picture structure, NULL if no pictures to
+            display
+
+------------------------------------------------------------------------------*/
+
+dpbOutPicture_t *h264bsdFrameOutputPicture(storage_t *pStorage)
+{
+
+/* Variables */
+
+    frameThreads_t *pThreads;
+    dpbStorage_t *dpb;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pThreads = pStorage->frameThreads;
+    dpb = pStorage->dpb;
+
+    if (pThreads != NULL && dpb->outIndex < dpb->numOut)
+    {
+        pthread_mutex_lock(&pThreads->mutex);
+        while (ImageDecoding(pThreads, dpb->outBuf[dpb->outIndex].data))
+            pthread_cond_wait(&pThreads->progress, &pThreads->mutex);
+        pthread_mutex_unlock(&pThreads->mutex);
+    }
+
+    return(h264bsdDpbOutputPicture(dpb));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFrameConcealedMbs
+
+        Functional description:
+            Number of macroblocks concealed on the frame threads, in the
+            pictures finished so far.
+
+        Inputs:
+            pStorage    pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            number of macroblocks, 0 without frame threads
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdFrameConcealedMbs(storage_t *pStorage)
+{
+
+/* Variables */
+
+    frameThreads_t *pThreads;
+    u32 numMbs;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pThreads = pStorage->frameThreads;
+    if (pThreads == NULL)
+        return(0);
+
+    pthread_mutex_lock(&pThreads->mutex);
+    numMbs = pThreads->numConcealedMbs;
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    return(numMbs);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFrameRowDecoded
+
+        Functional description:
+            Called by slice data decoding on a frame thread after rows have
+            been deblocking filtered. Makes the rows above the last filtered
+            one available.
+
+        Inputs:
+            pPic        picture being decoded
+
+        Outputs:
+            pPic        rows made available
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFrameRowDecoded(framePicture_t *pPic)
+{
+
+/* Code */
+
+    ASSERT(pPic);
+
+    /* filtering of the next row changes the last one filtered */
+    SetRowsReady(pPic, pPic->storage->rowsFiltered - 1);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdWaitFrameRows
+
+        Functional description:
+            Called on a frame thread to wait until a reference picture has
+            the given number of rows available. Returns right away if the
+            reference picture is not being decoded.
+
+        Inputs:
+            pPic        picture being decoded
+            refData     image of the reference picture
+            numRows     number of macroblock rows needed
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdWaitFrameRows(framePicture_t *pPic, u8 *refData, u32 numRows)
+{
+
+/* Variables */
+
+    u32 i;
+    frameThreads_t *pThreads;
+    framePicture_t *pRef;
+
+/* Code */
+
+    ASSERT(pPic);
+
+    pThreads = pPic->pThreads;
+
+    pthread_mutex_lock(&pThreads->mutex);
+    for (i = 0; i < pThreads->numThreads; i++)
+    {
+        pRef = pThreads->pics + i;
+        if (pRef == pPic || pRef->storage->currImage->data != refData)
+            continue;
+        /* the image of a reference picture is not given to a new picture
+         * before this one is finished, but the thread of the reference
+         * may have started a new picture with another image by the time
+         * this one wakes up */
+        while (pRef->decoding && pRef->rowsReady < numRows &&
+               pRef->storage->currImage->data == refData)
+            pthread_cond_wait(&pThreads->progress, &pThreads->mutex);
+        break;
+    }
+    pthread_mutex_unlock(&pThreads->mutex);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: EndPicture
+
+        Functional description:
+            Mark the picture being queued ended, with the current reference
+            picture list of the DPB used for its concealment.
+
+------------------------------------------------------------------------------*/
+
+void EndPicture(frameThreads_t *pThreads, dpbStorage_t *dpb, u32 sliceType)
+{
+
+/* Variables */
+
+    framePicture_t *pPic;
+
+/* Code */
+
+    pPic = pThreads->pCurrent;
+    ASSERT(pPic);
+
+    CopyRefPicList(pPic, dpb, pPic->concealRefPics, pPic->concealRefPicList);
+
+    pthread_mutex_lock(&pThreads->mutex);
+    pPic->concealSliceType = sliceType;
+    pPic->ended = HANTRO_TRUE;
+    pthread_cond_broadcast(&pThreads->start);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    pThreads->pCurrent = NULL;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: CopyRefPicList
+
+        Functional description:
+            Copy the reference picture list of the DPB and add its images
+            to the ones read by the picture.
+
+------------------------------------------------------------------------------*/
+
+void CopyRefPicList(framePicture_t *pPic, dpbStorage_t *dpb,
+    dpbPicture_t *refPics, dpbPicture_t **refPicList)
+{
+
+/* Variables */
+
+    u32 i, j;
+
+/* Code */
+
+    for (i = 0; i < MAX_NUM_REF_PICS + 1; i++)
+    {
+        if (dpb->list[i] == NULL)
+        {
+            refPicList[i] = NULL;
+            continue;
+        }
+
+        refPics[i] = *dpb->list[i];
+        refPicList[i] = refPics + i;
+
+        if (!IS_EXISTING(refPics[i]))
+            continue;
+        for (j = 0; j < pPic->numRefs; j++)
+            if (pPic->refs[j] == refPics[i].data)
+                break;
+        if (j == pPic->numRefs && j < MAX_NUM_PIC_REFS)
+            pPic->refs[pPic->numRefs++] = refPics[i].data;
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: ImageInUse
+
+        Functional description:
+            Check if a picture being decoded reads or writes an image, or
+            it is in the output buffer of the DPB. Called holding the mutex.
+
+------------------------------------------------------------------------------*/
+
+u32 ImageInUse(frameThreads_t *pThreads, dpbStorage_t *dpb, u8 *data)
+{
+
+/* Variables */
+
+    u32 i, j;
+    framePicture_t *pPic;
+
+/* Code */
+
+    for (i = dpb->outIndex; i < dpb->numOut; i++)
+        if (dpb->outBuf[i].data == data)
+            return(HANTRO_TRUE);
+
+    /* would be exchanged for a new image */
+    if (h264bsdDpbImageHeld(dpb, data))
+        return(HANTRO_TRUE);
+
+    for (i = 0; i < pThreads->numThreads; i++)
+    {
+        pPic = pThreads->pics + i;
+        if (!pPic->decoding)
+            continue;
+        if (pPic->storage->currImage->data == data)
+            return(HANTRO_TRUE);
+        for (j = 0; j < pPic->numRefs; j++)
+            if (pPic->refs[j] == data)
+                return(HANTRO_TRUE);
+    }
+
+    return(HANTRO_FALSE);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: ImageDecoding
+
+        Functional description:
+            Check if a picture being decoded writes an image. Called holding
+            the mutex.
+
+------------------------------------------------------------------------------*/
+
+u32 ImageDecoding(frameThreads_t *pThreads, u8 *data)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    for (i = 0; i < pThreads->numThreads; i++)
+        if (pThreads->pics[i].decoding &&
+            pThreads->pics[i].storage->currImage->data == data)
+            return(HANTRO_TRUE);
+
+    return(HANTRO_FALSE);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: SetRowsReady
+
+        Functional description:
+            Make rows of the picture available to other pictures.
+
+------------------------------------------------------------------------------*/
+
+void SetRowsReady(framePicture_t *pPic, u32 numRows)
+{
+
+/* Code */
+
+    pthread_mutex_lock(&pPic->pThreads->mutex);
+    pPic->rowsReady = numRows;
+    pthread_cond_broadcast(&pPic->pThreads->progress);
+    pthread_mutex_unlock(&pPic->pThreads->mutex);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: DecodeFrameSlice
+
+        Functional description:
+            Decode a queued slice on the thread of the picture. A corrupted
+            slice is marked like the decoder does.
+
+------------------------------------------------------------------------------*/
+
+void DecodeFrameSlice(framePicture_t *pPic, frameSlice_t *pSlice)
+{
+
+/* Variables */
+
+    u32 tmp;
+    storage_t *pPicStorage;
+
+/* Code */
+
+    pPicStorage = pPic->storage;
+
+    pPicStorage->activePps = pSlice->pps;
+    pPicStorage->dpb->list = pSlice->refPicList;
+    pPicStorage->sliceGroupMap = pSlice->pps->numSliceGroups != 1 ?
+        pSlice->sliceGroupMap : pPic->sliceGroupMap;
+
+    tmp = h264bsdDecodeSliceData(pSlice->strm, pPicStorage,
+        pPicStorage->currImage, pSlice->sliceHeader);
+    if (tmp != HANTRO_OK)
+    {
+        EPRINT("SLICE_DATA");
+        h264bsdMarkSliceCorrupted(pPicStorage,
+            pSlice->sliceHeader->firstMbInSlice);
+    }
+
+    pPicStorage->sliceGroupMap = pPic->sliceGroupMap;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FinishPicture
+
+        Functional description:
+            Conceal the macroblocks of the picture that were not decoded and
+            filter the rows not filtered yet.
+
+------------------------------------------------------------------------------*/
+
+void FinishPicture(framePicture_t *pPic)
+{
+
+/* Variables */
+
+    u32 i;
+    storage_t *pPicStorage;
+    image_t *pImage;
+
+/* Code */
+
+    pPicStorage = pPic->storage;
+    pImage = pPicStorage->currImage;
+
+    if (pPicStorage->slice->numDecodedMbs < pPicStorage->picSizeInMbs)
+    {
+        /* concealment copies whole macroblocks of a reference picture */
+        for (i = 0; i < MAX_NUM_REF_PICS + 1; i++)
+            if (pPic->concealRefPicList[i] != NULL &&
+                IS_EXISTING(*pPic->concealRefPicList[i]))
+                h264bsdWaitFrameRows(pPic, pPic->concealRefPicList[i]->data,
+                    pImage->height);
+
+        pPicStorage->dpb->list = pPic->concealRefPicList;
+        (void)h264bsdConceal(pPicStorage, pImage, pPic->concealSliceType);
+    }
+
+    h264bsdFilterPictureRows(pImage, pPicStorage->mb,
+        pPicStorage->rowsFiltered, pImage->height - pPicStorage->rowsFiltered);
+    pPicStorage->rowsFiltered = pImage->height;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FrameThread
+
+        Functional description:
+            Thread function, decodes the slices of the pictures handed to
+            the thread until the threads are freed.
+
+------------------------------------------------------------------------------*/
+
+void *FrameThread(void *arg)
+{
+
+/* Variables */
+
+    framePicture_t *pPic = (framePicture_t*)arg;
+    frameThreads_t *pThreads = pPic->pThreads;
+    frameSlice_t *pSlice;
+
+/* Code */
+
+    pthread_mutex_lock(&pThreads->mutex);
+    for (;;)
+    {
+        while (!pThreads->quit && !(pPic->decoding &&
+               (pPic->numTaken < pPic->numSlices || pPic->ended)))
+            pthread_cond_wait(&pThreads->start, &pThreads->mutex);
+        if (pThreads->quit)
+            break;
+
+        if (pPic->numTaken < pPic->numSlices)
+        {
+            pSlice = pPic->slices[pPic->numTaken++];
+            pthread_mutex_unlock(&pThreads->mutex);
+            DecodeFrameSlice(pPic, pSlice);
+            pthread_mutex_lock(&pThreads->mutex);
+            continue;
+        }
+
+        pthread_mutex_unlock(&pThreads->mutex);
+        FinishPicture(pPic);
+        pthread_mutex_lock(&pThreads->mutex);
+
+        pPic->rowsReady = pPic->storage->currImage->height;
+        pPic->decoding = HANTRO_FALSE;
+        pThreads->numConcealedMbs += pPic->storage->numConcealedMbs;
+        pthread_cond_broadcast(&pThreads->progress);
+    }
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    return(NULL);
+
+}
@@ -0,0 +1,54 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+    1. Include headers
+    2. Module defines
+    3. Data types
+    4. Function prototypes
+
+------------------------------------------------------------------------------*/
+
+#ifndef H264SWDEC_FRAME_THREADS_H
+#define H264SWDEC_FRAME_THREADS_H
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+#include "h264bsd_stream.h"
+#include "h264bsd_storage.h"
+
+/*------------------------------------------------------------------------------
+    2. Module defines
+------------------------------------------------------------------------------*/
+
+/* upper limit for the number of frame threads of a decoder instance */
+#define MAX_NUM_FRAME_THREADS 16
+
+/*------------------------------------------------------------------------------
+    3. Data types
+------------------------------------------------------------------------------*/
+
+typedef struct frameThreads frameThreads_t;
+typedef struct framePicture framePicture_t;
+
+/*------------------------------------------------------------------------------
+    4. Function prototypes
+------------------------------------------------------------------------------*/
+
+frameThreads_t *h264bsdCreateFrameThreads(u32 numThreads);
+void h264bsdFreeFrameThreads(frameThreads_t *pThreads);
+
+u32 h264bsdStartFrame(storage_t *pStorage);
+u32 h264bsdQueueFrameSlice(storage_t *pStorage, strmData_t *pStrmData);
+u32 h264bsdEndFrame(storage_t *pStorage);
+void h264bsdFinishFrames(storage_t *pStorage);
+dpbOutPicture_t *h264bsdFrameOutputPicture(storage_t *pStorage);
+u32 h264bsdFrameConcealedMbs(storage_t *pStorage);
+
+void h264bsdFrameRowDecoded(framePicture_t *pPic);
+void h264bsdWaitFrameRows(framePicture_t *pPic, u8 *refData, u32 numRows);
+
+#endif /* #ifdef H264SWDEC_FRAME_THREADS_H */
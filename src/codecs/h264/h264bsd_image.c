@@ -36,6 +36,7 @@
 #include "h264bsd_image.h"
 #include "h264bsd_util.h"
 #include "h264bsd_neighbour.h"
+#include "h264bsd_transform.h"
 
 /*------------------------------------------------------------------------------
     2. External compiler flags
@@ -64,7 +65,8 @@ extern const u8 h264bsdClip[];
 
         Functional description:
             Write one macroblock into the image. Both luma and chroma
-            components will be written at the same time.
+            components will be written at the same time, chroma is left out
+            if image->lumaOnly is set.
 
         Inputs:
             data    pointer to macroblock data to be written, 256 values for
@@ -122,6 +124,9 @@ void h264bsdWriteMacroblock(image_t *image, u8 *data)
         lum += width-4;
     }
 
+    if (image->lumaOnly)
+        return;
+
     width >>= 1;
     for (i = 8; i ; i--)
     {
@@ -151,7 +156,8 @@ void h264bsdWriteMacroblock(image_t *image, u8 *data)
         Functional description:
             Write one macroblock into the image. Prediction for the macroblock
             and the residual are given separately and will be combined while
-            writing the data to the image
+            writing the data to the image. Chroma is left out if
+            image->lumaOnly is set.
 
         Inputs:
             data        pointer to macroblock prediction data, 256 values for
@@ -175,7 +181,6 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
 
 /* Variables */
 
-    u32 i;
     u32 picWidth, picSize;
     u8 *lum, *cb, *cr;
     u8 *imageBlock;
@@ -184,8 +189,12 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
     u32 block;
     u32 x, y;
     i32 *pRes;
-    i32 tmp1, tmp2, tmp3, tmp4;
+    i32 tmp1, tmp2;
+#ifndef H264DEC_SIMD
+    u32 i;
+    i32 tmp3, tmp4;
     const u8 *clp = h264bsdClip + 512;
+#endif
 
 /* Code */
 
@@ -245,6 +254,9 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
 
             /* Calculate image = prediction + residual
              * Process four pixels in a loop */
+#ifdef H264DEC_SIMD
+            h264bsdAddResidual4x4(imageBlock, picWidth, tmp, 16, pRes);
+#else
             for (i = 4; i; i--)
             {
                 tmp1 = tmp[0];
@@ -266,10 +278,14 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
                 imageBlock[3] = (u8)tmp3;
                 imageBlock += picWidth;
             }
+#endif /* H264DEC_SIMD */
         }
 
     }
 
+    if (image->lumaOnly)
+        return;
+
     picWidth /= 2;
 
     for (block = 16; block <= 23; block++)
@@ -317,6 +333,9 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
 
             RANGE_CHECK_ARRAY(pRes, -512, 511, 16);
 
+#ifdef H264DEC_SIMD
+            h264bsdAddResidual4x4(imageBlock, picWidth, tmp, 8, pRes);
+#else
             for (i = 4; i; i--)
             {
                 tmp1 = tmp[0];
@@ -338,6 +357,7 @@ void h264bsdWriteOutputBlocks(image_t *image, u32 mbNum, u8 *data,
                 imageBlock[3] = (u8)tmp3;
                 imageBlock += picWidth;
             }
+#endif /* H264DEC_SIMD */
         }
     }
 
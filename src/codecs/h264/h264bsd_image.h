@@ -52,6 +52,8 @@ typedef struct
     u8 *luma;
     u8 *cb;
     u8 *cr;
+    /* chroma is not reconstructed, see h264bsdSetLumaOnly */
+    u32 lumaOnly;
 } image_t;
 
 /*------------------------------------------------------------------------------
@@ -0,0 +1,317 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdSetPoolSizes
+          h264bsdGetPoolImage
+          h264bsdPutPoolImage
+          h264bsdFreeImagePool
+          UseSize
+          FreeSize
+
+--------------------------------------------------------------------------------
+
+    Pool of the image allocations of the DPB. The DPB is freed and allocated
+    again whenever a sequence parameter set is activated, at every stream
+    reconnect and variant switch, and the images it frees are kept here to
+    be handed out again for the same image size instead of going back to
+    the system. Image data is mapped in huge pages where the system
+    allows (ALLOCATE_IMAGE).
+
+    Images of the maxSizes sizes used last are kept, those of other sizes
+    are freed. An allocation is IMAGE_POOL_PADDING + IMAGE_POOL_ALIGNMENT - 1
+    bytes larger than the image, the image data starts at
+    ALIGN(pAllocatedData, IMAGE_POOL_ALIGNMENT).
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "h264bsd_image_pool.h"
+#include "h264bsd_util.h"
+
+#include <stdlib.h>
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static void UseSize(imagePool_t *pool, u32 size);
+static void FreeSize(imagePool_t *pool, u32 size);
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdSetPoolSizes
+
+        Functional description:
+            Set the number of image sizes kept in the pool. Images of the
+            sizes used before the last maxSizes ones are freed.
+
+        Inputs:
+            pool        pointer to the pool
+            maxSizes    number of sizes, 0 to free all images when the DPB
+                        lets go of them
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetPoolSizes(imagePool_t *pool, u32 maxSizes)
+{
+
+/* Code */
+
+    ASSERT(pool);
+
+    if (maxSizes > MAX_IMAGE_POOL_SIZES)
+        maxSizes = MAX_IMAGE_POOL_SIZES;
+
+    pool->maxSizes = maxSizes;
+    while (pool->numSizes > pool->maxSizes)
+        FreeSize(pool, pool->sizes[--pool->numSizes]);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdGetPoolImage
+
+        Functional description:
+            Get an allocation for an image of size bytes, one from the pool
+            if there is one of the same size.
+
+        Inputs:
+            pool        pointer to the pool
+            size        size of the image
+
+        Outputs:
+            none
+
+        Returns:
+            pointer to the allocation, NULL if memory allocation failed
+
+------------------------------------------------------------------------------*/
+
+u8 *h264bsdGetPoolImage(imagePool_t *pool, u32 size)
+{
+
+/* Variables */
+
+    u32 i;
+    u8 *pAllocatedData;
+
+/* Code */
+
+    ASSERT(pool);
+    ASSERT(size);
+
+    UseSize(pool, size);
+
+    for (i = 0; i < pool->numImages; i++)
+    {
+        if (pool->images[i].size == size)
+        {
+            pAllocatedData = pool->images[i].pAllocatedData;
+            pool->images[i] = pool->images[--pool->numImages];
+            return(pAllocatedData);
+        }
+    }
+
+    ALLOCATE_IMAGE(pAllocatedData,
+        size + IMAGE_POOL_PADDING + IMAGE_POOL_ALIGNMENT - 1);
+
+    return(pAllocatedData);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdPutPoolImage
+
+        Functional description:
+            Give an allocation got with h264bsdGetPoolImage back to the
+            pool. It is freed if the pool does not keep images of its size,
+            or under memory pressure (see big_alloc.h).
+
+        Inputs:
+            pool            pointer to the pool
+            pAllocatedData  allocation, may be NULL
+            size            size of the image given to h264bsdGetPoolImage
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdPutPoolImage(imagePool_t *pool, u8 *pAllocatedData, u32 size)
+{
+
+/* Variables */
+
+    poolImage_t *images;
+
+/* Code */
+
+    ASSERT(pool);
+
+    if (pAllocatedData == NULL)
+        return;
+
+    UseSize(pool, size);
+    if (pool->numSizes == 0 || big_alloc_pressure() >= BIG_PRESSURE_DPB)
+    {
+        FREE_IMAGE(pAllocatedData);
+        return;
+    }
+
+    if (pool->numImages == pool->numAllocated)
+    {
+        images = (poolImage_t*)realloc(pool->images,
+            (pool->numAllocated + 8) * sizeof(poolImage_t));
+        if (images == NULL)
+        {
+            FREE_IMAGE(pAllocatedData);
+            return;
+        }
+        pool->images = images;
+        pool->numAllocated += 8;
+    }
+
+    pool->images[pool->numImages].pAllocatedData = pAllocatedData;
+    pool->images[pool->numImages].size = size;
+    pool->numImages++;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFreeImagePool
+
+        Functional description:
+            Free all images of the pool. The number of sizes kept is not
+            changed.
+
+        Inputs:
+            pool        pointer to the pool
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFreeImagePool(imagePool_t *pool)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(pool);
+
+    for (i = 0; i < pool->numImages; i++)
+        FREE_IMAGE(pool->images[i].pAllocatedData);
+    FREE(pool->images);
+    pool->numImages = 0;
+    pool->numAllocated = 0;
+    pool->numSizes = 0;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: UseSize
+
+        Functional description:
+            Move an image size first in the sizes of the pool and free the
+            images of the sizes that no longer fit in maxSizes. The size is
+            not kept at all if maxSizes is 0.
+
+------------------------------------------------------------------------------*/
+
+void UseSize(imagePool_t *pool, u32 size)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    for (i = 0; i < pool->numSizes; i++)
+        if (pool->sizes[i] == size)
+            break;
+
+    if (i == pool->numSizes)
+    {
+        if (i == MAX_IMAGE_POOL_SIZES)
+            FreeSize(pool, pool->sizes[--i]);
+        else
+            pool->numSizes++;
+    }
+
+    for (; i; i--)
+        pool->sizes[i] = pool->sizes[i-1];
+    pool->sizes[0] = size;
+
+    while (pool->numSizes > pool->maxSizes)
+        FreeSize(pool, pool->sizes[--pool->numSizes]);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: FreeSize
+
+        Functional description:
+            Free the images of a size in the pool.
+
+------------------------------------------------------------------------------*/
+
+void FreeSize(imagePool_t *pool, u32 size)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    for (i = 0; i < pool->numImages;)
+    {
+        if (pool->images[i].size == size)
+        {
+            FREE_IMAGE(pool->images[i].pAllocatedData);
+            pool->images[i] = pool->images[--pool->numImages];
+        }
+        else
+            i++;
+    }
+
+}
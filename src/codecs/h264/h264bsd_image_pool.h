@@ -0,0 +1,65 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+    1. Include headers
+    2. Module defines
+    3. Data types
+    4. Function prototypes
+
+------------------------------------------------------------------------------*/
+
+#ifndef H264SWDEC_IMAGE_POOL_H
+#define H264SWDEC_IMAGE_POOL_H
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+
+/*------------------------------------------------------------------------------
+    2. Module defines
+------------------------------------------------------------------------------*/
+
+/* alignment of the image data within an allocation, a cache line */
+#define IMAGE_POOL_ALIGNMENT 64
+
+/* bytes allocated after the image, functions may read beyond the end of
+ * an array by a maximum of 32 bytes (ARM OpenMax DL implementation) */
+#define IMAGE_POOL_PADDING 32
+
+/* default and upper limit for the number of image sizes kept in a pool */
+#define IMAGE_POOL_SIZES 2
+#define MAX_IMAGE_POOL_SIZES 8
+
+/*------------------------------------------------------------------------------
+    3. Data types
+------------------------------------------------------------------------------*/
+
+/* free image of the pool */
+typedef struct {
+    u8 *pAllocatedData;
+    u32 size;
+} poolImage_t;
+
+/* images freed by the DPB, handed out again for the same image size */
+typedef struct {
+    poolImage_t *images;
+    u32 numImages;
+    u32 numAllocated;                   /* entries allocated in images */
+    u32 sizes[MAX_IMAGE_POOL_SIZES];    /* sizes kept, last used first */
+    u32 numSizes;
+    u32 maxSizes;
+} imagePool_t;
+
+/*------------------------------------------------------------------------------
+    4. Function prototypes
+------------------------------------------------------------------------------*/
+
+void h264bsdSetPoolSizes(imagePool_t *pool, u32 maxSizes);
+u8 *h264bsdGetPoolImage(imagePool_t *pool, u32 size);
+void h264bsdPutPoolImage(imagePool_t *pool, u8 *pAllocatedData, u32 size);
+void h264bsdFreeImagePool(imagePool_t *pool);
+
+#endif /* #ifdef H264SWDEC_IMAGE_POOL_H */
@@ -25,6 +25,7 @@
      4. Local function prototypes
      5. Functions
           h264bsdInterPrediction
+          WaitRefRows
           MvPrediction16x16
           MvPrediction16x8
           MvPrediction8x16
@@ -45,6 +46,7 @@
 #include "h264bsd_util.h"
 #include "h264bsd_reconstruct.h"
 #include "h264bsd_dpb.h"
+#include "h264bsd_frame_threads.h"
 
 /*------------------------------------------------------------------------------
     2. External compiler flags
@@ -65,6 +67,8 @@ typedef struct
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
 
+static void WaitRefRows(mbStorage_t *pMb, dpbStorage_t *dpb, u32 mbNum,
+    image_t *currImage);
 static u32 MvPrediction16x16(mbStorage_t *pMb, mbPred_t *mbPred,
     dpbStorage_t *dpb);
 static u32 MvPrediction16x8(mbStorage_t *pMb, mbPred_t *mbPred,
@@ -226,6 +230,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
 
     refImage.width = currImage->width;
     refImage.height = currImage->height;
+    refImage.lumaOnly = currImage->lumaOnly;
 
     switch (pMb->mbType)
     {
@@ -233,6 +238,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         case P_L0_16x16:
             if (MvPrediction16x16(pMb, &pMbLayer->mbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             refImage.data = pMb->refAddr[0];
             tmp = (0<<24) + (0<<16) + (16<<8) + 16;
             h264bsdPredictSamples(data, pMb->mv, &refImage,
@@ -242,6 +248,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         case P_L0_L0_16x8:
             if ( MvPrediction16x8(pMb, &pMbLayer->mbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             refImage.data = pMb->refAddr[0];
             tmp = (0<<24) + (0<<16) + (16<<8) + 8;
             h264bsdPredictSamples(data, pMb->mv, &refImage,
@@ -256,6 +263,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         case P_L0_L0_8x16:
             if ( MvPrediction8x16(pMb, &pMbLayer->mbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             refImage.data = pMb->refAddr[0];
             tmp = (0<<24) + (0<<16) + (8<<8) + 16;
             h264bsdPredictSamples(data, pMb->mv, &refImage,
@@ -269,6 +277,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         default: /* P_8x8 and P_8x8ref0 */
             if ( MvPrediction8x8(pMb, &pMbLayer->subMbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             for (i = 0; i < 4; i++)
             {
                 refImage.data = pMb->refAddr[i];
@@ -383,6 +392,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
 
     refImage.width = currImage->width;
     refImage.height = currImage->height;
+    refImage.lumaOnly = currImage->lumaOnly;
 
     switch (pMb->mbType)
     {
@@ -390,6 +400,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         case P_L0_16x16:
             if (MvPrediction16x16(pMb, &pMbLayer->mbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             refImage.data = pMb->refAddr[0];
             h264bsdPredictSamples(data, pMb->mv, &refImage, col, row, 0, 0,
                 16, 16);
@@ -398,6 +409,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         case P_L0_L0_16x8:
             if ( MvPrediction16x8(pMb, &pMbLayer->mbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             refImage.data = pMb->refAddr[0];
             h264bsdPredictSamples(data, pMb->mv, &refImage, col, row, 0, 0,
                 16, 8);
@@ -409,6 +421,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         case P_L0_L0_8x16:
             if ( MvPrediction8x16(pMb, &pMbLayer->mbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             refImage.data = pMb->refAddr[0];
             h264bsdPredictSamples(data, pMb->mv, &refImage, col, row, 0, 0,
                 8, 16);
@@ -420,6 +433,7 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
         default: /* P_8x8 and P_8x8ref0 */
             if ( MvPrediction8x8(pMb, &pMbLayer->subMbPred, dpb) != HANTRO_OK)
                 return(HANTRO_NOK);
+            WaitRefRows(pMb, dpb, mbNum, currImage);
             for (i = 0; i < 4; i++)
             {
                 refImage.data = pMb->refAddr[i];
@@ -482,6 +496,51 @@ u32 h264bsdInterPrediction(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
 }
 #endif /* H264DEC_OMXDL */
 
+/*------------------------------------------------------------------------------
+
+    Function: WaitRefRows
+
+        Functional description:
+            Wait until the reference pictures of the macroblock are
+            decoded far enough for its prediction when the picture is
+            decoded on a frame thread. The rows needed are the ones reached
+            by the macroblock moved by its largest vertical motion vector,
+            plus the three lines below used by the interpolation.
+
+------------------------------------------------------------------------------*/
+
+void WaitRefRows(mbStorage_t *pMb, dpbStorage_t *dpb, u32 mbNum,
+    image_t *currImage)
+{
+
+/* Variables */
+
+    u32 i, numRows;
+    i32 ver, line;
+
+/* Code */
+
+    if (dpb->framePicture == NULL)
+        return;
+
+    ver = pMb->mv[0].ver;
+    for (i = 1; i < 16; i++)
+        ver = MAX(ver, pMb->mv[i].ver);
+
+    /* last luma line read, motion vectors in quarter samples */
+    line = (i32)(mbNum / currImage->width) * 16 + 15 + (ver >> 2) + 3;
+    if (line < 0)
+        numRows = 1;
+    else
+        numRows = MIN((u32)line / 16 + 1, currImage->height);
+
+    for (i = 0; i < 4; i++)
+        if (i == 0 || pMb->refAddr[i] != pMb->refAddr[i-1])
+            h264bsdWaitFrameRows(dpb->framePicture, pMb->refAddr[i],
+                numRows);
+
+}
+
 /*------------------------------------------------------------------------------
 
     Function: MvPrediction16x16
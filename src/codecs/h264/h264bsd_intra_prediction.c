@@ -62,6 +62,7 @@
 #include "h264bsd_macroblock_layer.h"
 #include "h264bsd_neighbour.h"
 #include "h264bsd_image.h"
+#include "h264bsd_transform.h"
 
 #ifdef H264DEC_OMXDL
 #include "omxtypes.h"
@@ -166,6 +167,7 @@ u8 *get_h264bsdClip() {
 ------------------------------------------------------------------------------*/
 static void Get4x4NeighbourPels(u8 *a, u8 *l, u8 *data, u8 *above, u8 *left,
     u32 blockNum);
+#ifndef H264DEC_SIMD
 static void Intra16x16VerticalPrediction(u8 *data, u8 *above);
 static void Intra16x16HorizontalPrediction(u8 *data, u8 *left);
 static void Intra16x16DcPrediction(u8 *data, u8 *above, u8 *left,
@@ -176,16 +178,36 @@ static void IntraChromaDcPrediction(u8 *data, u8 *above, u8 *left,
 static void IntraChromaHorizontalPrediction(u8 *data, u8 *left);
 static void IntraChromaVerticalPrediction(u8 *data, u8 *above);
 static void IntraChromaPlanePrediction(u8 *data, u8 *above, u8 *left);
+#else
+/* SSE2/NEON versions from h264bsd_intra_prediction_simd.c */
+#define Intra16x16VerticalPrediction    h264bsdIntra16x16VerticalPrediction
+#define Intra16x16HorizontalPrediction  h264bsdIntra16x16HorizontalPrediction
+#define Intra16x16DcPrediction          h264bsdIntra16x16DcPrediction
+#define Intra16x16PlanePrediction       h264bsdIntra16x16PlanePrediction
+#define IntraChromaDcPrediction         h264bsdIntraChromaDcPrediction
+#define IntraChromaHorizontalPrediction h264bsdIntraChromaHorizontalPrediction
+#define IntraChromaVerticalPrediction   h264bsdIntraChromaVerticalPrediction
+#define IntraChromaPlanePrediction      h264bsdIntraChromaPlanePrediction
+#endif /* H264DEC_SIMD */
 
 static void Intra4x4VerticalPrediction(u8 *data, u8 *above);
 static void Intra4x4HorizontalPrediction(u8 *data, u8 *left);
 static void Intra4x4DcPrediction(u8 *data, u8 *above, u8 *left, u32 A, u32 B);
+#ifndef H264DEC_SIMD
 static void Intra4x4DiagonalDownLeftPrediction(u8 *data, u8 *above);
 static void Intra4x4DiagonalDownRightPrediction(u8 *data, u8 *above, u8 *left);
 static void Intra4x4VerticalRightPrediction(u8 *data, u8 *above, u8 *left);
 static void Intra4x4HorizontalDownPrediction(u8 *data, u8 *above, u8 *left);
 static void Intra4x4VerticalLeftPrediction(u8 *data, u8 *above);
 static void Intra4x4HorizontalUpPrediction(u8 *data, u8 *left);
+#else
+#define Intra4x4DiagonalDownLeftPrediction  h264bsdIntra4x4DiagonalDownLeftPrediction
+#define Intra4x4DiagonalDownRightPrediction h264bsdIntra4x4DiagonalDownRightPrediction
+#define Intra4x4VerticalRightPrediction     h264bsdIntra4x4VerticalRightPrediction
+#define Intra4x4HorizontalDownPrediction    h264bsdIntra4x4HorizontalDownPrediction
+#define Intra4x4VerticalLeftPrediction      h264bsdIntra4x4VerticalLeftPrediction
+#define Intra4x4HorizontalUpPrediction      h264bsdIntra4x4HorizontalUpPrediction
+#endif /* H264DEC_SIMD */
 void h264bsdAddResidual(u8 *data, i32 *residual, u32 blockNum);
 
 static void Write4x4To16x16(u8 *data, u8 *data4x4, u32 blockNum);
@@ -498,7 +520,7 @@ u32 h264bsdIntraPrediction(mbStorage_t *pMb, macroblockLayer_t *mbLayer,
     ASSERT(mbNum < image->width * image->height);
     ASSERT(h264bsdMbPartPredMode(pMb->mbType) != PRED_MODE_INTER);
 
-    h264bsdGetNeighbourPels(image, pelAbove, pelLeft, mbNum);
+    h264bsdGetNeighbourPels(image, pelAbove, pelLeft, mbNum, pMb);
 
     if (h264bsdMbPartPredMode(pMb->mbType) == PRED_MODE_INTRA16x16)
     {
@@ -515,11 +537,14 @@ u32 h264bsdIntraPrediction(mbStorage_t *pMb, macroblockLayer_t *mbLayer,
             return(tmp);
     }
 
-    tmp = h264bsdIntraChromaPrediction(pMb, data + 256,
-            mbLayer->residual.level+16, pelAbove + 21, pelLeft + 16,
-            mbLayer->mbPred.intraChromaPredMode, constrainedIntraPred);
-    if (tmp != HANTRO_OK)
-        return(tmp);
+    if (!image->lumaOnly)
+    {
+        tmp = h264bsdIntraChromaPrediction(pMb, data + 256,
+                mbLayer->residual.level+16, pelAbove + 21, pelLeft + 16,
+                mbLayer->mbPred.intraChromaPredMode, constrainedIntraPred);
+        if (tmp != HANTRO_OK)
+            return(tmp);
+    }
 
     /* if decoded flag > 1 -> mb has already been successfully decoded and
      * written to output -> do not write again */
@@ -538,11 +563,13 @@ u32 h264bsdIntraPrediction(mbStorage_t *pMb, macroblockLayer_t *mbLayer,
 
         Functional description:
           Get pixel values from neighbouring macroblocks into 'above'
-          and 'left' arrays.
+          and 'left' arrays. Only macroblocks of the same slice are read,
+          others may be written by another slice thread at the same time.
 
 ------------------------------------------------------------------------------*/
 
-void h264bsdGetNeighbourPels(image_t *image, u8 *above, u8 *left, u32 mbNum)
+void h264bsdGetNeighbourPels(image_t *image, u8 *above, u8 *left, u32 mbNum,
+    mbStorage_t *pMb)
 {
 
 /* Variables */
@@ -551,12 +578,14 @@ void h264bsdGetNeighbourPels(image_t *image, u8 *above, u8 *left, u32 mbNum)
     u32 width, picSize;
     u8 *ptr, *tmp;
     u32 row, col;
+    u32 availableA, availableB, availableC, availableD;
 
 /* Code */
 
     ASSERT(image);
     ASSERT(above);
     ASSERT(left);
+    ASSERT(pMb);
     ASSERT(mbNum < image->width * image->height);
 
     if (!mbNum)
@@ -567,22 +596,31 @@ void h264bsdGetNeighbourPels(image_t *image, u8 *above, u8 *left, u32 mbNum)
     row = mbNum / width;
     col = mbNum - row * width;
 
+    availableA = h264bsdIsNeighbourAvailable(pMb, pMb->mbA);
+    availableB = h264bsdIsNeighbourAvailable(pMb, pMb->mbB);
+    availableC = h264bsdIsNeighbourAvailable(pMb, pMb->mbC);
+    availableD = h264bsdIsNeighbourAvailable(pMb, pMb->mbD);
+
     width *= 16;
     ptr = image->data + row * 16 * width  + col * 16;
 
-    /* note that luma samples above-right to current macroblock do not make
-     * sense when current mb is the right-most mb in a row. Same applies to
-     * sample above-left if col is zero. However, usage of pels in prediction
-     * is controlled by neighbour availability information in actual prediction
-     * process */
+    /* pels of unavailable neighbours are left out, usage of pels in
+     * prediction is controlled by the same availability information */
     if (row)
     {
         tmp = ptr - (width + 1);
-        for (i = 21; i--;)
-            *above++ = *tmp++;
+        if (availableD)
+            above[0] = tmp[0];
+        if (availableB)
+            for (i = 1; i < 17; i++)
+                above[i] = tmp[i];
+        if (availableC)
+            for (i = 17; i < 21; i++)
+                above[i] = tmp[i];
+        above += 21;
     }
 
-    if (col)
+    if (col && availableA)
     {
         ptr--;
         for (i = 16; i--; ptr+=width)
@@ -595,14 +633,20 @@ void h264bsdGetNeighbourPels(image_t *image, u8 *above, u8 *left, u32 mbNum)
     if (row)
     {
         tmp = ptr - (width + 1);
-        for (i = 9; i--;)
-            *above++ = *tmp++;
-        tmp += (picSize * 64) - 9;
-        for (i = 9; i--;)
-            *above++ = *tmp++;
+        if (availableD)
+        {
+            above[0] = tmp[0];
+            above[9] = tmp[picSize * 64];
+        }
+        if (availableB)
+            for (i = 1; i < 9; i++)
+            {
+                above[i] = tmp[i];
+                above[9 + i] = tmp[picSize * 64 + i];
+            }
     }
 
-    if (col)
+    if (col && availableA)
     {
         ptr--;
         for (i = 8; i--; ptr+=width)
@@ -929,12 +973,14 @@ void h264bsdAddResidual(u8 *data, i32 *residual, u32 blockNum)
 
 /* Variables */
 
-    u32 i;
     u32 x, y;
     u32 width;
-    i32 tmp1, tmp2, tmp3, tmp4;
     u8 *tmp;
+#ifndef H264DEC_SIMD
+    u32 i;
+    i32 tmp1, tmp2, tmp3, tmp4;
     const u8 *clp = h264bsdClip + 512;
+#endif
 
 /* Code */
 
@@ -961,6 +1007,9 @@ void h264bsdAddResidual(u8 *data, i32 *residual, u32 blockNum)
     }
 
     tmp = data + y*width + x;
+#ifdef H264DEC_SIMD
+    h264bsdAddResidual4x4(tmp, width, tmp, width, residual);
+#else
     for (i = 4; i; i--)
     {
         tmp1 = *residual++;
@@ -985,9 +1034,11 @@ void h264bsdAddResidual(u8 *data, i32 *residual, u32 blockNum)
 
         tmp += width;
     }
+#endif /* H264DEC_SIMD */
 
 }
 #endif
+#ifndef H264DEC_SIMD
 /*------------------------------------------------------------------------------
 
     Function: Intra16x16VerticalPrediction
@@ -1376,6 +1427,8 @@ void IntraChromaPlanePrediction(u8 *data, u8 *above, u8 *left)
 
 }
 
+#endif /* H264DEC_SIMD */
+
 /*------------------------------------------------------------------------------
 
     Function: Get4x4NeighbourPels
@@ -1600,6 +1653,7 @@ void Intra4x4DcPrediction(u8 *data, u8 *above, u8 *left, u32 availableA,
 
 }
 
+#ifndef H264DEC_SIMD
 /*------------------------------------------------------------------------------
 
     Function: Intra4x4DiagonalDownLeftPrediction
@@ -1829,6 +1883,8 @@ void Intra4x4HorizontalUpPrediction(u8 *data, u8 *left)
 
 }
 
+#endif /* H264DEC_SIMD */
+
 #endif /* H264DEC_OMXDL */
 
 /*------------------------------------------------------------------------------
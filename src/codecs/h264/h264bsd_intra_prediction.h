@@ -34,6 +34,7 @@
 ------------------------------------------------------------------------------*/
 
 #include "basetype.h"
+#include "h264bsd_cfg.h"
 #include "h264bsd_image.h"
 #include "h264bsd_macroblock_layer.h"
 
@@ -61,7 +62,33 @@ u32 h264bsdIntra16x16Prediction(mbStorage_t *pMb, u8 *data, i32 residual[][16],
 u32 h264bsdIntraChromaPrediction(mbStorage_t *pMb, u8 *data, i32 residual[][16],
     u8 *above, u8 *left, u32 predMode, u32 constrainedIntraPred);
 
-void h264bsdGetNeighbourPels(image_t *image, u8 *above, u8 *left, u32 mbNum);
+void h264bsdGetNeighbourPels(image_t *image, u8 *above, u8 *left, u32 mbNum,
+    mbStorage_t *pMb);
+
+#ifdef H264DEC_SIMD
+/* Predictors of h264bsd_intra_prediction_simd.c */
+void h264bsdIntra16x16VerticalPrediction(u8 *data, const u8 *above);
+void h264bsdIntra16x16HorizontalPrediction(u8 *data, const u8 *left);
+void h264bsdIntra16x16DcPrediction(u8 *data, const u8 *above,
+    const u8 *left, u32 availableA, u32 availableB);
+void h264bsdIntra16x16PlanePrediction(u8 *data, const u8 *above,
+    const u8 *left);
+void h264bsdIntraChromaDcPrediction(u8 *data, const u8 *above,
+    const u8 *left, u32 availableA, u32 availableB);
+void h264bsdIntraChromaHorizontalPrediction(u8 *data, const u8 *left);
+void h264bsdIntraChromaVerticalPrediction(u8 *data, const u8 *above);
+void h264bsdIntraChromaPlanePrediction(u8 *data, const u8 *above,
+    const u8 *left);
+void h264bsdIntra4x4DiagonalDownLeftPrediction(u8 *data, const u8 *above);
+void h264bsdIntra4x4DiagonalDownRightPrediction(u8 *data, const u8 *above,
+    const u8 *left);
+void h264bsdIntra4x4VerticalRightPrediction(u8 *data, const u8 *above,
+    const u8 *left);
+void h264bsdIntra4x4HorizontalDownPrediction(u8 *data, const u8 *above,
+    const u8 *left);
+void h264bsdIntra4x4VerticalLeftPrediction(u8 *data, const u8 *above);
+void h264bsdIntra4x4HorizontalUpPrediction(u8 *data, const u8 *left);
+#endif /* H264DEC_SIMD */
 
 #else
 
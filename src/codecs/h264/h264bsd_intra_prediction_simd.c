@@ -0,0 +1,724 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdIntra16x16VerticalPrediction
+          h264bsdIntra16x16HorizontalPrediction
+          h264bsdIntra16x16DcPrediction
+          h264bsdIntra16x16PlanePrediction
+          h264bsdIntraChromaDcPrediction
+          h264bsdIntraChromaHorizontalPrediction
+          h264bsdIntraChromaVerticalPrediction
+          h264bsdIntraChromaPlanePrediction
+          h264bsdIntra4x4DiagonalDownLeftPrediction
+          h264bsdIntra4x4DiagonalDownRightPrediction
+          h264bsdIntra4x4VerticalRightPrediction
+          h264bsdIntra4x4HorizontalDownPrediction
+          h264bsdIntra4x4VerticalLeftPrediction
+          h264bsdIntra4x4HorizontalUpPrediction
+
+--------------------------------------------------------------------------------
+
+    SSE2 and NEON versions of the intra predictors of
+    h264bsd_intra_prediction.c, with the same arguments and the same
+    output. Plane prediction runs in 16-bit lanes, which hold every
+    intermediate value for 8-bit samples. The directional 4x4 modes filter
+    the whole edge at once with byte averages, using
+    (a + 2b + c + 2) >> 2 == avg(floor((a + c) / 2), b), and pick
+    each row out of the filtered edge.
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+#include "h264bsd_intra_prediction.h"
+#include "h264bsd_util.h"
+
+#ifdef H264DEC_SIMD
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <arm_neon.h>
+#endif
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+    H264DEC_SIMD is set in h264bsd_cfg.h when the target has SSE2 or NEON.
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/* Vector helpers, v8 holds 16 unsigned 8-bit lanes and v16 eight signed
+ * 16-bit lanes. Shift() drops the n lowest lanes, Row() returns the four
+ * lowest as a word. */
+#if defined(__SSE2__)
+
+typedef __m128i v8;
+typedef __m128i v16;
+
+#define Shift(a, n)     _mm_srli_si128(a, n)
+#define Row(a)          ((u32)_mm_cvtsi128_si32(a))
+
+static inline v8 Make(uint64_t lo, uint64_t hi)
+{
+    return _mm_set_epi64x((long long)hi, (long long)lo);
+}
+static inline v8 Avg(v8 a, v8 b) { return _mm_avg_epu8(a, b); }
+static inline v8 Filter3(v8 a, v8 b, v8 c)
+{
+    v8 t = _mm_sub_epi8(_mm_avg_epu8(a, c),
+        _mm_and_si128(_mm_xor_si128(a, c), _mm_set1_epi8(1)));
+    return _mm_avg_epu8(t, b);
+}
+/* lanes 0, 1, ... of a and b alternating */
+static inline v8 Interleave(v8 a, v8 b) { return _mm_unpacklo_epi8(a, b); }
+/* lanes 0..7 of a followed by lanes 0..7 of b */
+static inline v8 Join(v8 a, v8 b) { return _mm_unpacklo_epi64(a, b); }
+
+static inline void Fill16(u8 *data, v8 a, u32 rows)
+{
+    for (; rows; rows--, data += 16)
+        _mm_storeu_si128((__m128i*)data, a);
+}
+static inline void Fill8(u8 *data, v8 a, u32 rows)
+{
+    for (; rows; rows--, data += 8)
+        _mm_storel_epi64((__m128i*)data, a);
+}
+static inline v8 Splat(u32 a) { return _mm_set1_epi8((char)a); }
+static inline v8 Load16(const u8 *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline v8 Load8(const u8 *p) { return _mm_loadl_epi64((const __m128i*)p); }
+
+static inline u32 Sum16(const u8 *p)
+{
+    v8 s = _mm_sad_epu8(Load16(p), _mm_setzero_si128());
+    return (u32)(_mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(Shift(s, 8)));
+}
+
+/* a + b * x for x = 0..7 */
+static inline v16 Ramp(i32 a, i32 b)
+{
+    return _mm_add_epi16(_mm_set1_epi16((short)a),
+        _mm_mullo_epi16(_mm_set1_epi16((short)b),
+            _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+static inline v16 Add16(v16 a, i32 b)
+{
+    return _mm_add_epi16(a, _mm_set1_epi16((short)b));
+}
+/* clip(lanes >> 5) of a and b as 16 bytes */
+static inline v8 Pack5(v16 a, v16 b)
+{
+    return _mm_packus_epi16(_mm_srai_epi16(a, 5), _mm_srai_epi16(b, 5));
+}
+
+#else /* NEON */
+
+typedef uint8x16_t v8;
+typedef int16x8_t v16;
+
+#define Shift(a, n)     vextq_u8(a, vdupq_n_u8(0), n)
+#define Row(a)          vgetq_lane_u32(vreinterpretq_u32_u8(a), 0)
+
+static inline v8 Make(uint64_t lo, uint64_t hi)
+{
+    return vcombine_u8(vcreate_u8(lo), vcreate_u8(hi));
+}
+static inline v8 Avg(v8 a, v8 b) { return vrhaddq_u8(a, b); }
+static inline v8 Filter3(v8 a, v8 b, v8 c)
+{
+    return vrhaddq_u8(vhaddq_u8(a, c), b);
+}
+static inline v8 Interleave(v8 a, v8 b) { return vzipq_u8(a, b).val[0]; }
+static inline v8 Join(v8 a, v8 b)
+{
+    return vcombine_u8(vget_low_u8(a), vget_low_u8(b));
+}
+
+static inline void Fill16(u8 *data, v8 a, u32 rows)
+{
+    for (; rows; rows--, data += 16)
+        vst1q_u8(data, a);
+}
+static inline void Fill8(u8 *data, v8 a, u32 rows)
+{
+    for (; rows; rows--, data += 8)
+        vst1_u8(data, vget_low_u8(a));
+}
+static inline v8 Splat(u32 a) { return vdupq_n_u8((u8)a); }
+static inline v8 Load16(const u8 *p) { return vld1q_u8(p); }
+static inline v8 Load8(const u8 *p)
+{
+    return vcombine_u8(vld1_u8(p), vdup_n_u8(0));
+}
+
+static inline u32 Sum16(const u8 *p)
+{
+    uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vld1q_u8(p))));
+    return (u32)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+}
+
+static inline v16 Ramp(i32 a, i32 b)
+{
+    static const i16 x[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    return vmlaq_n_s16(vdupq_n_s16((i16)a), vld1q_s16(x), (i16)b);
+}
+static inline v16 Add16(v16 a, i32 b)
+{
+    return vaddq_s16(a, vdupq_n_s16((i16)b));
+}
+static inline v8 Pack5(v16 a, v16 b)
+{
+    return vcombine_u8(vqshrun_n_s16(a, 5), vqshrun_n_s16(b, 5));
+}
+
+#endif
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static v8 LoadEdge(const u8 *above, const u8 *left);
+static void StoreRows(u8 *data, u32 r0, u32 r1, u32 r2, u32 r3);
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra16x16VerticalPrediction
+
+        Functional description:
+          Perform intra 16x16 vertical prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra16x16VerticalPrediction(u8 *data, const u8 *above)
+{
+
+    ASSERT(data);
+    ASSERT(above);
+
+    Fill16(data, Load16(above), 16);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra16x16HorizontalPrediction
+
+        Functional description:
+          Perform intra 16x16 horizontal prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra16x16HorizontalPrediction(u8 *data, const u8 *left)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(left);
+
+    for (i = 0; i < 16; i++)
+        Fill16(data + 16*i, Splat(left[i]), 1);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra16x16DcPrediction
+
+        Functional description:
+          Perform intra 16x16 DC prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra16x16DcPrediction(u8 *data, const u8 *above,
+    const u8 *left, u32 availableA, u32 availableB)
+{
+
+/* Variables */
+
+    u32 tmp;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+    ASSERT(left);
+
+    if (availableA && availableB)
+        tmp = (Sum16(above) + Sum16(left) + 16) >> 5;
+    else if (availableA)
+        tmp = (Sum16(left) + 8) >> 4;
+    else if (availableB)
+        tmp = (Sum16(above) + 8) >> 4;
+    /* neither A nor B available */
+    else
+        tmp = 128;
+
+    Fill16(data, Splat(tmp), 16);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra16x16PlanePrediction
+
+        Functional description:
+          Perform intra 16x16 plane prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra16x16PlanePrediction(u8 *data, const u8 *above,
+    const u8 *left)
+{
+
+/* Variables */
+
+    i32 i;
+    i32 a, b, c;
+    v16 lo, hi;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+    ASSERT(left);
+
+    a = 16 * (above[15] + left[15]);
+
+    for (i = 0, b = 0; i < 8; i++)
+        b += (i + 1) * (above[8+i] - above[6-i]);
+    b = (5 * b + 32) >> 6;
+
+    for (i = 0, c = 0; i < 7; i++)
+        c += (i + 1) * (left[8+i] - left[6-i]);
+    /* p[-1,-1] has to be accessed through above pointer */
+    c += (i + 1) * (left[8+i] - above[-1]);
+    c = (5 * c + 32) >> 6;
+
+    /* a + b * (x - 7) + c * (y - 7) + 16 for x = 0..15, one row per pass */
+    lo = Ramp(a - 7 * b - 7 * c + 16, b);
+    hi = Add16(lo, 8 * b);
+    for (i = 16; i--; data += 16)
+    {
+        Fill16(data, Pack5(lo, hi), 1);
+        lo = Add16(lo, c);
+        hi = Add16(hi, c);
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntraChromaDcPrediction
+
+        Functional description:
+          Perform intra chroma DC prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntraChromaDcPrediction(u8 *data, const u8 *above,
+    const u8 *left, u32 availableA, u32 availableB)
+{
+
+/* Variables */
+
+    u32 a0, a1, l0, l1;
+    u32 tmp1, tmp2, tmp3, tmp4;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+    ASSERT(left);
+
+    a0 = above[0] + above[1] + above[2] + above[3];
+    a1 = above[4] + above[5] + above[6] + above[7];
+    l0 = left[0] + left[1] + left[2] + left[3];
+    l1 = left[4] + left[5] + left[6] + left[7];
+
+    /* tmp1, tmp2 for y = 0..3 and tmp3, tmp4 for y = 4..7 */
+    if (availableA && availableB)
+    {
+        tmp1 = (a0 + l0 + 4) >> 3;
+        tmp2 = (a1 + 2) >> 2;
+        tmp3 = (l1 + 2) >> 2;
+        tmp4 = (a1 + l1 + 4) >> 3;
+    }
+    else if (availableB)
+    {
+        tmp1 = tmp3 = (a0 + 2) >> 2;
+        tmp2 = tmp4 = (a1 + 2) >> 2;
+    }
+    else if (availableA)
+    {
+        tmp1 = tmp2 = (l0 + 2) >> 2;
+        tmp3 = tmp4 = (l1 + 2) >> 2;
+    }
+    /* neither A nor B available */
+    else
+    {
+        tmp1 = tmp2 = tmp3 = tmp4 = 128;
+    }
+
+    ASSERT(tmp1 < 256 && tmp2 < 256 && tmp3 < 256 && tmp4 < 256);
+    Fill8(data, Make(tmp1 * 0x01010101U | (uint64_t)(tmp2 * 0x01010101U) << 32,
+        0), 4);
+    Fill8(data + 32, Make(tmp3 * 0x01010101U |
+        (uint64_t)(tmp4 * 0x01010101U) << 32, 0), 4);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntraChromaHorizontalPrediction
+
+        Functional description:
+          Perform intra chroma horizontal prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntraChromaHorizontalPrediction(u8 *data, const u8 *left)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(left);
+
+    for (i = 0; i < 8; i++)
+        Fill8(data + 8*i, Splat(left[i]), 1);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntraChromaVerticalPrediction
+
+        Functional description:
+          Perform intra chroma vertical prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntraChromaVerticalPrediction(u8 *data, const u8 *above)
+{
+
+    ASSERT(data);
+    ASSERT(above);
+
+    Fill8(data, Load8(above), 8);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntraChromaPlanePrediction
+
+        Functional description:
+          Perform intra chroma plane prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntraChromaPlanePrediction(u8 *data, const u8 *above,
+    const u8 *left)
+{
+
+/* Variables */
+
+    u32 i;
+    i32 a, b, c;
+    v16 row;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+    ASSERT(left);
+
+    a = 16 * (above[7] + left[7]);
+
+    b = (above[4] - above[2]) + 2 * (above[5] - above[1])
+        + 3 * (above[6] - above[0]) + 4 * (above[7] - above[-1]);
+    b = (17 * b + 16) >> 5;
+
+    /* p[-1,-1] has to be accessed through above pointer */
+    c = (left[4] - left[2]) + 2 * (left[5] - left[1])
+        + 3 * (left[6] - left[0]) + 4 * (left[7] - above[-1]);
+    c = (17 * c + 16) >> 5;
+
+    /* a + b * (x - 3) + c * (y - 3) + 16 for x = 0..7, two rows per pass */
+    row = Ramp(a - 3 * b - 3 * c + 16, b);
+    for (i = 4; i--; data += 16)
+    {
+        Fill16(data, Pack5(row, Add16(row, c)), 1);
+        row = Add16(row, 2 * c);
+    }
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra4x4DiagonalDownLeftPrediction
+
+        Functional description:
+          Perform intra 4x4 diagonal down-left prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra4x4DiagonalDownLeftPrediction(u8 *data, const u8 *above)
+{
+
+/* Variables */
+
+    uint64_t tmp;
+    v8 e, f;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+
+    /* p[7,-1] repeated past the end gives (p[6,-1] + 3p[7,-1] + 2) >> 2
+     * for the last sample */
+    memcpy(&tmp, above, 8);
+    e = Make(tmp, above[7] * 0x0101010101010101ULL);
+    f = Filter3(e, Shift(e, 1), Shift(e, 2));
+
+    StoreRows(data, Row(f), Row(Shift(f, 1)), Row(Shift(f, 2)),
+        Row(Shift(f, 3)));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra4x4DiagonalDownRightPrediction
+
+        Functional description:
+          Perform intra 4x4 diagonal down-right prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra4x4DiagonalDownRightPrediction(u8 *data, const u8 *above,
+    const u8 *left)
+{
+
+/* Variables */
+
+    v8 e, f;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+    ASSERT(left);
+
+    e = LoadEdge(above, left);
+    f = Filter3(e, Shift(e, 1), Shift(e, 2));
+
+    StoreRows(data, Row(Shift(f, 3)), Row(Shift(f, 2)), Row(Shift(f, 1)),
+        Row(f));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra4x4VerticalRightPrediction
+
+        Functional description:
+          Perform intra 4x4 vertical right prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra4x4VerticalRightPrediction(u8 *data, const u8 *above,
+    const u8 *left)
+{
+
+/* Variables */
+
+    u32 r0, r1;
+    v8 e, f, h;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+    ASSERT(left);
+
+    e = LoadEdge(above, left);
+    h = Avg(e, Shift(e, 1));
+    f = Filter3(e, Shift(e, 1), Shift(e, 2));
+
+    /* rows 2 and 3 are rows 0 and 1 moved right by one sample */
+    r0 = Row(Shift(h, 4));
+    r1 = Row(Shift(f, 3));
+    StoreRows(data, r0, r1, (r0 << 8) | (Row(Shift(f, 2)) & 0xFF),
+        (r1 << 8) | (Row(Shift(f, 1)) & 0xFF));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra4x4HorizontalDownPrediction
+
+        Functional description:
+          Perform intra 4x4 horizontal down prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra4x4HorizontalDownPrediction(u8 *data, const u8 *above,
+    const u8 *left)
+{
+
+/* Variables */
+
+    v8 e, f, h, s;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+    ASSERT(left);
+
+    e = LoadEdge(above, left);
+    h = Avg(e, Shift(e, 1));
+    f = Filter3(e, Shift(e, 1), Shift(e, 2));
+
+    /* samples from bottom-left to top-right, each row starts two later */
+    s = Join(Interleave(h, f), Shift(f, 4));
+
+    StoreRows(data, Row(Shift(s, 6)), Row(Shift(s, 4)), Row(Shift(s, 2)),
+        Row(s));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra4x4VerticalLeftPrediction
+
+        Functional description:
+          Perform intra 4x4 vertical left prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra4x4VerticalLeftPrediction(u8 *data, const u8 *above)
+{
+
+/* Variables */
+
+    v8 e, f, h;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(above);
+
+    e = Load8(above);
+    h = Avg(e, Shift(e, 1));
+    f = Filter3(e, Shift(e, 1), Shift(e, 2));
+
+    StoreRows(data, Row(h), Row(f), Row(Shift(h, 1)), Row(Shift(f, 1)));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIntra4x4HorizontalUpPrediction
+
+        Functional description:
+          Perform intra 4x4 horizontal up prediction mode.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdIntra4x4HorizontalUpPrediction(u8 *data, const u8 *left)
+{
+
+/* Variables */
+
+    u32 tmp;
+    v8 e, s;
+
+/* Code */
+
+    ASSERT(data);
+    ASSERT(left);
+
+    /* p[-1,3] repeated past the end fills the bottom-right samples */
+    memcpy(&tmp, left, 4);
+    e = Make(tmp | (uint64_t)(left[3] * 0x01010101U) << 32, 0);
+    s = Interleave(Avg(e, Shift(e, 1)), Filter3(e, Shift(e, 1), Shift(e, 2)));
+
+    StoreRows(data, Row(s), Row(Shift(s, 2)), Row(Shift(s, 4)),
+        Row(Shift(s, 6)));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: LoadEdge
+
+        Functional description:
+          Neighbour samples of a 4x4 block from bottom-left to top-right:
+          p[-1,3..0], p[-1,-1] and p[0..6,-1] in lanes 0..11.
+
+------------------------------------------------------------------------------*/
+
+v8 LoadEdge(const u8 *above, const u8 *left)
+{
+
+/* Variables */
+
+    u32 l;
+    uint64_t a;
+
+/* Code */
+
+    l = (u32)left[3] | (u32)left[2] << 8 | (u32)left[1] << 16 |
+        (u32)left[0] << 24;
+    memcpy(&a, above - 1, 8);
+
+    return Make(l | a << 32, a >> 32);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: StoreRows
+
+        Functional description:
+          Store four rows of a 4x4 block, the lowest byte of each word
+          being the leftmost sample.
+
+------------------------------------------------------------------------------*/
+
+void StoreRows(u8 *data, u32 r0, u32 r1, u32 r2, u32 r3)
+{
+    memcpy(data, &r0, 4);
+    memcpy(data + 4, &r1, 4);
+    memcpy(data + 8, &r2, 4);
+    memcpy(data + 12, &r3, 4);
+}
+
+#endif /* H264DEC_SIMD */
@@ -54,6 +54,7 @@
 #include "h264bsd_transform.h"
 #include "h264bsd_intra_prediction.h"
 #include "h264bsd_inter_prediction.h"
+#include "h264bsd_profile.h"
 
 #ifdef H264DEC_OMXDL
 #include "omxtypes.h"
@@ -106,7 +107,8 @@ static u32 ProcessIntra16x16Residual(mbStorage_t *pMb, u8 *data, u32 constrained
 
 
 #else
-static u32 ProcessResidual(mbStorage_t *pMb, i32 residualLevel[][16], u32 *);
+static u32 ProcessResidual(mbStorage_t *pMb, i32 residualLevel[][16], u32 *,
+    u32 lumaOnly);
 #endif
 
 /*------------------------------------------------------------------------------
@@ -974,6 +976,7 @@ u32 h264bsdDecodeMacroblock(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
 #ifdef H264DEC_OMXDL
     const u8 *pSrc;
 #endif
+    PROFILE_VARIABLES
 /* Code */
 
     ASSERT(pMb);
@@ -1093,8 +1096,10 @@ u32 h264bsdDecodeMacroblock(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
             tmp = ProcessChromaResidual(pMb, data, &pSrc);
 
 #else
+            PROFILE_START;
             tmp = ProcessResidual(pMb, pMbLayer->residual.level,
-                pMbLayer->residual.coeffMap);
+                pMbLayer->residual.coeffMap, currImage->lumaOnly);
+            PROFILE_END(PROFILE_TRANSFORM);
 #endif
             if (tmp != HANTRO_OK)
                 return (tmp);
@@ -1114,14 +1119,18 @@ u32 h264bsdDecodeMacroblock(mbStorage_t *pMb, macroblockLayer_t *pMbLayer,
 #else
         if (h264bsdMbPartPredMode(mbType) != PRED_MODE_INTER)
         {
+            PROFILE_START;
             tmp = h264bsdIntraPrediction(pMb, pMbLayer, currImage, mbNum,
                 constrainedIntraPredFlag, (u8*)data);
+            PROFILE_END(PROFILE_INTRA);
             if (tmp != HANTRO_OK) return (tmp);
         }
         else
         {
+            PROFILE_START;
             tmp = h264bsdInterPrediction(pMb, pMbLayer, dpb, mbNum,
                 currImage, (u8*)data);
+            PROFILE_END(PROFILE_INTER);
             if (tmp != HANTRO_OK) return (tmp);
         }
 #endif
@@ -1337,7 +1346,8 @@ u32 ProcessIntra4x4Residual(mbStorage_t *pMb,
 
 ------------------------------------------------------------------------------*/
 
-u32 ProcessResidual(mbStorage_t *pMb, i32 residualLevel[][16], u32 *coeffMap)
+u32 ProcessResidual(mbStorage_t *pMb, i32 residualLevel[][16], u32 *coeffMap,
+    u32 lumaOnly)
 {
 
 /* Variables */
@@ -1397,6 +1407,10 @@ u32 ProcessResidual(mbStorage_t *pMb, i32 residualLevel[][16], u32 *coeffMap)
         }
     }
 
+    /* chroma not reconstructed */
+    if (lumaOnly)
+        return(HANTRO_OK);
+
     /* chroma DC processing. First chroma dc block is block with index 25 */
     chromaQp =
         h264bsdQpC[CLIP3(0, 51, (i32)pMb->qpY + pMb->chromaQpIndexOffset)];
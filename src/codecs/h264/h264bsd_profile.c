@@ -0,0 +1,149 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdProfileTime
+          h264bsdProfileAdd
+          h264bsdProfileGet
+          h264bsdProfileReset
+
+--------------------------------------------------------------------------------
+
+    Time spent in the decoding stages, for benchmarking. The times of all
+    threads decoding slices or pictures are added up, so with threads the
+    sum may exceed the wall clock time. Reading the clock twice per stage
+    and macroblock costs a few percent of the decoding time, which is why
+    the timing is only compiled in with H264DEC_PROFILE and only done while
+    h264bsdProfiling is set.
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "h264bsd_profile.h"
+
+#ifdef H264DEC_PROFILE
+
+#include <time.h>
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+volatile u32 h264bsdProfiling = 0;
+
+/* nanoseconds per stage, added to atomically */
+static uint64_t stageTime[PROFILE_NUM_STAGES];
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdProfileTime
+
+        Functional description:
+            Monotonic clock in nanoseconds.
+
+------------------------------------------------------------------------------*/
+
+uint64_t h264bsdProfileTime(void)
+{
+
+/* Variables */
+
+    struct timespec ts;
+
+/* Code */
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdProfileAdd
+
+        Functional description:
+            Add the time since start to a stage.
+
+        Inputs:
+            stage       PROFILE_* stage
+            start       h264bsdProfileTime() at the start of the stage
+
+------------------------------------------------------------------------------*/
+
+void h264bsdProfileAdd(u32 stage, uint64_t start)
+{
+
+/* Code */
+
+    if (stage < PROFILE_NUM_STAGES)
+        __atomic_fetch_add(&stageTime[stage], h264bsdProfileTime() - start,
+            __ATOMIC_RELAXED);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdProfileGet
+
+        Functional description:
+            Read the times of all stages.
+
+        Outputs:
+            stageNs     PROFILE_NUM_STAGES times in nanoseconds
+
+------------------------------------------------------------------------------*/
+
+void h264bsdProfileGet(uint64_t *stageNs)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    for (i = 0; i < PROFILE_NUM_STAGES; i++)
+        stageNs[i] = __atomic_load_n(&stageTime[i], __ATOMIC_RELAXED);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdProfileReset
+
+        Functional description:
+            Set the times of all stages to zero.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdProfileReset(void)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    for (i = 0; i < PROFILE_NUM_STAGES; i++)
+        __atomic_store_n(&stageTime[i], 0, __ATOMIC_RELAXED);
+
+}
+
+#endif /* H264DEC_PROFILE */
@@ -0,0 +1,67 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+    1. Include headers
+    2. Module defines
+    3. Data types
+    4. Function prototypes
+
+------------------------------------------------------------------------------*/
+
+#ifndef H264SWDEC_PROFILE_H
+#define H264SWDEC_PROFILE_H
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include "basetype.h"
+
+/*------------------------------------------------------------------------------
+    2. Module defines
+------------------------------------------------------------------------------*/
+
+/* decoding stages timed when compiled with H264DEC_PROFILE */
+#define PROFILE_PARSE       0   /* macroblock layer, CAVLC */
+#define PROFILE_TRANSFORM   1   /* inverse quantization and transform */
+#define PROFILE_INTRA       2   /* intra prediction and reconstruction */
+#define PROFILE_INTER       3   /* inter prediction and reconstruction */
+#define PROFILE_DEBLOCK     4   /* deblocking filter */
+#define PROFILE_NUM_STAGES  5
+
+/* PROFILE_VARIABLES goes with the variables of a function, PROFILE_START
+ * and PROFILE_END(stage) around the code timed. Nothing is timed unless
+ * h264bsdProfiling is set, and nothing is compiled in without
+ * H264DEC_PROFILE. */
+#ifdef H264DEC_PROFILE
+#define PROFILE_VARIABLES uint64_t profileStart = 0;
+#define PROFILE_START \
+    if (h264bsdProfiling) profileStart = h264bsdProfileTime()
+#define PROFILE_END(stage) \
+    if (h264bsdProfiling) h264bsdProfileAdd(stage, profileStart)
+#else
+#define PROFILE_VARIABLES
+#define PROFILE_START
+#define PROFILE_END(stage)
+#endif
+
+/*------------------------------------------------------------------------------
+    3. Data types
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    4. Function prototypes
+------------------------------------------------------------------------------*/
+
+#ifdef H264DEC_PROFILE
+extern volatile u32 h264bsdProfiling;
+
+uint64_t h264bsdProfileTime(void);
+void h264bsdProfileAdd(u32 stage, uint64_t start);
+void h264bsdProfileGet(uint64_t *stageNs);
+void h264bsdProfileReset(void);
+#endif
+
+#endif /* #ifdef H264SWDEC_PROFILE_H */
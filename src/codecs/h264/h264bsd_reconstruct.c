@@ -83,6 +83,8 @@ extern const u8 h264bsdClip[];
 
 #ifndef H264DEC_OMXDL
 
+#ifndef H264DEC_SIMD
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdInterpolateChromaHor
@@ -402,6 +404,8 @@ void h264bsdInterpolateChromaHorVer(
 
 }
 
+#endif /* H264DEC_SIMD */
+
 /*------------------------------------------------------------------------------
 
     Function: PredictChroma
@@ -475,6 +479,7 @@ static void PredictChroma(
 }
 
 
+#ifndef H264DEC_SIMD
 /*------------------------------------------------------------------------------
 
     Function: h264bsdInterpolateVerHalf
@@ -1790,6 +1795,8 @@ void h264bsdInterpolateMidHorQuarter(
 }
 
 
+#endif /* H264DEC_SIMD */
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdPredictSamples
@@ -1928,14 +1935,15 @@ void h264bsdPredictSamples(
     }
 
     /* chroma */
-    PredictChroma(
-      data + 16*16 + (partY>>1)*8 + (partX>>1),
-      xA + partX,
-      yA + partY,
-      partWidth,
-      partHeight,
-      mv,
-      refPic);
+    if (!refPic->lumaOnly)
+        PredictChroma(
+          data + 16*16 + (partY>>1)*8 + (partX>>1),
+          xA + partX,
+          yA + partY,
+          partWidth,
+          partHeight,
+          mv,
+          refPic);
 
 }
 
@@ -2120,6 +2128,8 @@ void h264bsdPredictSamples(
 #endif /* H264DEC_OMXDL */
 
 
+#ifndef H264DEC_SIMD
+
 /*------------------------------------------------------------------------------
 
     Function: FillRow1
@@ -2366,6 +2376,8 @@ void h264bsdFillBlock(
     }
 }
 
+#endif /* H264DEC_SIMD */
+
 /*lint +e701 +e702 */
 
 
@@ -34,6 +34,7 @@
 ------------------------------------------------------------------------------*/
 
 #include "basetype.h"
+#include "h264bsd_cfg.h"
 #include "h264bsd_macroblock_layer.h"
 #include "h264bsd_image.h"
 
@@ -0,0 +1,952 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+
+--------------------------------------------------------------------------------
+
+    SSE2 and NEON versions of the motion compensation kernels of
+    h264bsd_reconstruct.c: luma 6-tap and chroma bilinear interpolation and
+    reference block fetching with edge extension. The C versions there stay
+    the reference; both give bit-exact results.
+
+    Luma positions are built the way the standard defines them: half samples
+    b, h and j from the 6-tap filter, quarter samples as the rounded average
+    of the two nearest integer or half samples.
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+#include "h264bsd_reconstruct.h"
+#include "h264bsd_util.h"
+
+#ifdef H264DEC_SIMD
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <arm_neon.h>
+#endif
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+    H264DEC_SIMD is set in h264bsd_cfg.h when the target has SSE2
+    or NEON; define H264DEC_NO_SIMD to build the C versions instead.
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/* Largest reference area a luma partition reads: (16+5) x (16+5) */
+#define FILL_SIZE (21*21)
+
+/* Vector helpers. v16 holds eight signed 16-bit lanes. Loads widen 4 or 8
+ * samples, stores narrow with unsigned saturation (the clip to 0..255). */
+#if defined(__SSE2__)
+
+typedef __m128i v16;
+
+static inline v16 Load8(const u8 *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p),
+        _mm_setzero_si128());
+}
+
+static inline v16 Load4(const u8 *p)
+{
+    u32 w;
+    memcpy(&w, p, 4);
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128((i32)w), _mm_setzero_si128());
+}
+
+static inline void Store8(u8 *p, v16 a)
+{
+    _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(a, a));
+}
+
+static inline void Store4(u8 *p, v16 a)
+{
+    u32 w = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(a, a));
+    memcpy(p, &w, 4);
+}
+
+static inline v16 LoadS16(const i16 *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void StoreS16(i16 *p, v16 a) { _mm_storeu_si128((__m128i*)p, a); }
+static inline v16 Add(v16 a, v16 b) { return _mm_add_epi16(a, b); }
+
+/* (a+f) - 5(b+e) + 20(c+d), given the three pair sums */
+static inline v16 Tap6(v16 af, v16 be, v16 cd)
+{
+    return _mm_add_epi16(_mm_add_epi16(af, _mm_mullo_epi16(cd, _mm_set1_epi16(20))),
+        _mm_mullo_epi16(be, _mm_set1_epi16(-5)));
+}
+
+/* (x + 16) >> 5 */
+static inline v16 Round5(v16 x)
+{
+    return _mm_srai_epi16(_mm_add_epi16(x, _mm_set1_epi16(16)), 5);
+}
+
+/* Second 6-tap pass over 16-bit intermediates: the sum needs 32 bits.
+ * (af - 5be + 20cd + 512) >> 10, saturated to 16 bits */
+static inline v16 Tap6Round10(v16 af, v16 be, v16 cd)
+{
+    const v16 k1_20 = _mm_set_epi16(20, 1, 20, 1, 20, 1, 20, 1);
+    const v16 km5_1 = _mm_set_epi16(1, -5, 1, -5, 1, -5, 1, -5);
+    const v16 c512 = _mm_set1_epi16(512);
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(af, cd), k1_20),
+        _mm_madd_epi16(_mm_unpacklo_epi16(be, c512), km5_1));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(af, cd), k1_20),
+        _mm_madd_epi16(_mm_unpackhi_epi16(be, c512), km5_1));
+    return _mm_packs_epi32(_mm_srai_epi32(lo, 10), _mm_srai_epi32(hi, 10));
+}
+
+/* Chroma: weighted sums, then (s + 32) >> 6 */
+static inline v16 Mul(v16 a, i32 w)
+{
+    return _mm_mullo_epi16(a, _mm_set1_epi16((i16)w));
+}
+
+static inline v16 MulAdd(v16 acc, v16 a, i32 w)
+{
+    return _mm_add_epi16(acc, _mm_mullo_epi16(a, _mm_set1_epi16((i16)w)));
+}
+
+static inline v16 Shift6(v16 s)
+{
+    return _mm_srli_epi16(_mm_add_epi16(s, _mm_set1_epi16(32)), 6);
+}
+
+/* dst = (dst + src + 1) >> 1 */
+static inline void Avg16(u8 *dst, const u8 *src)
+{
+    _mm_storeu_si128((__m128i*)dst, _mm_avg_epu8(
+        _mm_loadu_si128((const __m128i*)dst), _mm_loadu_si128((const __m128i*)src)));
+}
+
+static inline void Avg8(u8 *dst, const u8 *src)
+{
+    _mm_storel_epi64((__m128i*)dst, _mm_avg_epu8(
+        _mm_loadl_epi64((const __m128i*)dst), _mm_loadl_epi64((const __m128i*)src)));
+}
+
+static inline void Copy16(u8 *dst, const u8 *src)
+{
+    _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+}
+
+#else /* NEON */
+
+typedef int16x8_t v16;
+
+static inline v16 Load8(const u8 *p)
+{
+    return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)));
+}
+
+static inline v16 Load4(const u8 *p)
+{
+    u32 w;
+    memcpy(&w, p, 4);
+    return vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(w))));
+}
+
+static inline void Store8(u8 *p, v16 a)
+{
+    vst1_u8(p, vqmovun_s16(a));
+}
+
+static inline void Store4(u8 *p, v16 a)
+{
+    u32 w = vget_lane_u32(vreinterpret_u32_u8(vqmovun_s16(a)), 0);
+    memcpy(p, &w, 4);
+}
+
+static inline v16 LoadS16(const i16 *p) { return vld1q_s16(p); }
+static inline void StoreS16(i16 *p, v16 a) { vst1q_s16(p, a); }
+static inline v16 Add(v16 a, v16 b) { return vaddq_s16(a, b); }
+
+static inline v16 Tap6(v16 af, v16 be, v16 cd)
+{
+    return vmlaq_n_s16(vmlaq_n_s16(af, cd, 20), be, -5);
+}
+
+static inline v16 Round5(v16 x)
+{
+    return vrshrq_n_s16(x, 5);
+}
+
+static inline v16 Tap6Round10(v16 af, v16 be, v16 cd)
+{
+    int32x4_t lo = vmovl_s16(vget_low_s16(af));
+    int32x4_t hi = vmovl_s16(vget_high_s16(af));
+    lo = vmlal_n_s16(lo, vget_low_s16(cd), 20);
+    hi = vmlal_n_s16(hi, vget_high_s16(cd), 20);
+    lo = vmlsl_n_s16(lo, vget_low_s16(be), 5);
+    hi = vmlsl_n_s16(hi, vget_high_s16(be), 5);
+    return vcombine_s16(vqrshrn_n_s32(lo, 10), vqrshrn_n_s32(hi, 10));
+}
+
+static inline v16 Mul(v16 a, i32 w)
+{
+    return vmulq_n_s16(a, (i16)w);
+}
+
+static inline v16 MulAdd(v16 acc, v16 a, i32 w)
+{
+    return vmlaq_n_s16(acc, a, (i16)w);
+}
+
+static inline v16 Shift6(v16 s)
+{
+    return vreinterpretq_s16_u16(vrshrq_n_u16(vreinterpretq_u16_s16(s), 6));
+}
+
+static inline void Avg16(u8 *dst, const u8 *src)
+{
+    vst1q_u8(dst, vrhaddq_u8(vld1q_u8(dst), vld1q_u8(src)));
+}
+
+static inline void Avg8(u8 *dst, const u8 *src)
+{
+    vst1_u8(dst, vrhadd_u8(vld1_u8(dst), vld1_u8(src)));
+}
+
+static inline void Copy16(u8 *dst, const u8 *src)
+{
+    vst1q_u8(dst, vld1q_u8(src));
+}
+
+#endif
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static const u8 *RefBlock(u8 *ref, u8 *fill, i32 x0, i32 y0, u32 *width,
+    u32 height, u32 blockWidth, u32 blockHeight);
+static void HalfHor(const u8 *ref, u32 width, u8 *mb, u32 partWidth,
+    u32 partHeight);
+static void HalfVer(const u8 *ref, u32 width, u8 *mb, u32 partWidth,
+    u32 partHeight);
+static void HalfMid(const u8 *ref, u32 width, u8 *mb, u32 partWidth,
+    u32 partHeight, i16 *table);
+static void AvgBlock(u8 *mb, const u8 *src, u32 srcStride, u32 partWidth,
+    u32 partHeight);
+static void PredictChromaBlock(const u8 *ref, u32 width, u32 height,
+    u8 *predPartChroma, u32 xFrac, u32 yFrac, u32 chromaPartWidth,
+    u32 chromaPartHeight);
+
+/*------------------------------------------------------------------------------
+    5. Functions
+------------------------------------------------------------------------------*/
+
+/* Point at the blockWidth x blockHeight reference area at (x0, y0), first
+ * copying it with edge extension into `fill` if it is not inside the
+ * picture. *width becomes the line length of the area returned. */
+static const u8 *RefBlock(u8 *ref, u8 *fill, i32 x0, i32 y0, u32 *width,
+    u32 height, u32 blockWidth, u32 blockHeight)
+{
+    if ((x0 < 0) || ((u32)x0+blockWidth > *width) ||
+        (y0 < 0) || ((u32)y0+blockHeight > height))
+    {
+        h264bsdFillBlock(ref, fill, x0, y0, *width, height,
+            blockWidth, blockHeight, blockWidth);
+        *width = blockWidth;
+        return fill;
+    }
+    return ref + (u32)y0 * *width + (u32)x0;
+}
+
+/* Horizontal half sample 'b'; ref is the leftmost filter tap */
+static void HalfHor(const u8 *ref, u32 width, u8 *mb, u32 partWidth,
+    u32 partHeight)
+{
+    u32 x, y;
+    v16 af, be, cd;
+
+    for (y = partHeight; y; y--)
+    {
+        if (partWidth == 4)
+        {
+            af = Add(Load4(ref), Load4(ref + 5));
+            be = Add(Load4(ref + 1), Load4(ref + 4));
+            cd = Add(Load4(ref + 2), Load4(ref + 3));
+            Store4(mb, Round5(Tap6(af, be, cd)));
+        }
+        else
+        {
+            for (x = 0; x < partWidth; x += 8)
+            {
+                af = Add(Load8(ref + x), Load8(ref + x + 5));
+                be = Add(Load8(ref + x + 1), Load8(ref + x + 4));
+                cd = Add(Load8(ref + x + 2), Load8(ref + x + 3));
+                Store8(mb + x, Round5(Tap6(af, be, cd)));
+            }
+        }
+        ref += width;
+        mb += 16;
+    }
+}
+
+/* Vertical half sample 'h'; ref is the topmost filter tap */
+static void HalfVer(const u8 *ref, u32 width, u8 *mb, u32 partWidth,
+    u32 partHeight)
+{
+    u32 x, y;
+    v16 af, be, cd;
+
+    for (y = partHeight; y; y--)
+    {
+        for (x = 0; x < partWidth; x += 8)
+        {
+            const u8 *p = ref + x;
+            if (partWidth == 4)
+            {
+                af = Add(Load4(p), Load4(p + 5*width));
+                be = Add(Load4(p + width), Load4(p + 4*width));
+                cd = Add(Load4(p + 2*width), Load4(p + 3*width));
+                Store4(mb, Round5(Tap6(af, be, cd)));
+            }
+            else
+            {
+                af = Add(Load8(p), Load8(p + 5*width));
+                be = Add(Load8(p + width), Load8(p + 4*width));
+                cd = Add(Load8(p + 2*width), Load8(p + 3*width));
+                Store8(mb + x, Round5(Tap6(af, be, cd)));
+            }
+        }
+        ref += width;
+        mb += 16;
+    }
+}
+
+/* Centre half sample 'j'; ref is the top-left filter tap. The unrounded
+ * horizontal sums of the partHeight+5 rows are left in table (16 per row)
+ * for the callers that also need 'b'. */
+static void HalfMid(const u8 *ref, u32 width, u8 *mb, u32 partWidth,
+    u32 partHeight, i16 *table)
+{
+    u32 x, y;
+    v16 af, be, cd;
+    i16 *t;
+
+    /* First step: horizontal 6-tap, kept at full precision */
+    t = table;
+    for (y = partHeight + 5; y; y--)
+    {
+        for (x = 0; x < partWidth; x += 8)
+        {
+            if (partWidth == 4)
+            {
+                af = Add(Load4(ref), Load4(ref + 5));
+                be = Add(Load4(ref + 1), Load4(ref + 4));
+                cd = Add(Load4(ref + 2), Load4(ref + 3));
+            }
+            else
+            {
+                af = Add(Load8(ref + x), Load8(ref + x + 5));
+                be = Add(Load8(ref + x + 1), Load8(ref + x + 4));
+                cd = Add(Load8(ref + x + 2), Load8(ref + x + 3));
+            }
+            StoreS16(t + x, Tap6(af, be, cd));
+        }
+        ref += width;
+        t += 16;
+    }
+
+    /* Second step: vertical 6-tap over the intermediates */
+    t = table;
+    for (y = partHeight; y; y--)
+    {
+        for (x = 0; x < partWidth; x += 8)
+        {
+            const i16 *p = t + x;
+            v16 r;
+            af = Add(LoadS16(p), LoadS16(p + 5*16));
+            be = Add(LoadS16(p + 16), LoadS16(p + 4*16));
+            cd = Add(LoadS16(p + 2*16), LoadS16(p + 3*16));
+            r = Tap6Round10(af, be, cd);
+            if (partWidth == 4)
+                Store4(mb, r);
+            else
+                Store8(mb + x, r);
+        }
+        t += 16;
+        mb += 16;
+    }
+}
+
+/* mb = (mb + src + 1) >> 1 over the partition */
+static void AvgBlock(u8 *mb, const u8 *src, u32 srcStride, u32 partWidth,
+    u32 partHeight)
+{
+    u32 y;
+    u32 a, b;
+
+    for (y = partHeight; y; y--)
+    {
+        if (partWidth == 16)
+            Avg16(mb, src);
+        else if (partWidth == 8)
+            Avg8(mb, src);
+        else
+        {
+            memcpy(&a, mb, 4);
+            memcpy(&b, src, 4);
+            /* per-byte rounded average */
+            a = (a | b) - (((a ^ b) >> 1) & 0x7F7F7F7F);
+            memcpy(mb, &a, 4);
+        }
+        mb += 16;
+        src += srcStride;
+    }
+}
+
+/*------------------------------------------------------------------------------
+
+    Luma interpolation. Arguments and reference positions are those of the
+    C versions in h264bsd_reconstruct.c.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInterpolateVerHalf(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight)
+{
+    u8 fill[FILL_SIZE];
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth, partHeight+5);
+    HalfVer(p, width, mb, partWidth, partHeight);
+}
+
+void h264bsdInterpolateVerQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 verOffset)    /* 0 for pixel d, 1 for pixel n */
+{
+    u8 fill[FILL_SIZE];
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth, partHeight+5);
+    HalfVer(p, width, mb, partWidth, partHeight);
+    AvgBlock(mb, p + (2+verOffset)*width, width, partWidth, partHeight);
+}
+
+void h264bsdInterpolateHorHalf(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight)
+{
+    u8 fill[FILL_SIZE];
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth+5, partHeight);
+    HalfHor(p, width, mb, partWidth, partHeight);
+}
+
+void h264bsdInterpolateHorQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 horOffset) /* 0 for pixel a, 1 for pixel c */
+{
+    u8 fill[FILL_SIZE];
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth+5, partHeight);
+    HalfHor(p, width, mb, partWidth, partHeight);
+    AvgBlock(mb, p + 2 + horOffset, width, partWidth, partHeight);
+}
+
+void h264bsdInterpolateHorVerQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 horVerOffset) /* 0 for pixel e, 1 for pixel g,
+                       2 for pixel p, 3 for pixel r */
+{
+    u8 fill[FILL_SIZE];
+    u8 ver[16*16];
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth+5, partHeight+5);
+    /* 'b' (or 's' one row down) averaged with 'h' (or 'm' one to the right) */
+    HalfHor(p + (((horVerOffset & 0x2) >> 1) + 2) * width, width, mb,
+        partWidth, partHeight);
+    HalfVer(p + 2 + (horVerOffset & 0x1), width, ver, partWidth, partHeight);
+    AvgBlock(mb, ver, 16, partWidth, partHeight);
+}
+
+void h264bsdInterpolateMidHalf(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight)
+{
+    u8 fill[FILL_SIZE];
+    i16 table[21*16];
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth+5, partHeight+5);
+    HalfMid(p, width, mb, partWidth, partHeight, table);
+}
+
+void h264bsdInterpolateMidVerQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 verOffset)    /* 0 for pixel f, 1 for pixel q */
+{
+    u8 fill[FILL_SIZE];
+    i16 table[21*16];
+    u8 hor[16*16];
+    const i16 *t;
+    u32 x, y;
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth+5, partHeight+5);
+    HalfMid(p, width, mb, partWidth, partHeight, table);
+
+    /* 'j' averaged with 'b' (or 's'), rounded from the same row sums */
+    t = table + (2+verOffset)*16;
+    for (y = 0; y < partHeight; y++)
+    {
+        for (x = 0; x < partWidth; x += 8)
+        {
+            if (partWidth == 4)
+                Store4(hor + y*16, Round5(LoadS16(t)));
+            else
+                Store8(hor + y*16 + x, Round5(LoadS16(t + x)));
+        }
+        t += 16;
+    }
+    AvgBlock(mb, hor, 16, partWidth, partHeight);
+}
+
+void h264bsdInterpolateMidHorQuarter(
+  u8 *ref,
+  u8 *mb,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 partWidth,
+  u32 partHeight,
+  u32 horOffset)    /* 0 for pixel i, 1 for pixel k */
+{
+    u8 fill[FILL_SIZE];
+    i16 table[21*16];
+    u8 ver[16*16];
+    const u8 *p;
+
+    ASSERT(ref);
+    ASSERT(mb);
+
+    p = RefBlock(ref, fill, x0, y0, &width, height, partWidth+5, partHeight+5);
+    /* 'j' averaged with 'h' (or 'm') */
+    HalfMid(p, width, mb, partWidth, partHeight, table);
+    HalfVer(p + 2 + horOffset, width, ver, partWidth, partHeight);
+    AvgBlock(mb, ver, 16, partWidth, partHeight);
+}
+
+/*------------------------------------------------------------------------------
+
+    Chroma interpolation: one bilinear kernel for all three cases, the
+    weights (8-xFrac, xFrac) x (8-yFrac, yFrac) in 1/8 sample units. ref
+    is the Cb block; Cr follows it `height` lines further on.
+
+------------------------------------------------------------------------------*/
+
+static void PredictChromaBlock(const u8 *ref, u32 width, u32 height,
+    u8 *predPartChroma, u32 xFrac, u32 yFrac, u32 chromaPartWidth,
+    u32 chromaPartHeight)
+{
+    i32 wa = (i32)((8 - xFrac) * (8 - yFrac));
+    i32 wb = (i32)(xFrac * (8 - yFrac));
+    i32 wc = (i32)((8 - xFrac) * yFrac);
+    i32 wd = (i32)(xFrac * yFrac);
+    u32 comp, x, y;
+
+    for (comp = 0; comp <= 1; comp++)
+    {
+        const u8 *p = ref + comp * height * width;
+        u8 *cbr = predPartChroma + comp * 8 * 8;
+
+        for (y = chromaPartHeight; y; y--)
+        {
+            /* Samples with weight 0 are not read: they may lie outside the
+             * reference area */
+            if (chromaPartWidth == 2)
+            {
+                /* Two samples: vector loads would read past the block */
+                for (x = 0; x < 2; x++)
+                {
+                    i32 v = wa * p[x] + 32;
+                    if (wb) v += wb * p[x+1];
+                    if (wc) v += wc * p[x+width];
+                    if (wd) v += wd * p[x+width+1];
+                    cbr[x] = (u8)(v >> 6);
+                }
+            }
+            else if (chromaPartWidth == 4)
+            {
+                v16 s = Mul(Load4(p), wa);
+                if (wb) s = MulAdd(s, Load4(p + 1), wb);
+                if (wc) s = MulAdd(s, Load4(p + width), wc);
+                if (wd) s = MulAdd(s, Load4(p + width + 1), wd);
+                Store4(cbr, Shift6(s));
+            }
+            else
+            {
+                v16 s = Mul(Load8(p), wa);
+                if (wb) s = MulAdd(s, Load8(p + 1), wb);
+                if (wc) s = MulAdd(s, Load8(p + width), wc);
+                if (wd) s = MulAdd(s, Load8(p + width + 1), wd);
+                Store8(cbr, Shift6(s));
+            }
+            p += width;
+            cbr += 8;
+        }
+    }
+}
+
+void h264bsdInterpolateChromaHor(
+  u8 *pRef,
+  u8 *predPartChroma,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 xFrac,
+  u32 chromaPartWidth,
+  u32 chromaPartHeight)
+{
+    u8 block[9*8*2];
+
+    ASSERT(predPartChroma);
+    ASSERT(chromaPartWidth);
+    ASSERT(chromaPartHeight);
+    ASSERT(xFrac < 8);
+    ASSERT(pRef);
+
+    if ((x0 < 0) || ((u32)x0+chromaPartWidth+1 > width) ||
+        (y0 < 0) || ((u32)y0+chromaPartHeight > height))
+    {
+        h264bsdFillBlock(pRef, block, x0, y0, width, height,
+            chromaPartWidth + 1, chromaPartHeight, chromaPartWidth + 1);
+        pRef += width * height;
+        h264bsdFillBlock(pRef, block + (chromaPartWidth+1)*chromaPartHeight,
+            x0, y0, width, height, chromaPartWidth + 1,
+            chromaPartHeight, chromaPartWidth + 1);
+
+        pRef = block;
+        x0 = 0;
+        y0 = 0;
+        width = chromaPartWidth+1;
+        height = chromaPartHeight;
+    }
+
+    PredictChromaBlock(pRef + (u32)y0 * width + (u32)x0, width, height,
+        predPartChroma, xFrac, 0, chromaPartWidth, chromaPartHeight);
+}
+
+void h264bsdInterpolateChromaVer(
+  u8 *pRef,
+  u8 *predPartChroma,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 yFrac,
+  u32 chromaPartWidth,
+  u32 chromaPartHeight)
+{
+    u8 block[9*8*2];
+
+    ASSERT(predPartChroma);
+    ASSERT(chromaPartWidth);
+    ASSERT(chromaPartHeight);
+    ASSERT(yFrac < 8);
+    ASSERT(pRef);
+
+    if ((x0 < 0) || ((u32)x0+chromaPartWidth > width) ||
+        (y0 < 0) || ((u32)y0+chromaPartHeight+1 > height))
+    {
+        h264bsdFillBlock(pRef, block, x0, y0, width, height, chromaPartWidth,
+            chromaPartHeight + 1, chromaPartWidth);
+        pRef += width * height;
+        h264bsdFillBlock(pRef, block + chromaPartWidth*(chromaPartHeight+1),
+            x0, y0, width, height, chromaPartWidth,
+            chromaPartHeight + 1, chromaPartWidth);
+
+        pRef = block;
+        x0 = 0;
+        y0 = 0;
+        width = chromaPartWidth;
+        height = chromaPartHeight+1;
+    }
+
+    PredictChromaBlock(pRef + (u32)y0 * width + (u32)x0, width, height,
+        predPartChroma, 0, yFrac, chromaPartWidth, chromaPartHeight);
+}
+
+void h264bsdInterpolateChromaHorVer(
+  u8 *ref,
+  u8 *predPartChroma,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 xFrac,
+  u32 yFrac,
+  u32 chromaPartWidth,
+  u32 chromaPartHeight)
+{
+    u8 block[9*9*2];
+
+    ASSERT(predPartChroma);
+    ASSERT(chromaPartWidth);
+    ASSERT(chromaPartHeight);
+    ASSERT(xFrac < 8);
+    ASSERT(yFrac < 8);
+    ASSERT(ref);
+
+    if ((x0 < 0) || ((u32)x0+chromaPartWidth+1 > width) ||
+        (y0 < 0) || ((u32)y0+chromaPartHeight+1 > height))
+    {
+        h264bsdFillBlock(ref, block, x0, y0, width, height,
+            chromaPartWidth + 1, chromaPartHeight + 1, chromaPartWidth + 1);
+        ref += width * height;
+        h264bsdFillBlock(ref, block + (chromaPartWidth+1)*(chromaPartHeight+1),
+            x0, y0, width, height, chromaPartWidth + 1,
+            chromaPartHeight + 1, chromaPartWidth + 1);
+
+        ref = block;
+        x0 = 0;
+        y0 = 0;
+        width = chromaPartWidth+1;
+        height = chromaPartHeight+1;
+    }
+
+    PredictChromaBlock(ref + (u32)y0 * width + (u32)x0, width, height,
+        predPartChroma, xFrac, yFrac, chromaPartWidth, chromaPartHeight);
+}
+
+/*------------------------------------------------------------------------------
+
+    Reference block fetching
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFillRow7(
+  u8 *ref,
+  u8 *fill,
+  i32 left,
+  i32 center,
+  i32 right)
+{
+    ASSERT(ref);
+    ASSERT(fill);
+
+    if (left)
+        memset(fill, *ref, (size_t)left);
+    memcpy(fill + left, ref, (size_t)center);
+    if (right)
+        memset(fill + left + center, ref[center-1], (size_t)right);
+}
+
+/* Copy one row that needs no edge extension */
+static inline void FillRow(const u8 *ref, u8 *fill, u32 blockWidth)
+{
+    u32 w;
+
+    switch (blockWidth)
+    {
+        case 16:
+            Copy16(fill, ref);
+            break;
+        case 8:
+            memcpy(fill, ref, 8);
+            break;
+        case 4:
+            memcpy(&w, ref, 4);
+            memcpy(fill, &w, 4);
+            break;
+        default:
+            memcpy(fill, ref, blockWidth);
+            break;
+    }
+}
+
+static inline void FillRowEdge(const u8 *ref, u8 *fill, u32 blockWidth,
+    u32 inside, i32 left, i32 center, i32 right)
+{
+    if (inside)
+        FillRow(ref, fill, blockWidth);
+    else
+        h264bsdFillRow7((u8*)ref, fill, left, center, right);
+}
+
+void h264bsdFillBlock(
+  u8 *ref,
+  u8 *fill,
+  i32 x0,
+  i32 y0,
+  u32 width,
+  u32 height,
+  u32 blockWidth,
+  u32 blockHeight,
+  u32 fillScanLength)
+{
+    i32 xstop, ystop;
+    i32 left, x, right;
+    i32 top, y, bottom;
+    u32 inside;
+
+    ASSERT(ref);
+    ASSERT(fill);
+    ASSERT(width);
+    ASSERT(height);
+    ASSERT(blockWidth);
+    ASSERT(blockHeight);
+
+    xstop = x0 + (i32)blockWidth;
+    ystop = y0 + (i32)blockHeight;
+    inside = (x0 >= 0 && xstop <= (i32)width);
+
+    /* Whole block in the picture: the common case (integer motion) */
+    if (inside && y0 >= 0 && ystop <= (i32)height)
+    {
+        ref += (u32)y0 * width + (u32)x0;
+        for (y = (i32)blockHeight; y; y--)
+        {
+            FillRow(ref, fill, blockWidth);
+            ref += width;
+            fill += fillScanLength;
+        }
+        return;
+    }
+
+    /* Clamp blocks lying completely outside to the nearest edge */
+    if (ystop < 0)
+        y0 = -(i32)blockHeight;
+    if (xstop < 0)
+        x0 = -(i32)blockWidth;
+    if (y0 > (i32)height)
+        y0 = (i32)height;
+    if (x0 > (i32)width)
+        x0 = (i32)width;
+
+    xstop = x0 + (i32)blockWidth;
+    ystop = y0 + (i32)blockHeight;
+
+    if (x0 > 0)
+        ref += x0;
+    if (y0 > 0)
+        ref += y0 * (i32)width;
+
+    left = x0 < 0 ? -x0 : 0;
+    right = xstop > (i32)width ? xstop - (i32)width : 0;
+    x = (i32)blockWidth - left - right;
+
+    top = y0 < 0 ? -y0 : 0;
+    bottom = ystop > (i32)height ? ystop - (i32)height : 0;
+    y = (i32)blockHeight - top - bottom;
+
+    /* Top-overfilling repeats the first line inside the picture */
+    for ( ; top; top--)
+    {
+        FillRowEdge(ref, fill, blockWidth, inside, left, x, right);
+        fill += fillScanLength;
+    }
+
+    /* Lines inside reference image */
+    for ( ; y; y--)
+    {
+        FillRowEdge(ref, fill, blockWidth, inside, left, x, right);
+        ref += width;
+        fill += fillScanLength;
+    }
+
+    /* Bottom-overfilling repeats the last one */
+    ref -= width;
+    for ( ; bottom; bottom--)
+    {
+        FillRowEdge(ref, fill, blockWidth, inside, left, x, right);
+        fill += fillScanLength;
+    }
+}
+
+#endif /* H264DEC_SIMD */
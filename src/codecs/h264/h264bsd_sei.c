@@ -168,11 +168,20 @@ static u32 DecodeReservedSeiMessage(
     Function: h264bsdDecodeSeiMessage
 
         Functional description:
-          <++>
+            Decode the SEI messages of an SEI NAL unit. Only payload types
+            in the mask are parsed, the others are skipped by their
+            payload size without looking at their contents. Picture timing
+            and buffering period messages are skipped without the VUI of
+            the sequence they refer to.
         Inputs:
-          <++>
+            pStrmData       pointer to stream data structure
+            pSeqParamSet    active sequence parameter set, may be NULL
+            numSliceGroups  number of slice groups of the active picture
+                            parameter set, 0 if not known
+            types           SEI_TYPE_MASK of the payload types to decode,
+                            limited to SEI_DECODABLE_TYPES
         Outputs:
-          <++>
+            pSeiMessage     decoded messages, decodedTypes tells which
 
 ------------------------------------------------------------------------------*/
 
@@ -180,12 +189,13 @@ u32 h264bsdDecodeSeiMessage(
   strmData_t *pStrmData,
   seqParamSet_t *pSeqParamSet,
   seiMessage_t *pSeiMessage,
-  u32 numSliceGroups)
+  u32 numSliceGroups,
+  u32 types)
 {
 
 /* Variables */
 
-    u32 tmp, payloadType, payloadSize, status;
+    u32 tmp, payloadType, payloadSize, status, skip, start, end;
 
 /* Code */
 
@@ -217,10 +227,22 @@ u32 h264bsdDecodeSeiMessage(
 
         pSeiMessage->payloadType = payloadType;
 
-        switch (payloadType)
+        skip = payloadType >= 32 ||
+               !(types & SEI_DECODABLE_TYPES & SEI_TYPE_MASK(payloadType));
+        if (payloadType <= SEI_PIC_TIMING &&
+            (!pSeqParamSet || !pSeqParamSet->vuiParametersPresentFlag))
+            skip = HANTRO_TRUE;
+        if (payloadType == 7 && !pSeqParamSet)
+            skip = HANTRO_TRUE;
+        if (payloadType == 18 && !numSliceGroups)
+            skip = HANTRO_TRUE;
+
+        start = pStrmData->strmBuffReadBits;
+        if (skip)
+            status = DecodeFillerPayload(pStrmData, payloadSize);
+        else switch (payloadType)
         {
             case 0:
-                ASSERT(pSeqParamSet);
                 status = DecodeBufferingPeriod(
                   pStrmData,
                   &pSeiMessage->bufferingPeriod,
@@ -232,7 +254,6 @@ u32 h264bsdDecodeSeiMessage(
                 break;
 
             case 1:
-                ASSERT(pSeqParamSet->vuiParametersPresentFlag);
                 status = DecodePictureTiming(
                   pStrmData,
                   &pSeiMessage->picTiming,
@@ -286,7 +307,6 @@ u32 h264bsdDecodeSeiMessage(
                 break;
 
             case 8:
-                ASSERT(pSeqParamSet);
                 status = DecodeSparePic(
                   pStrmData,
                   &pSeiMessage->sparePic,
@@ -346,7 +366,6 @@ u32 h264bsdDecodeSeiMessage(
                 break;
 
             case 18:
-                ASSERT(numSliceGroups);
                 status = DecodeMotionConstrainedSliceGroupSet(
                   pStrmData,
                   &pSeiMessage->motionConstrainedSliceGroupSet,
@@ -364,16 +383,17 @@ u32 h264bsdDecodeSeiMessage(
         if (status != HANTRO_OK)
             return(status);
 
-        while (!h264bsdIsByteAligned(pStrmData))
-        {
-            if (h264bsdGetBits(pStrmData, 1) != 1)
-                return(HANTRO_NOK);
-            while (!h264bsdIsByteAligned(pStrmData))
-            {
-                if (h264bsdGetBits(pStrmData, 1) != 0)
-                    return(HANTRO_NOK);
-            }
-        }
+        /* continue after the payload size whatever the payload parsed,
+         * which also skips its alignment bits and any extension */
+        end = start + 8 * payloadSize;
+        if (pStrmData->strmBuffReadBits > end)
+            return(HANTRO_NOK);
+        if (end > pStrmData->strmBuffReadBits &&
+            h264bsdFlushBits(pStrmData, end - pStrmData->strmBuffReadBits) ==
+                END_OF_STREAM)
+            return(HANTRO_NOK);
+        if (!skip)
+            pSeiMessage->decodedTypes |= SEI_TYPE_MASK(payloadType);
     } while (h264bsdMoreRbspData(pStrmData));
 
     return(h264bsdRbspTrailingBits(pStrmData));
@@ -48,6 +48,22 @@
 #define MAX_NUM_CLOCK_TS 3
 #define MAX_NUM_SUB_SEQ_LAYERS 256
 
+/* payload types of SEI messages and the bit of a type in the mask of
+ * types to decode, other types are skipped by their payload size */
+#define SEI_BUFFERING_PERIOD 0
+#define SEI_PIC_TIMING 1
+#define SEI_RECOVERY_POINT 6
+#define SEI_TYPE_MASK(type) (1U << (type))
+
+/* types decoded unless set otherwise with h264bsdSetSeiTypes */
+#define SEI_DEFAULT_TYPES \
+    (SEI_TYPE_MASK(SEI_PIC_TIMING) | SEI_TYPE_MASK(SEI_RECOVERY_POINT))
+
+/* types that may be decoded: user data, spare picture and reserved
+ * payloads are kept in memory that is never released and always skipped */
+#define SEI_DECODABLE_TYPES \
+    (((1U << 19) - 1) & ~(SEI_TYPE_MASK(4) | SEI_TYPE_MASK(5) | SEI_TYPE_MASK(8)))
+
 /*------------------------------------------------------------------------------
     3. Data types
 ------------------------------------------------------------------------------*/
@@ -219,6 +235,7 @@ typedef struct
 typedef struct
 {
     u32 payloadType;
+    u32 decodedTypes; /* SEI_TYPE_MASK of the payloads decoded */
     seiBufferingPeriod_t bufferingPeriod;
     seiPicTiming_t picTiming;
     seiPanScanRect_t panScanRect;
@@ -247,7 +264,8 @@ u32 h264bsdDecodeSeiMessage(
   strmData_t *pStrmData,
   seqParamSet_t *pSeqParamSet,
   seiMessage_t *pSeiMessage,
-  u32 numSliceGroups);
+  u32 numSliceGroups,
+  u32 types);
 
 #endif /* #ifdef H264SWDEC_SEI_H */
 
@@ -25,8 +25,14 @@
      4. Local function prototypes
      5. Functions
           h264bsdDecodeSliceData
+          h264bsdDecodeSliceJob
+          h264bsdSetSliceJobMbParams
+          DecodeSlice
+          DecodeSliceSimple
+          DecodeSliceGeneral
           SetMbParams
           h264bsdMarkSliceCorrupted
+          h264bsdFilterDecodedRows
 
 ------------------------------------------------------------------------------*/
 
@@ -37,6 +43,9 @@
 #include "h264bsd_slice_data.h"
 #include "h264bsd_util.h"
 #include "h264bsd_vlc.h"
+#include "h264bsd_deblocking.h"
+#include "h264bsd_frame_threads.h"
+#include "h264bsd_profile.h"
 
 /*------------------------------------------------------------------------------
     2. External compiler flags
@@ -50,6 +59,11 @@
     4. Local function prototypes
 ------------------------------------------------------------------------------*/
 
+static u32 DecodeSlice(strmData_t *pStrmData, storage_t *pStorage,
+    image_t *currImage, sliceHeader_t *pSliceHeader, dpbStorage_t *dpb,
+    macroblockLayer_t *mbLayer, u32 *sliceGroupMap, sliceStorage_t *slice,
+    u32 endMbAddr, u32 mbParamsSet, u32 filterRows, u32 *mbCount);
+
 static void SetMbParams(mbStorage_t *pMb, sliceHeader_t *pSlice, u32 sliceId,
     i32 chromaQpIndexOffset);
 
@@ -89,16 +103,8 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
 
 /* Variables */
 
-    u8 mbData[384 + 15 + 32];
-    u8 *data;
     u32 tmp;
-    u32 skipRun;
-    u32 prevSkipped;
-    u32 currMbAddr;
-    u32 moreMbs;
     u32 mbCount;
-    i32 qpY;
-    macroblockLayer_t *mbLayer;
 
 /* Code */
 
@@ -107,15 +113,6 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
     ASSERT(pStorage);
     ASSERT(pSliceHeader->firstMbInSlice < pStorage->picSizeInMbs);
 
-    /* ensure 16-byte alignment */
-    data = (u8*)ALIGN(mbData, 16);
-
-    mbLayer = pStorage->mbLayer;
-
-    currMbAddr = pSliceHeader->firstMbInSlice;
-    skipRun = 0;
-    prevSkipped = HANTRO_FALSE;
-
     /* increment slice index, will be one for decoding of the first slice of
      * the picture */
     pStorage->slice->sliceId++;
@@ -124,116 +121,194 @@ u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
      * decoded, needed for error handling */
     pStorage->slice->lastMbAddr = 0;
 
-    mbCount = 0;
-    /* initial quantization parameter for the slice is obtained as the sum of
-     * initial QP for the picture and sliceQpDelta for the current slice */
-    qpY = (i32)pStorage->activePps->picInitQp + pSliceHeader->sliceQpDelta;
-    do
+    tmp = DecodeSlice(pStrmData, pStorage, currImage, pSliceHeader,
+        pStorage->dpb, pStorage->mbLayer, pStorage->sliceGroupMap,
+        pStorage->slice, pStorage->picSizeInMbs, HANTRO_FALSE,
+        pStorage->rowFiltering || pStorage->dpb->framePicture != NULL,
+        &mbCount);
+    if (tmp != HANTRO_OK)
+        return(tmp);
+
+    if ((pStorage->slice->numDecodedMbs + mbCount) > pStorage->picSizeInMbs)
     {
-        /* primary picture and already decoded macroblock -> error */
-        if (!pSliceHeader->redundantPicCnt && pStorage->mb[currMbAddr].decoded)
-        {
-            EPRINT("Primary and already decoded");
-            return(HANTRO_NOK);
-        }
+        EPRINT("Num decoded mbs");
+        return(HANTRO_NOK);
+    }
 
-        SetMbParams(pStorage->mb + currMbAddr, pSliceHeader,
-            pStorage->slice->sliceId, pStorage->activePps->chromaQpIndexOffset);
+    pStorage->slice->numDecodedMbs += mbCount;
 
-        if (!IS_I_SLICE(pSliceHeader->sliceType))
-        {
-            if (!prevSkipped)
-            {
-                tmp = h264bsdDecodeExpGolombUnsigned(pStrmData, &skipRun);
-                if (tmp != HANTRO_OK)
-                    return(tmp);
-                /* skip_run shall be less than or equal to number of
-                 * macroblocks left */
-                if (skipRun > (pStorage->picSizeInMbs - currMbAddr))
-                {
-                    EPRINT("skip_run");
-                    return(HANTRO_NOK);
-                }
-                if (skipRun)
-                {
-                    prevSkipped = HANTRO_TRUE;
-                    memset(&mbLayer->mbPred, 0, sizeof(mbPred_t));
-                    /* mark current macroblock skipped */
-                    mbLayer->mbType = P_Skip;
-                }
-            }
-        }
+    return(HANTRO_OK);
 
-        if (skipRun)
-        {
-            DEBUG(("Skipping macroblock %d\n", currMbAddr));
-            skipRun--;
-        }
-        else
-        {
-            prevSkipped = HANTRO_FALSE;
-            tmp = h264bsdDecodeMacroblockLayer(pStrmData, mbLayer,
-                pStorage->mb + currMbAddr, pSliceHeader->sliceType,
-                pSliceHeader->numRefIdxL0Active);
-            if (tmp != HANTRO_OK)
-            {
-                EPRINT("macroblock_layer");
-                return(tmp);
-            }
-        }
+}
 
-        tmp = h264bsdDecodeMacroblock(pStorage->mb + currMbAddr, mbLayer,
-            currImage, pStorage->dpb, &qpY, currMbAddr,
-            pStorage->activePps->constrainedIntraPredFlag, data);
-        if (tmp != HANTRO_OK)
-        {
-            EPRINT("MACRO_BLOCK");
-            return(tmp);
-        }
+/*------------------------------------------------------------------------------
 
-        /* increment macroblock count only for macroblocks that were decoded
-         * for the first time (redundant slices) */
-        if (pStorage->mb[currMbAddr].decoded == 1)
-            mbCount++;
+   5.2  Function name: h264bsdDecodeSliceJob
 
-        /* keep on processing as long as there is stream data left or
-         * processing of macroblocks to be skipped based on the last skipRun is
-         * not finished */
-        moreMbs = (h264bsdMoreRbspData(pStrmData) || skipRun) ?
-                                        HANTRO_TRUE : HANTRO_FALSE;
+        Functional description:
+            Decode one slice queued for a slice thread. The job holds its
+            own copies of the stream, slice header, reference picture list
+            and image pointers, and its macroblocks have had their slice
+            parameters set when it was queued, so slices of the same picture
+            can be decoded at the same time. Macroblocks from endMbAddr on
+            belong to the next slice and are never touched.
 
-        /* lastMbAddr is only updated for intra slices (all macroblocks of
-         * inter slices will be lost in case of an error) */
-        if (IS_I_SLICE(pSliceHeader->sliceType))
-            pStorage->slice->lastMbAddr = currMbAddr;
+        Inputs:
+            pJob            pointer to the slice job
+            pStorage        pointer to storage structure
+            mbLayer         macroblock layer structure of the calling thread
+            sliceGroupMap   slice group map with a single slice group
 
-        currMbAddr = h264bsdNextMbAddress(pStorage->sliceGroupMap,
-            pStorage->picSizeInMbs, currMbAddr);
-        /* data left in the buffer but no more macroblocks for current slice
-         * group -> error */
-        if (moreMbs && !currMbAddr)
-        {
-            EPRINT("Next mb address");
-            return(HANTRO_NOK);
-        }
+        Outputs:
+            pJob            status is set to the result of the decoding and
+                            slice->numDecodedMbs to the number of decoded
+                            macroblocks
+            pStorage        mbStorage structure of each processed macroblock
+                            is updated here
 
-    } while (moreMbs);
+        Returns:
+            HANTRO_OK       success
+            HANTRO_NOK      invalid stream data
 
-    if ((pStorage->slice->numDecodedMbs + mbCount) > pStorage->picSizeInMbs)
-    {
-        EPRINT("Num decoded mbs");
-        return(HANTRO_NOK);
-    }
+------------------------------------------------------------------------------*/
 
-    pStorage->slice->numDecodedMbs += mbCount;
+u32 h264bsdDecodeSliceJob(sliceJob_t *pJob, storage_t *pStorage,
+    macroblockLayer_t *mbLayer, u32 *sliceGroupMap)
+{
 
-    return(HANTRO_OK);
+/* Code */
+
+    ASSERT(pJob);
+    ASSERT(pStorage);
+    ASSERT(mbLayer);
+
+    pJob->slice->lastMbAddr = 0;
+    pJob->slice->numDecodedMbs = 0;
+
+    pJob->status = DecodeSlice(pJob->strm, pStorage, pJob->currImage,
+        pJob->sliceHeader, pJob->dpb, mbLayer, sliceGroupMap, pJob->slice,
+        pJob->endMbAddr, HANTRO_TRUE, HANTRO_FALSE,
+        &pJob->slice->numDecodedMbs);
+
+    return(pJob->status);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.3  Function name: h264bsdSetSliceJobMbParams
+
+        Functional description:
+            Set the slice parameters of all macroblocks from the first one of
+            the slice job up to endMbAddr. Done before the job is started:
+            the slice threads check neighbour availability from the sliceId
+            of macroblocks in other slices, which must not change while they
+            run.
+
+        Inputs:
+            pJob            pointer to the slice job
+            pStorage        pointer to storage structure
+
+        Outputs:
+            pStorage        mbStorage structures of the slice updated
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdSetSliceJobMbParams(sliceJob_t *pJob, storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(pJob);
+    ASSERT(pStorage);
+    ASSERT(pJob->endMbAddr <= pStorage->picSizeInMbs);
+
+    for (i = pJob->sliceHeader->firstMbInSlice; i < pJob->endMbAddr; i++)
+        SetMbParams(pStorage->mb + i, pJob->sliceHeader, pJob->slice->sliceId,
+            pStorage->activePps->chromaQpIndexOffset);
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.4  Function name: DecodeSlice
+
+        Functional description:
+            Decode macroblocks and skip_run fields of a slice, the part of
+            decoding shared by h264bsdDecodeSliceData and
+            h264bsdDecodeSliceJob. Slices of a single slice group in primary
+            pictures without constrained intra prediction take the loop
+            specialized for them (DecodeSliceSimple), all others the
+            general one; both are generated from h264bsd_slice_data_loop.h.
+
+        Inputs:
+            pStrmData       pointer to stream data structure
+            pStorage        pointer to storage structure
+            currImage       pointer to current processed picture
+            pSliceHeader    pointer to slice header of the current slice
+            dpb             pointer to decoded picture buffer holding the
+                            reference picture list of the slice
+            mbLayer         macroblock layer structure used for decoding
+            sliceGroupMap   slice group for each macroblock
+            slice           sliceId of the slice, lastMbAddr is updated
+            endMbAddr       macroblocks from this one on must not be decoded
+            mbParamsSet     HANTRO_TRUE if SetMbParams has already been
+                            called for the macroblocks of the slice
+            filterRows      HANTRO_TRUE to deblocking filter the rows of the
+                            picture as they are completed, see
+                            h264bsdFilterDecodedRows
+
+        Outputs:
+            currImage       processed macroblocks are written to current image
+            pStorage        mbStorage structure of each processed macroblock
+                            is updated here
+            mbCount         number of macroblocks decoded for the first time
+
+        Returns:
+            HANTRO_OK       success
+            HANTRO_NOK      invalid stream data
+
+------------------------------------------------------------------------------*/
+
+#define SLICE_LOOP_NAME DecodeSliceSimple
+#define SLICE_LOOP_SIMPLE 1
+#include "h264bsd_slice_data_loop.h"
+
+#define SLICE_LOOP_NAME DecodeSliceGeneral
+#define SLICE_LOOP_SIMPLE 0
+#include "h264bsd_slice_data_loop.h"
+
+u32 DecodeSlice(strmData_t *pStrmData, storage_t *pStorage,
+    image_t *currImage, sliceHeader_t *pSliceHeader, dpbStorage_t *dpb,
+    macroblockLayer_t *mbLayer, u32 *sliceGroupMap, sliceStorage_t *slice,
+    u32 endMbAddr, u32 mbParamsSet, u32 filterRows, u32 *mbCount)
+{
+
+/* Code */
+
+    if (pStorage->activePps->numSliceGroups == 1 &&
+        !pSliceHeader->redundantPicCnt &&
+        !pStorage->activePps->constrainedIntraPredFlag)
+        return(DecodeSliceSimple(pStrmData, pStorage, currImage,
+            pSliceHeader, dpb, mbLayer, sliceGroupMap, slice, endMbAddr,
+            mbParamsSet, filterRows, mbCount));
+
+    return(DecodeSliceGeneral(pStrmData, pStorage, currImage, pSliceHeader,
+        dpb, mbLayer, sliceGroupMap, slice, endMbAddr, mbParamsSet,
+        filterRows, mbCount));
 
 }
 
 /*------------------------------------------------------------------------------
 
-   5.2  Function: SetMbParams
+   5.5  Function: SetMbParams
 
         Functional description:
             Set macroblock parameters that remain constant for this slice
@@ -274,13 +349,17 @@ void SetMbParams(mbStorage_t *pMb, sliceHeader_t *pSlice, u32 sliceId,
 
 /*------------------------------------------------------------------------------
 
-   5.3  Function name: h264bsdMarkSliceCorrupted
+   5.6  Function name: h264bsdMarkSliceCorrupted
 
         Functional description:
             Mark macroblocks of the slice corrupted. If lastMbAddr in the slice
             storage is set -> picWidhtInMbs (or at least 10) macroblocks back
             from  the lastMbAddr are marked corrupted. However, if lastMbAddr
             is not set -> all macroblocks of the slice are marked.
+            Macroblocks in rows already deblocking filtered are kept, those
+            rows have been handed on to the pictures referencing this one.
+            Only frame threads get there: decoding serially, the rows of the
+            slice are not filtered before it is decoded.
 
         Inputs:
             pStorage        pointer to storage structure
@@ -303,12 +382,16 @@ void h264bsdMarkSliceCorrupted(storage_t *pStorage, u32 firstMbInSlice)
     u32 tmp, i;
     u32 sliceId;
     u32 currMbAddr;
+    u32 firstUnfiltered;
 
 /* Code */
 
     ASSERT(pStorage);
     ASSERT(firstMbInSlice < pStorage->picSizeInMbs);
 
+    firstUnfiltered =
+        pStorage->rowsFiltered * pStorage->activeSps->picWidthInMbs;
+
     currMbAddr = firstMbInSlice;
 
     sliceId = pStorage->slice->sliceId;
@@ -339,7 +422,8 @@ void h264bsdMarkSliceCorrupted(storage_t *pStorage, u32 firstMbInSlice)
         if ( (pStorage->mb[currMbAddr].sliceId == sliceId) &&
              (pStorage->mb[currMbAddr].decoded) )
         {
-            pStorage->mb[currMbAddr].decoded--;
+            if (currMbAddr >= firstUnfiltered)
+                pStorage->mb[currMbAddr].decoded--;
         }
         else
         {
@@ -351,5 +435,84 @@ void h264bsdMarkSliceCorrupted(storage_t *pStorage, u32 firstMbInSlice)
 
     } while (currMbAddr);
 
+    /* rows below the filtered ones are counted again */
+    pStorage->rowsDecoded = pStorage->rowsFiltered;
+
+}
+
+/*------------------------------------------------------------------------------
+
+   5.7  Function name: h264bsdFilterDecodedRows
+
+        Functional description:
+            Deblocking filter the macroblock rows of the picture whose next
+            row has been decoded completely, so that filtering trails
+            reconstruction by a row while the rows are still in the cache.
+            The last row decoded is left unfiltered as intra prediction of
+            the row below reads its unfiltered pixels. Decoding serially,
+            the rows from the first one of the current slice on are left
+            unfiltered too, with the row above them: the slice may still be
+            marked corrupted, and concealment reads the unfiltered pixels
+            around the macroblocks it conceals. A row is never filtered
+            twice. Rows not filtered while the picture is decoded are
+            filtered once the picture is completed.
+
+        Inputs:
+            pStorage        pointer to storage structure
+            currImage       pointer to current processed picture
+            firstMbInSlice  address of the first macroblock of the slice
+                            being decoded
+
+        Outputs:
+            currImage       rows deblocking filtered
+            pStorage        rowsDecoded and rowsFiltered updated
+
+        Returns:
+            HANTRO_TRUE     rows were filtered
+            HANTRO_FALSE    otherwise
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdFilterDecodedRows(storage_t *pStorage, image_t *currImage,
+    u32 firstMbInSlice)
+{
+
+/* Variables */
+
+    u32 i, width, endRow, numRows;
+    mbStorage_t *pMb;
+
+/* Code */
+
+    ASSERT(pStorage);
+    ASSERT(currImage);
+
+    width = currImage->width;
+
+    while (pStorage->rowsDecoded < currImage->height)
+    {
+        pMb = pStorage->mb + pStorage->rowsDecoded * width;
+        for (i = 0; i < width; i++)
+            if (!pMb[i].decoded)
+                break;
+        if (i < width)
+            break;
+        pStorage->rowsDecoded++;
+    }
+
+    endRow = pStorage->rowsDecoded;
+    if (pStorage->dpb->framePicture == NULL)
+        endRow = MIN(endRow, firstMbInSlice / width);
+
+    if (endRow <= pStorage->rowsFiltered + 1)
+        return(HANTRO_FALSE);
+
+    numRows = endRow - 1 - pStorage->rowsFiltered;
+    h264bsdFilterPictureRows(currImage, pStorage->mb, pStorage->rowsFiltered,
+        numRows);
+    pStorage->rowsFiltered += numRows;
+
+    return(HANTRO_TRUE);
+
 }
 
@@ -47,6 +47,22 @@
     3. Data types
 ------------------------------------------------------------------------------*/
 
+/* slice decoded on a slice thread (h264bsd_slice_threads.c). Holds copies
+ * of the per-slice state the storage keeps for the slice being decoded */
+typedef struct
+{
+    sliceHeader_t sliceHeader[1];
+    strmData_t strm[1];
+    u8 *pStrmBuff;              /* copy of the slice NAL unit */
+    u32 strmBuffCapacity;
+    dpbStorage_t dpb[1];        /* list points to refPicList */
+    dpbPicture_t *refPicList[MAX_NUM_REF_PICS + 1];
+    image_t currImage[1];
+    sliceStorage_t slice[1];
+    u32 endMbAddr;              /* first macroblock of the next slice */
+    u32 status;
+} sliceJob_t;
+
 /*------------------------------------------------------------------------------
     4. Function prototypes
 ------------------------------------------------------------------------------*/
@@ -54,7 +70,15 @@
 u32 h264bsdDecodeSliceData(strmData_t *pStrmData, storage_t *pStorage,
     image_t *currImage, sliceHeader_t *pSliceHeader);
 
+u32 h264bsdDecodeSliceJob(sliceJob_t *pJob, storage_t *pStorage,
+    macroblockLayer_t *mbLayer, u32 *sliceGroupMap);
+
+void h264bsdSetSliceJobMbParams(sliceJob_t *pJob, storage_t *pStorage);
+
 void h264bsdMarkSliceCorrupted(storage_t *pStorage, u32 firstMbInSlice);
 
+u32 h264bsdFilterDecodedRows(storage_t *pStorage, image_t *currImage,
+    u32 firstMbInSlice);
+
 #endif /* #ifdef H264SWDEC_SLICE_DATA_H */
 
@@ -0,0 +1,184 @@
+/*------------------------------------------------------------------------------
+
+    Macroblock loop of a slice, included by h264bsd_slice_data.c once per
+    variant of it:
+
+        SLICE_LOOP_NAME     name of the function defined
+        SLICE_LOOP_SIMPLE   1 for the loop of the streams met in practice:
+                            a single slice group, primary coded pictures
+                            only (redundant_pic_cnt 0) and no constrained
+                            intra prediction. The next macroblock is then
+                            always the one after, and neither the slice
+                            group map, the redundant picture test nor the
+                            constrained intra flag is looked at per
+                            macroblock. 0 for the general loop.
+
+    Entropy coding is CAVLC in every variant, the only mode the decoder
+    supports. Both macros are undefined again at the end.
+
+------------------------------------------------------------------------------*/
+
+#if !defined(SLICE_LOOP_NAME) || !defined(SLICE_LOOP_SIMPLE)
+#error "define SLICE_LOOP_NAME and SLICE_LOOP_SIMPLE before including"
+#endif
+
+static u32 SLICE_LOOP_NAME(strmData_t *pStrmData, storage_t *pStorage,
+    image_t *currImage, sliceHeader_t *pSliceHeader, dpbStorage_t *dpb,
+    macroblockLayer_t *mbLayer, u32 *sliceGroupMap, sliceStorage_t *slice,
+    u32 endMbAddr, u32 mbParamsSet, u32 filterRows, u32 *mbCount)
+{
+
+/* Variables */
+
+    u8 mbData[384 + 15 + 32];
+    u8 *data;
+    u32 tmp;
+    u32 skipRun;
+    u32 prevSkipped;
+    u32 currMbAddr;
+    u32 moreMbs;
+    u32 intraSlice;
+    u32 constrainedIntraPred;
+    i32 qpY;
+    PROFILE_VARIABLES
+
+/* Code */
+
+    ASSERT(endMbAddr <= pStorage->picSizeInMbs);
+
+    /* ensure 16-byte alignment */
+    data = (u8*)ALIGN(mbData, 16);
+
+    currMbAddr = pSliceHeader->firstMbInSlice;
+    skipRun = 0;
+    prevSkipped = HANTRO_FALSE;
+    intraSlice = IS_I_SLICE(pSliceHeader->sliceType);
+#if SLICE_LOOP_SIMPLE
+    (void)sliceGroupMap;
+    constrainedIntraPred = HANTRO_FALSE;
+#else
+    constrainedIntraPred = pStorage->activePps->constrainedIntraPredFlag;
+#endif
+
+    *mbCount = 0;
+    /* initial quantization parameter for the slice is obtained as the sum of
+     * initial QP for the picture and sliceQpDelta for the current slice */
+    qpY = (i32)pStorage->activePps->picInitQp + pSliceHeader->sliceQpDelta;
+    do
+    {
+        /* primary picture and already decoded macroblock -> error */
+#if SLICE_LOOP_SIMPLE
+        if (pStorage->mb[currMbAddr].decoded)
+#else
+        if (!pSliceHeader->redundantPicCnt && pStorage->mb[currMbAddr].decoded)
+#endif
+        {
+            EPRINT("Primary and already decoded");
+            return(HANTRO_NOK);
+        }
+
+        if (!mbParamsSet)
+            SetMbParams(pStorage->mb + currMbAddr, pSliceHeader,
+                slice->sliceId, pStorage->activePps->chromaQpIndexOffset);
+
+        if (!intraSlice)
+        {
+            if (!prevSkipped)
+            {
+                tmp = h264bsdDecodeExpGolombUnsigned(pStrmData, &skipRun);
+                if (tmp != HANTRO_OK)
+                    return(tmp);
+                /* skip_run shall be less than or equal to number of
+                 * macroblocks left */
+                if (skipRun > (endMbAddr - currMbAddr))
+                {
+                    EPRINT("skip_run");
+                    return(HANTRO_NOK);
+                }
+                if (skipRun)
+                {
+                    prevSkipped = HANTRO_TRUE;
+                    memset(&mbLayer->mbPred, 0, sizeof(mbPred_t));
+                    /* mark current macroblock skipped */
+                    mbLayer->mbType = P_Skip;
+                }
+            }
+        }
+
+        if (skipRun)
+        {
+            DEBUG(("Skipping macroblock %d\n", currMbAddr));
+            skipRun--;
+        }
+        else
+        {
+            prevSkipped = HANTRO_FALSE;
+            PROFILE_START;
+            tmp = h264bsdDecodeMacroblockLayer(pStrmData, mbLayer,
+                pStorage->mb + currMbAddr, pSliceHeader->sliceType,
+                pSliceHeader->numRefIdxL0Active);
+            PROFILE_END(PROFILE_PARSE);
+            if (tmp != HANTRO_OK)
+            {
+                EPRINT("macroblock_layer");
+                return(tmp);
+            }
+        }
+
+        tmp = h264bsdDecodeMacroblock(pStorage->mb + currMbAddr, mbLayer,
+            currImage, dpb, &qpY, currMbAddr, constrainedIntraPred, data);
+        if (tmp != HANTRO_OK)
+        {
+            EPRINT("MACRO_BLOCK");
+            return(tmp);
+        }
+
+        /* increment macroblock count only for macroblocks that were decoded
+         * for the first time (redundant slices) */
+        if (pStorage->mb[currMbAddr].decoded == 1)
+            (*mbCount)++;
+
+        /* rows completed on a frame thread are handed on to the pictures
+         * referencing this one once filtered */
+        if (filterRows && (currMbAddr + 1) % currImage->width == 0 &&
+            h264bsdFilterDecodedRows(pStorage, currImage,
+                pSliceHeader->firstMbInSlice) &&
+            dpb->framePicture != NULL)
+            h264bsdFrameRowDecoded(dpb->framePicture);
+
+        /* keep on processing as long as there is stream data left or
+         * processing of macroblocks to be skipped based on the last skipRun is
+         * not finished */
+        moreMbs = (h264bsdMoreRbspData(pStrmData) || skipRun) ?
+                                        HANTRO_TRUE : HANTRO_FALSE;
+
+        /* lastMbAddr is only updated for intra slices (all macroblocks of
+         * inter slices will be lost in case of an error) */
+        if (intraSlice)
+            slice->lastMbAddr = currMbAddr;
+
+#if SLICE_LOOP_SIMPLE
+        /* one slice group: the macroblocks follow each other, endMbAddr is
+         * at most the picture size */
+        currMbAddr++;
+        if (moreMbs && currMbAddr >= endMbAddr)
+#else
+        currMbAddr = h264bsdNextMbAddress(sliceGroupMap,
+            pStorage->picSizeInMbs, currMbAddr);
+        /* data left in the buffer but no more macroblocks for current slice
+         * group -> error */
+        if (moreMbs && (!currMbAddr || currMbAddr >= endMbAddr))
+#endif
+        {
+            EPRINT("Next mb address");
+            return(HANTRO_NOK);
+        }
+
+    } while (moreMbs);
+
+    return(HANTRO_OK);
+
+}
+
+#undef SLICE_LOOP_NAME
+#undef SLICE_LOOP_SIMPLE
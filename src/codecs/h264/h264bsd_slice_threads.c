@@ -0,0 +1,526 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdCreateSliceThreads
+          h264bsdFreeSliceThreads
+          h264bsdQueueSlice
+          h264bsdFinishSlices
+          StartSlice
+          SliceThread
+
+--------------------------------------------------------------------------------
+
+    Pool of threads decoding the slices of a picture at the same time.
+    Slices are queued in the order they arrive and a slice is handed to the
+    threads once the next one is queued: its first macroblock is where the
+    previous slice has to end. The last slice of the picture is started by
+    h264bsdFinishSlices, which waits for all of them and is called at the
+    access unit boundary, before concealment and deblocking.
+
+    Only slices of pictures with a single slice group, in increasing
+    macroblock order, can be queued. Intra and motion vector prediction then
+    only look at macroblocks before the current one, so a slice never reads
+    one being decoded by another thread, and neighbours in other slices are
+    recognised by a sliceId that is set before any of the slices run.
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "h264bsd_slice_threads.h"
+#include "h264bsd_slice_data.h"
+#include "h264bsd_util.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/* one worker thread and its own macroblock layer structure */
+typedef struct
+{
+    sliceThreads_t *pThreads;
+    pthread_t thread;
+    macroblockLayer_t *mbLayer;
+} sliceThread_t;
+
+struct sliceThreads
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t start;       /* signalled when a job is started */
+    pthread_cond_t done;        /* signalled when a job is finished */
+
+    sliceThread_t *threads;
+    u32 numThreads;
+    u32 quit;
+
+    /* jobs of the current picture, all jobs of the array are allocated and
+     * reused for the following pictures */
+    sliceJob_t **jobs;
+    u32 numAllocated;
+    u32 numJobs;                /* jobs queued */
+    u32 numStarted;             /* jobs handed to the threads */
+    u32 numTaken;               /* jobs picked by a thread */
+    u32 numFinished;            /* jobs decoded */
+
+    storage_t *pStorage;
+
+    /* slice group map of a picture with a single slice group, the one in
+     * the storage is recomputed for every slice */
+    u32 *sliceGroupMap;
+    u32 sliceGroupMapSize;
+};
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+static void StartSlice(sliceThreads_t *pThreads, sliceJob_t *pJob,
+    u32 endMbAddr);
+static void *SliceThread(void *arg);
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdCreateSliceThreads
+
+        Functional description:
+            Start a pool of slice threads.
+
+        Inputs:
+            numThreads  number of threads, at most MAX_NUM_SLICE_THREADS
+
+        Outputs:
+            none
+
+        Returns:
+            pointer to the pool
+            NULL if memory allocation or creation of the threads failed
+
+------------------------------------------------------------------------------*/
+
+sliceThreads_t *h264bsdCreateSliceThreads(u32 numThreads)
+{
+
+/* Variables */
+
+    u32 i, size;
+    sliceThreads_t *pThreads;
+
+/* Code */
+
+    ASSERT(numThreads);
+
+    if (numThreads > MAX_NUM_SLICE_THREADS)
+        numThreads = MAX_NUM_SLICE_THREADS;
+
+    pThreads = (sliceThreads_t*)calloc(1, sizeof(sliceThreads_t));
+    if (pThreads == NULL)
+        return(NULL);
+
+    ALLOCATE(pThreads->threads, numThreads, sliceThread_t);
+    if (pThreads->threads == NULL)
+    {
+        FREE(pThreads);
+        return(NULL);
+    }
+
+    pthread_mutex_init(&pThreads->mutex, NULL);
+    pthread_cond_init(&pThreads->start, NULL);
+    pthread_cond_init(&pThreads->done, NULL);
+
+    /* same size as the mbLayer of the storage, see h264bsdInit */
+    size = (sizeof(macroblockLayer_t) + 63) & ~0x3F;
+
+    for (i = 0; i < numThreads; i++)
+    {
+        pThreads->threads[i].pThreads = pThreads;
+        pThreads->threads[i].mbLayer = (macroblockLayer_t*)malloc(size);
+        if (pThreads->threads[i].mbLayer == NULL ||
+            pthread_create(&pThreads->threads[i].thread, NULL, SliceThread,
+                pThreads->threads + i) != 0)
+        {
+            FREE(pThreads->threads[i].mbLayer);
+            break;
+        }
+        pThreads->numThreads++;
+    }
+
+    if (pThreads->numThreads < numThreads)
+    {
+        h264bsdFreeSliceThreads(pThreads);
+        return(NULL);
+    }
+
+    return(pThreads);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFreeSliceThreads
+
+        Functional description:
+            Stop the threads of a pool and free it. Jobs that have not been
+            picked by a thread are dropped.
+
+        Inputs:
+            pThreads    pointer to the pool, may be NULL
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFreeSliceThreads(sliceThreads_t *pThreads)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    if (pThreads == NULL)
+        return;
+
+    pthread_mutex_lock(&pThreads->mutex);
+    pThreads->quit = HANTRO_TRUE;
+    pthread_cond_broadcast(&pThreads->start);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    for (i = 0; i < pThreads->numThreads; i++)
+    {
+        pthread_join(pThreads->threads[i].thread, NULL);
+        FREE(pThreads->threads[i].mbLayer);
+    }
+
+    for (i = 0; i < pThreads->numAllocated; i++)
+    {
+        FREE(pThreads->jobs[i]->pStrmBuff);
+        FREE(pThreads->jobs[i]);
+    }
+
+    pthread_cond_destroy(&pThreads->done);
+    pthread_cond_destroy(&pThreads->start);
+    pthread_mutex_destroy(&pThreads->mutex);
+
+    FREE(pThreads->jobs);
+    FREE(pThreads->sliceGroupMap);
+    FREE(pThreads->threads);
+    FREE(pThreads);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdQueueSlice
+
+        Functional description:
+            Queue the slice whose header has just been decoded into the
+            storage, and start the one queued before it. The stream data,
+            slice header, reference picture list and current image are
+            copied, so the storage is free to go on with the next NAL unit.
+
+            Slices that cannot be decoded in parallel are not queued. All
+            queued slices are finished first, the caller then decodes the
+            slice with h264bsdDecodeSliceData.
+
+        Inputs:
+            pStorage    pointer to storage structure, with the slice header
+                        and reference picture list of the slice
+            pStrmData   pointer to stream data structure, positioned at the
+                        start of the slice data
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_OK   slice queued
+            HANTRO_NOK  slice not queued, decode it on the calling thread
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdQueueSlice(storage_t *pStorage, strmData_t *pStrmData)
+{
+
+/* Variables */
+
+    u32 size;
+    sliceHeader_t *pSliceHeader;
+    sliceThreads_t *pThreads;
+    sliceJob_t *pJob, **jobs;
+    u8 *pStrmBuff;
+
+/* Code */
+
+    ASSERT(pStorage);
+    ASSERT(pStrmData);
+
+    pThreads = pStorage->sliceThreads;
+    if (pThreads == NULL)
+        return(HANTRO_NOK);
+
+    pSliceHeader = pStorage->sliceHeader;
+    if (pStorage->activePps->numSliceGroups != 1 ||
+        pSliceHeader->redundantPicCnt ||
+        (pThreads->numJobs && pSliceHeader->firstMbInSlice <=
+         pThreads->jobs[pThreads->numJobs-1]->sliceHeader->firstMbInSlice))
+    {
+        h264bsdFinishSlices(pStorage);
+        return(HANTRO_NOK);
+    }
+
+    /* first slice of the picture, no thread is running */
+    if (!pThreads->numJobs)
+    {
+        pThreads->pStorage = pStorage;
+        if (pThreads->sliceGroupMapSize < pStorage->picSizeInMbs)
+        {
+            FREE(pThreads->sliceGroupMap);
+            pThreads->sliceGroupMapSize = 0;
+            ALLOCATE(pThreads->sliceGroupMap, pStorage->picSizeInMbs, u32);
+            if (pThreads->sliceGroupMap == NULL)
+                return(HANTRO_NOK);
+            memset(pThreads->sliceGroupMap, 0,
+                pStorage->picSizeInMbs * sizeof(u32));
+            pThreads->sliceGroupMapSize = pStorage->picSizeInMbs;
+        }
+    }
+
+    ASSERT(pThreads->pStorage == pStorage);
+
+    if (pThreads->numJobs == pThreads->numAllocated)
+    {
+        ALLOCATE(pJob, 1, sliceJob_t);
+        if (pJob == NULL)
+        {
+            h264bsdFinishSlices(pStorage);
+            return(HANTRO_NOK);
+        }
+        pJob->pStrmBuff = NULL;
+        pJob->strmBuffCapacity = 0;
+
+        /* threads index the array while holding the mutex */
+        pthread_mutex_lock(&pThreads->mutex);
+        jobs = (sliceJob_t**)realloc(pThreads->jobs,
+            (pThreads->numAllocated + 1) * sizeof(sliceJob_t*));
+        if (jobs != NULL)
+        {
+            pThreads->jobs = jobs;
+            pThreads->jobs[pThreads->numAllocated++] = pJob;
+        }
+        pthread_mutex_unlock(&pThreads->mutex);
+        if (jobs == NULL)
+        {
+            FREE(pJob);
+            h264bsdFinishSlices(pStorage);
+            return(HANTRO_NOK);
+        }
+    }
+
+    pJob = pThreads->jobs[pThreads->numJobs];
+
+    /* NAL units are decoded from a buffer of the application, the slice
+     * data is needed after the next one has been given */
+    size = pStrmData->strmBuffSize;
+    if (pJob->strmBuffCapacity < size)
+    {
+        pStrmBuff = (u8*)realloc(pJob->pStrmBuff, size);
+        if (pStrmBuff == NULL)
+        {
+            h264bsdFinishSlices(pStorage);
+            return(HANTRO_NOK);
+        }
+        pJob->pStrmBuff = pStrmBuff;
+        pJob->strmBuffCapacity = size;
+    }
+    memcpy(pJob->pStrmBuff, pStrmData->pStrmBuffStart, size);
+    *pJob->strm = *pStrmData;
+    pJob->strm->pStrmBuffStart = pJob->pStrmBuff;
+    pJob->strm->pStrmCurrPos = pJob->pStrmBuff +
+        (pStrmData->pStrmCurrPos - pStrmData->pStrmBuffStart);
+
+    *pJob->sliceHeader = *pSliceHeader;
+
+    *pJob->dpb = *pStorage->dpb;
+    memcpy(pJob->refPicList, pStorage->dpb->list,
+        sizeof(pJob->refPicList));
+    pJob->dpb->list = pJob->refPicList;
+
+    *pJob->currImage = *pStorage->currImage;
+
+    pJob->slice->sliceId = ++pStorage->slice->sliceId;
+    pJob->status = HANTRO_OK;
+
+    /* the previous slice ends where this one starts */
+    if (pThreads->numJobs > pThreads->numStarted)
+        StartSlice(pThreads, pThreads->jobs[pThreads->numStarted],
+            pSliceHeader->firstMbInSlice);
+
+    pThreads->numJobs++;
+
+    return(HANTRO_OK);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFinishSlices
+
+        Functional description:
+            Start the last queued slice, which may extend to the end of the
+            picture, and wait until all queued slices are decoded. Adds the
+            macroblocks of the slices to numDecodedMbs of the storage and
+            marks slices with errors corrupted, like the decoder does for a
+            slice decoded with h264bsdDecodeSliceData.
+
+        Inputs:
+            pStorage    pointer to storage structure
+
+        Outputs:
+            pStorage    slice storage and mbStorage structures updated
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFinishSlices(storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 i, sliceId;
+    sliceThreads_t *pThreads;
+    sliceJob_t *pJob;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    pThreads = pStorage->sliceThreads;
+    if (pThreads == NULL || !pThreads->numJobs)
+        return;
+
+    if (pThreads->numJobs > pThreads->numStarted)
+        StartSlice(pThreads, pThreads->jobs[pThreads->numStarted],
+            pStorage->picSizeInMbs);
+
+    pthread_mutex_lock(&pThreads->mutex);
+    while (pThreads->numFinished < pThreads->numStarted)
+        pthread_cond_wait(&pThreads->done, &pThreads->mutex);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    sliceId = pStorage->slice->sliceId;
+    for (i = 0; i < pThreads->numJobs; i++)
+    {
+        pJob = pThreads->jobs[i];
+        if (pJob->status == HANTRO_OK)
+            pStorage->slice->numDecodedMbs += pJob->slice->numDecodedMbs;
+        else
+        {
+            EPRINT("SLICE_DATA");
+            pStorage->slice->sliceId = pJob->slice->sliceId;
+            pStorage->slice->lastMbAddr = pJob->slice->lastMbAddr;
+            h264bsdMarkSliceCorrupted(pStorage,
+                pJob->sliceHeader->firstMbInSlice);
+        }
+    }
+    pStorage->slice->sliceId = sliceId;
+
+    pThreads->numJobs = 0;
+    pThreads->numStarted = 0;
+    pThreads->numTaken = 0;
+    pThreads->numFinished = 0;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: StartSlice
+
+        Functional description:
+            Hand a queued slice to the threads once it is known where it
+            ends.
+
+------------------------------------------------------------------------------*/
+
+void StartSlice(sliceThreads_t *pThreads, sliceJob_t *pJob, u32 endMbAddr)
+{
+
+/* Code */
+
+    ASSERT(pJob->sliceHeader->firstMbInSlice < endMbAddr);
+
+    pJob->endMbAddr = endMbAddr;
+    h264bsdSetSliceJobMbParams(pJob, pThreads->pStorage);
+
+    pthread_mutex_lock(&pThreads->mutex);
+    pThreads->numStarted++;
+    pthread_cond_signal(&pThreads->start);
+    pthread_mutex_unlock(&pThreads->mutex);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: SliceThread
+
+        Functional description:
+            Thread function, decodes started slices in the order they were
+            queued until the pool is freed.
+
+------------------------------------------------------------------------------*/
+
+void *SliceThread(void *arg)
+{
+
+/* Variables */
+
+    sliceThread_t *pThread = (sliceThread_t*)arg;
+    sliceThreads_t *pThreads = pThread->pThreads;
+    sliceJob_t *pJob;
+
+/* Code */
+
+    pthread_mutex_lock(&pThreads->mutex);
+    for (;;)
+    {
+        while (!pThreads->quit && pThreads->numTaken == pThreads->numStarted)
+            pthread_cond_wait(&pThreads->start, &pThreads->mutex);
+        if (pThreads->quit)
+            break;
+
+        pJob = pThreads->jobs[pThreads->numTaken++];
+        pthread_mutex_unlock(&pThreads->mutex);
+
+        (void)h264bsdDecodeSliceJob(pJob, pThreads->pStorage,
+            pThread->mbLayer, pThreads->sliceGroupMap);
+
+        pthread_mutex_lock(&pThreads->mutex);
+        pThreads->numFinished++;
+        pthread_cond_signal(&pThreads->done);
+    }
+    pthread_mutex_unlock(&pThreads->mutex);
+
+    return(NULL);
+
+}
@@ -0,0 +1,46 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+    1. Include headers
+    2. Module defines
+    3. Data types
+    4. Function prototypes
+
+------------------------------------------------------------------------------*/
+
+#ifndef H264SWDEC_SLICE_THREADS_H
+#define H264SWDEC_SLICE_THREADS_H
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+#include "h264bsd_stream.h"
+#include "h264bsd_storage.h"
+
+/*------------------------------------------------------------------------------
+    2. Module defines
+------------------------------------------------------------------------------*/
+
+/* upper limit for the number of slice threads of a decoder instance */
+#define MAX_NUM_SLICE_THREADS 16
+
+/*------------------------------------------------------------------------------
+    3. Data types
+------------------------------------------------------------------------------*/
+
+typedef struct sliceThreads sliceThreads_t;
+
+/*------------------------------------------------------------------------------
+    4. Function prototypes
+------------------------------------------------------------------------------*/
+
+sliceThreads_t *h264bsdCreateSliceThreads(u32 numThreads);
+void h264bsdFreeSliceThreads(sliceThreads_t *pThreads);
+
+u32 h264bsdQueueSlice(storage_t *pStorage, strmData_t *pStrmData);
+void h264bsdFinishSlices(storage_t *pStorage);
+
+#endif /* #ifdef H264SWDEC_SLICE_THREADS_H */
@@ -27,6 +27,9 @@
           h264bsdInitStorage
           h264bsdStoreSeqParamSet
           h264bsdStorePicParamSet
+          h264bsdIsRepeatedParamSet
+          h264bsdStoreParamSetBytes
+          h264bsdFreeParamSetBytes
           h264bsdActivateParamSets
           h264bsdResetStorage
           h264bsdIsStartOfPicture
@@ -50,6 +53,7 @@
 #include "h264bsd_nal_unit.h"
 #include "h264bsd_slice_header.h"
 #include "h264bsd_seq_param_set.h"
+#include "h264bsd_vlc.h"
 
 /*------------------------------------------------------------------------------
     2. External compiler flags
@@ -262,6 +266,179 @@ u32 h264bsdStorePicParamSet(storage_t *pStorage, picParamSet_t *pPicParamSet)
 
 }
 
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdIsRepeatedParamSet
+
+        Functional description:
+            Check if a sequence or picture parameter set NAL unit is byte
+            for byte the one stored with the same id. Streams repeat their
+            parameter sets before every IDR picture, such a repeated set
+            needs neither decoding nor storing again.
+
+        Inputs:
+            pStorage        pointer to storage structure
+            pStrmData       NAL unit, from its header byte on
+            nalUnitType     NAL_SEQ_PARAM_SET or NAL_PIC_PARAM_SET
+
+        Outputs:
+            none
+
+        Returns:
+            HANTRO_TRUE     same bytes as the stored parameter set
+            HANTRO_FALSE    new, changed or not parsable id
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdIsRepeatedParamSet(storage_t *pStorage, strmData_t *pStrmData,
+    u32 nalUnitType)
+{
+
+/* Variables */
+
+    strmData_t strm;
+    u32 id;
+    paramSetBytes_t *pBytes;
+
+/* Code */
+
+    ASSERT(pStorage);
+    ASSERT(pStrmData);
+    ASSERT(nalUnitType == NAL_SEQ_PARAM_SET ||
+           nalUnitType == NAL_PIC_PARAM_SET);
+
+    /* the id is the first syntax element of a PPS and follows the profile
+     * and level bytes in an SPS */
+    strm = *pStrmData;
+    strm.pStrmCurrPos = strm.pStrmBuffStart;
+    strm.bitPosInWord = 0;
+    strm.strmBuffReadBits = 0;
+    if (h264bsdFlushBits(&strm,
+            nalUnitType == NAL_SEQ_PARAM_SET ? 32 : 8) == END_OF_STREAM ||
+        h264bsdDecodeExpGolombUnsigned(&strm, &id) != HANTRO_OK)
+        return(HANTRO_FALSE);
+
+    if (nalUnitType == NAL_SEQ_PARAM_SET)
+    {
+        if (id >= MAX_NUM_SEQ_PARAM_SETS || pStorage->sps[id] == NULL)
+            return(HANTRO_FALSE);
+        pBytes = &pStorage->spsBytes[id];
+    }
+    else
+    {
+        if (id >= MAX_NUM_PIC_PARAM_SETS || pStorage->pps[id] == NULL)
+            return(HANTRO_FALSE);
+        pBytes = &pStorage->ppsBytes[id];
+    }
+
+    return(pBytes->data && pBytes->size == pStrmData->strmBuffSize &&
+           memcmp(pBytes->data, pStrmData->pStrmBuffStart, pBytes->size) == 0 ?
+           HANTRO_TRUE : HANTRO_FALSE);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdStoreParamSetBytes
+
+        Functional description:
+            Keep the bytes of a parameter set NAL unit just stored, for
+            h264bsdIsRepeatedParamSet. Without memory for them the set is
+            simply decoded again when repeated.
+
+        Inputs:
+            pStorage        pointer to storage structure
+            pStrmData       NAL unit, from its header byte on
+            nalUnitType     NAL_SEQ_PARAM_SET or NAL_PIC_PARAM_SET
+            id              id of the parameter set
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdStoreParamSetBytes(storage_t *pStorage, strmData_t *pStrmData,
+    u32 nalUnitType, u32 id)
+{
+
+/* Variables */
+
+    paramSetBytes_t *pBytes;
+
+/* Code */
+
+    ASSERT(pStorage);
+    ASSERT(pStrmData);
+
+    if (nalUnitType == NAL_SEQ_PARAM_SET)
+    {
+        ASSERT(id < MAX_NUM_SEQ_PARAM_SETS);
+        pBytes = &pStorage->spsBytes[id];
+    }
+    else
+    {
+        ASSERT(id < MAX_NUM_PIC_PARAM_SETS);
+        pBytes = &pStorage->ppsBytes[id];
+    }
+
+    if (pBytes->size != pStrmData->strmBuffSize)
+    {
+        FREE(pBytes->data);
+        pBytes->size = 0;
+        ALLOCATE(pBytes->data, pStrmData->strmBuffSize, u8);
+        if (pBytes->data == NULL)
+            return;
+        pBytes->size = pStrmData->strmBuffSize;
+    }
+    memcpy(pBytes->data, pStrmData->pStrmBuffStart, pBytes->size);
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdFreeParamSetBytes
+
+        Functional description:
+            Free the bytes kept by h264bsdStoreParamSetBytes.
+
+        Inputs:
+            pStorage        pointer to storage structure
+
+        Outputs:
+            none
+
+        Returns:
+            none
+
+------------------------------------------------------------------------------*/
+
+void h264bsdFreeParamSetBytes(storage_t *pStorage)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(pStorage);
+
+    for (i = 0; i < MAX_NUM_SEQ_PARAM_SETS; i++)
+    {
+        FREE(pStorage->spsBytes[i].data);
+        pStorage->spsBytes[i].size = 0;
+    }
+    for (i = 0; i < MAX_NUM_PIC_PARAM_SETS; i++)
+    {
+        FREE(pStorage->ppsBytes[i].data);
+        pStorage->ppsBytes[i].size = 0;
+    }
+
+}
+
 /*------------------------------------------------------------------------------
 
     Function: h264bsdActivateParamSets
@@ -275,7 +452,9 @@ u32 h264bsdStorePicParamSet(storage_t *pStorage, picParamSet_t *pPicParamSet)
             When new SPS is activated the function allocates memory for
             macroblock storages and slice group map and (re-)initializes the
             decoded picture buffer. If this is not the first activation the old
-            allocations are freed and FreeDpb called before new allocations.
+            allocations are freed and FreeDpb called before new allocations;
+            macroblock storages and slice group map of the same picture size
+            are kept and cleared instead.
 
         Inputs:
             pStorage        pointer to storage data structure
@@ -301,6 +480,8 @@ u32 h264bsdActivateParamSets(storage_t *pStorage, u32 ppsId, u32 isIdr)
 
     u32 tmp;
     u32 flag;
+    u32 restricted;
+    u32 dpbSize;
 
 /* Code */
 
@@ -341,13 +522,20 @@ u32 h264bsdActivateParamSets(storage_t *pStorage, u32 ppsId, u32 isIdr)
     {
         pStorage->pendingActivation = HANTRO_FALSE;
 
-        FREE(pStorage->mb);
-        FREE(pStorage->sliceGroupMap);
-
-        ALLOCATE(pStorage->mb, pStorage->picSizeInMbs, mbStorage_t);
-        ALLOCATE(pStorage->sliceGroupMap, pStorage->picSizeInMbs, u32);
-        if (pStorage->mb == NULL || pStorage->sliceGroupMap == NULL)
-            return(MEMORY_ALLOCATION_ERROR);
+        if (pStorage->mbStorageSize != pStorage->picSizeInMbs ||
+            pStorage->mb == NULL || pStorage->sliceGroupMap == NULL)
+        {
+            FREE(pStorage->mb);
+            FREE(pStorage->sliceGroupMap);
+            pStorage->mbStorageSize = 0;
+
+            ALLOCATE(pStorage->mb, pStorage->picSizeInMbs, mbStorage_t);
+            ALLOCATE(pStorage->sliceGroupMap, pStorage->picSizeInMbs, u32);
+            if (pStorage->mb == NULL || pStorage->sliceGroupMap == NULL)
+                return(MEMORY_ALLOCATION_ERROR);
+            pStorage->mbStorageSize = pStorage->picSizeInMbs;
+            pStorage->sliceGroupMapFlat = HANTRO_FALSE;
+        }
 
         memset(pStorage->mb, 0,
             pStorage->picSizeInMbs * sizeof(mbStorage_t));
@@ -356,28 +544,49 @@ u32 h264bsdActivateParamSets(storage_t *pStorage, u32 ppsId, u32 isIdr)
             pStorage->activeSps->picWidthInMbs,
             pStorage->picSizeInMbs);
 
+        restricted = pStorage->activeSps->vuiParametersPresentFlag &&
+            pStorage->activeSps->vuiParameters->bitstreamRestrictionFlag;
+
         /* dpb output reordering disabled if
          * 1) application set noReordering flag
          * 2) POC type equal to 2
          * 3) num_reorder_frames in vui equal to 0 */
         if ( pStorage->noReordering ||
              pStorage->activeSps->picOrderCntType == 2 ||
-             (pStorage->activeSps->vuiParametersPresentFlag &&
-              pStorage->activeSps->vuiParameters->bitstreamRestrictionFlag &&
+             (restricted &&
               !pStorage->activeSps->vuiParameters->numReorderFrames) )
             flag = HANTRO_TRUE;
         else
             flag = HANTRO_FALSE;
 
+        /* under memory pressure (see big_alloc.h) the dpb is sized for the
+         * reference frames, and the reorder depth when the vui gives one,
+         * instead of for what the level allows */
+        dpbSize = pStorage->activeSps->maxDpbSize;
+        if (big_alloc_pressure() >= BIG_PRESSURE_DPB)
+        {
+            tmp = MAX(1, pStorage->activeSps->numRefFrames);
+            if (restricted)
+                tmp = MAX(tmp,
+                    pStorage->activeSps->vuiParameters->numReorderFrames);
+            dpbSize = MIN(dpbSize, tmp);
+        }
+
         tmp = h264bsdResetDpb(pStorage->dpb,
             pStorage->activeSps->picWidthInMbs *
             pStorage->activeSps->picHeightInMbs,
-            pStorage->activeSps->maxDpbSize,
+            dpbSize,
             pStorage->activeSps->numRefFrames,
             pStorage->activeSps->maxFrameNum,
             flag);
         if (tmp != HANTRO_OK)
             return(tmp);
+
+        /* low latency: output pictures once more than num_reorder_frames
+         * wait for display instead of when the dpb is full */
+        if (pStorage->lowLatency && restricted)
+            pStorage->dpb->numReorderFrames =
+                pStorage->activeSps->vuiParameters->numReorderFrames;
     }
     else if (ppsId != pStorage->activePpsId)
     {
@@ -451,6 +660,8 @@ void h264bsdResetStorage(storage_t *pStorage)
 
     pStorage->slice->numDecodedMbs = 0;
     pStorage->slice->sliceId = 0;
+    pStorage->rowsDecoded = 0;
+    pStorage->rowsFiltered = 0;
 
     for (i = 0; i < pStorage->picSizeInMbs; i++)
     {
@@ -559,7 +770,8 @@ u32 h264bsdIsEndOfPicture(storage_t *pStorage)
 
         Functional description:
             Compute slice group map. Just call h264bsdDecodeSliceGroupMap with
-            appropriate parameters.
+            appropriate parameters, unless the map already holds the single
+            slice group of the active PPS.
 
         Inputs:
             pStorage                pointer to storage structure
@@ -581,6 +793,17 @@ void h264bsdComputeSliceGroupMap(storage_t *pStorage, u32 sliceGroupChangeCycle)
 
 /* Code */
 
+    /* a map of one slice group is all zeros whatever the change cycle, it
+     * is cleared once and kept as long as the pictures have one group */
+    if (pStorage->activePps->numSliceGroups == 1)
+    {
+        if (pStorage->sliceGroupMapFlat)
+            return;
+        pStorage->sliceGroupMapFlat = HANTRO_TRUE;
+    }
+    else
+        pStorage->sliceGroupMapFlat = HANTRO_FALSE;
+
     h264bsdDecodeSliceGroupMap(pStorage->sliceGroupMap,
                         pStorage->activePps, sliceGroupChangeCycle,
                         pStorage->activeSps->picWidthInMbs,
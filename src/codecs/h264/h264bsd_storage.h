@@ -43,6 +43,7 @@
 #include "h264bsd_seq_param_set.h"
 #include "h264bsd_dpb.h"
 #include "h264bsd_pic_order_cnt.h"
+#include "h264bsd_sei.h"
 
 /*------------------------------------------------------------------------------
     2. Module defines
@@ -71,6 +72,13 @@ typedef struct
     u32 firstCallFlag;
 } aubCheck_t;
 
+/* copy of the bytes of a parameter set NAL unit */
+typedef struct
+{
+    u8 *data;
+    u32 size;
+} paramSetBytes_t;
+
 /* storage data structure, holds all data of a decoder instance */
 typedef struct storage
 {
@@ -83,10 +91,19 @@ typedef struct storage
     seqParamSet_t *sps[MAX_NUM_SEQ_PARAM_SETS];
     picParamSet_t *pps[MAX_NUM_PIC_PARAM_SETS];
 
+    /* NAL unit bytes of the stored parameter sets, a repeated set equal
+     * to them is not decoded again */
+    paramSetBytes_t spsBytes[MAX_NUM_SEQ_PARAM_SETS];
+    paramSetBytes_t ppsBytes[MAX_NUM_PIC_PARAM_SETS];
+
     /* current slice group map, recomputed for each slice */
     u32 *sliceGroupMap;
+    u32 sliceGroupMapFlat; /* map holds a single slice group, nothing to
+                              recompute for pictures of one slice group */
 
     u32 picSizeInMbs;
+    u32 mbStorageSize; /* picSizeInMbs mb and sliceGroupMap are allocated
+                          for, kept over SPS changes of the same size */
 
     /* this flag is set after all macroblocks of a picture successfully
      * decoded -> redundant slices not decoded */
@@ -111,6 +128,14 @@ typedef struct storage
     /* flag to store noOutputReordering flag set by the application */
     u32 noReordering;
 
+    /* flag to output pictures as early as the stream allows, see
+     * h264bsdSetLowLatency */
+    u32 lowLatency;
+
+    /* flag to deblocking filter rows while the picture is decoded, see
+     * h264bsdSetRowFiltering */
+    u32 rowFiltering;
+
     /* DPB */
     dpbStorage_t dpb[1];
 
@@ -123,6 +148,11 @@ typedef struct storage
     /* current processed image */
     image_t currImage[1];
 
+    /* macroblock rows of the current image completely decoded and the ones
+     * deblocking filtered while the image is decoded */
+    u32 rowsDecoded;
+    u32 rowsFiltered;
+
     /* last valid NAL unit header is stored here */
     nalUnit_t prevNalUnit[1];
 
@@ -147,8 +177,22 @@ typedef struct storage
                               HEADERS_RDY to the user */
     u32 intraConcealmentFlag; /* 0 gray picture for corrupted intra
                                  1 previous frame used if available */
+    u32 skipNonRefDeblocking; /* deblocking filter disabled for pictures
+                                 not used for reference */
+    u32 concealment;          /* CONCEAL_FULL or CONCEAL_COPY */
+    u32 totalConcealedMbs;    /* concealed macroblocks of all pictures
+                                 concealed on the calling thread */
+    u32 seiTypes;             /* SEI_TYPE_MASK of the SEI payloads decoded,
+                                 the others are skipped */
+    seiMessage_t sei[1];      /* SEI messages since the last picture */
     u32* conversionBuffer; // used to perform yuv conversion
     size_t conversionBufferSize;
+
+    /* slice threads, NULL when slices are decoded on the calling thread */
+    struct sliceThreads *sliceThreads;
+
+    /* frame threads, NULL when pictures are decoded on the calling thread */
+    struct frameThreads *frameThreads;
 } storage_t;
 
 /*------------------------------------------------------------------------------
@@ -162,6 +206,11 @@ u32 h264bsdIsEndOfPicture(storage_t *pStorage);
 u32 h264bsdStoreSeqParamSet(storage_t *pStorage, seqParamSet_t *pSeqParamSet);
 u32 h264bsdStorePicParamSet(storage_t *pStorage, picParamSet_t *pPicParamSet);
 u32 h264bsdActivateParamSets(storage_t *pStorage, u32 ppsId, u32 isIdr);
+u32 h264bsdIsRepeatedParamSet(storage_t *pStorage, strmData_t *pStrmData,
+    u32 nalUnitType);
+void h264bsdStoreParamSetBytes(storage_t *pStorage, strmData_t *pStrmData,
+    u32 nalUnitType, u32 id);
+void h264bsdFreeParamSetBytes(storage_t *pStorage);
 void h264bsdComputeSliceGroupMap(storage_t *pStorage,
     u32 sliceGroupChangeCycle);
 
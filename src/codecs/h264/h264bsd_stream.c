@@ -26,6 +26,7 @@
      5. Functions
           h264bsdGetBits
           h264bsdShowBits32
+          h264bsdShowBits64
           h264bsdFlushBits
           h264bsdIsByteAligned
 
@@ -37,6 +38,7 @@
 
 #include "h264bsd_util.h"
 #include "h264bsd_stream.h"
+#include "../../../include/bitstream.h"
 
 /*------------------------------------------------------------------------------
     2. External compiler flags
@@ -116,9 +118,31 @@ inline u32 h264bsdGetBits(strmData_t *pStrmData, u32 numBits)
 inline u32 h264bsdShowBits32(strmData_t *pStrmData)
 {
 
-    i32 bits, shift;
-    u32 out;
-    u8 *pStrm;
+    return ((u32)(h264bsdShowBits64(pStrmData) >> 32));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdShowBits64
+
+        Functional description:
+            Read 64 bits from the stream buffer, like h264bsdShowBits32. Bits
+            beyond the end of the stream are set to '0' in the return value.
+
+        Input:
+            pStrmData   pointer to stream data structure
+
+        Output:
+            none
+
+        Returns:
+            bits read from stream
+
+------------------------------------------------------------------------------*/
+
+inline uint64_t h264bsdShowBits64(strmData_t *pStrmData)
+{
 
     ASSERT(pStrmData);
     ASSERT(pStrmData->pStrmCurrPos);
@@ -126,43 +150,9 @@ inline u32 h264bsdShowBits32(strmData_t *pStrmData)
     ASSERT(pStrmData->bitPosInWord ==
            (pStrmData->strmBuffReadBits & 0x7));
 
-    pStrm = pStrmData->pStrmCurrPos;
-
-    /* number of bits left in the buffer */
-    bits = (i32)pStrmData->strmBuffSize*8 - (i32)pStrmData->strmBuffReadBits;
-
-    /* at least 32-bits in the buffer */
-    if (bits >= 32)
-    {
-        u32 bitPosInWord = pStrmData->bitPosInWord;
-        out = ((u32)pStrm[0] << 24) | ((u32)pStrm[1] << 16) |
-              ((u32)pStrm[2] <<  8) | ((u32)pStrm[3]);
-
-        if (bitPosInWord)
-        {
-            u32 byte = (u32)pStrm[4];
-            u32 tmp = (8-bitPosInWord);
-            out <<= bitPosInWord;
-            out |= byte>>tmp;
-        }
-        return (out);
-    }
-    /* at least one bit in the buffer */
-    else if (bits > 0)
-    {
-        shift = (i32)(24 + pStrmData->bitPosInWord);
-        out = (u32)(*pStrm++) << shift;
-        bits -= (i32)(8 - pStrmData->bitPosInWord);
-        while (bits > 0)
-        {
-            shift -= 8;
-            out |= (u32)(*pStrm++) << shift;
-            bits -= 8;
-        }
-        return (out);
-    }
-    else
-        return (0);
+    /* the reader shared with the other codecs, see include/bitstream.h */
+    return (bits_peek64(pStrmData->pStrmBuffStart, pStrmData->strmBuffSize,
+        pStrmData->strmBuffReadBits));
 
 }
 
@@ -33,6 +33,7 @@
     1. Include headers
 ------------------------------------------------------------------------------*/
 
+#include <stdint.h>
 #include "basetype.h"
 
 /*------------------------------------------------------------------------------
@@ -60,6 +61,8 @@ u32 h264bsdGetBits(strmData_t *pStrmData, u32 numBits);
 
 u32 h264bsdShowBits32(strmData_t *pStrmData);
 
+uint64_t h264bsdShowBits64(strmData_t *pStrmData);
+
 u32 h264bsdFlushBits(strmData_t *pStrmData, u32 numBits);
 
 u32 h264bsdIsByteAligned(strmData_t *);
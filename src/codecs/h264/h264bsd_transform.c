@@ -101,9 +101,11 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap)
 
     i32 tmp0, tmp1, tmp2, tmp3;
     i32 d1, d2, d3;
-    u32 row,col;
     u32 qpDiv;
+#ifndef H264DEC_SIMD
+    u32 row,col;
     i32 *ptr;
+#endif
 
 /* Code */
 
@@ -155,6 +157,9 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap)
         data[10] = (d2 * tmp1);
         data[11] = (d3 * tmp2);
 
+#ifdef H264DEC_SIMD
+        return h264bsdInverseTransform4x4(data);
+#else
         /* horizontal transform */
         for (row = 4, ptr = data; row--; ptr += 4)
         {
@@ -187,6 +192,7 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap)
                 ((u32)(data[12] + 512) > 1023) )
                 return(HANTRO_NOK);
         }
+#endif /* H264DEC_SIMD */
     }
     else /* rows 1, 2 and 3 are zero */
     {
@@ -257,11 +263,14 @@ void h264bsdProcessLumaDc(i32 *data, u32 qp)
 
 /* Variables */
 
-    i32 tmp0, tmp1, tmp2, tmp3;
-    u32 row,col;
+    i32 tmp0;
     u32 qpMod, qpDiv;
     i32 levScale;
+#ifndef H264DEC_SIMD
+    i32 tmp1, tmp2, tmp3;
+    u32 row,col;
     i32 *ptr;
+#endif
 
 /* Code */
 
@@ -287,6 +296,14 @@ void h264bsdProcessLumaDc(i32 *data, u32 qp)
     data[11] = data[13];
     data[13] = tmp0;
 
+#ifdef H264DEC_SIMD
+    levScale = levelScale[ qpMod ][0];
+    if (qp >= 12)
+        h264bsdInverseLumaDc4x4(data, levScale << (qpDiv-2), 0, 0);
+    else
+        h264bsdInverseLumaDc4x4(data, levScale, ((1 - qpDiv) == 0) ? 1 : 2,
+            2-qpDiv);
+#else
     /* horizontal transform */
     for (row = 4, ptr = data; row--; ptr += 4)
     {
@@ -334,6 +351,7 @@ void h264bsdProcessLumaDc(i32 *data, u32 qp)
             data[12] = ((tmp0 - tmp3)*levScale+tmp) >> (2-qpDiv);
         }
     }
+#endif /* H264DEC_SIMD */
 
 }
 
@@ -34,6 +34,7 @@
 ------------------------------------------------------------------------------*/
 
 #include "basetype.h"
+#include "h264bsd_cfg.h"
 
 /*------------------------------------------------------------------------------
     2. Module defines
@@ -51,5 +52,13 @@ u32 h264bsdProcessBlock(i32 *data, u32 qp, u32 skip, u32 coeffMap);
 void h264bsdProcessLumaDc(i32 *data, u32 qp);
 void h264bsdProcessChromaDc(i32 *data, u32 qp);
 
+#ifdef H264DEC_SIMD
+/* Kernels of h264bsd_transform_simd.c, blocks in raster order */
+u32 h264bsdInverseTransform4x4(i32 *data);
+void h264bsdInverseLumaDc4x4(i32 *data, i32 levScale, i32 round, u32 shift);
+void h264bsdAddResidual4x4(u8 *out, u32 outStride, const u8 *pred,
+    u32 predStride, const i32 *residual);
+#endif /* H264DEC_SIMD */
+
 #endif /* #ifdef H264SWDEC_TRANSFORM_H */
 
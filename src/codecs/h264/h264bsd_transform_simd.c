@@ -0,0 +1,325 @@
+/*------------------------------------------------------------------------------
+
+    Table of contents
+
+     1. Include headers
+     2. External compiler flags
+     3. Module defines
+     4. Local function prototypes
+     5. Functions
+          h264bsdInverseTransform4x4
+          h264bsdInverseLumaDc4x4
+          h264bsdAddResidual4x4
+
+--------------------------------------------------------------------------------
+
+    SSE2 and NEON kernels for h264bsd_transform.c and for adding residuals
+    into the prediction. Transforms are done in 32-bit lanes, one row or
+    column of a 4x4 block per vector, so the results are bit-exact with the
+    C versions for any input.
+
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+    1. Include headers
+------------------------------------------------------------------------------*/
+
+#include "basetype.h"
+#include "h264bsd_transform.h"
+#include "h264bsd_util.h"
+
+#ifdef H264DEC_SIMD
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <arm_neon.h>
+#endif
+
+/*------------------------------------------------------------------------------
+    2. External compiler flags
+--------------------------------------------------------------------------------
+
+    H264DEC_SIMD is set in h264bsd_cfg.h when the target has SSE2 or NEON.
+
+--------------------------------------------------------------------------------
+    3. Module defines
+------------------------------------------------------------------------------*/
+
+/* Vector helpers, v32 holds four signed 32-bit lanes */
+#if defined(__SSE2__)
+
+typedef __m128i v32;
+
+static inline v32 Load(const i32 *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void Store(i32 *p, v32 a) { _mm_storeu_si128((__m128i*)p, a); }
+static inline v32 Add(v32 a, v32 b) { return _mm_add_epi32(a, b); }
+static inline v32 Sub(v32 a, v32 b) { return _mm_sub_epi32(a, b); }
+static inline v32 Half(v32 a) { return _mm_srai_epi32(a, 1); }
+static inline v32 Round6(v32 a)
+{
+    return _mm_srai_epi32(_mm_add_epi32(a, _mm_set1_epi32(32)), 6);
+}
+
+/* (a * s + r) >> shift, low 32 bits of the product as in C */
+static inline v32 Scale(v32 a, i32 s, i32 r, u32 shift)
+{
+    v32 k = _mm_set1_epi32(s);
+    v32 even = _mm_mul_epu32(a, k);
+    v32 odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), k);
+    v32 p = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+    return _mm_sra_epi32(_mm_add_epi32(p, _mm_set1_epi32(r)),
+        _mm_cvtsi32_si128((int)shift));
+}
+
+/* Non-zero if any lane is outside [-512, 511] */
+static inline u32 OutOfRange(v32 a, v32 b, v32 c, v32 d)
+{
+    v32 lo = _mm_set1_epi32(-512), hi = _mm_set1_epi32(511);
+    v32 m = _mm_or_si128(
+        _mm_or_si128(_mm_cmplt_epi32(a, lo), _mm_cmpgt_epi32(a, hi)),
+        _mm_or_si128(_mm_cmplt_epi32(b, lo), _mm_cmpgt_epi32(b, hi)));
+    m = _mm_or_si128(m,
+        _mm_or_si128(_mm_cmplt_epi32(c, lo), _mm_cmpgt_epi32(c, hi)));
+    m = _mm_or_si128(m,
+        _mm_or_si128(_mm_cmplt_epi32(d, lo), _mm_cmpgt_epi32(d, hi)));
+    return (u32)_mm_movemask_epi8(m);
+}
+
+static inline void Transpose(v32 *r)
+{
+    v32 t0 = _mm_unpacklo_epi32(r[0], r[1]);
+    v32 t1 = _mm_unpacklo_epi32(r[2], r[3]);
+    v32 t2 = _mm_unpackhi_epi32(r[0], r[1]);
+    v32 t3 = _mm_unpackhi_epi32(r[2], r[3]);
+    r[0] = _mm_unpacklo_epi64(t0, t1);
+    r[1] = _mm_unpackhi_epi64(t0, t1);
+    r[2] = _mm_unpacklo_epi64(t2, t3);
+    r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+#else /* NEON */
+
+typedef int32x4_t v32;
+
+static inline v32 Load(const i32 *p) { return vld1q_s32(p); }
+static inline void Store(i32 *p, v32 a) { vst1q_s32(p, a); }
+static inline v32 Add(v32 a, v32 b) { return vaddq_s32(a, b); }
+static inline v32 Sub(v32 a, v32 b) { return vsubq_s32(a, b); }
+static inline v32 Half(v32 a) { return vshrq_n_s32(a, 1); }
+static inline v32 Round6(v32 a)
+{
+    return vshrq_n_s32(vaddq_s32(a, vdupq_n_s32(32)), 6);
+}
+
+static inline v32 Scale(v32 a, i32 s, i32 r, u32 shift)
+{
+    return vshlq_s32(vaddq_s32(vmulq_n_s32(a, s), vdupq_n_s32(r)),
+        vdupq_n_s32(-(i32)shift));
+}
+
+static inline u32 OutOfRange(v32 a, v32 b, v32 c, v32 d)
+{
+    /* (u32)(x + 512) > 1023 as in C */
+    uint32x4_t k = vdupq_n_u32(512), lim = vdupq_n_u32(1023);
+    uint32x4_t m = vorrq_u32(
+        vcgtq_u32(vaddq_u32(vreinterpretq_u32_s32(a), k), lim),
+        vcgtq_u32(vaddq_u32(vreinterpretq_u32_s32(b), k), lim));
+    m = vorrq_u32(m, vcgtq_u32(vaddq_u32(vreinterpretq_u32_s32(c), k), lim));
+    m = vorrq_u32(m, vcgtq_u32(vaddq_u32(vreinterpretq_u32_s32(d), k), lim));
+    return (vgetq_lane_u64(vreinterpretq_u64_u32(m), 0) |
+            vgetq_lane_u64(vreinterpretq_u64_u32(m), 1)) != 0;
+}
+
+static inline void Transpose(v32 *r)
+{
+    int32x4x2_t a = vtrnq_s32(r[0], r[1]);
+    int32x4x2_t b = vtrnq_s32(r[2], r[3]);
+    r[0] = vcombine_s32(vget_low_s32(a.val[0]), vget_low_s32(b.val[0]));
+    r[1] = vcombine_s32(vget_low_s32(a.val[1]), vget_low_s32(b.val[1]));
+    r[2] = vcombine_s32(vget_high_s32(a.val[0]), vget_high_s32(b.val[0]));
+    r[3] = vcombine_s32(vget_high_s32(a.val[1]), vget_high_s32(b.val[1]));
+}
+
+#endif
+
+/*------------------------------------------------------------------------------
+    4. Local function prototypes
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInverseTransform4x4
+
+        Functional description:
+            Inverse transform of a dequantized 4x4 block in raster order:
+            horizontal pass, vertical pass and (x + 32) >> 6.
+
+        Returns:
+            HANTRO_OK       success
+            HANTRO_NOK      result not in valid range [-512, 511]
+
+------------------------------------------------------------------------------*/
+
+u32 h264bsdInverseTransform4x4(i32 *data)
+{
+
+/* Variables */
+
+    v32 r[4], t0, t1, t2, t3;
+
+/* Code */
+
+    ASSERT(data);
+
+    r[0] = Load(data);
+    r[1] = Load(data + 4);
+    r[2] = Load(data + 8);
+    r[3] = Load(data + 12);
+
+    /* horizontal transform: lanes are rows, r[i] is column i */
+    Transpose(r);
+    t0 = Add(r[0], r[2]);
+    t1 = Sub(r[0], r[2]);
+    t2 = Sub(Half(r[1]), r[3]);
+    t3 = Add(r[1], Half(r[3]));
+    r[0] = Add(t0, t3);
+    r[1] = Add(t1, t2);
+    r[2] = Sub(t1, t2);
+    r[3] = Sub(t0, t3);
+
+    /* vertical transform: lanes are columns again, r[i] is row i */
+    Transpose(r);
+    t0 = Add(r[0], r[2]);
+    t1 = Sub(r[0], r[2]);
+    t2 = Sub(Half(r[1]), r[3]);
+    t3 = Add(r[1], Half(r[3]));
+    r[0] = Round6(Add(t0, t3));
+    r[1] = Round6(Add(t1, t2));
+    r[2] = Round6(Sub(t1, t2));
+    r[3] = Round6(Sub(t0, t3));
+
+    Store(data, r[0]);
+    Store(data + 4, r[1]);
+    Store(data + 8, r[2]);
+    Store(data + 12, r[3]);
+
+    return OutOfRange(r[0], r[1], r[2], r[3]) ? HANTRO_NOK : HANTRO_OK;
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdInverseLumaDc4x4
+
+        Functional description:
+            Inverse Hadamard transform of the 4x4 luma DC block in raster
+            order, each result scaled as (x * levScale + round) >> shift.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdInverseLumaDc4x4(i32 *data, i32 levScale, i32 round, u32 shift)
+{
+
+/* Variables */
+
+    v32 r[4], t0, t1, t2, t3;
+
+/* Code */
+
+    ASSERT(data);
+
+    r[0] = Load(data);
+    r[1] = Load(data + 4);
+    r[2] = Load(data + 8);
+    r[3] = Load(data + 12);
+
+    Transpose(r);
+    t0 = Add(r[0], r[2]);
+    t1 = Sub(r[0], r[2]);
+    t2 = Sub(r[1], r[3]);
+    t3 = Add(r[1], r[3]);
+    r[0] = Add(t0, t3);
+    r[1] = Add(t1, t2);
+    r[2] = Sub(t1, t2);
+    r[3] = Sub(t0, t3);
+
+    Transpose(r);
+    t0 = Add(r[0], r[2]);
+    t1 = Sub(r[0], r[2]);
+    t2 = Sub(r[1], r[3]);
+    t3 = Add(r[1], r[3]);
+    Store(data,      Scale(Add(t0, t3), levScale, round, shift));
+    Store(data + 4,  Scale(Add(t1, t2), levScale, round, shift));
+    Store(data + 8,  Scale(Sub(t1, t2), levScale, round, shift));
+    Store(data + 12, Scale(Sub(t0, t3), levScale, round, shift));
+
+}
+
+/*------------------------------------------------------------------------------
+
+    Function: h264bsdAddResidual4x4
+
+        Functional description:
+            out = clip(pred + residual) for a 4x4 block. The residual is in
+            the range [-512, 511] (checked by the transform), so it is added
+            in 16 bits. out and pred may be the same block.
+
+------------------------------------------------------------------------------*/
+
+void h264bsdAddResidual4x4(u8 *out, u32 outStride, const u8 *pred,
+    u32 predStride, const i32 *residual)
+{
+
+/* Variables */
+
+    u32 i;
+
+/* Code */
+
+    ASSERT(out);
+    ASSERT(pred);
+    ASSERT(residual);
+
+    /* two rows per pass */
+    for (i = 2; i; i--)
+    {
+        u32 p0, p1, o0, o1;
+
+        memcpy(&p0, pred, 4);
+        memcpy(&p1, pred + predStride, 4);
+#if defined(__SSE2__)
+        {
+            __m128i res = _mm_packs_epi32(Load(residual), Load(residual + 4));
+            __m128i p = _mm_unpacklo_epi8(
+                _mm_unpacklo_epi32(_mm_cvtsi32_si128((int)p0),
+                    _mm_cvtsi32_si128((int)p1)), _mm_setzero_si128());
+            __m128i o = _mm_packus_epi16(_mm_add_epi16(p, res), res);
+            o0 = (u32)_mm_cvtsi128_si32(o);
+            o1 = (u32)_mm_cvtsi128_si32(_mm_srli_si128(o, 4));
+        }
+#else
+        {
+            int16x8_t res = vcombine_s16(vmovn_s32(Load(residual)),
+                vmovn_s32(Load(residual + 4)));
+            uint32x2_t pp = vset_lane_u32(p1, vdup_n_u32(p0), 1);
+            int16x8_t p = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(pp)));
+            uint32x2_t o = vreinterpret_u32_u8(vqmovun_s16(vaddq_s16(p, res)));
+            o0 = vget_lane_u32(o, 0);
+            o1 = vget_lane_u32(o, 1);
+        }
+#endif
+        memcpy(out, &o0, 4);
+        memcpy(out + outStride, &o1, 4);
+
+        residual += 8;
+        pred += 2*predStride;
+        out += 2*outStride;
+    }
+
+}
+
+#endif /* H264DEC_SIMD */
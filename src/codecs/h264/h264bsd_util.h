@@ -38,6 +38,7 @@
 #include "h264bsd_cfg.h"
 #include "h264bsd_stream.h"
 #include "h264bsd_image.h"
+#include "../../../include/big_alloc.h"
 
 #ifdef _ASSERT_USED
 #include <assert.h>
@@ -138,6 +139,15 @@
 /* macro to clip a value z, so that 0 <= z =< 255 */
 #define CLIP1(z) (((z) < 0) ? 0 : (((z) > 255) ? 255 : (z)))
 
+/* macro to count leading zeros of a non-zero 32-bit value */
+#if defined(__GNUC__)
+#define CLZ(a) ((u32)__builtin_clz(a))
+#elif defined(H264DEC_NEON)
+#define CLZ(a) h264bsdCountLeadingZeros(a)
+#else
+#define CLZ(a) h264bsdCountLeadingZeros(a, 32)
+#endif
+
 /* macro to allocate memory */
 #define ALLOCATE(ptr, count, type) \
 { \
@@ -150,6 +160,18 @@
     free((ptr)); (ptr) = NULL; \
 }
 
+/* macros to allocate and free image data, large buffers mapped in huge
+ * pages where the system allows (see big_alloc.h) */
+#define ALLOCATE_IMAGE(ptr, size) \
+{ \
+    (ptr) = (u8*)big_alloc((size)); \
+}
+
+#define FREE_IMAGE(ptr) \
+{ \
+    big_free((ptr)); (ptr) = NULL; \
+}
+
 #define ALIGN(ptr, bytePos) \
         (ptr + ( ((bytePos - (uintptr_t)ptr) & (bytePos - 1)) / sizeof(*ptr) ))
 
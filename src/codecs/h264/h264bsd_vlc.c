@@ -107,7 +107,7 @@ u32 h264bsdDecodeExpGolombUnsigned(strmData_t *pStrmData, u32 *codeNum)
 
 /* Variables */
 
-    u32 bits, numZeros;
+    u32 bits, numZeros, length;
 
 /* Code */
 
@@ -123,28 +123,15 @@ u32 h264bsdDecodeExpGolombUnsigned(strmData_t *pStrmData, u32 *codeNum)
         *codeNum = 0;
         return(HANTRO_OK);
     }
-    /* second bit is 1 -> code length 3 */
-    else if (bits >= 0x40000000)
+    /* less than 16 leading zeros -> whole code word within the 32 bits,
+     * codeNum + 1 is the value of its last numZeros + 1 bits */
+    else if (bits >= 0x00010000)
     {
-        if (h264bsdFlushBits(pStrmData, 3) == END_OF_STREAM)
+        numZeros = CLZ(bits);
+        length = 2 * numZeros + 1;
+        if (h264bsdFlushBits(pStrmData, length) == END_OF_STREAM)
             return(HANTRO_NOK);
-        *codeNum = 1 + ((bits >> 29) & 0x1);
-        return(HANTRO_OK);
-    }
-    /* third bit is 1 -> code length 5 */
-    else if (bits >= 0x20000000)
-    {
-        if (h264bsdFlushBits(pStrmData, 5) == END_OF_STREAM)
-            return(HANTRO_NOK);
-        *codeNum = 3 + ((bits >> 27) & 0x3);
-        return(HANTRO_OK);
-    }
-    /* fourth bit is 1 -> code length 7 */
-    else if (bits >= 0x10000000)
-    {
-        if (h264bsdFlushBits(pStrmData, 7) == END_OF_STREAM)
-            return(HANTRO_NOK);
-        *codeNum = 7 + ((bits >> 25) & 0x7);
+        *codeNum = (bits >> (32 - length)) - 1;
         return(HANTRO_OK);
     }
     /* other code lengths */
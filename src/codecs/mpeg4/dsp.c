@@ -0,0 +1,192 @@
+// C versions of the MPEG-4 block kernels, see dsp.h
+#include "dsp.h"
+#include "dsp_consts.h"
+#include "../../../include/cpu.h"
+#include <pthread.h>
+
+static inline int clip_sample(int v) {
+    return v < -256 ? -256 : v > 255 ? 255 : v;
+}
+
+// x * 181 / 256 ~ x / sqrt(2), wrapping like 32-bit vector lanes
+static inline int32_t mul181(int32_t x) {
+    return (int32_t)(181u * (uint32_t)x + 128u) >> 8;
+}
+
+static void idct_row(int16_t* blk) {
+    int32_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    x1 = blk[4] * 2048;
+    x2 = blk[6];
+    x3 = blk[2];
+    x4 = blk[1];
+    x5 = blk[7];
+    x6 = blk[5];
+    x7 = blk[3];
+    if (!(x1 | x2 | x3 | x4 | x5 | x6 | x7)) {
+        int16_t dc = (int16_t)(blk[0] * 8);
+        for (int i = 0; i < 8; i++) blk[i] = dc;
+        return;
+    }
+    x0 = blk[0] * 2048 + 128;
+
+    x8 = W7 * (x4 + x5);
+    x4 = x8 + (W1 - W7) * x4;
+    x5 = x8 - (W1 + W7) * x5;
+    x8 = W3 * (x6 + x7);
+    x6 = x8 - (W3 - W5) * x6;
+    x7 = x8 - (W3 + W5) * x7;
+
+    x8 = x0 + x1;
+    x0 -= x1;
+    x1 = W6 * (x3 + x2);
+    x2 = x1 - (W2 + W6) * x2;
+    x3 = x1 + (W2 - W6) * x3;
+    x1 = x4 + x6;
+    x4 -= x6;
+    x6 = x5 + x7;
+    x5 -= x7;
+
+    x7 = x8 + x3;
+    x8 -= x3;
+    x3 = x0 + x2;
+    x0 -= x2;
+    x2 = mul181(x4 + x5);
+    x4 = mul181(x4 - x5);
+
+    // Row results are kept in 16 bits between the passes
+    blk[0] = (int16_t)((x7 + x1) >> 8);
+    blk[1] = (int16_t)((x3 + x2) >> 8);
+    blk[2] = (int16_t)((x0 + x4) >> 8);
+    blk[3] = (int16_t)((x8 + x6) >> 8);
+    blk[4] = (int16_t)((x8 - x6) >> 8);
+    blk[5] = (int16_t)((x0 - x4) >> 8);
+    blk[6] = (int16_t)((x3 - x2) >> 8);
+    blk[7] = (int16_t)((x7 - x1) >> 8);
+}
+
+static void idct_col(int16_t* blk) {
+    int32_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    x1 = blk[8 * 4] * 256;
+    x2 = blk[8 * 6];
+    x3 = blk[8 * 2];
+    x4 = blk[8 * 1];
+    x5 = blk[8 * 7];
+    x6 = blk[8 * 5];
+    x7 = blk[8 * 3];
+    if (!(x1 | x2 | x3 | x4 | x5 | x6 | x7)) {
+        int16_t dc = (int16_t)clip_sample((blk[0] + 32) >> 6);
+        for (int i = 0; i < 8; i++) blk[8 * i] = dc;
+        return;
+    }
+    x0 = blk[0] * 256 + 8192;
+
+    x8 = W7 * (x4 + x5) + 4;
+    x4 = (x8 + (W1 - W7) * x4) >> 3;
+    x5 = (x8 - (W1 + W7) * x5) >> 3;
+    x8 = W3 * (x6 + x7) + 4;
+    x6 = (x8 - (W3 - W5) * x6) >> 3;
+    x7 = (x8 - (W3 + W5) * x7) >> 3;
+
+    x8 = x0 + x1;
+    x0 -= x1;
+    x1 = W6 * (x3 + x2) + 4;
+    x2 = (x1 - (W2 + W6) * x2) >> 3;
+    x3 = (x1 + (W2 - W6) * x3) >> 3;
+    x1 = x4 + x6;
+    x4 -= x6;
+    x6 = x5 + x7;
+    x5 -= x7;
+
+    x7 = x8 + x3;
+    x8 -= x3;
+    x3 = x0 + x2;
+    x0 -= x2;
+    x2 = mul181(x4 + x5);
+    x4 = mul181(x4 - x5);
+
+    blk[8 * 0] = (int16_t)clip_sample((x7 + x1) >> 14);
+    blk[8 * 1] = (int16_t)clip_sample((x3 + x2) >> 14);
+    blk[8 * 2] = (int16_t)clip_sample((x0 + x4) >> 14);
+    blk[8 * 3] = (int16_t)clip_sample((x8 + x6) >> 14);
+    blk[8 * 4] = (int16_t)clip_sample((x8 - x6) >> 14);
+    blk[8 * 5] = (int16_t)clip_sample((x0 - x4) >> 14);
+    blk[8 * 6] = (int16_t)clip_sample((x3 - x2) >> 14);
+    blk[8 * 7] = (int16_t)clip_sample((x7 - x1) >> 14);
+}
+
+void mpeg4_idct_c(int16_t* block) {
+    for (int i = 0; i < 8; i++) idct_row(block + 8 * i);
+    for (int i = 0; i < 8; i++) idct_col(block + i);
+}
+
+static inline uint8_t clip_pixel(int v) {
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+void mpeg4_put_block_c(const int16_t* block, uint8_t* dst, int stride) {
+    for (int y = 0; y < 8; y++, dst += stride, block += 8)
+        for (int x = 0; x < 8; x++) dst[x] = clip_pixel(block[x]);
+}
+
+void mpeg4_add_block_c(const int16_t* block, uint8_t* dst, int stride) {
+    for (int y = 0; y < 8; y++, dst += stride, block += 8)
+        for (int x = 0; x < 8; x++) dst[x] = clip_pixel(dst[x] + block[x]);
+}
+
+void mpeg4_mc_c(uint8_t* dst, const uint8_t* src, int stride, int size, int dxy, int rounding) {
+    const uint8_t* below = src + stride;
+    for (int y = 0; y < size; y++, dst += stride, src += stride, below += stride) {
+        for (int x = 0; x < size; x++) {
+            switch (dxy) {
+            case 0: dst[x] = src[x]; break;
+            case 1: dst[x] = (uint8_t)((src[x] + src[x + 1] + 1 - rounding) >> 1); break;
+            case 2: dst[x] = (uint8_t)((src[x] + below[x] + 1 - rounding) >> 1); break;
+            default:
+                dst[x] = (uint8_t)((src[x] + src[x + 1] + below[x] + below[x + 1] + 2 - rounding) >> 2);
+                break;
+            }
+        }
+    }
+}
+
+#ifdef MPEG4_SIMD
+mpeg4_dsp_t mpeg4_dsp = { mpeg4_idct_simd, mpeg4_put_block_simd, mpeg4_add_block_simd, mpeg4_mc_simd };
+#else
+mpeg4_dsp_t mpeg4_dsp = { mpeg4_idct_c, mpeg4_put_block_c, mpeg4_add_block_c, mpeg4_mc_c };
+#endif
+
+// The versions, best first, see include/cpu.h
+static const struct {
+    unsigned features;
+    mpeg4_dsp_t dsp;
+    const char *name;
+} dsp_table[] = {
+#if defined(MPEG4_SIMD) && defined(__SSE2__)
+    { CPU_SSE2, { mpeg4_idct_simd, mpeg4_put_block_simd, mpeg4_add_block_simd, mpeg4_mc_simd }, "sse2" },
+#elif defined(MPEG4_SIMD)
+    { CPU_NEON, { mpeg4_idct_simd, mpeg4_put_block_simd, mpeg4_add_block_simd, mpeg4_mc_simd }, "neon" },
+#endif
+    { 0, { mpeg4_idct_c, mpeg4_put_block_c, mpeg4_add_block_c, mpeg4_mc_c }, "c" },
+};
+
+static pthread_once_t dsp_once = PTHREAD_ONCE_INIT;
+
+static void dsp_select(void) {
+    unsigned features = cpu_features();
+    size_t i = 0;
+    while ((dsp_table[i].features & features) != dsp_table[i].features) i++;
+    mpeg4_dsp = dsp_table[i].dsp;
+}
+
+void mpeg4_dsp_init(void) {
+    pthread_once(&dsp_once, dsp_select);
+}
+
+int mpeg4_dsp_use_version(size_t i, const char **name) {
+    if (i >= sizeof(dsp_table) / sizeof(dsp_table[0])) return -1;
+    *name = dsp_table[i].name;
+    if ((dsp_table[i].features & cpu_features()) != dsp_table[i].features) return 0;
+    pthread_once(&dsp_once, dsp_select);
+    mpeg4_dsp = dsp_table[i].dsp;
+    return 1;
+}
@@ -0,0 +1,71 @@
+#ifndef MPEG4_DSP_H
+#define MPEG4_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// With SSE2 or NEON the IDCT, the block stores and the motion
+// compensation use the vector code of dsp_simd.c. Define MPEG4_NO_SIMD to
+// build the C versions only.
+#if !defined(MPEG4_NO_SIMD) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define MPEG4_SIMD
+#endif
+
+// 8x8 inverse DCT in place, raster order. Input coefficients are in
+// [-2048, 2047], output samples are clipped to [-256, 255]. Row/column
+// separable Chen-Wang factorization in 11-bit fixed point (IEEE 1180
+// accurate); the SIMD version is bit-exact with the C one.
+void mpeg4_idct_c(int16_t* block);
+
+// Store an IDCT output block: put writes it clipped to [0, 255] (intra),
+// add adds it to the prediction already in dst (inter)
+void mpeg4_put_block_c(const int16_t* block, uint8_t* dst, int stride);
+void mpeg4_add_block_c(const int16_t* block, uint8_t* dst, int stride);
+
+// Half-pel motion compensation of a size x size block (16 or 8) from src
+// to dst, both with `stride`. dxy is the half-pel position, horizontal in
+// bit 0 and vertical in bit 1; `rounding` is vop_rounding_type, which
+// rounds the averages down instead of up. Reads one more column and row
+// than the block when the position needs them.
+void mpeg4_mc_c(uint8_t* dst, const uint8_t* src, int stride, int size, int dxy, int rounding);
+
+#ifdef MPEG4_SIMD
+void mpeg4_idct_simd(int16_t* block);
+void mpeg4_put_block_simd(const int16_t* block, uint8_t* dst, int stride);
+void mpeg4_add_block_simd(const int16_t* block, uint8_t* dst, int stride);
+void mpeg4_mc_simd(uint8_t* dst, const uint8_t* src, int stride, int size, int dxy, int rounding);
+#endif
+
+// The versions the decoder calls: the vector ones when the CPU runs them
+// (include/cpu.h), the C ones otherwise. Set up by mpeg4_dsp_init(); until
+// then the ones of the ISA the program was built for.
+typedef struct {
+    void (*idct)(int16_t* block);
+    void (*put_block)(const int16_t* block, uint8_t* dst, int stride);
+    void (*add_block)(const int16_t* block, uint8_t* dst, int stride);
+    void (*mc)(uint8_t* dst, const uint8_t* src, int stride, int size, int dxy, int rounding);
+} mpeg4_dsp_t;
+
+extern mpeg4_dsp_t mpeg4_dsp;
+void mpeg4_dsp_init(void);
+// Kernel check (bin/kernels): make version i of the table the one called
+// from now on, i counting from 0, best first, the C one last. Returns 1
+// when it is in use, 0 when the CPU does not run it and -1 past the last
+// one; *name is the version's name unless -1. Not while other threads
+// decode.
+int mpeg4_dsp_use_version(size_t i, const char **name);
+
+#define mpeg4_idct      mpeg4_dsp.idct
+#define mpeg4_put_block mpeg4_dsp.put_block
+#define mpeg4_add_block mpeg4_dsp.add_block
+#define mpeg4_mc        mpeg4_dsp.mc
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MPEG4_DSP_H
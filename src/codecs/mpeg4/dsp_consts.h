@@ -0,0 +1,13 @@
+#ifndef MPEG4_DSP_CONSTS_H
+#define MPEG4_DSP_CONSTS_H
+
+// IDCT constants shared by dsp.c and dsp_simd.c:
+// 2048 * sqrt(2) * cos(k * pi / 16)
+#define W1 2841
+#define W2 2676
+#define W3 2408
+#define W5 1609
+#define W6 1108
+#define W7 565
+
+#endif // MPEG4_DSP_CONSTS_H
@@ -0,0 +1,310 @@
+// SSE2 and NEON versions of the MPEG-4 block kernels, see dsp.h. The IDCT
+// works in 32-bit lanes, four rows (then columns) per vector, with the
+// products of the C version regrouped into pairs a * ca + b * cb, so it is
+// bit-exact with mpeg4_idct_c for any input.
+#include "dsp.h"
+
+#ifdef MPEG4_SIMD
+
+#include "dsp_consts.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+typedef __m128i v16;    // eight int16 lanes
+typedef __m128i v32;    // four int32 lanes
+
+static inline v16 load16(const int16_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void store16(int16_t* p, v16 a) { _mm_storeu_si128((__m128i*)p, a); }
+static inline v32 widen_lo(v16 a) { return _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16); }
+static inline v32 widen_hi(v16 a) { return _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16); }
+static inline v32 splat(int32_t x) { return _mm_set1_epi32(x); }
+static inline v32 add(v32 a, v32 b) { return _mm_add_epi32(a, b); }
+static inline v32 sub(v32 a, v32 b) { return _mm_sub_epi32(a, b); }
+static inline v32 shl(v32 a, int n) { return _mm_slli_epi32(a, n); }
+static inline v32 sra(v32 a, int n) { return _mm_srai_epi32(a, n); }
+
+// a * ca + b * cb, a and b in int16 range: one pmaddwd on (a, b) pairs
+static inline v32 mul_add(v32 a, int ca, v32 b, int cb) {
+    v32 ab = _mm_or_si128(_mm_and_si128(a, _mm_set1_epi32(0xffff)), _mm_slli_epi32(b, 16));
+    return _mm_madd_epi16(ab, _mm_set1_epi32((int32_t)(((uint32_t)cb << 16) | ((uint32_t)ca & 0xffff))));
+}
+
+// x * 181 in 32 bits, as 128x + 32x + 16x + 4x + x
+static inline v32 mul181(v32 x) {
+    return add(add(shl(x, 7), shl(x, 5)), add(shl(x, 4), add(shl(x, 2), x)));
+}
+
+// Lanes of lo then hi, truncated to 16 bits as the C stores do
+static inline v16 narrow_wrap(v32 lo, v32 hi) {
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16),
+                           _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+}
+
+// Lanes of lo then hi, clipped to [-256, 255]
+static inline v16 narrow_clip(v32 lo, v32 hi) {
+    v16 a = _mm_packs_epi32(lo, hi);
+    return _mm_max_epi16(_mm_min_epi16(a, _mm_set1_epi16(255)), _mm_set1_epi16(-256));
+}
+
+static inline void transpose(v16* r) {
+    v16 a0 = _mm_unpacklo_epi16(r[0], r[1]), a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    v16 a2 = _mm_unpacklo_epi16(r[2], r[3]), a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    v16 a4 = _mm_unpacklo_epi16(r[4], r[5]), a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    v16 a6 = _mm_unpacklo_epi16(r[6], r[7]), a7 = _mm_unpackhi_epi16(r[6], r[7]);
+    v16 b0 = _mm_unpacklo_epi32(a0, a2), b1 = _mm_unpackhi_epi32(a0, a2);
+    v16 b2 = _mm_unpacklo_epi32(a1, a3), b3 = _mm_unpackhi_epi32(a1, a3);
+    v16 b4 = _mm_unpacklo_epi32(a4, a6), b5 = _mm_unpackhi_epi32(a4, a6);
+    v16 b6 = _mm_unpacklo_epi32(a5, a7), b7 = _mm_unpackhi_epi32(a5, a7);
+    r[0] = _mm_unpacklo_epi64(b0, b4);
+    r[1] = _mm_unpackhi_epi64(b0, b4);
+    r[2] = _mm_unpacklo_epi64(b1, b5);
+    r[3] = _mm_unpackhi_epi64(b1, b5);
+    r[4] = _mm_unpacklo_epi64(b2, b6);
+    r[5] = _mm_unpackhi_epi64(b2, b6);
+    r[6] = _mm_unpacklo_epi64(b3, b7);
+    r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+static inline void put8(uint8_t* dst, v16 a) {
+    _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(a, a));
+}
+
+static inline void add8(uint8_t* dst, v16 a) {
+    v16 p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)dst), _mm_setzero_si128());
+    p = _mm_add_epi16(p, a);
+    _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(p, p));
+}
+
+typedef __m128i v8;     // sixteen uint8 lanes, or eight in the low half
+
+static inline v8 load_row(const uint8_t* p, int size) {
+    return size == 16 ? _mm_loadu_si128((const __m128i*)p) : _mm_loadl_epi64((const __m128i*)p);
+}
+
+static inline void store_row(uint8_t* p, v8 a, int size) {
+    if (size == 16) _mm_storeu_si128((__m128i*)p, a);
+    else _mm_storel_epi64((__m128i*)p, a);
+}
+
+// (a + b + 1 - rounding) >> 1: pavgb rounds up, the xor bit undoes it
+static inline v8 avg2(v8 a, v8 b, int rounding) {
+    v8 avg = _mm_avg_epu8(a, b);
+    if (!rounding) return avg;
+    return _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+// (a + b + c + d + 2 - rounding) >> 2 in 16-bit lanes
+static inline v8 avg4(v8 a, v8 b, v8 c, v8 d, int rounding) {
+    v8 z = _mm_setzero_si128(), r = _mm_set1_epi16((short)(2 - rounding));
+    v8 lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(b, z)),
+                          _mm_add_epi16(_mm_unpacklo_epi8(c, z), _mm_unpacklo_epi8(d, z)));
+    v8 hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(b, z)),
+                          _mm_add_epi16(_mm_unpackhi_epi8(c, z), _mm_unpackhi_epi8(d, z)));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, r), 2);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, r), 2);
+    return _mm_packus_epi16(lo, hi);
+}
+
+#else // NEON
+#include <arm_neon.h>
+
+typedef int16x8_t v16;
+typedef int32x4_t v32;
+
+static inline v16 load16(const int16_t* p) { return vld1q_s16(p); }
+static inline void store16(int16_t* p, v16 a) { vst1q_s16(p, a); }
+static inline v32 widen_lo(v16 a) { return vmovl_s16(vget_low_s16(a)); }
+static inline v32 widen_hi(v16 a) { return vmovl_s16(vget_high_s16(a)); }
+static inline v32 splat(int32_t x) { return vdupq_n_s32(x); }
+static inline v32 add(v32 a, v32 b) { return vaddq_s32(a, b); }
+static inline v32 sub(v32 a, v32 b) { return vsubq_s32(a, b); }
+static inline v32 shl(v32 a, int n) { return vshlq_s32(a, vdupq_n_s32(n)); }
+static inline v32 sra(v32 a, int n) { return vshlq_s32(a, vdupq_n_s32(-n)); }
+
+static inline v32 mul_add(v32 a, int ca, v32 b, int cb) {
+    return vmlaq_n_s32(vmulq_n_s32(a, ca), b, cb);
+}
+
+static inline v32 mul181(v32 x) { return vmulq_n_s32(x, 181); }
+
+static inline v16 narrow_wrap(v32 lo, v32 hi) {
+    return vcombine_s16(vmovn_s32(lo), vmovn_s32(hi));
+}
+
+static inline v16 narrow_clip(v32 lo, v32 hi) {
+    v16 a = vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi));
+    return vmaxq_s16(vminq_s16(a, vdupq_n_s16(255)), vdupq_n_s16(-256));
+}
+
+static inline void transpose(v16* r) {
+    int16x8x2_t t01 = vtrnq_s16(r[0], r[1]), t23 = vtrnq_s16(r[2], r[3]);
+    int16x8x2_t t45 = vtrnq_s16(r[4], r[5]), t67 = vtrnq_s16(r[6], r[7]);
+    int32x4x2_t u02 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[0]), vreinterpretq_s32_s16(t23.val[0]));
+    int32x4x2_t u13 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[1]), vreinterpretq_s32_s16(t23.val[1]));
+    int32x4x2_t u46 = vtrnq_s32(vreinterpretq_s32_s16(t45.val[0]), vreinterpretq_s32_s16(t67.val[0]));
+    int32x4x2_t u57 = vtrnq_s32(vreinterpretq_s32_s16(t45.val[1]), vreinterpretq_s32_s16(t67.val[1]));
+#define LO(x) vget_low_s16(vreinterpretq_s16_s32(x))
+#define HI(x) vget_high_s16(vreinterpretq_s16_s32(x))
+    r[0] = vcombine_s16(LO(u02.val[0]), LO(u46.val[0]));
+    r[1] = vcombine_s16(LO(u13.val[0]), LO(u57.val[0]));
+    r[2] = vcombine_s16(LO(u02.val[1]), LO(u46.val[1]));
+    r[3] = vcombine_s16(LO(u13.val[1]), LO(u57.val[1]));
+    r[4] = vcombine_s16(HI(u02.val[0]), HI(u46.val[0]));
+    r[5] = vcombine_s16(HI(u13.val[0]), HI(u57.val[0]));
+    r[6] = vcombine_s16(HI(u02.val[1]), HI(u46.val[1]));
+    r[7] = vcombine_s16(HI(u13.val[1]), HI(u57.val[1]));
+#undef LO
+#undef HI
+}
+
+static inline void put8(uint8_t* dst, v16 a) {
+    vst1_u8(dst, vqmovun_s16(a));
+}
+
+static inline void add8(uint8_t* dst, v16 a) {
+    v16 p = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(dst)));
+    vst1_u8(dst, vqmovun_s16(vaddq_s16(p, a)));
+}
+
+typedef uint8x16_t v8;
+
+static inline v8 load_row(const uint8_t* p, int size) {
+    return size == 16 ? vld1q_u8(p) : vcombine_u8(vld1_u8(p), vdup_n_u8(0));
+}
+
+static inline void store_row(uint8_t* p, v8 a, int size) {
+    if (size == 16) vst1q_u8(p, a);
+    else vst1_u8(p, vget_low_u8(a));
+}
+
+static inline v8 avg2(v8 a, v8 b, int rounding) {
+    return rounding ? vhaddq_u8(a, b) : vrhaddq_u8(a, b);
+}
+
+static inline v8 avg4(v8 a, v8 b, v8 c, v8 d, int rounding) {
+    uint16x8_t r = vdupq_n_u16((uint16_t)(2 - rounding));
+    uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)),
+                              vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+    uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)),
+                              vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+    return vcombine_u8(vshrn_n_u16(vaddq_u16(lo, r), 2), vshrn_n_u16(vaddq_u16(hi, r), 2));
+}
+
+#endif
+
+// One pass of the transform on four lanes. c[k] holds input k; results
+// come back in c. Rows (first pass) keep 8 more bits of precision than
+// columns, which round (+4 >> 3) after the first multiplies.
+static inline void idct_pass(v32* c, int col) {
+    v32 x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    if (!col) {
+        x0 = add(shl(c[0], 11), splat(128));
+        x1 = shl(c[4], 11);
+        x4 = mul_add(c[1], W1, c[7], W7);
+        x5 = mul_add(c[1], W7, c[7], -W1);
+        x6 = mul_add(c[5], W5, c[3], W3);
+        x7 = mul_add(c[5], W3, c[3], -W5);
+        x2 = mul_add(c[2], W6, c[6], -W2);
+        x3 = mul_add(c[2], W2, c[6], W6);
+    } else {
+        v32 r = splat(4);
+        x0 = add(shl(c[0], 8), splat(8192));
+        x1 = shl(c[4], 8);
+        x4 = sra(add(mul_add(c[1], W1, c[7], W7), r), 3);
+        x5 = sra(add(mul_add(c[1], W7, c[7], -W1), r), 3);
+        x6 = sra(add(mul_add(c[5], W5, c[3], W3), r), 3);
+        x7 = sra(add(mul_add(c[5], W3, c[3], -W5), r), 3);
+        x2 = sra(add(mul_add(c[2], W6, c[6], -W2), r), 3);
+        x3 = sra(add(mul_add(c[2], W2, c[6], W6), r), 3);
+    }
+
+    x8 = add(x0, x1);
+    x0 = sub(x0, x1);
+    x1 = add(x4, x6);
+    x4 = sub(x4, x6);
+    x6 = add(x5, x7);
+    x5 = sub(x5, x7);
+
+    x7 = add(x8, x3);
+    x8 = sub(x8, x3);
+    x3 = add(x0, x2);
+    x0 = sub(x0, x2);
+    x2 = sra(add(mul181(add(x4, x5)), splat(128)), 8);
+    x4 = sra(add(mul181(sub(x4, x5)), splat(128)), 8);
+
+    int shift = col ? 14 : 8;
+    c[0] = sra(add(x7, x1), shift);
+    c[1] = sra(add(x3, x2), shift);
+    c[2] = sra(add(x0, x4), shift);
+    c[3] = sra(add(x8, x6), shift);
+    c[4] = sra(sub(x8, x6), shift);
+    c[5] = sra(sub(x0, x4), shift);
+    c[6] = sra(sub(x3, x2), shift);
+    c[7] = sra(sub(x7, x1), shift);
+}
+
+// Both passes; c[k] holds input k for lanes 0-3 and c[8 + k] for lanes 4-7
+static inline void idct_8(v16* r, int col) {
+    v32 lo[8], hi[8];
+    for (int k = 0; k < 8; k++) {
+        lo[k] = widen_lo(r[k]);
+        hi[k] = widen_hi(r[k]);
+    }
+    idct_pass(lo, col);
+    idct_pass(hi, col);
+    for (int k = 0; k < 8; k++)
+        r[k] = col ? narrow_clip(lo[k], hi[k]) : narrow_wrap(lo[k], hi[k]);
+}
+
+static inline void idct(const int16_t* block, v16* r) {
+    for (int i = 0; i < 8; i++) r[i] = load16(block + 8 * i);
+    transpose(r);       // r[k]: coefficient k of each row
+    idct_8(r, 0);       // r[j]: output j of each row
+    transpose(r);       // r[i]: row i
+    idct_8(r, 1);       // r[i]: output row i
+}
+
+void mpeg4_idct_simd(int16_t* block) {
+    v16 r[8];
+    idct(block, r);
+    for (int i = 0; i < 8; i++) store16(block + 8 * i, r[i]);
+}
+
+void mpeg4_put_block_simd(const int16_t* block, uint8_t* dst, int stride) {
+    for (int i = 0; i < 8; i++, dst += stride) put8(dst, load16(block + 8 * i));
+}
+
+void mpeg4_add_block_simd(const int16_t* block, uint8_t* dst, int stride) {
+    for (int i = 0; i < 8; i++, dst += stride) add8(dst, load16(block + 8 * i));
+}
+
+// The row below is loaded once and kept for the next row
+void mpeg4_mc_simd(uint8_t* dst, const uint8_t* src, int stride, int size, int dxy, int rounding) {
+    v8 top = load_row(src, size), top1 = dxy == 3 ? load_row(src + 1, size) : top;
+    for (int y = 0; y < size; y++, dst += stride, src += stride) {
+        switch (dxy) {
+        case 0:
+            store_row(dst, load_row(src, size), size);
+            break;
+        case 1:
+            store_row(dst, avg2(load_row(src, size), load_row(src + 1, size), rounding), size);
+            break;
+        case 2: {
+            v8 below = load_row(src + stride, size);
+            store_row(dst, avg2(top, below, rounding), size);
+            top = below;
+            break;
+        }
+        default: {
+            v8 below = load_row(src + stride, size), below1 = load_row(src + stride + 1, size);
+            store_row(dst, avg4(top, top1, below, below1, rounding), size);
+            top = below;
+            top1 = below1;
+            break;
+        }
+        }
+    }
+}
+
+#endif // MPEG4_SIMD
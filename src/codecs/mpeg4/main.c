@@ -1,216 +1,811 @@
+// MPEG-4 Part 2 (ISO/IEC 14496-2) video decoder: Simple profile I- and
+// P-VOPs, rectangular 8-bit VOLs with H.263 or MPEG quantization, AC/DC
+// prediction, half-pel and 4MV motion compensation and video packets.
+// B-VOPs and the tools of the advanced profiles are reported as
+// MPEG4_ERROR_UNSUPPORTED.
 #include "main.h"
+#include "../../../include/bitstream.h"
+#include "dsp.h"
+#include "vlc.h"
 #include <stdlib.h>
 #include <string.h>
 
+#define MAX_SIZE 2048
 
+// Edge around the frames for motion vectors pointing out of the VOP; at
+// least a block and the half-pel column more
+#define PAD_Y  32
+#define PAD_UV 16
+
+#define VOP_I 0
+#define VOP_P 1
+
+static const uint8_t zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// With AC prediction from the block above
+static const uint8_t alternate_horizontal[64] = {
+     0,  1,  2,  3,  8,  9, 16, 17, 10, 11,  4,  5,  6,  7, 15, 14,
+    13, 12, 19, 18, 24, 25, 32, 33, 26, 27, 20, 21, 22, 23, 28, 29,
+    30, 31, 34, 35, 40, 41, 48, 49, 42, 43, 36, 37, 38, 39, 44, 45,
+    46, 47, 50, 51, 56, 57, 58, 59, 52, 53, 54, 55, 60, 61, 62, 63
+};
+
+// With AC prediction from the block on the left
+static const uint8_t alternate_vertical[64] = {
+     0,  8, 16, 24,  1,  9,  2, 10, 17, 25, 32, 40, 48, 56, 57, 49,
+    41, 33, 26, 18,  3, 11,  4, 12, 19, 27, 34, 42, 50, 58, 35, 43,
+    51, 59, 20, 28,  5, 13,  6, 14, 21, 29, 36, 44, 52, 60, 37, 45,
+    53, 61, 22, 30,  7, 15, 23, 31, 38, 46, 54, 62, 39, 47, 55, 63
+};
+
+// Default matrices of the MPEG quantization, raster order
+static const uint8_t default_intra_matrix[64] = {
+     8, 17, 18, 19, 21, 23, 25, 27, 17, 18, 19, 21, 23, 25, 27, 28,
+    20, 21, 22, 23, 24, 26, 28, 30, 21, 22, 23, 24, 26, 28, 30, 32,
+    22, 23, 24, 26, 28, 30, 32, 35, 23, 24, 26, 28, 30, 32, 35, 38,
+    25, 26, 28, 30, 32, 35, 38, 41, 27, 28, 30, 32, 35, 38, 41, 45
+};
+
+static const uint8_t default_inter_matrix[64] = {
+    16, 17, 18, 19, 20, 21, 22, 23, 17, 18, 19, 20, 21, 22, 23, 24,
+    18, 19, 20, 21, 22, 23, 24, 25, 19, 20, 21, 22, 23, 24, 26, 27,
+    20, 21, 22, 23, 25, 26, 27, 28, 21, 22, 23, 24, 26, 27, 28, 30,
+    22, 23, 24, 26, 27, 28, 30, 31, 23, 24, 25, 27, 28, 30, 31, 33
+};
+
+static const int dquant_table[4] = {-1, -2, 1, 2};
+
+// QP from which intra DC coefficients are coded with the AC codes, by
+// intra_dc_vlc_thr
+static const int intra_dc_threshold[8] = {32, 13, 15, 17, 19, 21, 23, 0};
+
+// AC/DC prediction state of a decoded 8x8 block: the reconstructed DC and
+// the quantized first row and column
 typedef struct {
-    uint32_t cache;
-    int bits_left;
-    const uint8_t* data;
-    const uint8_t* end;
-    const uint8_t* ptr;
-} bit_reader_t;
+    int16_t dc;
+    int16_t row[7];
+    int16_t col[7];
+} pred_block_t;
 
+// Decoded picture inside its padding
+typedef struct {
+    uint8_t* memory;
+    uint8_t* y;
+    uint8_t* u;
+    uint8_t* v;
+} frame_t;
 
 struct mpeg4_decoder {
-    int width;
+    int width;              // Display size, from the VOL
     int height;
     int mb_width;
     int mb_height;
     int stride_y;
     int stride_uv;
-    
-    
-    uint8_t* frame_memory;
-    uint8_t* y_plane;
-    uint8_t* u_plane;
-    uint8_t* v_plane;
-    
-    
-    short blocks[6][64];
+
+    // The VOP being decoded and the last one, its reference; they trade
+    // places after each coded VOP
+    frame_t frames[2];
+    frame_t* cur;
+    frame_t* ref;
+
+    // Video object layer
+    int have_vol;
+    int time_inc_bits;
+    int quant_type;         // 0 H.263, 1 MPEG
+    int resync_disabled;
+    uint8_t intra_matrix[64];
+    uint8_t inter_matrix[64];
+
+    // Current VOP
+    int vop_type;
+    int intra_dc_thr;
+    int fcode;
+    int rounding;
+    int qp;
+
+    // Per macroblock: the video packet it was decoded in (a number that
+    // only grows, so no reset between VOPs), whether it is intra and its
+    // QP. Neighbours from another packet are not used for prediction.
+    unsigned packet;
+    unsigned* mb_packet;
+    uint8_t* mb_intra;
+    uint8_t* mb_qp;
+    int16_t (*mv)[4][2];    // Per MB and luma block, half pels
+    pred_block_t* pred[3];  // Luma grid of 2x2 blocks per MB, Cb, Cr
+
+    int16_t block[64];
 };
 
+static int clip(int v, int lo, int hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// Round half away from zero
+static int rounded_div(int a, int b) {
+    return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+static int dc_scaler(int qp, int chroma) {
+    if (qp < 5) return 8;
+    if (chroma) return qp < 25 ? (qp + 13) / 2 : qp - 6;
+    return qp < 9 ? 2 * qp : qp < 25 ? qp + 8 : 2 * qp - 16;
+}
 
-static void init_bit_reader(bit_reader_t* br, const uint8_t* data, size_t size) {
-    br->data = data;
-    br->ptr = data;
-    br->end = data + size;
-    br->cache = 0;
-    br->bits_left = 0;
+static void free_frames(mpeg4_decoder_t* dec) {
+    free(dec->frames[0].memory);
+    free(dec->frames[1].memory);
+    free(dec->mb_packet);
+    free(dec->mb_intra);
+    free(dec->mb_qp);
+    free(dec->mv);
+    free(dec->pred[0]);
+    memset(dec->frames, 0, sizeof(dec->frames));
+    dec->mb_packet = NULL;
+    dec->mb_intra = NULL;
+    dec->mb_qp = NULL;
+    dec->mv = NULL;
+    dec->pred[0] = dec->pred[1] = dec->pred[2] = NULL;
 }
 
-static inline int get_bits(bit_reader_t* br, int n) {
-    while (br->bits_left < n) {
-        if (br->ptr < br->end) {
-            br->cache |= ((uint32_t)(*br->ptr++)) << (24 - br->bits_left);
-            br->bits_left += 8;
-        } else {
-            return 0; 
+static mpeg4_error_t alloc_frames(mpeg4_decoder_t* dec, int width, int height) {
+    if (width <= 0 || height <= 0 || width > MAX_SIZE || height > MAX_SIZE)
+        return MPEG4_ERROR_UNSUPPORTED;
+    free_frames(dec);
+
+    dec->width = width;
+    dec->height = height;
+    dec->mb_width = (width + 15) / 16;
+    dec->mb_height = (height + 15) / 16;
+    dec->stride_y = dec->mb_width * 16 + 2 * PAD_Y;
+    dec->stride_uv = dec->mb_width * 8 + 2 * PAD_UV;
+
+    size_t mbs = (size_t)dec->mb_width * dec->mb_height;
+    size_t y_size = (size_t)dec->stride_y * (dec->mb_height * 16 + 2 * PAD_Y);
+    size_t uv_size = (size_t)dec->stride_uv * (dec->mb_height * 8 + 2 * PAD_UV);
+    int ok = 1;
+    for (int i = 0; i < 2; i++) {
+        frame_t* f = &dec->frames[i];
+        f->memory = (uint8_t*)malloc(y_size + 2 * uv_size);
+        if (!f->memory) {
+            ok = 0;
+            continue;
         }
+        memset(f->memory, 0, y_size);
+        memset(f->memory + y_size, 128, 2 * uv_size);
+        f->y = f->memory + (size_t)PAD_Y * dec->stride_y + PAD_Y;
+        f->u = f->memory + y_size + (size_t)PAD_UV * dec->stride_uv + PAD_UV;
+        f->v = f->u + uv_size;
     }
-    
-    int result = br->cache >> (32 - n);
-    br->cache <<= n;
-    br->bits_left -= n;
-    return result;
+    dec->cur = &dec->frames[0];
+    dec->ref = &dec->frames[1];
+    dec->mb_packet = (unsigned*)calloc(mbs, sizeof(unsigned));
+    dec->mb_intra = (uint8_t*)calloc(mbs, 1);
+    dec->mb_qp = (uint8_t*)calloc(mbs, 1);
+    dec->mv = calloc(mbs, sizeof(*dec->mv));
+    dec->pred[0] = (pred_block_t*)calloc(6 * mbs, sizeof(pred_block_t));
+    if (!ok || !dec->mb_packet || !dec->mb_intra || !dec->mb_qp || !dec->mv || !dec->pred[0]) {
+        free_frames(dec);
+        return MPEG4_ERROR_MEMORY;
+    }
+    dec->pred[1] = dec->pred[0] + 4 * mbs;
+    dec->pred[2] = dec->pred[1] + mbs;
+    return MPEG4_SUCCESS;
 }
 
-static inline int peek_bits(bit_reader_t* br, int n) {
-    while (br->bits_left < n) {
-        if (br->ptr < br->end) {
-            br->cache |= ((uint32_t)(*br->ptr++)) << (24 - br->bits_left);
-            br->bits_left += 8;
-        } else {
-            break;
-        }
+// Replicate the edge samples of a w x h plane into the padding, which
+// starts right of and below the picture (inside the last macroblocks when
+// the size is not a multiple of 16)
+static void pad_plane(uint8_t* p, int stride, int w, int h, int padded_w, int padded_h, int pad) {
+    for (int y = 0; y < h; y++) {
+        uint8_t* row = p + (ptrdiff_t)y * stride;
+        memset(row - pad, row[0], pad);
+        memset(row + w, row[w - 1], padded_w + pad - w);
     }
-    return br->cache >> (32 - n);
+    const uint8_t* top = p - pad;
+    const uint8_t* bottom = top + (ptrdiff_t)(h - 1) * stride;
+    for (int y = -pad; y < 0; y++) memcpy(p - pad + (ptrdiff_t)y * stride, top, stride);
+    for (int y = h; y < padded_h + pad; y++) memcpy(p - pad + (ptrdiff_t)y * stride, bottom, stride);
+}
+
+static void pad_frame(const mpeg4_decoder_t* dec, frame_t* f) {
+    int w = dec->mb_width * 16, h = dec->mb_height * 16;
+    pad_plane(f->y, dec->stride_y, dec->width, dec->height, w, h, PAD_Y);
+    pad_plane(f->u, dec->stride_uv, (dec->width + 1) / 2, (dec->height + 1) / 2, w / 2, h / 2, PAD_UV);
+    pad_plane(f->v, dec->stride_uv, (dec->width + 1) / 2, (dec->height + 1) / 2, w / 2, h / 2, PAD_UV);
 }
 
-static inline void skip_bits(bit_reader_t* br, int n) {
-    while (br->bits_left < n) {
-        if (br->ptr < br->end) {
-            br->cache |= ((uint32_t)(*br->ptr++)) << (24 - br->bits_left);
-            br->bits_left += 8;
-        } else {
-            br->bits_left = 0;
-            br->cache = 0;
-            return;
+// Quantization matrix in zigzag order, ended early by a 0 that repeats the
+// last value
+static int read_matrix(bit_reader_t* br, uint8_t* matrix) {
+    int i, last = 0;
+    for (i = 0; i < 64; i++) {
+        int v = (int)get_bits(br, 8);
+        if (v == 0) break;
+        matrix[zigzag[i]] = (uint8_t)(last = v);
+    }
+    if (last == 0) return -1;
+    for (; i < 64; i++) matrix[zigzag[i]] = (uint8_t)last;
+    return 0;
+}
+
+static int marker(bit_reader_t* br) {
+    return get_bits1(br) ? 0 : -1;
+}
+
+static mpeg4_error_t parse_vol(mpeg4_decoder_t* dec, bit_reader_t* br) {
+    int verid = 1;
+    skip_bits(br, 1);                           // random_accessible_vol
+    skip_bits(br, 8);                           // video_object_type_indication
+    if (get_bits1(br)) {                        // is_object_layer_identifier
+        verid = (int)get_bits(br, 4);
+        skip_bits(br, 3);                       // priority
+    }
+    if (get_bits(br, 4) == 15) skip_bits(br, 16); // extended pixel aspect ratio
+    if (get_bits1(br)) {                        // vol_control_parameters
+        if (get_bits(br, 2) != 1) return MPEG4_ERROR_UNSUPPORTED; // 4:2:0 only
+        skip_bits(br, 1);                       // low_delay
+        if (get_bits1(br)) {                    // vbv_parameters
+            skip_bits(br, 16);
+            skip_bits(br, 16);
+            skip_bits(br, 16);
+            skip_bits(br, 15);
+            skip_bits(br, 16);
         }
     }
-    br->cache <<= n;
-    br->bits_left -= n;
+    if (get_bits(br, 2) != 0) return MPEG4_ERROR_UNSUPPORTED; // shape: rectangular only
+    if (marker(br)) return MPEG4_ERROR_BITSTREAM;
+    int resolution = (int)get_bits(br, 16);
+    if (resolution == 0 || marker(br)) return MPEG4_ERROR_BITSTREAM;
+    int bits = 1;
+    while ((1 << bits) < resolution) bits++;
+    if (get_bits1(br)) skip_bits(br, bits);     // fixed_vop_rate
+    if (marker(br)) return MPEG4_ERROR_BITSTREAM;
+    int width = (int)get_bits(br, 13);
+    if (marker(br)) return MPEG4_ERROR_BITSTREAM;
+    int height = (int)get_bits(br, 13);
+    if (marker(br)) return MPEG4_ERROR_BITSTREAM;
+    if (get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;          // interlaced
+    skip_bits(br, 1);                                           // obmc_disable
+    if (get_bits(br, verid == 1 ? 1 : 2)) return MPEG4_ERROR_UNSUPPORTED; // sprites, GMC
+    if (get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;          // not_8_bit
+
+    int quant_type = get_bits1(br);
+    uint8_t intra_matrix[64], inter_matrix[64];
+    memcpy(intra_matrix, default_intra_matrix, 64);
+    memcpy(inter_matrix, default_inter_matrix, 64);
+    if (quant_type) {
+        if (get_bits1(br) && read_matrix(br, intra_matrix)) return MPEG4_ERROR_BITSTREAM;
+        if (get_bits1(br) && read_matrix(br, inter_matrix)) return MPEG4_ERROR_BITSTREAM;
+    }
+    if (verid != 1 && get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;  // quarter_sample
+    if (!get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;         // complexity estimation
+    int resync_disabled = get_bits1(br);
+    if (get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;          // data_partitioned
+    if (verid != 1) {
+        if (get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;      // newpred
+        if (get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;      // reduced resolution VOPs
+    }
+    if (get_bits1(br)) return MPEG4_ERROR_UNSUPPORTED;          // scalability
+    if (bits_left(br) < 0) return MPEG4_ERROR_BITSTREAM;
+
+    if (!dec->frames[0].memory || width != dec->width || height != dec->height) {
+        mpeg4_error_t err = alloc_frames(dec, width, height);
+        if (err != MPEG4_SUCCESS) return err;
+    }
+    dec->time_inc_bits = bits;
+    dec->quant_type = quant_type;
+    dec->resync_disabled = resync_disabled;
+    memcpy(dec->intra_matrix, intra_matrix, 64);
+    memcpy(dec->inter_matrix, inter_matrix, 64);
+    dec->have_vol = 1;
+    return MPEG4_SUCCESS;
+}
+
+static int resync_marker_bits(const mpeg4_decoder_t* dec) {
+    return dec->vop_type == VOP_I ? 17 : 16 + dec->fcode;
+}
+
+// Whether a video packet starts here: stuffing to the byte boundary (a 0
+// and then 1s) followed by the resync marker. Skips the stuffing if so.
+static int at_resync_marker(const mpeg4_decoder_t* dec, bit_reader_t* br) {
+    int n = 8 - (int)(bits_pos(br) & 7);
+    int len = resync_marker_bits(dec);
+    uint32_t bits = show_bits(br, n + len);
+    if ((bits >> len) != (1u << (n - 1)) - 1 || (bits & ((1u << len) - 1)) != 1) return 0;
+    skip_bits(br, n);
+    return 1;
+}
+
+// Move to the next resync marker after an error, at a byte boundary
+static int find_resync_marker(const mpeg4_decoder_t* dec, bit_reader_t* br) {
+    int len = resync_marker_bits(dec);
+    align_bits(br);
+    while (bits_left(br) >= len) {
+        if (show_bits(br, len) == 1) return 0;
+        skip_bits(br, 8);
+    }
+    return -1;
+}
+
+// video_packet_header after the resync marker; sets the first MB
+static int parse_packet_header(mpeg4_decoder_t* dec, bit_reader_t* br, int* mb) {
+    int mb_num = dec->mb_width * dec->mb_height;
+    int bits = 1;
+    while ((1 << bits) < mb_num) bits++;
+    skip_bits(br, resync_marker_bits(dec));
+    *mb = (int)get_bits(br, bits);
+    int qp = (int)get_bits(br, 5);
+    if (*mb >= mb_num || qp == 0) return -1;
+    dec->qp = qp;
+    if (get_bits1(br)) {                        // header_extension_code
+        while (get_bits1(br)) {}                // modulo_time_base
+        if (marker(br)) return -1;
+        skip_bits(br, dec->time_inc_bits);
+        if (marker(br)) return -1;
+        skip_bits(br, 2);                       // vop_coding_type
+        skip_bits(br, 3);                       // intra_dc_vlc_thr
+        if (dec->vop_type != VOP_I) skip_bits(br, 3);
+    }
+    dec->packet++;
+    return bits_left(br) < 0 ? -1 : 0;
 }
 
+// Prediction state of the block at (x, y) of plane `comp`'s block grid if
+// it may be used from the current packet, with the QP of its macroblock
+static const pred_block_t* neighbour(const mpeg4_decoder_t* dec, int comp, int x, int y, int* qp) {
+    if (x < 0 || y < 0) return NULL;
+    int shift = comp == 0;
+    int mb = (y >> shift) * dec->mb_width + (x >> shift);
+    if (dec->mb_packet[mb] != dec->packet || !dec->mb_intra[mb]) return NULL;
+    *qp = dec->mb_qp[mb];
+    return &dec->pred[comp][y * (dec->mb_width << shift) + x];
+}
 
-static void simple_idct(short* block) {
-    
-    for (int i = 0; i < 64; i++) {
-        block[i] = (block[i] * 4) >> 3; 
+// Next coefficient, regular or escaped: its run and last flag, and the
+// signed level as the return value (0 on error). `intra` picks the table.
+static int read_coefficient(bit_reader_t* br, const mpeg4_vlc_tables_t* t, int intra,
+                            int* last, int* run) {
+    const mpeg4_vlc_t* table = t->tcoef[intra];
+    int sym = read_vlc(br, table, MPEG4_TCOEF_BITS);
+    if (sym < 0) return 0;
+    if (sym == MPEG4_TCOEF_ESCAPE) {
+        if (!get_bits1(br)) {
+            // Type 1: level offset by the largest level of the run
+            sym = read_vlc(br, table, MPEG4_TCOEF_BITS);
+            if (sym < 0 || sym == MPEG4_TCOEF_ESCAPE) return 0;
+            *last = TCOEF_LAST(sym);
+            *run = TCOEF_RUN(sym);
+            int level = TCOEF_LEVEL(sym) + t->lmax[intra][*last][*run];
+            return get_bits1(br) ? -level : level;
+        }
+        if (!get_bits1(br)) {
+            // Type 2: run offset by the largest run of the level, plus 1
+            sym = read_vlc(br, table, MPEG4_TCOEF_BITS);
+            if (sym < 0 || sym == MPEG4_TCOEF_ESCAPE) return 0;
+            *last = TCOEF_LAST(sym);
+            int level = TCOEF_LEVEL(sym);
+            *run = TCOEF_RUN(sym) + t->rmax[intra][*last][level] + 1;
+            return get_bits1(br) ? -level : level;
+        }
+        // Type 3: fixed length
+        *last = get_bits1(br);
+        *run = (int)get_bits(br, 6);
+        if (!get_bits1(br)) return 0;
+        int level = (int)(get_bits(br, 12) ^ 0x800) - 0x800;
+        if (!get_bits1(br)) return 0;
+        return level;
     }
+    *last = TCOEF_LAST(sym);
+    *run = TCOEF_RUN(sym);
+    return get_bits1(br) ? -TCOEF_LEVEL(sym) : TCOEF_LEVEL(sym);
 }
 
+// Coefficients from scan position `i` on into raster order
+static int read_coefficients(bit_reader_t* br, const mpeg4_vlc_tables_t* t, int intra,
+                             const uint8_t* scan, int i, int16_t* block) {
+    for (;;) {
+        int last, run;
+        int level = read_coefficient(br, t, intra, &last, &run);
+        if (level == 0) return -1;
+        i += run;
+        if (i > 63) return -1;
+        block[scan[i++]] = (int16_t)level;
+        if (last) return 0;
+    }
+}
 
-static void add_block_to_frame(mpeg4_decoder_t* dec, short* block, int x, int y, int comp) {
-    uint8_t* dst;
-    int stride;
-    int block_size = 8;
-    
-    if (comp == 0) { 
-        dst = dec->y_plane + y * dec->stride_y + x;
-        stride = dec->stride_y;
-    } else if (comp == 1) { 
-        dst = dec->u_plane + (y >> 1) * dec->stride_uv + (x >> 1);
-        stride = dec->stride_uv;
-        block_size = 4; 
-    } else { 
-        dst = dec->v_plane + (y >> 1) * dec->stride_uv + (x >> 1);
-        stride = dec->stride_uv;
-        block_size = 4;
-    }
-    
-    
-    for (int j = 0; j < block_size; j++) {
-        for (int i = 0; i < block_size; i++) {
-            int idx = j * 8 + i;
-            int val = (block[idx] + 128);
-            if (val < 0) val = 0;
-            else if (val > 255) val = 255;
-            dst[j * stride + i] = (uint8_t)val;
+// Inverse quantization of the AC coefficients (and of the whole block for
+// inter blocks), saturated to 12 bits
+static void dequantize(const mpeg4_decoder_t* dec, int16_t* block, int qp, int intra) {
+    int first = intra ? 1 : 0;
+    if (dec->quant_type == 0) {
+        int add = (qp - 1) | 1;
+        for (int i = first; i < 64; i++) {
+            int v = block[i];
+            if (!v) continue;
+            v = v > 0 ? v * 2 * qp + add : v * 2 * qp - add;
+            block[i] = (int16_t)clip(v, -2048, 2047);
         }
+        return;
     }
+    const uint8_t* matrix = intra ? dec->intra_matrix : dec->inter_matrix;
+    int sum = intra ? block[0] : 0;
+    for (int i = first; i < 64; i++) {
+        int v = block[i];
+        if (!v) continue;
+        int k = intra ? 0 : v > 0 ? 1 : -1;
+        v = (2 * v + k) * matrix[i] * qp / 16;
+        block[i] = (int16_t)clip(v, -2048, 2047);
+        sum += block[i];
+    }
+    // Mismatch control: make the sum of the coefficients odd
+    if (!(sum & 1)) block[63] ^= 1;
 }
 
+// Intra block `n` (0-3 luma, 4 Cb, 5 Cr) of the macroblock at (mb_x, mb_y)
+static int decode_intra_block(mpeg4_decoder_t* dec, bit_reader_t* br, int mb_x, int mb_y,
+                              int n, int coded, int ac_pred, int use_dc_vlc) {
+    const mpeg4_vlc_tables_t* t = mpeg4_vlc_tables();
+    int16_t* block = dec->block;
+    int comp = n < 4 ? 0 : n - 3;
+    int x = comp ? mb_x : 2 * mb_x + (n & 1);
+    int y = comp ? mb_y : 2 * mb_y + (n >> 1);
+    int qp = dec->qp;
+    int scale = dc_scaler(qp, comp != 0);
+
+    // DC prediction from the left (A) or the top (C) block, whichever
+    // side the gradient through the top-left block (B) is smaller across
+    int qp_a = 0, qp_b = 0, qp_c = 0;
+    const pred_block_t* a = neighbour(dec, comp, x - 1, y, &qp_a);
+    const pred_block_t* b = neighbour(dec, comp, x - 1, y - 1, &qp_b);
+    const pred_block_t* c = neighbour(dec, comp, x, y - 1, &qp_c);
+    int fa = a ? a->dc : 1024, fb = b ? b->dc : 1024, fc = c ? c->dc : 1024;
+    int vertical = abs(fa - fb) < abs(fb - fc);
+    int dc_pred = vertical ? fc : fa;
+    const uint8_t* scan = !ac_pred ? zigzag : vertical ? alternate_horizontal : alternate_vertical;
 
-static void decode_macroblock(mpeg4_decoder_t* dec, bit_reader_t* br, int mb_x, int mb_y) {
-    
-    memset(dec->blocks, 0, sizeof(dec->blocks));
-    
-    
-    for (int i = 0; i < 6; i++) {
-        dec->blocks[i][0] = get_bits(br, 10);
+    memset(block, 0, sizeof(dec->block));
+    int start = 0;
+    if (use_dc_vlc) {
+        int size = read_vlc(br, t->dc_size[comp != 0], MPEG4_DC_BITS);
+        if (size < 0) return -1;
+        if (size) {
+            int diff = (int)get_bits(br, size);
+            if (!(diff >> (size - 1))) diff -= (1 << size) - 1;
+            block[0] = (int16_t)diff;
+            if (size > 8 && marker(br)) return -1;
+        }
+        start = 1;
     }
-    
-    
-    for (int i = 0; i < 6; i++) {
-        for (int j = 1; j < 16; j++) { 
-            if (peek_bits(br, 1)) {
-                skip_bits(br, 1);
-                int coeff = get_bits(br, 8);
-                dec->blocks[i][j] = (coeff & 1) ? -(coeff >> 1) : (coeff >> 1);
-            } else {
-                skip_bits(br, 1);
+    if (coded && read_coefficients(br, t, 1, scan, start, block)) return -1;
+
+    block[0] = (int16_t)(block[0] + (dc_pred + scale / 2) / scale);
+    if (ac_pred) {
+        int qp_n = vertical ? qp_c : qp_a;
+        const pred_block_t* p = vertical ? c : a;
+        if (p) {
+            for (int i = 1; i < 8; i++) {
+                int16_t* dst = vertical ? &block[i] : &block[i * 8];
+                int v = vertical ? p->row[i - 1] : p->col[i - 1];
+                if (qp_n != qp) v = rounded_div(v * qp_n, qp);
+                *dst = (int16_t)clip(*dst + v, -2048, 2047);
             }
         }
-        simple_idct(dec->blocks[i]);
     }
-    
-    
-    int x = mb_x * 16;
-    int y = mb_y * 16;
-    
-    
-    add_block_to_frame(dec, dec->blocks[0], x, y, 0);
-    add_block_to_frame(dec, dec->blocks[1], x + 8, y, 0);
-    add_block_to_frame(dec, dec->blocks[2], x, y + 8, 0);
-    add_block_to_frame(dec, dec->blocks[3], x + 8, y + 8, 0);
-    
-    
-    add_block_to_frame(dec, dec->blocks[4], x, y, 1);
-    add_block_to_frame(dec, dec->blocks[5], x, y, 2);
+
+    pred_block_t* self = &dec->pred[comp][y * (dec->mb_width << (comp == 0)) + x];
+    self->dc = (int16_t)clip(block[0] * scale, 0, 2047);
+    for (int i = 1; i < 8; i++) {
+        self->row[i - 1] = block[i];
+        self->col[i - 1] = block[i * 8];
+    }
+
+    block[0] = (int16_t)clip(block[0] * scale, -2048, 2047);
+    dequantize(dec, block, qp, 1);
+    mpeg4_idct(block);
+
+    uint8_t* dst;
+    if (comp == 0)
+        dst = dec->cur->y + (size_t)y * 8 * dec->stride_y + x * 8;
+    else
+        dst = (comp == 1 ? dec->cur->u : dec->cur->v) + (size_t)y * 8 * dec->stride_uv + x * 8;
+    mpeg4_put_block(block, dst, comp == 0 ? dec->stride_y : dec->stride_uv);
+    return 0;
 }
 
+// Intra macroblock after its mcbpc, in I- and P-VOPs
+static int decode_intra_mb(mpeg4_decoder_t* dec, bit_reader_t* br, int mb, int mcbpc) {
+    const mpeg4_vlc_tables_t* t = mpeg4_vlc_tables();
+    int ac_pred = get_bits1(br);
+    int cbpy = read_vlc(br, t->cbpy, MPEG4_CBPY_BITS);
+    if (cbpy < 0) return -1;
+    int cbp = cbpy << 2 | (mcbpc & 3);
 
-mpeg4_decoder_t* mpeg4_create_decoder(int width, int height) {
-    if (width <= 0 || height <= 0 || width > 2048 || height > 2048) {
-        return NULL;
+    // The DC code depends on the QP before the update
+    int use_dc_vlc = dec->qp < intra_dc_threshold[dec->intra_dc_thr];
+    if ((mcbpc >> 2) == 4) dec->qp = clip(dec->qp + dquant_table[get_bits(br, 2)], 1, 31);
+
+    dec->mb_packet[mb] = dec->packet;
+    dec->mb_intra[mb] = 1;
+    dec->mb_qp[mb] = (uint8_t)dec->qp;
+    memset(dec->mv[mb], 0, sizeof(dec->mv[mb]));
+    int mb_x = mb % dec->mb_width, mb_y = mb / dec->mb_width;
+    for (int n = 0; n < 6; n++) {
+        if (decode_intra_block(dec, br, mb_x, mb_y, n, cbp & (32 >> n), ac_pred, use_dc_vlc))
+            return -1;
+    }
+    return bits_left(br) < 0 ? -1 : 0;
+}
+
+static int decode_i_mb(mpeg4_decoder_t* dec, bit_reader_t* br, int mb) {
+    const mpeg4_vlc_tables_t* t = mpeg4_vlc_tables();
+    int mcbpc;
+    do {
+        mcbpc = read_vlc(br, t->mcbpc_i, MPEG4_MCBPC_BITS);
+    } while (mcbpc == MPEG4_MCBPC_STUFFING);
+    if (mcbpc < 0) return -1;
+    return decode_intra_mb(dec, br, mb, mcbpc);
+}
+
+static int median(int a, int b, int c) {
+    int lo = a < b ? a : b, hi = a < b ? b : a;
+    return c < lo ? lo : c > hi ? hi : c;
+}
+
+// Motion vector prediction for luma block `blk` of the macroblock at
+// (mb_x, mb_y): the median of the vectors on the left (A), above (B) and
+// above right (C). Candidates out of the VOP or from another video packet
+// are not valid: one is taken as zero, with two the third is the
+// prediction, with none it is zero. Intra macroblocks count as zero
+// vectors.
+static void predict_mv(const mpeg4_decoder_t* dec, int mb_x, int mb_y, int blk, int* px, int* py) {
+    // Macroblock offset and block of A, B and C for each block
+    static const int8_t candidates[4][3][3] = {
+        {{-1, 0, 1}, {0, -1, 2}, {1, -1, 2}},
+        {{0, 0, 0}, {0, -1, 3}, {1, -1, 2}},
+        {{-1, 0, 3}, {0, 0, 0}, {0, 0, 1}},
+        {{0, 0, 2}, {0, 0, 0}, {0, 0, 1}},
+    };
+    int mv[3][2] = {{0, 0}, {0, 0}, {0, 0}};
+    int valid = 0, last = 0;
+    for (int i = 0; i < 3; i++) {
+        const int8_t* c = candidates[blk][i];
+        int x = mb_x + c[0], y = mb_y + c[1];
+        if (x < 0 || x >= dec->mb_width || y < 0) continue;
+        int mb = y * dec->mb_width + x;
+        if (dec->mb_packet[mb] != dec->packet) continue;
+        mv[i][0] = dec->mv[mb][c[2]][0];
+        mv[i][1] = dec->mv[mb][c[2]][1];
+        valid++;
+        last = i;
+    }
+    if (valid == 1) {
+        *px = mv[last][0];
+        *py = mv[last][1];
+    } else {
+        *px = median(mv[0][0], mv[1][0], mv[2][0]);
+        *py = median(mv[0][1], mv[1][1], mv[2][1]);
+    }
+}
+
+// One vector component: motion_code and motion_residual added to the
+// prediction, wrapped into the range of the VOP's f_code
+static int read_mv_component(bit_reader_t* br, int fcode, int pred, int* v) {
+    int code = read_vlc(br, mpeg4_vlc_tables()->mv, MPEG4_MV_BITS);
+    if (code < 0) return -1;
+    int diff = 0;
+    if (code) {
+        int shift = fcode - 1;
+        int sign = get_bits1(br);
+        diff = shift ? ((code - 1) << shift | (int)get_bits(br, shift)) + 1 : code;
+        if (sign) diff = -diff;
+    }
+    int range = 32 << (fcode - 1);
+    int val = pred + diff;
+    if (val < -range) val += 2 * range;
+    else if (val >= range) val -= 2 * range;
+    *v = val;
+    return 0;
+}
+
+static int read_mv(mpeg4_decoder_t* dec, bit_reader_t* br, int mb, int blk) {
+    int px, py, x, y;
+    predict_mv(dec, mb % dec->mb_width, mb / dec->mb_width, blk, &px, &py);
+    if (read_mv_component(br, dec->fcode, px, &x) || read_mv_component(br, dec->fcode, py, &y))
+        return -1;
+    dec->mv[mb][blk][0] = (int16_t)x;
+    dec->mv[mb][blk][1] = (int16_t)y;
+    return 0;
+}
+
+// Block of `size` at (x, y) of a plane of the current VOP predicted from
+// the reference, moved by (mx, my) half pels. Positions further out than
+// the padding are clamped to it, which reads the same edge samples.
+static void predict_block(const mpeg4_decoder_t* dec, int plane, int x, int y, int mx, int my, int size) {
+    int stride = plane ? dec->stride_uv : dec->stride_y;
+    int pad = plane ? PAD_UV : PAD_Y;
+    int w = plane ? dec->mb_width * 8 : dec->mb_width * 16;
+    int h = plane ? dec->mb_height * 8 : dec->mb_height * 16;
+    const uint8_t* ref = plane == 0 ? dec->ref->y : plane == 1 ? dec->ref->u : dec->ref->v;
+    uint8_t* cur = plane == 0 ? dec->cur->y : plane == 1 ? dec->cur->u : dec->cur->v;
+    int sx = clip(x + (mx >> 1), -pad, w + pad - size - 1);
+    int sy = clip(y + (my >> 1), -pad, h + pad - size - 1);
+    mpeg4_mc(cur + (ptrdiff_t)y * stride + x, ref + (ptrdiff_t)sy * stride + sx, stride, size,
+             (mx & 1) | (my & 1) << 1, dec->rounding);
+}
+
+// Chroma vector from the sum of the four luma vectors (in sixteenths of
+// a chroma sample), rounded to half pels
+static int chroma_4mv(int sum) {
+    static const uint8_t round[16] = {0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2};
+    return round[sum & 15] + ((sum >> 3) & ~1);
+}
+
+static void predict_mb(const mpeg4_decoder_t* dec, int mb, int four) {
+    int mb_x = mb % dec->mb_width, mb_y = mb / dec->mb_width;
+    const int16_t (*mv)[2] = dec->mv[mb];
+    int cx, cy;
+    if (four) {
+        for (int k = 0; k < 4; k++)
+            predict_block(dec, 0, mb_x * 16 + (k & 1) * 8, mb_y * 16 + (k >> 1) * 8, mv[k][0], mv[k][1], 8);
+        cx = chroma_4mv(mv[0][0] + mv[1][0] + mv[2][0] + mv[3][0]);
+        cy = chroma_4mv(mv[0][1] + mv[1][1] + mv[2][1] + mv[3][1]);
+    } else {
+        predict_block(dec, 0, mb_x * 16, mb_y * 16, mv[0][0], mv[0][1], 16);
+        // Quarter positions of the chroma are taken as half pels
+        cx = (mv[0][0] >> 1) | (mv[0][0] & 1);
+        cy = (mv[0][1] >> 1) | (mv[0][1] & 1);
+    }
+    predict_block(dec, 1, mb_x * 8, mb_y * 8, cx, cy, 8);
+    predict_block(dec, 2, mb_x * 8, mb_y * 8, cx, cy, 8);
+}
+
+// Macroblock copied from the reference: not coded, or lost
+static void copy_mb(mpeg4_decoder_t* dec, int mb) {
+    dec->mb_intra[mb] = 0;
+    memset(dec->mv[mb], 0, sizeof(dec->mv[mb]));
+    predict_mb(dec, mb, 0);
+}
+
+static int decode_inter_block(mpeg4_decoder_t* dec, bit_reader_t* br, int mb, int n) {
+    int16_t* block = dec->block;
+    memset(block, 0, sizeof(dec->block));
+    if (read_coefficients(br, mpeg4_vlc_tables(), 0, zigzag, 0, block)) return -1;
+    dequantize(dec, block, dec->qp, 0);
+    mpeg4_idct(block);
+
+    int mb_x = mb % dec->mb_width, mb_y = mb / dec->mb_width;
+    if (n < 4) {
+        uint8_t* dst = dec->cur->y + (size_t)(mb_y * 16 + (n >> 1) * 8) * dec->stride_y + mb_x * 16 + (n & 1) * 8;
+        mpeg4_add_block(block, dst, dec->stride_y);
+    } else {
+        uint8_t* dst = (n == 4 ? dec->cur->u : dec->cur->v) + (size_t)mb_y * 8 * dec->stride_uv + mb_x * 8;
+        mpeg4_add_block(block, dst, dec->stride_uv);
+    }
+    return 0;
+}
+
+static int decode_p_mb(mpeg4_decoder_t* dec, bit_reader_t* br, int mb) {
+    const mpeg4_vlc_tables_t* t = mpeg4_vlc_tables();
+    dec->mb_packet[mb] = dec->packet;
+    int mcbpc;
+    do {
+        if (get_bits1(br)) {                    // not_coded
+            copy_mb(dec, mb);
+            return bits_left(br) < 0 ? -1 : 0;
+        }
+        mcbpc = read_vlc(br, t->mcbpc_p, MPEG4_MCBPC_BITS);
+    } while (mcbpc == MPEG4_MCBPC_STUFFING);
+    if (mcbpc < 0) return -1;
+    int type = mcbpc >> 2;
+    if (type >= 3) return decode_intra_mb(dec, br, mb, mcbpc);
+
+    // cbpy of inter macroblocks is coded inverted
+    int cbpy = read_vlc(br, t->cbpy, MPEG4_CBPY_BITS);
+    if (cbpy < 0) return -1;
+    int cbp = (15 - cbpy) << 2 | (mcbpc & 3);
+    if (type == 1) dec->qp = clip(dec->qp + dquant_table[get_bits(br, 2)], 1, 31);
+    dec->mb_intra[mb] = 0;
+    dec->mb_qp[mb] = (uint8_t)dec->qp;
+
+    memset(dec->mv[mb], 0, sizeof(dec->mv[mb]));
+    if (type == 2) {
+        for (int k = 0; k < 4; k++)
+            if (read_mv(dec, br, mb, k)) return -1;
+    } else {
+        if (read_mv(dec, br, mb, 0)) return -1;
+        for (int k = 1; k < 4; k++) memcpy(dec->mv[mb][k], dec->mv[mb][0], sizeof(dec->mv[mb][0]));
+    }
+    predict_mb(dec, mb, type == 2);
+
+    for (int n = 0; n < 6; n++) {
+        if ((cbp & (32 >> n)) && decode_inter_block(dec, br, mb, n)) return -1;
+    }
+    return bits_left(br) < 0 ? -1 : 0;
+}
+
+static mpeg4_error_t decode_vop(mpeg4_decoder_t* dec, bit_reader_t* br) {
+    if (!dec->have_vol) return MPEG4_ERROR_BITSTREAM;
+    int type = (int)get_bits(br, 2);
+    while (get_bits1(br)) {}                    // modulo_time_base
+    if (marker(br)) return MPEG4_ERROR_BITSTREAM;
+    skip_bits(br, dec->time_inc_bits);
+    if (marker(br)) return MPEG4_ERROR_BITSTREAM;
+    if (!get_bits1(br)) return MPEG4_SUCCESS;   // Not coded: the last picture again
+    if (type != VOP_I && type != VOP_P) return MPEG4_ERROR_UNSUPPORTED;
+    dec->vop_type = type;
+    dec->rounding = type == VOP_P ? get_bits1(br) : 0;
+    dec->intra_dc_thr = (int)get_bits(br, 3);
+    dec->qp = (int)get_bits(br, 5);
+    dec->fcode = type == VOP_P ? (int)get_bits(br, 3) : 1;
+    if (dec->qp == 0 || dec->fcode == 0 || bits_left(br) < 0) return MPEG4_ERROR_BITSTREAM;
+
+    // Macroblocks in video packets; after an error the rest of the packet
+    // is lost and decoding resumes at the next resync marker
+    int mb_num = dec->mb_width * dec->mb_height;
+    int decoded = 0;
+    unsigned first = ++dec->packet;
+    for (int mb = 0; mb < mb_num; mb++) {
+        if (!dec->resync_disabled && mb > 0 && at_resync_marker(dec, br)
+            && parse_packet_header(dec, br, &mb))
+            break;
+        int ret = type == VOP_P ? decode_p_mb(dec, br, mb) : decode_i_mb(dec, br, mb);
+        if (ret == 0) {
+            decoded++;
+            continue;
+        }
+        dec->mb_packet[mb] = 0;
+        if (dec->resync_disabled || find_resync_marker(dec, br) || parse_packet_header(dec, br, &mb))
+            break;
+        mb--;
+    }
+    if (!decoded) return MPEG4_ERROR_BITSTREAM;
+
+    // Macroblocks not decoded in this VOP are taken from the reference,
+    // then the VOP becomes the reference of the next one
+    for (int mb = 0; mb < mb_num; mb++) {
+        if (dec->mb_packet[mb] < first) copy_mb(dec, mb);
     }
-    
+    pad_frame(dec, dec->cur);
+    frame_t* f = dec->cur;
+    dec->cur = dec->ref;
+    dec->ref = f;
+    return MPEG4_SUCCESS;
+}
+
+mpeg4_decoder_t* mpeg4_create_decoder(int width, int height) {
     mpeg4_decoder_t* dec = (mpeg4_decoder_t*)calloc(1, sizeof(mpeg4_decoder_t));
     if (!dec) return NULL;
-    
-    
-    dec->width = (width + 15) & ~15;
-    dec->height = (height + 15) & ~15;
-    dec->mb_width = dec->width / 16;
-    dec->mb_height = dec->height / 16;
-    dec->stride_y = dec->width;
-    dec->stride_uv = dec->width / 2;
-    
-    
-    size_t y_size = dec->stride_y * dec->height;
-    size_t uv_size = dec->stride_uv * (dec->height / 2);
-    size_t total_size = y_size + 2 * uv_size;
-    
-    
-    dec->frame_memory = (uint8_t*)malloc(total_size);
-    if (!dec->frame_memory) {
+    if (alloc_frames(dec, width, height) != MPEG4_SUCCESS) {
         free(dec);
         return NULL;
     }
-    
-    
-    dec->y_plane = dec->frame_memory;
-    dec->u_plane = dec->y_plane + y_size;
-    dec->v_plane = dec->u_plane + uv_size;
-    
-    
-    memset(dec->y_plane, 0, y_size);
-    memset(dec->u_plane, 128, uv_size);
-    memset(dec->v_plane, 128, uv_size);
-    
+    mpeg4_dsp_init();
+    mpeg4_vlc_tables();
     return dec;
 }
 
 void mpeg4_destroy_decoder(mpeg4_decoder_t* decoder) {
     if (decoder) {
-        if (decoder->frame_memory) {
-            free(decoder->frame_memory);
-        }
+        free_frames(decoder);
         free(decoder);
     }
 }
 
+// Offset of the byte after the next 00 00 01 from `pos`, or 0
+static size_t next_start_code(const uint8_t* data, size_t size, size_t pos) {
+    for (; pos + 3 < size; pos++) {
+        if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1) return pos + 3;
+    }
+    return 0;
+}
+
 mpeg4_error_t mpeg4_decode_frame(mpeg4_decoder_t* decoder,
                                 const uint8_t* bitstream,
                                 size_t bitstream_size,
@@ -219,36 +814,35 @@ mpeg4_error_t mpeg4_decode_frame(mpeg4_decoder_t* decoder,
                                 uint8_t** v_plane,
                                 int* stride_y,
                                 int* stride_uv) {
-    if (!decoder || !bitstream || !y_plane || !u_plane || !v_plane || 
+    if (!decoder || !bitstream || !y_plane || !u_plane || !v_plane ||
         !stride_y || !stride_uv || bitstream_size == 0) {
         return MPEG4_ERROR_INVALID_PARAM;
     }
-    
-    bit_reader_t reader;
-    init_bit_reader(&reader, bitstream, bitstream_size);
-    
-    
-    skip_bits(&reader, 32); 
-    skip_bits(&reader, 2);  
-    
-    
-    for (int mb_y = 0; mb_y < decoder->mb_height; mb_y++) {
-        for (int mb_x = 0; mb_x < decoder->mb_width; mb_x++) {
-            if (reader.ptr >= reader.end) {
-                
-                break;
-            }
-            decode_macroblock(decoder, &reader, mb_x, mb_y);
+
+    // Headers up to the first VOP, which is decoded; other start codes
+    // (visual object sequence, GOV, user data) are skipped
+    mpeg4_error_t err = MPEG4_ERROR_BITSTREAM;
+    size_t pos = 0;
+    while ((pos = next_start_code(bitstream, bitstream_size, pos)) != 0) {
+        uint8_t code = bitstream[pos];
+        bit_reader_t reader;
+        init_bits(&reader, bitstream + pos + 1, bitstream_size - pos - 1);
+        if (code >= 0x20 && code <= 0x2f) {
+            err = parse_vol(decoder, &reader);
+            if (err != MPEG4_SUCCESS) return err;
+            err = MPEG4_ERROR_BITSTREAM;
+        } else if (code == 0xb6) {
+            err = decode_vop(decoder, &reader);
+            break;
         }
     }
-    
-    
-    *y_plane = decoder->y_plane;
-    *u_plane = decoder->u_plane;
-    *v_plane = decoder->v_plane;
+    if (err != MPEG4_SUCCESS) return err;
+
+    *y_plane = decoder->ref->y;
+    *u_plane = decoder->ref->u;
+    *v_plane = decoder->ref->v;
     *stride_y = decoder->stride_y;
     *stride_uv = decoder->stride_uv;
-    
     return MPEG4_SUCCESS;
 }
 
@@ -257,4 +851,4 @@ void mpeg4_get_frame_size(mpeg4_decoder_t* decoder, int* width, int* height) {
         *width = decoder->width;
         *height = decoder->height;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,150 @@
+// MPEG-4 Part 2 VLC tables, see vlc.h
+#include "vlc.h"
+#include <pthread.h>
+
+typedef struct {
+    uint16_t code;
+    uint8_t len;
+} vlc_code_t;
+
+// Transform coefficients (tables B-16 and B-17) in (last, run, level)
+// order; the symbols follow from the largest level of each run below.
+// The last code is the escape.
+static const vlc_code_t intra_tcoef_codes[103] = {
+    {0x2, 2}, {0x6, 3}, {0xf, 4}, {0xd, 5}, {0xc, 5}, {0x15, 6}, {0x13, 6}, {0x12, 6},
+    {0x17, 7}, {0x1f, 8}, {0x1e, 8}, {0x1d, 8}, {0x25, 9}, {0x24, 9}, {0x23, 9}, {0x21, 9},
+    {0x21, 10}, {0x20, 10}, {0xf, 10}, {0xe, 10}, {0x7, 11}, {0x6, 11}, {0x20, 11}, {0x21, 11},
+    {0x50, 12}, {0x51, 12}, {0x52, 12}, {0xe, 4}, {0x14, 6}, {0x16, 7}, {0x1c, 8}, {0x20, 9},
+    {0x1f, 9}, {0xd, 10}, {0x22, 11}, {0x53, 12}, {0x55, 12}, {0xb, 5}, {0x15, 7}, {0x1e, 9},
+    {0xc, 10}, {0x56, 12}, {0x11, 6}, {0x1b, 8}, {0x1d, 9}, {0xb, 10}, {0x10, 6}, {0x22, 9},
+    {0xa, 10}, {0xd, 6}, {0x1c, 9}, {0x8, 10}, {0x12, 7}, {0x1b, 9}, {0x54, 12}, {0x14, 7},
+    {0x1a, 9}, {0x57, 12}, {0x19, 8}, {0x9, 10}, {0x18, 8}, {0x23, 11}, {0x17, 8}, {0x19, 9},
+    {0x18, 9}, {0x7, 10}, {0x58, 12}, {0x7, 4}, {0xc, 6}, {0x16, 8}, {0x17, 9}, {0x6, 10},
+    {0x5, 11}, {0x4, 11}, {0x59, 12}, {0xf, 6}, {0x16, 9}, {0x5, 10}, {0xe, 6}, {0x4, 10},
+    {0x11, 7}, {0x24, 11}, {0x10, 7}, {0x25, 11}, {0x13, 7}, {0x5a, 12}, {0x15, 8}, {0x5b, 12},
+    {0x14, 8}, {0x13, 8}, {0x1a, 8}, {0x15, 9}, {0x14, 9}, {0x13, 9}, {0x12, 9}, {0x11, 9},
+    {0x26, 11}, {0x27, 11}, {0x5c, 12}, {0x5d, 12}, {0x5e, 12}, {0x5f, 12}, {0x3, 7},
+};
+
+static const vlc_code_t inter_tcoef_codes[103] = {
+    {0x2, 2}, {0xf, 4}, {0x15, 6}, {0x17, 7}, {0x1f, 8}, {0x25, 9}, {0x24, 9}, {0x21, 10},
+    {0x20, 10}, {0x7, 11}, {0x6, 11}, {0x20, 11}, {0x6, 3}, {0x14, 6}, {0x1e, 8}, {0xf, 10},
+    {0x21, 11}, {0x50, 12}, {0xe, 4}, {0x1d, 8}, {0xe, 10}, {0x51, 12}, {0xd, 5}, {0x23, 9},
+    {0xd, 10}, {0xc, 5}, {0x22, 9}, {0x52, 12}, {0xb, 5}, {0xc, 10}, {0x53, 12}, {0x13, 6},
+    {0xb, 10}, {0x54, 12}, {0x12, 6}, {0xa, 10}, {0x11, 6}, {0x9, 10}, {0x10, 6}, {0x8, 10},
+    {0x16, 7}, {0x55, 12}, {0x15, 7}, {0x14, 7}, {0x1c, 8}, {0x1b, 8}, {0x21, 9}, {0x20, 9},
+    {0x1f, 9}, {0x1e, 9}, {0x1d, 9}, {0x1c, 9}, {0x1b, 9}, {0x1a, 9}, {0x22, 11}, {0x23, 11},
+    {0x56, 12}, {0x57, 12}, {0x7, 4}, {0x19, 9}, {0x5, 11}, {0xf, 6}, {0x4, 11}, {0xe, 6},
+    {0xd, 6}, {0xc, 6}, {0x13, 7}, {0x12, 7}, {0x11, 7}, {0x10, 7}, {0x1a, 8}, {0x19, 8},
+    {0x18, 8}, {0x17, 8}, {0x16, 8}, {0x15, 8}, {0x14, 8}, {0x13, 8}, {0x18, 9}, {0x17, 9},
+    {0x16, 9}, {0x15, 9}, {0x14, 9}, {0x13, 9}, {0x12, 9}, {0x11, 9}, {0x7, 10}, {0x6, 10},
+    {0x5, 10}, {0x4, 10}, {0x24, 11}, {0x25, 11}, {0x26, 11}, {0x27, 11}, {0x58, 12}, {0x59, 12},
+    {0x5a, 12}, {0x5b, 12}, {0x5c, 12}, {0x5d, 12}, {0x5e, 12}, {0x5f, 12}, {0x3, 7},
+};
+
+static const uint8_t intra_lmax[2][21] = {
+    {27, 10, 5, 4, 3, 3, 3, 3, 2, 2, 1, 1, 1, 1, 1},
+    {8, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+};
+
+static const uint8_t inter_lmax[2][41] = {
+    {12, 6, 4, 3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    {3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+     1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+};
+
+// mcbpc for I-VOPs (table B-6): types 3 and 4, then stuffing
+static const vlc_code_t mcbpc_i_codes[9] = {
+    {1, 1}, {1, 3}, {2, 3}, {3, 3}, {1, 4}, {1, 6}, {2, 6}, {3, 6}, {1, 9},
+};
+
+// mcbpc for P-VOPs (table B-7) by index cbpc | intra << 2 | dquant << 3 |
+// 4MV << 4, then stuffing
+static const vlc_code_t mcbpc_p_codes[21] = {
+    {1, 1}, {3, 4}, {2, 4}, {5, 6}, {3, 5}, {4, 8}, {3, 8}, {3, 7},
+    {3, 3}, {7, 7}, {6, 7}, {5, 9}, {4, 6}, {4, 9}, {3, 9}, {2, 9},
+    {2, 3}, {5, 7}, {4, 7}, {5, 8}, {1, 9},
+};
+
+// cbpy of intra macroblocks (table B-8), by cbpy
+static const vlc_code_t cbpy_codes[16] = {
+    {3, 4}, {5, 5}, {4, 5}, {9, 4}, {3, 5}, {7, 4}, {2, 6}, {11, 4},
+    {2, 5}, {3, 6}, {5, 4}, {10, 4}, {4, 4}, {8, 4}, {6, 4}, {3, 2},
+};
+
+// dct_dc_size (tables B-13 and B-14), by size
+static const vlc_code_t dc_luma_codes[13] = {
+    {3, 3}, {3, 2}, {2, 2}, {2, 3}, {1, 3}, {1, 4}, {1, 5}, {1, 6},
+    {1, 7}, {1, 8}, {1, 9}, {1, 10}, {1, 11},
+};
+
+static const vlc_code_t dc_chroma_codes[13] = {
+    {3, 2}, {2, 2}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {1, 6}, {1, 7},
+    {1, 8}, {1, 9}, {1, 10}, {1, 11}, {1, 12},
+};
+
+// motion_code (table B-12) by magnitude; the sign bit follows
+static const vlc_code_t mv_codes[33] = {
+    {0x1, 1}, {0x1, 2}, {0x1, 3}, {0x1, 4}, {0x3, 6}, {0x5, 7}, {0x4, 7}, {0x3, 7},
+    {0xb, 9}, {0xa, 9}, {0x9, 9}, {0x11, 10}, {0x10, 10}, {0xf, 10}, {0xe, 10}, {0xd, 10},
+    {0xc, 10}, {0xb, 10}, {0xa, 10}, {0x9, 10}, {0x8, 10}, {0x7, 10}, {0x6, 10}, {0x5, 10},
+    {0x4, 10}, {0x7, 11}, {0x6, 11}, {0x5, 11}, {0x4, 11}, {0x3, 11}, {0x2, 11}, {0x3, 12},
+    {0x2, 12},
+};
+
+static mpeg4_vlc_tables_t tables;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void fill(mpeg4_vlc_t* table, int bits, const vlc_code_t* codes, int count,
+                 const int16_t* syms) {
+    for (int i = 0; i < count; i++) {
+        int shift = bits - codes[i].len;
+        int first = codes[i].code << shift;
+        for (int j = 0; j < 1 << shift; j++) {
+            table[first + j].sym = syms ? syms[i] : (int16_t)i;
+            table[first + j].len = codes[i].len;
+        }
+    }
+}
+
+static void fill_tcoef(int intra, const vlc_code_t* codes, const uint8_t* lmax, int runs) {
+    int16_t syms[103];
+    int n = 0;
+    for (int last = 0; last < 2; last++) {
+        for (int run = 0; run < runs; run++) {
+            int max = lmax[last * runs + run];
+            tables.lmax[intra][last][run] = (uint8_t)max;
+            for (int level = 1; level <= max; level++) {
+                syms[n++] = (int16_t)(last << 12 | run << 6 | level);
+                tables.rmax[intra][last][level] = (uint8_t)run;
+            }
+        }
+    }
+    syms[n] = MPEG4_TCOEF_ESCAPE;
+    fill(tables.tcoef[intra], MPEG4_TCOEF_BITS, codes, 103, syms);
+}
+
+static void tables_init(void) {
+    fill_tcoef(1, intra_tcoef_codes, &intra_lmax[0][0], 21);
+    fill_tcoef(0, inter_tcoef_codes, &inter_lmax[0][0], 41);
+
+    int16_t syms[21];
+    for (int i = 0; i < 8; i++) syms[i] = (int16_t)((3 + (i >> 2)) << 2 | (i & 3));
+    syms[8] = MPEG4_MCBPC_STUFFING;
+    fill(tables.mcbpc_i, MPEG4_MCBPC_BITS, mcbpc_i_codes, 9, syms);
+
+    static const uint8_t p_types[5] = {0, 3, 1, 4, 2};
+    for (int i = 0; i < 20; i++) syms[i] = (int16_t)(p_types[i >> 2] << 2 | (i & 3));
+    syms[20] = MPEG4_MCBPC_STUFFING;
+    fill(tables.mcbpc_p, MPEG4_MCBPC_BITS, mcbpc_p_codes, 21, syms);
+
+    fill(tables.cbpy, MPEG4_CBPY_BITS, cbpy_codes, 16, NULL);
+    fill(tables.dc_size[0], MPEG4_DC_BITS, dc_luma_codes, 13, NULL);
+    fill(tables.dc_size[1], MPEG4_DC_BITS, dc_chroma_codes, 13, NULL);
+    fill(tables.mv, MPEG4_MV_BITS, mv_codes, 33, NULL);
+}
+
+const mpeg4_vlc_tables_t* mpeg4_vlc_tables(void) {
+    pthread_once(&tables_once, tables_init);
+    return &tables;
+}
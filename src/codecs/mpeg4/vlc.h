@@ -0,0 +1,56 @@
+#ifndef MPEG4_VLC_H
+#define MPEG4_VLC_H
+
+#include "../../../include/bitstream.h"
+
+// MPEG-4 Part 2 variable length codes (ISO/IEC 14496-2 annex B), decoded
+// with one flat lookup per code: the next N bits index an entry holding
+// the symbol and the code length. N is the longest code of the table.
+typedef struct {
+    int16_t sym;
+    uint8_t len;        // 0 for bit patterns that are not a valid code
+} mpeg4_vlc_t;
+
+#define MPEG4_TCOEF_BITS  12
+#define MPEG4_MCBPC_BITS  9
+#define MPEG4_CBPY_BITS   6
+#define MPEG4_DC_BITS     12
+#define MPEG4_MV_BITS     12
+
+// TCOEF symbols pack last << 12 | run << 6 | level; the escape code has a
+// symbol of its own
+#define MPEG4_TCOEF_ESCAPE 0x2000
+#define TCOEF_LAST(s)  ((s) >> 12)
+#define TCOEF_RUN(s)   (((s) >> 6) & 63)
+#define TCOEF_LEVEL(s) ((s) & 63)
+
+// MCBPC symbols are mb_type << 2 | cbpc, with the MPEG-4 macroblock types
+// (3 intra, 4 intra + dquant for both; 0 inter, 1 inter + dquant, 2 inter
+// 4MV in P-VOPs). Stuffing is MPEG4_MCBPC_STUFFING.
+#define MPEG4_MCBPC_STUFFING 0x100
+
+typedef struct {
+    mpeg4_vlc_t tcoef[2][1 << MPEG4_TCOEF_BITS];   // [0] inter, [1] intra
+    mpeg4_vlc_t mcbpc_i[1 << MPEG4_MCBPC_BITS];
+    mpeg4_vlc_t mcbpc_p[1 << MPEG4_MCBPC_BITS];
+    mpeg4_vlc_t cbpy[1 << MPEG4_CBPY_BITS];         // Intra cbpy
+    mpeg4_vlc_t dc_size[2][1 << MPEG4_DC_BITS];     // [0] luma, [1] chroma
+    mpeg4_vlc_t mv[1 << MPEG4_MV_BITS];             // |motion_code|
+    // Largest level for a run and largest run for a level, for the
+    // escape codes: [intra][last][run or level]
+    uint8_t lmax[2][2][64];
+    uint8_t rmax[2][2][64];
+} mpeg4_vlc_tables_t;
+
+// The tables, built on first use
+const mpeg4_vlc_tables_t* mpeg4_vlc_tables(void);
+
+// Symbol of the next code, or -1 if the bits are not a valid code
+static inline int read_vlc(bit_reader_t* br, const mpeg4_vlc_t* table, int bits) {
+    const mpeg4_vlc_t* e = &table[show_bits(br, bits)];
+    if (!e->len) return -1;
+    skip_bits(br, e->len);
+    return e->sym;
+}
+
+#endif // MPEG4_VLC_H
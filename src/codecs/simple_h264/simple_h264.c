@@ -1,7 +1,8 @@
 #include "simple_h264.h"
+#include "../../../include/trace.h"
+#include "../../../include/bitstream.h"
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 
 // Basic H.264 decoder state
 struct simple_h264_decoder {
@@ -23,96 +24,82 @@ struct simple_h264_decoder {
     uint8_t initialized;
 };
 
-// Exponential Golomb decoding helpers
-static uint32_t read_ue_golomb(const uint8_t **data, size_t *bits_left) {
-    if (*bits_left == 0) return 0;
-    
-    uint32_t leading_zeros = 0;
-    const uint8_t *ptr = *data;
-    size_t bit_pos = 0;
-    
-    // Count leading zeros
-    while (bit_pos < *bits_left) {
-        uint8_t byte = ptr[bit_pos / 8];
-        uint8_t bit = (byte >> (7 - (bit_pos % 8))) & 1;
-        if (bit) break;
-        leading_zeros++;
-        bit_pos++;
-    }
-    
-    if (bit_pos + leading_zeros + 1 > *bits_left) return 0;
-    
-    uint32_t value = 0;
-    bit_pos++; // Skip the '1' bit
-    
-    // Read the remaining bits
-    for (uint32_t i = 0; i < leading_zeros; i++) {
-        if (bit_pos >= *bits_left) break;
-        uint8_t byte = ptr[bit_pos / 8];
-        uint8_t bit = (byte >> (7 - (bit_pos % 8))) & 1;
-        value = (value << 1) | bit;
-        bit_pos++;
+// SPS bytes looked at: everything up to the frame size and cropping,
+// scaling lists included, fits within this for real streams
+#define SPS_PARSE_MAX 512
+
+static void skip_scaling_list(bit_reader_t *br, int size) {
+    int last = 8, next = 8;
+    for (int i = 0; i < size && next != 0; i++) {
+        next = (last + get_se(br) + 256) % 256;
+        if (next != 0) last = next;
     }
-    
-    *data = ptr + (bit_pos / 8);
-    *bits_left -= bit_pos;
-    
-    return (1 << leading_zeros) - 1 + value;
 }
 
-// Parse SPS (Sequence Parameter Set)
+// Parse SPS (Sequence Parameter Set) up to the cropped frame size
 static int parse_sps(simple_h264_decoder_t *decoder, const uint8_t *data, size_t size) {
     if (size < 4) return 0;
-    
-    // Skip NAL header
-    const uint8_t *ptr = data + 1;
-    size_t bits_left = (size - 1) * 8;
-    
-    decoder->profile_idc = ptr[0];
-    decoder->level_idc = ptr[2];
-    
-    ptr += 3;
-    bits_left -= 24;
-    
-    // Read seq_parameter_set_id
-    uint32_t seq_param_id = read_ue_golomb(&ptr, &bits_left);
-    (void)seq_param_id; // Suppress unused warning
-    
-    // For baseline profile, skip to width/height
-    if (decoder->profile_idc == 66) { // Baseline profile
-        // Read log2_max_frame_num_minus4
-        read_ue_golomb(&ptr, &bits_left);
-        
-        // Read pic_order_cnt_type
-        uint32_t poc_type = read_ue_golomb(&ptr, &bits_left);
-        if (poc_type == 0) {
-            read_ue_golomb(&ptr, &bits_left); // log2_max_pic_order_cnt_lsb_minus4
-        }
-        
-        // Read max_num_ref_frames
-        read_ue_golomb(&ptr, &bits_left);
-        
-        // Skip gaps_in_frame_num_value_allowed_flag
-        if (bits_left > 0) {
-            ptr += (bits_left % 8 != 0) ? 1 : 0;
-            bits_left = bits_left - (bits_left % 8);
+
+    // Skip NAL header; emulation prevention removed once up front
+    uint8_t rbsp[SPS_PARSE_MAX];
+    size = bits_unescape(rbsp, data + 1, size - 1 < sizeof(rbsp) ? size - 1 : sizeof(rbsp));
+    bit_reader_t br;
+    init_bits(&br, rbsp, size);
+
+    decoder->profile_idc = (uint8_t)get_bits(&br, 8);
+    skip_bits(&br, 8); // constraint flags
+    decoder->level_idc = (uint8_t)get_bits(&br, 8);
+    get_ue(&br); // seq_parameter_set_id
+
+    uint32_t chroma_format_idc = 1;
+    switch (decoder->profile_idc) {
+    case 100: case 110: case 122: case 244: case 44:
+    case 83: case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+        chroma_format_idc = get_ue(&br);
+        if (chroma_format_idc == 3) skip_bits(&br, 1); // separate_colour_plane_flag
+        get_ue(&br); // bit_depth_luma_minus8
+        get_ue(&br); // bit_depth_chroma_minus8
+        skip_bits(&br, 1); // qpprime_y_zero_transform_bypass_flag
+        if (get_bits1(&br)) { // seq_scaling_matrix_present_flag
+            for (int i = 0; i < (chroma_format_idc != 3 ? 8 : 12); i++)
+                if (get_bits1(&br)) skip_scaling_list(&br, i < 6 ? 16 : 64);
         }
-        
-        // Read pic_width_in_mbs_minus1
-        uint32_t width_mbs = read_ue_golomb(&ptr, &bits_left) + 1;
-        decoder->width = width_mbs * 16;
-        
-        // Read pic_height_in_map_units_minus1
-        uint32_t height_mbs = read_ue_golomb(&ptr, &bits_left) + 1;
-        decoder->height = height_mbs * 16;
-        
-        decoder->sps_valid = 1;
-        return 1;
+        break;
     }
-    
-    // For other profiles, use fallback dimensions
-    decoder->width = 1920;
-    decoder->height = 1080;
+
+    get_ue(&br); // log2_max_frame_num_minus4
+    uint32_t poc_type = get_ue(&br);
+    if (poc_type == 0) {
+        get_ue(&br); // log2_max_pic_order_cnt_lsb_minus4
+    } else if (poc_type == 1) {
+        skip_bits(&br, 1); // delta_pic_order_always_zero_flag
+        get_se(&br); // offset_for_non_ref_pic
+        get_se(&br); // offset_for_top_to_bottom_field
+        uint32_t cycle = get_ue(&br);
+        for (uint32_t i = 0; i < cycle && bits_left(&br) > 0; i++) get_se(&br);
+    }
+    get_ue(&br); // max_num_ref_frames
+    skip_bits(&br, 1); // gaps_in_frame_num_value_allowed_flag
+
+    uint32_t width_mbs = get_ue(&br) + 1;
+    uint32_t height_map_units = get_ue(&br) + 1;
+    int frame_mbs_only = get_bits1(&br);
+    if (!frame_mbs_only) skip_bits(&br, 1); // mb_adaptive_frame_field_flag
+    skip_bits(&br, 1); // direct_8x8_inference_flag
+    uint32_t crop[4] = {0, 0, 0, 0};
+    if (get_bits1(&br)) { // frame_cropping_flag
+        for (int i = 0; i < 4; i++) crop[i] = get_ue(&br);
+    }
+    if (bits_left(&br) < 0 || width_mbs > 1024 || height_map_units > 1024) return 0;
+
+    // Cropping is in chroma samples (4:2:0 and 4:2:2 halve the width,
+    // 4:2:0 the height too) and in field pairs for field coding
+    uint32_t crop_x = chroma_format_idc == 1 || chroma_format_idc == 2 ? 2 : 1;
+    uint32_t crop_y = (chroma_format_idc == 1 ? 2 : 1) * (frame_mbs_only ? 1 : 2);
+    uint32_t width = width_mbs * 16, height = height_map_units * 16 * (frame_mbs_only ? 1 : 2);
+    if ((crop[0] + crop[1]) * crop_x >= width || (crop[2] + crop[3]) * crop_y >= height) return 0;
+    decoder->width = width - (crop[0] + crop[1]) * crop_x;
+    decoder->height = height - (crop[2] + crop[3]) * crop_y;
     decoder->sps_valid = 1;
     return 1;
 }
@@ -178,25 +165,24 @@ simple_h264_result_t simple_h264_decode(
     
     simple_h264_nal_type_t nal_type = simple_h264_get_nal_type(data);
     
-    printf("[SIMPLE_H264] Processing NAL type %d, size %zu\n", nal_type, data_size);
+    TRACE_DEBUG(TRACE_SIMPLE_H264_NAL, nal_type, data_size);
     
     switch (nal_type) {
         case SIMPLE_H264_NAL_SPS:
             if (parse_sps(decoder, data, data_size)) {
-                printf("[SIMPLE_H264] SPS parsed: %dx%d\n", decoder->width, decoder->height);
+                TRACE_INFO(TRACE_SIMPLE_H264_SPS, decoder->width, decoder->height);
                 return SIMPLE_H264_HEADERS_READY;
             } else {
-                printf("[SIMPLE_H264] SPS parsing failed\n");
+                TRACE_ERROR(TRACE_SIMPLE_H264_ERROR, nal_type, 0);
                 return SIMPLE_H264_PARAM_SET_ERROR;
             }
             break;
             
         case SIMPLE_H264_NAL_PPS:
             if (parse_pps(decoder, data, data_size)) {
-                printf("[SIMPLE_H264] PPS parsed successfully\n");
                 return SIMPLE_H264_HEADERS_READY;
             } else {
-                printf("[SIMPLE_H264] PPS parsing failed\n");
+                TRACE_ERROR(TRACE_SIMPLE_H264_ERROR, nal_type, 0);
                 return SIMPLE_H264_PARAM_SET_ERROR;
             }
             break;
@@ -204,7 +190,7 @@ simple_h264_result_t simple_h264_decode(
         case SIMPLE_H264_NAL_IDR_SLICE:
         case SIMPLE_H264_NAL_SLICE:
             if (!decoder->sps_valid || !decoder->pps_valid) {
-                printf("[SIMPLE_H264] Missing parameter sets for slice\n");
+                TRACE_ERROR(TRACE_SIMPLE_H264_ERROR, nal_type, 0);
                 return SIMPLE_H264_PARAM_SET_ERROR;
             }
             
@@ -245,24 +231,21 @@ simple_h264_result_t simple_h264_decode(
                     frame->y_stride = decoder->width;
                     frame->uv_stride = decoder->width / 2;
                     
-                    printf("[SIMPLE_H264] Frame ready: %dx%d\n", decoder->width, decoder->height);
+                    TRACE_DEBUG(TRACE_SIMPLE_H264_FRAME, decoder->width, decoder->height);
                     return SIMPLE_H264_FRAME_READY;
                 }
             }
             
-            printf("[SIMPLE_H264] Slice processed (no actual decoding)\n");
+            // Slice processed (no actual decoding)
             return SIMPLE_H264_OK;
             
         case SIMPLE_H264_NAL_AUD:
-            printf("[SIMPLE_H264] Access Unit Delimiter processed\n");
             return SIMPLE_H264_OK;
             
         case SIMPLE_H264_NAL_SEI:
-            printf("[SIMPLE_H264] SEI message processed\n");
             return SIMPLE_H264_OK;
             
         default:
-            printf("[SIMPLE_H264] Unsupported NAL type %d\n", nal_type);
             return SIMPLE_H264_OK;
     }
 }
@@ -0,0 +1,486 @@
+// YUV 4:2:0 to packed RGB conversion of decoded pictures, shared by the
+// player and the benchmark.
+//
+// Two rows share a chroma row, so the vector code converts a row pair at a
+// time and works out the chroma terms once for both. It is exact with the
+// C arithmetic: (c * k) >> 8 is the high half of (c << 7) * 2k (SSE2 and
+// AVX2 pmulhw) or the doubling high half of (c << 7) * k (NEON vqdmulh),
+// and the unsigned saturating packs do the clamping. The version used is
+// the first of pair_table (AVX2, SSSE3, SSE2 on x86; NEON) the CPU runs,
+// see include/cpu.h. Define YUV2RGB_NO_SIMD to build the C version only.
+#include "../../include/yuv2rgb.h"
+#include "../../include/cpu.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(YUV2RGB_NO_SIMD) && defined(__SSE2__) && defined(__GNUC__)
+#define YUV2RGB_X86
+#include <immintrin.h>
+#elif !defined(YUV2RGB_NO_SIMD) && defined(__ARM_NEON)
+#define YUV2RGB_NEON
+#include <arm_neon.h>
+#endif
+
+static inline uint8_t clamp_u8(int x) { return (x < 0) ? 0 : (x > 255 ? 255 : (uint8_t)x); }
+
+// Byte offsets of R, G and B in a pixel of each format
+static const uint8_t channel_offset[3][3] = {
+    [YUV2RGB_RGB24] = { 0, 1, 2 },
+    [YUV2RGB_BGR24] = { 2, 1, 0 },
+    [YUV2RGB_BGRA32] = { 2, 1, 0 },
+};
+
+// Pixels [from, width) of one row
+static void convert_row_c(yuv2rgb_format_t format, int from, int width,
+                          const uint8_t *py, const uint8_t *pu, const uint8_t *pv, uint8_t *dst)
+{
+    const int bpp = yuv2rgb_bytes_per_pixel(format);
+    const int ro = channel_offset[format][0], go = channel_offset[format][1], bo = channel_offset[format][2];
+    dst += from * bpp;
+    for (int i = from; i < width; ++i, dst += bpp) {
+        int y = py[i];
+        int u = pu[i / 2] - 128;
+        int v = pv[i / 2] - 128;
+
+        int r = y + ((v * 359) >> 8);
+        int g = y - ((u * 88) >> 8) - ((v * 183) >> 8);
+        int b = y + ((u * 454) >> 8);
+
+        dst[ro] = clamp_u8(r);
+        dst[go] = clamp_u8(g);
+        dst[bo] = clamp_u8(b);
+        if (bpp == 4) dst[3] = 255;
+    }
+}
+
+#if defined(YUV2RGB_X86) || defined(YUV2RGB_NEON)
+// Convert the first pixels of a row pair (y1 and d1 are NULL for the last
+// row of an odd height) and return how many, a multiple of the vector width
+typedef int (*convert_pair_fn)(yuv2rgb_format_t format, int width,
+                               const uint8_t *y0, const uint8_t *y1,
+                               const uint8_t *pu, const uint8_t *pv,
+                               uint8_t *d0, uint8_t *d1);
+#endif
+
+#ifdef YUV2RGB_X86
+// Red, green and blue terms of 8 chroma samples, each widened to the two
+// pixels it covers: 16 pixels in two halves
+typedef struct {
+    __m128i r[2], g[2], b[2];
+} chroma_sse2_t;
+
+static inline void chroma_sse2(chroma_sse2_t *c, const uint8_t *pu, const uint8_t *pv) {
+    const __m128i zero = _mm_setzero_si128(), bias = _mm_set1_epi16(128);
+    __m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)pu), zero);
+    __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)pv), zero);
+    u = _mm_slli_epi16(_mm_sub_epi16(u, bias), 7);
+    v = _mm_slli_epi16(_mm_sub_epi16(v, bias), 7);
+    __m128i r = _mm_mulhi_epi16(v, _mm_set1_epi16(2 * 359));
+    __m128i g = _mm_add_epi16(_mm_mulhi_epi16(u, _mm_set1_epi16(2 * 88)),
+                              _mm_mulhi_epi16(v, _mm_set1_epi16(2 * 183)));
+    __m128i b = _mm_mulhi_epi16(u, _mm_set1_epi16(2 * 454));
+    c->r[0] = _mm_unpacklo_epi16(r, r); c->r[1] = _mm_unpackhi_epi16(r, r);
+    c->g[0] = _mm_unpacklo_epi16(g, g); c->g[1] = _mm_unpackhi_epi16(g, g);
+    c->b[0] = _mm_unpacklo_epi16(b, b); c->b[1] = _mm_unpackhi_epi16(b, b);
+}
+
+// R, G and B of 16 pixels of a row
+static inline void rgb_sse2(const chroma_sse2_t *c, const uint8_t *py, __m128i *r, __m128i *g, __m128i *b) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i y = _mm_loadu_si128((const __m128i *)py);
+    __m128i lo = _mm_unpacklo_epi8(y, zero), hi = _mm_unpackhi_epi8(y, zero);
+    *r = _mm_packus_epi16(_mm_add_epi16(lo, c->r[0]), _mm_add_epi16(hi, c->r[1]));
+    *g = _mm_packus_epi16(_mm_sub_epi16(lo, c->g[0]), _mm_sub_epi16(hi, c->g[1]));
+    *b = _mm_packus_epi16(_mm_add_epi16(lo, c->b[0]), _mm_add_epi16(hi, c->b[1]));
+}
+
+// 16 pixels of 32 bits from their bytes in memory order
+static inline void store_32_sse2(uint8_t *dst, __m128i a, __m128i b, __m128i c, __m128i d) {
+    __m128i ab0 = _mm_unpacklo_epi8(a, b), ab1 = _mm_unpackhi_epi8(a, b);
+    __m128i cd0 = _mm_unpacklo_epi8(c, d), cd1 = _mm_unpackhi_epi8(c, d);
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(ab0, cd0));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(ab0, cd0));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(ab1, cd1));
+    _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(ab1, cd1));
+}
+
+// Four 32-bit pixels with zero top bytes as 12 bytes: each 64-bit half
+// closes up to 6 bytes, then the upper half moves down next to the lower
+static inline void store_3of4_sse2(uint8_t *dst, __m128i px) {
+    const __m128i low = _mm_set1_epi64x(0x0000000000ffffffLL);
+    const __m128i high = _mm_set1_epi64x(0x0000ffffff000000LL);
+    px = _mm_or_si128(_mm_and_si128(px, low), _mm_and_si128(_mm_srli_epi64(px, 8), high));
+    px = _mm_or_si128(_mm_move_epi64(px), _mm_srli_si128(_mm_unpackhi_epi64(_mm_setzero_si128(), px), 2));
+    uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(px, 8));
+    _mm_storel_epi64((__m128i *)dst, px);
+    memcpy(dst + 8, &tail, 4);
+}
+
+// 16 pixels of 24 bits from their bytes in memory order
+static inline void store_24_sse2(uint8_t *dst, __m128i a, __m128i b, __m128i c) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i ab0 = _mm_unpacklo_epi8(a, b), ab1 = _mm_unpackhi_epi8(a, b);
+    __m128i c0 = _mm_unpacklo_epi8(c, zero), c1 = _mm_unpackhi_epi8(c, zero);
+    store_3of4_sse2(dst, _mm_unpacklo_epi16(ab0, c0));
+    store_3of4_sse2(dst + 12, _mm_unpackhi_epi16(ab0, c0));
+    store_3of4_sse2(dst + 24, _mm_unpacklo_epi16(ab1, c1));
+    store_3of4_sse2(dst + 36, _mm_unpackhi_epi16(ab1, c1));
+}
+
+static int pair_sse2(yuv2rgb_format_t format, int width,
+                     const uint8_t *y0, const uint8_t *y1, const uint8_t *pu, const uint8_t *pv,
+                     uint8_t *d0, uint8_t *d1)
+{
+    const int bpp = yuv2rgb_bytes_per_pixel(format);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        chroma_sse2_t c;
+        chroma_sse2(&c, pu + i / 2, pv + i / 2);
+        for (int k = 0; k < 2; k++) {
+            const uint8_t *py = k ? y1 : y0;
+            uint8_t *dst = (k ? d1 : d0) + i * bpp;
+            if (!py) break;
+            __m128i r, g, b;
+            rgb_sse2(&c, py + i, &r, &g, &b);
+            if (format == YUV2RGB_RGB24) store_24_sse2(dst, r, g, b);
+            else if (format == YUV2RGB_BGR24) store_24_sse2(dst, b, g, r);
+            else store_32_sse2(dst, b, g, r, alpha);
+        }
+    }
+    return i;
+}
+
+// pshufb masks interleaving three planes of 16 bytes: output vector j
+// takes byte 16j + k from plane (16j + k) % 3
+static const int8_t interleave3[3][3][16] __attribute__((aligned(16))) = {
+    {
+        {0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5},
+        {-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1},
+        {-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1},
+    }, {
+        {-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1},
+        {5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10},
+        {-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1},
+    }, {
+        {-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1},
+        {-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1},
+        {10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15},
+    },
+};
+
+__attribute__((target("ssse3")))
+static inline void store_24_ssse3(uint8_t *dst, __m128i a, __m128i b, __m128i c) {
+    for (int j = 0; j < 3; j++) {
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(_mm_shuffle_epi8(a, _mm_load_si128((const __m128i *)interleave3[j][0])),
+                         _mm_shuffle_epi8(b, _mm_load_si128((const __m128i *)interleave3[j][1]))),
+            _mm_shuffle_epi8(c, _mm_load_si128((const __m128i *)interleave3[j][2])));
+        _mm_storeu_si128((__m128i *)(dst + 16 * j), out);
+    }
+}
+
+__attribute__((target("ssse3")))
+static int pair_ssse3(yuv2rgb_format_t format, int width,
+                      const uint8_t *y0, const uint8_t *y1, const uint8_t *pu, const uint8_t *pv,
+                      uint8_t *d0, uint8_t *d1)
+{
+    const int bpp = yuv2rgb_bytes_per_pixel(format);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        chroma_sse2_t c;
+        chroma_sse2(&c, pu + i / 2, pv + i / 2);
+        for (int k = 0; k < 2; k++) {
+            const uint8_t *py = k ? y1 : y0;
+            uint8_t *dst = (k ? d1 : d0) + i * bpp;
+            if (!py) break;
+            __m128i r, g, b;
+            rgb_sse2(&c, py + i, &r, &g, &b);
+            if (format == YUV2RGB_RGB24) store_24_ssse3(dst, r, g, b);
+            else if (format == YUV2RGB_BGR24) store_24_ssse3(dst, b, g, r);
+            else store_32_sse2(dst, b, g, r, alpha);
+        }
+    }
+    return i;
+}
+
+// 32 pixels a step. The in-lane unpacks and packs cancel out, so the
+// terms of chroma samples 0-3 and 8-11 widened by unpacklo line up with
+// luma unpacklo (pixels 0-7 and 16-23) and the packs come out in order.
+__attribute__((target("avx2")))
+static int pair_avx2(yuv2rgb_format_t format, int width,
+                     const uint8_t *y0, const uint8_t *y1, const uint8_t *pu, const uint8_t *pv,
+                     uint8_t *d0, uint8_t *d1)
+{
+    const int bpp = yuv2rgb_bytes_per_pixel(format);
+    const __m256i zero = _mm256_setzero_si256(), bias = _mm256_set1_epi16(128);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+    int i = 0;
+    for (; i + 32 <= width; i += 32) {
+        __m256i u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pu + i / 2)));
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pv + i / 2)));
+        u = _mm256_slli_epi16(_mm256_sub_epi16(u, bias), 7);
+        v = _mm256_slli_epi16(_mm256_sub_epi16(v, bias), 7);
+        __m256i cr = _mm256_mulhi_epi16(v, _mm256_set1_epi16(2 * 359));
+        __m256i cg = _mm256_add_epi16(_mm256_mulhi_epi16(u, _mm256_set1_epi16(2 * 88)),
+                                      _mm256_mulhi_epi16(v, _mm256_set1_epi16(2 * 183)));
+        __m256i cb = _mm256_mulhi_epi16(u, _mm256_set1_epi16(2 * 454));
+        __m256i r0 = _mm256_unpacklo_epi16(cr, cr), r1 = _mm256_unpackhi_epi16(cr, cr);
+        __m256i g0 = _mm256_unpacklo_epi16(cg, cg), g1 = _mm256_unpackhi_epi16(cg, cg);
+        __m256i b0 = _mm256_unpacklo_epi16(cb, cb), b1 = _mm256_unpackhi_epi16(cb, cb);
+        for (int k = 0; k < 2; k++) {
+            const uint8_t *py = k ? y1 : y0;
+            uint8_t *dst = (k ? d1 : d0) + i * bpp;
+            if (!py) break;
+            __m256i y = _mm256_loadu_si256((const __m256i *)(py + i));
+            __m256i lo = _mm256_unpacklo_epi8(y, zero), hi = _mm256_unpackhi_epi8(y, zero);
+            __m256i r = _mm256_packus_epi16(_mm256_add_epi16(lo, r0), _mm256_add_epi16(hi, r1));
+            __m256i g = _mm256_packus_epi16(_mm256_sub_epi16(lo, g0), _mm256_sub_epi16(hi, g1));
+            __m256i b = _mm256_packus_epi16(_mm256_add_epi16(lo, b0), _mm256_add_epi16(hi, b1));
+            if (format == YUV2RGB_BGRA32) {
+                __m256i bg0 = _mm256_unpacklo_epi8(b, g), bg1 = _mm256_unpackhi_epi8(b, g);
+                __m256i ra0 = _mm256_unpacklo_epi8(r, alpha), ra1 = _mm256_unpackhi_epi8(r, alpha);
+                __m256i q0 = _mm256_unpacklo_epi16(bg0, ra0), q1 = _mm256_unpackhi_epi16(bg0, ra0);
+                __m256i q2 = _mm256_unpacklo_epi16(bg1, ra1), q3 = _mm256_unpackhi_epi16(bg1, ra1);
+                _mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(q0, q1, 0x20));
+                _mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(q2, q3, 0x20));
+                _mm256_storeu_si256((__m256i *)(dst + 64), _mm256_permute2x128_si256(q0, q1, 0x31));
+                _mm256_storeu_si256((__m256i *)(dst + 96), _mm256_permute2x128_si256(q2, q3, 0x31));
+            } else {
+                if (format == YUV2RGB_BGR24) {
+                    __m256i t = r;
+                    r = b;
+                    b = t;
+                }
+                store_24_ssse3(dst, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g),
+                               _mm256_castsi256_si128(b));
+                store_24_ssse3(dst + 48, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1),
+                               _mm256_extracti128_si256(b, 1));
+            }
+        }
+    }
+    // One more step of 16
+    return i + pair_ssse3(format, width - i, y0 + i, y1 ? y1 + i : NULL, pu + i / 2, pv + i / 2,
+                          d0 + i * bpp, d1 ? d1 + i * bpp : NULL);
+}
+
+static const struct {
+    unsigned features;
+    convert_pair_fn fn;
+    const char *name;
+} pair_table[] = {
+    { CPU_AVX2 | CPU_SSSE3, pair_avx2, "avx2" },
+    { CPU_SSSE3, pair_ssse3, "ssse3" },
+    { CPU_SSE2, pair_sse2, "sse2" },
+};
+#endif
+
+#ifdef YUV2RGB_NEON
+static int pair_neon(yuv2rgb_format_t format, int width,
+                     const uint8_t *y0, const uint8_t *y1, const uint8_t *pu, const uint8_t *pv,
+                     uint8_t *d0, uint8_t *d1)
+{
+    const int bpp = yuv2rgb_bytes_per_pixel(format);
+    const uint8x8_t bias = vdup_n_u8(128);
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        int16x8_t u = vshlq_n_s16(vreinterpretq_s16_u16(vsubl_u8(vld1_u8(pu + i / 2), bias)), 7);
+        int16x8_t v = vshlq_n_s16(vreinterpretq_s16_u16(vsubl_u8(vld1_u8(pv + i / 2), bias)), 7);
+        int16x8x2_t cr = vzipq_s16(vqdmulhq_n_s16(v, 359), vqdmulhq_n_s16(v, 359));
+        int16x8_t gt = vaddq_s16(vqdmulhq_n_s16(u, 88), vqdmulhq_n_s16(v, 183));
+        int16x8x2_t cg = vzipq_s16(gt, gt);
+        int16x8x2_t cb = vzipq_s16(vqdmulhq_n_s16(u, 454), vqdmulhq_n_s16(u, 454));
+        for (int k = 0; k < 2; k++) {
+            const uint8_t *py = k ? y1 : y0;
+            uint8_t *dst = (k ? d1 : d0) + i * bpp;
+            if (!py) break;
+            uint8x16_t y = vld1q_u8(py + i);
+            int16x8_t lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+            int16x8_t hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+            uint8x16_t r = vcombine_u8(vqmovun_s16(vaddq_s16(lo, cr.val[0])), vqmovun_s16(vaddq_s16(hi, cr.val[1])));
+            uint8x16_t g = vcombine_u8(vqmovun_s16(vsubq_s16(lo, cg.val[0])), vqmovun_s16(vsubq_s16(hi, cg.val[1])));
+            uint8x16_t b = vcombine_u8(vqmovun_s16(vaddq_s16(lo, cb.val[0])), vqmovun_s16(vaddq_s16(hi, cb.val[1])));
+            if (format == YUV2RGB_BGRA32) {
+                uint8x16x4_t px = { { b, g, r, vdupq_n_u8(255) } };
+                vst4q_u8(dst, px);
+            } else if (format == YUV2RGB_BGR24) {
+                uint8x16x3_t px = { { b, g, r } };
+                vst3q_u8(dst, px);
+            } else {
+                uint8x16x3_t px = { { r, g, b } };
+                vst3q_u8(dst, px);
+            }
+        }
+    }
+    return i;
+}
+
+static const struct {
+    unsigned features;
+    convert_pair_fn fn;
+    const char *name;
+} pair_table[] = {
+    { CPU_NEON, pair_neon, "neon" },
+};
+#endif
+
+#if defined(YUV2RGB_X86) || defined(YUV2RGB_NEON)
+static convert_pair_fn pair_fn;     // NULL: C only
+static pthread_once_t pair_once = PTHREAD_ONCE_INIT;
+
+static void select_pair(void) {
+    unsigned features = cpu_features();
+    for (size_t i = 0; i < sizeof(pair_table) / sizeof(pair_table[0]); i++) {
+        if ((pair_table[i].features & features) == pair_table[i].features) {
+            pair_fn = pair_table[i].fn;
+            break;
+        }
+    }
+}
+#endif
+
+int yuv2rgb_use_version(size_t i, const char **name) {
+#if defined(YUV2RGB_X86) || defined(YUV2RGB_NEON)
+    if (i >= sizeof(pair_table) / sizeof(pair_table[0])) return -1;
+    *name = pair_table[i].name;
+    if ((pair_table[i].features & cpu_features()) != pair_table[i].features) return 0;
+    pthread_once(&pair_once, select_pair);
+    pair_fn = pair_table[i].fn;
+    return 1;
+#else
+    (void)i;
+    (void)name;
+    return -1;
+#endif
+}
+
+// Convert a row pair (y1 and d1 NULL for the last row of an odd height):
+// the vector code first, C for the pixels it leaves
+static void convert_pair(yuv2rgb_format_t format, int width,
+                         const uint8_t *y0, const uint8_t *y1, const uint8_t *pu, const uint8_t *pv,
+                         uint8_t *d0, uint8_t *d1)
+{
+    int done = 0;
+#if defined(YUV2RGB_X86) || defined(YUV2RGB_NEON)
+    pthread_once(&pair_once, select_pair);
+    if (pair_fn) done = pair_fn(format, width, y0, y1, pu, pv, d0, d1);
+#endif
+    convert_row_c(format, done, width, y0, pu, pv, d0);
+    if (y1) convert_row_c(format, done, width, y1, pu, pv, d1);
+}
+
+void yuv420_to_rgb(yuv2rgb_format_t format, int width, int height,
+                   const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                   int y_stride, int u_stride, int v_stride,
+                   uint8_t *dst, int dst_stride)
+{
+    for (int j = 0; j < height; j += 2) {
+        const uint8_t *y0 = y_plane + j * y_stride;
+        const uint8_t *y1 = j + 1 < height ? y0 + y_stride : NULL;
+        uint8_t *d0 = dst + j * dst_stride;
+        convert_pair(format, width, y0, y1, u_plane + (j / 2) * u_stride, v_plane + (j / 2) * v_stride,
+                     d0, y1 ? d0 + dst_stride : NULL);
+    }
+}
+
+// Source sample of output sample x of n, with the sample centres of both
+// lined up: (x + 0.5) * src / n - 0.5 in 16.16 fixed point. Bilinear reads
+// i0 and i1 weighted 256 - frac and frac; nearest only reads i0.
+typedef struct {
+    int i0, i1, frac;
+} scale_tap_t;
+
+static scale_tap_t scale_tap(int x, int n, int src, yuv2rgb_filter_t filter) {
+    int64_t pos = (((int64_t)(2 * x + 1) * src << 16) / n - 65536) / 2;
+    scale_tap_t t;
+    if (filter == YUV2RGB_NEAREST) {
+        t.i0 = (int)((pos + 32768) >> 16);
+        t.frac = 0;
+    } else {
+        if (pos < 0) pos = 0;
+        t.i0 = (int)(pos >> 16);
+        t.frac = (int)(pos >> 8) & 255;
+    }
+    if (t.i0 > src - 1) t.i0 = src - 1;
+    t.i1 = t.i0 + 1 < src ? t.i0 + 1 : t.i0;
+    return t;
+}
+
+// One output row of a plane: the taps across, then for bilinear a blend of
+// the two source rows (kept apart from the gathers so it vectorizes)
+static void scale_row(uint8_t *dst, uint8_t *tmp, int n, const scale_tap_t *taps,
+                      const uint8_t *plane, int stride, scale_tap_t row, yuv2rgb_filter_t filter)
+{
+    const uint8_t *r0 = plane + row.i0 * stride;
+    if (filter == YUV2RGB_NEAREST) {
+        for (int x = 0; x < n; x++) dst[x] = r0[taps[x].i0];
+        return;
+    }
+    for (int x = 0; x < n; x++)
+        dst[x] = (uint8_t)((r0[taps[x].i0] * (256 - taps[x].frac) + r0[taps[x].i1] * taps[x].frac + 128) >> 8);
+    if (row.frac == 0) return;
+    const uint8_t *r1 = plane + row.i1 * stride;
+    for (int x = 0; x < n; x++)
+        tmp[x] = (uint8_t)((r1[taps[x].i0] * (256 - taps[x].frac) + r1[taps[x].i1] * taps[x].frac + 128) >> 8);
+    const int fy = row.frac;
+    for (int x = 0; x < n; x++) dst[x] = (uint8_t)((dst[x] * (256 - fy) + tmp[x] * fy + 128) >> 8);
+}
+
+int yuv420_to_rgb_scaled_rows(yuv2rgb_format_t format, yuv2rgb_filter_t filter, int width, int height,
+                              const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                              int y_stride, int u_stride, int v_stride,
+                              uint8_t *dst, int dst_width, int dst_height, int dst_stride,
+                              int first_row, int rows)
+{
+    if (width <= 0 || height <= 0 || dst_width <= 0 || dst_height <= 0) return 0;
+    const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    const int dcw = (dst_width + 1) / 2, dch = (dst_height + 1) / 2;
+
+    // Scaled rows (two of luma, one of each chroma, one to blend with)
+    // and the taps across, for both plane widths
+    size_t row_bytes = 3 * (size_t)dst_width + 2 * (size_t)dcw;
+    size_t taps_size = ((size_t)dst_width + dcw) * sizeof(scale_tap_t);
+    scale_tap_t *taps = malloc(taps_size + row_bytes);
+    if (!taps) return -1;
+    scale_tap_t *ctaps = taps + dst_width;
+    uint8_t *y0 = (uint8_t *)(ctaps + dcw), *y1 = y0 + dst_width, *tmp = y1 + dst_width;
+    uint8_t *pu = tmp + dst_width, *pv = pu + dcw;
+    for (int x = 0; x < dst_width; x++) taps[x] = scale_tap(x, dst_width, width, filter);
+    for (int x = 0; x < dcw; x++) ctaps[x] = scale_tap(x, dcw, cw, filter);
+
+    int end = first_row + rows < dst_height ? first_row + rows : dst_height;
+    for (int j = first_row; j < end; j += 2) {
+        int pair = j + 1 < end;
+        scale_row(y0, tmp, dst_width, taps, y_plane, y_stride, scale_tap(j, dst_height, height, filter), filter);
+        if (pair)
+            scale_row(y1, tmp, dst_width, taps, y_plane, y_stride, scale_tap(j + 1, dst_height, height, filter), filter);
+        scale_tap_t crow = scale_tap(j / 2, dch, ch, filter);
+        scale_row(pu, tmp, dcw, ctaps, u_plane, u_stride, crow, filter);
+        scale_row(pv, tmp, dcw, ctaps, v_plane, v_stride, crow, filter);
+        uint8_t *d0 = dst + j * dst_stride;
+        convert_pair(format, dst_width, y0, pair ? y1 : NULL, pu, pv, d0, pair ? d0 + dst_stride : NULL);
+    }
+    free(taps);
+    return 0;
+}
+
+int yuv420_to_rgb_scaled(yuv2rgb_format_t format, yuv2rgb_filter_t filter, int width, int height,
+                         const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                         int y_stride, int u_stride, int v_stride,
+                         uint8_t *dst, int dst_width, int dst_height, int dst_stride)
+{
+    return yuv420_to_rgb_scaled_rows(format, filter, width, height, y_plane, u_plane, v_plane,
+                                     y_stride, u_stride, v_stride,
+                                     dst, dst_width, dst_height, dst_stride, 0, dst_height);
+}
+
+void yuv420_to_rgb24(int width, int height,
+                     const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                     int y_stride, int u_stride, int v_stride,
+                     uint8_t *rgb, int rgb_stride)
+{
+    yuv420_to_rgb(YUV2RGB_RGB24, width, height, y_plane, u_plane, v_plane,
+                  y_stride, u_stride, v_stride, rgb, rgb_stride);
+}
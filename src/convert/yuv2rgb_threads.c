@@ -0,0 +1,213 @@
+// Band-split YUV 4:2:0 to RGB conversion on a small pool of persistent
+// threads. Rows do not depend on each other, so a picture is cut into
+// horizontal bands of an even number of rows (a chroma row is never split)
+// that the workers and the calling thread convert at the same time.
+#define _GNU_SOURCE
+#include "../../include/yuv2rgb.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_CONVERT_THREADS 16
+// Pictures smaller than two bands of this many pixels are converted on the
+// calling thread: waking the workers would cost more than it saves
+#define MIN_BAND_PIXELS (128 * 1024)
+
+struct yuv2rgb_threads {
+    pthread_mutex_t mutex;
+    pthread_cond_t start;       // signalled when a picture is handed out
+    pthread_cond_t done;        // signalled when its last band is finished
+    pthread_t threads[MAX_CONVERT_THREADS];
+    int num_threads;            // workers, the caller converts bands too
+    int quit;
+
+    // Picture being converted
+    yuv2rgb_format_t format;
+    int width, height;
+    const uint8_t *y_plane, *u_plane, *v_plane;
+    int y_stride, u_stride, v_stride;
+    uint8_t *dst;
+    int dst_width, dst_height;  // output size
+    int dst_stride;
+    int scaled;                 // through yuv420_to_rgb_scaled_rows()
+    yuv2rgb_filter_t filter;
+    int band_rows;              // even, of the output
+    int num_bands;
+    int next_band;              // bands handed out
+    int bands_done;
+};
+
+static void convert_band(const yuv2rgb_threads_t *t, int band) {
+    int first = band * t->band_rows;
+    int rows = t->dst_height - first < t->band_rows ? t->dst_height - first : t->band_rows;
+    if (t->scaled) {
+        yuv420_to_rgb_scaled_rows(t->format, t->filter, t->width, t->height,
+                                  t->y_plane, t->u_plane, t->v_plane, t->y_stride, t->u_stride, t->v_stride,
+                                  t->dst, t->dst_width, t->dst_height, t->dst_stride, first, rows);
+        return;
+    }
+    yuv420_to_rgb(t->format, t->width, rows,
+                  t->y_plane + first * t->y_stride,
+                  t->u_plane + first / 2 * t->u_stride,
+                  t->v_plane + first / 2 * t->v_stride,
+                  t->y_stride, t->u_stride, t->v_stride,
+                  t->dst + first * t->dst_stride, t->dst_stride);
+}
+
+// Convert bands until none is left to take; called with the mutex held
+static void take_bands(yuv2rgb_threads_t *t) {
+    while (t->next_band < t->num_bands) {
+        int band = t->next_band++;
+        pthread_mutex_unlock(&t->mutex);
+        convert_band(t, band);
+        pthread_mutex_lock(&t->mutex);
+        if (++t->bands_done == t->num_bands) pthread_cond_signal(&t->done);
+    }
+}
+
+static void *convert_thread(void *arg) {
+    yuv2rgb_threads_t *t = arg;
+    pthread_mutex_lock(&t->mutex);
+    for (;;) {
+        while (!t->quit && t->next_band >= t->num_bands) pthread_cond_wait(&t->start, &t->mutex);
+        if (t->quit) break;
+        take_bands(t);
+    }
+    pthread_mutex_unlock(&t->mutex);
+    return NULL;
+}
+
+yuv2rgb_threads_t *yuv2rgb_threads_create(int threads) {
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > MAX_CONVERT_THREADS) threads = MAX_CONVERT_THREADS;
+    if (threads < 2) return NULL;
+
+    yuv2rgb_threads_t *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    pthread_mutex_init(&t->mutex, NULL);
+    pthread_cond_init(&t->start, NULL);
+    pthread_cond_init(&t->done, NULL);
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&t->threads[i], NULL, convert_thread, t) != 0) break;
+        t->num_threads++;
+    }
+    if (t->num_threads == 0) {
+        yuv2rgb_threads_destroy(t);
+        return NULL;
+    }
+    return t;
+}
+
+void yuv2rgb_threads_destroy(yuv2rgb_threads_t *t) {
+    if (!t) return;
+    pthread_mutex_lock(&t->mutex);
+    t->quit = 1;
+    pthread_cond_broadcast(&t->start);
+    pthread_mutex_unlock(&t->mutex);
+    for (int i = 0; i < t->num_threads; i++) pthread_join(t->threads[i], NULL);
+    pthread_cond_destroy(&t->done);
+    pthread_cond_destroy(&t->start);
+    pthread_mutex_destroy(&t->mutex);
+    free(t);
+}
+
+int yuv2rgb_threads_pin(yuv2rgb_threads_t *t, uint64_t cpus) {
+    if (!t || !cpus) return 0;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; cpu++)
+        if (cpus & (1ULL << cpu)) CPU_SET(cpu, &set);
+    int result = 0;
+    for (int i = 0; i < t->num_threads; i++) {
+        if (pthread_setaffinity_np(t->threads[i], sizeof(set), &set) != 0) result = -1;
+        pthread_setname_np(t->threads[i], "anhelo-convert");
+    }
+    return result;
+#else
+    return -1;
+#endif
+}
+
+// Hand the bands of the picture set up in t to the workers, take some
+// on this thread and wait for all of them
+static void run_bands(yuv2rgb_threads_t *t) {
+    pthread_cond_broadcast(&t->start);
+    take_bands(t);
+    while (t->bands_done < t->num_bands) pthread_cond_wait(&t->done, &t->mutex);
+    pthread_mutex_unlock(&t->mutex);
+}
+
+// How many bands of at least MIN_BAND_PIXELS for an output of this size,
+// one per thread at most
+static int count_bands(const yuv2rgb_threads_t *t, int width, int height) {
+    int bands = t ? t->num_threads + 1 : 1;
+    long pixels = (long)width * height;
+    if (pixels / MIN_BAND_PIXELS < bands) bands = (int)(pixels / MIN_BAND_PIXELS);
+    return bands;
+}
+
+// Lock the pool and set up the picture; the output is split into bands
+static void set_picture(yuv2rgb_threads_t *t, int bands, int scaled, yuv2rgb_filter_t filter,
+                        yuv2rgb_format_t format, int width, int height,
+                        const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                        int y_stride, int u_stride, int v_stride,
+                        uint8_t *dst, int dst_width, int dst_height, int dst_stride)
+{
+    pthread_mutex_lock(&t->mutex);
+    t->format = format;
+    t->width = width;
+    t->height = height;
+    t->y_plane = y_plane;
+    t->u_plane = u_plane;
+    t->v_plane = v_plane;
+    t->y_stride = y_stride;
+    t->u_stride = u_stride;
+    t->v_stride = v_stride;
+    t->dst = dst;
+    t->dst_width = dst_width;
+    t->dst_height = dst_height;
+    t->dst_stride = dst_stride;
+    t->scaled = scaled;
+    t->filter = filter;
+    t->band_rows = ((dst_height + bands - 1) / bands + 1) & ~1;
+    t->num_bands = (dst_height + t->band_rows - 1) / t->band_rows;
+    t->next_band = 0;
+    t->bands_done = 0;
+}
+
+void yuv420_to_rgb_threaded(yuv2rgb_threads_t *t, yuv2rgb_format_t format, int width, int height,
+                            const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                            int y_stride, int u_stride, int v_stride,
+                            uint8_t *dst, int dst_stride)
+{
+    int bands = count_bands(t, width, height);
+    if (bands < 2) {
+        yuv420_to_rgb(format, width, height, y_plane, u_plane, v_plane,
+                      y_stride, u_stride, v_stride, dst, dst_stride);
+        return;
+    }
+    set_picture(t, bands, 0, YUV2RGB_NEAREST, format, width, height, y_plane, u_plane, v_plane,
+                y_stride, u_stride, v_stride, dst, width, height, dst_stride);
+    run_bands(t);
+}
+
+int yuv420_to_rgb_scaled_threaded(yuv2rgb_threads_t *t, yuv2rgb_format_t format, yuv2rgb_filter_t filter,
+                                  int width, int height,
+                                  const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                                  int y_stride, int u_stride, int v_stride,
+                                  uint8_t *dst, int dst_width, int dst_height, int dst_stride)
+{
+    int bands = count_bands(t, dst_width, dst_height);
+    if (bands < 2)
+        return yuv420_to_rgb_scaled(format, filter, width, height, y_plane, u_plane, v_plane,
+                                    y_stride, u_stride, v_stride, dst, dst_width, dst_height, dst_stride);
+    set_picture(t, bands, 1, filter, format, width, height, y_plane, u_plane, v_plane,
+                y_stride, u_stride, v_stride, dst, dst_width, dst_height, dst_stride);
+    run_bands(t);
+    return 0;
+}
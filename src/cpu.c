@@ -0,0 +1,94 @@
+// CPU feature detection, see include/cpu.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#endif
+
+#include "../include/cpu.h"
+
+static const struct {
+    unsigned feature;
+    const char *name;
+} feature_names[] = {
+    { CPU_SSE2, "sse2" }, { CPU_SSSE3, "ssse3" }, { CPU_SSE41, "sse4.1" }, { CPU_AVX2, "avx2" },
+    { CPU_AES, "aes" }, { CPU_NEON, "neon" },
+};
+
+#define FEATURE_COUNT (sizeof(feature_names) / sizeof(feature_names[0]))
+
+static unsigned features;
+static pthread_once_t features_once = PTHREAD_ONCE_INIT;
+
+static unsigned detect(void) {
+    unsigned found = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+    if (edx & bit_SSE2) found |= CPU_SSE2;
+    if (ecx & bit_SSSE3) found |= CPU_SSSE3;
+    if (ecx & bit_SSE4_1) found |= CPU_SSE41;
+    if (ecx & bit_AES) found |= CPU_AES;
+    // AVX needs the OS to save the YMM state on context switches too
+    int avx_state = 0;
+    if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+        unsigned lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        avx_state = (lo & 6) == 6;
+    }
+    if (avx_state && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2)) found |= CPU_AVX2;
+#elif defined(__aarch64__)
+    // Advanced SIMD is part of ARMv8-A; HWCAP_ASIMD says the kernel agrees
+#if defined(__linux__)
+    if (getauxval(AT_HWCAP) & (1UL << 1)) found |= CPU_NEON;
+    if (getauxval(AT_HWCAP) & (1UL << 3)) found |= CPU_AES;       // HWCAP_AES
+#else
+    found |= CPU_NEON;
+#endif
+#elif defined(__arm__) && defined(__linux__)
+    if (getauxval(AT_HWCAP) & (1UL << 12)) found |= CPU_NEON;     // HWCAP_NEON
+#endif
+    return found;
+}
+
+static unsigned parse_disabled(const char *list) {
+    unsigned disabled = 0;
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        if (len == 3 && strncmp(list, "all", 3) == 0) disabled = ~0u;
+        for (size_t i = 0; i < FEATURE_COUNT; i++)
+            if (strlen(feature_names[i].name) == len && strncmp(list, feature_names[i].name, len) == 0)
+                disabled |= feature_names[i].feature;
+        list += len;
+        if (*list == ',') list++;
+    }
+    return disabled;
+}
+
+static void features_init(void) {
+    features = detect();
+    const char *disable = getenv("ANHELO_CPU_DISABLE");
+    if (disable) features &= ~parse_disabled(disable);
+}
+
+unsigned cpu_features(void) {
+    pthread_once(&features_once, features_init);
+    return features;
+}
+
+void cpu_feature_names(unsigned set, char *buf, size_t size) {
+    size_t used = 0;
+    if (size) buf[0] = '\0';
+    for (size_t i = 0; i < FEATURE_COUNT; i++) {
+        if (!(set & feature_names[i].feature)) continue;
+        int n = snprintf(buf + used, size - used, "%s%s", used ? " " : "", feature_names[i].name);
+        if (n < 0 || (size_t)n >= size - used) break;
+        used += (size_t)n;
+    }
+    if (!used) snprintf(buf, size, "none");
+}
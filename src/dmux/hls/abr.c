@@ -0,0 +1,158 @@
+#include "hls_internal.h"
+#include "../../../include/big_alloc.h"
+#include <string.h>
+
+// Adaptive bitrate controller. The fetcher feeds it per-segment download
+// throughput, the consumer feeds it decoder speed, and the fetcher asks it
+// which rendition to load at each segment boundary.
+
+#define ABR_BW_SAFETY      0.8   // Use at most this share of the estimated bandwidth
+#define ABR_DECODE_SAFETY  0.85  // ... and of the measured decoder pixel rate
+#define ABR_FAST_ALPHA     0.5   // EWMA weights: fast reacts to drops,
+#define ABR_SLOW_ALPHA     0.15  // slow keeps brief spikes from switching up
+#define ABR_UP_HOLD        3     // Segments to stay put before switching up
+#define ABR_DEFAULT_FPS    30.0
+
+void hls_abr_init(hls_abr_t *abr) {
+    memset(abr, 0, sizeof(*abr));
+    pthread_mutex_init(&abr->lock, NULL);
+}
+
+static void abr_clear(hls_abr_t *abr) {
+    hls_playlist_destroy(abr->master);
+    abr->master = NULL;
+    free(abr->renditions);
+    abr->renditions = NULL;
+    abr->count = 0;
+}
+
+void hls_abr_destroy(hls_abr_t *abr) {
+    abr_clear(abr);
+    pthread_mutex_destroy(&abr->lock);
+}
+
+// Keep the parsed master playlist and pick out the video renditions
+// (variants[] is already sorted and limited to playable codecs). Entries
+// without RESOLUTION are taken as audio-only when others have one.
+hls_error_t hls_abr_load_master(hls_abr_t *abr, const char *data, size_t len, const char *master_url) {
+    hls_playlist_t *master = hls_playlist_create();
+    if (!master) return HLS_ERROR_MEMORY;
+    hls_error_t err = hls_parse_playlist_from_memory(NULL, data, len, master_url, master);
+    if (err == HLS_OK && master->variant_count == 0) err = HLS_ERROR_PARSE;
+
+    const hls_variant_t **renditions = NULL;
+    size_t count = 0;
+    if (err == HLS_OK) {
+        renditions = malloc(master->variant_count * sizeof(*renditions));
+        if (!renditions) err = HLS_ERROR_MEMORY;
+    }
+    if (err == HLS_OK) {
+        int any_resolution = 0;
+        for (size_t i = 0; i < master->variant_count; i++) {
+            if (master->variants[i].height > 0) any_resolution = 1;
+        }
+        for (size_t i = 0; i < master->variant_count; i++) {
+            if (!any_resolution || master->variants[i].height > 0) renditions[count++] = &master->variants[i];
+        }
+    }
+    if (err != HLS_OK) {
+        free(renditions);
+        hls_playlist_destroy(master);
+        return err;
+    }
+
+    pthread_mutex_lock(&abr->lock);
+    abr_clear(abr);
+    abr->master = master;
+    abr->renditions = renditions;
+    abr->count = count;
+    // Start on the lightest rendition and climb once measurements allow
+    abr->current = 0;
+    abr->playing = 0;
+    abr->segments_since_switch = 0;
+    pthread_mutex_unlock(&abr->lock);
+    return HLS_OK;
+}
+
+// Absolute playlist URL of a rendition (caller frees)
+char *hls_abr_url(const hls_abr_t *abr, size_t rendition) {
+    return hls_resolve_url(abr->master->base_url, abr->renditions[rendition]->url);
+}
+
+// Fetcher: one whole-segment download of `bytes` took `seconds`
+void hls_abr_add_throughput(hls_abr_t *abr, double bytes, double seconds) {
+    if (seconds <= 0.0 || bytes <= 0.0) return;
+    double bps = bytes * 8.0 / seconds;
+    pthread_mutex_lock(&abr->lock);
+    if (abr->bw_samples == 0) {
+        abr->bw_fast = abr->bw_slow = bps;
+    } else {
+        abr->bw_fast += ABR_FAST_ALPHA * (bps - abr->bw_fast);
+        abr->bw_slow += ABR_SLOW_ALPHA * (bps - abr->bw_slow);
+    }
+    abr->bw_samples++;
+    abr->segments_since_switch++;
+    pthread_mutex_unlock(&abr->lock);
+}
+
+// Consumer: the rendition whose segment is about to be decoded
+void hls_abr_set_playing(hls_abr_t *abr, int rendition) {
+    pthread_mutex_lock(&abr->lock);
+    abr->playing = rendition;
+    pthread_mutex_unlock(&abr->lock);
+}
+
+// Consumer: `frames` were decoded in `busy_seconds` of non-idle decoder time.
+// Stored as a pixel rate so it transfers to renditions of other sizes.
+void hls_abr_add_decode(hls_abr_t *abr, unsigned frames, double busy_seconds) {
+    if (frames == 0 || busy_seconds <= 0.0) return;
+    pthread_mutex_lock(&abr->lock);
+    if (abr->playing >= 0 && (size_t)abr->playing < abr->count) {
+        const hls_variant_t *r = abr->renditions[abr->playing];
+        double pixels = (double)r->width * (double)r->height;
+        if (pixels > 0.0) {
+            double rate = (double)frames / busy_seconds * pixels;
+            abr->decode_rate = abr->decode_rate > 0.0
+                ? abr->decode_rate + ABR_FAST_ALPHA * (rate - abr->decode_rate)
+                : rate;
+        }
+    }
+    pthread_mutex_unlock(&abr->lock);
+}
+
+static int decoder_can_handle(const hls_abr_t *abr, const hls_variant_t *r) {
+    if (abr->decode_rate <= 0.0 || r->height <= 0) return 1;
+    double fps = r->frame_rate > 0.0 ? r->frame_rate : ABR_DEFAULT_FPS;
+    return (double)r->width * (double)r->height * fps <= abr->decode_rate * ABR_DECODE_SAFETY;
+}
+
+// Fetcher, at a segment boundary: pick the rendition for the next segment.
+// Drops happen immediately, climbs only after ABR_UP_HOLD steady segments.
+// Under memory pressure (big_alloc.h) there are no climbs, and at the last
+// level one step down every ABR_UP_HOLD segments until it eases.
+size_t hls_abr_select(hls_abr_t *abr) {
+    big_pressure_t pressure = big_alloc_pressure();
+    pthread_mutex_lock(&abr->lock);
+    size_t choice = abr->current;
+    if (pressure >= BIG_PRESSURE_RENDITION && abr->current > 0 &&
+        abr->segments_since_switch >= ABR_UP_HOLD) {
+        choice = abr->current - 1;
+    } else if (abr->count > 1 && abr->bw_samples > 0) {
+        double budget = (abr->bw_fast < abr->bw_slow ? abr->bw_fast : abr->bw_slow) * ABR_BW_SAFETY;
+        size_t best = 0;
+        for (size_t i = 0; i < abr->count; i++) {
+            const hls_variant_t *r = abr->renditions[i];
+            if ((double)r->bandwidth <= budget && decoder_can_handle(abr, r)) best = i;
+        }
+        if (best < abr->current || (best > abr->current && abr->segments_since_switch >= ABR_UP_HOLD &&
+                                    pressure == BIG_PRESSURE_NONE)) {
+            choice = best;
+        }
+    }
+    if (choice != abr->current) {
+        abr->current = choice;
+        abr->segments_since_switch = 0;
+    }
+    pthread_mutex_unlock(&abr->lock);
+    return choice;
+}
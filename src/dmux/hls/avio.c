@@ -0,0 +1,136 @@
+// HLS fed to libavformat through a custom AVIOContext, see
+// include/hls_avio.h (builds with FFmpeg only)
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+
+#include "../../../include/hls_avio.h"
+#include "../../../include/spsc_ring.h"
+
+typedef struct {
+    uint8_t *data;
+    size_t size, capacity;
+    size_t read;            // Consumer: bytes of it already read
+} avio_chunk_t;
+
+struct hls_avio {
+    hls_demuxer_t *demuxer;
+    char *url;
+    pthread_t thread;
+    spsc_ring_t ring;
+    avio_chunk_t chunks[HLS_AVIO_CHUNKS];
+    AVIOContext *context;
+    atomic_int closing;
+    _Atomic hls_error_t error;
+};
+
+// Fetcher side: copy every chunk into a slot, waiting for a free one
+static int chunk_callback(const unsigned char *data, size_t size, unsigned flags, void *user_data) {
+    hls_avio_t *a = user_data;
+    (void)flags;
+    if (size == 0) return atomic_load(&a->closing);
+    int index = spsc_ring_reserve(&a->ring, NULL);
+    if (index < 0) return 1;
+    avio_chunk_t *chunk = &a->chunks[index];
+    if (size > chunk->capacity) {
+        uint8_t *grown = realloc(chunk->data, size);
+        if (!grown) {
+            spsc_ring_cancel(&a->ring);
+            return 1;
+        }
+        chunk->data = grown;
+        chunk->capacity = size;
+    }
+    memcpy(chunk->data, data, size);
+    chunk->size = size;
+    chunk->read = 0;
+    spsc_ring_publish(&a->ring);
+    return 0;
+}
+
+static void *fetch_thread(void *arg) {
+    hls_avio_t *a = arg;
+    hls_error_t err = hls_process_stream_chunked(a->demuxer, a->url, chunk_callback, a);
+    atomic_store(&a->error, err);
+    spsc_ring_finish(&a->ring);
+    return NULL;
+}
+
+// libavformat side: as much of the oldest chunks as fits
+static int read_packet(void *opaque, uint8_t *buf, int buf_size) {
+    hls_avio_t *a = opaque;
+    int done = 0;
+    while (done < buf_size) {
+        if (atomic_load(&a->closing)) return AVERROR_EXIT;
+        // Wait for data only while nothing was read yet
+        int index = spsc_ring_peek(&a->ring, done ? 0 : HLS_AVIO_POLL_MS);
+        if (index < 0) {
+            if (done) break;
+            if (spsc_ring_finished(&a->ring)) return AVERROR_EOF;
+            continue;
+        }
+        avio_chunk_t *chunk = &a->chunks[index];
+        size_t n = chunk->size - chunk->read;
+        if (n > (size_t)(buf_size - done)) n = (size_t)(buf_size - done);
+        memcpy(buf + done, chunk->data + chunk->read, n);
+        chunk->read += n;
+        done += (int)n;
+        if (chunk->read == chunk->size) spsc_ring_pop(&a->ring);
+    }
+    return done;
+}
+
+hls_avio_t *hls_avio_open(hls_demuxer_t *demuxer, const char *url) {
+    hls_avio_t *a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->demuxer = demuxer;
+    a->url = strdup(url);
+    uint8_t *buffer = av_malloc(HLS_AVIO_BUFFER);
+    if (buffer) a->context = avio_alloc_context(buffer, HLS_AVIO_BUFFER, 0, a, read_packet, NULL, NULL);
+    if (!a->url || !a->context) {
+        if (!a->context) av_free(buffer);
+        avio_context_free(&a->context);
+        free(a->url);
+        free(a);
+        return NULL;
+    }
+    a->context->seekable = 0;
+    atomic_init(&a->error, HLS_OK);
+    spsc_ring_init(&a->ring, HLS_AVIO_CHUNKS);
+    if (pthread_create(&a->thread, NULL, fetch_thread, a) != 0) {
+        spsc_ring_destroy(&a->ring);
+        av_freep(&a->context->buffer);
+        avio_context_free(&a->context);
+        free(a->url);
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+AVIOContext *hls_avio_context(hls_avio_t *avio) {
+    return avio->context;
+}
+
+hls_error_t hls_avio_error(hls_avio_t *avio) {
+    return atomic_load(&avio->error);
+}
+
+void hls_avio_close(hls_avio_t *avio) {
+    if (!avio) return;
+    // The fetcher stops at its next chunk or pause tick
+    atomic_store(&avio->closing, 1);
+    spsc_ring_close(&avio->ring);
+    pthread_join(avio->thread, NULL);
+    spsc_ring_destroy(&avio->ring);
+    for (int i = 0; i < HLS_AVIO_CHUNKS; i++) free(avio->chunks[i].data);
+    // libavformat may have replaced the buffer it was given
+    av_freep(&avio->context->buffer);
+    avio_context_free(&avio->context);
+    free(avio->url);
+    free(avio);
+}
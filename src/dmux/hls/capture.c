@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+#include "hls_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+// Capture and replay of the demuxer's transfers. A capture directory holds
+// one file per response body and an index of them, in the order they
+// completed:
+//
+//   # anhelo capture <wall clock of the first request, Unix seconds>
+//   <start us> <duration us> <status> <file|-> <url>
+//
+// times counted from the first request, status 0 for a failed transfer.
+// The index is written line by line, so a capture cut short by a crash
+// still replays up to its last complete response.
+//
+// Replay answers each URL from its recordings. In real time a request gets
+// the newest recording made by then (the first one before that) after the
+// transfer time it took, delivered in pieces over that time; at max speed a
+// URL's recordings are handed out in turn, each at once, and the last one
+// again after that. Either way the last recording of a media playlist is
+// served as ended, so replaying a live stream ends with its capture.
+
+#define HLS_CAPTURE_VERSION "# anhelo capture"
+#define HLS_REPLAY_CHUNK 16384      // Bytes per write while streaming a response
+#define HLS_REPLAY_PIECES 8         // A real-time response comes in this many writes at least
+
+typedef struct {
+    char *url;
+    char *file;                 // NULL without a body
+    uint64_t start_us;
+    uint64_t duration_us;
+    long code;
+    int served;                 // Max speed: handed out already
+    int final;                  // Last recording of its URL path
+} hls_recording_t;
+
+typedef struct {
+    char *dir;
+    int replay;
+    hls_replay_speed_t speed;
+    // Capture
+    FILE *index;
+    unsigned files;
+    uint64_t origin_us;         // CLOCK_MONOTONIC of the first request, 0 before it
+    // Replay
+    hls_recording_t *recs;
+    size_t count;
+    uint64_t replay_origin_us;
+    double time_shift;          // Seconds from the capture's wall clock to the replay's
+    double last_bytes, last_seconds;
+} hls_capture_t;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void capture_free(hls_capture_t *c) {
+    if (!c) return;
+    if (c->index) fclose(c->index);
+    for (size_t i = 0; i < c->count; i++) {
+        free(c->recs[i].url);
+        free(c->recs[i].file);
+    }
+    free(c->recs);
+    free(c->dir);
+    free(c);
+}
+
+void hls_capture_destroy(hls_demuxer_t *demuxer) {
+    capture_free((hls_capture_t *)demuxer->capture);
+    demuxer->capture = NULL;
+}
+
+hls_error_t hls_capture_start(hls_demuxer_t *demuxer, const char *dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return HLS_ERROR_IO;
+    hls_capture_t *c = calloc(1, sizeof(*c));
+    if (!c || !(c->dir = strdup(dir))) {
+        free(c);
+        return HLS_ERROR_MEMORY;
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    c->index = fopen(path, "w");
+    if (!c->index) {
+        capture_free(c);
+        return HLS_ERROR_IO;
+    }
+    hls_capture_destroy(demuxer);
+    demuxer->capture = c;
+    return HLS_OK;
+}
+
+// curl sink recording what the wrapped one accepts
+static size_t tee_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    hls_capture_tee_t *tee = (hls_capture_tee_t *)userp;
+    size_t taken = tee->write_fn(contents, size, nmemb, tee->userp);
+    if (tee->file && taken && fwrite(contents, 1, taken, tee->file) != taken) {
+        fclose(tee->file);
+        tee->file = NULL;
+        tee->failed = 1;
+    }
+    return taken;
+}
+
+hls_write_fn hls_capture_begin(hls_demuxer_t *demuxer, hls_capture_tee_t *tee, hls_write_fn write_fn, void *userp) {
+    hls_capture_t *c = (hls_capture_t *)demuxer->capture;
+    tee->write_fn = write_fn;
+    tee->userp = userp;
+    tee->failed = 0;
+    tee->start_us = now_us();
+    if (!c->origin_us) {
+        c->origin_us = tee->start_us;
+        fprintf(c->index, HLS_CAPTURE_VERSION " %.6f\n", wall_seconds());
+    }
+    tee->number = c->files++;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%06u", c->dir, tee->number);
+    tee->file = fopen(path, "wb");
+    if (!tee->file) tee->failed = 1;
+    return tee_callback;
+}
+
+void hls_capture_end(hls_demuxer_t *demuxer, hls_capture_tee_t *tee, const char *url, long code) {
+    hls_capture_t *c = (hls_capture_t *)demuxer->capture;
+    char file[16];
+    snprintf(file, sizeof(file), "%06u", tee->number);
+    if (tee->file && fclose(tee->file) != 0) tee->failed = 1;
+    tee->file = NULL;
+    int body = code == 200 || code == 206;
+    if (tee->failed || !body) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", c->dir, file);
+        remove(path);
+    }
+    if (tee->failed) {
+        fprintf(stderr, "HLS: capture of %s incomplete, not recorded\n", url);
+        return;
+    }
+    fprintf(c->index, "%llu %llu %ld %s %s\n",
+            (unsigned long long)(tee->start_us - c->origin_us),
+            (unsigned long long)(now_us() - tee->start_us),
+            code, body ? file : "-", url);
+    fflush(c->index);
+}
+
+// Length of the URL without its query, which blocking reloads vary
+static size_t url_path_len(const char *url) {
+    const char *q = strchr(url, '?');
+    return q ? (size_t)(q - url) : strlen(url);
+}
+
+static int load_index(hls_capture_t *c, FILE *f) {
+    char line[8192];
+    double wall = 0.0;
+    if (!fgets(line, sizeof(line), f) ||
+        sscanf(line, HLS_CAPTURE_VERSION " %lf", &wall) != 1) return -1;
+    c->time_shift = wall_seconds() - wall;
+
+    size_t capacity = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long start, duration;
+        long code;
+        char file[64];
+        int url_at = 0;
+        if (sscanf(line, "%llu %llu %ld %63s %n", &start, &duration, &code, file, &url_at) != 4 || !url_at) continue;
+        char *url = line + url_at;
+        url[strcspn(url, "\r\n")] = '\0';
+        if (!*url) continue;
+        if (c->count == capacity) {
+            size_t n = capacity ? capacity * 2 : 64;
+            hls_recording_t *recs = realloc(c->recs, n * sizeof(*recs));
+            if (!recs) return -1;
+            c->recs = recs;
+            capacity = n;
+        }
+        hls_recording_t *r = &c->recs[c->count];
+        memset(r, 0, sizeof(*r));
+        r->url = strdup(url);
+        r->file = strcmp(file, "-") != 0 ? strdup(file) : NULL;
+        if (!r->url || (strcmp(file, "-") != 0 && !r->file)) {
+            free(r->url);
+            free(r->file);
+            return -1;
+        }
+        r->start_us = start;
+        r->duration_us = duration;
+        r->code = code;
+        c->count++;
+    }
+
+    for (size_t i = 0; i < c->count; i++) {
+        hls_recording_t *r = &c->recs[i];
+        // A 304 stands for the body recorded before it
+        if (r->code == 304) {
+            for (size_t j = i; j-- > 0;) {
+                if (c->recs[j].file && strcmp(c->recs[j].url, r->url) == 0) {
+                    if (!(r->file = strdup(c->recs[j].file))) return -1;
+                    r->code = 200;
+                    break;
+                }
+            }
+        }
+        size_t len = url_path_len(r->url);
+        r->final = 1;
+        for (size_t j = i + 1; j < c->count && r->final; j++)
+            if (url_path_len(c->recs[j].url) == len && strncmp(c->recs[j].url, r->url, len) == 0) r->final = 0;
+    }
+    return c->count ? 0 : -1;
+}
+
+hls_error_t hls_replay_start(hls_demuxer_t *demuxer, const char *dir, hls_replay_speed_t speed) {
+    hls_capture_t *c = calloc(1, sizeof(*c));
+    if (!c || !(c->dir = strdup(dir))) {
+        free(c);
+        return HLS_ERROR_MEMORY;
+    }
+    c->replay = 1;
+    c->speed = speed;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/index", dir);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        capture_free(c);
+        return HLS_ERROR_IO;
+    }
+    int bad = load_index(c, f);
+    fclose(f);
+    if (bad) {
+        capture_free(c);
+        return HLS_ERROR_PARSE;
+    }
+    c->replay_origin_us = now_us();
+    hls_capture_destroy(demuxer);
+    demuxer->capture = c;
+    // Skipping ahead would depend on how fast this machine decodes
+    if (speed == HLS_REPLAY_MAX_SPEED) demuxer->catchup_segments = 0;
+    return HLS_OK;
+}
+
+const char *hls_replay_url(const hls_demuxer_t *demuxer) {
+    const hls_capture_t *c = (const hls_capture_t *)demuxer->capture;
+    return c && c->replay ? c->recs[0].url : NULL;
+}
+
+int hls_replaying(const hls_demuxer_t *demuxer) {
+    const hls_capture_t *c = (const hls_capture_t *)demuxer->capture;
+    return c && c->replay;
+}
+
+int hls_capturing(const hls_demuxer_t *demuxer) {
+    const hls_capture_t *c = (const hls_capture_t *)demuxer->capture;
+    return c && !c->replay;
+}
+
+int hls_replay_unpaced(const hls_demuxer_t *demuxer) {
+    const hls_capture_t *c = (const hls_capture_t *)demuxer->capture;
+    return c && c->replay && c->speed == HLS_REPLAY_MAX_SPEED;
+}
+
+double hls_replay_date_time(const hls_demuxer_t *demuxer, double program_date_time) {
+    const hls_capture_t *c = (const hls_capture_t *)demuxer->capture;
+    if (!c || !c->replay || program_date_time == 0.0) return program_date_time;
+    // At max speed the wall clock says nothing about latency
+    return c->speed == HLS_REPLAY_MAX_SPEED ? 0.0 : program_date_time + c->time_shift;
+}
+
+void hls_replay_last_transfer(const hls_demuxer_t *demuxer, double *bytes, double *seconds) {
+    const hls_capture_t *c = (const hls_capture_t *)demuxer->capture;
+    *bytes = c->last_bytes;
+    *seconds = c->last_seconds;
+}
+
+static const hls_recording_t *pick(hls_capture_t *c, const char *url, uint64_t elapsed) {
+    hls_recording_t *first = NULL, *latest = NULL;
+    for (size_t i = 0; i < c->count; i++) {
+        hls_recording_t *r = &c->recs[i];
+        if (strcmp(r->url, url) != 0) continue;
+        if (c->speed == HLS_REPLAY_MAX_SPEED) {
+            latest = r;
+            if (!r->served) break;
+            continue;
+        }
+        if (!first) first = r;
+        if (r->start_us <= elapsed) latest = r;
+    }
+    if (c->speed == HLS_REPLAY_MAX_SPEED && latest) latest->served = 1;
+    return latest ? latest : first;
+}
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char *data = NULL;
+    long len = -1;
+    if (fseek(f, 0, SEEK_END) == 0) len = ftell(f);
+    // Room for an appended end tag
+    if (len >= 0 && fseek(f, 0, SEEK_SET) == 0 && (data = malloc((size_t)len + 32))) {
+        if (fread(data, 1, (size_t)len, f) != (size_t)len) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    *size = data ? (size_t)len : 0;
+    return data;
+}
+
+// Sleep until CLOCK_MONOTONIC reaches `at`; non-zero once the fetch was stopped
+static int wait_until(hls_demuxer_t *demuxer, uint64_t at) {
+    hls_segment_queue_t *q = (hls_segment_queue_t *)demuxer->fetch_queue;
+    uint64_t now = now_us();
+    if (at <= now) return q && atomic_load(&q->stopped);
+    if (q) return hls_queue_wait_stopped(q, (long)(at - now));
+    struct timespec ts = { (time_t)((at - now) / 1000000), (long)((at - now) % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+    return 0;
+}
+
+hls_error_t hls_replay_perform(hls_demuxer_t *demuxer, const char *url, hls_write_fn write_fn, void *userp, long *code) {
+    hls_capture_t *c = (hls_capture_t *)demuxer->capture;
+    uint64_t begin = now_us();
+    *code = 0;
+    c->last_bytes = 0.0;
+    c->last_seconds = 0.0;
+    const hls_recording_t *r = pick(c, url, begin - c->replay_origin_us);
+    if (!r) {
+        fprintf(stderr, "HLS: %s not in the replay\n", url);
+        return HLS_ERROR_NETWORK;
+    }
+
+    int paced = c->speed == HLS_REPLAY_REALTIME;
+    uint64_t start = begin;
+    if (paced && c->replay_origin_us + r->start_us > start) start = c->replay_origin_us + r->start_us;
+    if (paced && wait_until(demuxer, start)) return HLS_ERROR_NETWORK;
+
+    size_t size = 0;
+    char *data = NULL;
+    if (r->file) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", c->dir, r->file);
+        if (!(data = read_file(path, &size))) {
+            fprintf(stderr, "HLS: cannot read %s of the replay\n", path);
+            return HLS_ERROR_IO;
+        }
+        if (r->final && memmem(data, size, "#EXTINF", 7) && !memmem(data, size, "#EXT-X-ENDLIST", 14)) {
+            static const char end_tag[] = "\n#EXT-X-ENDLIST\n";
+            memcpy(data + size, end_tag, sizeof(end_tag) - 1);
+            size += sizeof(end_tag) - 1;
+        }
+    }
+
+    // Delivered piece by piece over the recorded transfer time
+    size_t chunk = size / HLS_REPLAY_PIECES + 1;
+    if (!paced || chunk > HLS_REPLAY_CHUNK) chunk = HLS_REPLAY_CHUNK;
+    hls_error_t err = HLS_OK;
+    for (size_t off = 0; off < size && err == HLS_OK; off += chunk) {
+        size_t n = size - off < chunk ? size - off : chunk;
+        if (paced && wait_until(demuxer, start + r->duration_us * off / size)) err = HLS_ERROR_NETWORK;
+        else if (write_fn(data + off, 1, n, userp) != n) err = HLS_ERROR_NETWORK;
+    }
+    free(data);
+    if (err == HLS_OK && paced && wait_until(demuxer, start + r->duration_us)) err = HLS_ERROR_NETWORK;
+    if (err != HLS_OK) return err;
+
+    *code = r->code;
+    c->last_bytes = (double)size;
+    c->last_seconds = paced ? r->duration_us / 1e6 : (now_us() - begin) / 1e6;
+    return r->code == 0 || r->code >= 400 ? HLS_ERROR_NETWORK : HLS_OK;
+}
@@ -0,0 +1,137 @@
+#include "hls_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// AES-128 segments (#EXT-X-KEY METHOD=AES-128): CBC over the whole
+// segment with PKCS#7 padding, the key a 16-byte resource of its own and
+// the IV either listed or the segment's media sequence number. Decryption
+// runs on the bytes curl hands over, so the segment never sits encrypted
+// in memory and takes no second pass.
+
+#define HLS_DECRYPT_CHUNK 16384     // Bytes decrypted per forwarded write
+
+void hls_keys_clear(hls_key_cache_t *keys) {
+    free(keys->url);
+    keys->url = NULL;
+}
+
+// The key at url, downloaded unless it is the one held
+static hls_error_t key_fetch(hls_demuxer_t *demuxer, hls_key_cache_t *keys, const char *url) {
+    if (keys->url && strcmp(keys->url, url) == 0) return HLS_OK;
+    hls_keys_clear(keys);
+    struct hls_buffer buf = {0};
+    hls_error_t err = hls_download_url(demuxer, url, &buf);
+    if (err == HLS_OK && buf.size != AES_BLOCK) {
+        fprintf(stderr, "HLS: key %s is %zu bytes, not %d\n", url, buf.size, AES_BLOCK);
+        err = HLS_ERROR_PARSE;
+    }
+    if (err == HLS_OK) {
+        memcpy(keys->key, buf.data, AES_BLOCK);
+        if (!(keys->url = strdup(url))) err = HLS_ERROR_MEMORY;
+    }
+    free(buf.data);
+    return err;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The IV attribute (0x and up to 32 hex digits, right-aligned), or with
+// none msn as a big-endian 128-bit number
+static int parse_iv(const char *text, long msn, uint8_t iv[AES_BLOCK]) {
+    memset(iv, 0, AES_BLOCK);
+    if (!text) {
+        for (int i = 0; i < 8; i++) iv[AES_BLOCK - 1 - i] = (uint8_t)((unsigned long long)msn >> (8 * i));
+        return 0;
+    }
+    if (text[0] != '0' || (text[1] != 'x' && text[1] != 'X')) return -1;
+    text += 2;
+    size_t len = strlen(text);
+    if (len == 0 || len > 2 * AES_BLOCK) return -1;
+    for (size_t i = 0; i < len; i++) {
+        int v = hex_digit(text[len - 1 - i]);
+        if (v < 0) return -1;
+        iv[AES_BLOCK - 1 - i / 2] |= (uint8_t)(v << (4 * (i % 2)));
+    }
+    return 0;
+}
+
+// curl write callback: every whole block but the last is decrypted and
+// passed on; the last one may be the padding and waits for the end
+static size_t decrypt_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    hls_decrypt_t *d = (hls_decrypt_t *)userp;
+    size_t realsize = size * nmemb;
+    const uint8_t *data = (const uint8_t *)contents;
+    size_t total = d->held_size + realsize;
+    if (total <= AES_BLOCK) {
+        memcpy(d->held + d->held_size, data, realsize);
+        d->held_size = total;
+        return realsize;
+    }
+    size_t ready = total - (total % AES_BLOCK ? total % AES_BLOCK : AES_BLOCK);
+    uint8_t out[HLS_DECRYPT_CHUNK] __attribute__((aligned(16)));
+    while (ready > 0) {
+        size_t n = ready < sizeof(out) ? ready : sizeof(out);
+        // The held bytes go first; ready covers them as it is a whole block at least
+        size_t from_held = d->held_size;
+        memcpy(out, d->held, from_held);
+        memcpy(out + from_held, data, n - from_held);
+        data += n - from_held;
+        d->held_size = 0;
+        aes128_cbc_decrypt(&d->aes, d->iv, out, out, n / AES_BLOCK);
+        if (d->write_fn(out, 1, n, d->userp) != n) return 0;
+        ready -= n;
+    }
+    size_t rest = (size_t)((const uint8_t *)contents + realsize - data);
+    memcpy(d->held, data, rest);
+    d->held_size = rest;
+    return realsize;
+}
+
+// The held block, without its padding
+static hls_error_t decrypt_finish(hls_decrypt_t *d) {
+    if (d->held_size != AES_BLOCK) return HLS_ERROR_PARSE;
+    uint8_t out[AES_BLOCK] __attribute__((aligned(16)));
+    aes128_cbc_decrypt(&d->aes, d->iv, d->held, out, 1);
+    unsigned pad = out[AES_BLOCK - 1];
+    if (pad == 0 || pad > AES_BLOCK) return HLS_ERROR_PARSE;
+    for (unsigned i = 1; i < pad; i++)
+        if (out[AES_BLOCK - 1 - i] != pad) return HLS_ERROR_PARSE;
+    size_t n = AES_BLOCK - pad;
+    if (n && d->write_fn(out, 1, n, d->userp) != n) return HLS_ERROR_IO;
+    return HLS_OK;
+}
+
+hls_error_t hls_download_segment(hls_demuxer_t *demuxer, hls_key_cache_t *keys, const char *base_url,
+                                 const hls_segment_t *segment, long msn, const char *url,
+                                 hls_write_fn write_fn, void *userp) {
+    if (!segment->is_key_segment) return hls_download_to(demuxer, url, write_fn, userp);
+    if (!segment->key_url) {
+        if (!keys->warned) fprintf(stderr, "HLS: segments use an encryption method other than AES-128, skipping them\n");
+        keys->warned = 1;
+        return HLS_ERROR_PARSE;
+    }
+    char *key_url = hls_resolve_url(base_url, segment->key_url);
+    if (!key_url) return HLS_ERROR_MEMORY;
+    hls_error_t err = key_fetch(demuxer, keys, key_url);
+    free(key_url);
+    if (err != HLS_OK) return err;
+
+    hls_decrypt_t d;
+    d.write_fn = write_fn;
+    d.userp = userp;
+    d.held_size = 0;
+    if (parse_iv(segment->key_iv, msn, d.iv) != 0) {
+        fprintf(stderr, "HLS: bad IV %s\n", segment->key_iv);
+        return HLS_ERROR_PARSE;
+    }
+    aes128_init(&d.aes, keys->key);
+    err = hls_download_to(demuxer, url, decrypt_write_callback, &d);
+    if (err == HLS_OK) err = decrypt_finish(&d);
+    return err;
+}
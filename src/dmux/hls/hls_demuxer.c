@@ -1,24 +1,21 @@
-#include "../../../include/hls_demuxer.h"
-#include <curl/curl.h>
+#include "hls_internal.h"
+#include "../../../include/memory_pool.h"
+#include "../../../include/metrics.h"
+#include "../../../include/net.h"
+#include "../../../include/pipeline.h"
 #include <string.h>
 #include <ctype.h>
-#include <unistd.h> // for usleep
-
-// Internal buffer structure
-struct hls_buffer {
-    char *data;
-    size_t size;
-    size_t capacity;
-};
+#include <strings.h>
+#include <time.h>
 
 // Internal callback for curl
 static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
     struct hls_buffer *buf = (struct hls_buffer *)userp;
 
-    if (buf->size + realsize > buf->capacity) {
+    if (buf->size + realsize + 1 > buf->capacity) {
         size_t new_capacity = buf->capacity * 2;
-        if (new_capacity < buf->size + realsize) {
+        if (new_capacity < buf->size + realsize + 1) {
             new_capacity = buf->size + realsize + 1024;
         }
         char *new_data = realloc(buf->data, new_capacity);
@@ -34,31 +31,196 @@ static size_t write_callback(void *contents, size_t size, size_t nmemb, void *us
     return realsize;
 }
 
-// Download URL to buffer (internal function)
-static hls_error_t download_url(hls_demuxer_t *demuxer, const char *url, struct hls_buffer *buf) {
-    CURL *curl;
-    CURLcode res;
-    
-    curl = curl_easy_init();
+// Abort in-flight transfers once the active fetch queue has been stopped
+static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    (void)dltotal; (void)dlnow; (void)ultotal; (void)ulnow;
+    hls_demuxer_t *demuxer = (hls_demuxer_t *)clientp;
+    hls_segment_queue_t *q = (hls_segment_queue_t *)demuxer->fetch_queue;
+    return (q && atomic_load(&q->stopped)) ? 1 : 0;
+}
+
+// Return a copy of the value if the header line is "<name>: value"
+static char *header_value(const char *line, size_t len, const char *name) {
+    size_t name_len = strlen(name);
+    if (len <= name_len || strncasecmp(line, name, name_len) != 0 || line[name_len] != ':') return NULL;
+    const char *s = line + name_len + 1;
+    const char *e = line + len;
+    while (s < e && (*s == ' ' || *s == '\t')) s++;
+    while (e > s && isspace((unsigned char)e[-1])) e--;
+    return e > s ? strndup(s, (size_t)(e - s)) : NULL;
+}
+
+// Collect ETag/Last-Modified of the final response (redirect hops reset them)
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    size_t len = size * nitems;
+    hls_validators_t *v = (hls_validators_t *)userdata;
+    char *value;
+
+    if (len >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        hls_validators_clear(v);
+    } else if ((value = header_value(buffer, len, "ETag")) != NULL) {
+        free(v->etag);
+        v->etag = value;
+    } else if ((value = header_value(buffer, len, "Last-Modified")) != NULL) {
+        free(v->last_modified);
+        v->last_modified = value;
+    }
+    return len;
+}
+
+// A new easy handle set up like the persistent one: options set here
+// survive across transfers, so each download only has to swap the URL and
+// the sink buffer
+void *hls_easy_handle(hls_demuxer_t *demuxer) {
+    // The process-wide share hands over DNS answers, TLS sessions and open
+    // connections, including those the resolver just used for usher, so
+    // playlist reloads and segment fetches ride warm connections
+    CURL *curl = demuxer->unpooled ? net_easy_handle_unpooled() : net_easy_handle();
+    if (!curl) return NULL;
+
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, demuxer);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    // Error bodies must not land in a segment being assembled from parts
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+#ifdef MINIMAL_MEMORY_BUFFERS
+    curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, 16384L); // Smaller receive buffer
+#else
+    // HTTP/2 where the CDN edge offers it (falls back to HTTP/1.1 keep-alive)
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+    return curl;
+}
+
+// Lazily set up the persistent easy handle
+static CURL *demuxer_connection(hls_demuxer_t *demuxer) {
+    if (!demuxer->curl_handle) demuxer->curl_handle = hls_easy_handle(demuxer);
+    return (CURL *)demuxer->curl_handle;
+}
+
+// Run one transfer on the persistent handle. Per-request options are reset
+// afterwards so they do not leak into the next fetch.
+static hls_error_t perform(hls_demuxer_t *demuxer, const char *url, hls_write_fn write_fn, void *userp,
+                           struct curl_slist *headers, hls_validators_t *seen, long *code) {
+    if (hls_replaying(demuxer)) return hls_replay_perform(demuxer, url, write_fn, userp, code);
+    CURL *curl = demuxer_connection(demuxer);
     if (!curl) return HLS_ERROR_MEMORY;
-    
+
+    hls_capture_tee_t tee;
+    int capturing = hls_capturing(demuxer);
+    if (capturing) {
+        write_fn = hls_capture_begin(demuxer, &tee, write_fn, userp);
+        userp = &tee;
+    }
+
     curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, buf);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_fn);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, userp);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, demuxer->user_agent);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, demuxer->timeout_ms);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    
-    res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
+    if (headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    if (seen) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, seen);
+    }
+
+    CURLcode res = curl_easy_perform(curl);
+    *code = 0;
+    if (res == CURLE_OK) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, code);
+    if (capturing) hls_capture_end(demuxer, &tee, url, *code);
+
+    if (headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+    if (seen) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+    }
+
+    if (res != CURLE_OK || *code >= 400) {
         return HLS_ERROR_NETWORK;
     }
-    
+
     return HLS_OK;
 }
 
+// Download URL over the demuxer's persistent connection into a custom sink
+hls_error_t hls_download_to(hls_demuxer_t *demuxer, const char *url, hls_write_fn write_fn, void *userp) {
+    long code;
+    return perform(demuxer, url, write_fn, userp, NULL, NULL, &code);
+}
+
+// Download URL to buffer over the demuxer's persistent connection
+hls_error_t hls_download_url(hls_demuxer_t *demuxer, const char *url, struct hls_buffer *buf) {
+    return hls_download_to(demuxer, url, write_callback, buf);
+}
+
+// Size and duration of the last transfer on the persistent handle
+static void last_transfer_stats(hls_demuxer_t *demuxer, double *bytes, double *seconds) {
+    if (hls_replaying(demuxer)) {
+        hls_replay_last_transfer(demuxer, bytes, seconds);
+        return;
+    }
+    curl_off_t size = 0, usec = 0;
+    curl_easy_getinfo((CURL *)demuxer->curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+    curl_easy_getinfo((CURL *)demuxer->curl_handle, CURLINFO_TOTAL_TIME_T, &usec);
+    *bytes = (double)size;
+    *seconds = (double)usec / 1000000.0;
+}
+
+void hls_validators_clear(hls_validators_t *v) {
+    free(v->etag);
+    free(v->last_modified);
+    v->etag = NULL;
+    v->last_modified = NULL;
+}
+
+// Conditional GET for playlist reloads. On a 304 *not_modified is set and
+// buf is left as it was; on a 200 the validators are replaced by the ones the
+// server sent with the new body.
+hls_error_t hls_download_conditional(hls_demuxer_t *demuxer, const char *url, struct hls_buffer *buf,
+                                     hls_validators_t *v, int *not_modified) {
+    struct curl_slist *headers = NULL;
+    char line[512];
+    if (v->etag) {
+        snprintf(line, sizeof(line), "If-None-Match: %s", v->etag);
+        headers = curl_slist_append(headers, line);
+    }
+    if (v->last_modified) {
+        snprintf(line, sizeof(line), "If-Modified-Since: %s", v->last_modified);
+        headers = curl_slist_append(headers, line);
+    }
+
+    hls_validators_t seen = {0};
+    long code;
+    size_t old_size = buf->size;
+    hls_error_t err = perform(demuxer, url, write_callback, buf, headers, &seen, &code);
+    curl_slist_free_all(headers);
+
+    *not_modified = 0;
+    if (err == HLS_OK && code == 304) {
+        *not_modified = 1;
+        buf->size = old_size;
+        hls_validators_clear(&seen);
+    } else if (err == HLS_OK) {
+        hls_validators_clear(v);
+        *v = seen;
+    } else {
+        hls_validators_clear(&seen);
+    }
+    return err;
+}
+
+// curl sink that streams into a prefetch queue slot
+static size_t slot_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    size_t realsize = size * nmemb;
+    if (hls_queue_append((hls_queue_slot_t *)userp, contents, realsize) != 0) return 0;
+    return realsize;
+}
+
 // Create demuxer
 hls_demuxer_t* hls_demuxer_create(void) {
     hls_demuxer_t *demuxer = calloc(1, sizeof(hls_demuxer_t));
@@ -66,12 +228,27 @@ hls_demuxer_t* hls_demuxer_create(void) {
     
     demuxer->user_agent = strdup("HLS-Demuxer/1.0");
     demuxer->timeout_ms = 10000;
+    // The HLS spec asks players not to start closer than three target
+    // durations from the end of a live playlist
+    demuxer->live_start_segments = 3;
+    demuxer->catchup_segments = 8;
+#ifdef MINIMAL_MEMORY_BUFFERS
+    demuxer->prefetch_depth = 2;
+    demuxer->prefetch_max_bytes = 4 * 1024 * 1024;
+    demuxer->timeshift_bytes = 32 * 1024 * 1024;
+#else
+    demuxer->prefetch_depth = 3;
+    demuxer->prefetch_max_bytes = 16 * 1024 * 1024;
+    demuxer->timeshift_bytes = 128 * 1024 * 1024;
+#endif
     return demuxer;
 }
 
 // Destroy demuxer
 void hls_demuxer_destroy(hls_demuxer_t *demuxer) {
     if (demuxer) {
+        if (demuxer->curl_handle) curl_easy_cleanup((CURL *)demuxer->curl_handle);
+        hls_capture_destroy(demuxer);
         free(demuxer->user_agent);
         free(demuxer);
     }
@@ -82,9 +259,12 @@ hls_playlist_t* hls_playlist_create(void) {
     hls_playlist_t *playlist = calloc(1, sizeof(hls_playlist_t));
     if (!playlist) return NULL;
     
+    playlist->arena = pool_create(POOL_BLOCK_SIZE);
     playlist->segment_capacity = 16;
     playlist->segments = calloc(playlist->segment_capacity, sizeof(hls_segment_t));
-    if (!playlist->segments) {
+    if (!playlist->arena || !playlist->segments) {
+        pool_destroy(playlist->arena);
+        free(playlist->segments);
         free(playlist);
         return NULL;
     }
@@ -92,146 +272,886 @@ hls_playlist_t* hls_playlist_create(void) {
     return playlist;
 }
 
+// Drop all entries but keep the arena blocks and array capacity for reuse
+void hls_playlist_reset(hls_playlist_t *playlist) {
+    if (!playlist) return;
+
+    pool_reset(playlist->arena);
+    playlist->type = HLS_PLAYLIST_UNKNOWN;
+    playlist->base_url = NULL;
+    playlist->segment_count = 0;
+    playlist->prefetch_count = 0;
+    playlist->variant_count = 0;
+    playlist->target_duration = 0.0;
+    playlist->ended = false;
+    playlist->media_sequence = 0;
+    playlist->part_target = 0.0;
+    playlist->can_block_reload = false;
+    playlist->part_hold_back = 0.0;
+    playlist->can_skip_until = 0.0;
+    playlist->part_count = 0;
+    playlist->preload_hint_url = NULL;
+    playlist->map_url = NULL;
+    playlist->encrypted = false;
+    playlist->key_url = NULL;
+    playlist->key_iv = NULL;
+}
+
 // Destroy playlist
 void hls_playlist_destroy(hls_playlist_t *playlist) {
     if (!playlist) return;
     
-    for (size_t i = 0; i < playlist->segment_count; i++) {
-        free(playlist->segments[i].url);
-        free(playlist->segments[i].key_url);
-        free(playlist->segments[i].key_iv);
-    }
     free(playlist->segments);
-    free(playlist->base_url);
-    if (playlist->variants) {
-        for (size_t i = 0; i < playlist->variant_count; i++) {
-            free(playlist->variants[i]);
-        }
-        free(playlist->variants);
-    }
+    free(playlist->parts);
+    free(playlist->variants);
+    pool_destroy(playlist->arena);
     free(playlist);
 }
 
-// Get base URL from full URL
-char* hls_resolve_url(const char *base_url, const char *relative_url) {
+// relative_url against base_url's directory, in pool (malloc'd if NULL)
+static char *resolve_url(memory_pool_t *pool, const char *base_url, const char *relative_url) {
     if (!base_url || !relative_url) return NULL;
-    
+
     // If relative_url is already absolute
-    if (strncmp(relative_url, "http://", 7) == 0 || strncmp(relative_url, "https://", 8) == 0) {
-        return strdup(relative_url);
+    size_t dir_len = 0;
+    if (strncmp(relative_url, "http://", 7) != 0 && strncmp(relative_url, "https://", 8) != 0) {
+        // Simple path resolution (basic implementation)
+        const char *last_slash = strrchr(base_url, '/');
+        dir_len = last_slash ? (size_t)(last_slash - base_url) + 1 : strlen(base_url);
     }
-    
-    // Simple path resolution (basic implementation)
-    size_t base_len = strlen(base_url);
     size_t rel_len = strlen(relative_url);
-    char *result = malloc(base_len + rel_len + 2);
+    char *result = pool ? pool_alloc_aligned(pool, dir_len + rel_len + 1, 1) : malloc(dir_len + rel_len + 1);
     if (!result) return NULL;
-    
-    strcpy(result, base_url);
-    char *last_slash = strrchr(result, '/');
-    if (last_slash) {
-        last_slash[1] = '\0';
-    }
-    strcat(result, relative_url);
-    
+
+    memcpy(result, base_url, dir_len);
+    memcpy(result + dir_len, relative_url, rel_len + 1);
     return result;
 }
 
-// Process entire stream
-// Process HLS stream continuously until callback signals quit or error
-hls_error_t hls_process_stream(hls_demuxer_t *demuxer, const char *playlist_url, hls_segment_callback_t callback, void *user_data) {
-    if (!demuxer || !playlist_url || !callback) {
-        return HLS_ERROR_PARSE;
+// Get base URL from full URL
+char* hls_resolve_url(const char *base_url, const char *relative_url) {
+    return resolve_url(NULL, base_url, relative_url);
+}
+
+// Background fetcher state for one hls_process_stream() call
+typedef struct {
+    hls_demuxer_t *demuxer;
+    const char *playlist_url;
+    hls_segment_queue_t queue;
+    hls_abr_t abr;              // Used when playlist_url is a master playlist
+    hls_error_t error;          // First fatal fetch error (reported after drain)
+    char *init_url;             // #EXT-X-MAP section held in init
+    struct hls_buffer init;
+    hls_key_cache_t keys;       // AES-128 key of the segments
+    hls_ranged_t ranged;        // Connections of ranged segment downloads
+    double connection_bps;      // Fastest single connection of the last segment (0 = unknown)
+    double stream_bps;          // Bitrate of the last segment
+    memory_pool_t *scratch;     // Fetcher thread's arena: URLs of one fetch
+} hls_fetcher_t;
+
+#define HLS_DEFAULT_RELOAD_US 500000   // Playlist without #EXT-X-TARGETDURATION
+#define HLS_MIN_RELOAD_US     100000
+#define HLS_IDLE_TICK_US      50000    // Callback tick interval while paused
+
+// Reload delay per the HLS rules: one target duration after a reload that
+// brought new segments, half of it after one that did not
+static long reload_interval_us(double target_duration, int changed) {
+    long us = target_duration > 0 ? (long)(target_duration * 1000000.0) : HLS_DEFAULT_RELOAD_US;
+    if (!changed) us /= 2;
+    return us < HLS_MIN_RELOAD_US ? HLS_MIN_RELOAD_US : us;
+}
+
+static uint64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static long elapsed_us(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000L + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+// Put a segment's fMP4 init section in front of its media data, so each
+// queued (and timeshift-recorded) segment is self-contained. The section
+// is only downloaded again when the URI changes.
+static hls_error_t slot_add_init(hls_fetcher_t *f, hls_queue_slot_t *slot, const char *base_url, const char *map_url) {
+    if (!map_url) return HLS_OK;
+    pool_mark_t mark = pool_mark(f->scratch);
+    char *url = resolve_url(f->scratch, base_url, map_url);
+    if (!url) return HLS_ERROR_MEMORY;
+    if (!f->init_url || strcmp(url, f->init_url) != 0) {
+        free(f->init_url);
+        f->init_url = NULL;
+        f->init.size = 0;
+        hls_error_t err = hls_download_url(f->demuxer, url, &f->init);
+        if (err == HLS_OK && !(f->init_url = strdup(url))) err = HLS_ERROR_MEMORY;
+        pool_rewind(f->scratch, mark);
+        if (err != HLS_OK) return err;
+    } else {
+        pool_rewind(f->scratch, mark);
     }
-    demuxer->segment_callback = callback;
-    demuxer->callback_user_data = user_data;
+    return hls_queue_append(slot, f->init.data, f->init.size) == 0 ? HLS_OK : HLS_ERROR_MEMORY;
+}
+
+// Low-latency fetch position carried across playlist reloads. A segment is
+// assembled part by part into one queue slot, so consumers see the same
+// segment boundaries as with whole-segment fetches.
+typedef struct {
+    long next_msn;              // Segment being assembled (-1 before the first playlist)
+    int next_part;              // Next part index wanted within next_msn
+    hls_queue_slot_t *slot;     // Slot receiving next_msn, NULL until its first byte
+} hls_ll_state_t;
+
+static void ll_finish_segment(hls_ll_state_t *ll, int ok) {
+    if (ll->slot) hls_queue_end(ll->slot, ok);
+    ll->slot = NULL;
+    ll->next_msn++;
+    ll->next_part = 0;
+}
 
-    size_t last_count = 0;
-    char *last_processed_url = NULL; // track the URL of the last segment we processed
-    while (1) {
-        // Download playlist
-        struct hls_buffer buf = {0};
-        buf.capacity = 4096;
-        buf.data = malloc(buf.capacity);
-        if (!buf.data) return HLS_ERROR_MEMORY;
-        hls_error_t err = download_url(demuxer, playlist_url, &buf);
+// Append one part (or a whole segment) of ll->next_msn to its slot. A transfer
+// that fails after delivering bytes truncates the segment.
+static hls_error_t ll_fetch(hls_fetcher_t *f, hls_ll_state_t *ll, const char *base_url, const char *map_url,
+                            const char *url, double duration) {
+    pool_mark_t mark = pool_mark(f->scratch);
+    char *full_url = resolve_url(f->scratch, base_url, url);
+    if (!full_url) return HLS_ERROR_MEMORY;
+    if (!ll->slot) {
+        ll->slot = hls_queue_begin(&f->queue, -1, ll->next_msn);
+        if (!ll->slot) { pool_rewind(f->scratch, mark); return HLS_ERROR_IO; }
+        hls_error_t err = slot_add_init(f, ll->slot, base_url, map_url);
         if (err != HLS_OK) {
-            free(buf.data);
+            pool_rewind(f->scratch, mark);
+            ll_finish_segment(ll, 0);
             return err;
         }
+    }
+    size_t before = ll->slot->buf.size;
+    hls_error_t err = hls_download_to(f->demuxer, full_url, slot_write_callback, ll->slot);
+    pool_rewind(f->scratch, mark);
+    if (err == HLS_OK) ll->slot->duration += duration;
+    else if (ll->slot->buf.size != before) ll_finish_segment(ll, 0);
+    return err;
+}
+
+static const hls_part_t *ll_find_part(const hls_playlist_t *playlist, long msn, int index) {
+    for (size_t i = 0; i < playlist->part_count; i++) {
+        if (playlist->parts[i].msn == msn && playlist->parts[i].index == index) return &playlist->parts[i];
+    }
+    return NULL;
+}
+
+// Fetch everything the playlist offers past the current position: finished
+// segments whole (or their remaining parts if already started), then the
+// parts of the in-progress segment, then the preload hint. Returns non-zero
+// if anything new was downloaded.
+static int ll_fetch_playlist(hls_fetcher_t *f, hls_ll_state_t *ll, const hls_playlist_t *playlist) {
+    long live_msn = playlist->media_sequence + (long)(playlist->segment_count - playlist->prefetch_count);
+    int fetched = 0;
+
+    // Join at the start of the in-progress segment, which begins with an
+    // independent part
+    if (ll->next_msn < 0) ll->next_msn = live_msn;
+    if (ll->next_msn < playlist->media_sequence) {
+        // Fell out of the window; resume at the oldest segment still listed
+        if (ll->slot) ll_finish_segment(ll, 0);
+        ll->next_msn = playlist->media_sequence;
+        ll->next_part = 0;
+    }
+
+    while (!atomic_load(&f->queue.stopped)) {
+        const hls_part_t *part = ll_find_part(playlist, ll->next_msn, ll->next_part);
+        if (ll->next_msn < live_msn) {
+            if (part && ll->slot) {
+                if (ll_fetch(f, ll, playlist->base_url, playlist->map_url, part->url, part->duration) != HLS_OK) return fetched;
+                ll->next_part++;
+                fetched = 1;
+            } else if (ll->slot) {
+                // All listed parts are in; a hole truncates the segment
+                ll_finish_segment(ll, ll_find_part(playlist, ll->next_msn, ll->next_part + 1) == NULL);
+            } else {
+                const hls_segment_t *segment = &playlist->segments[ll->next_msn - playlist->media_sequence];
+                hls_error_t err = ll_fetch(f, ll, playlist->base_url, segment->map_url, segment->url, segment->duration);
+                if (!ll->slot) return fetched;
+                ll_finish_segment(ll, err == HLS_OK);
+                fetched = 1;
+            }
+        } else {
+            if (!part) break;
+            if (ll_fetch(f, ll, playlist->base_url, playlist->map_url, part->url, part->duration) != HLS_OK) return fetched;
+            ll->next_part++;
+            fetched = 1;
+        }
+    }
+
+    // The hint names the part right after the last listed one; the server
+    // holds the request until that part is ready
+    if (playlist->preload_hint_url && ll->next_msn == live_msn &&
+        !ll_find_part(playlist, ll->next_msn, ll->next_part) && !atomic_load(&f->queue.stopped)) {
+        if (ll_fetch(f, ll, playlist->base_url, playlist->map_url, playlist->preload_hint_url, playlist->part_target) == HLS_OK) {
+            ll->next_part++;
+            fetched = 1;
+        }
+    }
+    return fetched;
+}
+
+// Playlist reload URL with the LL-HLS delivery directives: blocking (msn
+// >= 0) has the server answer once part `part` of segment `msn` is
+// available, skip asks for a delta update
+static char *reload_url(memory_pool_t *pool, const char *url, long msn, int part, int skip) {
+    size_t len = strlen(url) + 80;
+    char *result = pool_alloc_aligned(pool, len, 1);
+    if (!result) return NULL;
+    char sep = strchr(url, '?') ? '&' : '?';
+    int n = snprintf(result, len, "%s", url);
+    if (msn >= 0) n += snprintf(result + n, len - (size_t)n, "%c_HLS_msn=%ld&_HLS_part=%d", sep, msn, part);
+    if (skip) snprintf(result + n, len - (size_t)n, "%c_HLS_skip=YES", msn >= 0 ? '&' : sep);
+    return result;
+}
+
+static char *url_directory(const char *url) {
+    const char *last_slash = strrchr(url, '/');
+    return last_slash ? strndup(url, last_slash - url + 1) : NULL;
+}
+
+// Split a segment over several connections while one connection has been
+// measured slower than the stream needs (the last segment's own bitrate),
+// or while catching up: after the consumer asked to skip ahead, or with
+// catchup_segments or more listed after it. A segment or two of backlog is
+// normal on a live playlist and is left to the single connection.
+static int use_ranges(const hls_fetcher_t *f, const hls_segment_t *segment, long behind, int catching_up) {
+    hls_demuxer_t *demuxer = f->demuxer;
+    if (demuxer->range_parts < 2 || segment->is_prefetch) return 0;
+    // The ranges arrive out of order, decryption and the recording take
+    // them in order
+    if (segment->is_key_segment || hls_replaying(demuxer) || hls_capturing(demuxer)) return 0;
+    if (catching_up) return 1;
+    if (demuxer->catchup_segments > 0 && behind >= (long)demuxer->catchup_segments) return 1;
+    return f->connection_bps > 0.0 && f->connection_bps < f->stream_bps;
+}
+
+// Fetcher thread: reload the playlist and download new segments into the
+// queue until the consumer stops it, the playlist ends or a fatal error occurs.
+// A master playlist hands rendition choice to the ABR controller, which may
+// move to another rendition at any segment boundary.
+static void *fetch_thread(void *arg) {
+    hls_fetcher_t *f = (hls_fetcher_t *)arg;
+    hls_demuxer_t *demuxer = f->demuxer;
+    const char *playlist_url = f->playlist_url;
+    int rendition = -1;         // ABR rendition being loaded, -1 without a master
+    char *variant_url = NULL;   // Its playlist URL
+
+    pipeline_pin_thread(demuxer->fetch_cpus);
+
+    char *base_url = url_directory(playlist_url);
+    // URL strings come from here, each rewound once fetched
+    f->scratch = pool_thread();
+
+    // buf holds the last parsed playlist body, next receives each reload;
+    // both keep their capacity across reloads
+    struct hls_buffer buf = {0};
+    struct hls_buffer next = {0};
+    hls_validators_t validators = {0};
+    hls_ll_state_t ll = { -1, 0, NULL };
+    // Reparsed in place on every reload
+    hls_playlist_t *playlist = f->scratch ? hls_playlist_create() : NULL;
+    // A delta update is parsed into the spare from playlist, then the two
+    // swap places
+    hls_playlist_t *spare = playlist ? hls_playlist_create() : NULL;
+    if (!spare) {
+        f->error = HLS_ERROR_MEMORY;
+        hls_playlist_destroy(playlist);
+        playlist = NULL;
+    }
+    int have_window = 0;        // playlist holds this rendition's segments, delta updates may skip them
+    int skipping = 0;           // The validators are those of delta update responses
+    struct timespec loaded_at = {0, 0};  // Start of the last successful load
+    int blocking = 0;           // Server supports LL-HLS blocking reloads
+    double reload_target = 0.0; // Target duration, or part target for LL-HLS
+    long next_msn = -1;         // Media sequence number of the next segment to fetch
+    // A segment fetched ahead by the standby goes first, the live edge
+    // rule then applies from the one after it
+    const hls_primed_t *primed = demuxer->primed;
+    if (playlist && primed && primed->data && strcmp(primed->playlist_url, f->playlist_url) == 0) {
+        hls_queue_slot_t *slot = hls_queue_begin(&f->queue, -1, primed->msn);
+        if (slot) {
+            slot->duration = primed->duration;
+            slot->program_date_time = primed->program_date_time;
+            slot->downloaded_us = primed->fetched_us;
+            int ok = hls_queue_append(slot, primed->data, primed->size) == 0;
+            hls_queue_end(slot, ok);
+            next_msn = primed->msn + 1;
+        }
+    }
+    while (playlist && !atomic_load(&f->queue.stopped)) {
+        struct timespec load_start;
+        clock_gettime(CLOCK_MONOTONIC, &load_start);
 
-        // Parse playlist
-        hls_playlist_t *playlist = hls_playlist_create();
-        if (!playlist) {
-            free(buf.data);
-            return HLS_ERROR_MEMORY;
+        if (!next.data) {
+            next.capacity = 4096;
+            next.data = malloc(next.capacity);
+            if (!next.data) { f->error = HLS_ERROR_MEMORY; break; }
+        }
+        next.size = 0;
+        int not_modified = 0;
+        hls_error_t err;
+        // Delta updates leave out the segments older than the skip
+        // boundary, which is only safe while what we have is recent
+        int skip = have_window && playlist->can_skip_until > 0.0 &&
+                   elapsed_us(&loaded_at) < (long)(playlist->can_skip_until * 500000.0);
+        if (skip != skipping) {
+            hls_validators_clear(&validators);
+            skipping = skip;
+        }
+        if (blocking || skip) {
+            pool_mark_t mark = pool_mark(f->scratch);
+            char *url = reload_url(f->scratch, playlist_url, blocking ? ll.next_msn : -1, ll.next_part, skip);
+            if (!url) { f->error = HLS_ERROR_MEMORY; break; }
+            if (blocking) err = hls_download_url(demuxer, url, &next);
+            else err = hls_download_conditional(demuxer, url, &next, &validators, &not_modified);
+            pool_rewind(f->scratch, mark);
+        } else {
+            err = hls_download_conditional(demuxer, playlist_url, &next, &validators, &not_modified);
         }
-    char *base_url = NULL;
-    char *last_slash = strrchr(playlist_url, '/');
-    if (last_slash) base_url = strndup(playlist_url, last_slash - playlist_url + 1);
-    // Parser will duplicate base_url into playlist->base_url, do not assign directly to avoid double-free
-    err = hls_parse_playlist_from_memory(demuxer, buf.data, buf.size, base_url, playlist);
         if (err != HLS_OK) {
-            hls_playlist_destroy(playlist);
-            free(buf.data);
+            if (!atomic_load(&f->queue.stopped)) f->error = err;
+            break;
+        }
+        loaded_at = load_start;
+        // Blocking reloads wait for the server on purpose
+        if (!blocking) metrics_record(METRIC_PLAYLIST_FETCH, (uint64_t)elapsed_us(&load_start));
+
+        if (rendition < 0 && hls_is_master_playlist(next.data, next.size)) {
+            err = hls_abr_load_master(&f->abr, next.data, next.size, playlist_url);
+            if (err != HLS_OK) { f->error = err; break; }
+            rendition = (int)f->abr.current;
+            free(variant_url);
+            variant_url = hls_abr_url(&f->abr, (size_t)rendition);
+            if (!variant_url) { f->error = HLS_ERROR_MEMORY; break; }
+            playlist_url = variant_url;
             free(base_url);
-            return err;
+            base_url = url_directory(playlist_url);
+            hls_validators_clear(&validators);
+            continue;
         }
 
-        // Determine starting index based on last processed URL (handles sliding windows)
-        size_t start_index = 0;
-        if (last_processed_url) {
-            for (size_t i = 0; i < playlist->segment_count; i++) {
-                if (playlist->segments[i].url && strcmp(playlist->segments[i].url, last_processed_url) == 0) {
-                    start_index = i + 1; // start after the last processed one
-                    break;
+        // A 304, or a 200 with a byte-identical body from a server that sends
+        // no validators, means nothing to parse
+        int changed = 0;
+        int ended = 0;
+        int switched = 0;
+        if (!not_modified && !(buf.data && next.size == buf.size && memcmp(next.data, buf.data, buf.size) == 0)) {
+            struct hls_buffer tmp = buf;
+            buf = next;
+            next = tmp;
+
+            // Parser will duplicate base_url into playlist->base_url, do not assign directly to avoid double-free
+            if (skip) {
+                err = hls_parse_playlist_delta(demuxer, buf.data, buf.size, base_url, playlist, spare);
+                if (err == HLS_OK) {
+                    hls_playlist_t *tmp_playlist = playlist;
+                    playlist = spare;
+                    spare = tmp_playlist;
+                } else if (err == HLS_ERROR_PARSE) {
+                    // Skipped more than we have: load the whole playlist
+                    have_window = 0;
+                    buf.size = 0;
+                    continue;
+                }
+            } else {
+                err = hls_parse_playlist_from_memory(demuxer, buf.data, buf.size, base_url, playlist);
+            }
+            if (err != HLS_OK) {
+                f->error = err;
+                break;
+            }
+            have_window = 1;
+            ended = playlist->ended;
+            // Where the live edge is, for the consumer's latency tracking
+            atomic_store(&f->queue.live_end_msn,
+                         playlist->media_sequence + (long)(playlist->segment_count - playlist->prefetch_count));
+            atomic_store(&f->queue.segment_us, (long)(playlist->target_duration * 1000000.0));
+
+            if (playlist->part_count > 0 && !ended) {
+                // LL-HLS: follow the live edge part by part
+                changed = ll_fetch_playlist(f, &ll, playlist);
+                reload_target = playlist->part_target > 0 ? playlist->part_target : playlist->target_duration;
+                blocking = playlist->can_block_reload;
+            } else {
+                reload_target = playlist->target_duration;
+                blocking = 0;
+
+                // Segment i has media sequence number media_sequence + i, so the
+                // position carries over reloads, window slides and renditions
+                long first_msn = playlist->media_sequence;
+                long end_msn = first_msn + (long)playlist->segment_count;
+                int rejoin = atomic_exchange(&f->queue.jump_live, 0);
+                long skip_to = atomic_exchange(&f->queue.skip_to_msn, -1);
+                int catching_up = skip_to > next_msn && next_msn >= 0;
+                if (catching_up) next_msn = skip_to;
+                int restarted = next_msn > end_msn + (long)playlist->segment_count;
+                if (next_msn < 0 || rejoin || restarted) {
+                    // Join (or rejoin after a stream restart) near the live edge
+                    long live_end = end_msn - (long)playlist->prefetch_count;
+                    long back = demuxer->live_start_segments ? (long)demuxer->live_start_segments : live_end - first_msn;
+                    // Fast start: only the newest complete segment, the
+                    // player begins at its first random access point
+                    if (demuxer->fast_start && next_msn < 0 && live_end > first_msn) back = 1;
+                    long join = live_end - back > first_msn ? live_end - back : first_msn;
+                    // A requested jump only ever skips ahead
+                    if (next_msn < 0 || restarted || join > next_msn) next_msn = join;
+                } else if (next_msn < first_msn) {
+                    // Fell behind: those segments already left the window
+                    fprintf(stderr, "HLS: fell behind the live window, skipped %ld segment(s)\n", first_msn - next_msn);
+                    next_msn = first_msn;
+                }
+                size_t start_index = next_msn < end_msn ? (size_t)(next_msn - first_msn) : playlist->segment_count;
+                changed = start_index < playlist->segment_count;
+
+                // Fetch new segments ahead of the decoder; claiming a slot blocks
+                // while the queue is at its depth or byte cap
+                for (size_t i = start_index; i < playlist->segment_count; i++) {
+                    hls_segment_t *segment = &playlist->segments[i];
+                    pool_mark_t mark = pool_mark(f->scratch);
+                    char *segment_url = resolve_url(f->scratch, playlist->base_url, segment->url);
+                    if (!segment_url) continue;
+                    hls_queue_slot_t *slot = hls_queue_begin(&f->queue, rendition, first_msn + (long)i);
+                    if (!slot) { pool_rewind(f->scratch, mark); break; }
+                    slot->duration = segment->duration;
+                    slot->program_date_time = hls_replay_date_time(demuxer, segment->program_date_time);
+                    long behind = ended ? 0 : end_msn - (long)playlist->prefetch_count - (first_msn + (long)i + 1);
+                    int ranged = use_ranges(f, segment, behind, catching_up);
+                    hls_transfer_t transfer = {0};
+                    hls_error_t seg_err = slot_add_init(f, slot, playlist->base_url, segment->map_url);
+                    if (seg_err == HLS_OK && ranged) {
+                        seg_err = hls_download_ranged(demuxer, &f->ranged, segment_url, slot, demuxer->range_parts,
+                                                      &transfer);
+                    } else if (seg_err == HLS_OK) {
+                        seg_err = hls_download_segment(demuxer, &f->keys, playlist->base_url, segment, first_msn + (long)i,
+                                                       segment_url, slot_write_callback, slot);
+                    }
+                    slot->downloaded_us = monotonic_us();
+                    hls_queue_end(slot, seg_err == HLS_OK);
+                    pool_rewind(f->scratch, mark);
+                    // A prefetch entry the edge could not serve yet is
+                    // retried once it is listed as a regular segment
+                    if (seg_err != HLS_OK && segment->is_prefetch) break;
+                    next_msn = first_msn + (long)i + 1;
+
+                    // Prefetch downloads are paced by the encoder, not the
+                    // network, so they say nothing about throughput
+                    double bytes = 0.0, seconds = 0.0;
+                    int measured = seg_err == HLS_OK && !segment->is_prefetch;
+                    if (seg_err == HLS_OK) {
+                        if (ranged) {
+                            bytes = transfer.bytes;
+                            seconds = transfer.seconds;
+                        } else {
+                            last_transfer_stats(demuxer, &bytes, &seconds);
+                            transfer.connection_bps = seconds > 0.0 ? bytes * 8.0 / seconds : 0.0;
+                        }
+                        metrics_count(METRIC_SEGMENTS, 1);
+                        metrics_count(METRIC_SEGMENT_BYTES, (uint64_t)bytes);
+                    }
+                    if (measured) {
+                        f->connection_bps = transfer.connection_bps;
+                        if (segment->duration > 0.0) f->stream_bps = bytes * 8.0 / segment->duration;
+                        metrics_record(METRIC_SEGMENT_DOWNLOAD, (uint64_t)(seconds * 1e6));
+                        if (seconds > 0.0) metrics_record(METRIC_SEGMENT_KBPS, (uint64_t)(bytes * 8.0 / 1000.0 / seconds));
+                    }
+
+                    if (rendition >= 0) {
+                        if (measured) hls_abr_add_throughput(&f->abr, bytes, seconds);
+                        size_t choice = hls_abr_select(&f->abr);
+                        if ((int)choice != rendition) {
+                            char *url = hls_abr_url(&f->abr, choice);
+                            if (!url) break;
+                            rendition = (int)choice;
+                            free(variant_url);
+                            variant_url = url;
+                            playlist_url = variant_url;
+                            free(base_url);
+                            base_url = url_directory(playlist_url);
+                            hls_validators_clear(&validators);
+                            buf.size = 0;
+                            have_window = 0;
+                            switched = 1;
+                            break;
+                        }
+                    }
                 }
             }
-        } else {
-            start_index = last_count; // initial fallback
         }
-        if (start_index > playlist->segment_count) start_index = playlist->segment_count;
-
-        // Process new segments
-        for (size_t i = start_index; i < playlist->segment_count; i++) {
-            hls_segment_t *segment = &playlist->segments[i];
-            char *segment_url = hls_resolve_url(playlist->base_url, segment->url);
-            if (!segment_url) continue;
-            struct hls_buffer seg_buf = {0};
-            seg_buf.capacity = 1024*1024;
-            seg_buf.data = malloc(seg_buf.capacity);
-            if (!seg_buf.data) {
-                free(segment_url);
+        if (ended) break;
+
+        // Blocking reloads wait on the server side instead; a rendition
+        // switch loads the new playlist right away
+        if (blocking || switched) continue;
+
+        // The interval counts from the start of the last load, so time spent
+        // downloading segments (or waiting for queue space) is not added on top
+        long wait_us = reload_interval_us(reload_target, changed) - elapsed_us(&load_start);
+        if (hls_replay_unpaced(demuxer)) wait_us = 0;
+        if (hls_queue_wait_stopped(&f->queue, wait_us > 0 ? wait_us : 0)) break;
+    }
+
+    if (ll.slot) hls_queue_end(ll.slot, 0);
+    free(f->init_url);
+    free(f->init.data);
+    hls_keys_clear(&f->keys);
+    hls_ranged_clear(&f->ranged);
+    hls_playlist_destroy(playlist);
+    hls_playlist_destroy(spare);
+    hls_validators_clear(&validators);
+    free(variant_url);
+    free(next.data);
+    free(buf.data);
+    free(base_url);
+    hls_queue_close(&f->queue);
+    return NULL;
+}
+
+// Consumer: move the finished head segment from the queue into the
+// timeshift recording without playing it
+static void record_head(hls_segment_queue_t *q, hls_timeshift_t *ts) {
+    size_t avail;
+    hls_slot_state_t state;
+    hls_queue_slot_t *slot = hls_queue_read(q, 0, 0, 1, &avail, &state);
+    if (!slot) return;
+    if (state == HLS_SLOT_COMPLETE) hls_timeshift_store(ts, slot->msn, slot->duration, slot->buf.data, slot->buf.size);
+    hls_queue_read_done(slot);
+    hls_queue_release(q);
+}
+
+// Consumer, as live segment `msn` starts: update the latency stats and decide
+// whether playback has drifted far enough behind to skip ahead. Returns the
+// first sequence number worth playing (segments before it are skipped).
+static long catch_up(hls_demuxer_t *demuxer, hls_segment_queue_t *q, long msn, long skip_msn) {
+    long live_end = atomic_load(&q->live_end_msn);
+    if (live_end < 0 || msn < 0) return skip_msn;
+    long behind = live_end - msn;
+    // Pictures shown later than that, the queues after the fetcher backed
+    // up: by the measured latency, less the segment the live edge is old
+    long segment_us = atomic_load(&q->segment_us);
+    if (demuxer->stats.live_latency > 0.0 && segment_us > 0) {
+        long measured = (long)(demuxer->stats.live_latency * 1000000.0 / (double)segment_us) - 1;
+        if (measured > behind) behind = measured;
+    }
+    demuxer->stats.segments_behind = behind;
+    demuxer->stats.latency = (double)behind * (double)segment_us / 1000000.0;
+
+    if (demuxer->catchup_segments > 0 && behind > (long)demuxer->catchup_segments && msn >= skip_msn) {
+        // Segments start with a keyframe on the streams we play, so the
+        // skip lands cleanly at the start of one
+        long keep = demuxer->live_start_segments > 0 ? (long)demuxer->live_start_segments : 1;
+        skip_msn = live_end - keep;
+        demuxer->stats.catchups++;
+        fprintf(stderr, "HLS: %ld segments behind live, skipping ahead\n", behind);
+        atomic_store(&q->skip_to_msn, skip_msn);
+    }
+    return skip_msn;
+}
+
+// Run the fetcher and feed the consumer until quit or error. Exactly one of
+// segment_cb (whole segments) and chunk_cb (streaming) is set.
+static hls_error_t process_stream(hls_demuxer_t *demuxer, const char *playlist_url,
+                                  hls_segment_callback_t segment_cb, hls_chunk_callback_t chunk_cb,
+                                  void *user_data) {
+    hls_fetcher_t fetcher = {0};
+    fetcher.demuxer = demuxer;
+    fetcher.playlist_url = playlist_url;
+    fetcher.error = HLS_OK;
+    if (hls_queue_init(&fetcher.queue, demuxer->prefetch_depth, demuxer->prefetch_max_bytes) != 0) {
+        return HLS_ERROR_MEMORY;
+    }
+    hls_abr_init(&fetcher.abr);
+    hls_timeshift_t timeshift;
+    if (hls_timeshift_init(&timeshift, demuxer->timeshift_dir, demuxer->timeshift_bytes) != 0) {
+        fprintf(stderr, "HLS: could not create the timeshift ring, playing live only\n");
+    }
+    demuxer->fetch_queue = &fetcher.queue;
+    demuxer->abr = &fetcher.abr;
+    demuxer->timeshift = &timeshift;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, fetch_thread, &fetcher) != 0) {
+        demuxer->fetch_queue = NULL;
+        demuxer->abr = NULL;
+        demuxer->timeshift = NULL;
+        hls_timeshift_destroy(&timeshift);
+        hls_abr_destroy(&fetcher.abr);
+        hls_queue_destroy(&fetcher.queue);
+        return HLS_ERROR_MEMORY;
+    }
+
+    size_t consumed = 0;   // Bytes of the head segment already delivered
+    long skip_msn = -1;    // Catch-up: live segments before this are skipped
+    int quit = 0;
+    hls_queue_slot_t *slot;
+    size_t avail;
+    hls_slot_state_t state;
+    while (!quit) {
+        if (consumed == 0) {
+            if (hls_timeshift_paused(&timeshift)) {
+                // Keep recording so the live window does not slip away, and
+                // tick the callback so the application can run its UI
+                int ready = hls_queue_wait_ended(&fetcher.queue, HLS_IDLE_TICK_US);
+                if (ready < 0) break;
+                if (ready > 0) record_head(&fetcher.queue, &timeshift);
+                quit = segment_cb ? segment_cb(NULL, 0, user_data) : chunk_cb(NULL, 0, 0, user_data);
                 continue;
             }
-            hls_error_t seg_err = download_url(demuxer, segment_url, &seg_buf);
-            if (seg_err == HLS_OK && seg_buf.size > 0) {
-                int cb = callback((const unsigned char*)seg_buf.data, seg_buf.size, user_data);
-                if (cb) {
-                    // Cleanup and exit on callback request
-                    free(seg_buf.data);
-                    free(segment_url);
-                    if (last_processed_url) { free(last_processed_url); last_processed_url = NULL; }
-                    hls_playlist_destroy(playlist);
-                    free(buf.data);
-                    free(base_url);
-                    return HLS_OK;
+            if (hls_timeshift_shifted(&timeshift)) {
+                // Behind live: record what has arrived meanwhile, then play
+                // from the ring straight out of the mapping
+                while (hls_queue_wait_ended(&fetcher.queue, 0) > 0) record_head(&fetcher.queue, &timeshift);
+                const unsigned char *data;
+                const hls_timeshift_entry_t *e = hls_timeshift_next(&timeshift, &data);
+                if (e) {
+                    demuxer->stats.program_date_time = 0.0;
+                    demuxer->stats.downloaded_us = 0;
+                    quit = segment_cb ? segment_cb(data, e->size, user_data)
+                                      : chunk_cb(data, e->size, HLS_CHUNK_SEGMENT_START | HLS_CHUNK_SEGMENT_END, user_data);
+                    continue;
                 }
             }
-            free(seg_buf.data);
-            free(segment_url);
-            // Update last processed URL to current segment
-            if (last_processed_url) { free(last_processed_url); last_processed_url = NULL; }
-            if (segment->url) last_processed_url = strdup(segment->url);
         }
-        last_count = playlist->segment_count;
-        hls_playlist_destroy(playlist);
-        free(buf.data);
-        free(base_url);
 
-        // Wait before refreshing playlist
-        usleep(500000); // 0.5s
+        slot = hls_queue_read(&fetcher.queue, consumed, HLS_CHUNK_ALIGN, segment_cb != NULL, &avail, &state);
+        if (!slot) break;
+        if (consumed == 0) {
+            skip_msn = catch_up(demuxer, &fetcher.queue, slot->msn, skip_msn);
+            if (slot->msn < skip_msn) {
+                // Still recorded, so it can be rewound to
+                hls_queue_read_done(slot);
+                record_head(&fetcher.queue, &timeshift);
+                demuxer->stats.segments_skipped++;
+                continue;
+            }
+        }
+        int ended = state != HLS_SLOT_FILLING;
+        if (consumed == 0) {
+            if (slot->tag >= 0) hls_abr_set_playing(&fetcher.abr, slot->tag);
+            demuxer->stats.program_date_time = slot->program_date_time;
+            demuxer->stats.downloaded_us = ended ? slot->downloaded_us : 0;
+        }
+        if (segment_cb) {
+            // Failed downloads are dropped whole in segment mode
+            if (state == HLS_SLOT_COMPLETE) {
+                quit = segment_cb((const unsigned char *)slot->buf.data, slot->buf.size, user_data);
+            }
+        } else if (consumed > 0 || avail > 0) {
+            unsigned flags = 0;
+            if (consumed == 0) flags |= HLS_CHUNK_SEGMENT_START;
+            if (ended) flags |= HLS_CHUNK_SEGMENT_END;
+            if (state == HLS_SLOT_FAILED) flags |= HLS_CHUNK_TRUNCATED;
+            quit = chunk_cb((const unsigned char *)slot->buf.data + consumed, avail, flags, user_data);
+            consumed += avail;
+        }
+        if (ended) {
+            if (state == HLS_SLOT_COMPLETE) {
+                hls_timeshift_store(&timeshift, slot->msn, slot->duration, slot->buf.data, slot->buf.size);
+            }
+            hls_timeshift_played(&timeshift, slot->msn);
+        }
+        hls_queue_read_done(slot);
+        if (ended) {
+            hls_queue_release(&fetcher.queue);
+            consumed = 0;
+        }
+    }
+
+    // Stop the fetcher (aborts any in-flight transfer) and wait for it
+    hls_queue_stop(&fetcher.queue);
+    pthread_join(thread, NULL);
+    demuxer->primed = NULL;
+    demuxer->fetch_queue = NULL;
+    demuxer->abr = NULL;
+    demuxer->timeshift = NULL;
+    hls_timeshift_destroy(&timeshift);
+    hls_abr_destroy(&fetcher.abr);
+    hls_queue_destroy(&fetcher.queue);
+    return fetcher.error;
+}
+
+// Process HLS stream continuously until callback signals quit or error.
+// Downloads run on a background thread up to prefetch_depth segments ahead;
+// the callback is always invoked on the calling thread with whole segments.
+hls_error_t hls_process_stream(hls_demuxer_t *demuxer, const char *playlist_url, hls_segment_callback_t callback, void *user_data) {
+    if (!demuxer || !playlist_url || !callback) {
+        return HLS_ERROR_PARSE;
+    }
+    demuxer->segment_callback = callback;
+    demuxer->callback_user_data = user_data;
+    return process_stream(demuxer, playlist_url, callback, NULL, user_data);
+}
+
+// Streaming variant: segment bytes are delivered while they download, in
+// HLS_CHUNK_ALIGN-sized multiples (the tail of a segment may be shorter)
+hls_error_t hls_process_stream_chunked(hls_demuxer_t *demuxer, const char *playlist_url, hls_chunk_callback_t callback, void *user_data) {
+    if (!demuxer || !playlist_url || !callback) {
+        return HLS_ERROR_PARSE;
+    }
+    demuxer->callback_user_data = user_data;
+    return process_stream(demuxer, playlist_url, NULL, callback, user_data);
+}
+
+// Sink of hls_fetch_preview(): a non-zero callback return cuts the
+// transfer short, which is then not an error
+typedef struct {
+    hls_segment_callback_t callback;
+    void *user_data;
+    int done;
+} hls_preview_sink_t;
+
+static size_t preview_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    hls_preview_sink_t *sink = (hls_preview_sink_t *)userp;
+    size_t realsize = size * nmemb;
+    if (sink->done) return 0;
+    if (realsize && sink->callback(contents, realsize, sink->user_data) != 0) {
+        sink->done = 1;
+        return 0;
+    }
+    return realsize;
+}
+
+// segment is NULL for an init section
+static hls_error_t preview_download(hls_demuxer_t *demuxer, const char *base_url, const char *relative,
+                                    const hls_segment_t *segment, long msn, hls_preview_sink_t *sink) {
+    char *url = hls_resolve_url(base_url, relative);
+    if (!url) return HLS_ERROR_MEMORY;
+    hls_key_cache_t keys = {0};
+    hls_error_t err = segment ? hls_download_segment(demuxer, &keys, base_url, segment, msn, url, preview_write_callback, sink)
+                              : hls_download_to(demuxer, url, preview_write_callback, sink);
+    hls_keys_clear(&keys);
+    free(url);
+    return sink->done ? HLS_OK : err;
+}
+
+// The media playlist of playlist_url (the lightest video rendition of a
+// master) and how many complete segments it lists, at least one
+static hls_error_t load_live_edge(hls_demuxer_t *demuxer, const char *playlist_url, hls_playlist_t *playlist,
+                                  size_t *complete) {
+    hls_error_t err = hls_parse_playlist(demuxer, playlist_url, playlist);
+    if (err == HLS_OK && playlist->type == HLS_PLAYLIST_MASTER) {
+        const hls_variant_t *variant = NULL;
+        for (size_t i = 0; i < playlist->variant_count && !variant; i++)
+            if (playlist->variants[i].height > 0) variant = &playlist->variants[i];
+        if (!variant && playlist->variant_count) variant = &playlist->variants[0];
+        char *url = variant ? hls_resolve_url(playlist->base_url, variant->url) : NULL;
+        err = !variant ? HLS_ERROR_PARSE : !url ? HLS_ERROR_MEMORY : hls_parse_playlist(demuxer, url, playlist);
+        free(url);
     }
+    *complete = err == HLS_OK ? playlist->segment_count - playlist->prefetch_count : 0;
+    if (err == HLS_OK && *complete == 0) err = HLS_ERROR_PARSE;
+    return err;
+}
+
+// Preview fetch: the lightest video rendition, then only its newest
+// complete segment (with its init section), streamed to the callback as it
+// downloads until the callback has what it wants
+hls_error_t hls_fetch_preview(hls_demuxer_t *demuxer, const char *playlist_url, hls_segment_callback_t callback,
+                              void *user_data, bool *ended) {
+    if (!demuxer || !playlist_url || !callback) return HLS_ERROR_PARSE;
+    if (ended) *ended = false;
+    hls_playlist_t *playlist = hls_playlist_create();
+    if (!playlist) return HLS_ERROR_MEMORY;
+    size_t complete;
+    hls_error_t err = load_live_edge(demuxer, playlist_url, playlist, &complete);
+    if (err == HLS_OK) {
+        const hls_segment_t *segment = &playlist->segments[complete - 1];
+        hls_preview_sink_t sink = { callback, user_data, 0 };
+        if (ended) *ended = playlist->ended;
+        long msn = playlist->media_sequence + (long)complete - 1;
+        if (segment->map_url) err = preview_download(demuxer, playlist->base_url, segment->map_url, NULL, msn, &sink);
+        if (err == HLS_OK && !sink.done) err = preview_download(demuxer, playlist->base_url, segment->url, segment, msn, &sink);
+    }
+    hls_playlist_destroy(playlist);
+    return err;
+}
+
+void hls_primed_clear(hls_primed_t *primed) {
+    if (!primed) return;
+    free(primed->playlist_url);
+    free(primed->data);
+    memset(primed, 0, sizeof(*primed));
+}
+
+// Standby fetch: the newest complete segment into a buffer, as the
+// fetcher would queue it
+hls_error_t hls_prime(hls_demuxer_t *demuxer, const char *playlist_url, hls_primed_t *primed) {
+    if (!demuxer || !playlist_url || !primed) return HLS_ERROR_PARSE;
+    hls_primed_clear(primed);
+    hls_playlist_t *playlist = hls_playlist_create();
+    if (!playlist) return HLS_ERROR_MEMORY;
+    size_t complete;
+    struct hls_buffer buf = {0};
+    hls_error_t err = load_live_edge(demuxer, playlist_url, playlist, &complete);
+    if (err == HLS_OK) {
+        const hls_segment_t *segment = &playlist->segments[complete - 1];
+        long msn = playlist->media_sequence + (long)complete - 1;
+        char *map_url = segment->map_url ? hls_resolve_url(playlist->base_url, segment->map_url) : NULL;
+        char *url = hls_resolve_url(playlist->base_url, segment->url);
+        if (!url || (segment->map_url && !map_url)) err = HLS_ERROR_MEMORY;
+        if (err == HLS_OK && map_url) err = hls_download_url(demuxer, map_url, &buf);
+        if (err == HLS_OK) {
+            hls_key_cache_t keys = {0};
+            err = hls_download_segment(demuxer, &keys, playlist->base_url, segment, msn, url, write_callback, &buf);
+            hls_keys_clear(&keys);
+        }
+        free(map_url);
+        free(url);
+        if (err == HLS_OK && !(primed->playlist_url = strdup(playlist_url))) err = HLS_ERROR_MEMORY;
+        if (err == HLS_OK) {
+            primed->data = (unsigned char *)buf.data;
+            primed->size = buf.size;
+            primed->msn = msn;
+            primed->duration = segment->duration;
+            primed->program_date_time = segment->program_date_time;
+            primed->target_duration = playlist->target_duration;
+            primed->fetched_us = monotonic_us();
+            primed->ended = playlist->ended;
+            buf.data = NULL;
+        }
+    }
+    free(buf.data);
+    hls_playlist_destroy(playlist);
+    return err;
+}
+
+void hls_report_decode_stats(hls_demuxer_t *demuxer, unsigned frames, double busy_seconds) {
+    if (!demuxer || !demuxer->abr) return;
+    hls_abr_add_decode((hls_abr_t *)demuxer->abr, frames, busy_seconds);
+}
+
+void hls_report_latency(hls_demuxer_t *demuxer, double live_latency, double present_delay) {
+    if (!demuxer) return;
+    demuxer->stats.live_latency = live_latency;
+    demuxer->stats.present_delay = present_delay;
+}
+
+void hls_jump_to_live_edge(hls_demuxer_t *demuxer) {
+    if (!demuxer || !demuxer->fetch_queue) return;
+    atomic_store(&((hls_segment_queue_t *)demuxer->fetch_queue)->jump_live, 1);
+    if (demuxer->timeshift) hls_timeshift_seek((hls_timeshift_t *)demuxer->timeshift, 0.0);
+}
+
+void hls_timeshift_pause(hls_demuxer_t *demuxer, bool paused) {
+    if (!demuxer || !demuxer->timeshift) return;
+    hls_timeshift_set_paused((hls_timeshift_t *)demuxer->timeshift, paused);
+}
+
+void hls_timeshift_rewind(hls_demuxer_t *demuxer, double seconds) {
+    if (!demuxer || !demuxer->timeshift) return;
+    hls_timeshift_seek((hls_timeshift_t *)demuxer->timeshift, seconds);
+}
+
+double hls_timeshift_behind_live(hls_demuxer_t *demuxer) {
+    if (!demuxer || !demuxer->timeshift) return 0.0;
+    return hls_timeshift_delay((hls_timeshift_t *)demuxer->timeshift);
 }
 
 // Error string conversion
@@ -257,10 +1177,31 @@ bool hls_is_master_playlist(const char *data, size_t len) {
         // trim leading spaces
         const char *s = p;
         while (s < line_end && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
-        if ((size_t)(line_end - s) >= 19 && strncmp(s, "#EXT-X-STREAM-INF:", 19) == 0) {
+        if ((size_t)(line_end - s) >= 18 && strncmp(s, "#EXT-X-STREAM-INF:", 18) == 0) {
             return true;
         }
         p = nl ? nl + 1 : end;
     }
     return false;
-}
\ No newline at end of file
+}
+
+// Check a CODECS attribute against the built-in video decoders. Audio codecs
+// are ignored; a list without any playable video codec is rejected.
+bool hls_codecs_playable(const char *codecs) {
+    if (!codecs) return true;  // Unknown, assume the common H.264 case
+    const char *p = codecs;
+    while (*p) {
+        while (*p == ' ' || *p == ',') p++;
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if ((len >= 4 && (strncmp(p, "avc1", 4) == 0 || strncmp(p, "avc3", 4) == 0))
+#ifdef USE_MPEG4
+            || (len >= 7 && strncmp(p, "mp4v.20", 7) == 0)
+#endif
+            ) {
+            return true;
+        }
+        p += len;
+    }
+    return false;
+}
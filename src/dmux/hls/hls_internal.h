@@ -0,0 +1,225 @@
+// Internal helpers shared by the HLS demuxer translation units
+#ifndef HLS_INTERNAL_H
+#define HLS_INTERNAL_H
+
+#include "../../../include/hls_demuxer.h"
+#include "../../../include/aes.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+// Growable download buffer (always NUL-terminated when non-empty)
+struct hls_buffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+typedef enum {
+    HLS_SLOT_FREE = 0,
+    HLS_SLOT_FILLING,           // Download in progress, data grows
+    HLS_SLOT_COMPLETE,
+    HLS_SLOT_FAILED             // Download aborted; data may be partial
+} hls_slot_state_t;
+
+struct hls_segment_queue;
+
+// One segment in the prefetch ring
+typedef struct {
+    struct hls_buffer buf;
+    hls_slot_state_t state;
+    int readers;                // Consumer read references (blocks realloc)
+    int tag;                    // Producer-defined (ABR rendition index)
+    long msn;                   // Media sequence number of the segment
+    double duration;            // Seconds of media (0 if unknown)
+    double program_date_time;   // Unix seconds (0 if unknown)
+    uint64_t downloaded_us;     // CLOCK_MONOTONIC when the download completed
+    struct hls_segment_queue *queue;
+} hls_queue_slot_t;
+
+// Ring of downloaded segments between the fetcher thread and the consumer
+typedef struct hls_segment_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // Signalled on every state change
+    hls_queue_slot_t *slots;
+    size_t depth;               // Number of slots (max segments ahead)
+    size_t head;                // Oldest published slot
+    size_t count;               // Published, not yet released slots
+    size_t bytes_queued;        // Bytes held by published slots
+    size_t max_bytes;           // Producer stalls once this much is queued
+    int closed;                 // Producer finished
+    atomic_int stopped;         // Consumer aborted
+    atomic_int jump_live;       // Consumer asked to skip ahead to the live edge
+    atomic_long skip_to_msn;    // Consumer catch-up: fetch from here on (-1 = no request)
+    atomic_long live_end_msn;   // Producer: msn after the newest listed segment (-1 = none yet)
+    atomic_long segment_us;     // Producer: target duration of the playlist
+} hls_segment_queue_t;
+
+typedef size_t (*hls_write_fn)(void *contents, size_t size, size_t nmemb, void *userp);
+
+// HTTP cache validators remembered between playlist reloads
+typedef struct {
+    char *etag;
+    char *last_modified;
+} hls_validators_t;
+
+// Adaptive bitrate state shared by the fetcher and the consumer
+typedef struct {
+    pthread_mutex_t lock;
+    hls_playlist_t *master;     // Parsed master playlist
+    const hls_variant_t **renditions;  // Video variants of master, ascending bandwidth
+    size_t count;
+    size_t current;             // Rendition the fetcher is loading
+    int playing;                // Rendition the consumer is decoding
+    double bw_fast, bw_slow;    // Throughput EWMAs, bits per second
+    int bw_samples;
+    double decode_rate;         // Decoded pixels per busy second (0 = unknown)
+    int segments_since_switch;
+} hls_abr_t;
+
+// One recorded segment in the timeshift ring
+typedef struct {
+    long msn;
+    size_t offset;              // Position in the mapping
+    size_t size;
+    double duration;
+} hls_timeshift_entry_t;
+
+// mmap-backed history of played segments (timeshift.c)
+typedef struct {
+    pthread_mutex_t lock;
+    int fd;
+    unsigned char *map;         // NULL when timeshift is disabled
+    size_t size;
+    size_t write_pos;           // End of the newest segment
+    hls_timeshift_entry_t *entries;  // Index ring, ascending msn
+    size_t capacity, first, count;
+    int paused;
+    long play_msn;              // Next recorded segment to play (-1 = live)
+    long last_msn;              // Last segment delivered to the callback
+} hls_timeshift_t;
+
+// Download URL into buf using the demuxer's persistent connection
+hls_error_t hls_download_url(hls_demuxer_t *demuxer, const char *url, struct hls_buffer *buf);
+// Download URL, handing received bytes to a custom curl write function
+hls_error_t hls_download_to(hls_demuxer_t *demuxer, const char *url, hls_write_fn write_fn, void *userp);
+// Conditional GET appending to buf; *not_modified is set on a 304
+hls_error_t hls_download_conditional(hls_demuxer_t *demuxer, const char *url, struct hls_buffer *buf,
+                                     hls_validators_t *v, int *not_modified);
+void hls_validators_clear(hls_validators_t *v);
+// A new CURL easy handle with the persistent connection's options
+void *hls_easy_handle(hls_demuxer_t *demuxer);
+
+// Capture and replay (capture.c). A transfer being captured writes through
+// a tee: hls_capture_begin() returns the write function to give curl, with
+// the tee as its user pointer, and hls_capture_end() records the response.
+typedef struct {
+    hls_write_fn write_fn;
+    void *userp;
+    FILE *file;
+    unsigned number;
+    uint64_t start_us;
+    int failed;
+} hls_capture_tee_t;
+
+int hls_capturing(const hls_demuxer_t *demuxer);
+hls_write_fn hls_capture_begin(hls_demuxer_t *demuxer, hls_capture_tee_t *tee, hls_write_fn write_fn, void *userp);
+void hls_capture_end(hls_demuxer_t *demuxer, hls_capture_tee_t *tee, const char *url, long code);
+void hls_capture_destroy(hls_demuxer_t *demuxer);
+// Replay: answer a transfer from the recording instead of the network
+int hls_replaying(const hls_demuxer_t *demuxer);
+hls_error_t hls_replay_perform(hls_demuxer_t *demuxer, const char *url, hls_write_fn write_fn, void *userp, long *code);
+void hls_replay_last_transfer(const hls_demuxer_t *demuxer, double *bytes, double *seconds);
+// Max speed: playlist reloads are not to wait
+int hls_replay_unpaced(const hls_demuxer_t *demuxer);
+// A recorded program date-time moved to the replay's wall clock (0 = unknown)
+double hls_replay_date_time(const hls_demuxer_t *demuxer, double program_date_time);
+
+// AES-128 segment decryption (decrypt.c). The segment is decrypted in
+// curl's write callback as it arrives, one block behind the network: the
+// last block is held back until the transfer ends, as it has the padding.
+typedef struct {
+    char *url;                  // Key held, NULL = none yet
+    uint8_t key[AES_BLOCK];
+    int warned;                 // Undecryptable segments were reported
+} hls_key_cache_t;
+
+typedef struct {
+    hls_write_fn write_fn;
+    void *userp;
+    aes128_t aes;
+    uint8_t iv[AES_BLOCK];
+    uint8_t held[AES_BLOCK];    // Ciphertext not decrypted yet
+    size_t held_size;
+} hls_decrypt_t;
+
+// Download a segment (media sequence number msn, its URL resolved) to
+// write_fn, decrypted when the playlist lists a key for it. The key is
+// fetched once per URI and kept in keys.
+hls_error_t hls_download_segment(hls_demuxer_t *demuxer, hls_key_cache_t *keys, const char *base_url,
+                                 const hls_segment_t *segment, long msn, const char *url,
+                                 hls_write_fn write_fn, void *userp);
+void hls_keys_clear(hls_key_cache_t *keys);
+
+// Ranged segment downloads (ranged.c): a segment fetched as byte ranges
+// over several connections at once, written in place into its queue slot.
+// A first range learns the size; the rest is split between the others.
+#define HLS_RANGE_MAX_PARTS 8
+
+typedef struct {
+    void *multi;                                // CURLM, set up on first use
+    void *handles[HLS_RANGE_MAX_PARTS + 1];     // The first range's, then the parts'
+} hls_ranged_t;
+
+typedef struct {
+    double bytes, seconds;      // The segment, as a whole
+    double connection_bps;      // Fastest connection of the transfer, bits/s
+} hls_transfer_t;
+
+// Download url into a filling slot over up to `parts` connections (ranges
+// the server does not honour come back whole, over one). Not for replay,
+// capture or encrypted segments.
+hls_error_t hls_download_ranged(hls_demuxer_t *demuxer, hls_ranged_t *r, const char *url,
+                                hls_queue_slot_t *slot, size_t parts, hls_transfer_t *transfer);
+void hls_ranged_clear(hls_ranged_t *r);
+
+// Segment queue (segment_queue.c)
+int hls_queue_init(hls_segment_queue_t *q, size_t depth, size_t max_bytes);
+void hls_queue_destroy(hls_segment_queue_t *q);
+hls_queue_slot_t *hls_queue_begin(hls_segment_queue_t *q, int tag, long msn);
+int hls_queue_append(hls_queue_slot_t *slot, const void *data, size_t size);
+int hls_queue_reserve(hls_queue_slot_t *slot, size_t size);
+void hls_queue_publish(hls_queue_slot_t *slot, size_t size);
+void hls_queue_end(hls_queue_slot_t *slot, int ok);
+void hls_queue_close(hls_segment_queue_t *q);
+hls_queue_slot_t *hls_queue_read(hls_segment_queue_t *q, size_t consumed, size_t align,
+                                 int whole_segment, size_t *avail, hls_slot_state_t *state);
+void hls_queue_read_done(hls_queue_slot_t *slot);
+void hls_queue_release(hls_segment_queue_t *q);
+void hls_queue_stop(hls_segment_queue_t *q);
+int hls_queue_wait_ended(hls_segment_queue_t *q, long usec);
+int hls_queue_wait_stopped(hls_segment_queue_t *q, long usec);
+
+// Adaptive bitrate (abr.c)
+void hls_abr_init(hls_abr_t *abr);
+void hls_abr_destroy(hls_abr_t *abr);
+hls_error_t hls_abr_load_master(hls_abr_t *abr, const char *data, size_t len, const char *master_url);
+void hls_abr_add_throughput(hls_abr_t *abr, double bytes, double seconds);
+void hls_abr_set_playing(hls_abr_t *abr, int rendition);
+void hls_abr_add_decode(hls_abr_t *abr, unsigned frames, double busy_seconds);
+size_t hls_abr_select(hls_abr_t *abr);
+char *hls_abr_url(const hls_abr_t *abr, size_t rendition);
+
+// Timeshift (timeshift.c)
+int hls_timeshift_init(hls_timeshift_t *ts, const char *dir, size_t bytes);
+void hls_timeshift_destroy(hls_timeshift_t *ts);
+void hls_timeshift_store(hls_timeshift_t *ts, long msn, double duration, const void *data, size_t size);
+void hls_timeshift_played(hls_timeshift_t *ts, long msn);
+int hls_timeshift_paused(hls_timeshift_t *ts);
+int hls_timeshift_shifted(hls_timeshift_t *ts);
+const hls_timeshift_entry_t *hls_timeshift_next(hls_timeshift_t *ts, const unsigned char **data);
+void hls_timeshift_set_paused(hls_timeshift_t *ts, int paused);
+void hls_timeshift_seek(hls_timeshift_t *ts, double seconds);
+double hls_timeshift_delay(hls_timeshift_t *ts);
+
+#endif // HLS_INTERNAL_H
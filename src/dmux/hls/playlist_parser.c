@@ -1,155 +1,429 @@
-#include "../../../include/hls_demuxer.h"
+#include "hls_internal.h"
+#include "../../../include/memory_pool.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
-#include <curl/curl.h>
-
-// Internal buffer structure (also defined in hls_demuxer.c for internal use)
-struct hls_buffer {
-    char *data;
-    size_t size;
-    size_t capacity;
-};
-
-// Internal callback for curl
-static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
-    size_t realsize = size * nmemb;
-    struct hls_buffer *buf = (struct hls_buffer *)userp;
-
-    if (buf->size + realsize > buf->capacity) {
-        size_t new_capacity = buf->capacity * 2;
-        if (new_capacity < buf->size + realsize) {
-            new_capacity = buf->size + realsize + 1024;
+
+// The parser works on views into the downloaded text. The few strings a
+// playlist keeps (URLs, CODECS) are copied into the playlist's arena, and the
+// entry arrays keep their capacity across hls_playlist_reset(), so reparsing
+// a reloaded playlist of similar size does no heap allocation.
+
+// Non-owning slice of the playlist text (not NUL-terminated)
+typedef struct {
+    const char *p;
+    size_t len;
+} str_view_t;
+
+static str_view_t view_trim(const char *p, size_t len) {
+    while (len > 0 && isspace((unsigned char)*p)) { p++; len--; }
+    while (len > 0 && isspace((unsigned char)p[len - 1])) len--;
+    str_view_t v = { p, len };
+    return v;
+}
+
+// If v starts with tag, return true and leave the remainder in *rest
+static bool view_tag(str_view_t v, const char *tag, str_view_t *rest) {
+    size_t tag_len = strlen(tag);
+    if (v.len < tag_len || memcmp(v.p, tag, tag_len) != 0) return false;
+    rest->p = v.p + tag_len;
+    rest->len = v.len - tag_len;
+    return true;
+}
+
+static bool view_eq(str_view_t v, const char *s) {
+    return v.len == strlen(s) && memcmp(v.p, s, v.len) == 0;
+}
+
+// Numbers are converted from a bounded copy so parsing never reads past the view
+static double view_double(str_view_t v) {
+    char tmp[64];
+    size_t n = v.len < sizeof(tmp) - 1 ? v.len : sizeof(tmp) - 1;
+    memcpy(tmp, v.p, n);
+    tmp[n] = '\0';
+    return atof(tmp);
+}
+
+static long view_long(str_view_t v) {
+    return (long)view_double(v);
+}
+
+// ISO 8601 date and time as in #EXT-X-PROGRAM-DATE-TIME
+// (2024-05-01T12:00:00.123Z, or with a +hh:mm offset) in Unix seconds, 0
+// when malformed
+static double view_date_time(str_view_t v) {
+    char tmp[64];
+    size_t n = v.len < sizeof(tmp) - 1 ? v.len : sizeof(tmp) - 1;
+    memcpy(tmp, v.p, n);
+    tmp[n] = '\0';
+    int year, month, day, hour, minute, used = 0;
+    double second;
+    if (sscanf(tmp, "%4d-%2d-%2dT%2d:%2d:%lf%n", &year, &month, &day, &hour, &minute, &second, &used) < 6 ||
+        month < 1 || month > 12)
+        return 0.0;
+    const char *zone = tmp + used;
+    int offset = 0;
+    if (*zone == '+' || *zone == '-') {
+        int zone_hours = 0, zone_minutes = 0;
+        sscanf(zone + 1, zone[3] == ':' ? "%2d:%2d" : "%2d%2d", &zone_hours, &zone_minutes);
+        offset = (zone_hours * 60 + zone_minutes) * 60 * (*zone == '-' ? -1 : 1);
+    }
+    // Days since 1970-01-01 of the (proleptic Gregorian) date
+    long y = year - (month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long year_of_era = y - era * 400;
+    long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    long days = era * 146097 + day_of_era - 719468;
+    return (double)days * 86400.0 + hour * 3600.0 + minute * 60.0 + second - offset;
+}
+
+// Strings are packed without alignment
+static char *view_dup(memory_pool_t *arena, str_view_t v) {
+    return pool_strndup(arena, v.p, v.len);
+}
+
+// Find NAME in an attribute list (NAME=value,NAME="quoted value",...).
+// On success *value holds the value with any quotes stripped.
+static bool attr_find(str_view_t attrs, const char *name, str_view_t *value) {
+    size_t name_len = strlen(name);
+    const char *p = attrs.p;
+    const char *end = attrs.p + attrs.len;
+    while (p < end) {
+        const char *eq = memchr(p, '=', (size_t)(end - p));
+        if (!eq) return false;
+        const char *v = eq + 1;
+        const char *v_end;
+        if (v < end && *v == '"') {
+            v++;
+            v_end = memchr(v, '"', (size_t)(end - v));
+            if (!v_end) v_end = end;
+        } else {
+            v_end = memchr(v, ',', (size_t)(end - v));
+            if (!v_end) v_end = end;
         }
-        char *new_data = realloc(buf->data, new_capacity);
-        if (!new_data) return 0;
-        buf->data = new_data;
-        buf->capacity = new_capacity;
+        if ((size_t)(eq - p) == name_len && memcmp(p, name, name_len) == 0) {
+            value->p = v;
+            value->len = (size_t)(v_end - v);
+            return true;
+        }
+        p = v_end;
+        if (p < end && *p == '"') p++;
+        if (p < end && *p == ',') p++;
     }
+    return false;
+}
 
-    memcpy(buf->data + buf->size, contents, realsize);
-    buf->size += realsize;
-    buf->data[buf->size] = '\0';
+static double attr_double(str_view_t attrs, const char *name) {
+    str_view_t v;
+    return attr_find(attrs, name, &v) ? view_double(v) : 0.0;
+}
 
-    return realsize;
+static bool attr_is_yes(str_view_t attrs, const char *name) {
+    str_view_t v;
+    return attr_find(attrs, name, &v) && view_eq(v, "YES");
 }
 
-// Download URL to buffer (internal function)
-static hls_error_t download_url(hls_demuxer_t *demuxer, const char *url, struct hls_buffer *buf) {
-    CURL *curl;
-    CURLcode res;
-    
-    curl = curl_easy_init();
-    if (!curl) return HLS_ERROR_MEMORY;
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, buf);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, demuxer->user_agent);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, demuxer->timeout_ms);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    
-    res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        return HLS_ERROR_NETWORK;
+// Grow an entry array to hold at least one more element
+static bool reserve(void **array, size_t *capacity, size_t count, size_t elem_size) {
+    if (count < *capacity) return true;
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    void *temp = realloc(*array, new_capacity * elem_size);
+    if (!temp) return false;
+    *array = temp;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Record an #EXT-X-PART belonging to the segment whose URI comes next
+static hls_error_t add_part(hls_playlist_t *playlist, str_view_t attrs, int index) {
+    str_view_t uri, range;
+    if (!attr_find(attrs, "URI", &uri)) return HLS_OK;
+    // Byte-range parts are not fetched individually; the parent segment
+    // (or the next plain part) is used instead
+    if (attr_find(attrs, "BYTERANGE", &range)) return HLS_OK;
+    if (!reserve((void **)&playlist->parts, &playlist->part_capacity, playlist->part_count, sizeof(hls_part_t))) {
+        return HLS_ERROR_MEMORY;
     }
-    
+    hls_part_t *part = &playlist->parts[playlist->part_count];
+    part->url = view_dup(playlist->arena, uri);
+    if (!part->url) return HLS_ERROR_MEMORY;
+    part->duration = attr_double(attrs, "DURATION");
+    part->independent = attr_is_yes(attrs, "INDEPENDENT");
+    part->msn = playlist->media_sequence + (long)playlist->segment_count;
+    part->index = index;
+    playlist->part_count++;
     return HLS_OK;
 }
 
-// Trim whitespace from string
-static char* trim(char *str) {
-    char *end;
-    
-    // Trim leading space
-    while(isspace((unsigned char)*str)) str++;
-    
-    if(*str == 0) return str;
-    
-    // Trim trailing space
-    end = str + strlen(str) - 1;
-    while(end > str && isspace((unsigned char)*end)) end--;
-    
-    // Write new null terminator
-    *(end+1) = 0;
-    
-    return str;
+// Attributes of an #EXT-X-STREAM-INF waiting for its URI line
+typedef struct {
+    long bandwidth;
+    long average_bandwidth;
+    int width, height;
+    double frame_rate;
+    str_view_t codecs;
+    bool has_codecs;
+} pending_variant_t;
+
+static void parse_stream_inf(str_view_t attrs, pending_variant_t *v) {
+    str_view_t value;
+    memset(v, 0, sizeof(*v));
+    v->bandwidth = (long)attr_double(attrs, "BANDWIDTH");
+    v->average_bandwidth = (long)attr_double(attrs, "AVERAGE-BANDWIDTH");
+    v->frame_rate = attr_double(attrs, "FRAME-RATE");
+    if (attr_find(attrs, "RESOLUTION", &value)) {
+        v->width = (int)view_long(value);
+        const char *x = memchr(value.p, 'x', value.len);
+        if (x) {
+            str_view_t h = { x + 1, value.len - (size_t)(x + 1 - value.p) };
+            v->height = (int)view_long(h);
+        }
+    }
+    v->has_codecs = attr_find(attrs, "CODECS", &v->codecs);
 }
 
-// Parse playlist from memory
-hls_error_t hls_parse_playlist_from_memory(hls_demuxer_t *demuxer, const char *data, size_t len, const char *base_url, hls_playlist_t *playlist) {
+// Insert a variant keeping variants[] sorted by ascending bandwidth.
+// Renditions we cannot decode are dropped here so nobody downloads their
+// playlists.
+static hls_error_t add_variant(hls_playlist_t *playlist, const pending_variant_t *pv, str_view_t url) {
+    char *codecs = pv->has_codecs ? view_dup(playlist->arena, pv->codecs) : NULL;
+    if (pv->has_codecs && !codecs) return HLS_ERROR_MEMORY;
+    if (!hls_codecs_playable(codecs)) return HLS_OK;
+
+    if (!reserve((void **)&playlist->variants, &playlist->variant_capacity, playlist->variant_count, sizeof(hls_variant_t))) {
+        return HLS_ERROR_MEMORY;
+    }
+    hls_variant_t v;
+    v.url = view_dup(playlist->arena, url);
+    if (!v.url) return HLS_ERROR_MEMORY;
+    v.bandwidth = pv->bandwidth;
+    v.average_bandwidth = pv->average_bandwidth;
+    v.width = pv->width;
+    v.height = pv->height;
+    v.frame_rate = pv->frame_rate;
+    v.codecs = codecs;
+
+    size_t i = playlist->variant_count;
+    while (i > 0 && playlist->variants[i - 1].bandwidth > v.bandwidth) {
+        playlist->variants[i] = playlist->variants[i - 1];
+        i--;
+    }
+    playlist->variants[i] = v;
+    playlist->variant_count++;
+    return HLS_OK;
+}
+
+// Append a segment (prefetch entries always come after the regular ones).
+// *date_time is its program date-time (0 if unknown) and moves on to the
+// next segment's.
+static hls_error_t add_segment(hls_playlist_t *playlist, str_view_t url, double duration, bool is_prefetch,
+                               double *date_time) {
+    if (!reserve((void **)&playlist->segments, &playlist->segment_capacity, playlist->segment_count, sizeof(hls_segment_t))) {
+        return HLS_ERROR_MEMORY;
+    }
+
+    hls_segment_t *seg = &playlist->segments[playlist->segment_count];
+    memset(seg, 0, sizeof(hls_segment_t));
+    seg->url = view_dup(playlist->arena, url);
+    if (!seg->url) return HLS_ERROR_MEMORY;
+    seg->duration = duration;
+    seg->is_prefetch = is_prefetch;
+    seg->map_url = playlist->map_url;
+    seg->is_key_segment = playlist->encrypted;
+    seg->key_url = playlist->key_url;
+    seg->key_iv = playlist->key_iv;
+    seg->program_date_time = *date_time;
+    if (*date_time > 0.0) *date_time += duration;
+    playlist->segment_count++;
+    if (is_prefetch) playlist->prefetch_count++;
+    return HLS_OK;
+}
+
+// A string segments share (init section or key URI), copied once per run
+// of segments with the same one
+typedef struct {
+    const char *from;
+    char *to;
+} shared_copy_t;
+
+static bool copy_shared(memory_pool_t *arena, shared_copy_t *c, const char *from, char **to) {
+    if (from != c->from) {
+        c->from = from;
+        c->to = from ? pool_strndup(arena, from, strlen(from)) : NULL;
+        if (from && !c->to) return false;
+    }
+    *to = c->to;
+    return true;
+}
+
+// The segments an #EXT-X-SKIP of a delta update stands for, copied from
+// the previous playlist: they are the next `count` ones by media sequence
+// number, and must all be regular segments of it. Their strings are copied
+// into this playlist's arena.
+static hls_error_t add_skipped(hls_playlist_t *playlist, const hls_playlist_t *previous, long count,
+                               double *date_time) {
+    if (!previous || count < 0) return HLS_ERROR_PARSE;
+    long first = playlist->media_sequence + (long)playlist->segment_count - previous->media_sequence;
+    size_t listed = previous->segment_count - previous->prefetch_count;
+    if (first < 0 || (size_t)first + (size_t)count > listed) return HLS_ERROR_PARSE;
+
+    shared_copy_t map = { NULL, NULL }, key = { NULL, NULL }, iv = { NULL, NULL };
+    for (long i = 0; i < count; i++) {
+        const hls_segment_t *from = &previous->segments[first + i];
+        if (!reserve((void **)&playlist->segments, &playlist->segment_capacity, playlist->segment_count, sizeof(hls_segment_t))) {
+            return HLS_ERROR_MEMORY;
+        }
+        hls_segment_t *seg = &playlist->segments[playlist->segment_count];
+        memset(seg, 0, sizeof(hls_segment_t));
+        seg->url = pool_strndup(playlist->arena, from->url, strlen(from->url));
+        if (!seg->url || !copy_shared(playlist->arena, &map, from->map_url, &seg->map_url) ||
+            !copy_shared(playlist->arena, &key, from->key_url, &seg->key_url) ||
+            !copy_shared(playlist->arena, &iv, from->key_iv, &seg->key_iv)) {
+            return HLS_ERROR_MEMORY;
+        }
+        seg->is_key_segment = from->is_key_segment;
+        seg->duration = from->duration;
+        seg->program_date_time = from->program_date_time;
+        playlist->segment_count++;
+    }
+    // The tags the skipped segments had carry on to those listed after them
+    if (count > 0) {
+        const hls_segment_t *last = &playlist->segments[playlist->segment_count - 1];
+        playlist->map_url = last->map_url;
+        playlist->encrypted = last->is_key_segment;
+        playlist->key_url = last->key_url;
+        playlist->key_iv = last->key_iv;
+        if (last->program_date_time > 0.0) *date_time = last->program_date_time + last->duration;
+    }
+    return HLS_OK;
+}
+
+// Parse playlist from memory. The playlist is reset first, so the same
+// object can be reused for every reload. `previous` fills in an
+// #EXT-X-SKIP, which is a parse error without it.
+static hls_error_t parse_playlist(const char *data, size_t len, const char *base_url, const hls_playlist_t *previous,
+                                  hls_playlist_t *playlist) {
     if (!data || !playlist) return HLS_ERROR_PARSE;
+    hls_playlist_reset(playlist);
     
     if (base_url) {
-        playlist->base_url = strdup(base_url);
+        str_view_t base = { base_url, strlen(base_url) };
+        playlist->base_url = view_dup(playlist->arena, base);
+        if (!playlist->base_url) return HLS_ERROR_MEMORY;
     }
     
     const char *line = data;
+    const char *end = data + len;
     double current_duration = 0.0;
+    double date_time = 0.0;     // Program date-time of the next segment
+    int part_index = 0;  // Parts seen since the last segment URI
+    pending_variant_t pending_variant;
+    bool have_variant = false;  // #EXT-X-STREAM-INF waiting for its URI line
+    hls_error_t err = HLS_OK;
     
-    while (line < data + len) {
-        const char *next_line = strchr(line, '\n');
-        if (!next_line) next_line = data + len;
-        
-        size_t line_len = next_line - line;
-        char *line_copy = strndup(line, line_len);
-        if (!line_copy) return HLS_ERROR_MEMORY;
+    while (line < end && err == HLS_OK) {
+        const char *next_line = memchr(line, '\n', (size_t)(end - line));
+        if (!next_line) next_line = end;
+        str_view_t trimmed = view_trim(line, (size_t)(next_line - line));
+        str_view_t rest;
         
-        char *trimmed = trim(line_copy);
-        
-        if (strncmp(trimmed, "#EXTM3U", 7) == 0) {
+        if (view_tag(trimmed, "#EXTM3U", &rest)) {
             // Valid HLS playlist
-        } else if (strncmp(trimmed, "#EXT-X-STREAM-INF:", 18) == 0) {
+        } else if (view_tag(trimmed, "#EXT-X-STREAM-INF:", &rest)) {
             playlist->type = HLS_PLAYLIST_MASTER;
             // Next line should be variant URL
-        } else if (strncmp(trimmed, "#EXTINF:", 8) == 0) {
+            parse_stream_inf(rest, &pending_variant);
+            have_variant = true;
+        } else if (view_tag(trimmed, "#EXTINF:", &rest)) {
             playlist->type = HLS_PLAYLIST_MEDIA;
             // Parse duration
-            current_duration = atof(trimmed + 8);
-        } else if (strncmp(trimmed, "#EXT-X-TARGETDURATION:", 22) == 0) {
+            current_duration = view_double(rest);
+        } else if (view_tag(trimmed, "#EXT-X-TARGETDURATION:", &rest)) {
+            playlist->type = HLS_PLAYLIST_MEDIA;
+            playlist->target_duration = view_double(rest);
+        } else if (view_tag(trimmed, "#EXT-X-ENDLIST", &rest)) {
+            playlist->ended = true;
+        } else if (view_tag(trimmed, "#EXT-X-PROGRAM-DATE-TIME:", &rest)) {
+            date_time = view_date_time(rest);
+        } else if (view_tag(trimmed, "#EXT-X-MEDIA-SEQUENCE:", &rest)) {
             playlist->type = HLS_PLAYLIST_MEDIA;
-        } else if (strncmp(trimmed, "#EXT-X-MEDIA-SEQUENCE:", 22) == 0) {
+            playlist->media_sequence = view_long(rest);
+        } else if (view_tag(trimmed, "#EXT-X-PART-INF:", &rest)) {
+            playlist->part_target = attr_double(rest, "PART-TARGET");
+        } else if (view_tag(trimmed, "#EXT-X-SERVER-CONTROL:", &rest)) {
+            playlist->can_block_reload = attr_is_yes(rest, "CAN-BLOCK-RELOAD");
+            playlist->part_hold_back = attr_double(rest, "PART-HOLD-BACK");
+            playlist->can_skip_until = attr_double(rest, "CAN-SKIP-UNTIL");
+        } else if (view_tag(trimmed, "#EXT-X-SKIP:", &rest)) {
+            err = add_skipped(playlist, previous, (long)attr_double(rest, "SKIPPED-SEGMENTS"), &date_time);
+        } else if (view_tag(trimmed, "#EXT-X-PART:", &rest)) {
+            err = add_part(playlist, rest, part_index++);
+        } else if (view_tag(trimmed, "#EXT-X-TWITCH-PREFETCH:", &rest)) {
+            // Twitch lists the next segments before they are complete; the
+            // edge streams them while they are produced
             playlist->type = HLS_PLAYLIST_MEDIA;
-        } else if (trimmed[0] != '#' && strlen(trimmed) > 0) {
+            err = add_segment(playlist, view_trim(rest.p, rest.len), current_duration, true, &date_time);
+        } else if (view_tag(trimmed, "#EXT-X-MAP:", &rest)) {
+            // Init section for the segments that follow. Byte-range maps
+            // (single-file packaging) are not supported.
+            str_view_t uri, range;
+            playlist->map_url = NULL;
+            if (attr_find(rest, "URI", &uri) && !attr_find(rest, "BYTERANGE", &range)) {
+                playlist->map_url = view_dup(playlist->arena, uri);
+                if (!playlist->map_url) err = HLS_ERROR_MEMORY;
+            }
+        } else if (view_tag(trimmed, "#EXT-X-KEY:", &rest)) {
+            // Key for the segments that follow. AES-128 is decrypted as it
+            // downloads; other methods (SAMPLE-AES) leave the segments
+            // without a key URI. Keys for other KEYFORMATs are DRM systems
+            // listed next to the plain one, and are passed over.
+            str_view_t method, format, uri, iv;
+            if (!attr_find(rest, "KEYFORMAT", &format) || view_eq(format, "identity")) {
+                playlist->encrypted = attr_find(rest, "METHOD", &method) && !view_eq(method, "NONE");
+                playlist->key_url = NULL;
+                playlist->key_iv = NULL;
+                if (playlist->encrypted && view_eq(method, "AES-128") && attr_find(rest, "URI", &uri)) {
+                    bool has_iv = attr_find(rest, "IV", &iv);
+                    playlist->key_url = view_dup(playlist->arena, uri);
+                    if (has_iv) playlist->key_iv = view_dup(playlist->arena, iv);
+                    if (!playlist->key_url || (has_iv && !playlist->key_iv)) err = HLS_ERROR_MEMORY;
+                }
+            }
+        } else if (view_tag(trimmed, "#EXT-X-PRELOAD-HINT:", &rest)) {
+            str_view_t type, uri;
+            if (attr_find(rest, "TYPE", &type) && view_eq(type, "PART") && attr_find(rest, "URI", &uri)) {
+                playlist->preload_hint_url = view_dup(playlist->arena, uri);
+                if (!playlist->preload_hint_url) err = HLS_ERROR_MEMORY;
+            }
+        } else if (trimmed.len > 0 && trimmed.p[0] != '#') {
             // This is a segment URL
             if (playlist->type == HLS_PLAYLIST_MASTER) {
-                // Add to variants
-                playlist->variants = realloc(playlist->variants, (playlist->variant_count + 1) * sizeof(char*));
-                if (playlist->variants) {
-                    playlist->variants[playlist->variant_count] = strdup(trimmed);
-                    if (playlist->variants[playlist->variant_count]) {
-                        playlist->variant_count++;
-                    }
-                }
+                if (have_variant) err = add_variant(playlist, &pending_variant, trimmed);
+                have_variant = false;
             } else {
-                // Add to segments
-                if (playlist->segment_count >= playlist->segment_capacity) {
-                    playlist->segment_capacity *= 2;
-                    hls_segment_t *temp = realloc(playlist->segments, playlist->segment_capacity * sizeof(hls_segment_t));
-                    if (!temp) {
-                        free(line_copy);
-                        return HLS_ERROR_MEMORY;
-                    }
-                    playlist->segments = temp;
-                }
-                
-                hls_segment_t *seg = &playlist->segments[playlist->segment_count];
-                memset(seg, 0, sizeof(hls_segment_t));
-                seg->url = strdup(trimmed);
-                seg->duration = current_duration;
-                if (seg->url) {
-                    playlist->segment_count++;
-                }
+                err = add_segment(playlist, trimmed, current_duration, false, &date_time);
+                part_index = 0;
             }
         }
         
-        free(line_copy);
         line = next_line + 1;
     }
     
-    return HLS_OK;
+    return err;
+}
+
+hls_error_t hls_parse_playlist_from_memory(hls_demuxer_t *demuxer, const char *data, size_t len, const char *base_url, hls_playlist_t *playlist) {
+    (void)demuxer;
+    return parse_playlist(data, len, base_url, NULL, playlist);
+}
+
+hls_error_t hls_parse_playlist_delta(hls_demuxer_t *demuxer, const char *data, size_t len, const char *base_url,
+                                     const hls_playlist_t *previous, hls_playlist_t *playlist) {
+    (void)demuxer;
+    if (previous == playlist) return HLS_ERROR_PARSE;
+    return parse_playlist(data, len, base_url, previous, playlist);
 }
 
 // Parse playlist from URL
@@ -159,7 +433,7 @@ hls_error_t hls_parse_playlist(hls_demuxer_t *demuxer, const char *url, hls_play
     buf.data = malloc(buf.capacity);
     if (!buf.data) return HLS_ERROR_MEMORY;
     
-    hls_error_t err = download_url(demuxer, url, &buf);
+    hls_error_t err = hls_download_url(demuxer, url, &buf);
     if (err != HLS_OK) {
         free(buf.data);
         return err;
@@ -0,0 +1,240 @@
+#include "hls_internal.h"
+#include <curl/curl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// Ranged segment downloads. Where one TCP connection to the CDN tops out
+// below the stream's bitrate, a segment takes longer to fetch than to play;
+// several connections, each bringing a byte range, add up to what the path
+// carries. The first range, HLS_RANGE_FIRST bytes, is asked for alone: its
+// Content-Range tells the segment size, the slot is reserved for all of it
+// and the rest is split between the other connections as soon as that
+// response starts. Every range is written straight to its place in the
+// slot, and the prefix that is complete is published as it grows, so a
+// streaming consumer reads the start while the rest is still arriving.
+
+#define HLS_RANGE_FIRST    (256 * 1024)   // First range, also the smallest part
+#define HLS_RANGE_POLL_MS  100
+
+typedef struct range_transfer range_transfer_t;
+
+typedef struct {
+    range_transfer_t *t;
+    CURL *curl;
+    size_t start, length;       // Range within the segment
+    size_t filled;
+    int checked;                // Response looked at
+    long long content_start;    // Content-Range of the response, -1 = none
+    long long content_total;
+} range_part_t;
+
+struct range_transfer {
+    hls_queue_slot_t *slot;
+    size_t base;                // Slot bytes before the segment (its init section)
+    size_t total;               // Segment size, 0 = not known yet
+    int whole;                  // The first response is the whole segment
+    range_part_t parts[HLS_RANGE_MAX_PARTS + 1];
+    size_t count;
+};
+
+void hls_ranged_clear(hls_ranged_t *r) {
+    for (size_t i = 0; i < HLS_RANGE_MAX_PARTS + 1; i++) {
+        if (r->handles[i]) curl_easy_cleanup((CURL *)r->handles[i]);
+        r->handles[i] = NULL;
+    }
+    if (r->multi) curl_multi_cleanup((CURLM *)r->multi);
+    r->multi = NULL;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// "Content-Range: bytes <first>-<last>/<total>" of the final response
+static size_t part_header_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+    size_t len = size * nitems;
+    range_part_t *p = (range_part_t *)userdata;
+    static const char name[] = "Content-Range:";
+    if (len >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        p->content_start = p->content_total = -1;
+    } else if (len > sizeof(name) - 1 && strncasecmp(buffer, name, sizeof(name) - 1) == 0) {
+        char line[128];
+        size_t n = len < sizeof(line) ? len : sizeof(line) - 1;
+        memcpy(line, buffer, n);
+        line[n] = '\0';
+        long long first, last, total;
+        if (sscanf(line + sizeof(name) - 1, " bytes %lld-%lld/%lld", &first, &last, &total) == 3 &&
+            first >= 0 && last >= first && total > last) {
+            p->content_start = first;
+            p->content_total = total;
+        }
+    }
+    return len;
+}
+
+// At a part's first bytes: is this the range asked for? The first one
+// also sizes the segment, or turns out to be all of it.
+static int part_check(range_part_t *p) {
+    range_transfer_t *t = p->t;
+    p->checked = 1;
+    long code = 0;
+    curl_easy_getinfo(p->curl, CURLINFO_RESPONSE_CODE, &code);
+    int ranged = code == 206 && p->content_start == (long long)p->start;
+    if (p == &t->parts[0]) {
+        if (!ranged || p->content_total <= 0) {
+            // No ranges from this server: one plain download
+            t->whole = 1;
+            return 0;
+        }
+        t->total = (size_t)p->content_total;
+        if (p->length > t->total) p->length = t->total;
+        return hls_queue_reserve(t->slot, t->base + t->total);
+    }
+    return ranged && p->content_total == (long long)t->total ? 0 : -1;
+}
+
+static size_t part_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    range_part_t *p = (range_part_t *)userp;
+    range_transfer_t *t = p->t;
+    size_t realsize = size * nmemb;
+    if (!p->checked && part_check(p) != 0) return 0;
+    if (t->whole) return hls_queue_append(t->slot, contents, realsize) == 0 ? realsize : 0;
+    // Past the end of the reserve would be more than was asked for
+    if (realsize > p->length - p->filled) return 0;
+    memcpy(t->slot->buf.data + t->base + p->start + p->filled, contents, realsize);
+    p->filled += realsize;
+    return realsize;
+}
+
+static int part_start(hls_demuxer_t *demuxer, hls_ranged_t *r, range_transfer_t *t, const char *url,
+                      size_t start, size_t length) {
+    size_t i = t->count;
+    if (!r->handles[i] && !(r->handles[i] = hls_easy_handle(demuxer))) return -1;
+    range_part_t *p = &t->parts[i];
+    p->t = t;
+    p->curl = (CURL *)r->handles[i];
+    p->start = start;
+    p->length = length;
+    p->content_start = p->content_total = -1;
+
+    char range[64];
+    snprintf(range, sizeof(range), "%zu-%zu", start, start + length - 1);
+    curl_easy_setopt(p->curl, CURLOPT_URL, url);
+    curl_easy_setopt(p->curl, CURLOPT_RANGE, range);
+    curl_easy_setopt(p->curl, CURLOPT_WRITEFUNCTION, part_write_callback);
+    curl_easy_setopt(p->curl, CURLOPT_WRITEDATA, p);
+    curl_easy_setopt(p->curl, CURLOPT_HEADERFUNCTION, part_header_callback);
+    curl_easy_setopt(p->curl, CURLOPT_HEADERDATA, p);
+    curl_easy_setopt(p->curl, CURLOPT_USERAGENT, demuxer->user_agent);
+    curl_easy_setopt(p->curl, CURLOPT_TIMEOUT_MS, demuxer->timeout_ms);
+    if (curl_multi_add_handle((CURLM *)r->multi, p->curl) != CURLM_OK) return -1;
+    t->count++;
+    return 0;
+}
+
+// The rest of the segment after the first range, in parts of at least
+// HLS_RANGE_FIRST bytes
+static int split_rest(hls_demuxer_t *demuxer, hls_ranged_t *r, range_transfer_t *t, const char *url,
+                      size_t parts) {
+    size_t offset = t->parts[0].length;
+    size_t rest = t->total - offset;
+    if (rest == 0) return 0;
+    size_t n = (rest + HLS_RANGE_FIRST - 1) / HLS_RANGE_FIRST;
+    if (n > parts) n = parts;
+    size_t part_size = (rest + n - 1) / n;
+    while (offset < t->total) {
+        size_t length = t->total - offset < part_size ? t->total - offset : part_size;
+        if (part_start(demuxer, r, t, url, offset, length) != 0) return -1;
+        offset += length;
+    }
+    return 0;
+}
+
+// Publish the complete prefix: the parts are in segment order
+static void publish(range_transfer_t *t) {
+    if (t->whole || t->total == 0) return;
+    size_t end = 0;
+    for (size_t i = 0; i < t->count; i++) {
+        end = t->parts[i].start + t->parts[i].filled;
+        if (t->parts[i].filled < t->parts[i].length) break;
+    }
+    if (t->base + end > t->slot->buf.size) hls_queue_publish(t->slot, t->base + end);
+}
+
+static double part_bps(const range_part_t *p) {
+    curl_off_t size = 0, usec = 0;
+    curl_easy_getinfo(p->curl, CURLINFO_SIZE_DOWNLOAD_T, &size);
+    curl_easy_getinfo(p->curl, CURLINFO_TOTAL_TIME_T, &usec);
+    return usec > 0 ? (double)size * 8.0 * 1000000.0 / (double)usec : 0.0;
+}
+
+hls_error_t hls_download_ranged(hls_demuxer_t *demuxer, hls_ranged_t *r, const char *url,
+                                hls_queue_slot_t *slot, size_t parts, hls_transfer_t *transfer) {
+    if (parts > HLS_RANGE_MAX_PARTS) parts = HLS_RANGE_MAX_PARTS;
+    if (!r->multi) {
+        if (!(r->multi = curl_multi_init())) return HLS_ERROR_MEMORY;
+        // One connection per range, even where HTTP/2 could multiplex them
+        // over one: that one connection is what is too slow
+        curl_multi_setopt((CURLM *)r->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_NOTHING);
+    }
+    CURLM *multi = (CURLM *)r->multi;
+
+    range_transfer_t t;
+    memset(&t, 0, sizeof(t));
+    t.slot = slot;
+    t.base = slot->buf.size;
+    uint64_t start_us = now_us();
+    int failed = part_start(demuxer, r, &t, url, 0, HLS_RANGE_FIRST) != 0;
+    int split = 0, running = !failed;
+    while (running && !failed) {
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            failed = 1;
+            break;
+        }
+        CURLMsg *msg;
+        int queued;
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            if (msg->msg == CURLMSG_DONE && msg->data.result != CURLE_OK) failed = 1;
+        }
+        if (!split && t.total > 0 && !failed) {
+            split = 1;
+            if (split_rest(demuxer, r, &t, url, parts) != 0) failed = 1;
+            running = 1;
+            continue;
+        }
+        publish(&t);
+        if (running) curl_multi_poll(multi, NULL, 0, HLS_RANGE_POLL_MS, NULL);
+    }
+    double seconds = (double)(now_us() - start_us) / 1000000.0;
+
+    // Every range all there, or the segment failed
+    size_t bytes = slot->buf.size - t.base;
+    if (!failed && !t.whole) {
+        bytes = 0;
+        for (size_t i = 0; i < t.count; i++) {
+            if (t.parts[i].filled != t.parts[i].length) failed = 1;
+            bytes += t.parts[i].filled;
+        }
+    }
+    transfer->bytes = (double)bytes;
+    transfer->seconds = seconds;
+    transfer->connection_bps = 0.0;
+    for (size_t i = 0; i < t.count; i++) {
+        // The first range is short enough for its request's round trip to
+        // count against it; it only speaks for the connection on its own
+        if (i == 0 && t.count > 1) continue;
+        double bps = part_bps(&t.parts[i]);
+        if (bps > transfer->connection_bps) transfer->connection_bps = bps;
+    }
+    for (size_t i = 0; i < t.count; i++) {
+        curl_multi_remove_handle(multi, t.parts[i].curl);
+    }
+    if (failed) return HLS_ERROR_NETWORK;
+    publish(&t);
+    return HLS_OK;
+}
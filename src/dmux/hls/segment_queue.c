@@ -0,0 +1,263 @@
+#include "hls_internal.h"
+#include "../../../include/big_alloc.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// Bounded ring of downloaded segments shared by the fetcher thread (producer)
+// and the thread running hls_process_stream() (consumer). Slot buffers keep
+// their capacity between segments so steady-state playback does not allocate.
+//
+// A slot is published as soon as its download starts and fills while the
+// transfer runs, so a streaming consumer can read behind the writer. The
+// writer only reallocates a slot while no reader is inside it.
+
+static size_t slot_index(const hls_segment_queue_t *q, size_t n) {
+    return (q->head + n) % q->depth;
+}
+
+int hls_queue_init(hls_segment_queue_t *q, size_t depth, size_t max_bytes) {
+    memset(q, 0, sizeof(*q));
+    if (depth == 0) depth = 1;
+    q->slots = calloc(depth, sizeof(*q->slots));
+    if (!q->slots) return -1;
+    q->depth = depth;
+    q->max_bytes = max_bytes;
+    atomic_init(&q->stopped, 0);
+    atomic_init(&q->jump_live, 0);
+    atomic_init(&q->skip_to_msn, -1);
+    atomic_init(&q->live_end_msn, -1);
+    atomic_init(&q->segment_us, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    return 0;
+}
+
+void hls_queue_destroy(hls_segment_queue_t *q) {
+    if (!q->slots) return;
+    for (size_t i = 0; i < q->depth; i++) {
+        big_free(q->slots[i].buf.data);
+    }
+    free(q->slots);
+    q->slots = NULL;
+    pthread_cond_destroy(&q->changed);
+    pthread_mutex_destroy(&q->lock);
+}
+
+// Segments queued at most: the depth, or under memory pressure the one
+// being played and the next (big_alloc.h)
+static size_t queue_limit(const hls_segment_queue_t *q) {
+    if (q->depth > 2 && big_alloc_pressure() >= BIG_PRESSURE_PREFETCH) return 2;
+    return q->depth;
+}
+
+// Producer: wait for a free slot (depth and byte cap permitting), reset it and
+// publish it to the consumer in the filling state. Returns NULL once the
+// consumer has stopped the queue.
+hls_queue_slot_t *hls_queue_begin(hls_segment_queue_t *q, int tag, long msn) {
+    pthread_mutex_lock(&q->lock);
+    while (!atomic_load(&q->stopped) &&
+           (q->count >= queue_limit(q) || (q->count > 0 && q->bytes_queued >= q->max_bytes))) {
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    hls_queue_slot_t *slot = NULL;
+    if (!atomic_load(&q->stopped)) {
+        slot = &q->slots[slot_index(q, q->count)];
+        slot->buf.size = 0;
+        slot->state = HLS_SLOT_FILLING;
+        slot->readers = 0;
+        slot->tag = tag;
+        slot->msn = msn;
+        slot->duration = 0.0;
+        slot->program_date_time = 0.0;
+        slot->downloaded_us = 0;
+        slot->queue = q;
+        q->count++;
+        pthread_cond_broadcast(&q->changed);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return slot;
+}
+
+// Producer: make room for `size` bytes in a filling slot. Returns 0 on
+// success.
+int hls_queue_reserve(hls_queue_slot_t *slot, size_t size) {
+    hls_segment_queue_t *q = slot->queue;
+    struct hls_buffer *buf = &slot->buf;
+    if (size + 1 <= buf->capacity) return 0;
+
+    size_t new_capacity = buf->capacity ? buf->capacity * 2 : 1024 * 1024;
+    while (new_capacity < size + 1) new_capacity *= 2;
+    // The consumer may be reading the filled prefix; only move the
+    // buffer once it has stepped out
+    pthread_mutex_lock(&q->lock);
+    while (slot->readers > 0 && !atomic_load(&q->stopped)) {
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    char *new_data = atomic_load(&q->stopped) ? NULL : big_realloc(buf->data, new_capacity);
+    if (new_data) {
+        buf->data = new_data;
+        buf->capacity = new_capacity;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return new_data ? 0 : -1;
+}
+
+// Producer: show the consumer the first `size` bytes of a filling slot,
+// written in place within its reserve
+void hls_queue_publish(hls_queue_slot_t *slot, size_t size) {
+    hls_segment_queue_t *q = slot->queue;
+    struct hls_buffer *buf = &slot->buf;
+    pthread_mutex_lock(&q->lock);
+    q->bytes_queued += size - buf->size;
+    buf->size = size;
+    buf->data[buf->size] = '\0';
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Producer: append downloaded bytes to a filling slot. Returns 0 on success.
+int hls_queue_append(hls_queue_slot_t *slot, const void *data, size_t size) {
+    struct hls_buffer *buf = &slot->buf;
+    if (hls_queue_reserve(slot, buf->size + size) != 0) return -1;
+    // Bytes past buf->size are invisible to the consumer until published
+    memcpy(buf->data + buf->size, data, size);
+    hls_queue_publish(slot, buf->size + size);
+    return 0;
+}
+
+// Producer: mark the filling slot complete (ok != 0) or failed
+void hls_queue_end(hls_queue_slot_t *slot, int ok) {
+    hls_segment_queue_t *q = slot->queue;
+    pthread_mutex_lock(&q->lock);
+    slot->state = (ok && slot->buf.size > 0) ? HLS_SLOT_COMPLETE : HLS_SLOT_FAILED;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Producer: no more segments will be published
+void hls_queue_close(hls_segment_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Consumer: wait until the oldest slot has data past `consumed` (at least
+// `align` bytes of it, unless the download has ended), or, with
+// whole_segment set, until the download has ended. Returns the slot with a
+// read reference held; *avail receives the readable byte count past
+// `consumed` and *state the slot state those bytes were sampled in.
+// Returns NULL when the queue is closed and drained, or stopped.
+hls_queue_slot_t *hls_queue_read(hls_segment_queue_t *q, size_t consumed, size_t align,
+                                 int whole_segment, size_t *avail, hls_slot_state_t *state) {
+    pthread_mutex_lock(&q->lock);
+    hls_queue_slot_t *slot = NULL;
+    while (!atomic_load(&q->stopped)) {
+        if (q->count == 0) {
+            if (q->closed) break;
+            pthread_cond_wait(&q->changed, &q->lock);
+            continue;
+        }
+        hls_queue_slot_t *head = &q->slots[q->head];
+        size_t ready = head->buf.size > consumed ? head->buf.size - consumed : 0;
+        if (head->state != HLS_SLOT_FILLING) {
+            slot = head;
+            *avail = ready;
+            break;
+        }
+        if (!whole_segment && align > 0 && ready >= align) {
+            slot = head;
+            *avail = ready - ready % align;
+            break;
+        }
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    if (slot) {
+        slot->readers++;
+        *state = slot->state;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return slot;
+}
+
+// Consumer: drop the read reference taken by hls_queue_read()
+void hls_queue_read_done(hls_queue_slot_t *slot) {
+    hls_segment_queue_t *q = slot->queue;
+    pthread_mutex_lock(&q->lock);
+    slot->readers--;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Consumer: done with the oldest slot (its download must have ended)
+void hls_queue_release(hls_segment_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        hls_queue_slot_t *slot = &q->slots[q->head];
+        q->bytes_queued -= slot->buf.size;
+        slot->state = HLS_SLOT_FREE;
+        // Under memory pressure played segments give their buffer back
+        // rather than keeping it for the next one
+        if (big_alloc_pressure() >= BIG_PRESSURE_PREFETCH) {
+            big_free(slot->buf.data);
+            slot->buf.data = NULL;
+            slot->buf.capacity = 0;
+        }
+        q->head = slot_index(q, 1);
+        q->count--;
+    }
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Consumer: abort the producer (wakes it from begin/append and from waits)
+void hls_queue_stop(hls_segment_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    atomic_store(&q->stopped, 1);
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Absolute CLOCK_REALTIME deadline usec from now, for pthread_cond_timedwait
+static void deadline_after(long usec, struct timespec *deadline) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += usec / 1000000;
+    deadline->tv_nsec += (usec % 1000000) * 1000;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+// Consumer: wait up to usec for the oldest slot's download to end. Returns 1
+// if it has, 0 on timeout, -1 once the queue is stopped or closed and drained.
+int hls_queue_wait_ended(hls_segment_queue_t *q, long usec) {
+    struct timespec deadline;
+    deadline_after(usec, &deadline);
+
+    pthread_mutex_lock(&q->lock);
+    int result = 0;
+    for (;;) {
+        if (atomic_load(&q->stopped) || (q->count == 0 && q->closed)) { result = -1; break; }
+        if (q->count > 0 && q->slots[q->head].state != HLS_SLOT_FILLING) { result = 1; break; }
+        if (pthread_cond_timedwait(&q->changed, &q->lock, &deadline) == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return result;
+}
+
+// Producer: sleep up to usec, returning non-zero early if the queue was stopped
+int hls_queue_wait_stopped(hls_segment_queue_t *q, long usec) {
+    struct timespec deadline;
+    deadline_after(usec, &deadline);
+
+    pthread_mutex_lock(&q->lock);
+    int rc = 0;
+    while (!atomic_load(&q->stopped) && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&q->changed, &q->lock, &deadline);
+    }
+    int stopped = atomic_load(&q->stopped);
+    pthread_mutex_unlock(&q->lock);
+    return stopped;
+}
@@ -0,0 +1,200 @@
+#include "hls_internal.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+// Timeshift ring: finished segments are copied into a fixed-size file that
+// is mapped shared, so the history lives in the page cache rather than the
+// heap and the kernel decides what stays resident. Segments are laid out
+// back to back and wrap to the start when the next one does not fit; the
+// index is ordered by media sequence number, oldest first.
+//
+// Only the consumer thread stores and reads segments. The lock covers the
+// playback controls, which may be called from any thread.
+
+#define HLS_TS_DEFAULT_DURATION 2.0  // Assumed length of a segment with no EXTINF
+
+int hls_timeshift_init(hls_timeshift_t *ts, const char *dir, size_t bytes) {
+    memset(ts, 0, sizeof(*ts));
+    ts->fd = -1;
+    ts->play_msn = -1;
+    ts->last_msn = -1;
+    pthread_mutex_init(&ts->lock, NULL);
+    if (bytes == 0) return 0;
+
+    // An unlinked file: nothing to clean up after a crash. /var/tmp rather
+    // than /tmp, which is often tmpfs and would put the ring back in RAM.
+    if (!dir) dir = getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/var/tmp";
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/anhelo-timeshift-XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (ftruncate(fd, (off_t)bytes) != 0) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    ts->fd = fd;
+    ts->map = map;
+    ts->size = bytes;
+    return 0;
+}
+
+void hls_timeshift_destroy(hls_timeshift_t *ts) {
+    if (ts->map) munmap(ts->map, ts->size);
+    if (ts->fd >= 0) close(ts->fd);
+    free(ts->entries);
+    ts->map = NULL;
+    ts->entries = NULL;
+    ts->fd = -1;
+    pthread_mutex_destroy(&ts->lock);
+}
+
+static hls_timeshift_entry_t *entry_at(hls_timeshift_t *ts, size_t n) {
+    return &ts->entries[(ts->first + n) % ts->capacity];
+}
+
+static void drop_oldest(hls_timeshift_t *ts) {
+    ts->first = (ts->first + 1) % ts->capacity;
+    ts->count--;
+}
+
+// Consumer: copy a finished segment into the ring, evicting whatever it
+// overwrites. Segments larger than the ring are not kept.
+void hls_timeshift_store(hls_timeshift_t *ts, long msn, double duration, const void *data, size_t size) {
+    if (!ts->map || size == 0 || size > ts->size) return;
+    pthread_mutex_lock(&ts->lock);
+    // A rendition switch or rejoin can restart the numbering; history
+    // that no longer lines up is dropped
+    if (ts->count > 0 && msn <= entry_at(ts, ts->count - 1)->msn) ts->count = 0;
+
+    if (ts->count == ts->capacity) {
+        size_t capacity = ts->capacity ? ts->capacity * 2 : 64;
+        hls_timeshift_entry_t *entries = malloc(capacity * sizeof(*entries));
+        if (!entries) {
+            pthread_mutex_unlock(&ts->lock);
+            return;
+        }
+        for (size_t i = 0; i < ts->count; i++) entries[i] = *entry_at(ts, i);
+        free(ts->entries);
+        ts->entries = entries;
+        ts->capacity = capacity;
+        ts->first = 0;
+    }
+
+    size_t offset = ts->write_pos;
+    if (offset + size > ts->size) {
+        // Wrap: the oldest entries sit in the tail that is skipped
+        offset = 0;
+        while (ts->count > 0 && entry_at(ts, 0)->offset >= ts->write_pos) drop_oldest(ts);
+    }
+    while (ts->count > 0) {
+        const hls_timeshift_entry_t *oldest = entry_at(ts, 0);
+        if (oldest->offset >= offset + size || oldest->offset + oldest->size <= offset) break;
+        drop_oldest(ts);
+    }
+    memcpy(ts->map + offset, data, size);
+    hls_timeshift_entry_t *e = entry_at(ts, ts->count++);
+    e->msn = msn;
+    e->offset = offset;
+    e->size = size;
+    e->duration = duration > 0.0 ? duration : HLS_TS_DEFAULT_DURATION;
+    ts->write_pos = offset + size;
+    pthread_mutex_unlock(&ts->lock);
+}
+
+// Consumer: a live segment was just delivered
+void hls_timeshift_played(hls_timeshift_t *ts, long msn) {
+    pthread_mutex_lock(&ts->lock);
+    ts->last_msn = msn;
+    pthread_mutex_unlock(&ts->lock);
+}
+
+// Consumer, at a segment boundary: non-zero while playback is paused.
+// Pausing live playback pins the position to the segment after the last
+// one delivered, so it resumes from the recording.
+int hls_timeshift_paused(hls_timeshift_t *ts) {
+    pthread_mutex_lock(&ts->lock);
+    if (ts->paused && ts->play_msn < 0 && ts->last_msn >= 0) ts->play_msn = ts->last_msn + 1;
+    int paused = ts->paused;
+    pthread_mutex_unlock(&ts->lock);
+    return paused;
+}
+
+// Consumer, at a segment boundary: non-zero while playing from the recording
+int hls_timeshift_shifted(hls_timeshift_t *ts) {
+    pthread_mutex_lock(&ts->lock);
+    int shifted = ts->play_msn >= 0;
+    pthread_mutex_unlock(&ts->lock);
+    return shifted;
+}
+
+// Consumer, at a segment boundary: the recorded segment to play next, or
+// NULL to play live. *data points into the mapping and stays valid until
+// the next hls_timeshift_store(). Reaching the newest recording returns to
+// live playback.
+const hls_timeshift_entry_t *hls_timeshift_next(hls_timeshift_t *ts, const unsigned char **data) {
+    const hls_timeshift_entry_t *e = NULL;
+    pthread_mutex_lock(&ts->lock);
+    if (ts->play_msn >= 0) {
+        for (size_t i = 0; i < ts->count; i++) {
+            // The oldest entry at or after the position; anything older has
+            // been overwritten since
+            if (entry_at(ts, i)->msn >= ts->play_msn) {
+                e = entry_at(ts, i);
+                break;
+            }
+        }
+        if (e) {
+            ts->play_msn = e->msn + 1;
+            ts->last_msn = e->msn;
+            *data = ts->map + e->offset;
+        } else {
+            ts->play_msn = -1;
+        }
+    }
+    pthread_mutex_unlock(&ts->lock);
+    return e;
+}
+
+void hls_timeshift_set_paused(hls_timeshift_t *ts, int paused) {
+    pthread_mutex_lock(&ts->lock);
+    ts->paused = paused;
+    pthread_mutex_unlock(&ts->lock);
+}
+
+// Start playback `seconds` before the end of the recording; 0 returns to live
+void hls_timeshift_seek(hls_timeshift_t *ts, double seconds) {
+    pthread_mutex_lock(&ts->lock);
+    if (seconds <= 0.0 || ts->count == 0) {
+        ts->play_msn = -1;
+    } else {
+        size_t i = ts->count;
+        double behind = 0.0;
+        while (i > 0 && behind < seconds) behind += entry_at(ts, --i)->duration;
+        ts->play_msn = entry_at(ts, i)->msn;
+    }
+    pthread_mutex_unlock(&ts->lock);
+}
+
+// Seconds of recording between the playback position and the newest segment
+double hls_timeshift_delay(hls_timeshift_t *ts) {
+    double delay = 0.0;
+    pthread_mutex_lock(&ts->lock);
+    if (ts->play_msn >= 0) {
+        for (size_t i = 0; i < ts->count; i++) {
+            if (entry_at(ts, i)->msn >= ts->play_msn) delay += entry_at(ts, i)->duration;
+        }
+    }
+    pthread_mutex_unlock(&ts->lock);
+    return delay;
+}
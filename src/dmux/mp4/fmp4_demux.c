@@ -0,0 +1,363 @@
+#include "../../../include/fmp4_demux.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Fragmented MP4 / CMAF demuxer: reads the first H.264 video track from the
+// init section (moov) and walks each moof's track runs, handing the samples
+// to the callback where they sit in the following mdat. Nothing is copied
+// except the avcC parameter sets.
+
+#define FOURCC(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+// tfhd flags
+#define TFHD_BASE_DATA_OFFSET       0x000001
+#define TFHD_SAMPLE_DESCRIPTION     0x000002
+#define TFHD_DEFAULT_DURATION       0x000008
+#define TFHD_DEFAULT_SIZE           0x000010
+#define TFHD_DEFAULT_FLAGS          0x000020
+// trun flags
+#define TRUN_DATA_OFFSET            0x000001
+#define TRUN_FIRST_SAMPLE_FLAGS     0x000004
+#define TRUN_SAMPLE_DURATION        0x000100
+#define TRUN_SAMPLE_SIZE            0x000200
+#define TRUN_SAMPLE_FLAGS           0x000400
+#define TRUN_SAMPLE_CTS             0x000800
+// sample_flags: sample_is_non_sync_sample
+#define SAMPLE_NON_SYNC             0x00010000
+
+#define VISUAL_SAMPLE_ENTRY_SIZE    78  // Fixed fields before an avc1 entry's child boxes
+
+struct fmp4_demux {
+    fmp4_sample_callback_t callback;
+    void *user_data;
+
+    uint32_t track_id;          // 0 until a moov named an H.264 track
+    uint32_t timescale;
+    int nal_length_size;
+    // trex defaults for the track
+    uint32_t default_duration, default_size, default_flags;
+    int64_t next_dts;           // Decode time after the last fragment (for moofs without tfdt)
+
+    uint8_t *avcc;              // Last avcC seen, to notice init section changes
+    size_t avcc_size;
+    uint8_t *config;            // Its SPS/PPS with 4-byte length prefixes
+    size_t config_size;
+};
+
+// One box: payload view plus its type
+typedef struct {
+    uint32_t type;
+    const uint8_t *start;       // Box header
+    const uint8_t *data;        // Payload
+    size_t size;                // Payload size
+} box_t;
+
+static uint16_t rd16(const uint8_t *p) { return (uint16_t)((p[0] << 8) | p[1]); }
+static uint32_t rd32(const uint8_t *p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+static uint64_t rd64(const uint8_t *p) { return ((uint64_t)rd32(p) << 32) | rd32(p + 4); }
+
+// Read the box at *p and advance past it. False at the end of the buffer or
+// on a box that claims more bytes than there are.
+static bool next_box(const uint8_t **p, const uint8_t *end, box_t *box) {
+    if (end - *p < 8) return false;
+    uint64_t size = rd32(*p);
+    size_t header = 8;
+    box->type = rd32(*p + 4);
+    if (size == 1) {
+        if (end - *p < 16) return false;
+        size = rd64(*p + 8);
+        header = 16;
+    } else if (size == 0) {
+        size = (uint64_t)(end - *p);  // Extends to the end of the buffer
+    }
+    if (size < header || size > (uint64_t)(end - *p)) return false;
+    box->start = *p;
+    box->data = *p + header;
+    box->size = (size_t)size - header;
+    *p += size;
+    return true;
+}
+
+// First child of the given type
+static bool find_box(const uint8_t *data, size_t size, uint32_t type, box_t *out) {
+    const uint8_t *p = data;
+    while (next_box(&p, data + size, out)) {
+        if (out->type == type) return true;
+    }
+    return false;
+}
+
+static bool find_path(const uint8_t *data, size_t size, const uint32_t *types, int count, box_t *out) {
+    for (int i = 0; i < count; i++) {
+        if (!find_box(data, size, types[i], out)) return false;
+        data = out->data;
+        size = out->size;
+    }
+    return true;
+}
+
+fmp4_demux_t *fmp4_demux_create(fmp4_sample_callback_t callback, void *user_data) {
+    fmp4_demux_t *mp4 = calloc(1, sizeof(*mp4));
+    if (!mp4) return NULL;
+    mp4->callback = callback;
+    mp4->user_data = user_data;
+    return mp4;
+}
+
+void fmp4_demux_destroy(fmp4_demux_t *mp4) {
+    if (!mp4) return;
+    free(mp4->avcc);
+    free(mp4->config);
+    free(mp4);
+}
+
+bool fmp4_probe(const uint8_t *data, size_t size) {
+    if (size < 8) return false;
+    uint32_t type = rd32(data + 4);
+    return type == FOURCC('f', 't', 'y', 'p') || type == FOURCC('s', 't', 'y', 'p') ||
+           type == FOURCC('m', 'o', 'o', 'v') || type == FOURCC('m', 'o', 'o', 'f') ||
+           type == FOURCC('s', 'i', 'd', 'x') || type == FOURCC('e', 'm', 's', 'g');
+}
+
+// Re-frame avcC's SPS and PPS lists as 4-byte length-prefixed NAL units
+static bool avcc_to_config(fmp4_demux_t *mp4, const uint8_t *avcc, size_t size) {
+    if (size < 7) return false;
+    // Each 2-byte length grows to 4 bytes, so the output is at most twice the input
+    uint8_t *config = malloc(2 * size);
+    if (!config) return false;
+    size_t out = 0;
+    const uint8_t *p = avcc + 5;
+    const uint8_t *end = avcc + size;
+    for (int list = 0; list < 2 && p < end; list++) {
+        // numOfSequenceParameterSets (low 5 bits), then numOfPictureParameterSets
+        int count = list == 0 ? (*p++ & 0x1F) : *p++;
+        for (int i = 0; i < count; i++) {
+            if (end - p < 2) break;
+            size_t len = rd16(p);
+            p += 2;
+            if (len > (size_t)(end - p) ) break;
+            config[out++] = (uint8_t)(len >> 24);
+            config[out++] = (uint8_t)(len >> 16);
+            config[out++] = (uint8_t)(len >> 8);
+            config[out++] = (uint8_t)len;
+            memcpy(config + out, p, len);
+            out += len;
+            p += len;
+        }
+    }
+    free(mp4->config);
+    mp4->config = config;
+    mp4->config_size = out;
+    mp4->nal_length_size = (avcc[4] & 0x3) + 1;
+    return true;
+}
+
+// Track id, timescale and avcC of an H.264 video trak, if it is one
+static bool parse_trak(const box_t *trak, uint32_t *track_id, uint32_t *timescale, box_t *avcc) {
+    box_t box;
+    if (!find_box(trak->data, trak->size, FOURCC('t', 'k', 'h', 'd'), &box) || box.size < 4) return false;
+    size_t id_at = box.data[0] == 1 ? 4 + 16 : 4 + 8;  // After creation/modification times
+    if (box.size < id_at + 4) return false;
+    *track_id = rd32(box.data + id_at);
+
+    static const uint32_t hdlr_path[] = { FOURCC('m', 'd', 'i', 'a'), FOURCC('h', 'd', 'l', 'r') };
+    if (!find_path(trak->data, trak->size, hdlr_path, 2, &box) || box.size < 12 ||
+        rd32(box.data + 8) != FOURCC('v', 'i', 'd', 'e')) {
+        return false;
+    }
+
+    static const uint32_t mdhd_path[] = { FOURCC('m', 'd', 'i', 'a'), FOURCC('m', 'd', 'h', 'd') };
+    if (!find_path(trak->data, trak->size, mdhd_path, 2, &box) || box.size < 4) return false;
+    size_t scale_at = box.data[0] == 1 ? 4 + 16 : 4 + 8;
+    if (box.size < scale_at + 4) return false;
+    *timescale = rd32(box.data + scale_at);
+    if (*timescale == 0) return false;
+
+    static const uint32_t stsd_path[] = {
+        FOURCC('m', 'd', 'i', 'a'), FOURCC('m', 'i', 'n', 'f'), FOURCC('s', 't', 'b', 'l'), FOURCC('s', 't', 's', 'd')
+    };
+    if (!find_path(trak->data, trak->size, stsd_path, 4, &box) || box.size < 8) return false;
+    // Sample entries follow the full box header and entry_count
+    const uint8_t *p = box.data + 8;
+    const uint8_t *end = box.data + box.size;
+    box_t entry;
+    while (next_box(&p, end, &entry)) {
+        if (entry.type != FOURCC('a', 'v', 'c', '1') && entry.type != FOURCC('a', 'v', 'c', '3')) continue;
+        if (entry.size < VISUAL_SAMPLE_ENTRY_SIZE) continue;
+        if (find_box(entry.data + VISUAL_SAMPLE_ENTRY_SIZE, entry.size - VISUAL_SAMPLE_ENTRY_SIZE,
+                     FOURCC('a', 'v', 'c', 'C'), avcc)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Select the first H.264 track. Returns 1 if its configuration changed.
+static int parse_moov(fmp4_demux_t *mp4, const box_t *moov) {
+    const uint8_t *p = moov->data;
+    const uint8_t *end = moov->data + moov->size;
+    box_t box, avcc;
+    uint32_t track_id = 0, timescale = 0;
+    bool found = false;
+    while (!found && next_box(&p, end, &box)) {
+        if (box.type == FOURCC('t', 'r', 'a', 'k')) found = parse_trak(&box, &track_id, &timescale, &avcc);
+    }
+    if (!found) return 0;
+
+    mp4->default_duration = mp4->default_size = mp4->default_flags = 0;
+    box_t mvex;
+    if (find_box(moov->data, moov->size, FOURCC('m', 'v', 'e', 'x'), &mvex)) {
+        p = mvex.data;
+        end = mvex.data + mvex.size;
+        while (next_box(&p, end, &box)) {
+            // Full box header, track_ID, default_sample_description_index,
+            // then the three defaults
+            if (box.type != FOURCC('t', 'r', 'e', 'x') || box.size < 24 || rd32(box.data + 4) != track_id) continue;
+            mp4->default_duration = rd32(box.data + 12);
+            mp4->default_size = rd32(box.data + 16);
+            mp4->default_flags = rd32(box.data + 20);
+        }
+    }
+
+    if (track_id != mp4->track_id || timescale != mp4->timescale) mp4->next_dts = 0;
+    mp4->track_id = track_id;
+    mp4->timescale = timescale;
+    if (mp4->avcc && avcc.size == mp4->avcc_size && memcmp(avcc.data, mp4->avcc, avcc.size) == 0) return 0;
+
+    uint8_t *copy = malloc(avcc.size);
+    if (!copy) return 0;
+    memcpy(copy, avcc.data, avcc.size);
+    if (!avcc_to_config(mp4, copy, avcc.size)) {
+        free(copy);
+        return 0;
+    }
+    free(mp4->avcc);
+    mp4->avcc = copy;
+    mp4->avcc_size = avcc.size;
+    return 1;
+}
+
+static int64_t to_clock(const fmp4_demux_t *mp4, int64_t t) {
+    return t * FMP4_CLOCK_HZ / (int64_t)mp4->timescale;
+}
+
+// Walk one traf of our track, delivering its samples. `moof` is the start of
+// the enclosing moof box and `segment` that of the media segment, the
+// anchors for data offsets.
+static int parse_traf(fmp4_demux_t *mp4, const box_t *traf, const uint8_t *moof, const uint8_t *segment,
+                      const uint8_t *end) {
+    box_t tfhd;
+    if (!find_box(traf->data, traf->size, FOURCC('t', 'f', 'h', 'd'), &tfhd) || tfhd.size < 8) return 0;
+    uint32_t tf_flags = rd32(tfhd.data) & 0xFFFFFF;
+    if (rd32(tfhd.data + 4) != mp4->track_id) return 0;
+
+    const uint8_t *q = tfhd.data + 8;
+    const uint8_t *q_end = tfhd.data + tfhd.size;
+    const uint8_t *base = moof;  // default-base-is-moof, which CMAF requires
+    uint32_t duration = mp4->default_duration, size = mp4->default_size, flags = mp4->default_flags;
+    if (tf_flags & TFHD_BASE_DATA_OFFSET) {
+        if (q_end - q < 8) return 0;
+        uint64_t offset = rd64(q);
+        if (offset > (uint64_t)(end - segment)) return 0;
+        base = segment + offset;
+        q += 8;
+    }
+    if (tf_flags & TFHD_SAMPLE_DESCRIPTION) q += 4;
+    if ((tf_flags & TFHD_DEFAULT_DURATION) && q_end - q >= 4) { duration = rd32(q); q += 4; }
+    if ((tf_flags & TFHD_DEFAULT_SIZE) && q_end - q >= 4) { size = rd32(q); q += 4; }
+    if ((tf_flags & TFHD_DEFAULT_FLAGS) && q_end - q >= 4) { flags = rd32(q); q += 4; }
+
+    int64_t dts = mp4->next_dts;
+    box_t box;
+    if (find_box(traf->data, traf->size, FOURCC('t', 'f', 'd', 't'), &box) && box.size >= 8) {
+        dts = box.data[0] == 1 && box.size >= 12 ? (int64_t)rd64(box.data + 4) : (int64_t)rd32(box.data + 4);
+    }
+
+    const uint8_t *run_end = base;  // Runs without a data_offset follow the previous one
+    const uint8_t *p = traf->data;
+    const uint8_t *traf_end = traf->data + traf->size;
+    int rc = 0;
+    while (!rc && next_box(&p, traf_end, &box)) {
+        if (box.type != FOURCC('t', 'r', 'u', 'n') || box.size < 8) continue;
+        int version = box.data[0];
+        uint32_t tr_flags = rd32(box.data) & 0xFFFFFF;
+        uint32_t count = rd32(box.data + 4);
+        const uint8_t *r = box.data + 8;
+        const uint8_t *r_end = box.data + box.size;
+        const uint8_t *sample = run_end;
+        if (tr_flags & TRUN_DATA_OFFSET) {
+            if (r_end - r < 4) break;
+            ptrdiff_t pos = (base - segment) + (int32_t)rd32(r);
+            r += 4;
+            if (pos < 0 || pos > end - segment) break;
+            sample = segment + pos;
+        }
+        uint32_t first_flags = flags;
+        bool have_first_flags = false;
+        if (tr_flags & TRUN_FIRST_SAMPLE_FLAGS) {
+            if (r_end - r < 4) break;
+            first_flags = rd32(r);
+            have_first_flags = true;
+            r += 4;
+        }
+        size_t entry_size = 4 * (size_t)(!!(tr_flags & TRUN_SAMPLE_DURATION) + !!(tr_flags & TRUN_SAMPLE_SIZE) +
+                                         !!(tr_flags & TRUN_SAMPLE_FLAGS) + !!(tr_flags & TRUN_SAMPLE_CTS));
+        if (entry_size && count > (size_t)(r_end - r) / entry_size) break;
+
+        for (uint32_t i = 0; i < count && !rc; i++) {
+            uint32_t s_duration = duration, s_size = size;
+            uint32_t s_flags = i == 0 && have_first_flags ? first_flags : flags;
+            int64_t cts = 0;
+            if (tr_flags & TRUN_SAMPLE_DURATION) { s_duration = rd32(r); r += 4; }
+            if (tr_flags & TRUN_SAMPLE_SIZE) { s_size = rd32(r); r += 4; }
+            if (tr_flags & TRUN_SAMPLE_FLAGS) { s_flags = rd32(r); r += 4; }
+            if (tr_flags & TRUN_SAMPLE_CTS) {
+                cts = version == 0 ? (int64_t)rd32(r) : (int64_t)(int32_t)rd32(r);
+                r += 4;
+            }
+            if (s_size > (size_t)(end - sample)) return rc;  // mdat truncated
+
+            fmp4_sample_t s;
+            s.data = sample;
+            s.size = s_size;
+            s.nal_length_size = mp4->nal_length_size;
+            s.dts = to_clock(mp4, dts);
+            s.pts = to_clock(mp4, dts + cts);
+            s.keyframe = !(s_flags & SAMPLE_NON_SYNC);
+            s.config = false;
+            if (s_size > 0 && mp4->callback) rc = mp4->callback(&s, mp4->user_data);
+            sample += s_size;
+            dts += s_duration;
+        }
+        run_end = sample;
+    }
+    mp4->next_dts = dts;
+    return rc;
+}
+
+int fmp4_demux_parse(fmp4_demux_t *mp4, const uint8_t *data, size_t size) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    const uint8_t *segment = data;  // Start of the media segment, after any init section
+    box_t box;
+    int rc = 0;
+    while (!rc && next_box(&p, end, &box)) {
+        if (box.type == FOURCC('f', 't', 'y', 'p')) {
+            segment = p;
+        } else if (box.type == FOURCC('m', 'o', 'o', 'v')) {
+            segment = p;
+            if (parse_moov(mp4, &box) && mp4->callback) {
+                fmp4_sample_t s = { mp4->config, mp4->config_size, 4, 0, 0, true, true };
+                rc = mp4->callback(&s, mp4->user_data);
+            }
+        } else if (box.type == FOURCC('m', 'o', 'o', 'f') && mp4->track_id) {
+            const uint8_t *q = box.data;
+            const uint8_t *moof_end = box.data + box.size;
+            box_t traf;
+            while (!rc && next_box(&q, moof_end, &traf)) {
+                if (traf.type == FOURCC('t', 'r', 'a', 'f')) rc = parse_traf(mp4, &traf, box.start, segment, end);
+            }
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,186 @@
+#include "../../../include/nal_index.h"
+#include "../../../include/cpu.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NAL_SCAN_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define NAL_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+// Start codes need two zero bytes in a row, so the search only has to stop
+// at zeros: a block of bytes with none cannot hold the start of one. The
+// vector/word loops skip such blocks and check candidates one by one. The
+// loop used is the first of scan_table the CPU runs, see include/cpu.h.
+
+typedef const uint8_t *(*scan_fn)(const uint8_t *p, const uint8_t *end);
+
+static inline int start_code_at(const uint8_t *p, const uint8_t *end) {
+    return end - p >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1;
+}
+
+static const uint8_t *scan_bytes(const uint8_t *p, const uint8_t *block_end, const uint8_t *end) {
+    for (; p < block_end; p++) {
+        if (*p == 0 && start_code_at(p, end)) return p;
+    }
+    return NULL;
+}
+
+// Word at a time: (v - 0x01..) & ~v & 0x80.. is non-zero iff v has a zero byte
+static const uint8_t *scan_words(const uint8_t *p, const uint8_t *end) {
+    while (end - p >= (ptrdiff_t)sizeof(uintptr_t)) {
+        uintptr_t v;
+        memcpy(&v, p, sizeof(v));
+        if ((v - (UINTPTR_MAX / 255)) & ~v & ((UINTPTR_MAX / 255) << 7)) {
+            const uint8_t *c = scan_bytes(p, p + sizeof(v), end);
+            if (c) return c;
+        }
+        p += sizeof(v);
+    }
+    return scan_bytes(p, end, end);
+}
+
+#ifdef NAL_SCAN_X86
+__attribute__((target("sse2")))
+static const uint8_t *scan_sse2(const uint8_t *p, const uint8_t *end) {
+    const __m128i zero = _mm_setzero_si128();
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        while (mask) {
+            const uint8_t *c = p + __builtin_ctz(mask);
+            if (start_code_at(c, end)) return c;
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+    return scan_bytes(p, end, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *scan_avx2(const uint8_t *p, const uint8_t *end) {
+    const __m256i zero = _mm256_setzero_si256();
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        while (mask) {
+            const uint8_t *c = p + __builtin_ctz(mask);
+            if (start_code_at(c, end)) return c;
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+    return scan_bytes(p, end, end);
+}
+#endif
+
+#ifdef NAL_SCAN_NEON
+static const uint8_t *scan_neon(const uint8_t *p, const uint8_t *end) {
+    while (end - p >= 16) {
+        uint64x2_t z = vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(p), vdupq_n_u8(0)));
+        if (vgetq_lane_u64(z, 0) | vgetq_lane_u64(z, 1)) {
+            const uint8_t *c = scan_bytes(p, p + 16, end);
+            if (c) return c;
+        }
+        p += 16;
+    }
+    return scan_bytes(p, end, end);
+}
+#endif
+
+static const struct {
+    unsigned features;
+    scan_fn fn;
+    const char *name;
+} scan_table[] = {
+#ifdef NAL_SCAN_X86
+    { CPU_AVX2, scan_avx2, "avx2" },
+    { CPU_SSE2, scan_sse2, "sse2" },
+#endif
+#ifdef NAL_SCAN_NEON
+    { CPU_NEON, scan_neon, "neon" },
+#endif
+    { 0, scan_words, "words" },
+};
+
+static scan_fn scan;
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+static void select_scan(void) {
+    unsigned features = cpu_features();
+    size_t i = 0;
+    while ((scan_table[i].features & features) != scan_table[i].features) i++;
+    scan = scan_table[i].fn;
+}
+
+const uint8_t *nal_find_start_code(const uint8_t *p, const uint8_t *end) {
+    pthread_once(&scan_once, select_scan);
+    return scan(p, end);
+}
+
+int nal_scan_use_version(size_t i, const char **name) {
+    if (i >= sizeof(scan_table) / sizeof(scan_table[0])) return -1;
+    *name = scan_table[i].name;
+    if ((scan_table[i].features & cpu_features()) != scan_table[i].features) return 0;
+    pthread_once(&scan_once, select_scan);
+    scan = scan_table[i].fn;
+    return 1;
+}
+
+static int index_add(nal_index_t *index, const uint8_t *base, const uint8_t *nal, size_t size) {
+    if (size == 0) return 0;
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 64;
+        nal_unit_t *units = realloc(index->units, capacity * sizeof(*units));
+        if (!units) return -1;
+        index->units = units;
+        index->capacity = capacity;
+    }
+    nal_unit_t *u = &index->units[index->count++];
+    u->offset = (size_t)(nal - base);
+    u->size = size;
+    u->type = nal[0] & 0x1F;
+    u->ref_idc = (nal[0] >> 5) & 0x3;
+    return 0;
+}
+
+int nal_index_annexb(nal_index_t *index, const uint8_t *data, size_t size) {
+    const uint8_t *end = data + size;
+    index->count = 0;
+    const uint8_t *sc = nal_find_start_code(data, end);
+    while (sc) {
+        const uint8_t *nal = sc + 3;
+        const uint8_t *next = nal_find_start_code(nal, end);
+        const uint8_t *nal_end = next ? next : end;
+        while (nal_end > nal && nal_end[-1] == 0) nal_end--;
+        if (index_add(index, data, nal, (size_t)(nal_end - nal)) < 0) return -1;
+        sc = next;
+    }
+    return (int)index->count;
+}
+
+int nal_index_length_prefixed(nal_index_t *index, const uint8_t *data, size_t size, int prefix_size) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    index->count = 0;
+    if (prefix_size < 1 || prefix_size > 4) return 0;
+    while (end - p >= prefix_size) {
+        size_t len = 0;
+        for (int i = 0; i < prefix_size; i++) len = (len << 8) | p[i];
+        p += prefix_size;
+        if (len == 0 || len > (size_t)(end - p)) break;
+        if (index_add(index, data, p, len) < 0) return -1;
+        p += len;
+    }
+    return (int)index->count;
+}
+
+void nal_index_free(nal_index_t *index) {
+    free(index->units);
+    index->units = NULL;
+    index->count = index->capacity = 0;
+}
@@ -0,0 +1,329 @@
+#include "../../../include/ts_demux.h"
+#include <stdlib.h>
+#include <string.h>
+
+// MPEG-TS demuxer: follows PAT -> PMT to find the video PID, then assembles
+// that PID's PES packets into one reusable buffer. PSI tables are re-parsed
+// only when their version changes.
+//
+// All state lives in the demuxer, not in the buffer being fed, so a PES
+// that straddles two HLS segments is completed by the next feed. The video
+// PID's continuity counter tells a seamless boundary from a gap (a skipped
+// or failed segment): on a gap the partial PES is dropped rather than
+// handed on truncated.
+
+#define TS_PAT_PID      0x0000
+#define TS_SECTION_MAX  1024            // PAT/PMT sections are at most 1021 bytes
+#ifdef MINIMAL_MEMORY_BUFFERS
+#define TS_PES_INITIAL  (16 * 1024)
+#else
+#define TS_PES_INITIAL  (256 * 1024)    // Typical 720p keyframe fits without growing
+#endif
+
+// Reassembles one PSI section that may span several packets
+typedef struct {
+    uint8_t buf[TS_SECTION_MAX];
+    size_t len;
+    bool active;               // Collecting; false until a payload unit start
+} ts_section_t;
+
+struct ts_demux {
+    ts_pes_callback_t callback;
+    void *user_data;
+
+    uint8_t carry[TS_PACKET_SIZE];  // Partial packet left over from the last feed
+    size_t carry_len;
+
+    ts_section_t pat, pmt;
+    int pat_version, pmt_version;   // Last parsed versions (-1 = none)
+    int pmt_pid;                    // -1 until the PAT names it
+
+    int video_pid;                  // -1 until known
+    uint8_t stream_type;            // 0 while the PID is only guessed
+    int video_cc;                   // Last continuity_counter on video_pid (-1 = none)
+
+    uint8_t *pes;                   // Payload of the PES being assembled
+    size_t pes_len, pes_capacity;
+    size_t pes_expected;            // From PES_packet_length (0 = unbounded)
+    int64_t pes_pts, pes_dts;       // Of the PES being assembled
+    bool pes_started;
+};
+
+// CRC-32/MPEG-2 over a PSI section (the last four bytes are the CRC itself,
+// so a good section sums to zero)
+static uint32_t section_crc(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04C11DB7u : crc << 1;
+        }
+    }
+    return crc;
+}
+
+ts_demux_t *ts_demux_create(ts_pes_callback_t callback, void *user_data) {
+    ts_demux_t *ts = calloc(1, sizeof(*ts));
+    if (!ts) return NULL;
+    ts->callback = callback;
+    ts->user_data = user_data;
+    ts_demux_reset(ts);
+    return ts;
+}
+
+void ts_demux_destroy(ts_demux_t *ts) {
+    if (!ts) return;
+    free(ts->pes);
+    free(ts);
+}
+
+void ts_demux_reset(ts_demux_t *ts) {
+    ts->carry_len = 0;
+    ts->pat.active = ts->pmt.active = false;
+    ts->pat_version = ts->pmt_version = -1;
+    ts->pmt_pid = -1;
+    ts->video_pid = -1;
+    ts->stream_type = 0;
+    ts->video_cc = -1;
+    ts->pes_len = 0;
+    ts->pes_expected = 0;
+    ts->pes_started = false;
+}
+
+int ts_demux_video_pid(const ts_demux_t *ts) {
+    return ts->video_pid;
+}
+
+// Collect section bytes from one packet payload. Returns the section length
+// once a whole, CRC-valid section is in s->buf, else 0.
+static size_t section_feed(ts_section_t *s, bool unit_start, const uint8_t *p, size_t len) {
+    if (unit_start) {
+        // pointer_field: bytes finishing a previous section come first
+        size_t skip = 1 + (size_t)(len ? p[0] : 0);
+        if (len < skip) return 0;
+        p += skip;
+        len -= skip;
+        s->len = 0;
+        s->active = true;
+    }
+    if (!s->active) return 0;
+
+    size_t room = sizeof(s->buf) - s->len;
+    if (len > room) len = room;
+    memcpy(s->buf + s->len, p, len);
+    s->len += len;
+    if (s->len < 3) return 0;
+
+    size_t total = 3 + (((size_t)(s->buf[1] & 0x0F) << 8) | s->buf[2]);
+    if (total > sizeof(s->buf) || total < 12) {
+        s->active = false;
+        return 0;
+    }
+    if (s->len < total) return 0;
+    s->active = false;
+    return section_crc(s->buf, total) == 0 ? total : 0;
+}
+
+static void parse_pat(ts_demux_t *ts, const uint8_t *sec, size_t len) {
+    if (sec[0] != 0x00 || !(sec[5] & 0x01)) return;  // table_id, current_next
+    int version = (sec[5] >> 1) & 0x1F;
+    if (version == ts->pat_version) return;
+    ts->pat_version = version;
+
+    // Program loop between the 8-byte header and the CRC; the first real
+    // program (number 0 is the network PID) is the one we play
+    for (size_t i = 8; i + 4 <= len - 4; i += 4) {
+        int program = (sec[i] << 8) | sec[i + 1];
+        int pid = ((sec[i + 2] & 0x1F) << 8) | sec[i + 3];
+        if (program == 0) continue;
+        if (pid != ts->pmt_pid) {
+            ts->pmt_pid = pid;
+            ts->pmt_version = -1;
+            ts->pmt.active = false;
+        }
+        return;
+    }
+}
+
+static bool is_video_stream(uint8_t stream_type) {
+    return stream_type == TS_STREAM_H264 || stream_type == TS_STREAM_MPEG4_VIDEO || stream_type == TS_STREAM_HEVC;
+}
+
+static void parse_pmt(ts_demux_t *ts, const uint8_t *sec, size_t len) {
+    if (sec[0] != 0x02 || !(sec[5] & 0x01)) return;
+    int version = (sec[5] >> 1) & 0x1F;
+    if (version == ts->pmt_version) return;
+    ts->pmt_version = version;
+
+    size_t program_info = ((size_t)(sec[10] & 0x0F) << 8) | sec[11];
+    size_t end = len - 4;
+    for (size_t i = 12 + program_info; i + 5 <= end; ) {
+        uint8_t stream_type = sec[i];
+        int pid = ((sec[i + 1] & 0x1F) << 8) | sec[i + 2];
+        size_t es_info = ((size_t)(sec[i + 3] & 0x0F) << 8) | sec[i + 4];
+        if (is_video_stream(stream_type)) {
+            if (pid != ts->video_pid) {
+                // A different stream than the guess: drop its partial PES
+                ts->pes_len = 0;
+                ts->pes_started = false;
+                ts->video_cc = -1;
+            }
+            ts->video_pid = pid;
+            ts->stream_type = stream_type;
+            return;
+        }
+        i += 5 + es_info;
+    }
+}
+
+static bool pes_reserve(ts_demux_t *ts, size_t size) {
+    if (size <= ts->pes_capacity) return true;
+    size_t capacity = ts->pes_capacity ? ts->pes_capacity : TS_PES_INITIAL;
+    while (capacity < size) capacity *= 2;
+    uint8_t *pes = realloc(ts->pes, capacity);
+    if (!pes) return false;
+    ts->pes = pes;
+    ts->pes_capacity = capacity;
+    return true;
+}
+
+static void pes_append(ts_demux_t *ts, const uint8_t *p, size_t len) {
+    if (!pes_reserve(ts, ts->pes_len + len)) {
+        // Out of memory: this PES is lost, the next one starts clean
+        ts->pes_len = 0;
+        ts->pes_started = false;
+        return;
+    }
+    memcpy(ts->pes + ts->pes_len, p, len);
+    ts->pes_len += len;
+}
+
+// 33-bit PTS/DTS field: 3 + 15 + 15 bits, each followed by a marker bit
+static int64_t read_timestamp(const uint8_t *p) {
+    return ((int64_t)(p[0] & 0x0E) << 29) | ((int64_t)p[1] << 22) | ((int64_t)(p[2] & 0xFE) << 14) |
+           ((int64_t)p[3] << 7) | (p[4] >> 1);
+}
+
+static int pes_deliver(ts_demux_t *ts) {
+    int rc = 0;
+    if (ts->pes_started && ts->pes_len > 0 && ts->callback) {
+        ts_pes_t pes = { ts->pes, ts->pes_len, ts->video_pid, ts->stream_type, ts->pes_pts, ts->pes_dts };
+        rc = ts->callback(&pes, ts->user_data);
+    }
+    ts->pes_len = 0;
+    ts->pes_started = false;
+    return rc;
+}
+
+static int pes_feed(ts_demux_t *ts, bool unit_start, const uint8_t *p, size_t len) {
+    int rc = 0;
+    if (unit_start) {
+        rc = pes_deliver(ts);
+        // packet_start_code_prefix, stream_id, PES_packet_length, flags,
+        // PES_header_data_length
+        if (len < 9 || p[0] != 0x00 || p[1] != 0x00 || p[2] != 0x01) return rc;
+        size_t data_start = 9 + (size_t)p[8];
+        if (data_start > len) return rc;
+        size_t packet_length = ((size_t)p[4] << 8) | p[5];
+        ts->pes_expected = packet_length + 6 > data_start ? packet_length + 6 - data_start : 0;
+        // Size the buffer up front when the length is declared
+        if (ts->pes_expected) pes_reserve(ts, ts->pes_expected);
+        // PTS_DTS_flags: '10' PTS only, '11' both
+        int flags = p[7] >> 6;
+        ts->pes_pts = (flags & 0x2) && p[8] >= 5 ? read_timestamp(p + 9) : TS_NO_TIMESTAMP;
+        ts->pes_dts = flags == 0x3 && p[8] >= 10 ? read_timestamp(p + 14) : ts->pes_pts;
+        ts->pes_started = true;
+        p += data_start;
+        len -= data_start;
+    } else if (!ts->pes_started) {
+        return 0;
+    }
+    pes_append(ts, p, len);
+    if (ts->pes_expected && ts->pes_len >= ts->pes_expected && !rc) rc = pes_deliver(ts);
+    return rc;
+}
+
+static int handle_packet(ts_demux_t *ts, const uint8_t *pkt) {
+    if (pkt[1] & 0x80) return 0;  // transport_error_indicator
+    bool unit_start = (pkt[1] & 0x40) != 0;
+    int pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+    int afc = (pkt[3] >> 4) & 0x3;
+    if (!(afc & 0x1)) return 0;   // No payload
+    size_t offset = 4;
+    if (afc == 3) offset += 1 + (size_t)pkt[4];
+    if (offset >= TS_PACKET_SIZE) return 0;
+    const uint8_t *p = pkt + offset;
+    size_t len = TS_PACKET_SIZE - offset;
+
+    if (pid == TS_PAT_PID) {
+        size_t n = section_feed(&ts->pat, unit_start, p, len);
+        if (n) parse_pat(ts, ts->pat.buf, n);
+        return 0;
+    }
+    if (pid == ts->pmt_pid) {
+        size_t n = section_feed(&ts->pmt, unit_start, p, len);
+        if (n) parse_pmt(ts, ts->pmt.buf, n);
+        return 0;
+    }
+    if (ts->video_pid < 0 && unit_start && len >= 4 &&
+        p[0] == 0x00 && p[1] == 0x00 && p[2] == 0x01 && (p[3] & 0xF0) == 0xE0) {
+        // No PMT (yet): take the first video stream_id we see
+        ts->video_pid = pid;
+        ts->stream_type = 0;
+    }
+    if (pid != ts->video_pid) return 0;
+
+    int cc = pkt[3] & 0x0F;
+    bool discontinuity = afc == 3 && pkt[4] > 0 && (pkt[5] & 0x80);
+    if (ts->video_cc >= 0 && !discontinuity) {
+        if (cc == ts->video_cc) return 0;  // Duplicate packet
+        if (cc != ((ts->video_cc + 1) & 0x0F)) {
+            // Packets went missing: whatever was being assembled is broken
+            ts->pes_len = 0;
+            ts->pes_started = false;
+        }
+    }
+    ts->video_cc = cc;
+    return pes_feed(ts, unit_start, p, len);
+}
+
+int ts_demux_feed(ts_demux_t *ts, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        if (ts->carry_len > 0) {
+            size_t take = TS_PACKET_SIZE - ts->carry_len;
+            if (take > size) take = size;
+            memcpy(ts->carry + ts->carry_len, data, take);
+            ts->carry_len += take;
+            data += take;
+            size -= take;
+            if (ts->carry_len < TS_PACKET_SIZE) break;
+            ts->carry_len = 0;
+            int rc = handle_packet(ts, ts->carry);
+            if (rc) return rc;
+            continue;
+        }
+        if (data[0] != 0x47) {
+            // Lost sync: skip to the next sync byte that has another one a
+            // packet later (or the last one we can see)
+            size_t i = 1;
+            while (i < size && !(data[i] == 0x47 && (i + TS_PACKET_SIZE >= size || data[i + TS_PACKET_SIZE] == 0x47))) i++;
+            data += i;
+            size -= i;
+            continue;
+        }
+        if (size < TS_PACKET_SIZE) {
+            memcpy(ts->carry, data, size);
+            ts->carry_len = size;
+            break;
+        }
+        int rc = handle_packet(ts, data);
+        if (rc) return rc;
+        data += TS_PACKET_SIZE;
+        size -= TS_PACKET_SIZE;
+    }
+    return 0;
+}
+
+int ts_demux_flush(ts_demux_t *ts) {
+    return pes_deliver(ts);
+}
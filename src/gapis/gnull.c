@@ -0,0 +1,212 @@
+// Null video backend (BACKEND=null): takes the pictures and throws them
+// away, for benchmarks on machines without a display. Every path main.c
+// can take still runs up to the output: YUV pictures are taken as they
+// are, the others are converted into a buffer of the output's own.
+//
+// ANHELO_NULL_CHECKSUM=1 hashes every picture (FNV-1a over the visible
+// bytes) and prints one checksum of them all at the end, =frames prints
+// one per picture as well, so runs of a replay can be compared.
+//
+// ANHELO_NULL_ZAP=n presses the next channel key after every n pictures,
+// for channel switching runs.
+#include "../include/video.h"
+#include "../include/yuv2rgb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// Window the mosaic's cells divide, as the other outputs' default
+#define NULL_MOSAIC_WIDTH 640
+#define NULL_MOSAIC_HEIGHT 480
+
+struct video_t {
+    int width, height;
+    uint8_t *pixels;            // video_lock_native() target, BGRA32
+    int linesize;
+    int checksum;               // 0 off, 1 total, 2 and per picture
+    unsigned long frames;
+    uint64_t total;             // FNV-1a of the picture checksums
+    int osd_enabled;
+    unsigned long zap_every;    // ANHELO_NULL_ZAP, 0 = off
+    int channel_step;
+};
+
+video_t *video_create(int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+    video_t *v = calloc(1, sizeof(video_t));
+    if (!v) return NULL;
+    v->width = width;
+    v->height = height;
+    v->linesize = width * 4;
+    v->pixels = malloc((size_t)v->linesize * height);
+    if (!v->pixels) {
+        free(v);
+        return NULL;
+    }
+    const char *env = getenv("ANHELO_NULL_CHECKSUM");
+    if (env && strcmp(env, "frames") == 0) v->checksum = 2;
+    else if (env && strcmp(env, "0") != 0) v->checksum = 1;
+    v->total = FNV_OFFSET;
+    const char *zap = getenv("ANHELO_NULL_ZAP");
+    if (zap) v->zap_every = strtoul(zap, NULL, 10);
+    return v;
+}
+
+static uint64_t hash_plane(uint64_t h, const uint8_t *p, int stride, int width, int height) {
+    for (int y = 0; y < height; y++, p += stride) {
+        for (int x = 0; x < width; x++) {
+            h ^= p[x];
+            h *= FNV_PRIME;
+        }
+    }
+    return h;
+}
+
+// One picture taken, h its checksum
+static void taken(video_t *v, uint64_t h) {
+    v->frames++;
+    if (v->zap_every && v->frames % v->zap_every == 0) v->channel_step = 1;
+    if (!v->checksum) return;
+    for (int i = 0; i < 8; i++) {
+        v->total ^= (uint8_t)(h >> (i * 8));
+        v->total *= FNV_PRIME;
+    }
+    if (v->checksum == 2) printf("Null output: picture %lu checksum %016llx\n", v->frames, (unsigned long long)h);
+}
+
+void video_draw(video_t *v, const uint8_t *rgb, int linesize) {
+    if (!v || !rgb || linesize < v->width * 3) return;
+    taken(v, v->checksum ? hash_plane(FNV_OFFSET, rgb, linesize, v->width * 3, v->height) : 0);
+}
+
+yuv2rgb_format_t video_pixel_format(video_t *v) {
+    (void)v;
+    return YUV2RGB_BGRA32;
+}
+
+void video_draw_native(video_t *v, const uint8_t *pixels, int linesize) {
+    if (!v || !pixels || linesize < v->width * 4) return;
+    taken(v, v->checksum ? hash_plane(FNV_OFFSET, pixels, linesize, v->width * 4, v->height) : 0);
+}
+
+uint8_t *video_lock_native(video_t *v, int *linesize, int *width, int *height) {
+    if (!v) return NULL;
+    *linesize = v->linesize;
+    *width = v->width;
+    *height = v->height;
+    return v->pixels;
+}
+
+void video_unlock_native(video_t *v) {
+    if (!v) return;
+    taken(v, v->checksum ? hash_plane(FNV_OFFSET, v->pixels, v->linesize, v->width * 4, v->height) : 0);
+}
+
+int video_draw_yuv(video_t *v, int width, int height,
+                   const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                   int y_stride, int uv_stride) {
+    if (!v || width != v->width || height != v->height) return -1;
+    uint64_t h = 0;
+    if (v->checksum) {
+        h = hash_plane(FNV_OFFSET, y_plane, y_stride, width, height);
+        h = hash_plane(h, u_plane, uv_stride, (width + 1) / 2, (height + 1) / 2);
+        h = hash_plane(h, v_plane, uv_stride, (width + 1) / 2, (height + 1) / 2);
+    }
+    taken(v, h);
+    return 0;
+}
+
+// No display to put pictures into: they are downloaded and counted
+int video_draw_pixmap(video_t *v, video_put_fn put, void *user) {
+    (void)v; (void)put; (void)user;
+    return -1;
+}
+
+// Nothing to wait for: pictures are paced by their PTS alone
+int video_vsync(video_t *v) {
+    (void)v;
+    return 0;
+}
+
+// No window, no events: playback runs until the stream ends or a signal
+int video_poll(video_t *v) {
+    return v ? 0 : 1;
+}
+
+int video_channel_step(video_t *v) {
+    if (!v) return 0;
+    int step = v->channel_step;
+    v->channel_step = 0;
+    return step;
+}
+
+int video_osd_enabled(video_t *v) {
+    return v && v->osd_enabled;
+}
+
+void video_set_osd(video_t *v, const char *text) {
+    (void)v;
+    (void)text;
+}
+
+void video_destroy(video_t *v) {
+    if (!v) return;
+    if (v->checksum)
+        printf("Null output: %lu picture(s), checksum %016llx\n", v->frames, (unsigned long long)v->total);
+    free(v->pixels);
+    free(v);
+}
+
+// Mosaic: tiles are checksummed like pictures, by a video_t of cell size
+struct video_mosaic_t {
+    video_t *v;
+    int tiles;
+};
+
+video_mosaic_t *video_mosaic_create(int cols, int rows) {
+    if (cols <= 0 || rows <= 0) return NULL;
+    video_mosaic_t *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->v = video_create(NULL_MOSAIC_WIDTH / cols, NULL_MOSAIC_HEIGHT / rows);
+    if (!m->v) {
+        free(m);
+        return NULL;
+    }
+    m->tiles = cols * rows;
+    return m;
+}
+
+void video_mosaic_cell_size(video_mosaic_t *m, int *width, int *height) {
+    *width = m->v->width;
+    *height = m->v->height;
+}
+
+void video_mosaic_tile(video_mosaic_t *m, int tile, int width, int height,
+                       const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                       int y_stride, int uv_stride) {
+    if (!m || tile < 0 || tile >= m->tiles || width <= 0 || height <= 0) return;
+    uint64_t h = 0;
+    if (m->v->checksum) {
+        h = hash_plane(FNV_OFFSET + (uint64_t)tile, y_plane, y_stride, width, height);
+        h = hash_plane(h, u_plane, uv_stride, (width + 1) / 2, (height + 1) / 2);
+        h = hash_plane(h, v_plane, uv_stride, (width + 1) / 2, (height + 1) / 2);
+    }
+    taken(m->v, h);
+}
+
+void video_mosaic_present(video_mosaic_t *m) {
+    (void)m;
+}
+
+int video_mosaic_poll(video_mosaic_t *m) {
+    return m ? 0 : 1;
+}
+
+void video_mosaic_destroy(video_mosaic_t *m) {
+    if (!m) return;
+    video_destroy(m->v);
+    free(m);
+}
@@ -1,6 +1,12 @@
 #include "../../include/video.h"
+#include "../../include/osd.h"
 #include <SDL/SDL.h>
 #include <GL/gl.h>
+#include <GL/glext.h>
+#ifdef VAAPI_GLX
+#include <GL/glx.h>
+#endif
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,6 +22,8 @@ static int next_power_of_2(int n) {
     return n;
 }
 
+#define MAX_PBOS 3
+
 struct video_t {
     int video_width;       // Original video dimensions
     int video_height;
@@ -37,8 +45,240 @@ struct video_t {
     float tex_coords[8];   // Pre-calculated texture coordinates
     float vertices[8];     // Pre-calculated vertex positions
     int texture_initialized;
+
+    // YUV path (video_draw_yuv): Y, U and V in luminance textures, turned
+    // into RGB by an ARB fragment program. 0 when the driver has none.
+    GLuint yuv_program;
+    GLuint yuv_textures[3];
+    int yuv_textures_initialized;
+    PFNGLACTIVETEXTUREARBPROC ActiveTexture;
+    PFNGLBINDPROGRAMARBPROC BindProgram;
+    PFNGLDELETEPROGRAMSARBPROC DeletePrograms;
+
+    // Pixel buffer objects the frames are written into, in turn: texture
+    // uploads then return at once and the GPU pulls the data when it gets
+    // there. 0 buffers when the driver has no PBOs or ANHELO_GL_PBO=0.
+    GLuint pbos[MAX_PBOS];
+    int num_pbos;
+    int next_pbo;
+    PFNGLBINDBUFFERARBPROC BindBuffer;
+    PFNGLBUFFERDATAARBPROC BufferData;
+    PFNGLMAPBUFFERARBPROC MapBuffer;
+    PFNGLUNMAPBUFFERARBPROC UnmapBuffer;
+    PFNGLDELETEBUFFERSARBPROC DeleteBuffers;
+
+    int vsync;             // Swaps wait for the display's refresh
+
+#ifdef VAAPI_GLX
+    // Pixmap path (video_draw_pixmap): the decoder puts the picture, scaled
+    // to the displayed size and in RGB, into an X pixmap that is bound as
+    // a texture through GLX_EXT_texture_from_pixmap. pixmap is 0 when the
+    // display has no config for it.
+    Display *x_display;
+    Pixmap pixmap;
+    GLXPixmap glx_pixmap;
+    GLenum pixmap_target;       // GL_TEXTURE_2D or GL_TEXTURE_RECTANGLE_ARB
+    GLuint pixmap_texture;
+    int pixmap_y_inverted;      // Texture rows top first
+    PFNGLXBINDTEXIMAGEEXTPROC BindTexImage;
+    PFNGLXRELEASETEXIMAGEEXTPROC ReleaseTexImage;
+#endif
+
+    // Stats overlay (video_set_osd): the text drawn into a luminance
+    // texture, shown over the video's top left corner
+    int osd_enabled;
+    int channel_step;           // Channel key since video_channel_step()
+    char osd_text[OSD_TEXT_MAX];
+    GLuint osd_texture;
+    int osd_width, osd_height;                  // Box drawn, 0 for none
+    int osd_texture_width, osd_texture_height;
 };
 
+// Show the frame drawn. With vsync, return once it is on screen: drivers
+// queue the swap and block on a later call instead, which would make the
+// time a picture is shown unknown to the presentation scheduler.
+static void swap_buffers(video_t *v) {
+    SDL_GL_SwapBuffers();
+    if (v->vsync) glFinish();
+}
+
+// BT.601 with the coefficients of yuv420_to_rgb(): R = Y + 1.402 V,
+// G = Y - 0.344 U - 0.714 V, B = Y + 1.773 U, U and V centred on 128/255
+static const char yuv_fragment_program[] =
+    "!!ARBfp1.0\n"
+    "TEMP yuv, rgb;\n"
+    "TEX yuv.x, fragment.texcoord[0], texture[0], 2D;\n"
+    "TEX yuv.y, fragment.texcoord[0], texture[1], 2D;\n"
+    "TEX yuv.z, fragment.texcoord[0], texture[2], 2D;\n"
+    "SUB yuv.yz, yuv, {0, 0.50196078, 0.50196078, 0};\n"
+    "MAD rgb.xyz, yuv.y, {0, -0.34375, 1.7734375, 0}, yuv.x;\n"
+    "MAD result.color.xyz, yuv.z, {1.40234375, -0.71484375, 0, 0}, rgb;\n"
+    "MOV result.color.w, 1.0;\n"
+    "END\n";
+
+// `name` in a space separated extension list
+static int in_extension_list(const char *list, const char *name) {
+    size_t len = strlen(name);
+    for (const char *p = list; p && (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return 1;
+    }
+    return 0;
+}
+
+static int has_extension(const char *name) {
+    return in_extension_list((const char *)glGetString(GL_EXTENSIONS), name);
+}
+
+// Load and compile the YUV fragment program; leaves yuv_program 0 when the
+// driver lacks ARB_fragment_program or rejects it
+static void init_yuv_program(video_t *v) {
+    if (!has_extension("GL_ARB_fragment_program") || !has_extension("GL_ARB_multitexture")) return;
+    PFNGLGENPROGRAMSARBPROC GenPrograms = (PFNGLGENPROGRAMSARBPROC)SDL_GL_GetProcAddress("glGenProgramsARB");
+    PFNGLPROGRAMSTRINGARBPROC ProgramString = (PFNGLPROGRAMSTRINGARBPROC)SDL_GL_GetProcAddress("glProgramStringARB");
+    v->ActiveTexture = (PFNGLACTIVETEXTUREARBPROC)SDL_GL_GetProcAddress("glActiveTextureARB");
+    v->BindProgram = (PFNGLBINDPROGRAMARBPROC)SDL_GL_GetProcAddress("glBindProgramARB");
+    v->DeletePrograms = (PFNGLDELETEPROGRAMSARBPROC)SDL_GL_GetProcAddress("glDeleteProgramsARB");
+    if (!GenPrograms || !ProgramString || !v->ActiveTexture || !v->BindProgram || !v->DeletePrograms) return;
+
+    GLint error_pos = -1;
+    while (glGetError() != GL_NO_ERROR) {}
+    GenPrograms(1, &v->yuv_program);
+    v->BindProgram(GL_FRAGMENT_PROGRAM_ARB, v->yuv_program);
+    ProgramString(GL_FRAGMENT_PROGRAM_ARB, GL_PROGRAM_FORMAT_ASCII_ARB,
+                  (GLsizei)strlen(yuv_fragment_program), yuv_fragment_program);
+    glGetIntegerv(GL_PROGRAM_ERROR_POSITION_ARB, &error_pos);
+    v->BindProgram(GL_FRAGMENT_PROGRAM_ARB, 0);
+    if (error_pos != -1 || glGetError() != GL_NO_ERROR) {
+        printf("OpenGL: YUV fragment program rejected at %d: %s\n", (int)error_pos,
+               (const char *)glGetString(GL_PROGRAM_ERROR_STRING_ARB));
+        v->DeletePrograms(1, &v->yuv_program);
+        v->yuv_program = 0;
+        return;
+    }
+
+    glGenTextures(3, v->yuv_textures);
+    for (int i = 0; i < 3; i++) {
+        glBindTexture(GL_TEXTURE_2D, v->yuv_textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+}
+
+// Create the PBOs, ANHELO_GL_PBO of them (2 by default, up to 3)
+static void init_pbos(video_t *v) {
+    const char *env = getenv("ANHELO_GL_PBO");
+    int count = env ? atoi(env) : 2;
+    if (count <= 0) return;
+    if (count > MAX_PBOS) count = MAX_PBOS;
+    if (!has_extension("GL_ARB_pixel_buffer_object") && !has_extension("GL_EXT_pixel_buffer_object")) return;
+    PFNGLGENBUFFERSARBPROC GenBuffers = (PFNGLGENBUFFERSARBPROC)SDL_GL_GetProcAddress("glGenBuffersARB");
+    v->BindBuffer = (PFNGLBINDBUFFERARBPROC)SDL_GL_GetProcAddress("glBindBufferARB");
+    v->BufferData = (PFNGLBUFFERDATAARBPROC)SDL_GL_GetProcAddress("glBufferDataARB");
+    v->MapBuffer = (PFNGLMAPBUFFERARBPROC)SDL_GL_GetProcAddress("glMapBufferARB");
+    v->UnmapBuffer = (PFNGLUNMAPBUFFERARBPROC)SDL_GL_GetProcAddress("glUnmapBufferARB");
+    v->DeleteBuffers = (PFNGLDELETEBUFFERSARBPROC)SDL_GL_GetProcAddress("glDeleteBuffersARB");
+    if (!GenBuffers || !v->BindBuffer || !v->BufferData || !v->MapBuffer || !v->UnmapBuffer || !v->DeleteBuffers)
+        return;
+    GenBuffers(count, v->pbos);
+    v->num_pbos = count;
+}
+
+#ifdef VAAPI_GLX
+// The X pixmap of the displayed size and the GLX pixmap binding it as a
+// texture, on a config of the window's depth (what vaPutSurface draws
+// into) that binds RGB to 2D or rectangle textures. Leaves pixmap 0 when
+// there is none.
+static void init_pixmap(video_t *v) {
+    Display *display = glXGetCurrentDisplay();
+    GLXDrawable window = glXGetCurrentDrawable();
+    if (!display || !window) return;
+    int screen = DefaultScreen(display);
+    if (!in_extension_list(glXQueryExtensionsString(display, screen), "GLX_EXT_texture_from_pixmap")) return;
+    v->BindTexImage = (PFNGLXBINDTEXIMAGEEXTPROC)SDL_GL_GetProcAddress("glXBindTexImageEXT");
+    v->ReleaseTexImage = (PFNGLXRELEASETEXIMAGEEXTPROC)SDL_GL_GetProcAddress("glXReleaseTexImageEXT");
+    if (!v->BindTexImage || !v->ReleaseTexImage) return;
+
+    static const int attributes[] = {
+        GLX_DRAWABLE_TYPE, GLX_PIXMAP_BIT,
+        GLX_BIND_TO_TEXTURE_RGB_EXT, True,
+        GLX_DOUBLEBUFFER, False,
+        GLX_RED_SIZE, 8, GLX_GREEN_SIZE, 8, GLX_BLUE_SIZE, 8,
+        None
+    };
+    int count = 0, targets = 0, inverted = 0;
+    GLXFBConfig *configs = glXChooseFBConfig(display, screen, attributes, &count);
+    GLXFBConfig config = NULL;
+    for (int i = 0; i < count && !config; i++) {
+        XVisualInfo *visual = glXGetVisualFromFBConfig(display, configs[i]);
+        int depth = visual ? visual->depth : 0;
+        if (visual) XFree(visual);
+        targets = 0;
+        glXGetFBConfigAttrib(display, configs[i], GLX_BIND_TO_TEXTURE_TARGETS_EXT, &targets);
+        if (depth == 24 && (targets & (GLX_TEXTURE_2D_BIT_EXT | GLX_TEXTURE_RECTANGLE_BIT_EXT))) config = configs[i];
+    }
+    if (config) glXGetFBConfigAttrib(display, config, GLX_Y_INVERTED_EXT, &inverted);
+    if (configs) XFree(configs);
+    if (!config) return;
+
+    int rectangle = !(targets & GLX_TEXTURE_2D_BIT_EXT);
+    const int pixmap_attributes[] = {
+        GLX_TEXTURE_TARGET_EXT, rectangle ? GLX_TEXTURE_RECTANGLE_EXT : GLX_TEXTURE_2D_EXT,
+        GLX_TEXTURE_FORMAT_EXT, GLX_TEXTURE_FORMAT_RGB_EXT,
+        None
+    };
+    Pixmap pixmap = XCreatePixmap(display, window, v->display_width, v->display_height, 24);
+    v->glx_pixmap = glXCreatePixmap(display, config, pixmap, pixmap_attributes);
+    if (!v->glx_pixmap) {
+        XFreePixmap(display, pixmap);
+        return;
+    }
+    v->x_display = display;
+    v->pixmap = pixmap;
+    v->pixmap_target = rectangle ? GL_TEXTURE_RECTANGLE_ARB : GL_TEXTURE_2D;
+    v->pixmap_y_inverted = inverted == True;
+    glGenTextures(1, &v->pixmap_texture);
+    glBindTexture(v->pixmap_target, v->pixmap_texture);
+    glTexParameteri(v->pixmap_target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(v->pixmap_target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(v->pixmap_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(v->pixmap_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+}
+#endif
+
+// Orphan the next PBO, map it and leave it bound, so that the uploads
+// that follow take offsets into it. NULL when there is none or mapping
+// failed: the uploads then read from client memory as usual.
+static uint8_t *pbo_map(video_t *v, size_t size) {
+    if (!v->num_pbos) return NULL;
+    v->BindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, v->pbos[v->next_pbo]);
+    v->next_pbo = (v->next_pbo + 1) % v->num_pbos;
+    // A new data store each time: the GPU may still be reading the old one
+    v->BufferData(GL_PIXEL_UNPACK_BUFFER_ARB, (GLsizeiptrARB)size, NULL, GL_STREAM_DRAW_ARB);
+    uint8_t *p = v->MapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+    if (!p) v->BindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    return p;
+}
+
+// Copy rows of a plane tightly packed into a mapped PBO
+static uint8_t *pbo_copy(uint8_t *dst, const uint8_t *src, int row_bytes, int rows, int stride) {
+    for (int y = 0; y < rows; y++, dst += row_bytes) memcpy(dst, src + (size_t)y * stride, row_bytes);
+    return dst;
+}
+
+// Unmap the PBO written, then queue the uploads from it
+static void pbo_unmap(video_t *v) {
+    v->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+}
+
+// Unbind the PBO once the uploads from it are queued
+static void pbo_unbind(video_t *v) {
+    v->BindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+}
+
 video_t *video_create(int width, int height) {
     video_t *v = calloc(1, sizeof(video_t));
     if (!v) return NULL;
@@ -157,18 +397,58 @@ video_t *video_create(int width, int height) {
     // Set optimized pixel store parameters
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    init_yuv_program(v);
+    init_pbos(v);
+#ifdef VAAPI_GLX
+    init_pixmap(v);
+#endif
     
+    // SDL_GL_SWAP_CONTROL as the driver took it
+    int swap_control = 0;
+    v->vsync = SDL_GL_GetAttribute(SDL_GL_SWAP_CONTROL, &swap_control) == 0 && swap_control > 0;
+
     // Test OpenGL by clearing and swapping buffers
     glClear(GL_COLOR_BUFFER_BIT);
     SDL_GL_SwapBuffers();
     
-    printf("OpenGL optimized: %dx%d window, video: %dx%d display: %dx%d at (%d,%d)\n", 
+    int pixmap = 0;
+#ifdef VAAPI_GLX
+    pixmap = v->pixmap != 0;
+#endif
+    printf("OpenGL optimized: %dx%d window, video: %dx%d display: %dx%d at (%d,%d)%s%s%s\n", 
            v->window_width, v->window_height, v->video_width, v->video_height, 
-           v->display_width, v->display_height, v->video_x, v->video_y);
+           v->display_width, v->display_height, v->video_x, v->video_y,
+           v->yuv_program ? ", YUV fragment program" : "", v->num_pbos ? ", PBO uploads" : "",
+           pixmap ? ", texture from pixmap" : "");
     
     return v;
 }
 
+// The stats overlay as a quad of its own size, on texture unit 0
+static void draw_osd(video_t *v) {
+    if (!v->osd_enabled || !v->osd_width) return;
+    float s = (float)v->osd_width / v->osd_texture_width;
+    float t = (float)v->osd_height / v->osd_texture_height;
+    float x0 = (float)v->video_x, y0 = (float)v->video_y;
+    float x1 = x0 + v->osd_width, y1 = y0 + v->osd_height;
+#ifdef MINIMAL_MEMORY_BUFFERS
+    glEnable(GL_TEXTURE_2D);
+#endif
+    glBindTexture(GL_TEXTURE_2D, v->osd_texture);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(x0, y0);
+    glTexCoord2f(s, 0); glVertex2f(x1, y0);
+    glTexCoord2f(s, t); glVertex2f(x1, y1);
+    glTexCoord2f(0, t); glVertex2f(x0, y1);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+#ifdef MINIMAL_MEMORY_BUFFERS
+    glDisable(GL_TEXTURE_2D);
+#endif
+}
+
 void video_draw(video_t *v, const uint8_t *rgb, int linesize) {
     if (!v || !rgb || linesize <= 0) return;
     
@@ -182,48 +462,51 @@ void video_draw(video_t *v, const uint8_t *rgb, int linesize) {
     // Bind texture only once per frame
     glBindTexture(GL_TEXTURE_2D, v->texture_id);
     
-    // Set pixel store parameters only if needed
-    if (linesize != v->video_width * 3) {
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize / 3);
-    }
-    
 #ifdef MINIMAL_MEMORY_BUFFERS
     // Enable texture only when needed
     glEnable(GL_TEXTURE_2D);
     
     // In low-memory mode, use smallest possible texture
-    if (v->texture_initialized) {
-        // Update existing texture
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, v->video_width, v->video_height,
-                        GL_RGB, GL_UNSIGNED_BYTE, rgb);
-    } else {
-        // First frame: allocate minimum texture
+    if (!v->texture_initialized) {
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, v->texture_width, v->texture_height,
                      0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, v->video_width, v->video_height,
-                        GL_RGB, GL_UNSIGNED_BYTE, rgb);
         v->texture_initialized = 1;
     }
-    
-    // Draw and disable texture to save state
-    glCallList(v->display_list_id);
-    glDisable(GL_TEXTURE_2D);
 #else
-    // Use glTexSubImage2D for better performance after first frame
-    if (v->texture_initialized) {
-        // Upload only the video region into the POT texture
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, v->video_width, v->video_height,
-                        GL_RGB, GL_UNSIGNED_BYTE, rgb);
-    } else {
-        // First frame: allocate full power-of-two texture but upload video data into it
+    // First frame: allocate full power-of-two texture, the video goes
+    // into its lower-left corner
+    if (!v->texture_initialized) {
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, v->texture_width, v->texture_height,
                      0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-        // Upload the video into the lower-left corner of the POT texture
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, v->video_width, v->video_height,
-                        GL_RGB, GL_UNSIGNED_BYTE, rgb);
         v->texture_initialized = 1;
     }
 #endif
+
+    // Through a PBO the upload reads the copy there, tightly packed
+    const uint8_t *pixels = rgb;
+    uint8_t *pbo = pbo_map(v, (size_t)min_linesize * v->video_height);
+    if (pbo) {
+        pbo_copy(pbo, rgb, min_linesize, v->video_height, linesize);
+        pbo_unmap(v);
+        pixels = NULL;
+        linesize = min_linesize;
+    }
+    
+    // Set pixel store parameters only if needed
+    if (linesize != v->video_width * 3) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, linesize / 3);
+    }
+    
+    // Upload only the video region
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, v->video_width, v->video_height,
+                    GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    if (pbo) pbo_unbind(v);
+    
+#ifdef MINIMAL_MEMORY_BUFFERS
+    // Draw and disable texture to save state
+    glCallList(v->display_list_id);
+    glDisable(GL_TEXTURE_2D);
+#endif
     
     // Reset row length if it was changed
     if (linesize != v->video_width * 3) {
@@ -235,13 +518,141 @@ void video_draw(video_t *v, const uint8_t *rgb, int linesize) {
     
     // Use pre-compiled display list for maximum performance
     glCallList(v->display_list_id);
+    draw_osd(v);
     
     // Swap buffers to display the frame
-    SDL_GL_SwapBuffers();
+    swap_buffers(v);
+}
+
+// Textures are uploaded as GL_RGB
+yuv2rgb_format_t video_pixel_format(video_t *v) {
+    (void)v;
+    return YUV2RGB_RGB24;
+}
+
+void video_draw_native(video_t *v, const uint8_t *pixels, int linesize) {
+    video_draw(v, pixels, linesize);
+}
+
+// Upload one plane into its texture: the picture's planes are the lower
+// left corner of textures of the RGB texture's size (half for chroma), so
+// all three share the display list's texture coordinates
+static void upload_plane(GLuint texture, int w, int h, const uint8_t *plane, int stride) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_LUMINANCE, GL_UNSIGNED_BYTE, plane);
+}
+
+int video_draw_yuv(video_t *v, int width, int height,
+                   const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                   int y_stride, int uv_stride) {
+    if (!v || !v->yuv_program || width != v->video_width || height != v->video_height) return -1;
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    if (!v->yuv_textures_initialized) {
+        for (int i = 0; i < 3; i++) {
+            int tw = i ? (v->texture_width + 1) / 2 : v->texture_width;
+            int th = i ? (v->texture_height + 1) / 2 : v->texture_height;
+            glBindTexture(GL_TEXTURE_2D, v->yuv_textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, tw, th, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+        }
+        v->yuv_textures_initialized = 1;
+    }
+
+    // Through a PBO the three planes follow each other in it, the uploads
+    // take their offsets
+    uint8_t *pbo = pbo_map(v, (size_t)width * height + 2 * (size_t)cw * ch);
+    if (pbo) {
+        uint8_t *end = pbo_copy(pbo, y_plane, width, height, y_stride);
+        end = pbo_copy(end, u_plane, cw, ch, uv_stride);
+        pbo_copy(end, v_plane, cw, ch, uv_stride);
+        pbo_unmap(v);
+        y_plane = NULL;
+        u_plane = (const uint8_t *)(uintptr_t)((size_t)width * height);
+        v_plane = (const uint8_t *)(uintptr_t)((size_t)width * height + (size_t)cw * ch);
+        y_stride = width;
+        uv_stride = cw;
+    }
+
+    v->ActiveTexture(GL_TEXTURE2_ARB);
+    upload_plane(v->yuv_textures[2], cw, ch, v_plane, uv_stride);
+    v->ActiveTexture(GL_TEXTURE1_ARB);
+    upload_plane(v->yuv_textures[1], cw, ch, u_plane, uv_stride);
+    v->ActiveTexture(GL_TEXTURE0_ARB);
+    upload_plane(v->yuv_textures[0], width, height, y_plane, y_stride);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (pbo) pbo_unbind(v);
+
+    glEnable(GL_FRAGMENT_PROGRAM_ARB);
+    v->BindProgram(GL_FRAGMENT_PROGRAM_ARB, v->yuv_program);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glCallList(v->display_list_id);
+    glDisable(GL_FRAGMENT_PROGRAM_ARB);
+
+    // Leave unit 0 with the RGB texture for video_draw()
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+    draw_osd(v);
+    swap_buffers(v);
+    return 0;
+}
+
+int video_draw_pixmap(video_t *v, video_put_fn put, void *user) {
+#ifdef VAAPI_GLX
+    if (!v || !v->pixmap || put(v->pixmap, v->display_width, v->display_height, user) < 0) return -1;
+
+    // The X rendering into the pixmap is done before GL samples it
+    glXWaitX();
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(v->pixmap_target);
+    glBindTexture(v->pixmap_target, v->pixmap_texture);
+    v->BindTexImage(v->x_display, v->glx_pixmap, GLX_FRONT_LEFT_EXT, NULL);
+    // Rectangle textures take texel coordinates; rows are bottom first
+    // unless the config says otherwise
+    int rectangle = v->pixmap_target != GL_TEXTURE_2D;
+    float s = rectangle ? (float)v->display_width : 1.0f;
+    float t = rectangle ? (float)v->display_height : 1.0f;
+    float t_top = v->pixmap_y_inverted ? 0.0f : t, t_bottom = v->pixmap_y_inverted ? t : 0.0f;
+    float x0 = (float)v->video_x, y0 = (float)v->video_y;
+    float x1 = x0 + v->display_width, y1 = y0 + v->display_height;
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, t_top); glVertex2f(x0, y0);
+    glTexCoord2f(s, t_top); glVertex2f(x1, y0);
+    glTexCoord2f(s, t_bottom); glVertex2f(x1, y1);
+    glTexCoord2f(0, t_bottom); glVertex2f(x0, y1);
+    glEnd();
+    v->ReleaseTexImage(v->x_display, v->glx_pixmap, GLX_FRONT_LEFT_EXT);
+#ifndef MINIMAL_MEMORY_BUFFERS
+    if (rectangle)
+#endif
+        glDisable(v->pixmap_target);
+
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+    draw_osd(v);
+    swap_buffers(v);
+    return 0;
+#else
+    (void)v; (void)put; (void)user;
+    return -1;
+#endif
+}
+
+// Textures are only reached through uploads
+uint8_t *video_lock_native(video_t *v, int *linesize, int *width, int *height) {
+    (void)v; (void)linesize; (void)width; (void)height;
+    return NULL;
+}
+
+void video_unlock_native(video_t *v) {
+    (void)v;
+}
+
+int video_vsync(video_t *v) {
+    return v->vsync;
 }
 
 int video_poll(video_t *v) {
-    (void)v; // Suppress unused parameter warning
     
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
@@ -253,6 +664,9 @@ int video_poll(video_t *v) {
                     event.key.keysym.sym == SDLK_q) {
                     return 1; // Signal to quit
                 }
+                if (event.key.keysym.sym == SDLK_i) v->osd_enabled = !v->osd_enabled;
+                if (event.key.keysym.sym == SDLK_PAGEUP || event.key.keysym.sym == SDLK_UP) v->channel_step = -1;
+                if (event.key.keysym.sym == SDLK_PAGEDOWN || event.key.keysym.sym == SDLK_DOWN) v->channel_step = 1;
                 break;
         }
     }
@@ -260,6 +674,50 @@ int video_poll(video_t *v) {
     return 0; // Continue running
 }
 
+int video_channel_step(video_t *v) {
+    if (!v) return 0;
+    int step = v->channel_step;
+    v->channel_step = 0;
+    return step;
+}
+
+int video_osd_enabled(video_t *v) {
+    return v && v->osd_enabled;
+}
+
+void video_set_osd(video_t *v, const char *text) {
+    if (!v) return;
+    if (!text) text = "";
+    if (strcmp(text, v->osd_text) == 0) return;
+    snprintf(v->osd_text, sizeof(v->osd_text), "%s", text);
+    v->osd_width = v->osd_height = 0;
+    if (!v->osd_text[0]) return;
+
+    // Font pixels are scaled with the picture, the box is not clipped
+    int scale = v->display_height >= 720 ? 2 : 1, width, height;
+    osd_measure(v->osd_text, scale, &width, &height);
+    int tw = next_power_of_2(width), th = next_power_of_2(height);
+    uint8_t *pixels = malloc((size_t)tw * th);
+    if (!pixels) return;
+    osd_draw(pixels, tw, 1, tw, th, 0, 0, scale, v->osd_text, 255, 0);
+
+    if (!v->osd_texture) {
+        glGenTextures(1, &v->osd_texture);
+        glBindTexture(GL_TEXTURE_2D, v->osd_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, v->osd_texture);
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, tw, th, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+    free(pixels);
+    v->osd_width = width;
+    v->osd_height = height;
+    v->osd_texture_width = tw;
+    v->osd_texture_height = th;
+}
+
 void video_destroy(video_t *v) {
     if (!v) return;
     
@@ -267,9 +725,203 @@ void video_destroy(video_t *v) {
         glDeleteTextures(1, &v->texture_id);
     }
     
+    if (v->osd_texture) {
+        glDeleteTextures(1, &v->osd_texture);
+    }
+
     if (v->display_list_id) {
         glDeleteLists(v->display_list_id, 1);
     }
+
+    if (v->yuv_program) {
+        glDeleteTextures(3, v->yuv_textures);
+        v->DeletePrograms(1, &v->yuv_program);
+    }
+
+    if (v->num_pbos) {
+        v->DeleteBuffers(v->num_pbos, v->pbos);
+    }
+
+#ifdef VAAPI_GLX
+    if (v->pixmap) {
+        glDeleteTextures(1, &v->pixmap_texture);
+        glXDestroyPixmap(v->x_display, v->glx_pixmap);
+        XFreePixmap(v->x_display, v->pixmap);
+    }
+#endif
     
     free(v);
 }
+
+// Mosaic: a video_t of the window's size holds the GL state, the YUV
+// program and the PBO-free uploads of upload_plane(); each tile has
+// textures of its own, sized for its pictures
+typedef struct {
+    int width, height;          // Of its pictures, 0 before the first
+    int texture_width, texture_height;
+    GLuint textures[3];         // Y, U, V, or RGB in [0] without the YUV program
+    uint8_t *rgb;               // Converted picture without the YUV program
+    float x0, y0, x1, y1;       // Quad in the cell
+} mosaic_tile_t;
+
+struct video_mosaic_t {
+    video_t *v;
+    int cols, rows;
+    int cell_width, cell_height;
+    mosaic_tile_t *tiles;
+};
+
+video_mosaic_t *video_mosaic_create(int cols, int rows) {
+    SDL_Surface *screen = SDL_GetVideoSurface();
+    if (!screen || cols <= 0 || rows <= 0) return NULL;
+    video_mosaic_t *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->tiles = calloc((size_t)cols * rows, sizeof(mosaic_tile_t));
+    m->v = m->tiles ? video_create(screen->w, screen->h) : NULL;
+    if (!m->v) {
+        free(m->tiles);
+        free(m);
+        return NULL;
+    }
+    m->cols = cols;
+    m->rows = rows;
+    m->cell_width = screen->w / cols;
+    m->cell_height = screen->h / rows;
+    return m;
+}
+
+void video_mosaic_cell_size(video_mosaic_t *m, int *width, int *height) {
+    *width = m->cell_width;
+    *height = m->cell_height;
+}
+
+// New picture size: textures and a quad fitting the cell, aspect kept
+static int resize_tile(video_mosaic_t *m, int tile, int width, int height) {
+    video_t *v = m->v;
+    mosaic_tile_t *t = &m->tiles[tile];
+    int planes = v->yuv_program ? 3 : 1;
+    if (!t->textures[0]) {
+        glGenTextures(planes, t->textures);
+        for (int i = 0; i < planes; i++) {
+            glBindTexture(GL_TEXTURE_2D, t->textures[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+    t->texture_width = next_power_of_2(width);
+    t->texture_height = next_power_of_2(height);
+    if (v->yuv_program) {
+        for (int i = 0; i < 3; i++) {
+            int tw = i ? (t->texture_width + 1) / 2 : t->texture_width;
+            int th = i ? (t->texture_height + 1) / 2 : t->texture_height;
+            glBindTexture(GL_TEXTURE_2D, t->textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, tw, th, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+        }
+    } else {
+        uint8_t *rgb = realloc(t->rgb, (size_t)width * height * 3);
+        if (!rgb) return -1;
+        t->rgb = rgb;
+        glBindTexture(GL_TEXTURE_2D, t->textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, t->texture_width, t->texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+
+    int cell_x = tile % m->cols * m->cell_width, cell_y = tile / m->cols * m->cell_height;
+    int w = m->cell_width, h = (int)((float)m->cell_width * height / width);
+    if (h > m->cell_height) {
+        h = m->cell_height;
+        w = (int)((float)m->cell_height * width / height);
+    }
+    t->x0 = (float)(cell_x + (m->cell_width - w) / 2);
+    t->y0 = (float)(cell_y + (m->cell_height - h) / 2);
+    t->x1 = t->x0 + w;
+    t->y1 = t->y0 + h;
+    t->width = width;
+    t->height = height;
+    return 0;
+}
+
+void video_mosaic_tile(video_mosaic_t *m, int tile, int width, int height,
+                       const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                       int y_stride, int uv_stride) {
+    if (!m || tile < 0 || tile >= m->cols * m->rows || width <= 0 || height <= 0) return;
+    video_t *v = m->v;
+    mosaic_tile_t *t = &m->tiles[tile];
+    if ((width != t->width || height != t->height) && resize_tile(m, tile, width, height) < 0) {
+        t->width = 0;
+        return;
+    }
+    if (v->yuv_program) {
+        int cw = (width + 1) / 2, ch = (height + 1) / 2;
+        v->ActiveTexture(GL_TEXTURE2_ARB);
+        upload_plane(t->textures[2], cw, ch, v_plane, uv_stride);
+        v->ActiveTexture(GL_TEXTURE1_ARB);
+        upload_plane(t->textures[1], cw, ch, u_plane, uv_stride);
+        v->ActiveTexture(GL_TEXTURE0_ARB);
+        upload_plane(t->textures[0], width, height, y_plane, y_stride);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    } else {
+        yuv420_to_rgb(YUV2RGB_RGB24, width, height, y_plane, u_plane, v_plane,
+                      y_stride, uv_stride, uv_stride, t->rgb, width * 3);
+        glBindTexture(GL_TEXTURE_2D, t->textures[0]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, t->rgb);
+    }
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+}
+
+void video_mosaic_present(video_mosaic_t *m) {
+    if (!m) return;
+    video_t *v = m->v;
+    glClear(GL_COLOR_BUFFER_BIT);
+#ifdef MINIMAL_MEMORY_BUFFERS
+    glEnable(GL_TEXTURE_2D);
+#endif
+    if (v->yuv_program) {
+        glEnable(GL_FRAGMENT_PROGRAM_ARB);
+        v->BindProgram(GL_FRAGMENT_PROGRAM_ARB, v->yuv_program);
+    }
+    glColor3f(1.0f, 1.0f, 1.0f);
+    for (int i = 0; i < m->cols * m->rows; i++) {
+        const mosaic_tile_t *t = &m->tiles[i];
+        if (!t->width) continue;
+        if (v->yuv_program) {
+            v->ActiveTexture(GL_TEXTURE2_ARB);
+            glBindTexture(GL_TEXTURE_2D, t->textures[2]);
+            v->ActiveTexture(GL_TEXTURE1_ARB);
+            glBindTexture(GL_TEXTURE_2D, t->textures[1]);
+            v->ActiveTexture(GL_TEXTURE0_ARB);
+        }
+        glBindTexture(GL_TEXTURE_2D, t->textures[0]);
+        float s = (float)t->width / t->texture_width, u = (float)t->height / t->texture_height;
+        glBegin(GL_QUADS);
+        glTexCoord2f(0, 0); glVertex2f(t->x0, t->y0);
+        glTexCoord2f(s, 0); glVertex2f(t->x1, t->y0);
+        glTexCoord2f(s, u); glVertex2f(t->x1, t->y1);
+        glTexCoord2f(0, u); glVertex2f(t->x0, t->y1);
+        glEnd();
+    }
+    if (v->yuv_program) glDisable(GL_FRAGMENT_PROGRAM_ARB);
+    glBindTexture(GL_TEXTURE_2D, v->texture_id);
+#ifdef MINIMAL_MEMORY_BUFFERS
+    glDisable(GL_TEXTURE_2D);
+#endif
+    swap_buffers(v);
+}
+
+int video_mosaic_poll(video_mosaic_t *m) {
+    return m ? video_poll(m->v) : 1;
+}
+
+void video_mosaic_destroy(video_mosaic_t *m) {
+    if (!m) return;
+    for (int i = 0; i < m->cols * m->rows; i++) {
+        mosaic_tile_t *t = &m->tiles[i];
+        if (t->textures[0]) glDeleteTextures(m->v->yuv_program ? 3 : 1, t->textures);
+        free(t->rgb);
+    }
+    video_destroy(m->v);
+    free(m->tiles);
+    free(m);
+}
@@ -1,5 +1,8 @@
 #include "../include/video.h"
+#include "../include/yuv2rgb.h"
+#include "../include/osd.h"
 #include <SDL/SDL.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -18,6 +21,22 @@ struct video_t {
     // Reuse memory for row operations to reduce allocations
     uint8_t *row_buffer;
 #endif
+    // Where video_lock_native() has the picture drawn: its own size, or
+    // scaled down to fit the window when it is larger
+    int draw_x, draw_y, draw_width, draw_height;
+    int clears_left;        // frames to clear around the video (both
+                            // buffers of a double-buffered surface)
+
+    // YV12 overlay the pictures go to when it is done in hardware: the
+    // display (Xv, framebuffer scaler) converts and scales to overlay_rect
+    SDL_Overlay *overlay;
+    SDL_Rect overlay_rect;
+    int overlay_failed;
+
+    // Stats overlay (video_set_osd)
+    int osd_enabled;
+    int channel_step;           // Channel key since video_channel_step()
+    char osd_text[OSD_TEXT_MAX];
 };
 
 video_t *video_create(int width, int height) {
@@ -62,6 +81,25 @@ video_t *video_create(int width, int height) {
     v->screen_pixels = (uint8_t *)v->screen->pixels;
     v->screen_pitch = v->screen->pitch;
     v->bytes_per_pixel = v->screen->format->BytesPerPixel;
+    v->clears_left = 2;
+
+    // Pictures larger than the window are converted at the size they fit
+    // it in instead of cropped
+    v->draw_width = v->video_width;
+    v->draw_height = v->video_height;
+    if (v->draw_width > v->window_width || v->draw_height > v->window_height) {
+        if ((long)v->window_width * height > (long)v->window_height * width) {
+            v->draw_height = v->window_height;
+            v->draw_width = (int)((long)v->window_height * width / height);
+        } else {
+            v->draw_width = v->window_width;
+            v->draw_height = (int)((long)v->window_width * height / width);
+        }
+        if (v->draw_width < 1) v->draw_width = 1;
+        if (v->draw_height < 1) v->draw_height = 1;
+    }
+    v->draw_x = (v->window_width - v->draw_width) / 2;
+    v->draw_y = v->window_height - v->draw_height;
     
     printf("SDL optimized: %dx%d window, video: %dx%d at (%d,%d), copy: %dx%d\n", 
            v->window_width, v->window_height, v->video_width, v->video_height, 
@@ -78,6 +116,19 @@ video_t *video_create(int width, int height) {
     return v;
 }
 
+// Font pixels of the stats overlay per picture pixel
+static int osd_scale(int height) {
+    return height >= 720 ? 2 : 1;
+}
+
+// The stats overlay over the top left corner of the w x h area at (x, y)
+// of the locked surface
+static void draw_osd(video_t *v, int x, int y, int w, int h) {
+    if (!v->osd_enabled || !v->osd_text[0]) return;
+    osd_draw(v->screen_pixels + y * v->screen_pitch + x * v->bytes_per_pixel, v->screen_pitch, v->bytes_per_pixel,
+             w, h, 0, 0, osd_scale(h), v->osd_text, 255, 0);
+}
+
 void video_draw(video_t *v, const uint8_t *rgb, int linesize) {
     if (!v || !v->screen || !rgb || linesize <= 0) return;
     
@@ -159,6 +210,7 @@ void video_draw(video_t *v, const uint8_t *rgb, int linesize) {
         SDL_Rect fallback_rect = {v->video_x, v->video_y, v->copy_width, v->copy_height};
         SDL_FillRect(v->screen, &fallback_rect, SDL_MapRGB(v->screen->format, 64, 64, 64));
     }
+    if (bytes_per_pixel == 3 || bytes_per_pixel == 4) draw_osd(v, v->video_x, v->video_y, v->copy_width, v->copy_height);
     
     // Unlock surface
     if (SDL_MUSTLOCK(v->screen)) {
@@ -169,6 +221,143 @@ void video_draw(video_t *v, const uint8_t *rgb, int linesize) {
     SDL_Flip(v->screen);
 }
 
+// 24-bit surfaces are B, G, R in memory and 32-bit ones B, G, R, A, as
+// video_draw() writes them
+yuv2rgb_format_t video_pixel_format(video_t *v) {
+    if (v && v->bytes_per_pixel == 4) return YUV2RGB_BGRA32;
+    if (v && v->bytes_per_pixel == 3) return YUV2RGB_BGR24;
+    return YUV2RGB_RGB24;
+}
+
+void video_draw_native(video_t *v, const uint8_t *pixels, int linesize) {
+    if (!v || !v->screen || !pixels || linesize <= 0) return;
+    const int bytes_per_pixel = v->bytes_per_pixel;
+    // Other depths get RGB24 and video_draw()'s fallback
+    if (bytes_per_pixel != 3 && bytes_per_pixel != 4) {
+        video_draw(v, pixels, linesize);
+        return;
+    }
+    if (linesize < v->video_width * bytes_per_pixel) return;
+
+    if (SDL_MUSTLOCK(v->screen)) {
+        if (SDL_LockSurface(v->screen) < 0) return;
+    }
+#ifdef MINIMAL_MEMORY_BUFFERS
+    SDL_Rect clear_rect = {0, 0, v->window_width, v->window_height};
+    SDL_FillRect(v->screen, &clear_rect, 0);
+#else
+    memset(v->screen_pixels, 0, v->screen_pitch * v->window_height);
+#endif
+
+    // Same layout as the surface: a row copy each
+    for (int y = 0; y < v->copy_height; y++) {
+        memcpy(v->screen_pixels + (v->video_y + y) * v->screen_pitch + v->video_x * bytes_per_pixel,
+               pixels + y * linesize, (size_t)v->copy_width * bytes_per_pixel);
+    }
+    draw_osd(v, v->video_x, v->video_y, v->copy_width, v->copy_height);
+
+    if (SDL_MUSTLOCK(v->screen)) {
+        SDL_UnlockSurface(v->screen);
+    }
+    SDL_Flip(v->screen);
+}
+
+// Create the overlay on the first picture. Only a hardware one is kept:
+// a software overlay would be one more conversion on the CPU.
+static int open_overlay(video_t *v) {
+    if (v->overlay) return 0;
+    if (v->overlay_failed) return -1;
+    v->overlay = SDL_CreateYUVOverlay(v->video_width, v->video_height, SDL_YV12_OVERLAY, v->screen);
+    if (!v->overlay || !v->overlay->hw_overlay || v->overlay->planes != 3) {
+        if (v->overlay) SDL_FreeYUVOverlay(v->overlay);
+        v->overlay = NULL;
+        v->overlay_failed = 1;
+        return -1;
+    }
+
+    // Scaled to fit the window, keeping the aspect ratio
+    int w = v->window_width, h = v->window_height;
+    if ((long)w * v->video_height > (long)h * v->video_width) w = (int)((long)h * v->video_width / v->video_height);
+    else h = (int)((long)w * v->video_height / v->video_width);
+    v->overlay_rect.x = (Sint16)((v->window_width - w) / 2);
+    v->overlay_rect.y = (Sint16)((v->window_height - h) / 2);
+    v->overlay_rect.w = (Uint16)w;
+    v->overlay_rect.h = (Uint16)h;
+
+    SDL_FillRect(v->screen, NULL, 0);
+    SDL_Flip(v->screen);
+    printf("SDL: hardware YV12 overlay, %dx%d at (%d,%d)\n", w, h, v->overlay_rect.x, v->overlay_rect.y);
+    return 0;
+}
+
+static void copy_plane(uint8_t *dst, int dst_pitch, const uint8_t *src, int stride, int w, int h) {
+    for (int y = 0; y < h; y++) memcpy(dst + y * dst_pitch, src + y * stride, w);
+}
+
+int video_draw_yuv(video_t *v, int width, int height,
+                   const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                   int y_stride, int uv_stride) {
+    if (!v || width != v->video_width || height != v->video_height || open_overlay(v) < 0) return -1;
+    if (SDL_LockYUVOverlay(v->overlay) < 0) return -1;
+    // YV12 is Y, then V, then U
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    copy_plane(v->overlay->pixels[0], v->overlay->pitches[0], y_plane, y_stride, width, height);
+    copy_plane(v->overlay->pixels[1], v->overlay->pitches[1], v_plane, uv_stride, cw, ch);
+    copy_plane(v->overlay->pixels[2], v->overlay->pitches[2], u_plane, uv_stride, cw, ch);
+    if (v->osd_enabled && v->osd_text[0]) {
+        // Luma text, on a box of neutral chroma
+        int scale = osd_scale(height), box_width, box_height;
+        osd_draw(v->overlay->pixels[0], v->overlay->pitches[0], 1, width, height, 0, 0, scale, v->osd_text, 235, 16);
+        osd_measure(v->osd_text, scale, &box_width, &box_height);
+        for (int y = 0; y < (box_height + 1) / 2 && y < ch; y++) {
+            int n = (box_width + 1) / 2 < cw ? (box_width + 1) / 2 : cw;
+            memset(v->overlay->pixels[1] + y * v->overlay->pitches[1], 128, (size_t)n);
+            memset(v->overlay->pixels[2] + y * v->overlay->pitches[2], 128, (size_t)n);
+        }
+    }
+    SDL_UnlockYUVOverlay(v->overlay);
+    SDL_DisplayYUVOverlay(v->overlay, &v->overlay_rect);
+    return 0;
+}
+
+// No GL: pictures in GPU surfaces are downloaded instead
+int video_draw_pixmap(video_t *v, video_put_fn put, void *user) {
+    (void)v; (void)put; (void)user;
+    return -1;
+}
+
+uint8_t *video_lock_native(video_t *v, int *linesize, int *width, int *height) {
+    if (!v || !v->screen || (v->bytes_per_pixel != 3 && v->bytes_per_pixel != 4)) return NULL;
+    if (SDL_MUSTLOCK(v->screen)) {
+        if (SDL_LockSurface(v->screen) < 0) return NULL;
+    }
+    // The video area is written whole every frame: the rest of the
+    // surface only needs clearing at the start
+    if (v->clears_left > 0) {
+        memset(v->screen_pixels, 0, v->screen_pitch * v->window_height);
+        v->clears_left--;
+    }
+    *linesize = v->screen_pitch;
+    *width = v->draw_width;
+    *height = v->draw_height;
+    return v->screen_pixels + v->draw_y * v->screen_pitch + v->draw_x * v->bytes_per_pixel;
+}
+
+void video_unlock_native(video_t *v) {
+    draw_osd(v, v->draw_x, v->draw_y, v->draw_width, v->draw_height);
+    if (SDL_MUSTLOCK(v->screen)) {
+        SDL_UnlockSurface(v->screen);
+    }
+    SDL_Flip(v->screen);
+}
+
+// SDL_Flip() only waits for the refresh on a double-buffered hardware
+// surface; overlays are shown at once
+int video_vsync(video_t *v) {
+    Uint32 flip = SDL_HWSURFACE | SDL_DOUBLEBUF;
+    return (v->screen->flags & flip) == flip && !v->overlay;
+}
+
 int video_poll(video_t *v) {
     if (!v) return 1;
     
@@ -182,6 +371,9 @@ int video_poll(video_t *v) {
                     event.key.keysym.sym == SDLK_q) {
                     return 1; // Signal to quit
                 }
+                if (event.key.keysym.sym == SDLK_i) v->osd_enabled = !v->osd_enabled;
+                if (event.key.keysym.sym == SDLK_PAGEUP || event.key.keysym.sym == SDLK_UP) v->channel_step = -1;
+                if (event.key.keysym.sym == SDLK_PAGEDOWN || event.key.keysym.sym == SDLK_DOWN) v->channel_step = 1;
                 break;
         }
     }
@@ -189,8 +381,28 @@ int video_poll(video_t *v) {
     return 0; // Continue running
 }
 
+int video_channel_step(video_t *v) {
+    if (!v) return 0;
+    int step = v->channel_step;
+    v->channel_step = 0;
+    return step;
+}
+
+int video_osd_enabled(video_t *v) {
+    return v && v->osd_enabled;
+}
+
+void video_set_osd(video_t *v, const char *text) {
+    if (!v) return;
+    snprintf(v->osd_text, sizeof(v->osd_text), "%s", text ? text : "");
+}
+
 void video_destroy(video_t *v) {
     if (!v) return;
+
+    if (v->overlay) {
+        SDL_FreeYUVOverlay(v->overlay);
+    }
     
 #ifdef MINIMAL_MEMORY_BUFFERS
     if (v->row_buffer) {
@@ -200,3 +412,73 @@ void video_destroy(video_t *v) {
     
     free(v);
 }
+
+// Mosaic: tiles are converted straight into the surface, scaled to their
+// cell, through a video_t of the window's size
+struct video_mosaic_t {
+    video_t *v;
+    int cols, rows;
+    int cell_width, cell_height;
+};
+
+video_mosaic_t *video_mosaic_create(int cols, int rows) {
+    SDL_Surface *screen = SDL_GetVideoSurface();
+    if (!screen || cols <= 0 || rows <= 0) return NULL;
+    video_mosaic_t *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->v = video_create(screen->w, screen->h);
+    if (!m->v || (m->v->bytes_per_pixel != 3 && m->v->bytes_per_pixel != 4)) {
+        video_destroy(m->v);
+        free(m);
+        return NULL;
+    }
+    m->cols = cols;
+    m->rows = rows;
+    m->cell_width = screen->w / cols;
+    m->cell_height = screen->h / rows;
+    return m;
+}
+
+void video_mosaic_cell_size(video_mosaic_t *m, int *width, int *height) {
+    *width = m->cell_width;
+    *height = m->cell_height;
+}
+
+void video_mosaic_tile(video_mosaic_t *m, int tile, int width, int height,
+                       const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                       int y_stride, int uv_stride) {
+    if (!m || tile < 0 || tile >= m->cols * m->rows || width <= 0 || height <= 0) return;
+    video_t *v = m->v;
+    int w = m->cell_width, h = (int)((long)m->cell_width * height / width);
+    if (h > m->cell_height) {
+        h = m->cell_height;
+        w = (int)((long)m->cell_height * width / height);
+    }
+    if (w < 1 || h < 1) return;
+    int x = tile % m->cols * m->cell_width + (m->cell_width - w) / 2;
+    int y = tile / m->cols * m->cell_height + (m->cell_height - h) / 2;
+    if (SDL_MUSTLOCK(v->screen) && SDL_LockSurface(v->screen) < 0) return;
+    if (v->clears_left > 0) {
+        memset(v->screen_pixels, 0, v->screen_pitch * v->window_height);
+        v->clears_left--;
+    }
+    yuv420_to_rgb_scaled(video_pixel_format(v), YUV2RGB_BILINEAR, width, height,
+                         y_plane, u_plane, v_plane, y_stride, uv_stride, uv_stride,
+                         v->screen_pixels + y * v->screen_pitch + x * v->bytes_per_pixel,
+                         w, h, v->screen_pitch);
+    if (SDL_MUSTLOCK(v->screen)) SDL_UnlockSurface(v->screen);
+}
+
+void video_mosaic_present(video_mosaic_t *m) {
+    if (m) SDL_Flip(m->v->screen);
+}
+
+int video_mosaic_poll(video_mosaic_t *m) {
+    return m ? video_poll(m->v) : 1;
+}
+
+void video_mosaic_destroy(video_mosaic_t *m) {
+    if (!m) return;
+    video_destroy(m->v);
+    free(m);
+}
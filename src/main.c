@@ -2,7 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <curl/curl.h>
 
 #ifndef NO_FFMPEG
@@ -10,37 +12,54 @@
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
+#include "../include/hwaccel.h"
+#include "../include/hls_avio.h"
 #endif
 
 #include <SDL/SDL.h>
+#ifdef VAAPI_GLX
+#include <X11/Xlib.h>
+#endif
 
 #include "../include/video.h"
 #include "../include/twitch.h"
 #include "../include/memory_pool.h"
 #include "../include/hls_demuxer.h"
-
-#ifdef USE_OPENH264
-#include "codecs/openh264/openh264_decoder.h"
-#endif
-
-#include "codecs/simple_h264/simple_h264.h"
-
-#ifdef USE_MPEG4
-#include "codecs/mpeg4/main.h"
-#endif
+#include "../include/ts_demux.h"
+#include "../include/fmp4_demux.h"
+#include "../include/nal_index.h"
+#include "../include/decoder.h"
+#include "../include/yuv2rgb.h"
+#include "../include/render_queue.h"
+#include "../include/present.h"
+#include "../include/packet_queue.h"
+#include "../include/pipeline.h"
+#include "../include/cpu.h"
+#include "../include/metrics.h"
+#include "../include/osd.h"
+#include "../include/trace.h"
+#include "../include/mosaic.h"
+#include "../include/preview.h"
+#include "../include/standby.h"
+#include "../include/bitstream.h"
 
 // Forward declarations
 int init_video_output(int width, int height);
-static void yuv420_to_rgb24(int width, int height,
-                           const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
-                           int y_stride, int u_stride, int v_stride,
-                           uint8_t *rgb, int rgb_stride);
 static uint64_t get_time_us();
-static int process_h264_nal_unit(const uint8_t *nal_data, size_t nal_len, const char *debug_prefix);
+static int process_h264_nal_unit(const uint8_t *nal_data, size_t nal_len);
 
 #ifdef BACKEND_OPENGL
 extern video_t *video_create(int width, int height);
 extern void video_draw(video_t *v, const uint8_t *rgb, int linesize);
+extern yuv2rgb_format_t video_pixel_format(video_t *v);
+extern void video_draw_native(video_t *v, const uint8_t *pixels, int linesize);
+extern uint8_t *video_lock_native(video_t *v, int *linesize, int *width, int *height);
+extern void video_unlock_native(video_t *v);
+extern int video_draw_yuv(video_t *v, int width, int height,
+                          const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
+                          int y_stride, int uv_stride);
+extern int video_draw_pixmap(video_t *v, video_put_fn put, void *user);
+extern int video_vsync(video_t *v);
 extern int video_poll(video_t *v);
 extern void video_destroy(video_t *v);
 #endif
@@ -53,24 +72,31 @@ static struct SwsContext *sws_ctx = NULL;
 static AVFrame *frame = NULL;
 static AVFrame *rgb_frame = NULL;
 static uint8_t *rgb_buffer = NULL;
-#else
-static uint8_t *rgb_buffer = NULL; // RGB buffer for custom conversion
+static int rgb_buffer_capacity = 0;
+static hwaccel_t *hwaccel = NULL; // ANHELO_HWACCEL: decoding on the GPU
+static hls_avio_t *hls_avio = NULL; // HLS fetched by our demuxer, read by libavformat
 #endif
 
 static video_t *video = NULL;
 static SDL_Surface *screen = NULL;
 
-// Custom decoders
-static simple_h264_decoder_t *h264_decoder = NULL;
-#ifdef USE_MPEG4
-static mpeg4_decoder_t *mpeg4_decoder = NULL;
-#endif
+// Threads converting bands of each picture (see show_picture)
+static yuv2rgb_threads_t *convert_threads = NULL;
+
+// Decoder for the HLS path (backend chosen per codec, see decoder.h)
+static decoder_t *decoder = NULL;
 
 // HLS demuxer
 static hls_demuxer_t *hls_demuxer = NULL;
-static int use_custom_decoder = 0; // 0=FFmpeg, 1=H.264, 2=MPEG-4
+static ts_demux_t *ts_demux = NULL; // MPEG-TS segments -> video PES
+static fmp4_demux_t *fmp4_demux = NULL; // fMP4/CMAF segments -> video samples
+static nal_index_t nal_index = {0};  // NAL units of the buffer being decoded
 static int use_hls_demuxer = 0;
-static int should_quit_hls = 0; // Quit flag for HLS playback
+static atomic_int should_quit_hls = 0; // Quit flag for HLS playback
+// HLS: pictures for the render thread, NULL while drawing on the decoding thread
+static render_queue_t *render_queue = NULL;
+static packet_queue_t *packet_queue = NULL; // Demuxed packets when demuxing has a thread of its own
+static pipeline_config_t pipeline;
 
 // Basic frame structure for custom decoders (when NO_FFMPEG is defined)
 #ifdef NO_FFMPEG
@@ -78,68 +104,199 @@ static int should_quit_hls = 0; // Quit flag for HLS playback
 #endif
 
 // Memory pools for optimization
-static frame_pool_t *frame_pool = NULL;
+static frame_pool_t *frame_pool = NULL; // Converted pictures (draw_converted)
 static memory_pool_t *string_pool = NULL;
 
 // Frame timing variables - optimized for smooth playbook
-static uint64_t last_frame_time = 0;
-static uint64_t frame_duration_us = 33333; // ~30 FPS in microseconds
+static uint64_t frame_duration_us = 33333; // ~30 FPS in microseconds; spacing of frames without a PTS
 #ifndef NO_FFMPEG
 static double frame_rate = 30.0; // Default frame rate (FFmpeg mode only)
 #endif
 static int frames_dropped = 0;
 static int frames_displayed = 0;
-#ifndef NO_FFMPEG
-static int skip_remaining = 0; // Runtime counter: skip this many decoded frames after last displayed frame (FFmpeg mode only)
-#endif
+static atomic_int frames_decoded = 0; // Pictures out of the decoder, shown or queued
+static uint64_t paced_us = 0; // Decoding thread's time waiting on frame pacing (excluded from decode load)
+static _Atomic uint64_t decode_busy_us = 0; // Decoding thread's time decoding packets, without paced_us
+static uint64_t inline_present_us = 0; // Decoding thread's time showing pictures itself (no render thread)
+static uint64_t demux_output_us = 0; // Demuxing thread's time handing packets on
+static atomic_int catching_up = 0; // HLS: drop non-reference frames until back near live
+static atomic_int skip_level = 0; // Decode-skip level, see update_skip_level()
+static int skip_level_applied = -1; // Level the decoder was last set to
+static int awaiting_rap = 0; // Fast start: nothing decoded before the first random access point
+static int channel_count = 0; // Channels being switched between (ANHELO_ZAP), 0 for one stream
+static atomic_int channel_step = 0; // Switch asked for: -1 previous, 1 next, 0 none
+static uint64_t switch_started_us = 0; // Channel switch waiting for its first picture
 
-// Simple clamp helper
-static inline uint8_t clamp_u8(int x) { return (x < 0) ? 0 : (x > 255 ? 255 : (uint8_t)x); }
+// Frame pacing sleep, accounted so decoder load can be measured without it.
+// On the render thread it is no time of the decoder's.
+static void pace_sleep(uint64_t us) {
+    usleep(us);
+    if (!render_queue) paced_us += us;
+}
+
+// Handle the window's events. Returns 1 when playback is to stop: for
+// quitting, or for another channel while switching between several.
+static int poll_window(void) {
+    if (!video) return 0;
+    if (video_poll(video)) return 1;
+    int step = video_channel_step(video);
+    if (!step || channel_count < 2) return 0;
+    channel_step = step;
+    return 1;
+}
 
-// Get current time in microseconds
+// Get current time in microseconds (monotonic: immune to wall-clock steps)
 static uint64_t get_time_us() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
 }
 
-// Convert YUV420P (planar) to RGB24
-static void yuv420_to_rgb24(int width, int height,
-                            const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane,
-                            int y_stride, int u_stride, int v_stride,
-                            uint8_t *rgb, int rgb_stride)
-{
-    for (int j = 0; j < height; ++j) {
-        const uint8_t *py = y_plane + j * y_stride;
-        const uint8_t *pu = u_plane + (j / 2) * u_stride;
-        const uint8_t *pv = v_plane + (j / 2) * v_stride;
-        uint8_t *prgb = rgb + j * rgb_stride;
-        
-        for (int i = 0; i < width; ++i) {
-            int y = py[i];
-            int u = pu[i / 2] - 128;
-            int v = pv[i / 2] - 128;
-            
-            int r = y + ((v * 359) >> 8);
-            int g = y - ((u * 88) >> 8) - ((v * 183) >> 8);
-            int b = y + ((u * 454) >> 8);
-            
-            prgb[i * 3 + 0] = clamp_u8(r);
-            prgb[i * 3 + 1] = clamp_u8(g);
-            prgb[i * 3 + 2] = clamp_u8(b);
+/* Pictures are shown at their PTS by the presentation scheduler
+ * (include/present.h), on the render thread when there is one.
+ *
+ * Decoders output pictures in display order, which with B-frames is not
+ * the order access units arrive in. Incoming PTS are kept sorted and each
+ * displayed picture takes the smallest. Frames without one are placed a
+ * frame duration after the previous frame.
+ */
+#define PTS_QUEUE_SIZE 16        // Enough for the deepest H.264 reorder
+#define PTS_WRAP (1LL << 33)
+
+static present_clock_t presenter;
+static int unpaced = 0;          // Max speed replay: pictures are shown as soon as decoded
+static int64_t pts_queue[PTS_QUEUE_SIZE];
+static int pts_queue_len = 0;
+static int64_t clock_last_pts = TS_NO_TIMESTAMP;
+static int64_t pending_pts = TS_NO_TIMESTAMP; // Of the access unit whose slices come next
+
+// An access unit with this PTS went into the decoder
+static void pts_queue_push(int64_t pts) {
+    pending_pts = pts;
+    if (pts == TS_NO_TIMESTAMP) return;
+    if (pts_queue_len == PTS_QUEUE_SIZE) {
+        // Pictures that never came out: forget the oldest
+        memmove(pts_queue, pts_queue + 1, (PTS_QUEUE_SIZE - 1) * sizeof(pts_queue[0]));
+        pts_queue_len--;
+    }
+    int i = pts_queue_len++;
+    while (i > 0 && pts_queue[i - 1] > pts) {
+        pts_queue[i] = pts_queue[i - 1];
+        i--;
+    }
+    pts_queue[i] = pts;
+}
+
+// The access unit with this PTS was left out: no picture will take it
+static void pts_queue_remove(int64_t pts) {
+    for (int i = 0; i < pts_queue_len; i++) {
+        if (pts_queue[i] != pts) continue;
+        memmove(pts_queue + i, pts_queue + i + 1, (size_t)(pts_queue_len - i - 1) * sizeof(pts_queue[0]));
+        pts_queue_len--;
+        return;
+    }
+}
+
+static int64_t pts_queue_pop(void) {
+    if (pts_queue_len == 0) return TS_NO_TIMESTAMP;
+    int64_t pts = pts_queue[0];
+    memmove(pts_queue, pts_queue + 1, (size_t)(pts_queue_len - 1) * sizeof(pts_queue[0]));
+    pts_queue_len--;
+    return pts;
+}
+
+/* Decode-skip levels: when pictures are shown late the decoder is given
+ * less work, a level at a time, rather than falling further behind. Each
+ * level includes the ones below:
+ *   1  no deblocking of non-reference pictures and lost macroblocks
+ *      copied from the reference picture (backends supporting it)
+ *   2  non-reference slices (nal_ref_idc == 0) left out
+ *   3  only IDR and recovery point pictures decoded
+ * The level goes up when a picture is late by more than SKIP_LATE_US,
+ * waiting SKIP_SETTLE_US between steps for the last one to take effect,
+ * and down again once pictures have been on time for SKIP_RECOVER_US.
+ * It is changed by the thread presenting pictures and taken up by the
+ * decoding thread before its next decode (use_decoder(), or
+ * set_ffmpeg_skip() when FFmpeg decodes).
+ */
+#define SKIP_LEVEL_MAX 3
+#define SKIP_LATE_US 100000
+#define SKIP_SETTLE_US 500000
+#define SKIP_RECOVER_US 3000000
+
+// Decoder work left out at a skip level. ANHELO_CONCEAL=copy always uses
+// the cheap concealment.
+static unsigned skip_flags(int level) {
+    const char *conceal = getenv("ANHELO_CONCEAL");
+    unsigned skip = 0;
+    if (level >= 1) skip |= DECODER_SKIP_NONREF_DEBLOCK | DECODER_SKIP_CONCEAL;
+    if (conceal && strcmp(conceal, "copy") == 0) skip |= DECODER_SKIP_CONCEAL;
+    return skip;
+}
+
+#ifndef NO_FFMPEG
+// The skip levels for libavcodec, which leaves out the same work for
+// H.264: non-reference pictures unfiltered, then not decoded, then all but
+// keyframes not decoded
+static void set_ffmpeg_skip(AVCodecContext *ctx, int level) {
+    ctx->skip_loop_filter = level >= 1 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    ctx->skip_frame = level >= 3 ? AVDISCARD_NONKEY : level >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+#endif
+
+static void set_skip_level(int level) {
+    skip_level = level;
+    printf("Decode-skip level %d\n", level);
+}
+
+// Adjust the skip level from how late (wait < 0) the current picture is
+static void update_skip_level(int64_t wait, uint64_t now) {
+    static uint64_t changed_us = 0; // Last level change
+    static uint64_t on_time_us = 0; // Start of the pictures on time, 0 if late
+    if (wait < -SKIP_LATE_US) {
+        on_time_us = 0;
+        if (skip_level < SKIP_LEVEL_MAX && now - changed_us >= SKIP_SETTLE_US) {
+            set_skip_level(skip_level + 1);
+            changed_us = now;
+        }
+    } else if (wait >= 0) {
+        if (!on_time_us) on_time_us = now;
+        if (skip_level > 0 && now - on_time_us >= SKIP_RECOVER_US && now - changed_us >= SKIP_RECOVER_US) {
+            set_skip_level(skip_level - 1);
+            changed_us = now;
         }
     }
 }
 
-// NAL unit type detection helper (using simple decoder)
-static inline int get_nal_unit_type(const uint8_t *nal_data, size_t nal_len) {
-    (void)nal_len; // unused
-    return (int)simple_h264_get_nal_type(nal_data);
+// PTS of the picture the decoder just output
+static int64_t next_picture_pts(void) {
+    int64_t pts = pts_queue_pop();
+    if (pts == TS_NO_TIMESTAMP) {
+        int64_t step = (int64_t)frame_duration_us * TS_CLOCK_HZ / 1000000;
+        pts = clock_last_pts == TS_NO_TIMESTAMP ? 0 : (clock_last_pts + step) % PTS_WRAP;
+    }
+    clock_last_pts = pts;
+    return pts;
+}
+
+// Schedule a picture with this PTS and wait until it is to be drawn; *late
+// is how late (negative: early) it will be shown. Returns -1 when it is
+// dropped instead.
+static int present_frame(int64_t pts, int64_t *late) {
+    uint64_t start;
+    if (unpaced) {
+        *late = 0;
+        return 0;
+    }
+    if (present_schedule(&presenter, pts, get_time_us(), &start, late) == PRESENT_DROP) return -1;
+    uint64_t now = get_time_us();
+    if (start > now) pace_sleep(start - now);
+    return 0;
 }
 
 // Check if NAL unit is a parameter set (SPS=7, PPS=8)
 static inline int is_parameter_set(int nal_type) {
-    return simple_h264_is_parameter_set((simple_h264_nal_type_t)nal_type);
+    return nal_type == 7 || nal_type == 8;
 }
 
 // Check if NAL unit is a slice (1-5)
@@ -147,566 +304,762 @@ static inline int is_slice(int nal_type) {
     return (nal_type >= 1 && nal_type <= 5);
 }
 
-// Enhanced H.264 NAL processing with simple decoder
-static int process_h264_nal_unit(const uint8_t *nal_data, size_t nal_len, const char *debug_prefix) {
-    if (!nal_data || nal_len == 0 || !h264_decoder) return 0;
-    
-    simple_h264_nal_type_t nal_type = simple_h264_get_nal_type(nal_data);
-    simple_h264_frame_t frame = {0};
-    
-    simple_h264_result_t result = simple_h264_decode(h264_decoder, nal_data, nal_len, &frame);
-    
-    // Enhanced debug output with NAL type information
-    printf("[DEBUG] %s NAL len=%zu type=%d result=%s pic=%p w=%u h=%u\n", 
-           debug_prefix, nal_len, nal_type, simple_h264_result_string(result), 
-           (void*)frame.y_plane, frame.width, frame.height);
-    fflush(stdout);
-    
-    // For parameter sets, dump hex data for analysis
-    if (simple_h264_is_parameter_set(nal_type)) {
-        printf("[DEBUG] ParamSet hex dump (first 16 bytes): ");
-        for (size_t i = 0; i < (nal_len < 16 ? nal_len : 16); i++) {
-            printf("%02x ", nal_data[i]);
+// Make `decoder` one for `codec` (DECODER_CAP_H264/MPEG4), replacing a
+// decoder for another codec. ANHELO_DECODER names a preferred backend.
+static decoder_t *use_decoder(unsigned codec) {
+    if (decoder && (decoder_backend(decoder)->caps & codec)) {
+        int level = skip_level;
+        if (level != skip_level_applied) decoder_set_skip(decoder, skip_flags(level));
+        skip_level_applied = level;
+        return decoder;
+    }
+    decoder_destroy(decoder);
+    decoder = decoder_create(codec, getenv("ANHELO_DECODER"));
+    if (decoder) printf("Decoder: %s\n", decoder_backend(decoder)->name);
+    else fprintf(stderr, "No decoder for this stream's codec\n");
+    skip_level_applied = skip_level;
+    if (decoder) decoder_set_skip(decoder, skip_flags(skip_level_applied));
+    // Live playback: output pictures as soon as the stream's reordering
+    // allows. ANHELO_LOW_LATENCY=0 waits for a full DPB instead.
+    const char *low_latency = getenv("ANHELO_LOW_LATENCY");
+    if (decoder) decoder_set_low_latency(decoder, !low_latency || strcmp(low_latency, "0") != 0);
+    // Fast preview on slow machines: ANHELO_GRAY=1 skips chroma,
+    // ANHELO_DECIMATE=2 or 4 shows pictures at half or quarter size
+    const char *gray = getenv("ANHELO_GRAY");
+    const char *decimate = getenv("ANHELO_DECIMATE");
+    unsigned output = 0;
+    if (gray && strcmp(gray, "0") != 0) output |= DECODER_OUTPUT_GRAY;
+    if (decimate && atoi(decimate) == 2) output |= DECODER_OUTPUT_HALF;
+    if (decimate && atoi(decimate) == 4) output |= DECODER_OUTPUT_QUARTER;
+    if (decoder && output) decoder_set_output(decoder, output);
+    return decoder;
+}
+
+static atomic_int decoder_delay = 0; // Pictures the decoder holds back, for the queue depth
+
+// Print the decoder's output delay whenever a new sequence changes it
+static void report_decoder_delay(void) {
+    static int reported = -1;
+    int delay = decoder_get_delay(decoder);
+    if (delay < 0 || delay == reported) return;
+    decoder_delay = delay;
+    reported = delay;
+    printf("Decoder output delay: %d picture(s), %llu ms\n", delay,
+           (unsigned long long)(delay * frame_duration_us / 1000));
+}
+
+// Convert a picture on the CPU and draw it. Returns -1 without a buffer.
+static int draw_converted(const decoder_picture_t *pic) {
+    // One band per CPU by default; ANHELO_CONVERT_THREADS=1 converts on
+    // this thread only. Returns when all bands are done.
+    static int convert_threads_started = 0;
+    if (!convert_threads_started) {
+        const char *threads = getenv("ANHELO_CONVERT_THREADS");
+        convert_threads = yuv2rgb_threads_create(threads ? atoi(threads) : 0);
+        if (yuv2rgb_threads_pin(convert_threads, pipeline.cpus[PIPELINE_CONVERT]) < 0)
+            fprintf(stderr, "Could not pin the convert stage to its CPUs\n");
+        convert_threads_started = 1;
+    }
+    yuv2rgb_format_t format = video_pixel_format(video);
+
+    // Straight into the output's pixels where it lets us
+    int linesize, width, height;
+    uint64_t start = metrics_now_us();
+    uint8_t *pixels = video_lock_native(video, &linesize, &width, &height);
+    if (pixels) {
+        // Scaled while converting when the output is smaller, bilinear
+        // unless ANHELO_SCALE=nearest
+        if (width != pic->width || height != pic->height) {
+            const char *scale = getenv("ANHELO_SCALE");
+            yuv2rgb_filter_t filter = scale && strcmp(scale, "nearest") == 0 ? YUV2RGB_NEAREST : YUV2RGB_BILINEAR;
+            yuv420_to_rgb_scaled_threaded(convert_threads, format, filter, pic->width, pic->height,
+                                          pic->y, pic->u, pic->v, pic->y_stride, pic->uv_stride, pic->uv_stride,
+                                          pixels, width, height, linesize);
+        } else {
+            yuv420_to_rgb_threaded(convert_threads, format, width, height, pic->y, pic->u, pic->v,
+                                   pic->y_stride, pic->uv_stride, pic->uv_stride, pixels, linesize);
         }
-        printf("\n");
+        uint64_t converted = metrics_now_us();
+        metrics_record(METRIC_CONVERT, converted - start);
+        video_unlock_native(video);
+        metrics_record(METRIC_DRAW, metrics_now_us() - converted);
+        return 0;
     }
-    
-    // Provide more detailed status information
-    if (result == SIMPLE_H264_ERROR) {
-        printf("[DEBUG] %s NAL type %d caused decoder error\n", debug_prefix, nal_type);
-    } else if (result == SIMPLE_H264_PARAM_SET_ERROR) {
-        printf("[DEBUG] %s NAL type %d parameter set error (missing SPS/PPS?)\n", debug_prefix, nal_type);
-    } else if (result == SIMPLE_H264_HEADERS_READY) {
-        printf("[DEBUG] %s NAL type %d headers ready\n", debug_prefix, nal_type);
+
+    // Otherwise into a frame in the output's own pixel layout so drawing
+    // is a copy
+    if (!frame_pool && !(frame_pool = frame_pool_create(1))) return -1;
+    frame_format_t frame_format = format == YUV2RGB_BGRA32 ? FRAME_BGRA32 :
+                                  format == YUV2RGB_BGR24 ? FRAME_BGR24 : FRAME_RGB24;
+    frame_t *rgb = frame_pool_get(frame_pool, frame_format, pic->width, pic->height);
+    if (!rgb) {
+        printf("[DEBUG] Failed to allocate RGB buffer %dx%d\n", pic->width, pic->height);
+        return -1;
     }
-    
-    if (result == SIMPLE_H264_FRAME_READY && frame.y_plane && frame.width > 0 && frame.height > 0) {
-        if (!video) { 
-            if (init_video_output(frame.width, frame.height) < 0) { 
-                printf("[DEBUG] Failed to initialize video output %ux%u\n", frame.width, frame.height);
-                return 0; 
-            }
+    yuv420_to_rgb_threaded(convert_threads, format, pic->width, pic->height, pic->y, pic->u, pic->v,
+                           pic->y_stride, pic->uv_stride, pic->uv_stride,
+                           rgb->planes[0], rgb->strides[0]);
+    uint64_t converted = metrics_now_us();
+    metrics_record(METRIC_CONVERT, converted - start);
+    video_draw_native(video, rgb->planes[0], rgb->strides[0]);
+    metrics_record(METRIC_DRAW, metrics_now_us() - converted);
+    frame_unref(rgb);
+    return 0;
+}
+
+/* Where the pictures on their way to the screen come from, for the
+ * latency of each one shown: per segment, the PTS it starts at, its
+ * program date-time and when its download completed. The demuxing thread
+ * adds the segments, the presenting thread looks pictures up by PTS.
+ */
+#define TIMELINE_SEGMENTS 16
+#define TIMELINE_MAX_SEGMENT_US 60000000    // Segments are shorter than this
+
+typedef struct {
+    int64_t first_pts;          // TS_NO_TIMESTAMP until its first packet with one
+    double program_date_time;   // Unix seconds, 0 if unknown
+    uint64_t downloaded_us;     // get_time_us(), 0 if unknown
+} timeline_segment_t;
+
+static pthread_mutex_t timeline_lock = PTHREAD_MUTEX_INITIALIZER;
+static timeline_segment_t timeline[TIMELINE_SEGMENTS];
+static unsigned timeline_count = 0; // Segments added; the newest is at (count - 1) % TIMELINE_SEGMENTS
+static int timeline_open = 0; // Demuxing thread: the newest segment has no PTS yet
+static _Atomic uint64_t live_latency_us = 0; // Of the picture shown last, 0 if unknown
+static _Atomic uint64_t present_delay_us = 0;
+
+// Demuxing thread: a segment starts
+static void timeline_add(double program_date_time, uint64_t downloaded_us) {
+    pthread_mutex_lock(&timeline_lock);
+    timeline_segment_t *seg = &timeline[timeline_count++ % TIMELINE_SEGMENTS];
+    seg->first_pts = TS_NO_TIMESTAMP;
+    seg->program_date_time = program_date_time;
+    seg->downloaded_us = downloaded_us;
+    pthread_mutex_unlock(&timeline_lock);
+    timeline_open = 1;
+}
+
+// Demuxing thread: a packet of the newest segment has this PTS
+static void timeline_pts(int64_t pts) {
+    if (!timeline_open || pts == TS_NO_TIMESTAMP) return;
+    pthread_mutex_lock(&timeline_lock);
+    timeline[(timeline_count - 1) % TIMELINE_SEGMENTS].first_pts = pts;
+    pthread_mutex_unlock(&timeline_lock);
+    timeline_open = 0;
+}
+
+// The newest segment starting at or before pts. Returns 0 without one.
+static int timeline_find(int64_t pts, timeline_segment_t *found) {
+    int ok = 0;
+    pthread_mutex_lock(&timeline_lock);
+    unsigned n = timeline_count < TIMELINE_SEGMENTS ? timeline_count : TIMELINE_SEGMENTS;
+    for (unsigned i = 1; i <= n && !ok; i++) {
+        const timeline_segment_t *seg = &timeline[(timeline_count - i) % TIMELINE_SEGMENTS];
+        if (seg->first_pts == TS_NO_TIMESTAMP) continue;
+        int64_t offset = present_pts_delta_us(pts, seg->first_pts);
+        if (offset < 0 || offset >= TIMELINE_MAX_SEGMENT_US) continue;
+        *found = *seg;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&timeline_lock);
+    return ok;
+}
+
+// Latency of the picture just shown, for the metrics and the demuxer's
+// catch-up: from its program date-time (glass to glass), from its
+// segment's download, and what is queued behind it
+static void record_latency(int64_t pts, uint64_t now) {
+    int depth = decoder_delay;
+    if (packet_queue) depth += packet_queue_count(packet_queue);
+    if (render_queue && render_queue_count(render_queue) > 0) depth += render_queue_count(render_queue) - 1;
+    metrics_record(METRIC_QUEUE_DEPTH, (uint64_t)depth);
+
+    timeline_segment_t seg;
+    if (pts == TS_NO_TIMESTAMP || !timeline_find(pts, &seg)) return;
+    if (seg.downloaded_us && now > seg.downloaded_us) {
+        present_delay_us = now - seg.downloaded_us;
+        metrics_record(METRIC_PRESENT_DELAY, now - seg.downloaded_us);
+    }
+    if (seg.program_date_time > 0.0) {
+        struct timespec wall;
+        clock_gettime(CLOCK_REALTIME, &wall);
+        double shown = (double)wall.tv_sec + wall.tv_nsec / 1e9;
+        double latency = shown - seg.program_date_time - present_pts_delta_us(pts, seg.first_pts) / 1e6;
+        if (latency > 0.0) {
+            live_latency_us = (uint64_t)(latency * 1e6);
+            metrics_record(METRIC_LIVE_LATENCY, (uint64_t)(latency * 1e6));
+            TRACE_INFO(TRACE_LATENCY, depth, (uint64_t)(latency * 1e6));
         }
-        static int last_w = 0, last_h = 0;
-        if (!rgb_buffer || last_w != (int)frame.width || last_h != (int)frame.height) {
-            free(rgb_buffer);
-            rgb_buffer = (uint8_t*)malloc(frame.width * frame.height * 3);
-            if (!rgb_buffer) {
-                printf("[DEBUG] Failed to allocate RGB buffer %ux%u\n", frame.width, frame.height);
-                return 0;
-            }
-            last_w = (int)frame.width; last_h = (int)frame.height;
+    }
+}
+
+// While the overlay is on, give it the metrics of the last OSD_INTERVAL_US
+#define OSD_INTERVAL_US 1000000
+
+static void update_osd(void) {
+    static metrics_snapshot_t last, now, delta;
+    static int shown = 0;
+    if (!video_osd_enabled(video)) {
+        shown = 0;
+        return;
+    }
+    uint64_t time = metrics_now_us();
+    if (shown && time - last.time_us < OSD_INTERVAL_US) return;
+    metrics_snapshot(&now);
+    char text[OSD_TEXT_MAX];
+    if (shown) {
+        metrics_delta(&delta, &now, &last);
+        metrics_format_overlay(text, sizeof(text), &delta);
+    } else {
+        snprintf(text, sizeof(text), "STATS...");
+    }
+    video_set_osd(video, text);
+    last = now;
+    shown = 1;
+}
+
+// Pace, convert and draw one decoded picture, unless it is too late to.
+// Returns 1 when the user quit.
+static int show_picture(const decoder_picture_t *pic, int64_t pts) {
+    if (!video) {
+        if (init_video_output(pic->width, pic->height) < 0) {
+            printf("[DEBUG] Failed to initialize video output %dx%d\n", pic->width, pic->height);
+            return 0;
+        }
+    }
+    // Outputs with a YUV path convert the picture themselves;
+    // ANHELO_GPU_YUV=0 always converts on the CPU
+    static int gpu_yuv = -1;
+    if (gpu_yuv < 0) {
+        const char *env = getenv("ANHELO_GPU_YUV");
+        gpu_yuv = !(env && strcmp(env, "0") == 0);
+    }
+    int64_t late;
+    int dropped = present_frame(pts, &late) < 0;
+    update_skip_level(-late, get_time_us());
+    if (dropped) {
+        metrics_count(METRIC_FRAMES_DROPPED, 1);
+    } else {
+        update_osd();
+        uint64_t draw_start = metrics_now_us();
+        if (gpu_yuv && video_draw_yuv(video, pic->width, pic->height, pic->y, pic->u, pic->v,
+                                      pic->y_stride, pic->uv_stride) == 0) {
+            metrics_record(METRIC_DRAW, metrics_now_us() - draw_start);
+        } else if (draw_converted(pic) < 0) {
+            return 0;
         }
-        yuv420_to_rgb24((int)frame.width, (int)frame.height, 
-                        frame.y_plane, frame.u_plane, frame.v_plane,
-                        (int)frame.y_stride, (int)frame.uv_stride, (int)frame.uv_stride, 
-                        rgb_buffer, (int)frame.width * 3);
-        video_draw(video, rgb_buffer, (int)frame.width * 3);
+        uint64_t shown = get_time_us();
+        present_shown(&presenter, shown);
+        record_latency(pts, shown);
         frames_displayed++;
-        uint64_t now = get_time_us();
-        if (now - last_frame_time < frame_duration_us) usleep(frame_duration_us - (now - last_frame_time));
-        last_frame_time = get_time_us();
-        if (video && video_poll(video)) { should_quit_hls = 1; return 1; }
-        return 1; // Frame displayed
+        metrics_count(METRIC_FRAMES_DISPLAYED, 1);
+        if (switch_started_us) {
+            printf("Channel switch: first picture after %llu ms\n",
+                   (unsigned long long)((shown - switch_started_us) / 1000));
+            switch_started_us = 0;
+        }
+        metrics_record(METRIC_LATENESS, late > 0 ? (uint64_t)late : 0);
     }
-    return 0; // No frame displayed
+    if (poll_window()) { should_quit_hls = 1; return 1; }
+    return 0;
 }
 
-// Smart frame dropping with adaptive thresholds
-#ifndef FRAMESKIP_AMOUNT
-#define FRAMESKIP_AMOUNT 3
-#endif
+// Show every picture the decoder has ready, or hand it to the render
+// thread, which may make this wait for a free slot. Returns how many there
+// were.
+static int show_pictures(void) {
+    decoder_picture_t pic;
+    int shown = 0;
+    while (!should_quit_hls && decoder_get_picture(decoder, &pic)) {
+        int64_t pts = next_picture_pts();
+        if (render_queue) {
+            render_queue_push(render_queue, &pic, pts, &paced_us);
+        } else {
+            uint64_t start = get_time_us();
+            show_picture(&pic, pts);
+            inline_present_us += get_time_us() - start;
+        }
+        frames_decoded++;
+        metrics_count(METRIC_FRAMES_DECODED, 1);
+        shown++;
+    }
+    if (shown) report_decoder_delay();
+    return shown;
+}
 
-// HLS segment callback - processes each segment
-static int hls_segment_callback(const unsigned char *data, size_t size, void *user_data) {
+// Check an SEI NAL unit for a recovery point message (payload type 6)
+static int sei_has_recovery_point(const uint8_t *nal, size_t len) {
+    size_t i = 1;
+    while (i < len && nal[i] != 0x80) { // rbsp_trailing_bits
+        unsigned type = 0, size = 0;
+        while (i < len && nal[i] == 0xFF) type += nal[i++];
+        if (i >= len) break;
+        type += nal[i++];
+        while (i < len && nal[i] == 0xFF) size += nal[i++];
+        if (i >= len) break;
+        size += nal[i++];
+        if (type == 6) return 1;
+        i += size;
+    }
+    return 0;
+}
+
+// Whether to leave out a slice to catch up. Non-reference slices go while
+// behind live and from skip level 2, everything but random access points
+// (IDR and recovery point pictures) at level 3. Once a reference picture
+// is left out the ones after it would decode to garbage, so slices then
+// keep being left out up to the next random access point.
+static int skip_slice(const uint8_t *nal_data, size_t nal_len) {
+    static int recovery_point = 0; // Recovery point SEI in this access unit
+    static int after_slice = 0;    // Last NAL unit was a slice
+    static int until_rap = 0;      // Reference picture left out
+    int nal_type = nal_data[0] & 0x1F;
+    if (!is_slice(nal_type)) {
+        // A NAL unit after the slices starts the next access unit
+        if (after_slice) recovery_point = 0;
+        after_slice = 0;
+        if (nal_type == 6 && sei_has_recovery_point(nal_data, nal_len)) recovery_point = 1;
+        return 0;
+    }
+    after_slice = 1;
+    int ref = (nal_data[0] & 0x60) != 0;
+    int rap = nal_type == 5 || recovery_point;
+    if (rap) until_rap = awaiting_rap = 0;
+    int skip = (!ref && (catching_up || skip_level >= 2)) || (!rap && (skip_level >= 3 || until_rap || awaiting_rap));
+    if (skip && ref) until_rap = 1;
+    return skip;
+}
+
+// Decode one H.264 NAL unit (no start code) and show any pictures it
+// completes. Returns the number shown.
+static int process_h264_nal_unit(const uint8_t *nal_data, size_t nal_len) {
+    if (!nal_data || nal_len == 0 || !use_decoder(DECODER_CAP_H264)) return 0;
+
+    int nal_type = nal_data[0] & 0x1F;
+
+    // Skipping slices no other picture references (nal_ref_idc == 0)
+    // alone often wins the latency back. A left out picture's PTS is
+    // taken out of the queue so the pictures shown keep their own.
+    if (skip_slice(nal_data, nal_len)) {
+        // first_mb_in_slice == 0 (ue(v) "1"): the picture's first slice
+        if (!awaiting_rap && nal_len > 1 && (nal_data[1] & 0x80)) {
+            frames_dropped++;
+            metrics_count(METRIC_FRAMES_DROPPED, 1);
+        }
+        if (pending_pts != TS_NO_TIMESTAMP) pts_queue_remove(pending_pts);
+        pending_pts = TS_NO_TIMESTAMP;
+        return 0;
+    }
+    // Before the first random access point only parameter sets are kept
+    if (awaiting_rap && !is_parameter_set(nal_type)) return 0;
+    if (is_slice(nal_type)) pending_pts = TS_NO_TIMESTAMP;
+
+    int result = decoder_decode(decoder, nal_data, nal_len);
+
+    if (result < 0) TRACE_ERROR(TRACE_NAL_ERROR, nal_type, nal_len);
+    else TRACE_DEBUG(TRACE_NAL, nal_type, nal_len);
+    // Parameter sets with their first bytes, for analysis
+    if (is_parameter_set(nal_type)) {
+        uint64_t head = 0;
+        for (size_t i = 0; i < 8; i++) head = head << 8 | (i < nal_len ? nal_data[i] : 0);
+        TRACE_DEBUG(TRACE_PARAM_SET, nal_type, head);
+    }
+
+    return show_pictures();
+}
+
+// Decode the units in nal_index (over `base`): parameter sets first so the
+// decoder is configured before any slice, then everything else. With
+// `first_picture`, stop once a picture has been shown. Returns 1 when the
+// user quit.
+static int decode_nal_units(const uint8_t *base, int first_picture) {
+    for (size_t i = 0; i < nal_index.count; i++) {
+        const nal_unit_t *u = &nal_index.units[i];
+        if (is_parameter_set(u->type)) process_h264_nal_unit(base + u->offset, u->size);
+    }
+    for (size_t i = 0; i < nal_index.count; i++) {
+        const nal_unit_t *u = &nal_index.units[i];
+        if (is_parameter_set(u->type)) continue;
+        int shown = process_h264_nal_unit(base + u->offset, u->size);
+        if (should_quit_hls) return 1;
+        if (shown && first_picture) break; // we found a picture and displayed it
+    }
+    return 0;
+}
+
+// Packets from the demuxing stage to the decoding stage
+enum {
+    PACKET_TS_PES,          // Video PES; arg: its stream_type
+    PACKET_MP4_SAMPLE,      // arg: nal_length_size
+    PACKET_MP4_CONFIG,      // avcC parameter sets; arg: nal_length_size
+    PACKET_ANNEXB,          // Segment that is an elementary stream; arg: stop after its first picture
+    PACKET_SEGMENT_END      // No data: the packets of a segment are all out
+};
+
+// Decode one video PES from the TS demuxer. Returns 1 when the user quit.
+static int decode_video_pes(const uint8_t *data, size_t size, int stream_type) {
+    TRACE_DEBUG(TRACE_PES, stream_type, size);
+    // An MPEG-4 Part 2 PES is one frame and goes to the decoder as is
+    if (stream_type == TS_STREAM_MPEG4_VIDEO) {
+        if (use_decoder(DECODER_CAP_MPEG4) && decoder_decode(decoder, data, size) == 0)
+            show_pictures();
+        return should_quit_hls;
+    }
+    if (stream_type != 0 && stream_type != TS_STREAM_H264) {
+        static int unsupported_logged = 0;
+        if (!unsupported_logged) fprintf(stderr, "Unsupported video stream type 0x%02x\n", stream_type);
+        unsupported_logged = 1;
+        return 0;
+    }
+    // The PES payload may contain Annex-B start codes (0x000001/0x00000001)
+    // or length-prefixed NALs (common in some packagers). Index it once and
+    // decode from the index.
+    if (nal_index_annexb(&nal_index, data, size) > 0) {
+        if (decode_nal_units(data, 0)) return 1;
+    } else if (nal_index_length_prefixed(&nal_index, data, size, 4) > 0) {
+        // No start codes found: try common length-prefixed format (4-byte NAL size, big-endian)
+        if (decode_nal_units(data, 0)) return 1;
+    }
+    return should_quit_hls;
+}
+
+// Decode one H.264 sample (or the avcC parameter sets) from the fMP4
+// demuxer. Returns 1 when the user quit.
+static int decode_mp4_sample(const uint8_t *data, size_t size, int nal_length_size) {
+    if (nal_index_length_prefixed(&nal_index, data, size, nal_length_size) > 0) {
+        if (decode_nal_units(data, 0)) return 1;
+    }
+    return should_quit_hls;
+}
+
+// Decode-time histogram of the access unit just indexed: by the type of its
+// first slice, -1 without one
+static int h264_picture_metric(const uint8_t *base) {
+    for (size_t i = 0; i < nal_index.count; i++) {
+        const nal_unit_t *u = &nal_index.units[i];
+        if (!is_slice(u->type)) continue;
+        if (u->type == 5) return METRIC_DECODE_I;
+        // first_mb_in_slice, then slice_type after the NAL header;
+        // emulation prevention left out, only the first bytes are read
+        bit_reader_t br;
+        init_bits(&br, base + u->offset, u->size);
+        skip_bits(&br, 8);
+        get_ue(&br);
+        switch (get_ue(&br) % 5) {
+        case 2: case 4: return METRIC_DECODE_I;     // I, SI
+        case 1: return METRIC_DECODE_B;
+        default: return METRIC_DECODE_P;            // P, SP
+        }
+    }
+    return -1;
+}
+
+// Same for an MPEG-4 Part 2 frame: vop_coding_type after the VOP start code
+static int mpeg4_picture_metric(const uint8_t *data, size_t size) {
+    for (size_t i = 0; i + 4 < size; i++) {
+        if (data[i] || data[i + 1] || data[i + 2] != 1 || data[i + 3] != 0xB6) continue;
+        switch (data[i + 4] >> 6) {
+        case 0: return METRIC_DECODE_I;
+        case 2: return METRIC_DECODE_B;
+        default: return METRIC_DECODE_P;            // P, S(GMC)
+        }
+    }
+    return -1;
+}
+
+// Decoding stage: decode one packet and show, or queue, the pictures it
+// completes. The time it takes, frame pacing left out, is added to
+// decode_busy_us. Returns 1 when the user quit.
+static int decode_packet(int type, int arg, int64_t pts, const uint8_t *data, size_t size) {
+    uint64_t start = get_time_us();
+    uint64_t paced_start = paced_us;
+    uint64_t present_start = inline_present_us;
+    int quit = should_quit_hls;
+    int metric = -1;
+    switch (type) {
+    case PACKET_TS_PES:
+        pts_queue_push(pts);
+        quit = decode_video_pes(data, size, arg);
+        if (arg == TS_STREAM_MPEG4_VIDEO) metric = mpeg4_picture_metric(data, size);
+        else if (arg == 0 || arg == TS_STREAM_H264) metric = h264_picture_metric(data);
+        break;
+    case PACKET_MP4_SAMPLE:
+        pts_queue_push(pts);
+        quit = decode_mp4_sample(data, size, arg);
+        metric = h264_picture_metric(data);
+        break;
+    case PACKET_MP4_CONFIG:
+        quit = decode_mp4_sample(data, size, arg);
+        break;
+    case PACKET_ANNEXB:
+        if (nal_index_annexb(&nal_index, data, size) > 0)
+            quit = decode_nal_units(data, arg);
+        break;
+    case PACKET_SEGMENT_END: {
+        // Lost or corrupt macroblocks in this segment (a new decoder restarts the count)
+        static const decoder_t *counted = NULL;
+        static unsigned long reported = 0;
+        unsigned long concealed = decoder_concealed_mbs(decoder);
+        if (decoder != counted) reported = 0;
+        if (concealed > reported) metrics_count(METRIC_CONCEALED_MBS, concealed - reported);
+        counted = decoder;
+        reported = concealed;
+        break;
+    }
+    }
+    uint64_t busy = get_time_us() - start - (paced_us - paced_start);
+    decode_busy_us += busy;
+    // Showing the pictures itself is the presentation's time
+    if (metric >= 0) metrics_record((metric_stage_t)metric, busy - (inline_present_us - present_start));
+    return quit;
+}
+
+// Demuxing stage output: queue a packet for the decoding thread, or decode
+// it right away without one. A packet the queue has no memory for is
+// dropped. Returns 1 when the user quit.
+static int demux_output(int type, int arg, int64_t pts, const uint8_t *data, size_t size) {
+    uint64_t start = get_time_us();
+    int quit = should_quit_hls;
+    if (type == PACKET_TS_PES || type == PACKET_MP4_SAMPLE) timeline_pts(pts);
+    if (!packet_queue) quit = decode_packet(type, arg, pts, data, size);
+    // Only fails once the decoding thread stopped, or out of memory
+    else packet_queue_push(packet_queue, type, arg, pts, data, size, NULL);
+    demux_output_us += get_time_us() - start;
+    return quit;
+}
+
+static int demux_video_pes(const ts_pes_t *pes, void *user_data) {
+    (void)user_data;
+    return demux_output(PACKET_TS_PES, pes->stream_type, pes->pts, pes->data, pes->size);
+}
+
+static int demux_mp4_sample(const fmp4_sample_t *sample, void *user_data) {
+    (void)user_data;
+    return demux_output(sample->config ? PACKET_MP4_CONFIG : PACKET_MP4_SAMPLE, sample->nal_length_size,
+                        sample->pts, sample->data, sample->size);
+}
+
+// Demux one HLS segment into packets
+static int demux_hls_segment(const unsigned char *data, size_t size, void *user_data) {
     (void)user_data; // Not used
     
-    // Allow user to quit between segments
-    if (video && video_poll(video)) { should_quit_hls = 1; return 1; }
+    // Allow user to quit between segments (the render thread, or the
+    // decoding thread waiting for packets, polls itself)
+    if (!render_queue && !packet_queue && poll_window()) { should_quit_hls = 1; return 1; }
 
     if (should_quit_hls) return 1;
-    // Debug: indicate callback invocation and data size
-    printf("[DEBUG] HLS segment callback invoked. size=%zu bytes\n", size);
-    fflush(stdout);
-    static int pes_dump_done = 0; /* one-time dump flag for assembled PES payload */
-    if (use_custom_decoder == 1) {
-        // Use simple H.264 decoder
-        simple_h264_frame_t frame = {0};
-        
-        // Debug: about to call decoder
-        printf("[DEBUG] Calling simple_h264_decode() with %zu bytes\n", size);
-        fflush(stdout);
-
-        simple_h264_result_t result = simple_h264_decode(h264_decoder, data, size, &frame);
-
-        // Debug: report decoder status and picture info
-        printf("[DEBUG] simple_h264_decode returned result=%s, picture=%p, width=%u, height=%u\n",
-             simple_h264_result_string(result), (void*)frame.y_plane, frame.width, frame.height);
-        fflush(stdout);
-
-        if (result == SIMPLE_H264_FRAME_READY && frame.y_plane && frame.width > 0 && frame.height > 0) {
-            // Convert YUV to RGB and display
-            if (!video) {
-                if (init_video_output(frame.width, frame.height) < 0) {
-                    return -1;
-                }
-            }
-            
-            // Allocate/resize RGB buffer
-            static int hls_last_w = 0, hls_last_h = 0;
-            if (!rgb_buffer || hls_last_w != (int)frame.width || hls_last_h != (int)frame.height) {
-                free(rgb_buffer);
-                rgb_buffer = (uint8_t *)malloc(frame.width * frame.height * 3);
-                if (!rgb_buffer) { fprintf(stderr, "Failed to allocate RGB buffer (HLS)\n"); return -1; }
-                hls_last_w = (int)frame.width; hls_last_h = (int)frame.height;
-            }
+    if (size == 0) return 0; // Idle tick while the demuxer is paused
+    static unsigned segments = 0;
+    TRACE_INFO(TRACE_SEGMENT, ++segments, size);
+    if (fmp4_probe(data, size)) {
+        // fMP4/CMAF: samples are length-prefixed NAL units inside the mdat
+        if (!fmp4_demux) fmp4_demux = fmp4_demux_create(demux_mp4_sample, NULL);
+        if (!fmp4_demux) return -1;
+        if (fmp4_demux_parse(fmp4_demux, data, size)) return 1;
+    } else if (size >= TS_PACKET_SIZE && data[0] == 0x47) {
+        /* Many HLS segments are MPEG-TS files (188-byte packets). Hand them to
+         * the TS demuxer, which follows PAT/PMT to the video PID and calls
+         * demux_video_pes() for each reassembled PES. It is not flushed per
+         * segment: the PES still open at the end continues in the next one.
+         */
+        if (!ts_demux) ts_demux = ts_demux_create(demux_video_pes, NULL);
+        if (!ts_demux) return -1;
+        if (ts_demux_feed(ts_demux, data, size)) return 1;
+    } else {
+        // Not a TS segment: treat it as an H.264 Annex-B elementary stream
+        if (demux_output(PACKET_ANNEXB, 1, TS_NO_TIMESTAMP, data, size)) return 1;
+    }
+    
+    return demux_output(PACKET_SEGMENT_END, 0, TS_NO_TIMESTAMP, NULL, 0);
+}
 
-            // YUV420P layout from simple decoder: separate Y, U, V planes
-            yuv420_to_rgb24((int)frame.width, (int)frame.height, 
-                          frame.y_plane, frame.u_plane, frame.v_plane,
-                          (int)frame.y_stride, (int)frame.uv_stride, (int)frame.uv_stride,
-                          rgb_buffer, (int)frame.width * 3);
+// HLS segment callback - demuxes each segment and reports decoder load to
+// the demuxer's bitrate adaptation
+static int hls_segment_callback(const unsigned char *data, size_t size, void *user_data) {
+    // Start dropping a segment past the join point and stop once back at it
+    long behind = hls_demuxer->stats.segments_behind;
+    long target = (long)hls_demuxer->live_start_segments;
+    if (behind > target + 1) catching_up = 1;
+    else if (behind <= target) catching_up = 0;
+    // Counted from the next segment on
+    hls_report_latency(hls_demuxer, live_latency_us / 1e6, present_delay_us / 1e6);
+    if (size) timeline_add(hls_demuxer->stats.program_date_time, hls_demuxer->stats.downloaded_us);
 
-            video_draw(video, rgb_buffer, (int)frame.width * 3);
-            frames_displayed++;
-            
-            // Handle timing
-            uint64_t current_time = get_time_us();
-            if (current_time - last_frame_time < frame_duration_us) {
-                usleep(frame_duration_us - (current_time - last_frame_time));
-            }
-            last_frame_time = get_time_us();
+    uint64_t busy_start = decode_busy_us;
+    int decoded_start = frames_decoded;
 
-            // Poll for quit events after displaying a frame
-            if (video && video_poll(video)) { should_quit_hls = 1; return 1; }
-        }
-        else {
-            // Debug: decoder did not produce a ready picture for this segment
-            printf("[DEBUG] Decoder did not produce picture ready for this segment (result=%s)\n", simple_h264_result_string(result));
-            fflush(stdout);
-
-            /* Enhanced TS demux: many HLS segments are MPEG-TS files (188-byte packets).
-             * Try a best-effort extraction of PES payloads and Annex-B NAL units and feed
-             * them individually to the h264bsd decoder. This version handles parameter sets
-             * more carefully to ensure proper decoder initialization.
-             */
-            const uint8_t *seg = data;
-            // const uint8_t *seg_end = data + size; // unused
-
-            // Quick check for TS sync byte at offset 0 (0x47). If not present, skip TS demux.
-            if (size >= 188 && seg[0] == 0x47) {
-                // Lightweight TS -> PES assembly for a single video PID
-                int video_pid = -1;
-                uint8_t *pes_buf = NULL;
-                size_t pes_buf_len = 0;
-
-                // Find plausible TS sync offset (support segments that might include extra data)
-                int sync_offset = -1;
-                for (int off = 0; off < 188; ++off) {
-                    if (off + 188 * 3 > (int)size) break;
-                    if (seg[off] == 0x47 && seg[off + 188] == 0x47 && seg[off + 376] == 0x47) { sync_offset = off; break; }
-                }
-                if (sync_offset < 0) sync_offset = 0;
-
-                for (size_t pos = sync_offset; pos + 188 <= size; pos += 188) {
-                    const uint8_t *pkt = seg + pos;
-                    if (pkt[0] != 0x47) continue; // invalid/shifted
-                    uint8_t payload_unit_start = (pkt[1] & 0x40) != 0;
-                    int pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
-                    uint8_t afc = (pkt[3] & 0x30) >> 4; // adaptation_field_control
-                    size_t payload_offset = 4;
-                    if (afc == 2) continue; // adaptation only
-                    if (afc == 3) {
-                        // adaptation field present
-                        uint8_t af_len = pkt[4];
-                        payload_offset = 5 + af_len;
-                        if (payload_offset > 188) continue;
-                    }
-                    if (payload_offset >= 188) continue;
-                    const uint8_t *payload = pkt + payload_offset;
-                    size_t payload_len = 188 - payload_offset;
+    uint64_t demux_start = get_time_us();
+    uint64_t output_start = demux_output_us;
+    int quit = demux_hls_segment(data, size, user_data);
+    if (size) metrics_record(METRIC_DEMUX, get_time_us() - demux_start - (demux_output_us - output_start));
 
-                    if (payload_len == 0) continue;
+    // With a decoding thread of its own, what it got through meanwhile
+    uint64_t busy = decode_busy_us - busy_start;
+    hls_report_decode_stats(hls_demuxer, (unsigned)(frames_decoded - decoded_start), busy / 1000000.0);
+    return quit;
+}
 
-                    // If we haven't chosen a video PID yet, detect PES start with stream_id 0xE0
-                    if (video_pid == -1 && payload_unit_start && payload_len >= 6) {
-                        if (payload[0] == 0x00 && payload[1] == 0x00 && payload[2] == 0x01 && (payload[3] & 0xF0) == 0xE0) {
-                            video_pid = pid;
-                        }
-                    }
+// Demuxing stage: run the HLS stream through the demuxers up to its end,
+// the last PES included
+static hls_error_t demux_hls_stream(const char *url) {
+    hls_error_t err = hls_process_stream(hls_demuxer, url, hls_segment_callback, NULL);
+    if (err == HLS_OK && !should_quit_hls && ts_demux) ts_demux_flush(ts_demux);
+    return err;
+}
 
-                    if (video_pid != -1 && pid == video_pid) {
-                        // If start of PES, flush previous PES buffer first
-                        if (payload_unit_start && pes_buf_len > 0) {
-                            if (!pes_dump_done) {
-                                FILE *df = fopen("/tmp/anhelo_pes_dump.bin", "wb");
-                                if (df) {
-                                    fwrite(pes_buf, 1, pes_buf_len, df);
-                                    fclose(df);
-                                    printf("[DEBUG] dumped pes buf len=%zu to /tmp/anhelo_pes_dump.bin\n", pes_buf_len);
-                                    fflush(stdout);
-                                } else {
-                                    printf("[DEBUG] failed to open dump file for PES\n"); fflush(stdout);
-                                }
-                                pes_dump_done = 1;
-                            }
-                            // Try feeding the entire assembled PES payload to the decoder in one go
-                            {
-                                simple_h264_frame_t frame_all = {0};
-                                simple_h264_result_t result_all = simple_h264_decode(h264_decoder, pes_buf, pes_buf_len, &frame_all);
-                                printf("[DEBUG] TS->PES whole feed len=%zu result=%s pic=%p w=%u h=%u\n",
-                                       pes_buf_len, simple_h264_result_string(result_all), (void*)frame_all.y_plane, frame_all.width, frame_all.height);
-                                
-                                // Provide status details for whole PES processing  
-                                if (result_all == SIMPLE_H264_ERROR) {
-                                    printf("[DEBUG] TS->PES whole feed caused decoder error\n");
-                                } else if (result_all == SIMPLE_H264_PARAM_SET_ERROR) {
-                                    printf("[DEBUG] TS->PES whole feed parameter set error\n");
-                                } else if (result_all == SIMPLE_H264_HEADERS_READY) {
-                                    printf("[DEBUG] TS->PES whole feed headers ready\n");
-                                }
-                                fflush(stdout);
-                                
-                                if (result_all == SIMPLE_H264_FRAME_READY && frame_all.y_plane && frame_all.width > 0 && frame_all.height > 0) {
-                                    if (!video) { if (init_video_output(frame_all.width, frame_all.height) < 0) { /* ignore */ } }
-                                    static int last_w_all = 0, last_h_all = 0;
-                                    if (!rgb_buffer || last_w_all != (int)frame_all.width || last_h_all != (int)frame_all.height) {
-                                        free(rgb_buffer);
-                                        rgb_buffer = (uint8_t*)malloc(frame_all.width * frame_all.height * 3);
-                                        last_w_all = (int)frame_all.width; last_h_all = (int)frame_all.height;
-                                    }
-                                    if (rgb_buffer) {
-                                        yuv420_to_rgb24((int)frame_all.width, (int)frame_all.height, 
-                                                       frame_all.y_plane, frame_all.u_plane, frame_all.v_plane,
-                                                       (int)frame_all.y_stride, (int)frame_all.uv_stride, (int)frame_all.uv_stride, 
-                                                       rgb_buffer, (int)frame_all.width * 3);
-                                        video_draw(video, rgb_buffer, (int)frame_all.width * 3);
-                                        frames_displayed++;
-                                        uint64_t now = get_time_us();
-                                        if (now - last_frame_time < frame_duration_us) usleep(frame_duration_us - (now - last_frame_time));
-                                        last_frame_time = get_time_us();
-                                        if (video && video_poll(video)) { should_quit_hls = 1; return 1; }
-                                    }
-                                }
-                            }
-                            // The PES payload may contain Annex-B start codes (0x000001/0x00000001)
-                            // or length-prefixed NALs (common in some packagers). Detect which
-                            // format is present and parse appropriately.
-                            const uint8_t *b = pes_buf;
-                            const uint8_t *e = pes_buf + pes_buf_len;
-
-                            // Quick scan for Annex-B start codes
-                            int has_start_codes = 0;
-                            for (const uint8_t *p = b; p + 3 < e; ++p) {
-                                if (p[0] == 0 && p[1] == 0 && p[2] == 1) { has_start_codes = 1; break; }
-                            }
-
-                            if (has_start_codes) {
-                                // Enhanced Annex-B parsing with parameter set prioritization
-                                const uint8_t *s = b;
-                                
-                                // First pass: look for and process parameter sets (SPS/PPS)
-                                s = b;
-                                while (s + 3 < e) {
-                                    // find start code
-                                    const uint8_t *sc = NULL;
-                                    const uint8_t *p = s;
-                                    for (; p + 3 < e; ++p) {
-                                        if (p[0] == 0 && p[1] == 0 && p[2] == 1) { sc = p; break; }
-                                        if (p + 4 < e && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) { sc = p; break; }
-                                    }
-                                    if (!sc) break;
-                                    int sc_len = (sc[2] == 1) ? 3 : 4;
-                                    const uint8_t *nal_start = sc + sc_len;
-                                    const uint8_t *next = nal_start;
-                                    for (; next + 3 < e; ++next) {
-                                        if (next[0] == 0 && next[1] == 0 && next[2] == 1) break;
-                                        if (next + 4 < e && next[0] == 0 && next[1] == 0 && next[2] == 0 && next[3] == 1) break;
-                                    }
-                                    size_t nal_len = (size_t)(next - nal_start);
-                                    if (nal_len > 0) {
-                                        int nal_type = get_nal_unit_type(nal_start, nal_len);
-                                        // Process parameter sets first
-                                        if (is_parameter_set(nal_type)) {
-                                            process_h264_nal_unit(nal_start, nal_len, "TS->PES Annex-B ParamSet");
-                                        }
-                                    }
-                                    s = next;
-                                }
-                                
-                                // Second pass: process slices and other NAL units
-                                s = b;
-                                while (s + 3 < e) {
-                                    // find start code
-                                    const uint8_t *sc = NULL;
-                                    const uint8_t *p = s;
-                                    for (; p + 3 < e; ++p) {
-                                        if (p[0] == 0 && p[1] == 0 && p[2] == 1) { sc = p; break; }
-                                        if (p + 4 < e && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) { sc = p; break; }
-                                    }
-                                    if (!sc) break;
-                                    int sc_len = (sc[2] == 1) ? 3 : 4;
-                                    const uint8_t *nal_start = sc + sc_len;
-                                    const uint8_t *next = nal_start;
-                                    for (; next + 3 < e; ++next) {
-                                        if (next[0] == 0 && next[1] == 0 && next[2] == 1) break;
-                                        if (next + 4 < e && next[0] == 0 && next[1] == 0 && next[2] == 0 && next[3] == 1) break;
-                                    }
-                                    size_t nal_len = (size_t)(next - nal_start);
-                                    if (nal_len > 0) {
-                                        int nal_type = get_nal_unit_type(nal_start, nal_len);
-                                        // Skip parameter sets (already processed) and process others
-                                        if (!is_parameter_set(nal_type)) {
-                                            if (process_h264_nal_unit(nal_start, nal_len, "TS->PES Annex-B NAL")) {
-                                                if (video && video_poll(video)) { should_quit_hls = 1; return 1; }
-                                            }
-                                        }
-                                    }
-                                    s = next;
-                                }
-                            } else {
-                                // No start codes found: try common length-prefixed format (4-byte NAL size, big-endian)
-                                // Enhanced length-prefixed parsing with parameter set prioritization
-                                const uint8_t *p = b;
-                                
-                                // First pass: process parameter sets
-                                p = b;
-                                while (p + 4 <= e) {
-                                    uint32_t nal_len = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
-                                    p += 4;
-                                    if (nal_len == 0 || p + nal_len > e) break;
-                                    int nal_type = get_nal_unit_type(p, nal_len);
-                                    if (is_parameter_set(nal_type)) {
-                                        process_h264_nal_unit(p, nal_len, "TS->PES LenPref ParamSet");
-                                    }
-                                    p += nal_len;
-                                }
-                                
-                                // Second pass: process other NAL units
-                                p = b;
-                                while (p + 4 <= e) {
-                                    uint32_t nal_len = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
-                                    p += 4;
-                                    if (nal_len == 0 || p + nal_len > e) break;
-                                    int nal_type = get_nal_unit_type(p, nal_len);
-                                    if (!is_parameter_set(nal_type)) {
-                                        if (process_h264_nal_unit(p, nal_len, "TS->PES LenPref NAL")) {
-                                            if (video && video_poll(video)) { should_quit_hls = 1; return 1; }
-                                        }
-                                    }
-                                    p += nal_len;
-                                }
-                            }
-
-                            free(pes_buf); pes_buf = NULL; pes_buf_len = 0;
-                        }
+typedef struct {
+    const char *url;
+    hls_error_t err;
+} decode_job_t;
 
-                        // If this payload contains PES start, skip PES header and append payload body
-                        if (payload_unit_start && payload_len >= 9 && payload[0] == 0x00 && payload[1] == 0x00 && payload[2] == 0x01) {
-                            uint8_t pes_header_data_len = 0;
-                            if (payload_len >= 9) pes_header_data_len = payload[8];
-                            size_t data_start = 9 + pes_header_data_len;
-                            if (data_start <= payload_len) {
-                                size_t add_len = payload_len - data_start;
-                                uint8_t *nb = realloc(pes_buf, pes_buf_len + add_len);
-                                if (!nb) { free(pes_buf); pes_buf = NULL; pes_buf_len = 0; break; }
-                                pes_buf = nb;
-                                memcpy(pes_buf + pes_buf_len, payload + data_start, add_len);
-                                pes_buf_len += add_len;
-                            }
-                        } else {
-                            // append whole payload
-                            uint8_t *nb = realloc(pes_buf, pes_buf_len + payload_len);
-                            if (!nb) { free(pes_buf); pes_buf = NULL; pes_buf_len = 0; break; }
-                            pes_buf = nb;
-                            memcpy(pes_buf + pes_buf_len, payload, payload_len);
-                            pes_buf_len += payload_len;
-                        }
-                    }
-                }
-
-                // Final flush of any remaining PES buffer
-                if (pes_buf_len > 0 && pes_buf) {
-                    if (!pes_dump_done) {
-                        FILE *df = fopen("/tmp/anhelo_pes_dump.bin", "wb");
-                        if (df) { fwrite(pes_buf, 1, pes_buf_len, df); fclose(df); printf("[DEBUG] dumped final pes buf len=%zu to /tmp/anhelo_pes_dump.bin\n", pes_buf_len); fflush(stdout); }
-                        pes_dump_done = 1;
-                    }
-                    const uint8_t *b = pes_buf;
-                    const uint8_t *e = pes_buf + pes_buf_len;
+// How long the render thread, and the decoding thread presenting itself,
+// wait for a picture or packet before polling the window
+#define RENDER_POLL_MS 10
 
-                    int has_start_codes = 0;
-                    for (const uint8_t *p = b; p + 3 < e; ++p) {
-                        if (p[0] == 0 && p[1] == 0 && p[2] == 1) { has_start_codes = 1; break; }
-                    }
+static void *demux_worker(void *arg) {
+    decode_job_t *job = arg;
+    pipeline_enter_stage(&pipeline, PIPELINE_DEMUX);
+    job->err = demux_hls_stream(job->url);
+    packet_queue_finish(packet_queue);
+    return NULL;
+}
 
-                    if (has_start_codes) {
-                        const uint8_t *s = b;
-                        
-                        // Process parameter sets first
-                        s = b;
-                        while (s + 3 < e) {
-                            const uint8_t *sc = NULL;
-                            const uint8_t *p = s;
-                            for (; p + 3 < e; ++p) {
-                                if (p[0] == 0 && p[1] == 0 && p[2] == 1) { sc = p; break; }
-                                if (p + 4 < e && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) { sc = p; break; }
-                            }
-                            if (!sc) break;
-                            int sc_len = (sc[2] == 1) ? 3 : 4;
-                            const uint8_t *nal_start = sc + sc_len;
-                            const uint8_t *next = nal_start;
-                            for (; next + 3 < e; ++next) {
-                                if (next[0] == 0 && next[1] == 0 && next[2] == 1) break;
-                                if (next + 4 < e && next[0] == 0 && next[1] == 0 && next[2] == 0 && next[3] == 1) break;
-                            }
-                            size_t nal_len = (size_t)(next - nal_start);
-                            if (nal_len > 0) {
-                                int nal_type = get_nal_unit_type(nal_start, nal_len);
-                                if (is_parameter_set(nal_type)) {
-                                    process_h264_nal_unit(nal_start, nal_len, "Final TS flush ParamSet");
-                                }
-                            }
-                            s = next;
-                        }
-                        
-                        // Process other NAL units
-                        s = b;
-                        while (s + 3 < e) {
-                            const uint8_t *sc = NULL;
-                            const uint8_t *p = s;
-                            for (; p + 3 < e; ++p) {
-                                if (p[0] == 0 && p[1] == 0 && p[2] == 1) { sc = p; break; }
-                                if (p + 4 < e && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) { sc = p; break; }
-                            }
-                            if (!sc) break;
-                            int sc_len = (sc[2] == 1) ? 3 : 4;
-                            const uint8_t *nal_start = sc + sc_len;
-                            const uint8_t *next = nal_start;
-                            for (; next + 3 < e; ++next) {
-                                if (next[0] == 0 && next[1] == 0 && next[2] == 1) break;
-                                if (next + 4 < e && next[0] == 0 && next[1] == 0 && next[2] == 0 && next[3] == 1) break;
-                            }
-                            size_t nal_len = (size_t)(next - nal_start);
-                            if (nal_len > 0) {
-                                int nal_type = get_nal_unit_type(nal_start, nal_len);
-                                if (!is_parameter_set(nal_type)) {
-                                    process_h264_nal_unit(nal_start, nal_len, "Final TS flush NAL");
-                                }
-                            }
-                            s = next;
-                        }
-                    }
-                    free(pes_buf);
-                    pes_buf = NULL; pes_buf_len = 0;
-                }
-            } else {
-                // Not a TS segment; keep previous simple Annex-B fallback (search for start codes)
-                const uint8_t *buf = data;
-                const uint8_t *end = data + size;
-                const uint8_t *pos = buf;
-                
-                // First pass: look for and process parameter sets
-                pos = buf;
-                while (pos + 3 < end) {
-                    const uint8_t *start = NULL;
-                    const uint8_t *p = pos;
-                    for (; p + 3 < end; ++p) {
-                        if (p[0] == 0 && p[1] == 0 && p[2] == 1) { start = p + 3; break; }
-                        if (p + 4 < end && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) { start = p + 4; break; }
-                    }
-                    if (!start) break;
-                    const uint8_t *next = start;
-                    for (; next + 3 < end; ++next) {
-                        if (next[0] == 0 && next[1] == 0 && next[2] == 1) break;
-                        if (next + 4 < end && next[0] == 0 && next[1] == 0 && next[2] == 0 && next[3] == 1) break;
-                    }
-                    size_t nal_len = (size_t)(next - start);
-                    if (nal_len > 0) {
-                        int nal_type = get_nal_unit_type(start, nal_len);
-                        if (is_parameter_set(nal_type)) {
-                            process_h264_nal_unit(start, nal_len, "Fallback ParamSet");
-                        }
-                    }
-                    pos = next;
-                }
-                
-                // Second pass: process other NAL units  
-                pos = buf;
-                while (pos + 3 < end) {
-                    const uint8_t *start = NULL;
-                    const uint8_t *p = pos;
-                    for (; p + 3 < end; ++p) {
-                        if (p[0] == 0 && p[1] == 0 && p[2] == 1) { start = p + 3; break; }
-                        if (p + 4 < end && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) { start = p + 4; break; }
-                    }
-                    if (!start) break;
-                    const uint8_t *next = start;
-                    for (; next + 3 < end; ++next) {
-                        if (next[0] == 0 && next[1] == 0 && next[2] == 1) break;
-                        if (next + 4 < end && next[0] == 0 && next[1] == 0 && next[2] == 0 && next[3] == 1) break;
-                    }
-                    size_t nal_len = (size_t)(next - start);
-                    if (nal_len > 0) {
-                        int nal_type = get_nal_unit_type(start, nal_len);
-                        if (!is_parameter_set(nal_type)) {
-                            if (process_h264_nal_unit(start, nal_len, "Fallback NAL")) {
-                                if (video && video_poll(video)) { should_quit_hls = 1; return 1; }
-                                break; // we found a picture and displayed it
-                            }
-                        }
-                    }
-                    pos = next;
-                }
-            }
+// Decode the packets the demuxing thread queues until it is done or the
+// user quits. Without a render thread this one presents too, so the window
+// is polled while no packet is there.
+static void decode_packets(void) {
+    while (!should_quit_hls) {
+        packet_t *packet = packet_queue_peek(packet_queue, RENDER_POLL_MS);
+        if (packet) {
+            decode_packet(packet->type, packet->arg, packet->pts, packet->data, packet->size);
+            packet_queue_pop(packet_queue);
+        } else if (packet_queue_finished(packet_queue)) {
+            break;
+        } else if (!render_queue && poll_window()) {
+            should_quit_hls = 1;
         }
-    } else if (use_custom_decoder == 2) {
-        // Use MPEG-4 decoder
-#ifdef USE_MPEG4
-        uint8_t *y_plane, *u_plane, *v_plane;
-        int stride_y, stride_uv;
-        
-        mpeg4_error_t err = mpeg4_decode_frame(mpeg4_decoder, data, size, 
-                                              &y_plane, &u_plane, &v_plane, 
-                                              &stride_y, &stride_uv);
-        
-        if (err == MPEG4_SUCCESS) {
-            int width, height;
-            mpeg4_get_frame_size(mpeg4_decoder, &width, &height);
-            
-            if (!video) {
-                if (init_video_output(width, height) < 0) {
-                    return -1;
-                }
-            }
-            
-            // Allocate/resize RGB buffer
-            static int hls_mpeg_last_w = 0, hls_mpeg_last_h = 0;
-            if (!rgb_buffer || hls_mpeg_last_w != width || hls_mpeg_last_h != height) {
-                free(rgb_buffer);
-                rgb_buffer = (uint8_t *)malloc(width * height * 3);
-                if (!rgb_buffer) { fprintf(stderr, "Failed to allocate RGB buffer (HLS MPEG-4)\n"); return -1; }
-                hls_mpeg_last_w = width; hls_mpeg_last_h = height;
-            }
+    }
+    // Wakes the demuxing thread if it waits for a slot
+    packet_queue_close(packet_queue);
+}
 
-            // Convert and draw (assumes 4:2:0 planes from decoder)
-            yuv420_to_rgb24(width, height, y_plane, u_plane, v_plane, stride_y, stride_uv, stride_uv,
-                            rgb_buffer, width * 3);
+// Demux and decode the HLS stream, demuxing on a thread of its own when
+// there is a packet queue. At the end of the stream the pictures the
+// decoder held back for reordering are shown.
+static hls_error_t run_decode_stage(const char *url) {
+    decode_job_t job = { url, HLS_OK };
+    pthread_t thread;
+    if (packet_queue && pthread_create(&thread, NULL, demux_worker, &job) == 0) {
+        decode_packets();
+        pthread_join(thread, NULL);
+    } else {
+        packet_queue_destroy(packet_queue);
+        packet_queue = NULL;
+        job.err = demux_hls_stream(url);
+    }
+    if (job.err == HLS_OK && !should_quit_hls) {
+        decoder_flush(decoder);
+        show_pictures();
+    }
+    return job.err;
+}
 
-            video_draw(video, rgb_buffer, width * 3);
-            frames_displayed++;
-            
-            // Handle timing
-            uint64_t current_time = get_time_us();
-            if (current_time - last_frame_time < frame_duration_us) {
-                usleep(frame_duration_us - (current_time - last_frame_time));
-            }
-            last_frame_time = get_time_us();
+static void *decode_worker(void *arg) {
+    decode_job_t *job = arg;
+    pipeline_enter_stage(&pipeline, PIPELINE_DECODE);
+    job->err = run_decode_stage(job->url);
+    render_queue_finish(render_queue);
+    return NULL;
+}
+
+// Render thread: show the queued pictures as they come due, keeping the
+// window responsive while none is there, until the decoding thread is done
+// or the user quits
+static void render_pictures(void) {
+    for (;;) {
+        render_picture_t *picture = render_queue_peek(render_queue, RENDER_POLL_MS);
+        if (picture) {
+            int quit = show_picture(&picture->pic, picture->pts);
+            render_queue_pop(render_queue);
+            if (quit) break;
+        } else if (render_queue_finished(render_queue)) {
+            break;
+        } else if (poll_window()) {
+            should_quit_hls = 1;
+            break;
         }
-#endif
     }
-    
-    return 0;
+    // Wakes the decoding thread if it waits for a slot
+    render_queue_close(render_queue);
+}
+
+// Play the HLS stream through the stages of include/pipeline.h. This
+// thread owns the window and its GL context and must poll its events, so
+// it presents the pictures: waiting for vsync or a picture's due time no
+// longer holds up decoding, and fetching or demuxing no longer hold up
+// either, only a full queue does. ANHELO_RENDER_QUEUE sets how many
+// pictures are decoded ahead (1 to RENDER_QUEUE_MAX), ANHELO_PACKET_QUEUE
+// how many packets are demuxed ahead (1 to PACKET_QUEUE_MAX) and
+// ANHELO_RANGE_PARTS over how many connections a segment may be fetched
+// when one is too slow or the fetcher is catching up (unset or 0 = never
+// split).
+static hls_error_t play_hls_stream(const char *url) {
+    const char *depth = getenv("ANHELO_RENDER_QUEUE");
+    const char *packets = getenv("ANHELO_PACKET_QUEUE");
+    const char *range_parts = getenv("ANHELO_RANGE_PARTS");
+    pipeline_enter_stage(&pipeline, PIPELINE_PRESENT);
+    hls_demuxer->fetch_cpus = pipeline.cpus[PIPELINE_FETCH];
+    if (range_parts) hls_demuxer->range_parts = atoi(range_parts) > 0 ? (size_t)atoi(range_parts) : 0;
+    if (pipeline.threaded[PIPELINE_DECODE])
+        render_queue = render_queue_create(depth ? atoi(depth) : RENDER_QUEUE_DEPTH);
+    if (pipeline.threaded[PIPELINE_DEMUX])
+        packet_queue = packet_queue_create(packets ? atoi(packets) : PACKET_QUEUE_DEPTH);
+
+    decode_job_t job = { url, HLS_OK };
+    pthread_t thread;
+    if (render_queue && pthread_create(&thread, NULL, decode_worker, &job) == 0) {
+        render_pictures();
+        pthread_join(thread, NULL);
+    } else {
+        render_queue_destroy(render_queue);
+        render_queue = NULL;
+        job.err = run_decode_stage(url);
+    }
+    render_queue_destroy(render_queue);
+    render_queue = NULL;
+    packet_queue_destroy(packet_queue);
+    packet_queue = NULL;
+    return job.err;
+}
+
+// Between two channels: the next stream starts from nothing but what is
+// kept for it, the demuxer with its connection, the decoder with its
+// picture buffers and the window. The pictures the decoder still holds
+// are the last channel's and are dropped.
+static void restart_stream(void) {
+    decoder_picture_t pic;
+    if (decoder) {
+        decoder_flush(decoder);
+        while (decoder_get_picture(decoder, &pic)) {}
+    }
+    if (ts_demux) ts_demux_reset(ts_demux);
+    if (fmp4_demux) {
+        fmp4_demux_destroy(fmp4_demux);
+        fmp4_demux = NULL;
+    }
+    pts_queue_len = 0;
+    clock_last_pts = TS_NO_TIMESTAMP;
+    pending_pts = TS_NO_TIMESTAMP;
+    pthread_mutex_lock(&timeline_lock);
+    timeline_count = 0;
+    timeline_open = 0;
+    pthread_mutex_unlock(&timeline_lock);
+    live_latency_us = 0;
+    present_delay_us = 0;
+    catching_up = 0;
+    awaiting_rap = 1;
+    present_restart(&presenter);
+    memset(&hls_demuxer->stats, 0, sizeof(hls_demuxer->stats));
 }
 
 void cleanup_resources() {
@@ -714,6 +1067,7 @@ void cleanup_resources() {
     if (rgb_buffer) {
         av_free(rgb_buffer);
         rgb_buffer = NULL;
+        rgb_buffer_capacity = 0;
     }
     if (rgb_frame) {
         av_frame_free(&rgb_frame);
@@ -728,36 +1082,36 @@ void cleanup_resources() {
     if (codec_ctx) {
         avcodec_free_context(&codec_ctx);
     }
+    hwaccel_destroy(hwaccel);
+    hwaccel = NULL;
     if (format_ctx) {
         avformat_close_input(&format_ctx);
     }
+    hls_avio_close(hls_avio);
+    hls_avio = NULL;
 #endif
 
-#ifdef NO_FFMPEG
-    if (rgb_buffer) {
-        free(rgb_buffer);
-        rgb_buffer = NULL;
-    }
-    // Custom scaling context cleanup would go here
-#endif
+    yuv2rgb_threads_destroy(convert_threads);
+    convert_threads = NULL;
     
-    // Clean up custom decoders
-    if (h264_decoder) {
-        simple_h264_destroy(h264_decoder);
-        h264_decoder = NULL;
-    }
-#ifdef USE_MPEG4
-    if (mpeg4_decoder) {
-        mpeg4_destroy_decoder(mpeg4_decoder);
-        mpeg4_decoder = NULL;
-    }
-#endif
+    // Clean up the decoder
+    decoder_destroy(decoder);
+    decoder = NULL;
     
     // Clean up HLS demuxer
     if (hls_demuxer) {
         hls_demuxer_destroy(hls_demuxer);
         hls_demuxer = NULL;
     }
+    if (ts_demux) {
+        ts_demux_destroy(ts_demux);
+        ts_demux = NULL;
+    }
+    if (fmp4_demux) {
+        fmp4_demux_destroy(fmp4_demux);
+        fmp4_demux = NULL;
+    }
+    nal_index_free(&nal_index);
     if (video) {
         video_destroy(video);
         video = NULL;
@@ -778,6 +1132,9 @@ void cleanup_resources() {
     }
     
     SDL_Quit();
+    twitch_prewarm_wait();
+    metrics_stop();
+    trace_stop();
 }
 
 int get_user_input_gui(char *buffer, size_t buffer_size) {
@@ -875,9 +1232,14 @@ char *resolve_stream_url(const char *input) {
         return strdup(input);
     }
     
-    // Try to resolve as Twitch channel
+    // Try to resolve as Twitch channel. The built-in HLS demuxer adapts
+    // between renditions itself, so it gets the master playlist.
     printf("Resolving Twitch channel: %s\n", input);
+#ifdef NO_FFMPEG
+    char *resolved = twitch_resolve_master(input);
+#else
     char *resolved = twitch_resolve(input);
+#endif
     if (resolved) {
         printf("Resolved to: %s\n", resolved);
         return resolved;
@@ -887,6 +1249,121 @@ char *resolve_stream_url(const char *input) {
     return strdup(input);
 }
 
+// Background resolution, so startup work that does not need the URL can
+// run while the resolver waits on the network
+typedef struct {
+    const char *input;
+    char *url;
+} resolve_job_t;
+
+static void *resolve_worker(void *arg) {
+    resolve_job_t *job = (resolve_job_t *)arg;
+    job->url = resolve_stream_url(job->input);
+    return NULL;
+}
+
+// Resolve `count` inputs at once. The HLS URLs among them go to urls[] in
+// order (jobs[] owns them, free each job's url); returns how many, 0 when
+// out of memory.
+static int resolve_streams(int count, char **inputs, resolve_job_t *jobs, const char **urls, const char *mode) {
+    for (int i = 0; i < count; i++) {
+        jobs[i].input = inputs[i];
+        jobs[i].url = NULL;
+    }
+    pthread_t *resolvers = malloc((size_t)count * sizeof(*resolvers));
+    int *resolving = calloc((size_t)count, sizeof(*resolving));
+    if (!resolvers || !resolving) {
+        fprintf(stderr, "%s: out of memory\n", mode);
+        free(resolving);
+        free(resolvers);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        resolving[i] = pthread_create(&resolvers[i], NULL, resolve_worker, &jobs[i]) == 0;
+        if (!resolving[i]) jobs[i].url = resolve_stream_url(inputs[i]);
+    }
+    int playable = 0;
+    for (int i = 0; i < count; i++) {
+        if (resolving[i]) pthread_join(resolvers[i], NULL);
+        if (jobs[i].url && is_hls_stream(jobs[i].url)) urls[playable++] = jobs[i].url;
+        else fprintf(stderr, "%s: %s is not an HLS stream, left out\n", mode, inputs[i]);
+    }
+    free(resolving);
+    free(resolvers);
+    return playable;
+}
+
+// Several inputs: resolve them all at once and play them as a mosaic
+// (include/mosaic.h). Returns the exit status.
+static int play_mosaic(int count, char **inputs) {
+    if (count > MOSAIC_MAX_STREAMS) count = MOSAIC_MAX_STREAMS;
+    resolve_job_t jobs[MOSAIC_MAX_STREAMS];
+    const char *urls[MOSAIC_MAX_STREAMS];
+    int playable = resolve_streams(count, inputs, jobs, urls, "Mosaic");
+    int status = playable && mosaic_play(urls, playable, &pipeline) == 0 ? 0 : 1;
+    for (int i = 0; i < count; i++) free(jobs[i].url);
+    return status;
+}
+
+// ANHELO_PREVIEW: the inputs as a grid of thumbnails refreshed every
+// `interval` seconds (include/preview.h). Returns the exit status.
+static int play_preview(int count, char **inputs, double interval) {
+    if (count > PREVIEW_MAX_CHANNELS) count = PREVIEW_MAX_CHANNELS;
+    resolve_job_t jobs[PREVIEW_MAX_CHANNELS];
+    const char *urls[PREVIEW_MAX_CHANNELS];
+    int playable = resolve_streams(count, inputs, jobs, urls, "Preview");
+    int status = playable && preview_browse(urls, playable, interval) == 0 ? 0 : 1;
+    for (int i = 0; i < count; i++) free(jobs[i].url);
+    return status;
+}
+
+// ANHELO_ZAP=1 with several inputs: play them one at a time, Page Up and
+// Page Down switching between them. The demuxer, the decoder and the
+// window stay across switches, and the standby (include/standby.h) keeps
+// the channel after the current one, in the direction of the last
+// switch, fetched ahead. Returns the exit status.
+static int play_channels(int count, char **inputs) {
+    if (count > STANDBY_MAX_CHANNELS) count = STANDBY_MAX_CHANNELS;
+    resolve_job_t jobs[STANDBY_MAX_CHANNELS];
+    const char *urls[STANDBY_MAX_CHANNELS];
+    int playable = resolve_streams(count, inputs, jobs, urls, "Channels");
+    if (!hls_demuxer) hls_demuxer = hls_demuxer_create();
+    int status = playable && hls_demuxer && use_decoder(DECODER_CAP_H264) ? 0 : 1;
+    // ANHELO_ZAP_STANDBY=0 switches without fetching ahead, for comparison
+    const char *warm_env = getenv("ANHELO_ZAP_STANDBY");
+    int use_standby = status == 0 && playable > 1 && !(warm_env && strcmp(warm_env, "0") == 0);
+    standby_t *standby = use_standby ? standby_create(urls, playable) : NULL;
+    if (status == 0) {
+        const char *fast_start = getenv("ANHELO_FAST_START");
+        hls_demuxer->fast_start = !fast_start || strcmp(fast_start, "0") != 0;
+        awaiting_rap = hls_demuxer->fast_start;
+        channel_count = playable;
+    }
+    int channel = 0, step = 1;
+    while (status == 0) {
+        hls_primed_t primed = {0};
+        int warm = standby_take(standby, channel, &primed);
+        standby_target(standby, (channel + step + playable) % playable);
+        printf("Channel %d of %d%s: %s\n", channel + 1, playable, warm ? ", from the standby" : "", urls[channel]);
+        hls_demuxer->primed = warm ? &primed : NULL;
+        should_quit_hls = 0;
+        channel_step = 0;
+        hls_error_t err = play_hls_stream(urls[channel]);
+        hls_demuxer->primed = NULL;
+        hls_primed_clear(&primed);
+        if (err != HLS_OK) fprintf(stderr, "HLS processing failed: %s\n", hls_get_error_string(err));
+        step = channel_step;
+        if (!step) break;
+        channel = (channel + step + playable) % playable;
+        restart_stream();
+        switch_started_us = get_time_us();
+    }
+    standby_destroy(standby);
+    channel_count = 0;
+    for (int i = 0; i < count; i++) free(jobs[i].url);
+    return status;
+}
+
 #ifndef NO_FFMPEG
 int init_ffmpeg(const char *url) {
     // Initialize FFmpeg (not needed in newer versions)
@@ -941,6 +1418,13 @@ int init_ffmpeg(const char *url) {
     av_dict_set(&opts, "hls_list_size", "10", 0); // Keep more segments
 #endif
     
+    // HLS from our own fetcher instead of FFmpeg's HLS demuxer; the hls_*
+    // and buffer options above then go unused
+    if (hls_avio) {
+        format_ctx->pb = hls_avio_context(hls_avio);
+        format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    
     if (avformat_open_input(&format_ctx, url, NULL, &opts) < 0) {
         fprintf(stderr, "Failed to open input: %s\n", url);
         av_dict_free(&opts);
@@ -1037,6 +1521,9 @@ int init_ffmpeg(const char *url) {
     av_dict_set(&codec_opts, "tune", "fastdecode", 0); // Optimize for decoding speed
     av_dict_set(&codec_opts, "preset", "fast", 0); // Balance between speed and quality
     
+    // Surfaces on the GPU instead, where asked for and available
+    hwaccel = hwaccel_attach(codec_ctx, codec, getenv("ANHELO_HWACCEL"));
+    
     // Open codec
     if (avcodec_open2(codec_ctx, codec, &codec_opts) < 0) {
         fprintf(stderr, "Failed to open codec\n");
@@ -1053,57 +1540,88 @@ int init_ffmpeg(const char *url) {
         return -1;
     }
     
-    // Allocate buffer for RGB frame with memory-efficient alignment
-#ifdef MINIMAL_MEMORY_BUFFERS
-    // In low-memory mode, use minimal alignment for memory savings
-    int rgb_buffer_size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, codec_ctx->width, codec_ctx->height, 1);
-#else
-    // Optimized alignment for performance
-    int rgb_buffer_size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, codec_ctx->width, codec_ctx->height, 16);
-#endif
-    
-    rgb_buffer = (uint8_t *)av_malloc(rgb_buffer_size);
-    if (!rgb_buffer) {
-        fprintf(stderr, "Failed to allocate RGB buffer\n");
-        return -1;
-    }
+    printf("Video stream: %dx%d, codec: %s\n", 
+           codec_ctx->width, codec_ctx->height, codec->name);
     
+    return video_stream_idx;
+}
+
+// video_draw_pixmap() callback: the frame's VAAPI surface into the output's
+// pixmap
+static int put_frame_surface(unsigned long pixmap, int width, int height, void *user) {
+    return hwaccel_put_pixmap(hwaccel, user, pixmap, width, height);
+}
+
+// RGB for the pictures the output can't take as YUV. The scaler comes from
+// sws_getCachedContext, which hands the same one back while size and
+// format stay, and the buffer only grows, so a resolution switch
+// allocates once at most.
+static int convert_ffmpeg_frame(const AVFrame *picture) {
+    int sws_flags = SWS_FAST_BILINEAR;
 #ifdef MINIMAL_MEMORY_BUFFERS
-    if (av_image_fill_arrays(rgb_frame->data, rgb_frame->linesize, rgb_buffer, AV_PIX_FMT_RGB24, 
-                            codec_ctx->width, codec_ctx->height, 1) < 0) {
-#else
-    if (av_image_fill_arrays(rgb_frame->data, rgb_frame->linesize, rgb_buffer, AV_PIX_FMT_RGB24, 
-                            codec_ctx->width, codec_ctx->height, 16) < 0) {
+    // lowest-memory/resolution-preserving scaling
+    sws_flags = SWS_POINT;
 #endif
-        fprintf(stderr, "Failed to fill RGB frame arrays\n");
+    sws_ctx = sws_getCachedContext(sws_ctx, picture->width, picture->height, (enum AVPixelFormat)picture->format,
+                                   picture->width, picture->height, AV_PIX_FMT_RGB24,
+                                   sws_flags, NULL, NULL, NULL);
+    if (!sws_ctx) {
+        fprintf(stderr, "Failed to create sws context for %dx%d fmt %d\n", picture->width, picture->height, picture->format);
         return -1;
     }
-    
-    // Initialize scaling context with optimized flags
-    {
-        int sws_flags = SWS_FAST_BILINEAR;
-#ifdef MINIMAL_MEMORY_BUFFERS
-        // lowest-memory/resolution-preserving scaling
-        sws_flags = SWS_POINT;
-#endif
-        sws_ctx = sws_getCachedContext(NULL,
-                                      codec_ctx->width, codec_ctx->height, codec_ctx->pix_fmt,
-                                      codec_ctx->width, codec_ctx->height, AV_PIX_FMT_RGB24,
-                                      sws_flags, NULL, NULL, NULL);
-        if (!sws_ctx) {
-            fprintf(stderr, "Failed to initialize scaling context (sws)\n");
+    // Rows aligned for the scaler's SIMD stores
+    int size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, picture->width, picture->height, 32);
+    if (size < 0) return -1;
+    if (size > rgb_buffer_capacity) {
+        av_free(rgb_buffer);
+        rgb_buffer = (uint8_t *)av_malloc(size);
+        rgb_buffer_capacity = rgb_buffer ? size : 0;
+        if (!rgb_buffer) {
+            fprintf(stderr, "Failed to allocate RGB buffer (FFmpeg path)\n");
             return -1;
         }
     }
-    
-    printf("Video stream: %dx%d, codec: %s\n", 
-           codec_ctx->width, codec_ctx->height, codec->name);
-    
-    return video_stream_idx;
+    if (av_image_fill_arrays(rgb_frame->data, rgb_frame->linesize, rgb_buffer,
+                             AV_PIX_FMT_RGB24, picture->width, picture->height, 32) < 0) {
+        fprintf(stderr, "Failed to fill RGB arrays (FFmpeg path)\n");
+        return -1;
+    }
+#ifdef MINIMAL_MEMORY_BUFFERS
+    /* Slice-based conversion to reduce peak memory working set.
+     * Processes small horizontal stripes instead of converting whole frame at once.
+     * Adjust slice_h for a trade-off between CPU overhead and peak memory.
+     */
+    const int slice_h = 32; /* small stripe height */
+    for (int y = 0; y < picture->height; y += slice_h) {
+        int h = picture->height - y;
+        if (h > slice_h) h = slice_h;
+        uint8_t *dst_ptr = rgb_frame->data[0] + y * rgb_frame->linesize[0];
+        uint8_t *dst_data[4] = { dst_ptr, NULL, NULL, NULL };
+        int dst_linesize[4] = { rgb_frame->linesize[0], 0, 0, 0 };
+        sws_scale(sws_ctx, (uint8_t const * const *)picture->data, picture->linesize, y, h,
+                  dst_data, dst_linesize);
+    }
+#else
+    sws_scale(sws_ctx, (uint8_t const * const *)picture->data, picture->linesize, 0, picture->height,
+              rgb_frame->data, rgb_frame->linesize);
+#endif
+    return 0;
 }
 #endif
 
-// H264BSD decoder functions removed - using simple_h264 decoder instead
+static void print_playback_stats(void) {
+    if (frames_displayed > 0) {
+        int dropped = frames_dropped + (int)presenter.stats.dropped;
+        printf("Performance: %d frames displayed, %d frames dropped (%.1f%% drop rate)\n", 
+               frames_displayed, dropped, 
+               (float)dropped / (frames_displayed + dropped) * 100.0f);
+        printf("Presentation: %lu early, %lu late, %lu dropped as late\n",
+               presenter.stats.early, presenter.stats.late, presenter.stats.dropped);
+        if (live_latency_us || present_delay_us)
+            printf("Latency: %.2f s behind the program date-time, %.0f ms from download to screen\n",
+                   live_latency_us / 1e6, present_delay_us / 1e3);
+    }
+}
 
 int init_video_output(int width, int height) {
     // Create video output
@@ -1112,6 +1630,7 @@ int init_video_output(int width, int height) {
         fprintf(stderr, "Failed to create video output\n");
         return -1;
     }
+    present_set_vsync(&presenter, video_vsync(video));
     
     return 0;
 }
@@ -1124,9 +1643,41 @@ int main(int argc, char *argv[]) {
     AVPacket packet; /* stack packet - avoid holding packet memory between iterations */
     int should_quit = 0;
 #endif
-    /* cURL easy handles are initialized per-use in resolver/demuxer. */
+    /* cURL easy handles are initialized per-use in resolver/demuxer.
+     * The global init is not thread-safe, so do it before any thread starts. */
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    pipeline_config_load(&pipeline);
+    trace_start();
+    metrics_start();
+    char features[64];
+    cpu_feature_names(cpu_features(), features, sizeof(features));
+    printf("CPU features: %s\n", features);
+
+    // The display's refresh rate is measured from the swaps unless
+    // ANHELO_REFRESH_HZ gives it
+    const char *refresh_hz = getenv("ANHELO_REFRESH_HZ");
+    double hz = refresh_hz ? atof(refresh_hz) : 0;
+    present_init(&presenter, frame_duration_us, hz >= 20 && hz <= 250 ? (uint64_t)(1000000 / hz) : 0);
+
+    // Anything but a direct URL goes through the Twitch resolver: start its
+    // DNS lookups and TLS handshakes now, overlapping SDL init and typing
+    // ANHELO_REPLAY=<dir> plays what ANHELO_CAPTURE=<dir> recorded instead of
+    // the network, as it came or, with ANHELO_REPLAY_SPEED=max, as fast as
+    // it decodes
+    const char *replay_dir = getenv("ANHELO_REPLAY");
+    const char *capture_dir = getenv("ANHELO_CAPTURE");
+    if (replay_dir && !*replay_dir) replay_dir = NULL;
+    if (!replay_dir && (argc <= 1 || (strncmp(argv[1], "http://", 7) != 0 && strncmp(argv[1], "https://", 8) != 0 &&
+                                      !is_hls_stream(argv[1])))) {
+        twitch_prewarm();
+    }
     
-    // Initialize SDL
+    // Initialize SDL; the null output needs no window
+#ifndef BACKEND_NULL
+#ifdef VAAPI_GLX
+    // The decoder's VAAPI threads share the window's X display
+    XInitThreads();
+#endif
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         fprintf(stderr, "SDL initialization failed: %s\n", SDL_GetError());
         fprintf(stderr, "Falling back to terminal mode\n");
@@ -1143,6 +1694,9 @@ int main(int argc, char *argv[]) {
         SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
         SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
         SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
+        // Swaps wait for the display's refresh unless ANHELO_VSYNC=0
+        const char *vsync = getenv("ANHELO_VSYNC");
+        SDL_GL_SetAttribute(SDL_GL_SWAP_CONTROL, !(vsync && strcmp(vsync, "0") == 0));
         
         // Create OpenGL window
         screen = SDL_SetVideoMode(640, 480, 32, SDL_OPENGL);
@@ -1162,9 +1716,42 @@ int main(int argc, char *argv[]) {
             SDL_WM_SetCaption("Anhelo - Video Stream Player", "Anhelo");
         }
     }
+#endif
     
+    // Thumbnails of every channel given, refreshed every few seconds
+    const char *preview = getenv("ANHELO_PREVIEW");
+    if (preview && atof(preview) > 0.0 && argc > 1 && !replay_dir) {
+        int status = play_preview(argc - 1, argv + 1, atof(preview));
+        cleanup_resources();
+        return status;
+    }
+
+    // More than one stream: all of them, tiled on the window, or with
+    // ANHELO_ZAP=1 one at a time to switch between
+    const char *zap = getenv("ANHELO_ZAP");
+    if (argc > 2 && !replay_dir) {
+        int status = zap && strcmp(zap, "0") != 0 ? play_channels(argc - 1, argv + 1) : play_mosaic(argc - 1, argv + 1);
+        if (zap && strcmp(zap, "0") != 0) print_playback_stats();
+        cleanup_resources();
+        return status;
+    }
+
     // Get input from user
-    if (argc > 1) {
+    if (replay_dir) {
+        hls_replay_speed_t speed = HLS_REPLAY_REALTIME;
+        const char *env = getenv("ANHELO_REPLAY_SPEED");
+        if (env && strcmp(env, "max") == 0) speed = HLS_REPLAY_MAX_SPEED;
+        hls_demuxer = hls_demuxer_create();
+        hls_error_t err = hls_demuxer ? hls_replay_start(hls_demuxer, replay_dir, speed) : HLS_ERROR_MEMORY;
+        if (err != HLS_OK) {
+            fprintf(stderr, "Cannot replay %s: %s\n", replay_dir, hls_get_error_string(err));
+            cleanup_resources();
+            return 1;
+        }
+        unpaced = speed == HLS_REPLAY_MAX_SPEED;
+        strncpy(input_buffer, hls_replay_url(hls_demuxer), sizeof(input_buffer) - 1);
+        input_buffer[sizeof(input_buffer) - 1] = '\0';
+    } else if (argc > 1) {
         strncpy(input_buffer, argv[1], sizeof(input_buffer) - 1);
         input_buffer[sizeof(input_buffer) - 1] = '\0';
     } else {
@@ -1184,8 +1771,19 @@ int main(int argc, char *argv[]) {
     
     printf("Input: %s\n", input_buffer);
     
-    // Resolve stream URL
-    stream_url = resolve_stream_url(input_buffer);
+    // Resolve stream URL in the background
+    resolve_job_t job = { input_buffer, NULL };
+    pthread_t resolver;
+    int resolving = pthread_create(&resolver, NULL, resolve_worker, &job) == 0;
+    if (!resolving) job.url = resolve_stream_url(input_buffer);
+#ifdef NO_FFMPEG
+    // Meanwhile set up what every NO_FFMPEG stream needs: the HLS demuxer
+    // and an H.264 decoder
+    if (!hls_demuxer) hls_demuxer = hls_demuxer_create();
+    use_decoder(DECODER_CAP_H264);
+#endif
+    if (resolving) pthread_join(resolver, NULL);
+    stream_url = job.url;
     if (!stream_url) {
         fprintf(stderr, "Failed to resolve stream URL\n");
         cleanup_resources();
@@ -1211,43 +1809,33 @@ int main(int argc, char *argv[]) {
 #ifdef NO_FFMPEG
     && 1
 #else
-    && 0 /* Prefer FFmpeg for HLS when available */
+    && replay_dir /* Prefer FFmpeg for HLS when available, replays need the demuxer */
 #endif
     ) {
         // Use HLS demuxer
-        hls_demuxer = hls_demuxer_create();
+        if (!hls_demuxer) hls_demuxer = hls_demuxer_create();
         if (!hls_demuxer) {
             fprintf(stderr, "Failed to create HLS demuxer\n");
             free(stream_url);
             cleanup_resources();
             return 1;
         }
+        if (capture_dir && *capture_dir && !replay_dir && hls_capture_start(hls_demuxer, capture_dir) != HLS_OK)
+            fprintf(stderr, "Cannot capture to %s, playing without\n", capture_dir);
+        // Fast start at the live edge, from the first IDR or recovery
+        // point of the newest segment; ANHELO_FAST_START=0 joins
+        // live_start_segments back instead
+        const char *fast_start = getenv("ANHELO_FAST_START");
+        hls_demuxer->fast_start = !fast_start || strcmp(fast_start, "0") != 0;
+        awaiting_rap = hls_demuxer->fast_start;
         
-        // Determine decoder to use based on URL or content
-        // For now, assume H.264 for HLS streams
-        use_custom_decoder = 1;
-        
-        // Initialize custom decoder
-        if (use_custom_decoder == 1) {
-            h264_decoder = simple_h264_create();
-            if (!h264_decoder) {
-                fprintf(stderr, "Failed to initialize simple H.264 decoder\n");
-                free(stream_url);
-                cleanup_resources();
-                return 1;
-            }
-        } else if (use_custom_decoder == 2) {
-#ifdef USE_MPEG4
-            // MPEG-4 decoder initialization would go here
-            // For now, assume 640x480
-            mpeg4_decoder = mpeg4_create_decoder(640, 480);
-            if (!mpeg4_decoder) {
-                fprintf(stderr, "Failed to create MPEG-4 decoder\n");
-                free(stream_url);
-                cleanup_resources();
-                return 1;
-            }
-#endif
+        // Start with H.264, the usual HLS video codec; the decoder is
+        // replaced if the PMT announces another one
+        if (!use_decoder(DECODER_CAP_H264)) {
+            fprintf(stderr, "Failed to initialize H.264 decoder\n");
+            free(stream_url);
+            cleanup_resources();
+            return 1;
         }
         
     // Initialize frames and scaling for custom decoders
@@ -1268,20 +1856,41 @@ int main(int argc, char *argv[]) {
         
         // Process HLS stream
     should_quit_hls = 0;
-    hls_error_t hls_err = hls_process_stream(hls_demuxer, stream_url, hls_segment_callback, NULL);
+    hls_error_t hls_err = play_hls_stream(stream_url);
         if (hls_err != HLS_OK) {
             fprintf(stderr, "HLS processing failed: %s\n", hls_get_error_string(hls_err));
         }
-        
+
         hls_demuxer_destroy(hls_demuxer);
+        hls_demuxer = NULL;
         if (should_quit_hls) {
             printf("Playback interrupted by user\n");
         } else if (hls_err != HLS_OK) {
             fprintf(stderr, "HLS processing failed: %s\n", hls_get_error_string(hls_err));
+            // The URL may have come from the resolver cache; resolve afresh next time
+            if (strcmp(stream_url, input_buffer) != 0) twitch_cache_forget(input_buffer);
         }
     } else {
 #ifndef NO_FFMPEG
-        // Use FFmpeg for non-HLS streams
+        // HLS is still fetched by our demuxer, with its prefetch queue,
+        // shared connections and fast start, FFmpeg only demuxing the
+        // segments and decoding; ANHELO_FFMPEG_HLS=1 leaves the playlist
+        // to FFmpeg's own HLS demuxer
+        const char *ffmpeg_hls = getenv("ANHELO_FFMPEG_HLS");
+        if (use_hls_demuxer && !(ffmpeg_hls && strcmp(ffmpeg_hls, "0") != 0)) {
+            if (!hls_demuxer) hls_demuxer = hls_demuxer_create();
+            if (hls_demuxer) {
+                if (capture_dir && *capture_dir && hls_capture_start(hls_demuxer, capture_dir) != HLS_OK)
+                    fprintf(stderr, "Cannot capture to %s, playing without\n", capture_dir);
+                const char *fast_start = getenv("ANHELO_FAST_START");
+                hls_demuxer->fast_start = !fast_start || strcmp(fast_start, "0") != 0;
+                hls_demuxer->fetch_cpus = pipeline.cpus[PIPELINE_FETCH];
+                hls_avio = hls_avio_open(hls_demuxer, stream_url);
+            }
+            if (!hls_avio) fprintf(stderr, "HLS fetcher unavailable, FFmpeg fetches the stream\n");
+        }
+        
+        // FFmpeg demuxes (and for other streams fetches) and decodes
         video_stream_idx = init_ffmpeg(stream_url);
         if (video_stream_idx < 0) {
             fprintf(stderr, "Failed to initialize FFmpeg\n");
@@ -1299,19 +1908,26 @@ int main(int argc, char *argv[]) {
         }
         
         printf("Starting playback... Press Q or ESC to quit\n");
+        int output_width = codec_ctx->width, output_height = codec_ctx->height;
         
         // Initialize stack packet (no long-lived allocation)
         memset(&packet, 0, sizeof(packet));
-        
-        // Initialize timing
-        last_frame_time = get_time_us();
+#ifndef DISABLE_FRAMESKIP
+        int ffmpeg_skip_applied = 0; // Skip level codec_ctx was last set to
+#endif
         
         // Main playback loop with proper frame timing
         while (!should_quit && av_read_frame(format_ctx, &packet) >= 0) {
             if (packet.stream_index == video_stream_idx) {
                 /* Avoid pre-decode packet dropping: it breaks decoder references
-                 * (missing refs, mmco failures). We do frameskip post-decode only.
+                 * (missing refs, mmco failures). Late pictures raise the
+                 * skip level instead, which the decoder takes up here.
                  */
+#ifndef DISABLE_FRAMESKIP
+                int level = skip_level;
+                if (level != ffmpeg_skip_applied) set_ffmpeg_skip(codec_ctx, level);
+                ffmpeg_skip_applied = level;
+#endif
                 // Send packet to decoder
                 int ret = avcodec_send_packet(codec_ctx, &packet);
                 if (ret < 0) {
@@ -1333,114 +1949,56 @@ int main(int argc, char *argv[]) {
                         break;
                     }
                     
-                    // Improved frame timing control for smoother playback
-                    uint64_t current_time = get_time_us();
-                    uint64_t elapsed = current_time - last_frame_time;
-                    
-    #ifndef DISABLE_FRAMESKIP
-                    /* Compile-time frameskip behavior:
-                     * After displaying a frame we set skip_remaining = FRAMESKIP_AMOUNT.
-                     * While skip_remaining > 0 we skip decoded frames (counting them as dropped)
-                     * and decrement the counter. This yields: [displayed, skip...skip, displayed].
-                     */
-                    if (FRAMESKIP_AMOUNT > 0 && skip_remaining > 0) {
-                        // Discard this decoded frame and advance the playback clock
-                        // so we don't try to "catch up" by showing skipped frames.
-                        frames_dropped++;
-                        skip_remaining--;
-                        last_frame_time += frame_duration_us; // advance timeline for skipped frame
-                        continue;
+                    // Wait for the frame's presentation time, or leave it
+                    // out when it is too late
+                    if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+                        pts_queue_push(av_rescale_q(frame->best_effort_timestamp,
+                                                    format_ctx->streams[video_stream_idx]->time_base,
+                                                    (AVRational){1, TS_CLOCK_HZ}) % PTS_WRAP);
                     }
-    #endif
+                    int64_t late;
+                    int dropped = present_frame(next_picture_pts(), &late) < 0;
+#ifndef DISABLE_FRAMESKIP
+                    update_skip_level(-late, get_time_us());
+#endif
+                    if (dropped) continue;
                     
-                    // Smoother timing with better sleep handling
-                    if (elapsed < frame_duration_us) {
-                        uint64_t sleep_time = frame_duration_us - elapsed;
-                        if (sleep_time > 1000 && sleep_time < 50000) { // Sleep between 1ms and 50ms
-                            usleep(sleep_time);
+                    if (frame->width != output_width || frame->height != output_height) {
+                        // Resolution switch (HLS ads): an output of the new size
+                        if (video) { video_destroy(video); video = NULL; }
+                        if (init_video_output(frame->width, frame->height) < 0) {
+                            fprintf(stderr, "Failed to reinit video output to %dx%d\n", frame->width, frame->height);
+                            break;
                         }
+                        output_width = frame->width;
+                        output_height = frame->height;
                     }
-                    
-                    // Update timing
-                    last_frame_time = get_time_us();
-                    
-                    // Ensure scaler/buffers match current frame size/format (HLS ads/resolution switches)
-                    {
-                        static int sws_w = 0, sws_h = 0, sws_fmt = -1;
-                        int f_w = frame->width > 0 ? frame->width : codec_ctx->width;
-                        int f_h = frame->height > 0 ? frame->height : codec_ctx->height;
-                        int f_fmt = frame->format >= 0 ? frame->format : codec_ctx->pix_fmt;
-                        if (!sws_ctx || sws_w != f_w || sws_h != f_h || sws_fmt != f_fmt || !rgb_buffer) {
-                            // Recreate sws context
-                            if (sws_ctx) { sws_freeContext(sws_ctx); sws_ctx = NULL; }
-                            int sws_flags = SWS_FAST_BILINEAR;
-                            sws_ctx = sws_getContext(f_w, f_h, (enum AVPixelFormat)f_fmt,
-                                                     f_w, f_h, AV_PIX_FMT_RGB24,
-                                                     sws_flags, NULL, NULL, NULL);
-                            if (!sws_ctx) {
-                                fprintf(stderr, "Failed to (re)create sws context for %dx%d fmt %d\n", f_w, f_h, f_fmt);
-                                break;
-                            }
-                            // Reallocate RGB buffer and fill arrays
-                            if (rgb_buffer) { av_free(rgb_buffer); rgb_buffer = NULL; }
-                            int rgb_buffer_size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, f_w, f_h, 16);
-                            rgb_buffer = (uint8_t *)av_malloc(rgb_buffer_size);
-                            if (!rgb_buffer) {
-                                fprintf(stderr, "Failed to allocate RGB buffer (FFmpeg path)\n");
-                                break;
-                            }
-                            if (av_image_fill_arrays(rgb_frame->data, rgb_frame->linesize, rgb_buffer,
-                                                     AV_PIX_FMT_RGB24, f_w, f_h, 16) < 0) {
-                                fprintf(stderr, "Failed to fill RGB arrays (FFmpeg path)\n");
-                                break;
-                            }
-                            sws_w = f_w; sws_h = f_h; sws_fmt = f_fmt;
-                            // Resize video output if needed
-                            if (video) { video_destroy(video); video = NULL; }
-                            if (init_video_output(f_w, f_h) < 0) {
-                                fprintf(stderr, "Failed to reinit video output to %dx%d\n", f_w, f_h);
-                                break;
-                            }
+                    // A VAAPI surface goes to the OpenGL output through an X
+                    // pixmap, never leaving the GPU. Else 4:2:0 goes to the
+                    // output as decoded, its planes read in place from the
+                    // frame (or its download from the GPU); other formats,
+                    // and outputs without a YUV path, go through RGB.
+                    if (video_draw_pixmap(video, put_frame_surface, frame) < 0) {
+                        const AVFrame *picture = hwaccel_download(hwaccel, frame);
+                        if (!picture) {
+                            frames_dropped++;
+                            continue;
+                        }
+                        decoder_picture_t pic;
+                        if (hwaccel_picture(hwaccel, picture, &pic) < 0 ||
+                            video_draw_yuv(video, pic.width, pic.height, pic.y, pic.u, pic.v,
+                                           pic.y_stride, pic.uv_stride) < 0) {
+                            if (convert_ffmpeg_frame(picture) < 0) break;
+                            video_draw(video, rgb_buffer, rgb_frame->linesize[0]);
                         }
                     }
-
-                    // Convert frame to RGB (optimized scaling)
-    #ifdef MINIMAL_MEMORY_BUFFERS
-                    /* Slice-based conversion to reduce peak memory working set.
-                     * Processes small horizontal stripes instead of converting whole frame at once.
-                     * Adjust slice_h for a trade-off between CPU overhead and peak memory.
-                     */
-                    const int slice_h = 32; /* small stripe height */
-                    for (int y = 0; y < codec_ctx->height; y += slice_h) {
-                        int h = codec_ctx->height - y;
-                        if (h > slice_h) h = slice_h;
-                        uint8_t *dst_ptr = rgb_frame->data[0] + y * rgb_frame->linesize[0];
-                        uint8_t *dst_data[4] = { dst_ptr, NULL, NULL, NULL };
-                        int dst_linesize[4] = { rgb_frame->linesize[0], 0, 0, 0 };
-                        sws_scale(sws_ctx,
-                                  (uint8_t const * const *)frame->data, frame->linesize,
-                                  y, h,
-                                  dst_data, dst_linesize);
-                    }
-    #else
-                    sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
-                              frame->linesize, 0, frame->height > 0 ? frame->height : codec_ctx->height,
-                              rgb_frame->data, rgb_frame->linesize);
-    #endif
-                    
-                    // Draw frame (use correct stride)
-                    video_draw(video, rgb_buffer, rgb_frame->linesize[0]);
+                    present_shown(&presenter, get_time_us());
                     frames_displayed++;
                     // Poll for quit events
                     if (video_poll(video)) {
                         should_quit = 1;
                         break;
                     }
-                    /* After displaying a frame, set skip_remaining so the next
-                     * FRAMESKIP_AMOUNT decoded frames are skipped.
-                     */
-                    skip_remaining = FRAMESKIP_AMOUNT;
-                    
                     // Poll for quit events less frequently to reduce overhead
                     if (frames_displayed % 5 == 0 && video_poll(video)) {
                         should_quit = 1;
@@ -1457,6 +2015,9 @@ int main(int argc, char *argv[]) {
              // No additional delays - timing is controlled above
         }
         
+        if (hls_avio && hls_avio_error(hls_avio) != HLS_OK)
+            fprintf(stderr, "HLS processing failed: %s\n", hls_get_error_string(hls_avio_error(hls_avio)));
+        
         // Flush decoder
         printf("Flushing decoder...\n");
         avcodec_send_packet(codec_ctx, NULL);
@@ -1478,11 +2039,7 @@ int main(int argc, char *argv[]) {
         return 1;
 #endif
     }    printf("Playback finished\n");
-    if (frames_displayed > 0) {
-        printf("Performance: %d frames displayed, %d frames dropped (%.1f%% drop rate)\n", 
-               frames_displayed, frames_dropped, 
-               (float)frames_dropped / (frames_displayed + frames_dropped) * 100.0f);
-    }
+    print_playback_stats();
     
     // Cleanup
     free(stream_url);
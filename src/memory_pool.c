@@ -1,182 +1,259 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-
-#ifndef NO_FFMPEG
-#include <libavformat/avformat.h>
-#include <libavcodec/avcodec.h>
-#include <libavutil/imgutils.h>
-#endif
+#include <pthread.h>
 
 #include "../include/memory_pool.h"
+#include "../include/big_alloc.h"
+
+// Memory pool implementation. A block's memory follows its header.
+struct pool_block {
+    pool_block_t *next;
+    size_t size;
+    size_t used;
+};
+
+static pool_block_t *block_create(size_t size) {
+    pool_block_t *block = malloc(sizeof(pool_block_t) + size);
+    if (!block) return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+// size bytes at align from what is left of the block, or NULL
+static void *block_take(pool_block_t *block, size_t size, size_t align) {
+    uintptr_t base = (uintptr_t)(block + 1);
+    uintptr_t p = (base + block->used + align - 1) & ~(uintptr_t)(align - 1);
+    if (p - base > block->size || size > block->size - (p - base)) return NULL;
+    block->used = p - base + size;
+    return (void *)p;
+}
 
-// Memory pool implementation
 memory_pool_t *pool_create(size_t initial_size) {
     memory_pool_t *pool = malloc(sizeof(memory_pool_t));
     if (!pool) return NULL;
-    
-    pool->pool_size = initial_size > POOL_BLOCK_SIZE ? initial_size : POOL_BLOCK_SIZE;
-    pool->pool = malloc(pool->pool_size);
-    if (!pool->pool) {
+
+    pool->block_size = initial_size > POOL_BLOCK_SIZE ? initial_size : POOL_BLOCK_SIZE;
+    pool->first = block_create(pool->block_size);
+    if (!pool->first) {
         free(pool);
         return NULL;
     }
-    
-    pool->used = 0;
-    pool->next = NULL;
+    pool->current = pool->first;
     return pool;
 }
 
 void *pool_alloc(memory_pool_t *pool, size_t size) {
-    if (!pool) return malloc(size); // Fallback to regular malloc
-    
-    // Align to 8-byte boundaries
-    size = (size + 7) & ~7;
-    
-    // Check if current pool has enough space
-    if (pool->used + size <= pool->pool_size) {
-        void *ptr = pool->pool + pool->used;
-        pool->used += size;
-        return ptr;
+    return pool_alloc_aligned(pool, size, POOL_ALIGN);
+}
+
+void *pool_alloc_aligned(memory_pool_t *pool, size_t size, size_t align) {
+    if (!pool || !align || (align & (align - 1))) return NULL;
+    void *p = block_take(pool->current, size, align);
+    if (p) return p;
+
+    // The next block is empty; skip it (it stays chained) when too small
+    pool_block_t *next = pool->current->next;
+    if (next && (p = block_take(next, size, align))) {
+        pool->current = next;
+        return p;
     }
-    
-    // Need a new pool block
-    if (!pool->next) {
-        size_t new_size = size > POOL_BLOCK_SIZE ? size : POOL_BLOCK_SIZE;
-        pool->next = pool_create(new_size);
-        if (!pool->next) return malloc(size); // Fallback
+    if (size > SIZE_MAX - align) return NULL;
+    size_t need = size + align - 1;
+    pool_block_t *block = block_create(need > pool->block_size ? need : pool->block_size);
+    if (!block) return NULL;
+    block->next = next;
+    pool->current->next = block;
+    pool->current = block;
+    return block_take(block, size, align);
+}
+
+char *pool_strndup(memory_pool_t *pool, const char *s, size_t len) {
+    len = strnlen(s, len);
+    char *copy = pool_alloc_aligned(pool, len + 1, 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+pool_mark_t pool_mark(memory_pool_t *pool) {
+    pool_mark_t mark = { NULL, 0 };
+    if (pool) {
+        mark.block = pool->current;
+        mark.used = pool->current->used;
     }
-    
-    return pool_alloc(pool->next, size);
+    return mark;
+}
+
+void pool_rewind(memory_pool_t *pool, pool_mark_t mark) {
+    if (!pool || !mark.block) return;
+    for (pool_block_t *block = mark.block; block != pool->current; block = block->next)
+        block->next->used = 0;
+    mark.block->used = mark.used;
+    pool->current = mark.block;
 }
 
 void pool_reset(memory_pool_t *pool) {
-    while (pool) {
-        pool->used = 0;
-        pool = pool->next;
-    }
+    if (!pool) return;
+    pool_rewind(pool, (pool_mark_t){ pool->first, 0 });
 }
 
 void pool_destroy(memory_pool_t *pool) {
-    while (pool) {
-        memory_pool_t *next = pool->next;
-        free(pool->pool);
-        free(pool);
-        pool = next;
+    if (!pool) return;
+    pool_block_t *block = pool->first;
+    while (block) {
+        pool_block_t *next = block->next;
+        free(block);
+        block = next;
     }
+    free(pool);
 }
 
-// Frame pool implementation
-frame_pool_t *frame_pool_create(int width, int height, int pool_size) {
-    if (pool_size > FRAME_POOL_SIZE) pool_size = FRAME_POOL_SIZE;
-    
-    frame_pool_t *pool = malloc(sizeof(frame_pool_t));
-    if (!pool) return NULL;
-    
-    pool->pool_size = pool_size;
-    memset(pool->available, 1, sizeof(pool->available)); // All available initially
-    
-    // Pre-allocate frames and RGB buffers
-    for (int i = 0; i < pool_size; i++) {
-#ifndef NO_FFMPEG
-        AVFrame *frame = av_frame_alloc();
-        if (!frame) {
-            // Cleanup on failure
-            for (int j = 0; j < i; j++) {
-                av_frame_free((AVFrame**)&pool->frames[j]);
-                av_free(pool->rgb_buffers[j]);
-            }
-            free(pool);
-            return NULL;
-        }
-        
-        // Allocate RGB buffer
-        int rgb_size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, 1);
-        uint8_t *rgb_buffer = av_malloc(rgb_size);
-        if (!rgb_buffer) {
-            av_frame_free(&frame);
-            // Cleanup on failure
-            for (int j = 0; j < i; j++) {
-                av_frame_free((AVFrame**)&pool->frames[j]);
-                av_free(pool->rgb_buffers[j]);
-            }
-            free(pool);
-            return NULL;
-        }
-        
-        pool->frames[i] = frame;
-        pool->rgb_buffers[i] = rgb_buffer;
-#ifndef NO_FFMPEG
-        pool->rgb_sizes[i] = rgb_size;
-#endif
-#else
-        // For NO_FFMPEG, just allocate basic buffers
-        int rgb_size = width * height * 3; // RGB24
-        uint8_t *rgb_buffer = malloc(rgb_size);
-        if (!rgb_buffer) {
-            // Cleanup on failure
-            for (int j = 0; j < i; j++) {
-                free(pool->rgb_buffers[j]);
-            }
-            free(pool);
-            return NULL;
-        }
-        
-        pool->frames[i] = NULL; // No FFmpeg frames
-        pool->rgb_buffers[i] = rgb_buffer;
-#endif
-    }
-    
+static pthread_key_t thread_pool_key;
+static pthread_once_t thread_pool_once = PTHREAD_ONCE_INIT;
+
+static void thread_pool_free(void *pool) {
+    pool_destroy(pool);
+}
+
+static void thread_pool_init(void) {
+    pthread_key_create(&thread_pool_key, thread_pool_free);
+}
+
+memory_pool_t *pool_thread(void) {
+    pthread_once(&thread_pool_once, thread_pool_init);
+    memory_pool_t *pool = pthread_getspecific(thread_pool_key);
+    if (!pool && (pool = pool_create(POOL_BLOCK_SIZE))) pthread_setspecific(thread_pool_key, pool);
     return pool;
 }
 
-void *get_frame_from_pool(frame_pool_t *pool) {
+// Frame pool implementation. The free list is a stack of frame indices
+// whose head carries a change count next to the index, so a pop racing
+// with a pop and push of the same frame fails its compare-and-swap (ABA).
+struct frame_pool {
+    int capacity;
+    atomic_int refs;                    // The owner's, and one per frame out
+    _Atomic uint64_t free_head;         // Count << 32 | top index + 1 (0: empty)
+    atomic_int free_next[FRAME_POOL_MAX]; // Index + 1 of the frame below
+    frame_t frames[FRAME_POOL_MAX];
+};
+
+static void push_free_frame(frame_pool_t *pool, int index) {
+    uint64_t head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+    uint64_t top;
+    do {
+        atomic_store_explicit(&pool->free_next[index], (int)(head & 0xFFFFFFFFu), memory_order_relaxed);
+        top = (((head >> 32) + 1) << 32) | (uint64_t)(index + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, top,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+// Index of a free frame taken off the list, -1 if there is none
+static int pop_free_frame(frame_pool_t *pool) {
+    uint64_t head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+    uint64_t below;
+    do {
+        int top = (int)(head & 0xFFFFFFFFu);
+        if (!top) return -1;
+        int next = atomic_load_explicit(&pool->free_next[top - 1], memory_order_relaxed);
+        below = (((head >> 32) + 1) << 32) | (uint64_t)next;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, below,
+                                                    memory_order_acquire, memory_order_acquire));
+    return (int)(head & 0xFFFFFFFFu) - 1;
+}
+
+frame_pool_t *frame_pool_create(int capacity) {
+    if (capacity < 1) capacity = 1;
+    if (capacity > FRAME_POOL_MAX) capacity = FRAME_POOL_MAX;
+    frame_pool_t *pool = calloc(1, sizeof(frame_pool_t));
     if (!pool) return NULL;
-    
-    for (int i = 0; i < pool->pool_size; i++) {
-        if (pool->available[i]) {
-            pool->available[i] = 0;
-            return pool->frames[i];
-        }
+    pool->capacity = capacity;
+    atomic_init(&pool->refs, 1);
+    atomic_init(&pool->free_head, 0);
+    for (int i = capacity - 1; i >= 0; i--) {
+        pool->frames[i].pool = pool;
+        pool->frames[i].index = i;
+        atomic_init(&pool->frames[i].refs, 0);
+        push_free_frame(pool, i);
     }
-    
-    // Pool exhausted, return NULL (caller should handle)
-    return NULL;
+    return pool;
 }
 
-void *get_rgb_buffer_from_pool(frame_pool_t *pool, int index) {
-    if (!pool || index < 0 || index >= pool->pool_size) return NULL;
-    return pool->rgb_buffers[index];
+static void frame_pool_release(frame_pool_t *pool) {
+    if (atomic_fetch_sub_explicit(&pool->refs, 1, memory_order_acq_rel) != 1) return;
+    for (int i = 0; i < pool->capacity; i++) big_free(pool->frames[i].memory);
+    free(pool);
 }
 
-void return_frame_to_pool(frame_pool_t *pool, void *frame) {
-    if (!pool || !frame) return;
-    
-    for (int i = 0; i < pool->pool_size; i++) {
-        if (pool->frames[i] == frame) {
-            pool->available[i] = 1;
-            return;
-        }
+void frame_pool_destroy(frame_pool_t *pool) {
+    if (pool) frame_pool_release(pool);
+}
+
+static size_t frame_align(size_t n) {
+    return (n + FRAME_ALIGN - 1) & ~(size_t)(FRAME_ALIGN - 1);
+}
+
+// Lay a frame out for format at width x height: plane offsets and strides.
+// Returns the bytes it takes, padding included.
+static size_t frame_layout(frame_format_t format, int width, int height, size_t offsets[3], int strides[3]) {
+    if (format == FRAME_YUV420) {
+        int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+        strides[0] = (int)frame_align((size_t)width);
+        strides[1] = strides[2] = (int)frame_align((size_t)chroma_width);
+        offsets[0] = 0;
+        offsets[1] = frame_align((size_t)strides[0] * height);
+        offsets[2] = offsets[1] + frame_align((size_t)strides[1] * chroma_height);
+        return frame_align(offsets[2] + (size_t)strides[2] * chroma_height + FRAME_PADDING);
     }
+    int bytes_per_pixel = format == FRAME_BGRA32 ? 4 : 3;
+    strides[0] = (int)frame_align((size_t)width * bytes_per_pixel);
+    strides[1] = strides[2] = 0;
+    offsets[0] = offsets[1] = offsets[2] = 0;
+    return frame_align((size_t)strides[0] * height + FRAME_PADDING);
 }
 
-void frame_pool_destroy(frame_pool_t *pool) {
-    if (!pool) return;
-    
-    for (int i = 0; i < pool->pool_size; i++) {
-#ifndef NO_FFMPEG
-        if (pool->frames[i]) {
-            av_frame_free((AVFrame**)&pool->frames[i]);
-        }
-        if (pool->rgb_buffers[i]) {
-            av_free(pool->rgb_buffers[i]);
-        }
-#else
-        if (pool->rgb_buffers[i]) {
-            free(pool->rgb_buffers[i]);
+frame_t *frame_pool_get(frame_pool_t *pool, frame_format_t format, int width, int height) {
+    if (!pool || width <= 0 || height <= 0) return NULL;
+    int index = pop_free_frame(pool);
+    if (index < 0) return NULL;
+    frame_t *frame = &pool->frames[index];
+
+    size_t offsets[3];
+    int strides[3];
+    size_t size = frame_layout(format, width, height, offsets, strides);
+    // The memory is kept while it is large enough, and not over twice that
+    if (!frame->memory || frame->size < size || frame->size / 2 > size) {
+        big_free(frame->memory);
+        frame->size = 0;
+        frame->memory = big_alloc(size);
+        if (!frame->memory) {
+            push_free_frame(pool, index);
+            return NULL;
         }
-#endif
+        frame->size = size;
     }
-    
-    free(pool);
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    for (int i = 0; i < 3; i++) {
+        frame->strides[i] = strides[i];
+        frame->planes[i] = strides[i] ? frame->memory + offsets[i] : NULL;
+    }
+    atomic_store_explicit(&frame->refs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+    return frame;
+}
+
+void frame_ref(frame_t *frame) {
+    atomic_fetch_add_explicit(&frame->refs, 1, memory_order_relaxed);
+}
+
+void frame_unref(frame_t *frame) {
+    if (!frame || atomic_fetch_sub_explicit(&frame->refs, 1, memory_order_acq_rel) != 1) return;
+    frame_pool_t *pool = frame->pool;
+    push_free_frame(pool, frame->index);
+    frame_pool_release(pool);
 }
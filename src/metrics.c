@@ -0,0 +1,281 @@
+// Playback metrics, see include/metrics.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "../include/metrics.h"
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+} histogram_t;
+
+static histogram_t histograms[METRIC_STAGES];
+static _Atomic uint64_t counters[METRIC_COUNTERS];
+
+static const char *const stage_names[METRIC_STAGES] = {
+    "playlist_fetch_us", "segment_download_us", "segment_kbps", "demux_us", "decode_i_us", "decode_p_us",
+    "decode_b_us", "convert_us", "draw_us", "lateness_us", "live_latency_us", "present_delay_us", "queue_depth"
+};
+static const char *const counter_names[METRIC_COUNTERS] = {
+    "frames_decoded", "frames_displayed", "frames_dropped", "segments", "segment_bytes", "concealed_mbs"
+};
+
+uint64_t metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void metrics_record(metric_stage_t stage, uint64_t value) {
+    histogram_t *h = &histograms[stage];
+    unsigned bucket = value ? 64 - (unsigned)__builtin_clzll(value) : 0;
+    if (bucket >= METRICS_BUCKETS) bucket = METRICS_BUCKETS - 1;
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, value, memory_order_relaxed, memory_order_relaxed)) {}
+}
+
+void metrics_count(metric_counter_t counter, uint64_t n) {
+    atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+}
+
+void metrics_snapshot(metrics_snapshot_t *s) {
+    s->time_us = metrics_now_us();
+    for (int i = 0; i < METRIC_STAGES; i++) {
+        histogram_t *h = &histograms[i];
+        s->stages[i].count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        s->stages[i].sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+        s->stages[i].max = atomic_load_explicit(&h->max, memory_order_relaxed);
+        for (int b = 0; b < METRICS_BUCKETS; b++)
+            s->stages[i].buckets[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_COUNTERS; i++) s->counters[i] = atomic_load_explicit(&counters[i], memory_order_relaxed);
+}
+
+void metrics_delta(metrics_snapshot_t *d, const metrics_snapshot_t *to, const metrics_snapshot_t *from) {
+    d->time_us = to->time_us - from->time_us;
+    for (int i = 0; i < METRIC_STAGES; i++) {
+        d->stages[i].count = to->stages[i].count - from->stages[i].count;
+        d->stages[i].sum = to->stages[i].sum - from->stages[i].sum;
+        d->stages[i].max = to->stages[i].max;
+        for (int b = 0; b < METRICS_BUCKETS; b++)
+            d->stages[i].buckets[b] = to->stages[i].buckets[b] - from->stages[i].buckets[b];
+    }
+    for (int i = 0; i < METRIC_COUNTERS; i++) d->counters[i] = to->counters[i] - from->counters[i];
+}
+
+uint64_t metrics_percentile(const metrics_snapshot_t *s, metric_stage_t stage, double q) {
+    // The counts were read one by one while others were added: go by their sum
+    uint64_t total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) total += s->stages[stage].buckets[b];
+    if (!total) return 0;
+    double rank = q * (double)total;
+    uint64_t below = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        uint64_t n = s->stages[stage].buckets[b];
+        if (n && (double)(below + n) >= rank) {
+            if (b == 0) return 0;
+            double lo = (double)(1ULL << (b - 1)), hi = (double)(1ULL << b);
+            return (uint64_t)(lo + (hi - lo) * (rank - (double)below) / (double)n);
+        }
+        below += n;
+    }
+    return s->stages[stage].max;
+}
+
+uint64_t metrics_mean(const metrics_snapshot_t *s, metric_stage_t stage) {
+    return s->stages[stage].count ? s->stages[stage].sum / s->stages[stage].count : 0;
+}
+
+const char *metrics_stage_name(metric_stage_t stage) {
+    return stage_names[stage];
+}
+
+const char *metrics_counter_name(metric_counter_t counter) {
+    return counter_names[counter];
+}
+
+// Milliseconds with one decimal
+#define MS(us) ((double)(us) / 1000.0)
+
+int metrics_format_overlay(char *buf, size_t size, const metrics_snapshot_t *d) {
+    double seconds = d->time_us ? (double)d->time_us / 1e6 : 1.0;
+    return snprintf(buf, size,
+                    "FPS %.1f  DROPPED %llu  LATE P99 %.1f MS\n"
+                    "DECODE I %.1f P %.1f B %.1f MS (P99 %.1f)\n"
+                    "CONVERT %.1f  DRAW %.1f MS\n"
+                    "SEGMENT %.0f MS  %llu KBPS  DEMUX %.1f MS\n"
+                    "PLAYLIST %.0f MS\n"
+                    "LIVE %.2f S  DOWNLOAD TO SHOW %.0f MS  QUEUED %llu",
+                    (double)d->counters[METRIC_FRAMES_DISPLAYED] / seconds,
+                    (unsigned long long)d->counters[METRIC_FRAMES_DROPPED],
+                    MS(metrics_percentile(d, METRIC_LATENESS, 0.99)),
+                    MS(metrics_mean(d, METRIC_DECODE_I)), MS(metrics_mean(d, METRIC_DECODE_P)),
+                    MS(metrics_mean(d, METRIC_DECODE_B)),
+                    MS(metrics_percentile(d, METRIC_DECODE_P, 0.99)),
+                    MS(metrics_mean(d, METRIC_CONVERT)), MS(metrics_mean(d, METRIC_DRAW)),
+                    MS(metrics_mean(d, METRIC_SEGMENT_DOWNLOAD)),
+                    (unsigned long long)metrics_mean(d, METRIC_SEGMENT_KBPS),
+                    MS(metrics_mean(d, METRIC_DEMUX)),
+                    MS(metrics_mean(d, METRIC_PLAYLIST_FETCH)),
+                    (double)metrics_mean(d, METRIC_LIVE_LATENCY) / 1e6, MS(metrics_mean(d, METRIC_PRESENT_DELAY)),
+                    (unsigned long long)metrics_mean(d, METRIC_QUEUE_DEPTH));
+}
+
+#undef MS
+
+// Periodic dump
+
+static pthread_t dump_thread;
+static int dumping = 0;
+static int dump_stop = 0;
+static pthread_mutex_t dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dump_cond;
+static FILE *dump_file = NULL;
+static int dump_socket = -1;
+static unsigned dump_interval_s = 10;
+
+// One JSON line of the interval `d`, without the newline
+static int format_line(char *buf, size_t size, const metrics_snapshot_t *d) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    size_t used = 0;
+#define APPEND(...) do { \
+        int n = snprintf(buf + used, size - used, __VA_ARGS__); \
+        if (n < 0 || (size_t)n >= size - used) return -1; \
+        used += (size_t)n; \
+    } while (0)
+    APPEND("{\"time\":%lld.%03ld,\"interval_ms\":%llu,\"stages\":{", (long long)now.tv_sec, now.tv_nsec / 1000000,
+           (unsigned long long)(d->time_us / 1000));
+    for (int i = 0; i < METRIC_STAGES; i++) {
+        APPEND("%s\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}",
+               i ? "," : "", stage_names[i], (unsigned long long)d->stages[i].count,
+               (unsigned long long)metrics_mean(d, (metric_stage_t)i),
+               (unsigned long long)metrics_percentile(d, (metric_stage_t)i, 0.5),
+               (unsigned long long)metrics_percentile(d, (metric_stage_t)i, 0.9),
+               (unsigned long long)metrics_percentile(d, (metric_stage_t)i, 0.99),
+               (unsigned long long)d->stages[i].max);
+    }
+    APPEND("},\"counters\":{");
+    for (int i = 0; i < METRIC_COUNTERS; i++)
+        APPEND("%s\"%s\":%llu", i ? "," : "", counter_names[i], (unsigned long long)d->counters[i]);
+    APPEND("}}");
+#undef APPEND
+    return (int)used;
+}
+
+static void dump(const metrics_snapshot_t *d) {
+    char line[4096];
+    int len = format_line(line, sizeof(line), d);
+    if (len < 0) return;
+    if (dump_socket >= 0) {
+        send(dump_socket, line, (size_t)len, 0);
+    } else if (dump_file) {
+        fprintf(dump_file, "%s\n", line);
+        fflush(dump_file);
+    }
+}
+
+static void *dump_worker(void *arg) {
+    (void)arg;
+    static metrics_snapshot_t last, now, delta;
+    metrics_snapshot(&last);
+    pthread_mutex_lock(&dump_mutex);
+    for (;;) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += dump_interval_s;
+        while (!dump_stop && pthread_cond_timedwait(&dump_cond, &dump_mutex, &deadline) == 0) {}
+        int stop = dump_stop;
+        pthread_mutex_unlock(&dump_mutex);
+        metrics_snapshot(&now);
+        metrics_delta(&delta, &now, &last);
+        dump(&delta);
+        last = now;
+        if (stop) break;
+        pthread_mutex_lock(&dump_mutex);
+    }
+    return NULL;
+}
+
+// "udp://host:port": a connected datagram socket, -1 on failure
+static int open_udp(const char *target) {
+    char host[256];
+    const char *colon = strrchr(target, ':');
+    if (!colon || (size_t)(colon - target) >= sizeof(host)) return -1;
+    memcpy(host, target, (size_t)(colon - target));
+    host[colon - target] = '\0';
+    struct addrinfo hints = {0}, *res;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+void metrics_start(void) {
+    const char *target = getenv("ANHELO_METRICS");
+    if (!target || !*target || dumping) return;
+    const char *interval = getenv("ANHELO_METRICS_INTERVAL");
+    if (interval && atoi(interval) > 0) dump_interval_s = (unsigned)atoi(interval);
+
+    if (strncmp(target, "udp://", 6) == 0) {
+        dump_socket = open_udp(target + 6);
+        if (dump_socket < 0) {
+            fprintf(stderr, "Metrics: cannot reach %s\n", target);
+            return;
+        }
+    } else if (!(dump_file = fopen(target, "a"))) {
+        perror("Metrics: cannot open ANHELO_METRICS file");
+        return;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&dump_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    dump_stop = 0;
+    if (pthread_create(&dump_thread, NULL, dump_worker, NULL) != 0) {
+        pthread_cond_destroy(&dump_cond);
+        if (dump_file) fclose(dump_file);
+        if (dump_socket >= 0) close(dump_socket);
+        dump_file = NULL;
+        dump_socket = -1;
+        return;
+    }
+    dumping = 1;
+}
+
+void metrics_stop(void) {
+    if (!dumping) return;
+    pthread_mutex_lock(&dump_mutex);
+    dump_stop = 1;
+    pthread_cond_signal(&dump_cond);
+    pthread_mutex_unlock(&dump_mutex);
+    pthread_join(dump_thread, NULL);
+    pthread_cond_destroy(&dump_cond);
+    if (dump_file) fclose(dump_file);
+    if (dump_socket >= 0) close(dump_socket);
+    dump_file = NULL;
+    dump_socket = -1;
+    dumping = 0;
+}
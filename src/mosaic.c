@@ -0,0 +1,568 @@
+// Mosaic playback, see include/mosaic.h. One lock (mosaic_t.lock) covers
+// the rings of every stream and the workers' run queue; the data of a
+// packet or picture slot is only touched outside it by the one side that
+// owns the slot at the time.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/mosaic.h"
+#include "../include/hls_demuxer.h"
+#include "../include/ts_demux.h"
+#include "../include/fmp4_demux.h"
+#include "../include/nal_index.h"
+#include "../include/decoder.h"
+#include "../include/present.h"
+#include "../include/metrics.h"
+#include "../include/video.h"
+#include "../include/big_alloc.h"
+
+#define MOSAIC_PTS_QUEUE 32
+#define MOSAIC_FRAME_PTS 3000       // Step of a picture without a PTS, 90 kHz (30 fps)
+#define MOSAIC_IDLE_US 10000        // Longest the compositor sleeps between looks
+
+typedef enum {
+    PACKET_ANNEXB,                  // H.264 access unit with start codes (or length prefixes)
+    PACKET_LENGTH_PREFIXED,         // H.264 sample of fMP4, nal_length_size prefixes
+    PACKET_MPEG4,                   // MPEG-4 Part 2 frame
+    PACKET_FLUSH                    // End of the stream: output what the decoder holds
+} packet_kind_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size, capacity;
+    packet_kind_t kind;
+    int nal_length_size;
+    int64_t pts;
+} mosaic_packet_t;
+
+typedef struct {
+    uint8_t *planes;                // Y, then U, then V, tightly packed
+    size_t capacity;
+    int width, height;
+    int64_t pts;
+} mosaic_picture_t;
+
+typedef struct mosaic mosaic_t;
+
+typedef struct {
+    mosaic_t *mosaic;
+    int index;
+    const char *url;
+    hls_demuxer_t *demuxer;
+    pthread_t thread;               // Fetch and demux
+    int started;
+    // Demux thread
+    ts_demux_t *ts;
+    fmp4_demux_t *mp4;
+    // Decoding worker
+    decoder_t *decoder;
+    unsigned codec;
+    nal_index_t nal;
+    int awaiting_rap;               // Nothing but parameter sets before the first random access point
+    int recovery_point;             // SEI recovery point in the access unit of the slices coming
+    int64_t pts_queue[MOSAIC_PTS_QUEUE];
+    int pts_count;
+    int64_t last_pts;
+    unsigned output;                // DECODER_OUTPUT_* chosen, once the picture size is known
+    int output_chosen;
+    // Rings, under the lock
+    mosaic_packet_t packets[MOSAIC_PACKETS];
+    unsigned packet_head, packet_count;
+    mosaic_picture_t pictures[MOSAIC_PICTURES];
+    unsigned picture_head, picture_count;
+    int queued;                     // In the run queue
+    int running;                    // On a worker
+    int input_ended;                // Demux thread done, the flush packet is in
+    // Compositor
+    int64_t anchor_pts;             // TS_NO_TIMESTAMP until the first picture
+    uint64_t anchor_us;
+    unsigned long shown, dropped, decoded;
+} mosaic_stream_t;
+
+struct mosaic {
+    pthread_mutex_t lock;
+    pthread_cond_t work;            // Run queue not empty, or stopping
+    pthread_cond_t space;           // A packet slot was freed
+    pthread_cond_t pictures;        // A picture was published
+    int run_queue[MOSAIC_MAX_STREAMS];
+    unsigned run_head, run_count;
+    atomic_int stop;                // Set under the lock, read anywhere
+    mosaic_stream_t streams[MOSAIC_MAX_STREAMS];
+    int count;
+    pthread_t *workers;
+    int worker_count;
+    const pipeline_config_t *pipeline;
+    int cell_width, cell_height;
+    int decimate;                   // ANHELO_DECIMATE, 0 when not given
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Under the lock: put the stream on the run queue if it can be decoded,
+// that is it has packets, room for a picture and no worker
+static void schedule(mosaic_t *m, mosaic_stream_t *s) {
+    if (s->queued || s->running || !s->packet_count || s->picture_count == MOSAIC_PICTURES) return;
+    m->run_queue[(m->run_head + m->run_count++) % MOSAIC_MAX_STREAMS] = s->index;
+    s->queued = 1;
+    pthread_cond_signal(&m->work);
+}
+
+// Demux thread: copy an access unit into the stream's packet ring, waiting
+// for a slot. Returns non-zero once the mosaic stops.
+static int push_packet(mosaic_stream_t *s, packet_kind_t kind, const uint8_t *data, size_t size,
+                       int nal_length_size, int64_t pts) {
+    mosaic_t *m = s->mosaic;
+    pthread_mutex_lock(&m->lock);
+    while (!m->stop && s->packet_count == MOSAIC_PACKETS) pthread_cond_wait(&m->space, &m->lock);
+    if (m->stop) {
+        pthread_mutex_unlock(&m->lock);
+        return 1;
+    }
+    // The slot past the last is the demux thread's until it is counted
+    mosaic_packet_t *p = &s->packets[(s->packet_head + s->packet_count) % MOSAIC_PACKETS];
+    pthread_mutex_unlock(&m->lock);
+
+    if (size > p->capacity) {
+        uint8_t *grown = big_realloc(p->data, size);
+        if (!grown) return 0;
+        p->data = grown;
+        p->capacity = size;
+    }
+    if (size) memcpy(p->data, data, size);
+    p->size = size;
+    p->kind = kind;
+    p->nal_length_size = nal_length_size;
+    p->pts = pts;
+
+    pthread_mutex_lock(&m->lock);
+    s->packet_count++;
+    if (kind == PACKET_FLUSH) s->input_ended = 1;
+    schedule(m, s);
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+static int ts_packet(const ts_pes_t *pes, void *user_data) {
+    mosaic_stream_t *s = (mosaic_stream_t *)user_data;
+    if (pes->stream_type == TS_STREAM_MPEG4_VIDEO)
+        return push_packet(s, PACKET_MPEG4, pes->data, pes->size, 0, pes->pts);
+    if (pes->stream_type != 0 && pes->stream_type != TS_STREAM_H264) return 0;
+    return push_packet(s, PACKET_ANNEXB, pes->data, pes->size, 0, pes->pts);
+}
+
+static int mp4_packet(const fmp4_sample_t *sample, void *user_data) {
+    return push_packet((mosaic_stream_t *)user_data, PACKET_LENGTH_PREFIXED, sample->data, sample->size,
+                       sample->nal_length_size, sample->config ? TS_NO_TIMESTAMP : sample->pts);
+}
+
+static int segment_callback(const unsigned char *data, size_t size, void *user_data) {
+    mosaic_stream_t *s = (mosaic_stream_t *)user_data;
+    if (size == 0) return s->mosaic->stop;
+    if (fmp4_probe(data, size)) {
+        if (!s->mp4 && !(s->mp4 = fmp4_demux_create(mp4_packet, s))) return 1;
+        return fmp4_demux_parse(s->mp4, data, size);
+    }
+    if (!s->ts && !(s->ts = ts_demux_create(ts_packet, s))) return 1;
+    return ts_demux_feed(s->ts, data, size);
+}
+
+static void *stream_thread(void *arg) {
+    mosaic_stream_t *s = (mosaic_stream_t *)arg;
+    pipeline_enter_stage(s->mosaic->pipeline, PIPELINE_DEMUX);
+    hls_error_t err = hls_process_stream(s->demuxer, s->url, segment_callback, s);
+    if (s->ts) ts_demux_flush(s->ts);
+    if (err != HLS_OK && !s->mosaic->stop)
+        fprintf(stderr, "Mosaic: stream %d: %s\n", s->index + 1, hls_get_error_string(err));
+    push_packet(s, PACKET_FLUSH, NULL, 0, 0, TS_NO_TIMESTAMP);
+    return NULL;
+}
+
+// Decoding worker side of a stream (one worker at a time)
+
+static void pts_push(mosaic_stream_t *s, int64_t pts) {
+    if (pts == TS_NO_TIMESTAMP) return;
+    if (s->pts_count == MOSAIC_PTS_QUEUE) {
+        memmove(s->pts_queue, s->pts_queue + 1, (MOSAIC_PTS_QUEUE - 1) * sizeof(s->pts_queue[0]));
+        s->pts_count--;
+    }
+    int i = s->pts_count++;
+    while (i > 0 && s->pts_queue[i - 1] > pts) {
+        s->pts_queue[i] = s->pts_queue[i - 1];
+        i--;
+    }
+    s->pts_queue[i] = pts;
+}
+
+// PTS of the next picture out, in display order
+static int64_t pts_pop(mosaic_stream_t *s) {
+    int64_t pts;
+    if (s->pts_count) {
+        pts = s->pts_queue[0];
+        memmove(s->pts_queue, s->pts_queue + 1, (size_t)(s->pts_count - 1) * sizeof(s->pts_queue[0]));
+        s->pts_count--;
+    } else {
+        pts = s->last_pts == TS_NO_TIMESTAMP ? 0 : (s->last_pts + MOSAIC_FRAME_PTS) & ((1LL << 33) - 1);
+    }
+    return s->last_pts = pts;
+}
+
+// Reduced output once the first picture tells how large the pictures are
+static void choose_output(mosaic_stream_t *s, const decoder_picture_t *pic) {
+    mosaic_t *m = s->mosaic;
+    s->output_chosen = 1;
+    int factor = m->decimate;
+    if (!factor) {
+        factor = 1;
+        if (pic->width >= 4 * m->cell_width && pic->height >= 4 * m->cell_height) factor = 4;
+        else if (pic->width >= 2 * m->cell_width && pic->height >= 2 * m->cell_height) factor = 2;
+    }
+    s->output = factor == 4 ? DECODER_OUTPUT_QUARTER : factor == 2 ? DECODER_OUTPUT_HALF : 0;
+    const char *gray = getenv("ANHELO_GRAY");
+    if (gray && strcmp(gray, "0") != 0) s->output |= DECODER_OUTPUT_GRAY;
+    if (s->output) decoder_set_output(s->decoder, s->output);
+}
+
+static void copy_plane(uint8_t *dst, const uint8_t *src, int stride, int width, int height) {
+    for (int y = 0; y < height; y++) memcpy(dst + (size_t)y * width, src + (size_t)y * stride, (size_t)width);
+}
+
+// Copy the decoder's pictures out into free slots of the picture ring
+static void take_pictures(mosaic_stream_t *s) {
+    mosaic_t *m = s->mosaic;
+    decoder_picture_t pic;
+    while (decoder_get_picture(s->decoder, &pic)) {
+        int64_t pts = pts_pop(s);
+        s->decoded++;
+        metrics_count(METRIC_FRAMES_DECODED, 1);
+        if (!s->output_chosen) choose_output(s, &pic);
+        pthread_mutex_lock(&m->lock);
+        int full = s->picture_count == MOSAIC_PICTURES;
+        mosaic_picture_t *out = &s->pictures[(s->picture_head + s->picture_count) % MOSAIC_PICTURES];
+        pthread_mutex_unlock(&m->lock);
+        if (full) {
+            // Only a flush puts out more pictures than a packet makes room for
+            s->dropped++;
+            continue;
+        }
+        int cw = (pic.width + 1) / 2, ch = (pic.height + 1) / 2;
+        size_t luma = (size_t)pic.width * pic.height, chroma = (size_t)cw * ch;
+        if (luma + 2 * chroma > out->capacity) {
+            uint8_t *grown = big_realloc(out->planes, luma + 2 * chroma);
+            if (!grown) continue;
+            out->planes = grown;
+            out->capacity = luma + 2 * chroma;
+        }
+        copy_plane(out->planes, pic.y, pic.y_stride, pic.width, pic.height);
+        copy_plane(out->planes + luma, pic.u, pic.uv_stride, cw, ch);
+        copy_plane(out->planes + luma + chroma, pic.v, pic.uv_stride, cw, ch);
+        out->width = pic.width;
+        out->height = pic.height;
+        out->pts = pts;
+        pthread_mutex_lock(&m->lock);
+        s->picture_count++;
+        pthread_cond_signal(&m->pictures);
+        pthread_mutex_unlock(&m->lock);
+    }
+}
+
+static int use_codec(mosaic_stream_t *s, unsigned codec) {
+    if (s->decoder && s->codec == codec) return 1;
+    decoder_destroy(s->decoder);
+    s->decoder = decoder_create(codec, getenv("ANHELO_DECODER"));
+    s->codec = codec;
+    s->output_chosen = 0;
+    s->awaiting_rap = codec == DECODER_CAP_H264;
+    return s->decoder != NULL;
+}
+
+static int sei_has_recovery_point(const uint8_t *nal, size_t len) {
+    size_t i = 1;
+    while (i < len && nal[i] != 0x80) {
+        unsigned type = 0, size = 0;
+        while (i < len && nal[i] == 0xFF) type += nal[i++];
+        if (i >= len) break;
+        type += nal[i++];
+        while (i < len && nal[i] == 0xFF) size += nal[i++];
+        if (i >= len) break;
+        size += nal[i++];
+        if (type == 6) return 1;
+        i += size;
+    }
+    return 0;
+}
+
+static void decode_nal(mosaic_stream_t *s, const uint8_t *nal, size_t size) {
+    if (!size) return;
+    int type = nal[0] & 0x1F;
+    if (type == 6 && sei_has_recovery_point(nal, size)) s->recovery_point = 1;
+    if (type >= 1 && type <= 5) {
+        if (type == 5 || s->recovery_point) s->awaiting_rap = 0;
+        s->recovery_point = 0;
+    }
+    if (s->awaiting_rap && type != 7 && type != 8) return;
+    decoder_decode(s->decoder, nal, size);
+    take_pictures(s);
+}
+
+static void decode_packet(mosaic_stream_t *s, const mosaic_packet_t *p) {
+    if (p->kind == PACKET_FLUSH) {
+        if (s->decoder) {
+            decoder_flush(s->decoder);
+            take_pictures(s);
+        }
+        return;
+    }
+    if (p->kind == PACKET_MPEG4) {
+        if (!use_codec(s, DECODER_CAP_MPEG4)) return;
+        pts_push(s, p->pts);
+        if (decoder_decode(s->decoder, p->data, p->size) == 0) take_pictures(s);
+        return;
+    }
+    if (!use_codec(s, DECODER_CAP_H264)) return;
+    int units = p->kind == PACKET_ANNEXB ? nal_index_annexb(&s->nal, p->data, p->size) : 0;
+    if (units <= 0) units = nal_index_length_prefixed(&s->nal, p->data, p->size, p->kind == PACKET_ANNEXB ? 4 : p->nal_length_size);
+    if (units <= 0) return;
+    pts_push(s, p->pts);
+    // Parameter sets first, so the decoder is configured before any slice
+    for (size_t i = 0; i < s->nal.count; i++)
+        if (s->nal.units[i].type == 7 || s->nal.units[i].type == 8)
+            decode_nal(s, p->data + s->nal.units[i].offset, s->nal.units[i].size);
+    for (size_t i = 0; i < s->nal.count; i++)
+        if (s->nal.units[i].type != 7 && s->nal.units[i].type != 8)
+            decode_nal(s, p->data + s->nal.units[i].offset, s->nal.units[i].size);
+}
+
+static void *worker_thread(void *arg) {
+    mosaic_t *m = (mosaic_t *)arg;
+    pipeline_enter_stage(m->pipeline, PIPELINE_DECODE);
+    pthread_mutex_lock(&m->lock);
+    for (;;) {
+        while (!m->stop && !m->run_count) pthread_cond_wait(&m->work, &m->lock);
+        if (m->stop) break;
+        mosaic_stream_t *s = &m->streams[m->run_queue[m->run_head]];
+        m->run_head = (m->run_head + 1) % MOSAIC_MAX_STREAMS;
+        m->run_count--;
+        s->queued = 0;
+        s->running = 1;
+        // A batch, then the stream goes to the back of the queue
+        for (int n = 0; n < MOSAIC_BATCH && s->packet_count && s->picture_count < MOSAIC_PICTURES && !m->stop; n++) {
+            mosaic_packet_t *p = &s->packets[s->packet_head];
+            pthread_mutex_unlock(&m->lock);
+            decode_packet(s, p);
+            pthread_mutex_lock(&m->lock);
+            s->packet_head = (s->packet_head + 1) % MOSAIC_PACKETS;
+            s->packet_count--;
+            pthread_cond_broadcast(&m->space);
+        }
+        s->running = 0;
+        schedule(m, s);
+        // The compositor waits for the last pictures of ended streams too
+        pthread_cond_signal(&m->pictures);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return NULL;
+}
+
+// Compositor (main thread)
+
+// When the stream's picture is due, anchoring its clock at the first one
+// and again after a jump
+static uint64_t due_us(mosaic_stream_t *s, const mosaic_picture_t *pic, uint64_t now) {
+    if (s->anchor_pts != TS_NO_TIMESTAMP) {
+        int64_t offset = present_pts_delta_us(pic->pts, s->anchor_pts);
+        int64_t due = (int64_t)s->anchor_us + offset;
+        if (offset >= 0 && due - (int64_t)now < PRESENT_MAX_DRIFT_US && (int64_t)now - due < PRESENT_MAX_DRIFT_US)
+            return (uint64_t)due;
+    }
+    s->anchor_pts = pic->pts;
+    s->anchor_us = now;
+    return now;
+}
+
+static void stop_all(mosaic_t *m) {
+    pthread_mutex_lock(&m->lock);
+    m->stop = 1;
+    pthread_cond_broadcast(&m->work);
+    pthread_cond_broadcast(&m->space);
+    pthread_mutex_unlock(&m->lock);
+}
+
+static void compose(mosaic_t *m, video_mosaic_t *out) {
+    const mosaic_picture_t *show[MOSAIC_MAX_STREAMS];
+    for (;;) {
+        uint64_t now = now_us();
+        uint64_t next = now + MOSAIC_IDLE_US;
+        int live = 0, any = 0;
+        pthread_mutex_lock(&m->lock);
+        for (int i = 0; i < m->count; i++) {
+            mosaic_stream_t *s = &m->streams[i];
+            show[i] = NULL;
+            // The newest picture due; those it overtakes are dropped
+            while (s->picture_count) {
+                const mosaic_picture_t *pic = &s->pictures[s->picture_head];
+                uint64_t due = due_us(s, pic, now);
+                if (due > now) {
+                    if (due < next) next = due;
+                    break;
+                }
+                const mosaic_picture_t *after = &s->pictures[(s->picture_head + 1) % MOSAIC_PICTURES];
+                if (s->picture_count > 1 && due_us(s, after, now) <= now) {
+                    s->dropped++;
+                    metrics_count(METRIC_FRAMES_DROPPED, 1);
+                    s->picture_head = (s->picture_head + 1) % MOSAIC_PICTURES;
+                    s->picture_count--;
+                    continue;
+                }
+                show[i] = pic;
+                break;
+            }
+            if (show[i]) any = 1;
+            if (!s->input_ended || s->packet_count || s->running || s->picture_count) live = 1;
+        }
+        pthread_mutex_unlock(&m->lock);
+        if (!live) break;
+
+        // Uploads read the slots unlocked: the workers only write free ones
+        for (int i = 0; i < m->count; i++) {
+            const mosaic_picture_t *pic = show[i];
+            if (!pic) continue;
+            size_t luma = (size_t)pic->width * pic->height;
+            size_t chroma = (size_t)((pic->width + 1) / 2) * ((pic->height + 1) / 2);
+            video_mosaic_tile(out, i, pic->width, pic->height, pic->planes, pic->planes + luma,
+                              pic->planes + luma + chroma, pic->width, (pic->width + 1) / 2);
+        }
+        if (any) {
+            uint64_t draw_start = now_us();
+            video_mosaic_present(out);
+            metrics_record(METRIC_DRAW, now_us() - draw_start);
+        }
+
+        pthread_mutex_lock(&m->lock);
+        for (int i = 0; i < m->count; i++) {
+            mosaic_stream_t *s = &m->streams[i];
+            if (!show[i]) continue;
+            s->picture_head = (s->picture_head + 1) % MOSAIC_PICTURES;
+            s->picture_count--;
+            s->shown++;
+            metrics_count(METRIC_FRAMES_DISPLAYED, 1);
+            schedule(m, s);
+        }
+        // Sleep until the next picture is due or one comes in
+        if (!any) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            uint64_t wait = next > now_us() ? next - now_us() : 0;
+            deadline.tv_nsec += (long)(wait % 1000000) * 1000;
+            deadline.tv_sec += (time_t)(wait / 1000000) + deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&m->pictures, &m->lock, &deadline);
+        }
+        pthread_mutex_unlock(&m->lock);
+        if (video_mosaic_poll(out)) break;
+    }
+}
+
+int mosaic_play(const char *const *urls, int count, const pipeline_config_t *pipeline) {
+    if (count > MOSAIC_MAX_STREAMS) {
+        fprintf(stderr, "Mosaic: %d streams, only the first %d shown\n", count, MOSAIC_MAX_STREAMS);
+        count = MOSAIC_MAX_STREAMS;
+    }
+    int cols = 1;
+    while (cols * cols < count) cols++;
+    int rows = (count + cols - 1) / cols;
+    video_mosaic_t *out = video_mosaic_create(cols, rows);
+    if (!out) {
+        fprintf(stderr, "Mosaic: the video output cannot tile\n");
+        return -1;
+    }
+
+    mosaic_t *m = calloc(1, sizeof(*m));
+    if (!m) {
+        video_mosaic_destroy(out);
+        return -1;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->work, NULL);
+    pthread_cond_init(&m->space, NULL);
+    pthread_cond_init(&m->pictures, NULL);
+    m->pipeline = pipeline;
+    m->count = count;
+    video_mosaic_cell_size(out, &m->cell_width, &m->cell_height);
+    const char *decimate = getenv("ANHELO_DECIMATE");
+    if (decimate) m->decimate = atoi(decimate) == 4 ? 4 : atoi(decimate) == 2 ? 2 : 1;
+
+    const char *threads = getenv("ANHELO_MOSAIC_THREADS");
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = threads ? atoi(threads) : (int)(cpus > 0 ? cpus : 1);
+    if (workers > count) workers = count;
+    if (workers < 1) workers = 1;
+    m->workers = calloc((size_t)workers, sizeof(pthread_t));
+    for (int i = 0; m->workers && i < workers; i++) {
+        if (pthread_create(&m->workers[m->worker_count], NULL, worker_thread, m) == 0) m->worker_count++;
+    }
+
+    const char *fast_start = getenv("ANHELO_FAST_START");
+    int started = 0;
+    for (int i = 0; i < count && m->worker_count; i++) {
+        mosaic_stream_t *s = &m->streams[i];
+        s->mosaic = m;
+        s->index = i;
+        s->url = urls[i];
+        s->anchor_pts = TS_NO_TIMESTAMP;
+        s->last_pts = TS_NO_TIMESTAMP;
+        s->demuxer = hls_demuxer_create();
+        if (s->demuxer) {
+            s->demuxer->fast_start = !fast_start || strcmp(fast_start, "0") != 0;
+            s->demuxer->fetch_cpus = pipeline->cpus[PIPELINE_FETCH];
+            // Tiles are not timeshifted, and the rings would add up
+            s->demuxer->timeshift_bytes = 0;
+            s->demuxer->unpooled = true;
+            s->started = pthread_create(&s->thread, NULL, stream_thread, s) == 0;
+        }
+        if (s->started) started++;
+        else s->input_ended = 1;
+    }
+    printf("Mosaic: %d of %d stream(s) on a %dx%d grid, %d decode worker(s)\n",
+           started, count, cols, rows, m->worker_count);
+
+    if (started) compose(m, out);
+
+    stop_all(m);
+    for (int i = 0; i < count; i++) {
+        mosaic_stream_t *s = &m->streams[i];
+        if (s->started) pthread_join(s->thread, NULL);
+    }
+    for (int i = 0; i < m->worker_count; i++) pthread_join(m->workers[i], NULL);
+
+    for (int i = 0; i < count; i++) {
+        mosaic_stream_t *s = &m->streams[i];
+        if (s->started)
+            printf("Mosaic: stream %d: %lu frames decoded, %lu displayed, %lu dropped\n",
+                   i + 1, s->decoded, s->shown, s->dropped);
+        if (s->demuxer) hls_demuxer_destroy(s->demuxer);
+        if (s->ts) ts_demux_destroy(s->ts);
+        if (s->mp4) fmp4_demux_destroy(s->mp4);
+        decoder_destroy(s->decoder);
+        nal_index_free(&s->nal);
+        for (int j = 0; j < MOSAIC_PACKETS; j++) big_free(s->packets[j].data);
+        for (int j = 0; j < MOSAIC_PICTURES; j++) big_free(s->pictures[j].planes);
+    }
+    video_mosaic_destroy(out);
+    free(m->workers);
+    pthread_cond_destroy(&m->pictures);
+    pthread_cond_destroy(&m->space);
+    pthread_cond_destroy(&m->work);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+    return started ? 0 : -1;
+}
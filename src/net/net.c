@@ -0,0 +1,68 @@
+#include <pthread.h>
+
+#include "../../include/net.h"
+
+// Handles on different threads use the share concurrently (pre-warm,
+// background resolve, HLS fetcher), so every kind of data gets a lock
+static CURLSH *share = NULL;
+static CURLSH *share_unpooled = NULL;  // DNS and TLS sessions, no connections
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+static pthread_once_t share_once = PTHREAD_ONCE_INIT;
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    (void)handle; (void)access; (void)userptr;
+    pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle; (void)userptr;
+    pthread_mutex_unlock(&share_locks[data]);
+}
+
+static CURLSH *new_share(int connections)
+{
+    CURLSH *sh = curl_share_init();
+    if (!sh) return NULL;
+    curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (connections) curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    return sh;
+}
+
+// Both shares take the same locks: they are only held for a lookup
+static void share_init(void)
+{
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) pthread_mutex_init(&share_locks[i], NULL);
+    share = new_share(1);
+    share_unpooled = new_share(0);
+}
+
+CURLSH *net_share(void)
+{
+    pthread_once(&share_once, share_init);
+    return share;
+}
+
+static CURL *easy_handle(CURLSH *sh)
+{
+    CURL *c = curl_easy_init();
+    if (!c) return NULL;
+    if (sh) curl_easy_setopt(c, CURLOPT_SHARE, sh);
+    curl_easy_setopt(c, CURLOPT_NOSIGNAL, 1L);
+    return c;
+}
+
+CURL *net_easy_handle(void)
+{
+    return easy_handle(net_share());
+}
+
+CURL *net_easy_handle_unpooled(void)
+{
+    pthread_once(&share_once, share_init);
+    return easy_handle(share_unpooled);
+}
@@ -0,0 +1,128 @@
+// On-screen text for the stats overlay, see include/osd.h
+#include <string.h>
+
+#include "../include/osd.h"
+
+#define OSD_FIRST_CHAR ' '
+#define OSD_LAST_CHAR '_'
+#define OSD_CELL_WIDTH (OSD_GLYPH_WIDTH + 1)
+#define OSD_CELL_HEIGHT (OSD_GLYPH_HEIGHT + 2)
+#define OSD_PADDING 2
+
+// 5x7 glyphs of ' ' to '_', a row a byte with the leftmost pixel in bit 4;
+// lower case is drawn as upper case
+static const uint8_t glyphs[OSD_LAST_CHAR - OSD_FIRST_CHAR + 1][OSD_GLYPH_HEIGHT] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // " (as ?)
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // # (as ?)
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // $ (as ?)
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // & (as ?)
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ' (as ?)
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // * (as ?)
+    { 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 }, // +
+    { 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 }, // ,
+    { 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c }, // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+    { 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, // 0
+    { 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 1
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, // 2
+    { 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e }, // 3
+    { 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, // 4
+    { 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e }, // 5
+    { 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, // 6
+    { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+    { 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, // 8
+    { 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c }, // 9
+    { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 }, // :
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ; (as ?)
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+    { 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 }, // =
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // @ (as ?)
+    { 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // A
+    { 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // B
+    { 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // C
+    { 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // D
+    { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // E
+    { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // F
+    { 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // G
+    { 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // H
+    { 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // L
+    { 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+    { 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // O
+    { 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // P
+    { 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // Q
+    { 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // R
+    { 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // S
+    { 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // W
+    { 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // X
+    { 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 }, // Y
+    { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // Z
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // [ (as ?)
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // backslash (as ?)
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ] (as ?)
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ^ (as ?)
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f }, // _
+};
+
+void osd_measure(const char *text, int scale, int *width, int *height) {
+    int columns = 0, lines = 1, column = 0;
+    for (const char *p = text; *p; p++) {
+        if (*p == '\n') {
+            lines++;
+            column = 0;
+        } else if (++column > columns) {
+            columns = column;
+        }
+    }
+    *width = (columns * OSD_CELL_WIDTH + 2 * OSD_PADDING) * scale;
+    *height = (lines * OSD_CELL_HEIGHT + 2 * OSD_PADDING) * scale;
+}
+
+static void fill(uint8_t *pixels, int stride, int bpp, int x0, int y0, int x1, int y1, uint8_t value) {
+    for (int y = y0; y < y1; y++) memset(pixels + (size_t)y * stride + (size_t)x0 * bpp, value, (size_t)(x1 - x0) * bpp);
+}
+
+void osd_draw(uint8_t *pixels, int stride, int bpp, int width, int height, int x, int y, int scale,
+              const char *text, uint8_t fg, uint8_t bg) {
+    int box_width, box_height;
+    osd_measure(text, scale, &box_width, &box_height);
+    int x1 = x + box_width < width ? x + box_width : width;
+    int y1 = y + box_height < height ? y + box_height : height;
+    if (x < 0 || y < 0 || x >= x1 || y >= y1) return;
+    fill(pixels, stride, bpp, x, y, x1, y1, bg);
+
+    int cx = x + OSD_PADDING * scale, cy = y + OSD_PADDING * scale;
+    for (const char *p = text; *p; p++) {
+        if (*p == '\n') {
+            cx = x + OSD_PADDING * scale;
+            cy += OSD_CELL_HEIGHT * scale;
+            continue;
+        }
+        int c = *p >= 'a' && *p <= 'z' ? *p - 'a' + 'A' : *p;
+        if (c < OSD_FIRST_CHAR || c > OSD_LAST_CHAR) c = '?';
+        const uint8_t *glyph = glyphs[c - OSD_FIRST_CHAR];
+        for (int row = 0; row < OSD_GLYPH_HEIGHT; row++) {
+            for (int col = 0; col < OSD_GLYPH_WIDTH; col++) {
+                if (!(glyph[row] & (0x10 >> col))) continue;
+                int px = cx + col * scale, py = cy + row * scale;
+                int px1 = px + scale < x1 ? px + scale : x1, py1 = py + scale < y1 ? py + scale : y1;
+                if (px < px1 && py < py1) fill(pixels, stride, bpp, px, py, px1, py1, fg);
+            }
+        }
+        cx += OSD_CELL_WIDTH * scale;
+    }
+}
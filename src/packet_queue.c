@@ -0,0 +1,79 @@
+// Packet queue between the demuxing thread and the decoding thread, see
+// include/packet_queue.h
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/packet_queue.h"
+#include "../include/spsc_ring.h"
+#include "../include/big_alloc.h"
+
+struct packet_queue {
+    spsc_ring_t ring;
+    packet_t slots[PACKET_QUEUE_MAX];
+};
+
+packet_queue_t *packet_queue_create(int depth) {
+    if (depth < 1) depth = 1;
+    if (depth > PACKET_QUEUE_MAX) depth = PACKET_QUEUE_MAX;
+    packet_queue_t *q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    spsc_ring_init(&q->ring, (unsigned)depth);
+    return q;
+}
+
+void packet_queue_destroy(packet_queue_t *q) {
+    if (!q) return;
+    for (int i = 0; i < PACKET_QUEUE_MAX; i++) big_free(q->slots[i].data);
+    spsc_ring_destroy(&q->ring);
+    free(q);
+}
+
+int packet_queue_push(packet_queue_t *q, int type, int arg, int64_t pts, const uint8_t *data, size_t size,
+                      uint64_t *waited_us) {
+    int index = spsc_ring_reserve(&q->ring, waited_us);
+    if (index < 0) return -1;
+    packet_t *slot = &q->slots[index];
+    if (size > slot->capacity) {
+        // Grown by half again so similar packets stop reallocating soon
+        size_t capacity = size + size / 2;
+        uint8_t *p = big_realloc(slot->data, capacity);
+        if (!p) {
+            spsc_ring_cancel(&q->ring);
+            return -1;
+        }
+        slot->data = p;
+        slot->capacity = capacity;
+    }
+    if (size) memcpy(slot->data, data, size);
+    slot->type = type;
+    slot->arg = arg;
+    slot->pts = pts;
+    slot->size = size;
+    spsc_ring_publish(&q->ring);
+    return 0;
+}
+
+void packet_queue_finish(packet_queue_t *q) {
+    spsc_ring_finish(&q->ring);
+}
+
+packet_t *packet_queue_peek(packet_queue_t *q, int timeout_ms) {
+    int index = spsc_ring_peek(&q->ring, timeout_ms);
+    return index < 0 ? NULL : &q->slots[index];
+}
+
+void packet_queue_pop(packet_queue_t *q) {
+    spsc_ring_pop(&q->ring);
+}
+
+int packet_queue_finished(packet_queue_t *q) {
+    return spsc_ring_finished(&q->ring);
+}
+
+void packet_queue_close(packet_queue_t *q) {
+    spsc_ring_close(&q->ring);
+}
+
+int packet_queue_count(const packet_queue_t *q) {
+    return (int)spsc_ring_count(&q->ring);
+}
@@ -0,0 +1,81 @@
+// Playback pipeline configuration and thread placement, see include/pipeline.h
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../include/pipeline.h"
+
+static const char *const stage_names[PIPELINE_STAGES] = { "fetch", "demux", "decode", "convert", "present" };
+static const char *const stage_envs[PIPELINE_STAGES] = {
+    "ANHELO_FETCH_CPUS", "ANHELO_DEMUX_CPUS", "ANHELO_DECODE_CPUS", "ANHELO_CONVERT_CPUS", "ANHELO_PRESENT_CPUS"
+};
+
+static int env_off(const char *name) {
+    const char *env = getenv(name);
+    return env && strcmp(env, "0") == 0;
+}
+
+void pipeline_config_load(pipeline_config_t *config) {
+    for (int i = 0; i < PIPELINE_STAGES; i++) {
+        config->threaded[i] = 1;
+        const char *cpus = getenv(stage_envs[i]);
+        config->cpus[i] = cpus ? pipeline_parse_cpus(cpus) : 0;
+        if (cpus && !config->cpus[i]) fprintf(stderr, "%s: no CPU in \"%s\", not pinning\n", stage_envs[i], cpus);
+    }
+    config->threaded[PIPELINE_DEMUX] = !env_off("ANHELO_DEMUX_THREAD");
+    config->threaded[PIPELINE_DECODE] = !env_off("ANHELO_DECODE_THREAD") && !env_off("ANHELO_RENDER_THREAD");
+}
+
+uint64_t pipeline_parse_cpus(const char *list) {
+    uint64_t mask = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) return 0;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) return 0;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < 64; cpu++) mask |= 1ULL << cpu;
+        if (*p == ',') p++;
+        else if (*p) return 0;
+    }
+    return mask;
+}
+
+const char *pipeline_stage_name(pipeline_stage_t stage) {
+    return stage >= 0 && stage < PIPELINE_STAGES ? stage_names[stage] : "?";
+}
+
+int pipeline_pin_thread(uint64_t cpus) {
+    if (!cpus) return 0;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; cpu++)
+        if (cpus & (1ULL << cpu)) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+void pipeline_enter_stage(const pipeline_config_t *config, pipeline_stage_t stage) {
+#ifdef __linux__
+    // The main thread keeps the program's name
+    if (stage != PIPELINE_PRESENT) {
+        char name[16];
+        snprintf(name, sizeof(name), "anhelo-%s", pipeline_stage_name(stage));
+        pthread_setname_np(pthread_self(), name);
+    }
+#endif
+    if (pipeline_pin_thread(config->cpus[stage]) < 0)
+        fprintf(stderr, "Could not pin the %s stage to its CPUs\n", pipeline_stage_name(stage));
+}
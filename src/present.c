@@ -0,0 +1,146 @@
+// Presentation scheduler, see include/present.h
+#include <string.h>
+
+#include "../include/present.h"
+#include "../include/ts_demux.h"
+
+#define PTS_WRAP (1LL << 33)
+// Drawing starts this long after the refresh before the picture's, so the
+// swap cannot catch that one
+#define PRESENT_VSYNC_MARGIN_US 1000
+// Late without vsync: by more than this
+#define PRESENT_ON_TIME_US 4000
+// Range of the refresh interval, and how close to its multiples the swap
+// intervals must be
+#define PRESENT_MIN_REFRESH_US 4000     // 250 Hz
+#define PRESENT_MAX_REFRESH_US 50000    // 20 Hz
+#define PRESENT_REFRESH_JITTER_US 1000
+#define PRESENT_REFRESH_WINDOW (sizeof(((present_clock_t *)0)->intervals_us) / sizeof(uint32_t))
+// PTS steps taken for the frame duration
+#define PRESENT_MAX_FRAME_US 200000
+
+void present_init(present_clock_t *c, uint64_t frame_us, uint64_t refresh_us) {
+    memset(c, 0, sizeof(*c));
+    c->anchor_pts = TS_NO_TIMESTAMP;
+    c->last_pts = TS_NO_TIMESTAMP;
+    c->frame_us = frame_us;
+    c->refresh_us = refresh_us;
+    c->refresh_fixed = refresh_us != 0;
+}
+
+void present_restart(present_clock_t *c) {
+    c->anchor_pts = TS_NO_TIMESTAMP;
+    c->last_pts = TS_NO_TIMESTAMP;
+    c->target_us = 0;
+}
+
+void present_set_vsync(present_clock_t *c, int vsync) {
+    c->vsync = vsync;
+    c->vblank_us = 0;
+    c->intervals = 0;
+}
+
+int64_t present_pts_delta_us(int64_t a, int64_t b) {
+    int64_t delta = (a - b) % PTS_WRAP;
+    if (delta < 0) delta += PTS_WRAP;
+    if (delta >= PTS_WRAP / 2) delta -= PTS_WRAP;
+    return delta * 1000000 / TS_CLOCK_HZ;
+}
+
+present_action_t present_schedule(present_clock_t *c, int64_t pts, uint64_t now,
+                                  uint64_t *start_us, int64_t *late_us) {
+    if (c->last_pts != TS_NO_TIMESTAMP) {
+        int64_t step = present_pts_delta_us(pts, c->last_pts);
+        if (step > 0 && step <= PRESENT_MAX_FRAME_US) c->frame_us = (uint64_t)step;
+    }
+    c->last_pts = pts;
+
+    int64_t due = (int64_t)now;
+    if (c->anchor_pts != TS_NO_TIMESTAMP) due = (int64_t)c->anchor_us + present_pts_delta_us(pts, c->anchor_pts);
+    if (c->anchor_pts == TS_NO_TIMESTAMP || due - (int64_t)now > PRESENT_MAX_DRIFT_US ||
+        (int64_t)now - due > PRESENT_MAX_DRIFT_US) {
+        c->anchor_pts = pts;
+        c->anchor_us = now;
+        due = (int64_t)now;
+    }
+
+    // When it can be shown: at the refresh closest to its time but not
+    // before the next one, or as soon as it is due
+    int64_t shown, start, tolerance;
+    int64_t refresh = (int64_t)c->refresh_us;
+    if (c->vsync && refresh && c->vblank_us) {
+        int64_t vblank = (int64_t)c->vblank_us;
+        int64_t next = vblank + (((int64_t)now - vblank) / refresh + 1) * refresh;
+        shown = due > vblank ? vblank + (due - vblank + refresh / 2) / refresh * refresh : next;
+        if (shown < next) shown = next;
+        start = shown - refresh + PRESENT_VSYNC_MARGIN_US;
+        tolerance = refresh / 2;
+        c->target_us = (uint64_t)shown;
+    } else {
+        shown = due > (int64_t)now ? due : (int64_t)now;
+        start = shown;
+        tolerance = PRESENT_ON_TIME_US;
+        c->target_us = 0;
+    }
+    if (start < (int64_t)now) start = (int64_t)now;
+    *start_us = (uint64_t)start;
+    *late_us = shown - due;
+
+    if (*late_us >= (int64_t)c->frame_us && c->shown_us && now - c->shown_us < PRESENT_MAX_GAP_US) {
+        c->stats.dropped++;
+        return PRESENT_DROP;
+    }
+    c->stats.shown++;
+    if (*late_us > tolerance) c->stats.late++;
+    else if (start > (int64_t)now) c->stats.early++;
+    return PRESENT_SHOW;
+}
+
+// The refresh interval from a window of swap intervals: the shortest one,
+// or the interval measured so far, divided by the smallest n making every
+// interval a multiple of it. 0 when there is none in range.
+static uint64_t measure_refresh(const present_clock_t *c) {
+    uint64_t shortest = c->refresh_us;
+    for (unsigned i = 0; i < c->intervals; i++)
+        if (!shortest || c->intervals_us[i] < shortest) shortest = c->intervals_us[i];
+    for (uint64_t n = 1; shortest / n >= PRESENT_MIN_REFRESH_US; n++) {
+        uint64_t refresh = shortest / n;
+        unsigned i = 0;
+        while (i < c->intervals) {
+            uint64_t rest = (c->intervals_us[i] + refresh / 2) % refresh;
+            if (rest > refresh / 2 + PRESENT_REFRESH_JITTER_US || rest < refresh / 2 - PRESENT_REFRESH_JITTER_US) break;
+            i++;
+        }
+        if (i == c->intervals) return refresh <= PRESENT_MAX_REFRESH_US ? refresh : 0;
+    }
+    // The display changed: from this window alone
+    if (c->refresh_us) {
+        present_clock_t window = *c;
+        window.refresh_us = 0;
+        return measure_refresh(&window);
+    }
+    return 0;
+}
+
+void present_shown(present_clock_t *c, uint64_t now) {
+    c->shown_us = now;
+    if (!c->vsync) return;
+    // Shown a refresh before the one it was meant for: that is the real
+    // refresh interval, the one measured is a multiple of it
+    if (c->target_us && now + PRESENT_REFRESH_JITTER_US < c->target_us && !c->refresh_fixed &&
+        c->target_us - now >= PRESENT_MIN_REFRESH_US) {
+        c->refresh_us = c->target_us - now;
+        c->intervals = 0;
+    }
+    // The draw returned at a refresh: measure the intervals between them,
+    // leaving out stalls
+    if (c->vblank_us && !c->refresh_fixed && now - c->vblank_us <= 4 * PRESENT_MAX_REFRESH_US) {
+        c->intervals_us[c->intervals++] = (uint32_t)(now - c->vblank_us);
+        if (c->intervals == PRESENT_REFRESH_WINDOW) {
+            uint64_t refresh = measure_refresh(c);
+            if (refresh) c->refresh_us = refresh;
+            c->intervals = 0;
+        }
+    }
+    c->vblank_us = now;
+}
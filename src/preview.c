@@ -0,0 +1,408 @@
+// Preview mode, see include/preview.h. The lock (preview_t.lock) covers the
+// schedule and the thumbnails of every channel; the rest of a channel
+// belongs to the one worker refreshing it.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "../include/preview.h"
+#include "../include/hls_demuxer.h"
+#include "../include/ts_demux.h"
+#include "../include/fmp4_demux.h"
+#include "../include/nal_index.h"
+#include "../include/decoder.h"
+#include "../include/metrics.h"
+#include "../include/video.h"
+#include "../include/big_alloc.h"
+
+#define PREVIEW_IDLE_US 100000      // Longest the compositor sleeps between looks
+
+typedef struct {
+    uint8_t *planes;                // Y, then U, then V, tightly packed
+    size_t capacity;
+    int width, height;
+} preview_picture_t;
+
+typedef struct preview preview_t;
+
+typedef struct {
+    preview_t *preview;
+    int index;
+    const char *url;
+    hls_demuxer_t *demuxer;
+    // Refresh, on one worker at a time
+    decoder_t *decoder;
+    unsigned codec;
+    int factor;                     // Reduction of the decoder's output
+    ts_demux_t *ts;
+    fmp4_demux_t *mp4;
+    uint8_t *boxes;                 // fMP4 bytes short of a whole box (or a moof's mdat)
+    size_t boxes_size, boxes_capacity;
+    nal_index_t nal;
+    int got_picture;
+    int source_width, source_height;  // Full size of the last picture, 0 before the first
+    preview_picture_t spare;        // Filled by the refresh, then swapped with thumb
+    // Under the lock
+    preview_picture_t thumb;
+    int fresh;                      // Thumb not shown yet
+    int busy;                       // On a worker
+    int done;                       // Not refreshed again
+    uint64_t due_us;
+    unsigned long refreshes, failures;
+} preview_channel_t;
+
+struct preview {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;         // A refresh finished, or stopping
+    atomic_int stop;                // Set under the lock, read anywhere
+    preview_channel_t channels[PREVIEW_MAX_CHANNELS];
+    int count;
+    pthread_t workers[PREVIEW_MAX_CHANNELS];
+    int worker_count;
+    uint64_t interval_us;
+    unsigned long rounds;           // ANHELO_PREVIEW_ROUNDS, 0 = no limit
+    int cell_width, cell_height;
+    unsigned gray;                  // DECODER_OUTPUT_GRAY under ANHELO_GRAY
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Under the lock: wait for a change, at most until `until` (now_us() clock)
+static void wait_changed(preview_t *p, uint64_t until) {
+    uint64_t now = now_us();
+    uint64_t wait = until > now ? until - now : 0;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)(wait % 1000000) * 1000;
+    deadline.tv_sec += (time_t)(wait / 1000000) + deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    pthread_cond_timedwait(&p->changed, &p->lock, &deadline);
+}
+
+// A fresh decoder for the codec, its output reduced by how much larger
+// than a tile the channel's pictures were last time
+static int use_codec(preview_channel_t *c, unsigned codec) {
+    if (c->decoder && c->codec == codec) return 1;
+    preview_t *p = c->preview;
+    decoder_destroy(c->decoder);
+    c->decoder = decoder_create(codec, getenv("ANHELO_DECODER"));
+    c->codec = codec;
+    if (!c->decoder) return 0;
+    c->factor = 1;
+    if (c->source_width >= 4 * p->cell_width && c->source_height >= 4 * p->cell_height) c->factor = 4;
+    else if (c->source_width >= 2 * p->cell_width && c->source_height >= 2 * p->cell_height) c->factor = 2;
+    unsigned output = p->gray;
+    if (c->factor == 4) output |= DECODER_OUTPUT_QUARTER;
+    else if (c->factor == 2) output |= DECODER_OUTPUT_HALF;
+    if (output) decoder_set_output(c->decoder, output);
+    decoder_set_low_latency(c->decoder, 1);
+    return 1;
+}
+
+static void copy_plane(uint8_t *dst, const uint8_t *src, int stride, int width, int height) {
+    for (int y = 0; y < height; y++) memcpy(dst + (size_t)y * width, src + (size_t)y * stride, (size_t)width);
+}
+
+// The decoder's next picture, if any, becomes the channel's thumbnail.
+// Returns non-zero once there is one, which ends the download.
+static int take_picture(preview_channel_t *c) {
+    decoder_picture_t pic;
+    if (!decoder_get_picture(c->decoder, &pic)) return 0;
+    metrics_count(METRIC_FRAMES_DECODED, 1);
+    c->got_picture = 1;
+    c->source_width = pic.width * c->factor;
+    c->source_height = pic.height * c->factor;
+
+    preview_picture_t *out = &c->spare;
+    int cw = (pic.width + 1) / 2, ch = (pic.height + 1) / 2;
+    size_t luma = (size_t)pic.width * pic.height, chroma = (size_t)cw * ch;
+    if (luma + 2 * chroma > out->capacity) {
+        uint8_t *grown = big_realloc(out->planes, luma + 2 * chroma);
+        if (!grown) return 1;
+        out->planes = grown;
+        out->capacity = luma + 2 * chroma;
+    }
+    copy_plane(out->planes, pic.y, pic.y_stride, pic.width, pic.height);
+    copy_plane(out->planes + luma, pic.u, pic.uv_stride, cw, ch);
+    copy_plane(out->planes + luma + chroma, pic.v, pic.uv_stride, cw, ch);
+    out->width = pic.width;
+    out->height = pic.height;
+
+    preview_t *p = c->preview;
+    pthread_mutex_lock(&p->lock);
+    preview_picture_t shown = c->thumb;
+    c->thumb = c->spare;
+    c->spare = shown;
+    c->fresh = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+// An H.264 access unit, Annex B (nal_length_size 0) or length prefixed.
+// Parameter sets are always decoded, slices only from the first IDR on,
+// and its picture is taken right after it.
+static int decode_h264(preview_channel_t *c, const uint8_t *data, size_t size, int nal_length_size) {
+    if (!use_codec(c, DECODER_CAP_H264)) return 1;
+    int units = nal_length_size ? nal_index_length_prefixed(&c->nal, data, size, nal_length_size)
+                                : nal_index_annexb(&c->nal, data, size);
+    if (units <= 0) return 0;
+    int idr = 0;
+    for (size_t i = 0; i < c->nal.count; i++) {
+        int type = c->nal.units[i].type;
+        if (type == 5) idr = 1;
+        if (type == 7 || type == 8) decoder_decode(c->decoder, data + c->nal.units[i].offset, c->nal.units[i].size);
+    }
+    if (!idr) return 0;
+    for (size_t i = 0; i < c->nal.count; i++)
+        if (c->nal.units[i].type == 5)
+            decoder_decode(c->decoder, data + c->nal.units[i].offset, c->nal.units[i].size);
+    decoder_flush(c->decoder);
+    return take_picture(c);
+}
+
+// MPEG-4 Part 2: the decoder only outputs from an I-VOP on
+static int decode_mpeg4(preview_channel_t *c, const uint8_t *data, size_t size) {
+    if (!use_codec(c, DECODER_CAP_MPEG4)) return 1;
+    if (decoder_decode(c->decoder, data, size) != 0) return 0;
+    return take_picture(c);
+}
+
+static int ts_packet(const ts_pes_t *pes, void *user_data) {
+    preview_channel_t *c = (preview_channel_t *)user_data;
+    if (pes->stream_type == TS_STREAM_MPEG4_VIDEO) return decode_mpeg4(c, pes->data, pes->size);
+    if (pes->stream_type != 0 && pes->stream_type != TS_STREAM_H264) return 0;
+    return decode_h264(c, pes->data, pes->size, 0);
+}
+
+static int mp4_packet(const fmp4_sample_t *sample, void *user_data) {
+    return decode_h264((preview_channel_t *)user_data, sample->data, sample->size, sample->nal_length_size);
+}
+
+// fmp4_demux_parse() takes whole boxes, and a moof only with the mdat it
+// describes: collect the chunks and parse as far as that allows
+static int feed_fmp4(preview_channel_t *c, const uint8_t *data, size_t size) {
+    if (!c->mp4 && !(c->mp4 = fmp4_demux_create(mp4_packet, c))) return 1;
+    if (c->boxes_size + size > c->boxes_capacity) {
+        size_t capacity = c->boxes_capacity ? c->boxes_capacity : 65536;
+        while (capacity < c->boxes_size + size) capacity *= 2;
+        uint8_t *grown = realloc(c->boxes, capacity);
+        if (!grown) return 1;
+        c->boxes = grown;
+        c->boxes_capacity = capacity;
+    }
+    memcpy(c->boxes + c->boxes_size, data, size);
+    c->boxes_size += size;
+
+    size_t whole = 0, last = 0;
+    while (whole + 8 <= c->boxes_size) {
+        const uint8_t *b = c->boxes + whole;
+        uint64_t box = (uint64_t)b[0] << 24 | (uint64_t)b[1] << 16 | (uint64_t)b[2] << 8 | b[3];
+        if (box == 1) {
+            if (whole + 16 > c->boxes_size) break;
+            box = 0;
+            for (int i = 8; i < 16; i++) box = box << 8 | b[i];
+        }
+        // A box up to the end of the file (size 0) is only whole at the end
+        if (box < 8 || box > c->boxes_size - whole) break;
+        last = whole;
+        whole += box;
+    }
+    if (whole && memcmp(c->boxes + last + 4, "moof", 4) == 0) whole = last;
+    if (!whole) return 0;
+    int stop = fmp4_demux_parse(c->mp4, c->boxes, whole);
+    memmove(c->boxes, c->boxes + whole, c->boxes_size - whole);
+    c->boxes_size -= whole;
+    return stop;
+}
+
+static int segment_callback(const unsigned char *data, size_t size, void *user_data) {
+    preview_channel_t *c = (preview_channel_t *)user_data;
+    if (atomic_load(&c->preview->stop)) return 1;
+    if (c->mp4 || (!c->ts && fmp4_probe(data, size))) return feed_fmp4(c, data, size);
+    if (!c->ts && !(c->ts = ts_demux_create(ts_packet, c))) return 1;
+    return ts_demux_feed(c->ts, data, size);
+}
+
+// Fetch and decode the channel's newest picture. Returns non-zero if it
+// became the thumbnail; *ended tells that the playlist will not change.
+static int refresh(preview_channel_t *c, bool *ended) {
+    c->got_picture = 0;
+    c->boxes_size = 0;
+    hls_error_t err = hls_fetch_preview(c->demuxer, c->url, segment_callback, c, ended);
+    // A segment read to its end may still hold the IDR's PES
+    if (!c->got_picture && c->ts && !atomic_load(&c->preview->stop)) ts_demux_flush(c->ts);
+    if (!c->got_picture && c->decoder) {
+        decoder_flush(c->decoder);
+        take_picture(c);
+    }
+    if (err != HLS_OK && !atomic_load(&c->preview->stop))
+        fprintf(stderr, "Preview: channel %d: %s\n", c->index + 1, hls_get_error_string(err));
+    // Nothing of the refresh is kept until the next one
+    if (c->ts) ts_demux_destroy(c->ts);
+    if (c->mp4) fmp4_demux_destroy(c->mp4);
+    decoder_destroy(c->decoder);
+    c->ts = NULL;
+    c->mp4 = NULL;
+    c->decoder = NULL;
+    return c->got_picture;
+}
+
+static void *worker_thread(void *arg) {
+    preview_t *p = (preview_t *)arg;
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop) {
+        preview_channel_t *next = NULL;
+        for (int i = 0; i < p->count; i++) {
+            preview_channel_t *c = &p->channels[i];
+            if (!c->busy && !c->done && (!next || c->due_us < next->due_us)) next = c;
+        }
+        if (!next) {
+            pthread_cond_wait(&p->changed, &p->lock);
+            continue;
+        }
+        if (next->due_us > now_us()) {
+            wait_changed(p, next->due_us);
+            continue;
+        }
+        next->busy = 1;
+        pthread_mutex_unlock(&p->lock);
+        bool ended = false;
+        int ok = refresh(next, &ended);
+        pthread_mutex_lock(&p->lock);
+        next->busy = 0;
+        next->refreshes++;
+        if (!ok) next->failures++;
+        next->due_us = now_us() + p->interval_us;
+        // An ended playlist would only give the same picture again
+        if (ended || (p->rounds && next->refreshes >= p->rounds)) next->done = 1;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Compositor (main thread): tile every new thumbnail. Uploads are small,
+// so they run under the lock rather than on a copy.
+static void compose(preview_t *p, video_mosaic_t *out) {
+    for (;;) {
+        int live = 0, any = 0;
+        pthread_mutex_lock(&p->lock);
+        for (int i = 0; i < p->count; i++) {
+            preview_channel_t *c = &p->channels[i];
+            if (c->fresh) {
+                const preview_picture_t *pic = &c->thumb;
+                size_t luma = (size_t)pic->width * pic->height;
+                size_t chroma = (size_t)((pic->width + 1) / 2) * ((pic->height + 1) / 2);
+                video_mosaic_tile(out, i, pic->width, pic->height, pic->planes, pic->planes + luma,
+                                  pic->planes + luma + chroma, pic->width, (pic->width + 1) / 2);
+                c->fresh = 0;
+                any = 1;
+                metrics_count(METRIC_FRAMES_DISPLAYED, 1);
+            }
+            if (!c->done || c->busy) live = 1;
+        }
+        if (!any && live) wait_changed(p, now_us() + PREVIEW_IDLE_US);
+        pthread_mutex_unlock(&p->lock);
+        if (any) {
+            uint64_t draw_start = now_us();
+            video_mosaic_present(out);
+            metrics_record(METRIC_DRAW, now_us() - draw_start);
+        }
+        if (!live) break;
+        if (video_mosaic_poll(out)) break;
+    }
+}
+
+int preview_browse(const char *const *urls, int count, double interval) {
+    if (count > PREVIEW_MAX_CHANNELS) {
+        fprintf(stderr, "Preview: %d channels, only the first %d shown\n", count, PREVIEW_MAX_CHANNELS);
+        count = PREVIEW_MAX_CHANNELS;
+    }
+    int cols = 1;
+    while (cols * cols < count) cols++;
+    int rows = (count + cols - 1) / cols;
+    video_mosaic_t *out = video_mosaic_create(cols, rows);
+    if (!out) {
+        fprintf(stderr, "Preview: the video output cannot tile\n");
+        return -1;
+    }
+
+    preview_t *p = calloc(1, sizeof(*p));
+    if (!p) {
+        video_mosaic_destroy(out);
+        return -1;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->changed, NULL);
+    p->count = count;
+    p->interval_us = (uint64_t)(interval * 1000000.0);
+    video_mosaic_cell_size(out, &p->cell_width, &p->cell_height);
+    const char *rounds = getenv("ANHELO_PREVIEW_ROUNDS");
+    if (rounds && atol(rounds) > 0) p->rounds = (unsigned long)atol(rounds);
+    const char *gray = getenv("ANHELO_GRAY");
+    if (gray && strcmp(gray, "0") != 0) p->gray = DECODER_OUTPUT_GRAY;
+
+    // Every channel is due at once to begin with
+    uint64_t start = now_us();
+    int channels = 0;
+    for (int i = 0; i < count; i++) {
+        preview_channel_t *c = &p->channels[i];
+        c->preview = p;
+        c->index = i;
+        c->url = urls[i];
+        c->due_us = start;
+        c->demuxer = hls_demuxer_create();
+        if (c->demuxer) {
+            c->demuxer->timeshift_bytes = 0;
+            // The workers fetch alongside each other
+            c->demuxer->unpooled = true;
+            channels++;
+        } else {
+            c->done = 1;
+        }
+    }
+
+    const char *threads = getenv("ANHELO_PREVIEW_THREADS");
+    int workers = threads ? atoi(threads) : PREVIEW_WORKERS;
+    if (workers > channels) workers = channels;
+    if (workers < 1) workers = 1;
+    for (int i = 0; channels && i < workers; i++) {
+        if (pthread_create(&p->workers[p->worker_count], NULL, worker_thread, p) == 0) p->worker_count++;
+    }
+    printf("Preview: %d of %d channel(s) on a %dx%d grid, refreshed every %.1f s by %d worker(s)\n",
+           p->worker_count ? channels : 0, count, cols, rows, interval, p->worker_count);
+
+    if (p->worker_count) compose(p, out);
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->worker_count; i++) pthread_join(p->workers[i], NULL);
+
+    for (int i = 0; i < count; i++) {
+        preview_channel_t *c = &p->channels[i];
+        if (c->demuxer)
+            printf("Preview: channel %d: %lu refreshes, %lu without a picture\n", i + 1, c->refreshes, c->failures);
+        if (c->demuxer) hls_demuxer_destroy(c->demuxer);
+        nal_index_free(&c->nal);
+        free(c->boxes);
+        big_free(c->spare.planes);
+        big_free(c->thumb.planes);
+    }
+    int started = p->worker_count && channels;
+    video_mosaic_destroy(out);
+    pthread_cond_destroy(&p->changed);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+    return started ? 0 : -1;
+}
@@ -0,0 +1,100 @@
+// Picture queue between the decoding thread and the render thread. Each
+// slot of the ring holds a frame from the queue's pool; the slots are
+// handed over by an spsc_ring_t, so neither side ever takes a lock.
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/render_queue.h"
+#include "../include/memory_pool.h"
+#include "../include/spsc_ring.h"
+
+struct render_queue {
+    spsc_ring_t ring;
+    frame_pool_t *pool;         // A frame per slot
+    render_picture_t slots[RENDER_QUEUE_MAX];
+};
+
+render_queue_t *render_queue_create(int depth) {
+    if (depth < 1) depth = 1;
+    if (depth > RENDER_QUEUE_MAX) depth = RENDER_QUEUE_MAX;
+    render_queue_t *q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    q->pool = frame_pool_create(depth);
+    if (!q->pool) {
+        free(q);
+        return NULL;
+    }
+    spsc_ring_init(&q->ring, (unsigned)depth);
+    return q;
+}
+
+void render_queue_destroy(render_queue_t *q) {
+    if (!q) return;
+    // Pictures the consumer left in the queue
+    for (int i = 0; i < RENDER_QUEUE_MAX; i++) frame_unref(q->slots[i].frame);
+    frame_pool_destroy(q->pool);
+    spsc_ring_destroy(&q->ring);
+    free(q);
+}
+
+static void copy_plane(uint8_t *dst, int dst_stride, const uint8_t *src, int src_stride, int width, int height) {
+    for (int y = 0; y < height; y++) memcpy(dst + (size_t)y * dst_stride, src + (size_t)y * src_stride, (size_t)width);
+}
+
+int render_queue_push(render_queue_t *q, const decoder_picture_t *pic, int64_t pts, uint64_t *waited_us) {
+    int index = spsc_ring_reserve(&q->ring, waited_us);
+    if (index < 0) return -1;
+    // The pool lays the frame out again when the geometry changed
+    frame_t *frame = frame_pool_get(q->pool, FRAME_YUV420, pic->width, pic->height);
+    if (!frame) {
+        spsc_ring_cancel(&q->ring);
+        return -1;
+    }
+
+    render_picture_t *slot = &q->slots[index];
+    int chroma_width = (pic->width + 1) / 2, chroma_height = (pic->height + 1) / 2;
+    copy_plane(frame->planes[0], frame->strides[0], pic->y, pic->y_stride, pic->width, pic->height);
+    copy_plane(frame->planes[1], frame->strides[1], pic->u, pic->uv_stride, chroma_width, chroma_height);
+    copy_plane(frame->planes[2], frame->strides[2], pic->v, pic->uv_stride, chroma_width, chroma_height);
+    slot->frame = frame;
+    slot->pic.y = frame->planes[0];
+    slot->pic.u = frame->planes[1];
+    slot->pic.v = frame->planes[2];
+    slot->pic.width = pic->width;
+    slot->pic.height = pic->height;
+    slot->pic.y_stride = frame->strides[0];
+    slot->pic.uv_stride = frame->strides[1];
+    slot->pts = pts;
+
+    spsc_ring_publish(&q->ring);
+    return 0;
+}
+
+void render_queue_finish(render_queue_t *q) {
+    spsc_ring_finish(&q->ring);
+}
+
+render_picture_t *render_queue_peek(render_queue_t *q, int timeout_ms) {
+    int index = spsc_ring_peek(&q->ring, timeout_ms);
+    return index < 0 ? NULL : &q->slots[index];
+}
+
+void render_queue_pop(render_queue_t *q) {
+    int index = spsc_ring_peeked(&q->ring);
+    if (index < 0) return;
+    frame_unref(q->slots[index].frame);
+    q->slots[index].frame = NULL;
+    spsc_ring_pop(&q->ring);
+}
+
+int render_queue_finished(render_queue_t *q) {
+    return spsc_ring_finished(&q->ring);
+}
+
+void render_queue_close(render_queue_t *q) {
+    spsc_ring_close(&q->ring);
+}
+
+int render_queue_count(const render_queue_t *q) {
+    return (int)spsc_ring_count(&q->ring);
+}
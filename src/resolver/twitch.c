@@ -6,8 +6,25 @@
 #include <curl/curl.h>
 
 #include "../../include/twitch.h"
+#include "../../include/hls_demuxer.h"
+#include "../../include/net.h"
 
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+// Resolved URLs are cached on disk per channel until the access token
+// expires, so reopening a channel skips the GQL and usher round trips
+#define TWITCH_CACHE_MARGIN  60   // Seconds before expiry a cached token is dropped
+#define TWITCH_CACHE_TTL     600  // Assumed token lifetime when it carries no expiry
+
+typedef struct {
+    long expires;    // Unix time the access token stops working
+    char *master;    // Usher master playlist URL
+    char *variant;   // Rendition picked by twitch_resolve() (NULL if not yet)
+} twitch_cache_entry_t;
 
 struct mem { 
     char *data; 
@@ -15,6 +32,69 @@ struct mem {
     size_t capacity; 
 };
 
+// Pre-warm: open connections to the resolver hosts while the user is still
+// typing, so the GQL POST and usher fetch skip DNS and the TLS handshake.
+// The connections land in the process-wide share (net.h).
+static const char *const prewarm_urls[] = {
+    "https://gql.twitch.tv/",
+    "https://usher.ttvnw.net/",
+};
+static pthread_t prewarm_thread;
+static int prewarm_running = 0;
+
+static size_t discard_cb(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+    (void)ptr; (void)userp;
+    return size * nmemb;
+}
+
+static void *prewarm_main(void *arg)
+{
+    (void)arg;
+    CURLM *multi = curl_multi_init();
+    if (!multi) return NULL;
+    size_t n = sizeof(prewarm_urls) / sizeof(prewarm_urls[0]);
+    CURL *handles[sizeof(prewarm_urls) / sizeof(prewarm_urls[0])] = {0};
+    for (size_t i = 0; i < n; i++) {
+        handles[i] = net_easy_handle();
+        if (!handles[i]) continue;
+        curl_easy_setopt(handles[i], CURLOPT_URL, prewarm_urls[i]);
+        curl_easy_setopt(handles[i], CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION, discard_cb);
+        curl_easy_setopt(handles[i], CURLOPT_USERAGENT, "anhelo-twitch/1.0");
+        curl_easy_setopt(handles[i], CURLOPT_TIMEOUT, 3L);
+        curl_multi_add_handle(multi, handles[i]);
+    }
+    // Both hosts in parallel; the status codes do not matter
+    int running = 1;
+    while (running) {
+        if (curl_multi_perform(multi, &running) != CURLM_OK) break;
+        if (running) curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!handles[i]) continue;
+        curl_multi_remove_handle(multi, handles[i]);
+        curl_easy_cleanup(handles[i]);
+    }
+    curl_multi_cleanup(multi);
+    return NULL;
+}
+
+void twitch_prewarm(void)
+{
+    if (prewarm_running) return;
+    prewarm_running = pthread_create(&prewarm_thread, NULL, prewarm_main, NULL) == 0;
+}
+
+/* A connection still in its handshake cannot be reused, so the resolver
+ * waits for the pre-warm to land rather than racing it with a second one */
+void twitch_prewarm_wait(void)
+{
+    if (!prewarm_running) return;
+    pthread_join(prewarm_thread, NULL);
+    prewarm_running = 0;
+}
+
 static size_t write_cb(void *ptr, size_t size, size_t nmemb, void *userp)
 {
     size_t realsize = size * nmemb;
@@ -58,7 +138,8 @@ static size_t write_cb(void *ptr, size_t size, size_t nmemb, void *userp)
 static char *fetch_url_content(const char *url, long timeout_seconds)
 {
     if (!url) return NULL;
-    CURL *c = curl_easy_init();
+    twitch_prewarm_wait();
+    CURL *c = net_easy_handle();
     if (!c) return NULL;
     struct mem m = {0}; // Initialize all fields to 0
     curl_easy_setopt(c, CURLOPT_URL, url);
@@ -109,85 +190,25 @@ static char *resolve_relative(const char *base, const char *ref)
 static char *pick_lowest_variant_from_master(const char *master_content, const char *master_url)
 {
     if (!master_content) return NULL;
-    const char *p = master_content;
-    struct variant { char *uri; int bandwidth; int height; };
-    struct variant *list = NULL; size_t n = 0;
+    hls_playlist_t *master = hls_playlist_create();
+    if (!master) return NULL;
 
-    while (*p) {
-        const char *line_end = strchr(p, '\n');
-        size_t linelen = line_end ? (size_t)(line_end - p) : strlen(p);
-        
-        const char *ln = p;
-        while (*ln == ' ' || *ln == '\t') { ln++; linelen--; }
-        if (linelen >= 17 && strncmp(ln, "#EXT-X-STREAM-INF:", 17) == 0) {
-            
-            char *line = malloc(linelen + 1);
-            if (!line) break;
-            memcpy(line, ln, linelen);
-            line[linelen] = '\0';
-            int bw = 0, h = 0;
-            
-            char *bwpos = strstr(line, "BANDWIDTH=");
-            if (bwpos) bw = atoi(bwpos + strlen("BANDWIDTH="));
-            char *respos = strstr(line, "RESOLUTION=");
-            if (respos) {
-                respos += strlen("RESOLUTION=");
-                /* width is not used, so skip parsing it */
-                char *x = strchr(respos, 'x');
-                if (x) h = atoi(x+1);
-            }
-            free(line);
-            
-            const char *q = line_end ? line_end + 1 : NULL;
-            while (q && *q) {
-                
-                const char *le = strchr(q, '\n');
-                size_t l = le ? (size_t)(le - q) : strlen(q);
-                
-                const char *s = q; while (*s == ' ' || *s == '\t') s++, l--;
-                if (l > 0 && *s != '#') {
-                    
-                    char *uri = malloc(l+1);
-                    if (!uri) break;
-                    memcpy(uri, s, l);
-                    uri[l] = '\0';
-                    
-                    char *abs = resolve_relative(master_url, uri);
-                    free(uri);
-                    struct variant v = { abs, bw, h };
-                    struct variant *tmp = realloc(list, (n+1)*sizeof(*list));
-                    if (!tmp) { free(abs); break; }
-                    list = tmp; list[n++] = v;
-                    break;
-                }
-                q = le ? le + 1 : NULL;
+    char *chosen = NULL;
+    if (hls_parse_playlist_from_memory(NULL, master_content, strlen(master_content), NULL, master) == HLS_OK) {
+        /* Variants come sorted by bandwidth, so the first of the lowest
+         * height is also the cheapest; audio-only entries have no height */
+        const hls_variant_t *best = NULL;
+        int best_h = INT_MAX;
+        for (size_t i = 0; i < master->variant_count; i++) {
+            int h = master->variants[i].height ? master->variants[i].height : INT_MAX;
+            if (!best || h < best_h) {
+                best = &master->variants[i];
+                best_h = h;
             }
-            p = line_end ? line_end + 1 : p + linelen;
-            continue;
         }
-        p = line_end ? line_end + 1 : NULL;
-        if (!p) break;
-    }
-
-    if (n == 0) return NULL;
-    
-    int best_idx = 0;
-    for (size_t i = 1; i < n; i++) {
-        int h1 = list[i].height ? list[i].height : INT_MAX;
-        int h0 = list[best_idx].height ? list[best_idx].height : INT_MAX;
-        if (h1 < h0) best_idx = i;
-        else if (h1 == h0) {
-            
-            if (list[i].bandwidth && list[best_idx].bandwidth && list[i].bandwidth < list[best_idx].bandwidth) best_idx = i;
-        }
-    }
-    // Take ownership of the chosen URI instead of duplicating it.
-    char *chosen = list[best_idx].uri;
-
-    for (size_t i = 0; i < n; i++) {
-        if (i != (size_t)best_idx) free(list[i].uri);
+        if (best) chosen = resolve_relative(master_url, best->url);
     }
-    free(list);
+    hls_playlist_destroy(master);
     return chosen;
 }
 
@@ -236,23 +257,118 @@ static char *extract_quoted_after(const char *hay, const char *anchor, const cha
 
 
 
-char *twitch_resolve(const char *input)
+/* Channel login from a name or twitch.tv URL, lowercased; 0 if there is none */
+static int parse_channel(const char *input, char *channel, size_t size)
 {
-    if (!input) return NULL;
+    if (!input) return 0;
     const char *name = input;
     const char *p = strstr(input, "twitch.tv/");
     if (p) name = p + strlen("twitch.tv/");
 
-    
-    char channel[256] = {0};
     size_t i = 0;
-    for (; name[i] && i + 1 < sizeof(channel); i++) {
+    for (; name[i] && i + 1 < size; i++) {
         if (!isalnum((unsigned char)name[i]) && name[i] != '_' && name[i] != '-') break;
-        channel[i] = name[i];
+        channel[i] = (char)tolower((unsigned char)name[i]);
     }
     channel[i] = '\0';
-    if (i == 0) return NULL;
+    return i > 0;
+}
+
+/* $XDG_CACHE_HOME/anhelo/twitch-<channel>, falling back to ~/.cache.
+ * Creates the directory when `create` is set. */
+static int cache_path(const char *channel, int create, char *path, size_t size)
+{
+    char dir[PATH_MAX];
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg) snprintf(dir, sizeof(dir), "%s/anhelo", xdg);
+    else if (home && *home) snprintf(dir, sizeof(dir), "%s/.cache/anhelo", home);
+    else return 0;
+
+    if (create) {
+        if (!xdg || !*xdg) {
+            char parent[PATH_MAX];
+            snprintf(parent, sizeof(parent), "%s/.cache", home);
+            if (mkdir(parent, 0700) != 0 && errno != EEXIST) return 0;
+        }
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) return 0;
+    }
+    int n = snprintf(path, size, "%s/twitch-%s", dir, channel);
+    return n > 0 && (size_t)n < size;
+}
+
+static void cache_entry_free(twitch_cache_entry_t *e)
+{
+    free(e->master);
+    free(e->variant);
+    e->master = e->variant = NULL;
+}
+
+/* Read the channel's entry; fails when missing or about to expire.
+ * File format: one "key value" pair per line. */
+static int cache_load(const char *channel, twitch_cache_entry_t *e)
+{
+    memset(e, 0, sizeof(*e));
+    char path[PATH_MAX];
+    if (!cache_path(channel, 0, path, sizeof(path))) return 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *value = strchr(line, ' ');
+        if (!value) continue;
+        *value++ = '\0';
+        if (strcmp(line, "expires") == 0) e->expires = strtol(value, NULL, 10);
+        else if (strcmp(line, "master") == 0 && !e->master) e->master = strdup(value);
+        else if (strcmp(line, "variant") == 0 && !e->variant) e->variant = strdup(value);
+    }
+    fclose(f);
+
+    if (!e->master || e->expires - TWITCH_CACHE_MARGIN <= (long)time(NULL)) {
+        cache_entry_free(e);
+        return 0;
+    }
+    return 1;
+}
+
+/* Replace the channel's entry. Written to a temporary file and renamed so a
+ * concurrent reader never sees half of it; 0600 since it holds a token. */
+static void cache_store(const char *channel, const twitch_cache_entry_t *e)
+{
+    char path[PATH_MAX], tmp[PATH_MAX + 16];
+    if (!e->master || !cache_path(channel, 1, path, sizeof(path))) return;
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
 
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    chmod(tmp, 0600);
+    int ok = fprintf(f, "expires %ld\nmaster %s\n", e->expires, e->master) > 0;
+    if (ok && e->variant) ok = fprintf(f, "variant %s\n", e->variant) > 0;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) unlink(tmp);
+}
+
+void twitch_cache_forget(const char *input)
+{
+    char channel[256], path[PATH_MAX];
+    if (parse_channel(input, channel, sizeof(channel)) && cache_path(channel, 0, path, sizeof(path))) {
+        unlink(path);
+    }
+}
+
+/* The token value is itself JSON; its "expires" field is a Unix time */
+static long token_expiry(const char *token)
+{
+    const char *p = strstr(token, "\"expires\":");
+    long expires = p ? strtol(p + strlen("\"expires\":"), NULL, 10) : 0;
+    return expires > 0 ? expires : (long)time(NULL) + TWITCH_CACHE_TTL;
+}
+
+/* Fetch a fresh access token and build the usher master playlist URL */
+static char *request_master(const char *channel, long *expires)
+{
     
     const char *sha = "0828119ded1c13477966434e15800ff57ddacf13ba1911c129dc2200705b0712";
     char vars[512];
@@ -267,7 +383,8 @@ char *twitch_resolve(const char *input)
     
     
     struct mem m = {0}; // Initialize all fields including capacity
-    CURL *c = curl_easy_init();
+    twitch_prewarm_wait();
+    CURL *c = net_easy_handle();
     if (!c) return NULL;
     struct curl_slist *hdrs = NULL;
     const char *client_id = getenv("TWITCH_CLIENT_ID");
@@ -281,7 +398,6 @@ char *twitch_resolve(const char *input)
 #ifdef MINIMAL_MEMORY_BUFFERS
     // Add minimal headers for smaller requests
     hdrs = curl_slist_append(hdrs, "Accept-Encoding: gzip, deflate");
-    hdrs = curl_slist_append(hdrs, "Connection: close"); // Don't keep connections
 #endif
     
     curl_easy_setopt(c, CURLOPT_URL, "https://gql.twitch.tv/gql");
@@ -299,7 +415,6 @@ char *twitch_resolve(const char *input)
     curl_easy_setopt(c, CURLOPT_ACCEPT_ENCODING, ""); // Use compression
     curl_easy_setopt(c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0); // Simpler protocol
     curl_easy_setopt(c, CURLOPT_MAXCONNECTS, 1); // Limit connections
-    curl_easy_setopt(c, CURLOPT_FORBID_REUSE, 1L); // Don't reuse connections
 #endif
     
     CURLcode res = curl_easy_perform(c);
@@ -336,6 +451,7 @@ char *twitch_resolve(const char *input)
 
     free(m.data);
     if (!sig || !token) { free(sig); free(token); return NULL; }
+    *expires = token_expiry(token);
 
     
     c = curl_easy_init();
@@ -356,22 +472,61 @@ char *twitch_resolve(const char *input)
     snprintf(master, sizeof(master), "https://usher.ttvnw.net/api/channel/hls/%s.m3u8?player=twitchweb&token=%s&sig=%s&allow_source=true&allow_audio_only=true&type=any&p=0",
         channel, token_e, sig);
 
-    
-    char *master_content = fetch_url_content(master, 5L);
-    char *final_url = NULL;
-    if (master_content) {
-        char *variant = pick_lowest_variant_from_master(master_content, master);
-        if (variant) final_url = variant;
-        else final_url = strdup(master);
-        free(master_content);
-    } else {
-        final_url = strdup(master);
-    }
-
     if (token_e) {
         if (token_e_from_curl) curl_free(token_e);
         else free(token_e);
     }
     free(sig); free(token);
+    return strdup(master);
+}
+
+/* Build the usher master playlist URL for a channel, or NULL on failure */
+char *twitch_resolve_master(const char *input)
+{
+    char channel[256];
+    if (!parse_channel(input, channel, sizeof(channel))) return NULL;
+
+    twitch_cache_entry_t e;
+    if (cache_load(channel, &e)) {
+        char *master = e.master;
+        e.master = NULL;
+        cache_entry_free(&e);
+        return master;
+    }
+
+    e.master = request_master(channel, &e.expires);
+    char *master = e.master ? strdup(e.master) : NULL;
+    cache_store(channel, &e);
+    cache_entry_free(&e);
+    return master;
+}
+
+char *twitch_resolve(const char *input)
+{
+    char channel[256];
+    if (!parse_channel(input, channel, sizeof(channel))) return NULL;
+
+    twitch_cache_entry_t e;
+    if (!cache_load(channel, &e)) {
+        e.master = request_master(channel, &e.expires);
+        if (!e.master) return NULL;
+    } else if (e.variant) {
+        char *variant = e.variant;
+        e.variant = NULL;
+        cache_entry_free(&e);
+        return variant;
+    }
+
+    char *master_content = fetch_url_content(e.master, 5L);
+    char *final_url = NULL;
+    if (master_content) {
+        e.variant = pick_lowest_variant_from_master(master_content, e.master);
+        free(master_content);
+    }
+    // A failed usher fetch falls back to the master URL; the token is
+    // still good, so it is cached either way
+    cache_store(channel, &e);
+    final_url = strdup(e.variant ? e.variant : e.master);
+    cache_entry_free(&e);
     return final_url;
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+// Single-producer/single-consumer ring indices, see include/spsc_ring.h
+#include <errno.h>
+#include <time.h>
+
+#include "../include/spsc_ring.h"
+
+void spsc_ring_init(spsc_ring_t *r, unsigned depth) {
+    r->depth = depth;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->closed, 0);
+    sem_init(&r->free_slots, 0, depth);
+    sem_init(&r->ready, 0, 0);
+    r->peeked = 0;
+    r->ended = 0;
+}
+
+void spsc_ring_destroy(spsc_ring_t *r) {
+    sem_destroy(&r->ready);
+    sem_destroy(&r->free_slots);
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+int spsc_ring_reserve(spsc_ring_t *r, uint64_t *waited_us) {
+    if (atomic_load(&r->closed)) return -1;
+    uint64_t start = now_us();
+    while (sem_wait(&r->free_slots) != 0 && errno == EINTR) {}
+    if (atomic_load(&r->closed)) return -1;
+    if (waited_us) *waited_us += now_us() - start;
+    return (int)(atomic_load_explicit(&r->head, memory_order_relaxed) % r->depth);
+}
+
+void spsc_ring_cancel(spsc_ring_t *r) {
+    sem_post(&r->free_slots);
+}
+
+void spsc_ring_publish(spsc_ring_t *r) {
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    sem_post(&r->ready);
+}
+
+void spsc_ring_finish(spsc_ring_t *r) {
+    sem_post(&r->ready);
+}
+
+int spsc_ring_peek(spsc_ring_t *r, int timeout_ms) {
+    if (r->ended) return -1;
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (!r->peeked) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)timeout_ms * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        int got;
+        while ((got = sem_timedwait(&r->ready, &deadline)) != 0 && errno == EINTR) {}
+        if (got != 0) return -1;
+        // Slots are published before the finish: an empty ring now is the end
+        if (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+            r->ended = 1;
+            return -1;
+        }
+        r->peeked = 1;
+    }
+    return (int)(tail % r->depth);
+}
+
+int spsc_ring_peeked(const spsc_ring_t *r) {
+    return r->peeked ? (int)(atomic_load_explicit(&r->tail, memory_order_relaxed) % r->depth) : -1;
+}
+
+void spsc_ring_pop(spsc_ring_t *r) {
+    if (!r->peeked) return;
+    r->peeked = 0;
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    sem_post(&r->free_slots);
+}
+
+int spsc_ring_finished(const spsc_ring_t *r) {
+    return r->ended;
+}
+
+unsigned spsc_ring_count(const spsc_ring_t *r) {
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    return atomic_load_explicit(&r->head, memory_order_acquire) - tail;
+}
+
+void spsc_ring_close(spsc_ring_t *r) {
+    atomic_store(&r->closed, 1);
+    sem_post(&r->free_slots);
+}
@@ -0,0 +1,145 @@
+// Warm standby for channel switching, see include/standby.h. The lock
+// covers everything but the demuxer, which is the thread's.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../include/standby.h"
+
+struct standby {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;         // New target, or stopping
+    pthread_t thread;
+    const char *const *urls;
+    int count;
+    hls_demuxer_t *demuxer;
+    int target;                     // Channel to keep ready, -1 = none
+    int ready_channel;              // Channel `ready` is of, -1 = none
+    hls_primed_t ready;
+    int stop;
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Under the lock: wait for a change, at most `wait` microseconds
+static void wait_changed(standby_t *s, uint64_t wait) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)(wait % 1000000) * 1000;
+    deadline.tv_sec += (time_t)(wait / 1000000) + deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    pthread_cond_timedwait(&s->changed, &s->lock, &deadline);
+}
+
+// Until the live edge has moved on by a segment: a target duration, give
+// or take the time the segment took to come out
+static uint64_t refresh_us(const hls_primed_t *p) {
+    uint64_t us = (uint64_t)(p->target_duration * 1000000.0);
+    if (us < STANDBY_MIN_REFRESH_US) us = STANDBY_MIN_REFRESH_US;
+    if (us > STANDBY_MAX_REFRESH_US) us = STANDBY_MAX_REFRESH_US;
+    return us;
+}
+
+static void *standby_thread(void *arg) {
+    standby_t *s = arg;
+    pthread_mutex_lock(&s->lock);
+    while (!s->stop) {
+        int channel = s->target;
+        if (channel < 0) {
+            wait_changed(s, STANDBY_MAX_REFRESH_US);
+            continue;
+        }
+        pthread_mutex_unlock(&s->lock);
+        hls_primed_t primed = {0};
+        hls_error_t err = hls_prime(s->demuxer, s->urls[channel], &primed);
+        pthread_mutex_lock(&s->lock);
+        uint64_t wait = STANDBY_RETRY_US;
+        if (err == HLS_OK && s->target == channel) {
+            hls_primed_clear(&s->ready);
+            s->ready = primed;
+            s->ready_channel = channel;
+            wait = refresh_us(&primed);
+            // An ended playlist's segment stays the newest
+            if (primed.ended) wait = STANDBY_MAX_REFRESH_US;
+        } else {
+            if (err != HLS_OK) fprintf(stderr, "Standby: channel %d: %s\n", channel + 1, hls_get_error_string(err));
+            hls_primed_clear(&primed);
+        }
+        // A new target is fetched right away
+        if (s->target == channel && !s->stop) wait_changed(s, wait);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+standby_t *standby_create(const char *const *urls, int count) {
+    standby_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->urls = urls;
+    s->count = count;
+    s->target = -1;
+    s->ready_channel = -1;
+    s->demuxer = hls_demuxer_create();
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->changed, NULL);
+    if (s->demuxer) {
+        // Busy while the player's demuxer is
+        s->demuxer->unpooled = true;
+        if (pthread_create(&s->thread, NULL, standby_thread, s) == 0) return s;
+    }
+    hls_demuxer_destroy(s->demuxer);
+    pthread_cond_destroy(&s->changed);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    return NULL;
+}
+
+void standby_target(standby_t *s, int channel) {
+    if (!s) return;
+    if (channel >= s->count) channel = -1;
+    pthread_mutex_lock(&s->lock);
+    if (channel != s->target) {
+        s->target = channel;
+        pthread_cond_signal(&s->changed);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+int standby_take(standby_t *s, int channel, hls_primed_t *primed) {
+    if (!s) return 0;
+    pthread_mutex_lock(&s->lock);
+    int taken = 0;
+    if (s->ready_channel == channel && s->ready.data && !s->ready.ended) {
+        // Older than a target duration and a half, a newer segment is out
+        uint64_t age = now_us() - s->ready.fetched_us;
+        if (age < refresh_us(&s->ready) * 3 / 2) {
+            *primed = s->ready;
+            memset(&s->ready, 0, sizeof(s->ready));
+            taken = 1;
+        }
+    }
+    hls_primed_clear(&s->ready);
+    s->ready_channel = -1;
+    pthread_mutex_unlock(&s->lock);
+    return taken;
+}
+
+void standby_destroy(standby_t *s) {
+    if (!s) return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_signal(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+    hls_primed_clear(&s->ready);
+    hls_demuxer_destroy(s->demuxer);
+    pthread_cond_destroy(&s->changed);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
@@ -0,0 +1,305 @@
+// Event tracer, see include/trace.h. Each thread writes its own ring, the
+// flusher thread is their only reader, so a ring is a single-producer/
+// single-consumer queue of records. Rings are kept on a list that only
+// grows; the ring of a thread that exited is reused by the next one once
+// it has been drained.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../include/trace.h"
+
+typedef struct {
+    uint64_t time_us;
+    uint64_t b;
+    uint32_t a;
+    uint32_t event;
+} trace_record_t;
+
+typedef struct trace_ring {
+    atomic_uint head;           // Owner: records written
+    atomic_uint tail;           // Flusher: records written out
+    atomic_int owned;           // A live thread writes it
+    _Atomic uint64_t lost;      // Records dropped on a full ring
+    uint64_t lost_reported;     // Flusher
+    unsigned id;
+    char name[16];
+    struct trace_ring *next;
+    trace_record_t records[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+static const struct {
+    const char *name, *a, *b;
+    int b_hex;
+} event_info[TRACE_EVENTS] = {
+    [TRACE_NAL] = { "nal", "type", "bytes", 0 },
+    [TRACE_NAL_ERROR] = { "nal_error", "type", "bytes", 0 },
+    [TRACE_PARAM_SET] = { "param_set", "type", "head", 1 },
+    [TRACE_PES] = { "pes", "stream_type", "bytes", 0 },
+    [TRACE_SEGMENT] = { "segment", "number", "bytes", 0 },
+    [TRACE_LATENCY] = { "latency", "queued", "live_us", 0 },
+    [TRACE_SIMPLE_H264_NAL] = { "simple_h264_nal", "type", "bytes", 0 },
+    [TRACE_SIMPLE_H264_SPS] = { "simple_h264_sps", "width", "height", 0 },
+    [TRACE_SIMPLE_H264_ERROR] = { "simple_h264_error", "type", "value", 0 },
+    [TRACE_SIMPLE_H264_FRAME] = { "simple_h264_frame", "width", "height", 0 },
+};
+
+static atomic_int tracing = 0;
+static _Atomic(trace_ring_t *) rings = NULL;
+static atomic_uint ring_ids = 0;
+static __thread trace_ring_t *thread_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static int trace_fd = -1;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// The thread exited: its ring is free once drained
+static void ring_release(void *p) {
+    atomic_store(&((trace_ring_t *)p)->owned, 0);
+}
+
+static void make_key(void) {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+static trace_ring_t *ring_attach(void) {
+    pthread_once(&key_once, make_key);
+    trace_ring_t *r;
+    for (r = atomic_load(&rings); r; r = r->next) {
+        int unowned = 0;
+        if (atomic_load(&r->head) == atomic_load(&r->tail) &&
+            atomic_compare_exchange_strong(&r->owned, &unowned, 1))
+            break;
+    }
+    if (!r) {
+        if (!(r = calloc(1, sizeof(*r)))) return NULL;
+        atomic_init(&r->owned, 1);
+        r->id = atomic_fetch_add(&ring_ids, 1);
+        r->next = atomic_load(&rings);
+        while (!atomic_compare_exchange_weak(&rings, &r->next, r)) {}
+    }
+#ifdef __linux__
+    if (pthread_getname_np(pthread_self(), r->name, sizeof(r->name)) != 0)
+#endif
+        strcpy(r->name, "thread");
+    pthread_setspecific(ring_key, r);
+    thread_ring = r;
+    return r;
+}
+
+void trace_event(trace_event_t event, uint32_t a, uint64_t b) {
+    if (!atomic_load_explicit(&tracing, memory_order_relaxed)) return;
+    trace_ring_t *r = thread_ring;
+    if (!r && !(r = ring_attach())) return;
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) >= TRACE_RING_EVENTS) {
+        atomic_fetch_add_explicit(&r->lost, 1, memory_order_relaxed);
+        return;
+    }
+    trace_record_t *rec = &r->records[head % TRACE_RING_EVENTS];
+    rec->time_us = now_us();
+    rec->event = (uint32_t)event;
+    rec->a = a;
+    rec->b = b;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+// Text output, without stdio so the crash handler can use it too
+
+static char *put_str(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *put_dec(char *p, uint64_t v, int min_digits) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v || n < min_digits);
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+static char *put_hex(char *p, uint64_t v) {
+    p = put_str(p, "0x");
+    for (int shift = 60; shift >= 0; shift -= 4) *p++ = "0123456789abcdef"[(v >> shift) & 15];
+    return p;
+}
+
+// Longest line: a name of 15, three values of 20 digits and the labels
+#define TRACE_LINE_MAX 160
+
+// "<seconds>.<us> <thread>/<id> <event> <a>=.. <b>=..\n"
+static char *format_record(char *p, const trace_ring_t *r, const trace_record_t *rec) {
+    p = put_dec(p, rec->time_us / 1000000, 1);
+    *p++ = '.';
+    p = put_dec(p, rec->time_us % 1000000, 6);
+    *p++ = ' ';
+    p = put_str(p, r->name);
+    *p++ = '/';
+    p = put_dec(p, r->id, 1);
+    *p++ = ' ';
+    if (rec->event >= TRACE_EVENTS) return put_str(p, "?\n");
+    p = put_str(p, event_info[rec->event].name);
+    *p++ = ' ';
+    p = put_str(p, event_info[rec->event].a);
+    *p++ = '=';
+    p = put_dec(p, rec->a, 1);
+    *p++ = ' ';
+    p = put_str(p, event_info[rec->event].b);
+    *p++ = '=';
+    p = event_info[rec->event].b_hex ? put_hex(p, rec->b) : put_dec(p, rec->b, 1);
+    *p++ = '\n';
+    return p;
+}
+
+static void write_all(const char *buf, size_t len) {
+    while (len) {
+        ssize_t n = write(trace_fd, buf, len);
+        if (n <= 0) return;
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+// Write out every record the rings hold, in buf
+static void drain(char *buf, size_t size) {
+    for (trace_ring_t *r = atomic_load(&rings); r; r = r->next) {
+        unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+        char *p = buf;
+        for (; tail != head; tail++) {
+            if ((size_t)(p - buf) > size - TRACE_LINE_MAX) {
+                write_all(buf, (size_t)(p - buf));
+                p = buf;
+            }
+            p = format_record(p, r, &r->records[tail % TRACE_RING_EVENTS]);
+        }
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+        uint64_t lost = atomic_load_explicit(&r->lost, memory_order_relaxed);
+        if (lost != r->lost_reported) {
+            if ((size_t)(p - buf) > size - TRACE_LINE_MAX) {
+                write_all(buf, (size_t)(p - buf));
+                p = buf;
+            }
+            p = put_str(p, "trace: ");
+            p = put_str(p, r->name);
+            *p++ = '/';
+            p = put_dec(p, r->id, 1);
+            p = put_str(p, " lost ");
+            p = put_dec(p, lost - r->lost_reported, 1);
+            p = put_str(p, " event(s)\n");
+            r->lost_reported = lost;
+        }
+        write_all(buf, (size_t)(p - buf));
+    }
+}
+
+// Flusher thread
+
+static pthread_t flush_thread;
+static int flushing = 0;
+static int flush_stop = 0;
+static pthread_mutex_t flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond;
+
+static void *flush_worker(void *arg) {
+    (void)arg;
+    static char buf[64 * 1024];
+    pthread_mutex_lock(&flush_mutex);
+    while (!flush_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += TRACE_FLUSH_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&flush_cond, &flush_mutex, &deadline);
+        pthread_mutex_unlock(&flush_mutex);
+        drain(buf, sizeof(buf));
+        pthread_mutex_lock(&flush_mutex);
+    }
+    pthread_mutex_unlock(&flush_mutex);
+    drain(buf, sizeof(buf));
+    return NULL;
+}
+
+// Crash: write what the rings hold (racing the flusher at worst, which
+// may repeat a few lines), then die of the signal as before
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+static void crash_handler(int sig) {
+    static char buf[4096];
+    atomic_store(&tracing, 0);
+    drain(buf, sizeof(buf));
+    char *p = put_str(buf, "trace: signal ");
+    p = put_dec(p, (uint64_t)sig, 1);
+    *p++ = '\n';
+    write_all(buf, (size_t)(p - buf));
+    raise(sig);
+}
+
+void trace_start(void) {
+    if (TRACE_LEVEL == 0) return;
+    const char *target = getenv("ANHELO_TRACE");
+    if (flushing || (target && strcmp(target, "0") == 0)) return;
+    if (target && *target) {
+        trace_fd = open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (trace_fd < 0) {
+            perror("Trace: cannot open ANHELO_TRACE file");
+            return;
+        }
+    } else {
+        trace_fd = STDERR_FILENO;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&flush_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    flush_stop = 0;
+    if (pthread_create(&flush_thread, NULL, flush_worker, NULL) != 0) {
+        pthread_cond_destroy(&flush_cond);
+        if (trace_fd != STDERR_FILENO) close(trace_fd);
+        trace_fd = -1;
+        return;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = crash_handler;
+    sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+        sigaction(crash_signals[i], &sa, NULL);
+    flushing = 1;
+    atomic_store(&tracing, 1);
+}
+
+void trace_stop(void) {
+    if (!flushing) return;
+    atomic_store(&tracing, 0);
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+        signal(crash_signals[i], SIG_DFL);
+    pthread_mutex_lock(&flush_mutex);
+    flush_stop = 1;
+    pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&flush_mutex);
+    pthread_join(flush_thread, NULL);
+    pthread_cond_destroy(&flush_cond);
+    if (trace_fd != STDERR_FILENO) close(trace_fd);
+    trace_fd = -1;
+    flushing = 0;
+}